@@ -260,6 +260,34 @@ static void hvf_set_dirty_tracking(MemoryRegionSection *section, bool on)
     }
 }
 
+/*
+ * Handle a write to a page that was write-protected for dirty logging.
+ * Only the faulting host page is marked dirty and made writable again,
+ * so further writes to it run at full speed until the next log sync
+ * write-protects the whole slot in one go.  Returns true if the fault
+ * was caused by dirty logging and the access can simply be retried.
+ */
+bool hvf_dirty_log_write_fault(uint64_t gpa)
+{
+    uint64_t page_size = qemu_real_host_page_size();
+    uint64_t page = QEMU_ALIGN_DOWN(gpa, page_size);
+    uint8_t *region_ptr;
+    hvf_slot *slot;
+
+    slot = hvf_find_overlap_slot(gpa, 1);
+    if (!slot || !(slot->flags & HVF_SLOT_LOG)) {
+        return false;
+    }
+
+    region_ptr = memory_region_get_ram_ptr(slot->region);
+    memory_region_set_dirty(slot->region,
+                            slot->mem - region_ptr + (page - slot->start),
+                            page_size);
+    hv_vm_protect(page, page_size,
+                  HV_MEMORY_READ | HV_MEMORY_WRITE | HV_MEMORY_EXEC);
+    return true;
+}
+
 static void hvf_log_start(MemoryListener *listener,
                           MemoryRegionSection *section, int old, int new)
 {
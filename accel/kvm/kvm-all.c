@@ -37,6 +37,7 @@
 #include "exec/ram_addr.h"
 #include "qemu/event_notifier.h"
 #include "qemu/main-loop.h"
+#include "qemu/lockable.h"
 #include "trace.h"
 #include "hw/irq.h"
 #include "qapi/visitor.h"
@@ -400,6 +401,7 @@ int kvm_init_vcpu(CPUState *cpu, Error **errp)
     cpu->kvm_state = s;
     cpu->vcpu_dirty = true;
     cpu->dirty_pages = 0;
+    cpu->dirty_ring_full_exits = 0;
     cpu->throttle_us_per_full = 0;
 
     mmap_size = kvm_ioctl(s, KVM_GET_VCPU_MMAP_SIZE, 0);
@@ -742,8 +744,9 @@ static uint64_t kvm_dirty_ring_reap_locked(KVMState *s, CPUState* cpu)
 }
 
 /*
- * Currently for simplicity, we must hold BQL before calling this.  We can
- * consider to drop the BQL if we're clear with all the race conditions.
+ * Currently for simplicity, we must hold BQL before calling this to reap
+ * all vCPUs, as the vCPU rings may otherwise be unmapped under our feet.
+ * A vCPU thread may reap its own ring without the BQL.
  */
 static uint64_t kvm_dirty_ring_reap(KVMState *s, CPUState *cpu)
 {
@@ -1366,6 +1369,18 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
     } while (size);
 }
 
+#define KVM_DIRTY_RING_REAPER_MIN_MS 10
+#define KVM_DIRTY_RING_REAPER_MAX_MS 1000
+
+/*
+ * Called by a vCPU whose dirty ring is full.  The vCPU only harvests its
+ * own ring; the reaper drains the others before they fill up too.
+ */
+static void kvm_dirty_ring_reaper_kick(KVMState *s)
+{
+    qemu_sem_post(&s->reaper.reaper_sem);
+}
+
 static void *kvm_dirty_ring_reaper_thread(void *data)
 {
     KVMState *s = data;
@@ -1378,10 +1393,25 @@ static void *kvm_dirty_ring_reaper_thread(void *data)
     while (true) {
         r->reaper_state = KVM_DIRTY_RING_REAPER_WAIT;
         trace_kvm_dirty_ring_reaper("wait");
+
         /*
-         * TODO: provide a smarter timeout rather than a constant?
+         * Rings filling up between two iterations means the reaper is not
+         * keeping up, so run more often.  Back off again once they stop.
          */
-        sleep(1);
+        if (qemu_sem_timedwait(&r->reaper_sem, r->reaper_interval_ms) == 0) {
+            while (qemu_sem_timedwait(&r->reaper_sem, 0) == 0) {
+                /* Coalesce kicks from several vCPUs */
+            }
+            r->reaper_interval_ms = MAX(r->reaper_interval_ms / 2,
+                                        KVM_DIRTY_RING_REAPER_MIN_MS);
+            trace_kvm_dirty_ring_reaper_kick("ring full",
+                                             r->reaper_interval_ms);
+        } else if (r->reaper_interval_ms < KVM_DIRTY_RING_REAPER_MAX_MS) {
+            r->reaper_interval_ms = MIN(r->reaper_interval_ms * 2,
+                                        KVM_DIRTY_RING_REAPER_MAX_MS);
+            trace_kvm_dirty_ring_reaper_kick("timeout",
+                                             r->reaper_interval_ms);
+        }
 
         /* keep sleeping so that dirtylimit not be interfered by reaper */
         if (dirtylimit_in_service()) {
@@ -1409,6 +1439,8 @@ static void kvm_dirty_ring_reaper_init(KVMState *s)
 {
     struct KVMDirtyRingReaper *r = &s->reaper;
 
+    qemu_sem_init(&r->reaper_sem, 0);
+    r->reaper_interval_ms = KVM_DIRTY_RING_REAPER_MAX_MS;
     qemu_thread_create(&r->reaper_thr, "kvm-reaper",
                        kvm_dirty_ring_reaper_thread,
                        s, QEMU_THREAD_JOINABLE);
@@ -2586,8 +2618,9 @@ static int kvm_init(MachineState *ms)
     }
 
     if (kvm_check_extension(kvm_state, KVM_CAP_BINARY_STATS_FD)) {
-        add_stats_callbacks(STATS_PROVIDER_KVM, query_stats_cb,
-                            query_stats_schemas_cb);
+        qemu_mutex_init(&stats_descriptors_lock);
+        add_stats_callbacks_thread_safe(STATS_PROVIDER_KVM, query_stats_cb,
+                                        query_stats_schemas_cb);
     }
 
     return 0;
@@ -2926,20 +2959,20 @@ int kvm_cpu_exec(CPUState *cpu)
              * We shouldn't continue if the dirty ring of this vcpu is
              * still full.  Got kicked by KVM_RESET_DIRTY_RINGS.
              */
-            trace_kvm_dirty_ring_full(cpu->cpu_index);
-            bql_lock();
+            cpu->dirty_ring_full_exits++;
+            trace_kvm_dirty_ring_full(cpu->cpu_index,
+                                      cpu->dirty_ring_full_exits);
             /*
-             * We throttle vCPU by making it sleep once it exit from kernel
-             * due to dirty ring full. In the dirtylimit scenario, reaping
-             * all vCPUs after a single vCPU dirty ring get full result in
-             * the miss of sleep, so just reap the ring-fulled vCPU.
+             * Only reap the ring that is full, so that the vCPU does not
+             * stall for as long as it takes to walk all the other rings.
+             * That is left to the reaper, which is kicked to do it before
+             * more rings fill up.  In the dirtylimit scenario the vCPU is
+             * throttled by sleeping below, and the reaper stays idle.
              */
-            if (dirtylimit_in_service()) {
-                kvm_dirty_ring_reap(kvm_state, cpu);
-            } else {
-                kvm_dirty_ring_reap(kvm_state, NULL);
+            kvm_dirty_ring_reap(kvm_state, cpu);
+            if (!dirtylimit_in_service()) {
+                kvm_dirty_ring_reaper_kick(kvm_state);
             }
-            bql_unlock();
             dirtylimit_vcpu_execute(cpu);
             ret = 0;
             break;
@@ -3845,6 +3878,9 @@ typedef struct StatsDescriptors {
 static QTAILQ_HEAD(, StatsDescriptors) stats_descriptors =
     QTAILQ_HEAD_INITIALIZER(stats_descriptors);
 
+/* query-stats can run out-of-band, outside the BQL */
+static QemuMutex stats_descriptors_lock;
+
 /*
  * Return the descriptors for 'target', that either have already been read
  * or are retrieved from 'stats_fd'.
@@ -3859,6 +3895,7 @@ static StatsDescriptors *find_stats_descriptors(StatsTarget target, int stats_fd
     size_t size_desc;
     ssize_t ret;
 
+    QEMU_LOCK_GUARD(&stats_descriptors_lock);
     ident = StatsTarget_str(target);
     QTAILQ_FOREACH(descriptors, &stats_descriptors, next) {
         if (g_str_equal(descriptors->ident, ident)) {
@@ -4051,6 +4088,8 @@ static void query_stats_cb(StatsResultList **result, StatsTarget target,
         stats_args.result.stats = result;
         stats_args.names = names;
         stats_args.errp = errp;
+        /* Keep vCPUs from being unplugged while outside the BQL */
+        QEMU_LOCK_GUARD(&qemu_cpu_list_lock);
         CPU_FOREACH(cpu) {
             if (!apply_str_list_filter(cpu->parent_obj.canonical_path, targets)) {
                 continue;
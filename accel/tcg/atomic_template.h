@@ -59,6 +59,73 @@
 # define ABI_TYPE  uint32_t
 #endif
 
+#if DATA_SIZE > 1 && DATA_SIZE < 16
+/*
+ * Compare-and-swap of an unaligned value, by a compare-and-swap of the
+ * enclosing block.  Like a host cmpxchg, this always writes the block.
+ */
+static DATA_TYPE glue(atomic_unaligned_cmpxchg_, SUFFIX)(void *haddr,
+                                                        DATA_TYPE cmpv,
+                                                        DATA_TYPE newv)
+{
+    int bsize = atomic_unaligned_block_size((uintptr_t)haddr, DATA_SIZE);
+    uintptr_t ofs = (uintptr_t)haddr & (bsize - 1);
+    void *block = haddr - ofs;
+    AtomicBlock cur, new;
+    DATA_TYPE old;
+
+    memcpy(&cur, block, bsize);
+    do {
+        memcpy(&old, cur.b + ofs, DATA_SIZE);
+        new = cur;
+        if (old == cmpv) {
+            memcpy(new.b + ofs, &newv, DATA_SIZE);
+        }
+    } while (!atomic_block_cmpxchg(block, bsize, &cur, &new));
+    return old;
+}
+
+/*
+ * Load and compare-and-swap for the loops below, which also accept
+ * the unaligned host addresses allowed by atomic_mmu_lookup.
+ */
+# define ATOMIC_ALIGNED(P)  QEMU_PTR_IS_ALIGNED(P, DATA_SIZE)
+# define ATOMIC_LOAD(P)                                             \
+    (ATOMIC_ALIGNED(P) ? qatomic_read__nocheck(P) : ({              \
+        typeof(*(P)) val_;                                          \
+        memcpy(&val_, P, DATA_SIZE);                                \
+        val_;                                                       \
+    }))
+# define ATOMIC_CMPXCHG(P, C, N)                                    \
+    (ATOMIC_ALIGNED(P) ? qatomic_cmpxchg__nocheck(P, C, N) :        \
+     (typeof(*(P)))glue(atomic_unaligned_cmpxchg_, SUFFIX)(P, C, N))
+#else
+# define ATOMIC_ALIGNED(P)  true
+# define ATOMIC_LOAD(P)     qatomic_read__nocheck(P)
+# define ATOMIC_CMPXCHG(P, C, N)  qatomic_cmpxchg__nocheck(P, C, N)
+#endif
+
+/*
+ * The loop for operations on unaligned addresses that have a direct
+ * host equivalent otherwise.  FN computes the new memory value.
+ */
+#define ATOMIC_RMW(P, FN, VAL, OLD, NEW)                            \
+    do {                                                            \
+        DATA_TYPE cmp_;                                             \
+        smp_mb();                                                   \
+        cmp_ = ATOMIC_LOAD(P);                                      \
+        do {                                                        \
+            OLD = cmp_; NEW = FN(OLD, VAL);                         \
+            cmp_ = ATOMIC_CMPXCHG(P, OLD, NEW);                     \
+        } while (cmp_ != OLD);                                      \
+    } while (0)
+
+#define XCHG(X, Y)  (Y)
+#define ADD(X, Y)   (X + Y)
+#define AND(X, Y)   (X & Y)
+#define OR(X, Y)    (X | Y)
+#define XOR(X, Y)   (X ^ Y)
+
 /* Define host-endian atomic operations.  Note that END is used within
    the ATOMIC_NAME macro, and redefined below.  */
 #if DATA_SIZE == 1
@@ -80,7 +147,7 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, abi_ptr addr,
 #if DATA_SIZE == 16
     ret = atomic16_cmpxchg(haddr, cmpv, newv);
 #else
-    ret = qatomic_cmpxchg__nocheck(haddr, cmpv, newv);
+    ret = ATOMIC_CMPXCHG(haddr, cmpv, newv);
 #endif
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
@@ -93,34 +160,43 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
 {
     DATA_TYPE *haddr = atomic_mmu_lookup(env_cpu(env), addr, oi,
                                          DATA_SIZE, retaddr);
-    DATA_TYPE ret;
+    DATA_TYPE ret, new;
 
-    ret = qatomic_xchg__nocheck(haddr, val);
+    if (likely(ATOMIC_ALIGNED(haddr))) {
+        ret = qatomic_xchg__nocheck(haddr, val);
+    } else {
+        ATOMIC_RMW(haddr, XCHG, val, ret, new);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
     return ret;
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+#define GEN_ATOMIC_HELPER(X, FN, RET)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
-    DATA_TYPE *haddr, ret;                                          \
+    DATA_TYPE *haddr, ret, old, new;                                \
     haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
-    ret = qatomic_##X(haddr, val);                                  \
+    if (likely(ATOMIC_ALIGNED(haddr))) {                            \
+        ret = qatomic_##X(haddr, val);                              \
+    } else {                                                        \
+        ATOMIC_RMW(haddr, FN, val, old, new);                       \
+        ret = RET;                                                  \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
     return ret;                                                     \
 }
 
-GEN_ATOMIC_HELPER(fetch_add)
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(add_fetch)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+GEN_ATOMIC_HELPER(fetch_add, ADD, old)
+GEN_ATOMIC_HELPER(fetch_and, AND, old)
+GEN_ATOMIC_HELPER(fetch_or, OR, old)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, old)
+GEN_ATOMIC_HELPER(add_fetch, ADD, new)
+GEN_ATOMIC_HELPER(and_fetch, AND, new)
+GEN_ATOMIC_HELPER(or_fetch, OR, new)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, new)
 
 #undef GEN_ATOMIC_HELPER
 
@@ -139,10 +215,10 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     XDATA_TYPE *haddr, cmp, old, new, val = xval;                   \
     haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
     smp_mb();                                                       \
-    cmp = qatomic_read__nocheck(haddr);                             \
+    cmp = ATOMIC_LOAD(haddr);                                       \
     do {                                                            \
         old = cmp; new = FN(old, val);                              \
-        cmp = qatomic_cmpxchg__nocheck(haddr, old, new);            \
+        cmp = ATOMIC_CMPXCHG(haddr, old, new);                      \
     } while (cmp != old);                                           \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
@@ -185,7 +261,7 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, abi_ptr addr,
 #if DATA_SIZE == 16
     ret = atomic16_cmpxchg(haddr, BSWAP(cmpv), BSWAP(newv));
 #else
-    ret = qatomic_cmpxchg__nocheck(haddr, BSWAP(cmpv), BSWAP(newv));
+    ret = ATOMIC_CMPXCHG(haddr, BSWAP(cmpv), BSWAP(newv));
 #endif
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
@@ -198,32 +274,41 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
 {
     DATA_TYPE *haddr = atomic_mmu_lookup(env_cpu(env), addr, oi,
                                          DATA_SIZE, retaddr);
-    ABI_TYPE ret;
+    DATA_TYPE ret, new;
 
-    ret = qatomic_xchg__nocheck(haddr, BSWAP(val));
+    if (likely(ATOMIC_ALIGNED(haddr))) {
+        ret = qatomic_xchg__nocheck(haddr, BSWAP(val));
+    } else {
+        ATOMIC_RMW(haddr, XCHG, BSWAP(val), ret, new);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
     return BSWAP(ret);
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+#define GEN_ATOMIC_HELPER(X, FN, RET)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
-    DATA_TYPE *haddr, ret;                                          \
+    DATA_TYPE *haddr, ret, old, new;                                \
     haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
-    ret = qatomic_##X(haddr, BSWAP(val));                           \
+    if (likely(ATOMIC_ALIGNED(haddr))) {                            \
+        ret = qatomic_##X(haddr, BSWAP(val));                       \
+    } else {                                                        \
+        ATOMIC_RMW(haddr, FN, BSWAP(val), old, new);                \
+        ret = RET;                                                  \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
     return BSWAP(ret);                                              \
 }
 
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+GEN_ATOMIC_HELPER(fetch_and, AND, old)
+GEN_ATOMIC_HELPER(fetch_or, OR, old)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, old)
+GEN_ATOMIC_HELPER(and_fetch, AND, new)
+GEN_ATOMIC_HELPER(or_fetch, OR, new)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, new)
 
 #undef GEN_ATOMIC_HELPER
 
@@ -241,10 +326,10 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     XDATA_TYPE *haddr, ldo, ldn, old, new, val = xval;              \
     haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
     smp_mb();                                                       \
-    ldn = qatomic_read__nocheck(haddr);                             \
+    ldn = ATOMIC_LOAD(haddr);                                       \
     do {                                                            \
         ldo = ldn; old = BSWAP(ldo); new = FN(old, val);            \
-        ldn = qatomic_cmpxchg__nocheck(haddr, ldo, BSWAP(new));     \
+        ldn = ATOMIC_CMPXCHG(haddr, ldo, BSWAP(new));               \
     } while (ldo != ldn);                                           \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
@@ -263,10 +348,8 @@ GEN_ATOMIC_HELPER_FN(umax_fetch, MAX,  DATA_TYPE, new)
 
 /* Note that for addition, we need to use a separate cmpxchg loop instead
    of bswaps for the reverse-host-endian helpers.  */
-#define ADD(X, Y)   (X + Y)
 GEN_ATOMIC_HELPER_FN(fetch_add, ADD, DATA_TYPE, old)
 GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new)
-#undef ADD
 
 #undef GEN_ATOMIC_HELPER_FN
 #endif /* DATA_SIZE < 16 */
@@ -274,6 +357,15 @@ GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new)
 #undef END
 #endif /* DATA_SIZE > 1 */
 
+#undef ATOMIC_ALIGNED
+#undef ATOMIC_LOAD
+#undef ATOMIC_CMPXCHG
+#undef ATOMIC_RMW
+#undef XCHG
+#undef ADD
+#undef AND
+#undef OR
+#undef XOR
 #undef BSWAP
 #undef ABI_TYPE
 #undef DATA_TYPE
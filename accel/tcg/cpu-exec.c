@@ -235,6 +235,91 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+static inline bool tb_jmp_cache_match(const CPUJumpCacheEntry *e,
+                                      TranslationBlock *tb, vaddr pc,
+                                      uint64_t cs_base, uint32_t flags,
+                                      uint32_t cflags)
+{
+    return (tb &&
+            e->pc == pc &&
+            tb->cs_base == cs_base &&
+            tb->flags == flags &&
+            tb_cflags(tb) == cflags);
+}
+
+/*
+ * Install @tb for @pc in the direct-mapped slot @hash, pushing the
+ * previous occupant, if any, into the victim set for that slot.
+ */
+static void tb_jmp_cache_insert(CPUJumpCache *jc, uint32_t hash,
+                                vaddr pc, TranslationBlock *tb)
+{
+    CPUJumpCacheEntry *e = &jc->array[hash];
+    TranslationBlock *old = qatomic_read(&e->tb);
+
+    if (old && old != tb) {
+        unsigned set = tb_jmp_victim_set(hash);
+        unsigned way = jc->victim_next[set];
+        CPUJumpCacheEntry *v = &jc->victim[set][way];
+
+        jc->victim_next[set] = (way + 1) % TB_JMP_VICTIM_WAYS;
+        v->pc = e->pc;
+        qatomic_set(&v->tb, old);
+    }
+
+    e->pc = pc;
+    qatomic_set(&e->tb, tb);
+}
+
+/*
+ * Look for @pc in the victim set for @hash.  On a hit, the entry is
+ * swapped with the current occupant of the direct-mapped slot.
+ */
+static TranslationBlock *tb_jmp_victim_lookup(CPUJumpCache *jc, uint32_t hash,
+                                              vaddr pc, uint64_t cs_base,
+                                              uint32_t flags, uint32_t cflags)
+{
+    unsigned set = tb_jmp_victim_set(hash);
+
+    for (int way = 0; way < TB_JMP_VICTIM_WAYS; way++) {
+        CPUJumpCacheEntry *v = &jc->victim[set][way];
+        TranslationBlock *tb = qatomic_read(&v->tb);
+
+        if (tb_jmp_cache_match(v, tb, pc, cs_base, flags, cflags)) {
+            CPUJumpCacheEntry *e = &jc->array[hash];
+
+            /*
+             * A concurrent invalidation may clear either entry while
+             * we swap them; a stale TB copied here is harmless since
+             * it has CF_INVALID set and will never match again.
+             */
+            v->pc = e->pc;
+            qatomic_set(&v->tb, qatomic_read(&e->tb));
+            e->pc = pc;
+            qatomic_set(&e->tb, tb);
+            return tb;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Discard the jump cache if a tb_flush() happened since it was last
+ * cleared.  This must be called before the first tb_lookup() on each
+ * entry to the execution loop; a flush cannot happen while the cpu is
+ * running, other than from its own thread, which resynchronizes itself.
+ */
+static inline void tb_jmp_cache_sync(CPUState *cpu)
+{
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    unsigned count = qatomic_read(&tb_ctx.tb_flush_count);
+
+    if (unlikely(jc->tb_flush_count != count)) {
+        tcg_flush_jmp_cache(cpu);
+        jc->tb_flush_count = count;
+    }
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
                                           uint64_t cs_base, uint32_t flags,
@@ -247,25 +332,29 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
     jc = cpu->tb_jmp_cache;
+    hash = tb_jmp_cache_hash_func(jc->bits, pc);
 
     tb = qatomic_read(&jc->array[hash].tb);
-    if (likely(tb &&
-               jc->array[hash].pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb_cflags(tb) == cflags)) {
+    if (likely(tb_jmp_cache_match(&jc->array[hash], tb, pc,
+                                  cs_base, flags, cflags))) {
+        qatomic_set(&jc->stats.hits, jc->stats.hits + 1);
         goto hit;
     }
 
+    tb = tb_jmp_victim_lookup(jc, hash, pc, cs_base, flags, cflags);
+    if (tb) {
+        qatomic_set(&jc->stats.victim_hits, jc->stats.victim_hits + 1);
+        goto hit;
+    }
+
+    qatomic_set(&jc->stats.misses, jc->stats.misses + 1);
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
 
-    jc->array[hash].pc = pc;
-    qatomic_set(&jc->array[hash].tb, tb);
+    tb_jmp_cache_insert(jc, hash, pc, tb);
 
 hit:
     /*
@@ -276,6 +365,22 @@ hit:
     return tb;
 }
 
+/*
+ * Account one non-chained entry into @tb at @pc, and report it once
+ * when it crosses the hotness threshold.
+ */
+static inline void tb_note_exec(TranslationBlock *tb, vaddr pc)
+{
+    if (unlikely(tb_hot_threshold)) {
+        uint32_t n = qatomic_read(&tb->exec_count) + 1;
+
+        qatomic_set(&tb->exec_count, n);
+        if (unlikely(n == tb_hot_threshold)) {
+            trace_exec_tb_hot(tb, pc, n);
+        }
+    }
+}
+
 static void log_cpu_exec(vaddr pc, CPUState *cpu,
                          const TranslationBlock *tb)
 {
@@ -407,6 +512,7 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     if (tb == NULL) {
         return tcg_code_gen_epilogue;
     }
+    tb_note_exec(tb, pc);
 
     if (qemu_loglevel_mask(CPU_LOG_TB_CPU | CPU_LOG_EXEC)) {
         log_cpu_exec(pc, cpu, tb);
@@ -564,6 +670,7 @@ void cpu_exec_step_atomic(CPUState *cpu)
         cpu->running = true;
 
         cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+        tb_jmp_cache_sync(cpu);
 
         cflags = curr_cflags(cpu);
         /* Execute in a serial context. */
@@ -976,7 +1083,6 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
             tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
             if (tb == NULL) {
                 CPUJumpCache *jc;
-                uint32_t h;
 
                 mmap_lock();
                 tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
@@ -986,10 +1092,9 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(pc);
                 jc = cpu->tb_jmp_cache;
-                jc->array[h].pc = pc;
-                qatomic_set(&jc->array[h].tb, tb);
+                tb_jmp_cache_insert(jc, tb_jmp_cache_hash_func(jc->bits, pc),
+                                    pc, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -1007,6 +1112,7 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
             if (last_tb) {
                 tb_add_jump(last_tb, tb_exit, tb);
             }
+            tb_note_exec(tb, pc);
 
             cpu_loop_exec_tb(cpu, tb, pc, &last_tb, &tb_exit);
 
@@ -1042,6 +1148,7 @@ int cpu_exec(CPUState *cpu)
 
     RCU_READ_LOCK_GUARD();
     cpu_exec_enter(cpu);
+    tb_jmp_cache_sync(cpu);
 
     /*
      * Calculate difference between guest clock and host clock.
@@ -1066,7 +1173,11 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
 
-    cpu->tb_jmp_cache = g_new0(CPUJumpCache, 1);
+    cpu->tb_jmp_cache = g_malloc0(sizeof(CPUJumpCache) +
+                                  sizeof(CPUJumpCacheEntry) *
+                                  ((size_t)1 << tb_jmp_cache_bits));
+    cpu->tb_jmp_cache->bits = tb_jmp_cache_bits;
+    cpu->tb_jmp_cache->tb_flush_count = qatomic_read(&tb_ctx.tb_flush_count);
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
@@ -29,6 +29,8 @@
 #include "exec/ram_addr.h"
 #include "tcg/tcg.h"
 #include "qemu/error-report.h"
+#include "qemu/range.h"
+#include "qemu/stats-counter.h"
 #include "exec/log.h"
 #include "exec/helper-proto-common.h"
 #include "qemu/atomic.h"
@@ -60,6 +62,8 @@
 # define DEBUG_TLB_LOG_GATE 0
 #endif
 
+STATS_COUNTER_DEFINE(tlb_fills, "tlb-fills");
+
 #define tlb_debug(fmt, ...) do { \
     if (DEBUG_TLB_LOG_GATE) { \
         qemu_log_mask(CPU_LOG_MMU, "%s: " fmt, __func__, \
@@ -105,16 +109,32 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
 static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
 {
     CPUJumpCache *jc = cpu->tb_jmp_cache;
-    int i, i0;
+    int i, i0, n;
 
     if (unlikely(!jc)) {
         return;
     }
 
-    i0 = tb_jmp_cache_hash_page(page_addr);
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
+    i0 = tb_jmp_cache_hash_page(jc->bits, page_addr);
+    n = tb_jmp_page_size(jc->bits);
+    for (i = 0; i < n; i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
     }
+
+    /*
+     * The victim sets are indexed by the low bits of the hash, which
+     * for softmmu vary within a page; scan them all by address.
+     * This runs on the owning cpu, so reading pc is safe.
+     */
+    for (i = 0; i < TB_JMP_VICTIM_SETS; i++) {
+        for (int w = 0; w < TB_JMP_VICTIM_WAYS; w++) {
+            CPUJumpCacheEntry *v = &jc->victim[i][w];
+
+            if ((v->pc & TARGET_PAGE_MASK) == page_addr) {
+                qatomic_set(&v->tb, NULL);
+            }
+        }
+    }
 }
 
 /**
@@ -240,6 +260,9 @@ static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
+    for (int i = 0; i < CPU_TLB_LARGE_SIZE; i++) {
+        desc->ltable[i].addr = -1;
+    }
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUState *cpu, int mmu_idx,
@@ -264,6 +287,78 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
     tlb_mmu_flush_locked(desc, fast);
 }
 
+static void tlb_walk_cache_flush(CPUState *cpu)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+
+    if (c->walk_used) {
+        memset(c->walk, -1, sizeof(c->walk));
+        c->walk_used = false;
+    }
+}
+
+static inline vaddr tlb_walk_tag(vaddr addr, unsigned shift)
+{
+    return (addr & -((vaddr)1 << shift)) | shift;
+}
+
+static inline CPUTLBWalkEntry *tlb_walk_entry(CPUState *cpu, vaddr addr,
+                                              unsigned shift)
+{
+    unsigned index = ((addr >> shift) + shift) & (CPU_TLB_WALK_SIZE - 1);
+
+    return &cpu->neg.tlb.c.walk[index];
+}
+
+const CPUTLBWalkEntry *tlb_walk_cache_lookup(CPUState *cpu, vaddr addr,
+                                             unsigned shift, uint64_t root,
+                                             uint32_t mode)
+{
+    CPUTLBWalkEntry *e = tlb_walk_entry(cpu, addr, shift);
+
+    assert_cpu_is_self(cpu);
+    if (e->tag == tlb_walk_tag(addr, shift) &&
+        e->root == root && e->mode == mode) {
+        return e;
+    }
+    return NULL;
+}
+
+void tlb_walk_cache_insert(CPUState *cpu, vaddr addr, unsigned shift,
+                           uint64_t root, uint32_t mode,
+                           uint64_t entry, uint64_t attrs)
+{
+    CPUTLBWalkEntry *e = tlb_walk_entry(cpu, addr, shift);
+
+    assert_cpu_is_self(cpu);
+    tcg_debug_assert(shift >= TARGET_PAGE_BITS && shift < TARGET_LONG_BITS);
+    *e = (CPUTLBWalkEntry) {
+        .tag = tlb_walk_tag(addr, shift),
+        .root = root,
+        .mode = mode,
+        .entry = entry,
+        .attrs = attrs,
+    };
+    cpu->neg.tlb.c.walk_used = true;
+}
+
+void tlb_walk_cache_remove(CPUState *cpu, vaddr addr)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+
+    assert_cpu_is_self(cpu);
+    if (!c->walk_used) {
+        return;
+    }
+    for (int i = 0; i < CPU_TLB_WALK_SIZE; i++) {
+        vaddr tag = c->walk[i].tag;
+
+        if (tag != -1 && tlb_walk_tag(addr, tag & ~TARGET_PAGE_MASK) == tag) {
+            c->walk[i].tag = -1;
+        }
+    }
+}
+
 static inline void tlb_n_used_entries_inc(CPUState *cpu, uintptr_t mmu_idx)
 {
     cpu->neg.tlb.d[mmu_idx].n_used_entries++;
@@ -283,6 +378,8 @@ void tlb_init(CPUState *cpu)
 
     /* All tlbs are initialized flushed. */
     cpu->neg.tlb.c.dirty = 0;
+    cpu->neg.tlb.c.walk_used = false;
+    memset(cpu->neg.tlb.c.walk, -1, sizeof(cpu->neg.tlb.c.walk));
 
     for (i = 0; i < NB_MMU_MODES; i++) {
         tlb_mmu_init(&cpu->neg.tlb.d[i], &cpu->neg.tlb.f[i], now);
@@ -346,6 +443,7 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 
+    tlb_walk_cache_flush(cpu);
     tcg_flush_jmp_cache(cpu);
 
     if (to_clean == ALL_MMUIDX_BITS) {
@@ -473,6 +571,47 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
+/*
+ * Drop the remembered large pages which intersect [@addr, @addr + @len)
+ * when compared under @bits significant address bits.
+ */
+static void tlb_flush_ltable_range_locked(CPUState *cpu, int midx,
+                                          vaddr addr, vaddr len,
+                                          unsigned bits)
+{
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+
+    for (int i = 0; i < CPU_TLB_LARGE_SIZE; i++) {
+        CPUTLBLargePage *lp = &d->ltable[i];
+
+        if (lp->addr == (vaddr)-1) {
+            continue;
+        }
+        /* Be conservative with partially significant addresses. */
+        if (bits < TARGET_LONG_BITS ||
+            ranges_overlap(lp->addr, ~lp->mask + 1, addr, len)) {
+            lp->addr = -1;
+        }
+    }
+}
+
+/*
+ * Perform a full flush of @midx forced by an overlap with the large
+ * page region, but retain the remembered large pages: the caller drops
+ * the ones that are actually being invalidated.
+ */
+static void tlb_flush_one_mmuidx_keep_large_locked(CPUState *cpu, int midx)
+{
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    CPUTLBLargePage keep[CPU_TLB_LARGE_SIZE];
+    size_t lindex = d->lindex;
+
+    memcpy(keep, d->ltable, sizeof(keep));
+    tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+    memcpy(d->ltable, keep, sizeof(keep));
+    d->lindex = lindex;
+}
+
 static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 {
     vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
@@ -483,13 +622,15 @@ static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
         tlb_debug("forcing full flush midx %d (%016"
                   VADDR_PRIx "/%016" VADDR_PRIx ")\n",
                   midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+        tlb_flush_one_mmuidx_keep_large_locked(cpu, midx);
     } else {
         if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
             tlb_n_used_entries_dec(cpu, midx);
         }
         tlb_flush_vtlb_page_locked(cpu, midx, page);
     }
+    tlb_flush_ltable_range_locked(cpu, midx, page, TARGET_PAGE_SIZE,
+                                  TARGET_LONG_BITS);
 }
 
 /**
@@ -519,6 +660,12 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 
+    /*
+     * Intermediate page table entries can cover much more than a page,
+     * and targets may invalidate them all with a page flush.
+     */
+    tlb_walk_cache_flush(cpu);
+
     /*
      * Discard jump cache entries for any tb which might potentially
      * overlap the flushed page, which includes the previous.
@@ -527,6 +674,83 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
     tb_jmp_cache_clear_page(cpu, addr);
 }
 
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    CPUTLBPendingFlush pending[CPU_TLB_PENDING_FLUSH_MAX];
+    uint16_t full;
+    int i, n;
+
+    assert_cpu_is_self(cpu);
+
+    qemu_spin_lock(&c->lock);
+    n = c->pending_count;
+    full = c->pending_full;
+    memcpy(pending, c->pending, n * sizeof(pending[0]));
+    c->pending_count = 0;
+    c->pending_full = 0;
+    c->pending_scheduled = false;
+    qemu_spin_unlock(&c->lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        uint16_t idxmap = pending[i].idxmap & ~full;
+
+        if (idxmap) {
+            tlb_flush_page_by_mmuidx_async_0(cpu, pending[i].addr, idxmap);
+        }
+    }
+}
+
+/**
+ * tlb_flush_page_by_mmuidx_queue:
+ * @cpu: cpu on which to flush
+ * @addr: page aligned address
+ * @idxmap: mmu_idx to flush
+ *
+ * Queue a page flush to be run on @cpu, which must not be the current
+ * cpu.  Requests that arrive before @cpu has run the queued work item
+ * are merged into it: repeated pages are flushed only once, and past
+ * CPU_TLB_PENDING_FLUSH_MAX distinct pages the affected mmu_idx are
+ * flushed entirely instead.  Since the work item is queued no later
+ * than the first request in the batch, the ordering guarantees of
+ * async_run_on_cpu, and hence of the _synced variants, are preserved.
+ */
+static void tlb_flush_page_by_mmuidx_queue(CPUState *cpu, vaddr addr,
+                                           uint16_t idxmap)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    bool schedule;
+    int i;
+
+    qemu_spin_lock(&c->lock);
+    schedule = !c->pending_scheduled;
+    c->pending_scheduled = true;
+
+    for (i = 0; i < c->pending_count; i++) {
+        if (c->pending[i].addr == addr) {
+            c->pending[i].idxmap |= idxmap;
+            break;
+        }
+    }
+    if (i == c->pending_count) {
+        if (i < CPU_TLB_PENDING_FLUSH_MAX) {
+            c->pending[i].addr = addr;
+            c->pending[i].idxmap = idxmap;
+            c->pending_count++;
+        } else {
+            c->pending_full |= idxmap;
+        }
+    }
+    qemu_spin_unlock(&c->lock);
+
+    if (schedule) {
+        async_run_on_cpu(cpu, tlb_flush_pending_async_work, RUN_ON_CPU_NULL);
+    }
+}
+
 /**
  * tlb_flush_page_by_mmuidx_async_1:
  * @cpu: cpu on which to flush
@@ -580,22 +804,8 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, vaddr addr, uint16_t idxmap)
 
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-    } else if (idxmap < TARGET_PAGE_SIZE) {
-        /*
-         * Most targets have only a few mmu_idx.  In the case where
-         * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
-         * allocating memory for this operation.
-         */
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
-
-        /* Otherwise allocate a structure, freed by the worker.  */
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(d));
+        tlb_flush_page_by_mmuidx_queue(cpu, addr, idxmap);
     }
 }
 
@@ -607,32 +817,16 @@ void tlb_flush_page(CPUState *cpu, vaddr addr)
 void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, vaddr addr,
                                        uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                TLBFlushPageByMMUIdxData *d
-                    = g_new(TLBFlushPageByMMUIdxData, 1);
-
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_page_by_mmuidx_queue(dst_cpu, addr, idxmap);
         }
     }
 
@@ -648,36 +842,31 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               vaddr addr,
                                               uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_page_by_mmuidx_queue(dst_cpu, addr, idxmap);
+        }
+    }
+
     /*
      * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
+     * Most targets have only a few mmu_idx.  In the case where
+     * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
+     * allocating memory for this operation.
      */
     if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
                               RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
+        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
 
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
         d->addr = addr;
         d->idxmap = idxmap;
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
@@ -725,9 +914,11 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
         tlb_debug("forcing full flush midx %d ("
                   "%016" VADDR_PRIx "/%016" VADDR_PRIx ")\n",
                   midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+        tlb_flush_one_mmuidx_keep_large_locked(cpu, midx);
+        tlb_flush_ltable_range_locked(cpu, midx, addr, len, bits);
         return;
     }
+    tlb_flush_ltable_range_locked(cpu, midx, addr, len, bits);
 
     for (vaddr i = 0; i < len; i += TARGET_PAGE_SIZE) {
         vaddr page = addr + i;
@@ -765,11 +956,13 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 
+    tlb_walk_cache_flush(cpu);
+
     /*
      * If the length is larger than the jump cache size, then it will take
      * longer to clear each entry individually than it will to clear it all.
      */
-    if (d.len >= (TARGET_PAGE_SIZE * TB_JMP_CACHE_SIZE)) {
+    if (d.len >= (TARGET_PAGE_SIZE * tb_jmp_cache_size(cpu->tb_jmp_cache))) {
         tcg_flush_jmp_cache(cpu);
         return;
     }
@@ -1102,6 +1295,83 @@ static inline void tlb_set_compare(CPUTLBEntryFull *full, CPUTLBEntry *ent,
     full->slow_flags[access_type] = flags;
 }
 
+/*
+ * Remember the translation of a large page, so that misses on other
+ * target pages within it can be refilled without another page table walk.
+ * Pages with PAGE_WRITE_INV must see the target's tlb_fill on each store,
+ * and are therefore not recorded.
+ */
+static void tlb_remember_large_page(CPUState *cpu, int mmu_idx,
+                                    vaddr addr, const CPUTLBEntryFull *full)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    vaddr lp_mask, lp_addr;
+    CPUTLBLargePage *lp = NULL;
+
+    if (full->lg_page_size >= TARGET_LONG_BITS ||
+        (full->prot & PAGE_WRITE_INV)) {
+        return;
+    }
+
+    lp_mask = ~(((vaddr)1 << full->lg_page_size) - 1);
+    lp_addr = addr & lp_mask;
+
+    for (int i = 0; i < CPU_TLB_LARGE_SIZE; i++) {
+        if (desc->ltable[i].addr == lp_addr &&
+            desc->ltable[i].mask == lp_mask) {
+            lp = &desc->ltable[i];
+            break;
+        }
+    }
+    if (lp == NULL) {
+        lp = &desc->ltable[desc->lindex++ % CPU_TLB_LARGE_SIZE];
+    }
+
+    lp->addr = lp_addr;
+    lp->mask = lp_mask;
+    lp->full = *full;
+    /* Store the physical address of the start of the large page. */
+    lp->full.phys_addr = (full->phys_addr & TARGET_PAGE_MASK)
+                         - ((addr & TARGET_PAGE_MASK) - lp_addr);
+}
+
+/*
+ * Refill the tlb entry for @addr from a remembered large page.
+ * Return true if a large page covering @addr grants @access_type.
+ */
+static bool tlb_large_page_hit(CPUState *cpu, int mmu_idx, vaddr addr,
+                               MMUAccessType access_type)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    int need;
+
+    switch (access_type) {
+    case MMU_DATA_STORE:
+        need = PAGE_WRITE;
+        break;
+    case MMU_INST_FETCH:
+        need = PAGE_EXEC;
+        break;
+    default:
+        need = PAGE_READ;
+        break;
+    }
+
+    for (int i = 0; i < CPU_TLB_LARGE_SIZE; i++) {
+        CPUTLBLargePage *lp = &desc->ltable[i];
+
+        if ((addr & lp->mask) == lp->addr && (lp->full.prot & need)) {
+            vaddr page = addr & TARGET_PAGE_MASK;
+            CPUTLBEntryFull full = lp->full;
+
+            full.phys_addr += page - lp->addr;
+            tlb_set_page_full(cpu, mmu_idx, page, &full);
+            return true;
+        }
+    }
+    return false;
+}
+
 /*
  * Add a new TLB entry. At most one entry for a given virtual address
  * is permitted. Only a single TARGET_PAGE_SIZE region is mapped, the
@@ -1131,6 +1401,7 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
     } else {
         sz = (hwaddr)1 << full->lg_page_size;
         tlb_add_large_page(cpu, mmu_idx, addr, sz);
+        tlb_remember_large_page(cpu, mmu_idx, addr, full);
     }
     addr_page = addr & TARGET_PAGE_MASK;
     paddr_page = full->phys_addr & TARGET_PAGE_MASK;
@@ -1312,6 +1583,10 @@ static void tlb_fill(CPUState *cpu, vaddr addr, int size,
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
      */
+    if (tlb_large_page_hit(cpu, mmu_idx, addr, access_type)) {
+        return;
+    }
+    stats_counter_inc(&tlb_fills);
     ok = cpu->cc->tcg_ops->tlb_fill(cpu, addr, size,
                                     access_type, mmu_idx, false, retaddr);
     assert(ok);
@@ -1429,7 +1704,8 @@ static int probe_access_internal(CPUState *cpu, vaddr addr,
 
     if (!tlb_hit_page(tlb_addr, page_addr)) {
         if (!victim_tlb_hit(cpu, mmu_idx, index, access_type, page_addr)) {
-            if (!cpu->cc->tcg_ops->tlb_fill(cpu, addr, fault_size, access_type,
+            if (!tlb_large_page_hit(cpu, mmu_idx, addr, access_type) &&
+                !cpu->cc->tcg_ops->tlb_fill(cpu, addr, fault_size, access_type,
                                             mmu_idx, nonfault, retaddr)) {
                 /* Non-faulting page table read failed.  */
                 *phost = NULL;
@@ -1842,9 +2118,40 @@ static bool mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
     return crosspage;
 }
 
+/**
+ * mmu_lookup_contiguous: check for a host contiguous page crossing access
+ * @l: result of a page crossing mmu_lookup()
+ *
+ * Guest pages that are adjacent in the address space are commonly also
+ * adjacent in host memory, e.g. both backed by the same RAMBlock.  If the
+ * two halves of the access are RAM and the access requires no atomicity,
+ * return the host address at which it can be performed as a single unaligned
+ * host access.  Otherwise return NULL, and the caller must go byte by byte.
+ */
+static void *mmu_lookup_contiguous(MMULookupLocals *l)
+{
+    int flags = l->page[0].flags | l->page[1].flags;
+
+    switch (l->memop & MO_ATOM_MASK) {
+    case MO_ATOM_IFALIGN:
+    case MO_ATOM_WITHIN16:
+    case MO_ATOM_NONE:
+        break;
+    default:
+        return NULL;
+    }
+    if (flags & (TLB_MMIO | TLB_DISCARD_WRITE)) {
+        return NULL;
+    }
+    if (l->page[0].haddr + l->page[0].size != l->page[1].haddr) {
+        return NULL;
+    }
+    return l->page[0].haddr;
+}
+
 /*
- * Probe for an atomic operation.  Do not allow unaligned operations,
- * or io operations to proceed.  Return the host address.
+ * Probe for an atomic operation.  Do not allow unaligned operations that
+ * cannot be widened, or io operations to proceed.  Return the host address.
  */
 static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
                                int size, uintptr_t retaddr)
@@ -1872,11 +2179,15 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
 
     /* Enforce qemu required alignment.  */
     if (unlikely(addr & (size - 1))) {
-        /* We get here if guest alignment was not requested,
-           or was not enforced by cpu_unaligned_access above.
-           We might widen the access and emulate, but for now
-           mark an exception and exit the cpu loop.  */
-        goto stop_the_world;
+        /*
+         * We get here if guest alignment was not requested, or was not
+         * enforced by cpu_unaligned_access above.  The helpers widen the
+         * access to a compare-and-swap of the enclosing block if there is
+         * one, otherwise mark an exception and exit the cpu loop.
+         */
+        if (!atomic_unaligned_block_size(addr, size)) {
+            goto stop_the_world;
+        }
     }
 
     index = tlb_index(cpu, mmu_idx, addr);
@@ -2385,6 +2696,7 @@ static uint16_t do_ld2_mmu(CPUState *cpu, vaddr addr, MemOpIdx oi,
 {
     MMULookupLocals l;
     bool crosspage;
+    void *haddr;
     uint16_t ret;
     uint8_t a, b;
 
@@ -2394,6 +2706,12 @@ static uint16_t do_ld2_mmu(CPUState *cpu, vaddr addr, MemOpIdx oi,
         return do_ld_2(cpu, &l.page[0], l.mmu_idx, access_type, l.memop, ra);
     }
 
+    haddr = mmu_lookup_contiguous(&l);
+    if (haddr) {
+        ret = lduw_he_p(haddr);
+        return l.memop & MO_BSWAP ? bswap16(ret) : ret;
+    }
+
     a = do_ld_1(cpu, &l.page[0], l.mmu_idx, access_type, ra);
     b = do_ld_1(cpu, &l.page[1], l.mmu_idx, access_type, ra);
 
@@ -2410,6 +2728,7 @@ static uint32_t do_ld4_mmu(CPUState *cpu, vaddr addr, MemOpIdx oi,
 {
     MMULookupLocals l;
     bool crosspage;
+    void *haddr;
     uint32_t ret;
 
     cpu_req_mo(TCG_MO_LD_LD | TCG_MO_ST_LD);
@@ -2418,6 +2737,12 @@ static uint32_t do_ld4_mmu(CPUState *cpu, vaddr addr, MemOpIdx oi,
         return do_ld_4(cpu, &l.page[0], l.mmu_idx, access_type, l.memop, ra);
     }
 
+    haddr = mmu_lookup_contiguous(&l);
+    if (haddr) {
+        ret = ldl_he_p(haddr);
+        return l.memop & MO_BSWAP ? bswap32(ret) : ret;
+    }
+
     ret = do_ld_beN(cpu, &l.page[0], 0, l.mmu_idx, access_type, l.memop, ra);
     ret = do_ld_beN(cpu, &l.page[1], ret, l.mmu_idx, access_type, l.memop, ra);
     if ((l.memop & MO_BSWAP) == MO_LE) {
@@ -2431,6 +2756,7 @@ static uint64_t do_ld8_mmu(CPUState *cpu, vaddr addr, MemOpIdx oi,
 {
     MMULookupLocals l;
     bool crosspage;
+    void *haddr;
     uint64_t ret;
 
     cpu_req_mo(TCG_MO_LD_LD | TCG_MO_ST_LD);
@@ -2439,6 +2765,12 @@ static uint64_t do_ld8_mmu(CPUState *cpu, vaddr addr, MemOpIdx oi,
         return do_ld_8(cpu, &l.page[0], l.mmu_idx, access_type, l.memop, ra);
     }
 
+    haddr = mmu_lookup_contiguous(&l);
+    if (haddr) {
+        ret = ldq_he_p(haddr);
+        return l.memop & MO_BSWAP ? bswap64(ret) : ret;
+    }
+
     ret = do_ld_beN(cpu, &l.page[0], 0, l.mmu_idx, access_type, l.memop, ra);
     ret = do_ld_beN(cpu, &l.page[1], ret, l.mmu_idx, access_type, l.memop, ra);
     if ((l.memop & MO_BSWAP) == MO_LE) {
@@ -2804,6 +3136,7 @@ static void do_st2_mmu(CPUState *cpu, vaddr addr, uint16_t val,
 {
     MMULookupLocals l;
     bool crosspage;
+    void *haddr;
     uint8_t a, b;
 
     cpu_req_mo(TCG_MO_LD_ST | TCG_MO_ST_ST);
@@ -2813,6 +3146,12 @@ static void do_st2_mmu(CPUState *cpu, vaddr addr, uint16_t val,
         return;
     }
 
+    haddr = mmu_lookup_contiguous(&l);
+    if (haddr) {
+        stw_he_p(haddr, l.memop & MO_BSWAP ? bswap16(val) : val);
+        return;
+    }
+
     if ((l.memop & MO_BSWAP) == MO_LE) {
         a = val, b = val >> 8;
     } else {
@@ -2827,6 +3166,7 @@ static void do_st4_mmu(CPUState *cpu, vaddr addr, uint32_t val,
 {
     MMULookupLocals l;
     bool crosspage;
+    void *haddr;
 
     cpu_req_mo(TCG_MO_LD_ST | TCG_MO_ST_ST);
     crosspage = mmu_lookup(cpu, addr, oi, ra, MMU_DATA_STORE, &l);
@@ -2835,6 +3175,12 @@ static void do_st4_mmu(CPUState *cpu, vaddr addr, uint32_t val,
         return;
     }
 
+    haddr = mmu_lookup_contiguous(&l);
+    if (haddr) {
+        stl_he_p(haddr, l.memop & MO_BSWAP ? bswap32(val) : val);
+        return;
+    }
+
     /* Swap to little endian for simplicity, then store by bytes. */
     if ((l.memop & MO_BSWAP) != MO_LE) {
         val = bswap32(val);
@@ -2848,6 +3194,7 @@ static void do_st8_mmu(CPUState *cpu, vaddr addr, uint64_t val,
 {
     MMULookupLocals l;
     bool crosspage;
+    void *haddr;
 
     cpu_req_mo(TCG_MO_LD_ST | TCG_MO_ST_ST);
     crosspage = mmu_lookup(cpu, addr, oi, ra, MMU_DATA_STORE, &l);
@@ -2856,6 +3203,12 @@ static void do_st8_mmu(CPUState *cpu, vaddr addr, uint64_t val,
         return;
     }
 
+    haddr = mmu_lookup_contiguous(&l);
+    if (haddr) {
+        stq_he_p(haddr, l.memop & MO_BSWAP ? bswap64(val) : val);
+        return;
+    }
+
     /* Swap to little endian for simplicity, then store by bytes. */
     if ((l.memop & MO_BSWAP) != MO_LE) {
         val = bswap64(val);
@@ -64,6 +64,20 @@ static void icount_enable_adaptive(void)
     use_icount = ICOUNT_ADAPTATIVE;
 }
 
+/*
+ * In lock-step mode the vCPUs run in parallel, each for the same quantum
+ * of instructions.  timers_state.qemu_icount is only advanced once all of
+ * them have completed the quantum, and a vCPU sees it plus the instructions
+ * it has executed itself in the current quantum.
+ */
+static bool icount_lockstep;
+
+void icount_enable_lockstep(void)
+{
+    assert(icount_enabled() == ICOUNT_PRECISE);
+    icount_lockstep = true;
+}
+
 /*
  * The current number of executed instructions is based on what we
  * originally budgeted minus the current state of the decrementing
@@ -85,6 +99,10 @@ static void icount_update_locked(CPUState *cpu)
     int64_t executed = icount_get_executed(cpu);
     cpu->icount_budget -= executed;
 
+    if (icount_lockstep) {
+        cpu->icount_quantum += executed;
+        return;
+    }
     qatomic_set_i64(&timers_state.qemu_icount,
                     timers_state.qemu_icount + executed);
 }
@@ -103,6 +121,25 @@ void icount_update(CPUState *cpu)
                          &timers_state.vm_clock_lock);
 }
 
+/*
+ * End a lock-step quantum of @insns instructions.  Called with all vCPUs
+ * waiting for the next quantum.
+ */
+void icount_lockstep_advance(int64_t insns)
+{
+    CPUState *cpu;
+
+    seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                       &timers_state.vm_clock_lock);
+    qatomic_set_i64(&timers_state.qemu_icount,
+                    timers_state.qemu_icount + insns);
+    CPU_FOREACH(cpu) {
+        cpu->icount_quantum = 0;
+    }
+    seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                         &timers_state.vm_clock_lock);
+}
+
 static int64_t icount_get_raw_locked(void)
 {
     CPUState *cpu = current_cpu;
@@ -114,6 +151,10 @@ static int64_t icount_get_raw_locked(void)
         }
         /* Take into account what has run */
         icount_update_locked(cpu);
+        if (icount_lockstep) {
+            return qatomic_read_i64(&timers_state.qemu_icount) +
+                   cpu->icount_quantum;
+        }
     }
     /* The read is protected by the seqlock, but needs atomic64 to avoid UB */
     return qatomic_read_i64(&timers_state.qemu_icount);
@@ -299,8 +340,10 @@ void icount_start_warp_timer(void)
     /*
      * Nothing to do if the VM is stopped: QEMU_CLOCK_VIRTUAL timers
      * do not fire, so computing the deadline does not make sense.
+     * In lock-step mode idle vCPUs still complete their quanta, which
+     * end at the next deadline, so there is no need to warp either.
      */
-    if (!runstate_is_running()) {
+    if (!runstate_is_running() || icount_lockstep) {
         return;
     }
 
@@ -10,10 +10,18 @@
 #define ACCEL_TCG_INTERNAL_COMMON_H
 
 #include "exec/translation-block.h"
+#include "qemu/atomic128.h"
 
 extern int64_t max_delay;
 extern int64_t max_advance;
 
+/* Default instructions per quantum for lock-step icount */
+#define MTTCG_ICOUNT_QUANTUM_DEFAULT 10000
+extern uint32_t mttcg_icount_quantum;
+
+/* Upper bound of the adaptive halt-polling window, 0 disables polling */
+extern uint32_t tcg_halt_poll_ns;
+
 /*
  * Return true if CS is not running in parallel with other cpus, either
  * because there are no other cpus or we are within an exclusive context.
@@ -23,4 +31,26 @@ static inline bool cpu_in_serial_context(CPUState *cs)
     return !(cs->tcg_cflags & CF_PARALLEL) || cpu_in_exclusive_context(cs);
 }
 
+/*
+ * Return the size of the naturally aligned block around the unaligned
+ * atomic operation of SIZE bytes at ADDR, if the host can compare-and-swap
+ * the whole block, or 0 if it cannot and the operation must be performed
+ * with all other cpus stopped.
+ */
+static inline int atomic_unaligned_block_size(uint64_t addr, int size)
+{
+    if ((addr & 3) + size <= 4) {
+        return 4;
+    }
+#ifdef CONFIG_ATOMIC64
+    if ((addr & 7) + size <= 8) {
+        return 8;
+    }
+#endif
+    if (HAVE_CMPXCHG128 && (addr & 15) + size <= 16) {
+        return 16;
+    }
+    return 0;
+}
+
 #endif
@@ -94,6 +94,8 @@ static inline vaddr log_pc(CPUState *cpu, const TranslationBlock *tb)
 }
 
 extern bool one_insn_per_tb;
+extern unsigned tb_jmp_cache_bits;
+extern uint32_t tb_hot_threshold;
 
 /**
  * tcg_req_mo:
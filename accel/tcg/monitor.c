@@ -15,10 +15,13 @@
 #include "monitor/monitor.h"
 #include "sysemu/cpus.h"
 #include "sysemu/cpu-timers.h"
+#include "sysemu/stats.h"
 #include "sysemu/tcg.h"
+#include "hw/core/cpu.h"
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 
 
 static void dump_drift_info(GString *buf)
@@ -46,10 +49,15 @@ static void dump_accel_info(GString *buf)
     bool one_insn_per_tb = object_property_get_bool(OBJECT(accel),
                                                     "one-insn-per-tb",
                                                     &error_fatal);
+    uint64_t hot_tb_threshold = object_property_get_uint(OBJECT(accel),
+                                                         "hot-tb-threshold",
+                                                         &error_fatal);
 
     g_string_append_printf(buf, "Accelerator settings:\n");
-    g_string_append_printf(buf, "one-insn-per-tb: %s\n\n",
+    g_string_append_printf(buf, "one-insn-per-tb: %s\n",
                            one_insn_per_tb ? "on" : "off");
+    g_string_append_printf(buf, "hot-tb-threshold: %" PRIu64 "\n\n",
+                           hot_tb_threshold);
 }
 
 static void print_qht_statistics(struct qht_stats hst, GString *buf)
@@ -101,6 +109,8 @@ struct tb_tree_stats {
     size_t direct_jmp_count;
     size_t direct_jmp2_count;
     size_t cross_page;
+    size_t hot;
+    uint32_t hot_threshold;
 };
 
 static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
@@ -117,6 +127,10 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     if (tb->page_addr[1] != -1) {
         tst->cross_page++;
     }
+    if (tst->hot_threshold &&
+        qatomic_read(&tb->exec_count) >= tst->hot_threshold) {
+        tst->hot++;
+    }
     if (tb->jmp_reset_offset[0] != TB_JMP_OFFSET_INVALID) {
         tst->direct_jmp_count++;
         if (tb->jmp_reset_offset[1] != TB_JMP_OFFSET_INVALID) {
@@ -146,12 +160,36 @@ static void tcg_dump_info(GString *buf)
     g_string_append_printf(buf, "[TCG profiler not compiled]\n");
 }
 
+static void tb_jmp_cache_counts(size_t *phit, size_t *pvictim, size_t *pmiss)
+{
+    CPUState *cpu;
+    size_t hit = 0, victim = 0, miss = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        if (jc) {
+            hit += qatomic_read(&jc->stats.hits);
+            victim += qatomic_read(&jc->stats.victim_hits);
+            miss += qatomic_read(&jc->stats.misses);
+        }
+    }
+    *phit = hit;
+    *pvictim = victim;
+    *pmiss = miss;
+}
+
 static void dump_exec_info(GString *buf)
 {
+    AccelState *accel = current_accel();
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t jc_hit, jc_victim, jc_miss;
 
+    tst.hot_threshold = object_property_get_uint(OBJECT(accel),
+                                                 "hot-tb-threshold",
+                                                 &error_fatal);
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
     /* XXX: avoid using doubles ? */
@@ -175,6 +213,11 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "cross page TB count %zu (%zu%%)\n",
                            tst.cross_page,
                            nb_tbs ? (tst.cross_page * 100) / nb_tbs : 0);
+    if (tst.hot_threshold) {
+        g_string_append_printf(buf, "hot TB count        %zu (%zu%%)\n",
+                               tst.hot,
+                               nb_tbs ? (tst.hot * 100) / nb_tbs : 0);
+    }
     g_string_append_printf(buf, "direct jump count   %zu (%zu%%) "
                            "(2 jumps=%zu %zu%%)\n",
                            tst.direct_jmp_count,
@@ -196,6 +239,11 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+
+    tb_jmp_cache_counts(&jc_hit, &jc_victim, &jc_miss);
+    g_string_append_printf(buf, "TB jmp cache hits   %zu\n", jc_hit);
+    g_string_append_printf(buf, "TB jmp victim hits  %zu\n", jc_victim);
+    g_string_append_printf(buf, "TB jmp cache misses %zu\n", jc_miss);
     tcg_dump_info(buf);
 }
 
@@ -235,10 +283,191 @@ HumanReadableText *qmp_x_query_opcount(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+static const char *const tcg_vcpu_stats[] = {
+    "tb-jmp-cache-hits",
+    "tb-jmp-cache-victim-hits",
+    "tb-jmp-cache-misses",
+    "halt-attempted-poll",
+    "halt-successful-poll",
+    "halt-wakeup",
+    "halt-poll-success-ns",
+    "halt-poll-fail-ns",
+};
+
+static const char *const tcg_vm_stats[] = {
+    "tb-htable-head-buckets",
+    "tb-htable-used-head-buckets",
+    "tb-htable-entries",
+    "tb-htable-chain-buckets",
+};
+
+static StatsList *tcg_stats_add(StatsList *list, strList *names,
+                                const char *name, uint64_t val)
+{
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        return list;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QNUM;
+    stats->value->u.scalar = val;
+
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+/*
+ * Histogram of the number of buckets in each chain of the TB hash table.
+ * Element 0 counts the empty head buckets.
+ */
+static StatsList *tcg_stats_add_chain_hist(StatsList *list, strList *names,
+                                           const char *name,
+                                           const struct qht_stats *hst)
+{
+    g_autofree uint64_t *hist = NULL;
+    uint64List *val_list = NULL;
+    size_t n = 1;
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        return list;
+    }
+
+    if (qdist_sample_count(&hst->chain)) {
+        n = (size_t)qdist_xmax(&hst->chain) + 1;
+    }
+    hist = g_new0(uint64_t, n);
+    hist[0] = hst->head_buckets - hst->used_head_buckets;
+    for (size_t i = 0; i < hst->chain.n; i++) {
+        hist[(size_t)hst->chain.entries[i].x] += hst->chain.entries[i].count;
+    }
+    for (size_t i = n; i-- > 0;) {
+        QAPI_LIST_PREPEND(val_list, hist[i]);
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QLIST;
+    stats->value->u.list = val_list;
+
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+static void tcg_query_vm_stats(StatsResultList **result, strList *names)
+{
+    struct qht_stats hst;
+    StatsList *list = NULL;
+
+    qht_statistics_init(&tb_ctx.htable, &hst);
+    list = tcg_stats_add_chain_hist(list, names, tcg_vm_stats[3], &hst);
+    list = tcg_stats_add(list, names, tcg_vm_stats[2], hst.entries);
+    list = tcg_stats_add(list, names, tcg_vm_stats[1],
+                         hst.used_head_buckets);
+    list = tcg_stats_add(list, names, tcg_vm_stats[0], hst.head_buckets);
+    qht_statistics_destroy(&hst);
+
+    if (list) {
+        add_stats_entry(result, STATS_PROVIDER_TCG, NULL, list);
+    }
+}
+
+static void tcg_query_stats_cb(StatsResultList **result, StatsTarget target,
+                               strList *names, strList *targets, Error **errp)
+{
+    CPUState *cpu;
+
+    if (!tcg_enabled()) {
+        return;
+    }
+    if (target == STATS_TARGET_VM) {
+        tcg_query_vm_stats(result, names);
+        return;
+    }
+    if (target != STATS_TARGET_VCPU) {
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+        StatsList *list = NULL;
+
+        if (!jc ||
+            !apply_str_list_filter(cpu->parent_obj.canonical_path, targets)) {
+            continue;
+        }
+
+        list = tcg_stats_add(list, names, tcg_vcpu_stats[7],
+            qatomic_read_u64(&cpu->halt_poll_stats.fail_ns));
+        list = tcg_stats_add(list, names, tcg_vcpu_stats[6],
+            qatomic_read_u64(&cpu->halt_poll_stats.success_ns));
+        list = tcg_stats_add(list, names, tcg_vcpu_stats[5],
+            qatomic_read_u64(&cpu->halt_poll_stats.wakeups));
+        list = tcg_stats_add(list, names, tcg_vcpu_stats[4],
+            qatomic_read_u64(&cpu->halt_poll_stats.successful));
+        list = tcg_stats_add(list, names, tcg_vcpu_stats[3],
+            qatomic_read_u64(&cpu->halt_poll_stats.attempted));
+        list = tcg_stats_add(list, names, tcg_vcpu_stats[2],
+                             qatomic_read(&jc->stats.misses));
+        list = tcg_stats_add(list, names, tcg_vcpu_stats[1],
+                             qatomic_read(&jc->stats.victim_hits));
+        list = tcg_stats_add(list, names, tcg_vcpu_stats[0],
+                             qatomic_read(&jc->stats.hits));
+        if (list) {
+            add_stats_entry(result, STATS_PROVIDER_TCG,
+                            cpu->parent_obj.canonical_path, list);
+        }
+    }
+}
+
+static void tcg_query_stats_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *list = NULL;
+
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    for (int i = ARRAY_SIZE(tcg_vcpu_stats) - 1; i >= 0; i--) {
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(tcg_vcpu_stats[i]);
+        value->type = STATS_TYPE_CUMULATIVE;
+        QAPI_LIST_PREPEND(list, value);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_TCG, STATS_TARGET_VCPU, list);
+
+    list = NULL;
+    for (int i = ARRAY_SIZE(tcg_vm_stats) - 1; i >= 0; i--) {
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(tcg_vm_stats[i]);
+        if (i == 3) {
+            value->type = STATS_TYPE_LINEAR_HISTOGRAM;
+            value->has_bucket_size = true;
+            value->bucket_size = 1;
+        } else {
+            value->type = STATS_TYPE_INSTANT;
+        }
+        QAPI_LIST_PREPEND(list, value);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_TCG, STATS_TARGET_VM, list);
+}
+
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    monitor_register_hmp_info_hrt("jit-profile", qmp_x_query_jit_profile);
+    add_stats_callbacks(STATS_PROVIDER_TCG, tcg_query_stats_cb,
+                        tcg_query_stats_schemas_cb);
 }
 
 type_init(hmp_tcg_register);
@@ -118,16 +118,27 @@ static void gen_empty_udata_cb(void)
  */
 static void gen_empty_inline_cb(void)
 {
+    TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
+    TCGv_ptr cpu_index_as_ptr = tcg_temp_ebb_new_ptr();
     TCGv_i64 val = tcg_temp_ebb_new_i64();
     TCGv_ptr ptr = tcg_temp_ebb_new_ptr();
 
+    tcg_gen_ld_i32(cpu_index, tcg_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    /* second operand will be replaced by the stride between vCPUs */
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(cpu_index_as_ptr, cpu_index);
+
     tcg_gen_movi_ptr(ptr, 0);
+    tcg_gen_add_ptr(ptr, ptr, cpu_index_as_ptr);
     tcg_gen_ld_i64(val, ptr, 0);
     /* pass an immediate != 0 so that it doesn't get optimized away */
     tcg_gen_addi_i64(val, val, 0xdeadface);
     tcg_gen_st_i64(val, ptr, 0);
     tcg_temp_free_ptr(ptr);
     tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(cpu_index_as_ptr);
+    tcg_temp_free_i32(cpu_index);
 }
 
 static void gen_empty_mem_cb(TCGv_i64 addr, uint32_t info)
@@ -204,6 +215,8 @@ void plugin_gen_empty_mem_callback(TCGv_i64 addr, uint32_t info)
 {
     enum qemu_plugin_mem_rw rw = get_plugin_meminfo_rw(info);
 
+    tcg_ctx->plugin_insn->mem_accesses++;
+
     gen_plugin_cb_start(PLUGIN_GEN_FROM_MEM, PLUGIN_GEN_CB_MEM, rw);
     gen_empty_mem_cb(addr, info);
     tcg_gen_plugin_cb_end();
@@ -315,6 +328,37 @@ static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
     return op;
 }
 
+static TCGOp *copy_mul_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static TCGOp *copy_ext_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* mov_i32 */
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        /* ext_i32_i64 */
+        op = copy_op(begin_op, op, INDEX_op_ext_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* add_i32 */
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        /* add_i64 */
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -376,12 +420,142 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+/*
+ * Emit ops with @gen at the end of the op list and move them after @op.
+ * This is used for the callbacks that do not fit in the empty callbacks,
+ * because they need control flow or are too rare to warrant one.
+ */
+static TCGOp *move_ops_after(TCGOp *op, TCGOp *last)
+{
+    TCGOp *new_op, *next;
+
+    for (new_op = QTAILQ_NEXT(last, link); new_op; new_op = next) {
+        next = QTAILQ_NEXT(new_op, link);
+        QTAILQ_REMOVE(&tcg_ctx->ops, new_op, link);
+        QTAILQ_INSERT_AFTER(&tcg_ctx->ops, op, new_op, link);
+        op = new_op;
+    }
+    return op;
+}
+
+static TCGOp *emit_after(TCGOp *op,
+                         void (*gen)(const struct qemu_plugin_dyn_cb *),
+                         const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGOp *last = tcg_last_op();
+
+    gen(cb);
+    return move_ops_after(op, last);
+}
+
+/* Compute the address of the counter of the current vCPU in @ptr */
+static void gen_inline_op_address(const struct qemu_plugin_dyn_cb *cb,
+                                  TCGv_i32 cpu_index, TCGv_ptr ptr)
+{
+    TCGv_i32 offset = tcg_temp_ebb_new_i32();
+    size_t stride;
+    void *base = plugin_inline_op_base(cb, &stride);
+
+    tcg_gen_muli_i32(offset, cpu_index, stride);
+    tcg_gen_ext_i32_ptr(ptr, offset);
+    tcg_gen_addi_ptr(ptr, ptr, (intptr_t)base);
+    tcg_temp_free_i32(offset);
+}
+
+static void gen_inline_store_cb(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
+    TCGv_ptr ptr = tcg_temp_ebb_new_ptr();
+
+    tcg_gen_ld_i32(cpu_index, tcg_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_inline_op_address(cb, cpu_index, ptr);
+    tcg_gen_st_i64(tcg_constant_i64(cb->inline_insn.imm), ptr, 0);
+
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(cpu_index);
+}
+
+static TCGCond plugin_cond_to_tcgcond(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        /* ALWAYS and NEVER conditions should never reach */
+        g_assert_not_reached();
+    }
+}
+
+static void gen_cond_cb(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
+    TCGv_ptr ptr = tcg_temp_ebb_new_ptr();
+    TCGv_i64 val = tcg_temp_ebb_new_i64();
+    TCGLabel *after_cb = gen_new_label();
+    TCGCond cond = plugin_cond_to_tcgcond(cb->inline_insn.cond);
+    TCGOp *op;
+
+    tcg_gen_ld_i32(cpu_index, tcg_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_inline_op_address(cb, cpu_index, ptr);
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_brcondi_i64(tcg_invert_cond(cond), val, cb->inline_insn.imm,
+                        after_cb);
+
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, tcg_constant_ptr(cb->userp));
+    /* call the plugin rather than the empty helper, like copy_call() */
+    op = tcg_last_op();
+    tcg_debug_assert(op->opc == INDEX_op_call);
+    op->args[TCGOP_CALLO(op) + TCGOP_CALLI(op)] = (uintptr_t)cb->f.vcpu_udata;
+
+    gen_set_label(after_cb);
+
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(cpu_index);
+}
+
 static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
+    size_t stride;
+    void *base;
+
+    if (cb->inline_insn.cond != QEMU_PLUGIN_COND_ALWAYS) {
+        return emit_after(op, gen_cond_cb, cb);
+    }
+    if (cb->inline_insn.op == QEMU_PLUGIN_INLINE_STORE_U64) {
+        return emit_after(op, gen_inline_store_cb, cb);
+    }
+
+    base = plugin_inline_op_base(cb, &stride);
+
+    /* ld_i32 cpu_index */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+
+    /* mul_i32 by the stride */
+    op = copy_mul_i32(&begin_op, op, stride);
+
+    /* ext_i32_ptr */
+    op = copy_ext_i32_ptr(&begin_op, op);
+
     /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    op = copy_const_ptr(&begin_op, op, base);
+
+    /* add_ptr */
+    op = copy_add_ptr(&begin_op, op);
 
     /* ld_i64 */
     op = copy_ld_i64(&begin_op, op);
@@ -395,13 +569,85 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+/*
+ * Record an access like plugin_mem_buffer_record(), but without making
+ * room for it: the TB start did, see plugin_register_vcpu_mem_buffered().
+ * There is no control flow, so that the temps of the access stay valid.
+ */
+static void gen_mem_buffer_record(const struct qemu_plugin_mem_buffer *buf,
+                                  TCGv_i64 addr, uint32_t info)
+{
+    GArray *data = buf->score->data;
+    TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
+    TCGv_i32 offset = tcg_temp_ebb_new_i32();
+    TCGv_ptr ptr = tcg_temp_ebb_new_ptr();
+    TCGv_ptr rec = tcg_temp_ebb_new_ptr();
+    TCGv_i64 pos = tcg_temp_ebb_new_i64();
+
+    tcg_gen_ld_i32(cpu_index, tcg_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_muli_i32(offset, cpu_index, g_array_get_element_size(data));
+    tcg_gen_ext_i32_ptr(ptr, offset);
+    tcg_gen_addi_ptr(ptr, ptr, (intptr_t)data->data);
+    tcg_gen_ld_i64(pos, ptr, offsetof(PluginMemBuffer, pos));
+
+    /* rec = &records[pos % n_records] */
+    tcg_gen_extrl_i64_i32(offset, pos);
+    tcg_gen_andi_i32(offset, offset, buf->n_records - 1);
+    tcg_gen_muli_i32(offset, offset, sizeof(struct qemu_plugin_mem_record));
+    tcg_gen_ext_i32_ptr(rec, offset);
+    tcg_gen_add_ptr(rec, rec, ptr);
+    tcg_gen_st_i64(addr, rec, offsetof(PluginMemBuffer, records) +
+                   offsetof(struct qemu_plugin_mem_record, vaddr));
+    tcg_gen_st_i32(tcg_constant_i32(info), rec,
+                   offsetof(PluginMemBuffer, records) +
+                   offsetof(struct qemu_plugin_mem_record, info));
+
+    tcg_gen_addi_i64(pos, pos, 1);
+    tcg_gen_st_i64(pos, ptr, offsetof(PluginMemBuffer, pos));
+
+    tcg_temp_free_i64(pos);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(offset);
+    tcg_temp_free_i32(cpu_index);
+}
+
+/* Find the address and meminfo arguments of an empty mem callback */
+static void mem_cb_args(TCGOp *begin_op, TCGv_i64 *addr, uint32_t *info)
+{
+    TCGOp *op = QTAILQ_NEXT(begin_op, link);
+    TCGTemp *ts;
+
+    tcg_debug_assert(op->opc == INDEX_op_mov_i32);
+    *info = arg_temp(op->args[1])->val;
+
+    op = find_op(op, INDEX_op_call);
+    tcg_debug_assert(op);
+    /* cpu_index and meminfo come first; the address may be split in two */
+    ts = arg_temp(op->args[TCGOP_CALLO(op) + 2]);
+    *addr = temp_tcgv_i64(ts - ts->temp_subindex);
+}
+
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
     enum plugin_gen_cb type = begin_op->args[1];
+    struct qemu_plugin_mem_buffer *buf = plugin_mem_buffer_of(cb);
 
     tcg_debug_assert(type == PLUGIN_GEN_CB_MEM);
 
+    /* leaves *cb_idx alone, the next callback loads cpu_index itself */
+    if (buf) {
+        TCGOp *last = tcg_last_op();
+        TCGv_i64 addr;
+        uint32_t info;
+
+        mem_cb_args(begin_op, &addr, &info);
+        gen_mem_buffer_record(buf, addr, info);
+        return move_ops_after(op, last);
+    }
+
     /* const_i32 == mov_i32 ("info", so it remains as is) */
     op = copy_op(&begin_op, op, INDEX_op_mov_i32);
 
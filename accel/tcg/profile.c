@@ -0,0 +1,266 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Sampling profiler for translated code
+ *
+ * While enabled, each thread running a vCPU is interrupted with SIGPROF
+ * at the requested frequency of consumed CPU time, and the host pc is
+ * recorded.  Samples are attributed to translation blocks and guest
+ * symbols only when the profile is queried, because the TB lookup is not
+ * async-signal-safe.  Samples taken in TBs that have been flushed since
+ * are therefore attributed to whatever occupies that code now, if any.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/type-helpers.h"
+#include "qapi/qapi-commands-machine.h"
+#include "disas/disas.h"
+#include "exec/translation-block.h"
+#include "hw/core/cpu.h"
+#include "sysemu/tcg.h"
+#include "tcg/tcg.h"
+#include "tb-jmp-cache.h"
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define TB_PROFILE_SUPPORTED 1
+#include <sys/time.h>
+#include <ucontext.h>
+#else
+#define TB_PROFILE_SUPPORTED 0
+#endif
+
+#define TB_PROFILE_MAX_SAMPLES   (1 << 18)
+#define TB_PROFILE_DEFAULT_FREQ  99
+#define TB_PROFILE_MAX_FREQ      10000
+
+static struct {
+    uintptr_t *samples;
+    size_t count;
+    bool running;
+} tb_profile;
+
+#if TB_PROFILE_SUPPORTED
+static uintptr_t tb_profile_host_pc(void *puc)
+{
+    ucontext_t *uc = puc;
+
+#if defined(__x86_64__)
+    return uc->uc_mcontext.gregs[REG_RIP];
+#else
+    return uc->uc_mcontext.pc;
+#endif
+}
+
+static void tb_profile_signal(int sig, siginfo_t *info, void *puc)
+{
+    size_t idx;
+
+    /* Only vCPU threads unblock SIGPROF, but be careful anyway. */
+    if (!current_cpu) {
+        return;
+    }
+
+    idx = qatomic_fetch_inc(&tb_profile.count);
+    if (idx < TB_PROFILE_MAX_SAMPLES) {
+        tb_profile.samples[idx] = tb_profile_host_pc(puc);
+    }
+}
+
+static void tb_profile_unblock_work(CPUState *cpu, run_on_cpu_data data)
+{
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+}
+
+static bool tb_profile_set_timer(uint32_t frequency, Error **errp)
+{
+    struct itimerval it = { };
+
+    if (frequency) {
+        it.it_interval.tv_usec = 1000000 / frequency;
+        it.it_value = it.it_interval;
+    }
+    if (setitimer(ITIMER_PROF, &it, NULL) < 0) {
+        error_setg_errno(errp, errno, "failed to set the profiling timer");
+        return false;
+    }
+    return true;
+}
+
+static bool tb_profile_start(uint32_t frequency, Error **errp)
+{
+    struct sigaction act = { };
+    CPUState *cpu;
+
+    if (!tb_profile.samples) {
+        tb_profile.samples = g_new0(uintptr_t, TB_PROFILE_MAX_SAMPLES);
+    }
+    qatomic_set(&tb_profile.count, 0);
+
+    act.sa_sigaction = tb_profile_signal;
+    act.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    if (sigaction(SIGPROF, &act, NULL) < 0) {
+        error_setg_errno(errp, errno, "failed to install the SIGPROF handler");
+        return false;
+    }
+
+    /* vCPU threads are created with all signals blocked. */
+    CPU_FOREACH(cpu) {
+        async_run_on_cpu(cpu, tb_profile_unblock_work, RUN_ON_CPU_NULL);
+    }
+
+    return tb_profile_set_timer(frequency, errp);
+}
+#endif
+
+void qmp_x_jit_profile(bool enable, bool has_frequency, uint32_t frequency,
+                       Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "JIT profiling is only available with accel=tcg");
+        return;
+    }
+    if (!TB_PROFILE_SUPPORTED) {
+        error_setg(errp, "JIT profiling is not supported on this host");
+        return;
+    }
+    if (!has_frequency) {
+        frequency = TB_PROFILE_DEFAULT_FREQ;
+    } else if (frequency == 0 || frequency > TB_PROFILE_MAX_FREQ) {
+        error_setg(errp, "frequency must be between 1 and %d Hz",
+                   TB_PROFILE_MAX_FREQ);
+        return;
+    }
+
+#if TB_PROFILE_SUPPORTED
+    if (enable) {
+        tb_profile.running = tb_profile_start(frequency, errp);
+    } else if (tb_profile.running) {
+        tb_profile_set_timer(0, errp);
+        tb_profile.running = false;
+    }
+#endif
+}
+
+/* Recover the guest pc of TBs which do not record it, see CF_PCREL. */
+static GHashTable *tb_profile_pcrel_map(void)
+{
+    GHashTable *map = g_hash_table_new(NULL, NULL);
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        if (!jc) {
+            continue;
+        }
+        for (size_t i = 0; i < tb_jmp_cache_size(jc); i++) {
+            TranslationBlock *tb = qatomic_read(&jc->array[i].tb);
+
+            if (tb) {
+                g_hash_table_insert(map, tb, (gpointer)(uintptr_t)jc->array[i].pc);
+            }
+        }
+    }
+    return map;
+}
+
+static char *tb_profile_frame(uintptr_t host_pc, GHashTable *pcrel)
+{
+    TranslationBlock *tb;
+    const char *sym;
+    vaddr pc;
+
+    if (!in_code_gen_buffer((const void *)(host_pc - tcg_splitwx_diff))) {
+        return g_strdup("[qemu]");
+    }
+    tb = tcg_tb_lookup(host_pc);
+    if (!tb) {
+        return g_strdup("[jit]");
+    }
+    if (tb_cflags(tb) & CF_PCREL) {
+        gpointer val;
+
+        if (!g_hash_table_lookup_extended(pcrel, tb, NULL, &val)) {
+            return g_strdup_printf("[phys 0x%" PRIx64 "]",
+                                   (uint64_t)tb->page_addr[0]);
+        }
+        pc = (vaddr)(uintptr_t)val;
+    } else {
+        pc = tb->pc;
+    }
+
+    sym = lookup_symbol(pc);
+    if (*sym) {
+        return g_strdup_printf("%s;0x%" VADDR_PRIx, sym, pc);
+    }
+    return g_strdup_printf("0x%" VADDR_PRIx, pc);
+}
+
+static gint tb_profile_cmp(gconstpointer a, gconstpointer b, gpointer data)
+{
+    GHashTable *counts = data;
+    size_t ca = GPOINTER_TO_SIZE(g_hash_table_lookup(counts,
+                                                     *(char *const *)a));
+    size_t cb = GPOINTER_TO_SIZE(g_hash_table_lookup(counts,
+                                                     *(char *const *)b));
+
+    return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+/*
+ * Return the samples in the "folded stacks" format understood by
+ * flamegraph.pl and most profile viewers: one line per guest pc,
+ * prefixed with the containing guest symbol where known.
+ */
+HumanReadableText *qmp_x_query_jit_profile(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    g_autoptr(GHashTable) counts = NULL;
+    g_autoptr(GHashTable) pcrel = NULL;
+    g_autoptr(GPtrArray) keys = NULL;
+    GHashTableIter iter;
+    gpointer key;
+    size_t n;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "JIT profiling is only available with accel=tcg");
+        return NULL;
+    }
+    if (!tb_profile.samples) {
+        error_setg(errp, "JIT profiling has not been enabled");
+        return NULL;
+    }
+
+    counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    pcrel = tb_profile_pcrel_map();
+    n = MIN(qatomic_read(&tb_profile.count), TB_PROFILE_MAX_SAMPLES);
+
+    for (size_t i = 0; i < n; i++) {
+        char *frame = tb_profile_frame(tb_profile.samples[i], pcrel);
+        size_t c = GPOINTER_TO_SIZE(g_hash_table_lookup(counts, frame));
+
+        g_hash_table_insert(counts, frame, GSIZE_TO_POINTER(c + 1));
+    }
+
+    keys = g_ptr_array_sized_new(g_hash_table_size(counts));
+    g_hash_table_iter_init(&iter, counts);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        g_ptr_array_add(keys, key);
+    }
+    g_ptr_array_sort_with_data(keys, tb_profile_cmp, counts);
+    for (guint i = 0; i < keys->len; i++) {
+        const char *frame = g_ptr_array_index(keys, i);
+
+        g_string_append_printf(buf, "%s %zu\n", frame,
+                               GPOINTER_TO_SIZE(g_hash_table_lookup(counts,
+                                                                    frame)));
+    }
+
+    return human_readable_text_from_str(buf);
+}
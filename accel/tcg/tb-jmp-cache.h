@@ -9,8 +9,37 @@
 #ifndef ACCEL_TCG_TB_JMP_CACHE_H
 #define ACCEL_TCG_TB_JMP_CACHE_H
 
-#define TB_JMP_CACHE_BITS 12
-#define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#include "qemu/rcu.h"
+
+/*
+ * The size of the direct-mapped table may be selected at startup
+ * with "-accel tcg,tb-jmp-cache-bits=N".  The upper bound keeps the
+ * softmmu hash, which splits the index into page and offset halves,
+ * well-defined for the smallest supported TARGET_PAGE_BITS.
+ */
+#define TB_JMP_CACHE_BITS_MIN     8
+#define TB_JMP_CACHE_BITS_MAX     16
+#define TB_JMP_CACHE_BITS_DEFAULT 12
+
+/*
+ * Entries evicted from the direct-mapped table are kept in a small
+ * set-associative victim cache, which catches the ping-pong between
+ * a few hot TBs that happen to hash to the same slot.
+ */
+#define TB_JMP_VICTIM_SET_BITS 4
+#define TB_JMP_VICTIM_SETS     (1 << TB_JMP_VICTIM_SET_BITS)
+#define TB_JMP_VICTIM_WAYS     4
+
+typedef struct CPUJumpCacheEntry {
+    TranslationBlock *tb;
+    vaddr pc;
+} CPUJumpCacheEntry;
+
+typedef struct CPUJumpCacheStats {
+    size_t hits;
+    size_t victim_hits;
+    size_t misses;
+} CPUJumpCacheStats;
 
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
@@ -18,13 +47,37 @@
  * no need for qatomic_rcu_read() and pc is always consistent with a
  * non-NULL value of 'tb'.  Strictly speaking pc is only needed for
  * CF_PCREL, but it's used always for simplicity.
+ *
+ * The statistics are only written by the owning CPU; readers from
+ * other threads use qatomic_read() and may see slightly stale values.
+ *
+ * tb_flush() does not clear the caches of other CPUs; each CPU clears its
+ * own cache before looking up a TB after a flush, see tb_jmp_cache_sync().
  */
 struct CPUJumpCache {
     struct rcu_head rcu;
-    struct {
-        TranslationBlock *tb;
-        vaddr pc;
-    } array[TB_JMP_CACHE_SIZE];
+    unsigned bits;
+    /* The value of tb_ctx.tb_flush_count when the cache was last cleared. */
+    unsigned tb_flush_count;
+    CPUJumpCacheStats stats;
+    uint8_t victim_next[TB_JMP_VICTIM_SETS];
+    CPUJumpCacheEntry victim[TB_JMP_VICTIM_SETS][TB_JMP_VICTIM_WAYS];
+    CPUJumpCacheEntry array[];
 };
 
+static inline size_t tb_jmp_cache_size(const CPUJumpCache *jc)
+{
+    return (size_t)1 << jc->bits;
+}
+
+/*
+ * The victim set is selected by the direct-mapped index, so that all
+ * of the TBs competing for one slot land in the same set and can be
+ * swapped in and out of the slot without further hashing.
+ */
+static inline unsigned tb_jmp_victim_set(uint32_t hash)
+{
+    return hash & (TB_JMP_VICTIM_SETS - 1);
+}
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
@@ -766,10 +766,6 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     }
     did_flush = true;
 
-    CPU_FOREACH(cpu) {
-        tcg_flush_jmp_cache(cpu);
-    }
-
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     tb_remove_all();
 
@@ -777,6 +773,19 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     /* XXX: flush processor icache at this point if cache flush is expensive */
     qatomic_inc(&tb_ctx.tb_flush_count);
 
+    /*
+     * Rather than clearing the jump cache of every cpu while all of them
+     * are stopped, let each cpu clear its own on its next entry to the
+     * execution loop, in parallel.  Only the current cpu may continue
+     * executing without passing through tb_jmp_cache_sync(), when the
+     * flush is done from within tb_gen_code in a serial context.
+     */
+    tcg_flush_jmp_cache(cpu);
+    /* As in tcg_flush_jmp_cache(), the cache may not yet be allocated. */
+    if (likely(cpu->tb_jmp_cache)) {
+        cpu->tb_jmp_cache->tb_flush_count = tb_ctx.tb_flush_count;
+    }
+
 done:
     mmap_unlock();
     if (did_flush) {
@@ -884,14 +893,19 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
             tcg_flush_jmp_cache(cpu);
         }
     } else {
-        uint32_t h = tb_jmp_cache_hash_func(tb->pc);
-
         CPU_FOREACH(cpu) {
             CPUJumpCache *jc = cpu->tb_jmp_cache;
+            uint32_t h = tb_jmp_cache_hash_func(jc->bits, tb->pc);
+            unsigned set = tb_jmp_victim_set(h);
 
             if (qatomic_read(&jc->array[h].tb) == tb) {
                 qatomic_set(&jc->array[h].tb, NULL);
             }
+            for (int w = 0; w < TB_JMP_VICTIM_WAYS; w++) {
+                if (qatomic_read(&jc->victim[set][w].tb) == tb) {
+                    qatomic_set(&jc->victim[set][w].tb, NULL);
+                }
+            }
         }
     }
 }
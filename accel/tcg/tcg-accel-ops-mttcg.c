@@ -30,11 +30,16 @@
 #include "qemu/main-loop.h"
 #include "qemu/notify.h"
 #include "qemu/guest-random.h"
+#include "qemu/processor.h"
+#include "qemu/timer.h"
 #include "exec/exec-all.h"
 #include "hw/boards.h"
 #include "tcg/startup.h"
 #include "tcg-accel-ops.h"
 #include "tcg-accel-ops-mttcg.h"
+#include "tcg-accel-ops-icount.h"
+#include "internal-common.h"
+#include "trace.h"
 
 typedef struct MttcgForceRcuNotifier {
     Notifier notifier;
@@ -56,6 +61,224 @@ static void mttcg_force_rcu(Notifier *notify, void *data)
     async_run_on_cpu(cpu, do_nothing, RUN_ON_CPU_NULL);
 }
 
+static void mttcg_handle_exit(CPUState *cpu, int r)
+{
+    switch (r) {
+    case EXCP_DEBUG:
+        cpu_handle_guest_debug(cpu);
+        break;
+    case EXCP_HALTED:
+        /*
+         * Usually cpu->halted is set, but may have already been
+         * reset by another thread by the time we arrive here.
+         */
+        break;
+    case EXCP_ATOMIC:
+        bql_unlock();
+        cpu_exec_step_atomic(cpu);
+        bql_lock();
+    default:
+        /* Ignore everything else? */
+        break;
+    }
+}
+
+/*
+ * Lock-step icount
+ *
+ * With icount, all vCPUs execute the same quantum of instructions in
+ * parallel and then wait for each other.  A quantum ends at the next
+ * QEMU_CLOCK_VIRTUAL deadline at the latest, and timers only run between
+ * quanta, so virtual time and timer events depend on the instruction
+ * counts only.  A vCPU that goes idle completes its quantum early.
+ * Memory accesses and interrupts between vCPUs within a quantum are not
+ * ordered, a smaller quantum bounds how far the vCPUs drift apart.
+ *
+ * The quantum is protected by the BQL.
+ */
+static int64_t mttcg_quantum;
+
+static bool mttcg_quantum_complete(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (!cpu->icount_quantum_done && !cpu->unplug) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Called by the last vCPU to complete the quantum */
+static void mttcg_quantum_start(void)
+{
+    CPUState *cpu;
+    int64_t deadline;
+
+    icount_lockstep_advance(mttcg_quantum);
+
+    /*
+     * Run the expired main loop timers here, with the BQL held and all
+     * vCPUs stopped, so that they fire at exactly this instruction count.
+     * Timers of other AioContexts can only be kicked; while they have not
+     * run, the deadline stays at 0 and the next quantum is empty.
+     */
+    qemu_clock_run_timers(QEMU_CLOCK_VIRTUAL);
+    icount_handle_deadline();
+
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                          QEMU_TIMER_ATTR_ALL);
+    mttcg_quantum = mttcg_icount_quantum;
+    if (deadline >= 0) {
+        mttcg_quantum = MIN(mttcg_quantum, icount_round(deadline));
+    }
+    trace_mttcg_quantum_start(mttcg_quantum);
+
+    CPU_FOREACH(cpu) {
+        cpu->icount_quantum_done = false;
+        qemu_cond_broadcast(cpu->halt_cond);
+    }
+}
+
+static void mttcg_icount_exec(CPUState *cpu)
+{
+    if (cpu_can_run(cpu) && !cpu->icount_quantum_done) {
+        int64_t budget = mttcg_quantum - cpu->icount_quantum;
+
+        if (budget > 0 && !cpu_thread_is_idle(cpu)) {
+            int insns_left = MIN(0xffff, budget);
+            int r;
+
+            g_assert(cpu->neg.icount_decr.u16.low == 0);
+            g_assert(cpu->icount_extra == 0);
+            cpu->icount_budget = budget;
+            cpu->neg.icount_decr.u16.low = insns_left;
+            cpu->icount_extra = budget - insns_left;
+
+            bql_unlock();
+            r = tcg_cpu_exec(cpu);
+            icount_process_data(cpu);
+            bql_lock();
+            mttcg_handle_exit(cpu, r);
+        }
+
+        if (cpu->icount_quantum >= mttcg_quantum ||
+            (cpu_can_run(cpu) && cpu_thread_is_idle(cpu))) {
+            cpu->icount_quantum_done = true;
+            if (mttcg_quantum_complete()) {
+                mttcg_quantum_start();
+            }
+        }
+    }
+
+    qatomic_set_mb(&cpu->exit_request, 0);
+
+    /*
+     * Unlike qemu_wait_io_event(), do not sleep while halted: an idle
+     * vCPU still has to go through the quanta.
+     */
+    while ((cpu->icount_quantum_done || !cpu_can_run(cpu)) &&
+           !cpu->stop && !cpu->unplug && cpu_work_list_empty(cpu)) {
+        qemu_cond_wait_bql(cpu->halt_cond);
+    }
+    qemu_wait_io_event_common(cpu);
+}
+
+/*
+ * Halt polling
+ *
+ * Before an idle vCPU thread sleeps on its halt condition, it can spin
+ * for a while without the BQL, waiting for a kick.  Every wakeup goes
+ * through qemu_cpu_kick(), which for MTTCG sets cpu->exit_request, so
+ * polling that flag is enough.  Waking up from the poll loop avoids the
+ * futex sleep and wakeup in qemu_cond_wait().
+ *
+ * The polling window adapts as in KVM: it grows when the vCPU was woken
+ * up shortly after it went to sleep, and shrinks when the vCPU stayed
+ * idle for longer than the maximum window, so that idle guests do not
+ * burn host CPU time.
+ */
+#define MTTCG_HALT_POLL_NS_START 10000
+
+static void mttcg_halt_poll_adjust(CPUState *cpu, int64_t block_ns)
+{
+    uint32_t window = cpu->halt_poll_ns;
+
+    if (block_ns <= tcg_halt_poll_ns) {
+        window = window ? MIN((uint64_t)window * 2, tcg_halt_poll_ns)
+                        : MIN(MTTCG_HALT_POLL_NS_START, tcg_halt_poll_ns);
+    } else {
+        window /= 2;
+        if (window < MTTCG_HALT_POLL_NS_START) {
+            window = 0;
+        }
+    }
+
+    if (window != cpu->halt_poll_ns) {
+        trace_mttcg_halt_poll_adjust(cpu->cpu_index, cpu->halt_poll_ns,
+                                     window, block_ns);
+        cpu->halt_poll_ns = window;
+    }
+}
+
+/* Only the vCPU thread updates its counters, query-stats reads them */
+static void mttcg_halt_poll_stat_add(uint64_t *stat, uint64_t val)
+{
+    qatomic_set_u64(stat, *stat + val);
+}
+
+/* Returns true if the vCPU was kicked while polling. */
+static bool mttcg_halt_poll(CPUState *cpu, int64_t start)
+{
+    int64_t end = start + cpu->halt_poll_ns;
+    bool kicked = false;
+
+    bql_unlock();
+    do {
+        if (qatomic_read(&cpu->exit_request)) {
+            kicked = true;
+            break;
+        }
+        cpu_relax();
+    } while (get_clock() < end);
+    bql_lock();
+
+    return kicked;
+}
+
+static void mttcg_wait_io_event(CPUState *cpu)
+{
+    int64_t start, now;
+    bool kicked;
+
+    if (!tcg_halt_poll_ns || !cpu_thread_is_idle(cpu)) {
+        qemu_wait_io_event(cpu);
+        return;
+    }
+
+    start = get_clock();
+    if (cpu->halt_poll_ns) {
+        mttcg_halt_poll_stat_add(&cpu->halt_poll_stats.attempted, 1);
+        kicked = mttcg_halt_poll(cpu, start);
+        now = get_clock();
+
+        if (kicked && !cpu_thread_is_idle(cpu)) {
+            mttcg_halt_poll_stat_add(&cpu->halt_poll_stats.successful, 1);
+            mttcg_halt_poll_stat_add(&cpu->halt_poll_stats.success_ns,
+                                     now - start);
+            qemu_wait_io_event(cpu);
+            return;
+        }
+        mttcg_halt_poll_stat_add(&cpu->halt_poll_stats.fail_ns, now - start);
+    }
+
+    qemu_wait_io_event(cpu);
+
+    mttcg_halt_poll_stat_add(&cpu->halt_poll_stats.wakeups, 1);
+    mttcg_halt_poll_adjust(cpu, get_clock() - start);
+}
+
 /*
  * In the multi-threaded case each vCPU has its own thread. The TLS
  * variable current_cpu can be used deep in the code to find the
@@ -68,7 +291,6 @@ static void *mttcg_cpu_thread_fn(void *arg)
     CPUState *cpu = arg;
 
     assert(tcg_enabled());
-    g_assert(!icount_enabled());
 
     rcu_register_thread();
     force_rcu.notifier.notify = mttcg_force_rcu;
@@ -89,35 +311,27 @@ static void *mttcg_cpu_thread_fn(void *arg)
     cpu->exit_request = 1;
 
     do {
+        if (icount_enabled()) {
+            mttcg_icount_exec(cpu);
+            continue;
+        }
+
         if (cpu_can_run(cpu)) {
             int r;
             bql_unlock();
             r = tcg_cpu_exec(cpu);
             bql_lock();
-            switch (r) {
-            case EXCP_DEBUG:
-                cpu_handle_guest_debug(cpu);
-                break;
-            case EXCP_HALTED:
-                /*
-                 * Usually cpu->halted is set, but may have already been
-                 * reset by another thread by the time we arrive here.
-                 */
-                break;
-            case EXCP_ATOMIC:
-                bql_unlock();
-                cpu_exec_step_atomic(cpu);
-                bql_lock();
-            default:
-                /* Ignore everything else? */
-                break;
-            }
+            mttcg_handle_exit(cpu, r);
         }
 
         qatomic_set_mb(&cpu->exit_request, 0);
-        qemu_wait_io_event(cpu);
+        mttcg_wait_io_event(cpu);
     } while (!cpu->unplug || cpu_can_run(cpu));
 
+    if (icount_enabled() && mttcg_quantum_complete()) {
+        /* Do not leave the other vCPUs waiting for this one */
+        mttcg_quantum_start();
+    }
     tcg_cpu_destroy(cpu);
     bql_unlock();
     rcu_remove_force_rcu_notifier(&force_rcu.notifier);
@@ -38,7 +38,9 @@
 #if !defined(CONFIG_USER_ONLY)
 #include "hw/boards.h"
 #endif
+#include "internal-common.h"
 #include "internal-target.h"
+#include "tb-jmp-cache.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -47,6 +49,10 @@ struct TCGState {
     bool one_insn_per_tb;
     int splitwx_enabled;
     unsigned long tb_size;
+    uint8_t tb_jmp_cache_bits;
+    uint32_t hot_tb_threshold;
+    uint32_t icount_quantum;
+    uint32_t halt_poll_ns;
 };
 typedef struct TCGState TCGState;
 
@@ -95,10 +101,16 @@ static void tcg_accel_instance_init(Object *obj)
 #else
     s->splitwx_enabled = 0;
 #endif
+    s->tb_jmp_cache_bits = TB_JMP_CACHE_BITS_DEFAULT;
+    s->icount_quantum = MTTCG_ICOUNT_QUANTUM_DEFAULT;
 }
 
 bool mttcg_enabled;
 bool one_insn_per_tb;
+unsigned tb_jmp_cache_bits = TB_JMP_CACHE_BITS_DEFAULT;
+uint32_t tb_hot_threshold;
+uint32_t mttcg_icount_quantum;
+uint32_t tcg_halt_poll_ns;
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -111,6 +123,16 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tb_jmp_cache_bits = s->tb_jmp_cache_bits;
+    tb_hot_threshold = s->hot_tb_threshold;
+    mttcg_icount_quantum = s->icount_quantum;
+    tcg_halt_poll_ns = s->halt_poll_ns;
+
+#ifndef CONFIG_USER_ONLY
+    if (mttcg_enabled && icount_enabled()) {
+        icount_enable_lockstep();
+    }
+#endif
 
     page_init();
     tb_htable_init();
@@ -141,8 +163,10 @@ static void tcg_set_thread(Object *obj, const char *value, Error **errp)
     if (strcmp(value, "multi") == 0) {
         if (TCG_OVERSIZED_GUEST) {
             error_setg(errp, "No MTTCG when guest word size > hosts");
-        } else if (icount_enabled()) {
-            error_setg(errp, "No MTTCG when icount is enabled");
+        } else if (icount_enabled() == ICOUNT_ADAPTATIVE ||
+                   replay_mode != REPLAY_MODE_NONE) {
+            error_setg(errp, "MTTCG with icount requires a fixed shift "
+                       "and no record/replay");
         } else {
 #ifndef TARGET_SUPPORTS_MTTCG
             warn_report("Guest not yet converted to MTTCG - "
@@ -181,6 +205,111 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_tb_jmp_cache_bits(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint8_t value = s->tb_jmp_cache_bits;
+
+    visit_type_uint8(v, name, &value, errp);
+}
+
+static void tcg_set_tb_jmp_cache_bits(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint8_t value;
+
+    if (!visit_type_uint8(v, name, &value, errp)) {
+        return;
+    }
+    if (value < TB_JMP_CACHE_BITS_MIN || value > TB_JMP_CACHE_BITS_MAX) {
+        error_setg(errp, "tb-jmp-cache-bits must be between %d and %d",
+                   TB_JMP_CACHE_BITS_MIN, TB_JMP_CACHE_BITS_MAX);
+        return;
+    }
+
+    s->tb_jmp_cache_bits = value;
+}
+
+static void tcg_get_hot_tb_threshold(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->hot_tb_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_hot_tb_threshold(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->hot_tb_threshold = value;
+}
+
+static void tcg_get_icount_quantum(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->icount_quantum;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_icount_quantum(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value == 0) {
+        error_setg(errp, "icount-quantum must be at least 1");
+        return;
+    }
+
+    s->icount_quantum = value;
+}
+
+static void tcg_get_halt_poll_ns(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->halt_poll_ns;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_halt_poll_ns(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->halt_poll_ns = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -242,6 +371,33 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add(oc, "tb-jmp-cache-bits", "uint8",
+        tcg_get_tb_jmp_cache_bits, tcg_set_tb_jmp_cache_bits,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tb-jmp-cache-bits",
+        "log2 of the number of per-vCPU TB jump cache entries");
+
+    object_class_property_add(oc, "hot-tb-threshold", "uint32",
+        tcg_get_hot_tb_threshold, tcg_set_hot_tb_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "hot-tb-threshold",
+        "Number of non-chained entries after which a TB is counted as hot"
+        " (0 disables counting)");
+
+    object_class_property_add(oc, "icount-quantum", "uint32",
+        tcg_get_icount_quantum, tcg_set_icount_quantum,
+        NULL, NULL);
+    object_class_property_set_description(oc, "icount-quantum",
+        "Instructions each vCPU executes between synchronizations"
+        " with multi-threaded icount");
+
+    object_class_property_add(oc, "halt-poll-ns", "uint32",
+        tcg_get_halt_poll_ns, tcg_set_halt_poll_ns,
+        NULL, NULL);
+    object_class_property_set_description(oc, "halt-poll-ns",
+        "Maximum time an idle vCPU thread polls for wakeups before"
+        " sleeping, with multi-threaded TCG (0 disables polling)");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
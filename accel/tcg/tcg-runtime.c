@@ -152,3 +152,13 @@ void HELPER(exit_atomic)(CPUArchState *env)
 {
     cpu_loop_exit_atomic(env_cpu(env), GETPC());
 }
+
+#ifdef CONFIG_USER_ONLY
+void HELPER(native_call)(CPUArchState *env)
+{
+    CPUState *cs = env_cpu(env);
+
+    cs->exception_index = EXCP_NATIVE;
+    cpu_loop_exit_restore(cs, GETPC());
+}
+#endif
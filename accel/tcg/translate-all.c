@@ -52,6 +52,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/cacheinfo.h"
 #include "qemu/timer.h"
+#include "qemu/stats-counter.h"
 #include "exec/log.h"
 #include "sysemu/cpus.h"
 #include "sysemu/cpu-timers.h"
@@ -68,6 +69,9 @@
 
 TBContext tb_ctx;
 
+STATS_COUNTER_DEFINE(tb_translations, "tb-translations");
+STATS_COUNTER_DEFINE(tb_translation_ns, "tb-translation-ns");
+
 /*
  * Encode VAL as a signed leb128 sequence at P.
  * Return P incremented past the encoded value.
@@ -268,11 +272,13 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
                            vaddr pc, void *host_pc,
                            int *max_insns, int64_t *ti)
 {
+    int64_t start;
     int ret = sigsetjmp(tcg_ctx->jmp_trans, 0);
     if (unlikely(ret != 0)) {
         return ret;
     }
 
+    start = get_clock();
     tcg_func_start(tcg_ctx);
 
     tcg_ctx->cpu = env_cpu(env);
@@ -281,7 +287,9 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     tcg_ctx->cpu = NULL;
     *max_insns = tb->icount;
 
-    return tcg_gen_code(tcg_ctx, tb, pc);
+    ret = tcg_gen_code(tcg_ctx, tb, pc);
+    stats_counter_add(&tb_translation_ns, get_clock() - start);
+    return ret;
 }
 
 /* Called with mmap_lock held for user mode emulation.  */
@@ -299,6 +307,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
     assert_memory_lock();
     qemu_thread_jit_write();
+    stats_counter_inc(&tb_translations);
 
     phys_pc = get_page_addr_code_hostp(env, pc, &host_pc);
 
@@ -333,6 +342,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
+    tb->exec_count = 0;
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
@@ -669,7 +679,12 @@ void tcg_flush_jmp_cache(CPUState *cpu)
         return;
     }
 
-    for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+    for (size_t i = 0, n = tb_jmp_cache_size(jc); i < n; i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
+    for (int i = 0; i < TB_JMP_VICTIM_SETS; i++) {
+        for (int w = 0; w < TB_JMP_VICTIM_WAYS; w++) {
+            qatomic_set(&jc->victim[i][w].tb, NULL);
+        }
+    }
 }
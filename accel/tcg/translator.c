@@ -112,6 +112,32 @@ static void gen_tb_end(const TranslationBlock *tb, uint32_t cflags,
     }
 }
 
+#ifdef CONFIG_USER_ONLY
+/* Guest addresses registered with translator_add_native_pc() */
+static GHashTable *native_pcs;
+
+void translator_add_native_pc(vaddr pc)
+{
+    if (!native_pcs) {
+        native_pcs = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                           g_free, NULL);
+    }
+    g_hash_table_add(native_pcs, g_memdup2(&pc, sizeof(pc)));
+}
+
+static bool is_native_pc(vaddr pc)
+{
+    uint64_t key = pc;
+
+    return unlikely(native_pcs) && g_hash_table_contains(native_pcs, &key);
+}
+#else
+static bool is_native_pc(vaddr pc)
+{
+    return false;
+}
+#endif
+
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
 {
     /* Suppress goto_tb if requested. */
@@ -155,6 +181,12 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     db->plugin_enabled = plugin_enabled;
 
     while (true) {
+        /* A native function must start its own TB, see below.  */
+        if (db->num_insns && is_native_pc(db->pc_next)) {
+            db->is_jmp = DISAS_TOO_MANY;
+            break;
+        }
+
         *max_insns = ++db->num_insns;
         ops->insn_start(db, cpu);
         tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
@@ -163,6 +195,21 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
             plugin_gen_insn_start(cpu, db);
         }
 
+        /*
+         * Leave the call of a native function to the cpu loop.  The
+         * byte of guest code that is pretended to be translated keeps
+         * the TB size and range non-empty.
+         */
+        if (is_native_pc(db->pc_next)) {
+            gen_helper_native_call(tcg_env);
+            db->pc_next++;
+            db->is_jmp = DISAS_NORETURN;
+            if (plugin_enabled) {
+                plugin_gen_insn_end();
+            }
+            break;
+        }
+
         /*
          * Disassemble one instruction.  The translate_insn hook should
          * update db->pc_next and db->is_jmp to indicate what should be
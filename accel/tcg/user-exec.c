@@ -23,17 +23,63 @@
 #include "tcg/tcg.h"
 #include "qemu/bitops.h"
 #include "qemu/rcu.h"
+#include "qemu/seqlock.h"
 #include "exec/cpu_ldst.h"
 #include "exec/translate-all.h"
 #include "exec/helper-proto.h"
 #include "qemu/atomic128.h"
+#include "qemu/stats-counter.h"
 #include "trace/trace-root.h"
 #include "tcg/tcg-ldst.h"
 #include "internal-common.h"
 #include "internal-target.h"
+#include "tb-jmp-cache.h"
 
 __thread uintptr_t helper_retaddr;
 
+static bool tcg_user_stats;
+
+void tcg_user_stats_enable(void)
+{
+    tcg_user_stats = true;
+}
+
+static void tcg_user_stats_print(const char *name, uint64_t value,
+                                 void *opaque)
+{
+    fprintf(opaque, "tcg-stats: %s %" PRIu64 "\n", name, value);
+}
+
+/*
+ * Print the always-on counters and the jump cache statistics, one
+ * "tcg-stats: name value" line each, for tests/bench/tcg.  The jump
+ * cache counts only cover the threads that are still running.
+ */
+void tcg_user_stats_exit(void)
+{
+    CPUState *cpu;
+    uint64_t hit = 0, victim = 0, miss = 0;
+
+    if (!tcg_user_stats) {
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        if (jc) {
+            hit += qatomic_read(&jc->stats.hits);
+            victim += qatomic_read(&jc->stats.victim_hits);
+            miss += qatomic_read(&jc->stats.misses);
+        }
+    }
+
+    stats_counter_foreach(tcg_user_stats_print, stderr);
+    tcg_user_stats_print("tb-jmp-cache-hits", hit, stderr);
+    tcg_user_stats_print("tb-jmp-cache-victim-hits", victim, stderr);
+    tcg_user_stats_print("tb-jmp-cache-misses", miss, stderr);
+}
+
 //#define DEBUG_SIGNAL
 
 /*
@@ -145,6 +191,13 @@ typedef struct PageFlagsNode {
 
 static IntervalTreeRoot pageflags_root;
 
+/*
+ * Changes to pageflags_root are made with the mmap_lock held, and are
+ * wrapped in pageflags_seq so that lockless lookups can tell whether
+ * they may have missed a node.
+ */
+static QemuSeqLock pageflags_seq;
+
 static PageFlagsNode *pageflags_find(target_ulong start, target_ulong last)
 {
     IntervalTreeNode *n;
@@ -153,6 +206,28 @@ static PageFlagsNode *pageflags_find(target_ulong start, target_ulong last)
     return n ? container_of(n, PageFlagsNode, itree) : NULL;
 }
 
+/*
+ * Like pageflags_find, but also safe without the mmap_lock.  See
+ * util/interval-tree.c re lockless lookups: no false positives but
+ * there are false negatives while the tree is being modified.  Retry
+ * until the tree was stable for the whole lookup, instead of waiting
+ * for the mmap_lock behind unrelated mmap and munmap calls.
+ */
+static PageFlagsNode *pageflags_lookup(target_ulong start, target_ulong last)
+{
+    PageFlagsNode *p;
+    unsigned seq;
+
+    if (have_mmap_lock()) {
+        return pageflags_find(start, last);
+    }
+    do {
+        seq = seqlock_read_begin(&pageflags_seq);
+        p = pageflags_find(start, last);
+    } while (!p && seqlock_read_retry(&pageflags_seq, seq));
+    return p;
+}
+
 static PageFlagsNode *pageflags_next(PageFlagsNode *p, target_ulong start,
                                      target_ulong last)
 {
@@ -208,23 +283,8 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageFlagsNode *p = pageflags_find(address, address);
-
-    /*
-     * See util/interval-tree.c re lockless lookups: no false positives but
-     * there are false negatives.  If we find nothing, retry with the mmap
-     * lock acquired.
-     */
-    if (p) {
-        return p->flags;
-    }
-    if (have_mmap_lock()) {
-        return 0;
-    }
+    PageFlagsNode *p = pageflags_lookup(address, address);
 
-    mmap_lock();
-    p = pageflags_find(address, address);
-    mmap_unlock();
     return p ? p->flags : 0;
 }
 
@@ -510,12 +570,16 @@ void page_set_flags(target_ulong start, target_ulong last, int flags)
 
     if (!flags || reset) {
         page_reset_target_data(start, last);
+    }
+    seqlock_write_begin(&pageflags_seq);
+    if (!flags || reset) {
         inval_tb |= pageflags_unset(start, last);
     }
     if (flags) {
         inval_tb |= pageflags_set_clear(start, last, flags,
                                         ~(reset ? 0 : PAGE_STICKY));
     }
+    seqlock_write_end(&pageflags_seq);
     if (inval_tb) {
         tb_invalidate_phys_range(start, last);
     }
@@ -524,7 +588,6 @@ void page_set_flags(target_ulong start, target_ulong last, int flags)
 bool page_check_range(target_ulong start, target_ulong len, int flags)
 {
     target_ulong last;
-    int locked;  /* tri-state: =0: unlocked, +1: global, -1: local */
     bool ret;
 
     if (len == 0) {
@@ -536,25 +599,13 @@ bool page_check_range(target_ulong start, target_ulong len, int flags)
         return false; /* wrap around */
     }
 
-    locked = have_mmap_lock();
     while (true) {
-        PageFlagsNode *p = pageflags_find(start, last);
+        PageFlagsNode *p = pageflags_lookup(start, last);
         int missing;
 
         if (!p) {
-            if (!locked) {
-                /*
-                 * Lockless lookups have false negatives.
-                 * Retry with the lock held.
-                 */
-                mmap_lock();
-                locked = -1;
-                p = pageflags_find(start, last);
-            }
-            if (!p) {
-                ret = false; /* entire region invalid */
-                break;
-            }
+            ret = false; /* entire region invalid */
+            break;
         }
         if (start < p->itree.start) {
             ret = false; /* initial bytes invalid */
@@ -591,11 +642,6 @@ bool page_check_range(target_ulong start, target_ulong len, int flags)
         }
         start = p->itree.last + 1;
     }
-
-    /* Release the lock if acquired locally. */
-    if (locked < 0) {
-        mmap_unlock();
-    }
     return ret;
 }
 
@@ -678,7 +724,9 @@ void page_protect(tb_page_addr_t address)
     }
 
     if (prot & PAGE_WRITE) {
+        seqlock_write_begin(&pageflags_seq);
         pageflags_set_clear(start, last, 0, PAGE_WRITE);
+        seqlock_write_end(&pageflags_seq);
         mprotect(g2h_untagged(start), qemu_host_page_size,
                  prot & (PAGE_READ | PAGE_EXEC) ? PROT_READ : PROT_NONE);
     }
@@ -732,7 +780,9 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             start = address & TARGET_PAGE_MASK;
             len = TARGET_PAGE_SIZE;
             prot = p->flags | PAGE_WRITE;
+            seqlock_write_begin(&pageflags_seq);
             pageflags_set_clear(start, start + len - 1, PAGE_WRITE, 0);
+            seqlock_write_end(&pageflags_seq);
             current_tb_invalidated = tb_invalidate_phys_page_unwind(start, pc);
         } else {
             start = address & qemu_host_page_mask;
@@ -747,8 +797,10 @@ int page_unprotect(target_ulong address, uintptr_t pc)
                     prot |= p->flags;
                     if (p->flags & PAGE_WRITE_ORG) {
                         prot |= PAGE_WRITE;
+                        seqlock_write_begin(&pageflags_seq);
                         pageflags_set_clear(addr, addr + TARGET_PAGE_SIZE - 1,
                                             PAGE_WRITE, 0);
+                        seqlock_write_end(&pageflags_seq);
                     }
                 }
                 /*
@@ -1221,7 +1273,8 @@ uint64_t cpu_ldq_code_mmu(CPUArchState *env, abi_ptr addr,
 #include "ldst_common.c.inc"
 
 /*
- * Do not allow unaligned operations to proceed.  Return the host address.
+ * Do not allow unaligned operations that cannot be widened to proceed.
+ * Return the host address.
  */
 static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
                                int size, uintptr_t retaddr)
@@ -1236,7 +1289,8 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
     }
 
     /* Enforce qemu required alignment.  */
-    if (unlikely(addr & (size - 1))) {
+    if (unlikely(addr & (size - 1)) &&
+        !atomic_unaligned_block_size(addr, size)) {
         cpu_loop_exit_atomic(cpu, retaddr);
     }
 
@@ -20,6 +20,9 @@
 #include "qom/object_interfaces.h"
 #include "qemu/mmap-alloc.h"
 #include "qemu/madvise.h"
+#include "qemu/error-report.h"
+#include "sysemu/reset.h"
+#include "sysemu/runstate.h"
 
 #ifdef CONFIG_NUMA
 #include <numaif.h>
@@ -226,6 +229,12 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
         return;
     }
 
+    if (backend->discard_on_reset && value) {
+        error_setg(errp,
+                   "'prealloc=on' and 'discard-on-reset=on' are incompatible");
+        return;
+    }
+
     if (!host_memory_backend_mr_inited(backend)) {
         backend->prealloc = value;
         return;
@@ -237,7 +246,7 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
         uint64_t sz = memory_region_size(&backend->mr);
 
         if (!qemu_prealloc_mem(fd, ptr, sz, backend->prealloc_threads,
-                               backend->prealloc_context, errp)) {
+                               backend->prealloc_context, false, errp)) {
             return;
         }
         backend->prealloc = true;
@@ -285,6 +294,40 @@ static void host_memory_backend_post_init(Object *obj)
     object_apply_compat_props(obj);
 }
 
+/*
+ * Give the memory back on system reset, so that the guest reboots with
+ * zeroed memory as after a restart of QEMU.  Only populated pages are
+ * touched; they are faulted in again lazily, as zero pages.
+ */
+static void host_memory_backend_reset(void *opaque)
+{
+    HostMemoryBackend *backend = opaque;
+    RAMBlock *rb = backend->mr.ram_block;
+
+    /* Don't throw away what was loaded into the memory before the first boot */
+    if (runstate_check(RUN_STATE_PRELAUNCH) ||
+        runstate_check(RUN_STATE_INMIGRATE)) {
+        return;
+    }
+
+    if (ram_block_discard_is_disabled()) {
+        warn_report_once("'discard-on-reset' is ignored while RAM discards "
+                         "are disabled");
+        return;
+    }
+
+    ram_block_discard_range(rb, 0, qemu_ram_get_used_length(rb));
+}
+
+static void host_memory_backend_finalize(Object *obj)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    if (backend->discard_on_reset && host_memory_backend_mr_inited(backend)) {
+        qemu_unregister_reset(host_memory_backend_reset, backend);
+    }
+}
+
 bool host_memory_backend_mr_inited(HostMemoryBackend *backend)
 {
     /*
@@ -397,13 +440,21 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
     /*
      * Preallocate memory after the NUMA policy has been instantiated.
      * This is necessary to guarantee memory is allocated with
-     * specified NUMA policy in place.
+     * specified NUMA policy in place.  Backends created on the command line
+     * preallocate asynchronously, see qemu_create_cli_devices().
      */
-    if (backend->prealloc && !qemu_prealloc_mem(memory_region_get_fd(&backend->mr),
-                                                ptr, sz,
-                                                backend->prealloc_threads,
-                                                backend->prealloc_context, errp)) {
-        return;
+    if (backend->prealloc) {
+        bool async = !phase_check(PHASE_LATE_BACKENDS_CREATED);
+
+        if (!qemu_prealloc_mem(memory_region_get_fd(&backend->mr), ptr, sz,
+                               backend->prealloc_threads,
+                               backend->prealloc_context, async, errp)) {
+            return;
+        }
+    }
+
+    if (backend->discard_on_reset) {
+        qemu_register_reset_nosnapshotload(host_memory_backend_reset, backend);
     }
 }
 
@@ -459,6 +510,30 @@ static void host_memory_backend_set_reserve(Object *o, bool value, Error **errp)
 }
 #endif /* CONFIG_LINUX */
 
+static bool host_memory_backend_get_discard_on_reset(Object *o, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(o);
+
+    return backend->discard_on_reset;
+}
+
+static void host_memory_backend_set_discard_on_reset(Object *o, bool value,
+                                                     Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(o);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property value");
+        return;
+    }
+    if (backend->prealloc && value) {
+        error_setg(errp,
+                   "'prealloc=on' and 'discard-on-reset=on' are incompatible");
+        return;
+    }
+    backend->discard_on_reset = value;
+}
+
 static bool
 host_memory_backend_get_use_canonical_path(Object *obj, Error **errp)
 {
@@ -538,6 +613,11 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "reserve",
         "Reserve swap space (or huge pages) if applicable");
 #endif /* CONFIG_LINUX */
+    object_class_property_add_bool(oc, "discard-on-reset",
+        host_memory_backend_get_discard_on_reset,
+        host_memory_backend_set_discard_on_reset);
+    object_class_property_set_description(oc, "discard-on-reset",
+        "Discard the memory contents on system reset");
     /*
      * Do not delete/rename option. This option must be considered stable
      * (as if it didn't have the 'x-' prefix including deprecation period) as
@@ -562,6 +642,7 @@ static const TypeInfo host_memory_backend_info = {
     .instance_size = sizeof(HostMemoryBackend),
     .instance_init = host_memory_backend_init,
     .instance_post_init = host_memory_backend_post_init,
+    .instance_finalize = host_memory_backend_finalize,
     .interfaces = (InterfaceInfo[]) {
         { TYPE_USER_CREATABLE },
         { }
@@ -452,6 +452,40 @@ static BlockDriver *bdrv_do_find_format(const char *format_name)
     return NULL;
 }
 
+/*
+ * Let the driver of @options start connecting to its server before the node
+ * is opened with these options.  Used where many nodes are opened in a row,
+ * followed by bdrv_preconnect_cleanup().
+ */
+void bdrv_preconnect(BlockdevOptions *options)
+{
+    const char *format_name = BlockdevDriver_str(options->driver);
+    BlockDriver *drv;
+
+    GLOBAL_STATE_CODE();
+
+    QLIST_FOREACH(drv, &bdrv_drivers, list) {
+        if (!strcmp(drv->format_name, format_name) && drv->bdrv_preconnect) {
+            drv->bdrv_preconnect(options);
+            return;
+        }
+    }
+}
+
+/* Drop the connections of bdrv_preconnect() that no node picked up */
+void bdrv_preconnect_cleanup(void)
+{
+    BlockDriver *drv;
+
+    GLOBAL_STATE_CODE();
+
+    QLIST_FOREACH(drv, &bdrv_drivers, list) {
+        if (drv->bdrv_preconnect_cleanup) {
+            drv->bdrv_preconnect_cleanup();
+        }
+    }
+}
+
 BlockDriver *bdrv_find_format(const char *format_name)
 {
     BlockDriver *drv1;
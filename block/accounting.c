@@ -26,6 +26,7 @@
 #include "qemu/osdep.h"
 #include "block/accounting.h"
 #include "block/block_int.h"
+#include "qemu/host-utils.h"
 #include "qemu/timer.h"
 #include "sysemu/qtest.h"
 
@@ -200,6 +201,73 @@ void block_latency_histograms_clear(BlockAcctStats *stats)
     }
 }
 
+static unsigned block_latency_log_index(uint64_t latency_ns)
+{
+    unsigned shift;
+
+    if (latency_ns < (1 << BLOCK_LATENCY_LOG_SUB_BITS)) {
+        return latency_ns;
+    }
+
+    shift = 63 - clz64(latency_ns) - BLOCK_LATENCY_LOG_SUB_BITS;
+    return ((shift + 1) << BLOCK_LATENCY_LOG_SUB_BITS) |
+           ((latency_ns >> shift) & ((1 << BLOCK_LATENCY_LOG_SUB_BITS) - 1));
+}
+
+/* Return the largest latency that falls in bucket @idx */
+static uint64_t block_latency_log_upper(unsigned idx)
+{
+    unsigned shift;
+    uint64_t low;
+
+    if (idx < (1 << BLOCK_LATENCY_LOG_SUB_BITS)) {
+        return idx;
+    }
+
+    shift = (idx >> BLOCK_LATENCY_LOG_SUB_BITS) - 1;
+    low = (uint64_t)((1 << BLOCK_LATENCY_LOG_SUB_BITS) |
+                     (idx & ((1 << BLOCK_LATENCY_LOG_SUB_BITS) - 1))) << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+/*
+ * Return the latency below which @per_mille thousandths of the requests
+ * of @type completed, or 0 if none did.
+ */
+uint64_t block_acct_latency_percentile(BlockAcctStats *stats,
+                                       enum BlockAcctType type,
+                                       unsigned per_mille)
+{
+    uint64_t *bins = stats->latency_log[type];
+    uint64_t total = 0, rank, sum = 0;
+    unsigned i;
+
+    assert(type < BLOCK_MAX_IOTYPE);
+    assert(per_mille <= 1000);
+
+    QEMU_LOCK_GUARD(&stats->lock);
+
+    for (i = 0; i < BLOCK_LATENCY_LOG_BUCKETS; i++) {
+        total += bins[i];
+    }
+    if (!total) {
+        return 0;
+    }
+
+    /* ceil(total * per_mille / 1000) without overflowing */
+    rank = (total / 1000) * per_mille +
+           DIV_ROUND_UP((total % 1000) * per_mille, 1000);
+    rank = MAX(rank, 1);
+
+    for (i = 0; i < BLOCK_LATENCY_LOG_BUCKETS; i++) {
+        sum += bins[i];
+        if (sum >= rank) {
+            break;
+        }
+    }
+    return block_latency_log_upper(i);
+}
+
 static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
                                  bool failed)
 {
@@ -230,6 +298,8 @@ static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
 
         if (!failed || stats->account_failed) {
             stats->total_time_ns[cookie->type] += latency_ns;
+            stats->latency_log[cookie->type]
+                [block_latency_log_index(MAX(latency_ns, 0))]++;
             stats->last_access_time_ns = time_ns;
 
             QSLIST_FOREACH(s, &stats->intervals, entries) {
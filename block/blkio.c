@@ -233,6 +233,9 @@ static void blkio_completion_fd_read(void *opaque)
     uint64_t val;
     int ret;
 
+    /* Batch guest notifications and new submissions from aio_co_wake() */
+    defer_call_begin();
+
     /* Polling may have already fetched a completion */
     if (s->poll_completion.user_data != NULL) {
         BlkioCoData *cod = s->poll_completion.user_data;
@@ -269,6 +272,8 @@ static void blkio_completion_fd_read(void *opaque)
         cod->ret = completion.ret;
         aio_co_wake(cod->coroutine);
     }
+
+    defer_call_end();
 }
 
 static bool blkio_completion_fd_poll(void *opaque)
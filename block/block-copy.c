@@ -36,6 +36,15 @@
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
 
+/*
+ * Guest writes that stall on copy-before-write tend to come back to the
+ * same areas of the disk.  Remember the few zones that were hit most
+ * recently, and let background copying empty them first.
+ */
+#define BLOCK_COPY_HEAT_ZONES 8
+#define BLOCK_COPY_HEAT_ZONE_CLUSTERS 256
+#define BLOCK_COPY_HEAT_DECAY 64
+
 typedef enum {
     COPY_READ_WRITE_CLUSTER,
     COPY_READ_WRITE,
@@ -54,6 +63,11 @@ typedef struct BlockCopyCallState {
     int max_workers;
     int64_t max_chunk;
     bool ignore_ratelimit;
+    /*
+     * Background calls copy hot zones first; the others are waited for by
+     * a guest write and heat up the zones they touch.
+     */
+    bool background;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
     /* Coroutine where async block-copy is running */
@@ -112,6 +126,11 @@ static int64_t task_end(BlockCopyTask *task)
     return task->req.offset + task->req.bytes;
 }
 
+typedef struct BlockCopyHeatZone {
+    int64_t offset;
+    unsigned heat; /* 0 means that the slot is free */
+} BlockCopyHeatZone;
+
 typedef struct BlockCopyState {
     /*
      * BdrvChild objects are not owned or managed by block-copy. They are
@@ -139,6 +158,8 @@ typedef struct BlockCopyState {
     BlockCopyMethod method;
     BlockReqList reqs;
     QLIST_HEAD(, BlockCopyCallState) calls;
+    BlockCopyHeatZone heat_zones[BLOCK_COPY_HEAT_ZONES];
+    unsigned heat_events;
     /*
      * skip_unallocated:
      *
@@ -180,25 +201,112 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
     }
 }
 
+static int64_t block_copy_heat_zone_size(BlockCopyState *s)
+{
+    return s->cluster_size * BLOCK_COPY_HEAT_ZONE_CLUSTERS;
+}
+
+/* Called with lock held */
+static void block_copy_heat_note(BlockCopyState *s, int64_t offset)
+{
+    BlockCopyHeatZone *coldest = &s->heat_zones[0];
+    int64_t zone = QEMU_ALIGN_DOWN(offset, block_copy_heat_zone_size(s));
+    int i;
+
+    if (++s->heat_events % BLOCK_COPY_HEAT_DECAY == 0) {
+        for (i = 0; i < BLOCK_COPY_HEAT_ZONES; i++) {
+            s->heat_zones[i].heat /= 2;
+        }
+    }
+
+    for (i = 0; i < BLOCK_COPY_HEAT_ZONES; i++) {
+        BlockCopyHeatZone *z = &s->heat_zones[i];
+
+        if (z->heat && z->offset == zone) {
+            z->heat++;
+            return;
+        }
+        if (z->heat < coldest->heat) {
+            coldest = z;
+        }
+    }
+
+    *coldest = (BlockCopyHeatZone) {
+        .offset = zone,
+        .heat = 1,
+    };
+}
+
+/*
+ * Find the first dirty area of the hottest zone which intersects
+ * @offset/@bytes.  Zones found to be clean are forgotten.
+ *
+ * Called with lock held.
+ */
+static bool block_copy_heat_next_dirty_area(BlockCopyState *s, int64_t offset,
+                                            int64_t bytes, int64_t max_chunk,
+                                            int64_t *dirty_start,
+                                            int64_t *dirty_count)
+{
+    int64_t zone_size = block_copy_heat_zone_size(s);
+    int64_t end = offset + bytes;
+
+    while (true) {
+        BlockCopyHeatZone *hottest = NULL;
+        int i;
+
+        for (i = 0; i < BLOCK_COPY_HEAT_ZONES; i++) {
+            BlockCopyHeatZone *z = &s->heat_zones[i];
+
+            if (z->heat && z->offset < end && z->offset + zone_size > offset &&
+                (!hottest || z->heat > hottest->heat)) {
+                hottest = z;
+            }
+        }
+        if (!hottest) {
+            return false;
+        }
+
+        if (bdrv_dirty_bitmap_next_dirty_area(
+                s->copy_bitmap, MAX(hottest->offset, offset),
+                MIN(hottest->offset + zone_size, end), max_chunk,
+                dirty_start, dirty_count)) {
+            trace_block_copy_hot_zone(s, hottest->offset, hottest->heat);
+            return true;
+        }
+        hottest->heat = 0;
+    }
+}
+
 /*
  * Search for the first dirty area in offset/bytes range and create task at
- * the beginning of it.
+ * the beginning of it.  Background calls look into the hot zones first; in
+ * that case *@hot is set to true and the task may start anywhere in the
+ * range.
  */
 static coroutine_fn BlockCopyTask *
 block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
-                       int64_t offset, int64_t bytes)
+                       int64_t offset, int64_t bytes, bool *hot)
 {
     BlockCopyTask *task;
     int64_t max_chunk;
 
     QEMU_LOCK_GUARD(&s->lock);
     max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
-    if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
+    *hot = call_state->background &&
+        block_copy_heat_next_dirty_area(s, call_state->offset,
+                                        call_state->bytes, max_chunk,
+                                        &offset, &bytes);
+    if (!*hot &&
+        !bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
                                            offset, offset + bytes,
                                            max_chunk, &offset, &bytes))
     {
         return NULL;
     }
+    if (!call_state->background) {
+        block_copy_heat_note(s, offset);
+    }
 
     assert(QEMU_IS_ALIGNED(offset, s->cluster_size));
     bytes = QEMU_ALIGN_UP(bytes, s->cluster_size);
@@ -741,14 +849,15 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
            !qatomic_read(&call_state->cancelled)) {
         BlockCopyTask *task;
         int64_t status_bytes;
+        bool hot;
 
-        task = block_copy_task_create(s, call_state, offset, bytes);
+        task = block_copy_task_create(s, call_state, offset, bytes, &hot);
         if (!task) {
             /* No more dirty bits in the bitmap */
             trace_block_copy_skip_range(s, offset, bytes);
             break;
         }
-        if (task->req.offset > offset) {
+        if (!hot && task->req.offset > offset) {
             trace_block_copy_skip_range(s, offset, task->req.offset - offset);
         }
 
@@ -764,8 +873,10 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
             !(ret & BDRV_BLOCK_ALLOCATED)) {
             block_copy_task_end(task, 0);
             trace_block_copy_skip_range(s, task->req.offset, task->req.bytes);
-            offset = task_end(task);
-            bytes = end - offset;
+            if (!hot) {
+                offset = task_end(task);
+                bytes = end - offset;
+            }
             g_free(task);
             continue;
         }
@@ -790,8 +901,11 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
 
         co_get_from_shres(s->mem, task->req.bytes);
 
-        offset = task_end(task);
-        bytes = end - offset;
+        /* Hot areas are copied out of order, the linear scan stays put. */
+        if (!hot) {
+            offset = task_end(task);
+            bytes = end - offset;
+        }
 
         if (!aio && bytes) {
             aio = aio_task_pool_new(call_state->max_workers);
@@ -955,6 +1069,7 @@ BlockCopyCallState *block_copy_async(BlockCopyState *s,
         .bytes = bytes,
         .max_workers = max_workers,
         .max_chunk = max_chunk,
+        .background = true,
         .cb = cb,
         .cb_opaque = cb_opaque,
 
@@ -166,13 +166,16 @@ static int coroutine_fn commit_run(Job *job, Error **errp)
         if (job_is_cancelled(&s->common.job)) {
             break;
         }
-        /* Copy if allocated above the base */
+        /*
+         * Copy if allocated above the base.  Query up to the end of the
+         * image so that long unallocated runs are skipped in one step.
+         */
         ret = blk_co_is_allocated_above(s->top, s->base_overlay, true,
-                                        offset, COMMIT_BUFFER_SIZE, &n);
+                                        offset, len - offset, &n);
         copy = (ret > 0);
         trace_commit_one_iteration(s, offset, n, ret);
         if (copy) {
-            assert(n < SIZE_MAX);
+            n = MIN(n, COMMIT_BUFFER_SIZE);
 
             ret = blk_co_pread(s->top, offset, n, buf, 0);
             if (ret >= 0) {
@@ -20,8 +20,10 @@
 
 #include "qemu/osdep.h"
 
+#include "block/aio_task.h"
 #include "block/block_int.h"
 #include "block/qdict.h"
+#include "block/thread-pool.h"
 #include "sysemu/block-backend.h"
 #include "crypto/block.h"
 #include "qapi/opts-visitor.h"
@@ -34,11 +36,21 @@
 #include "qemu/memalign.h"
 #include "crypto.h"
 
+/* Number of cipher contexts, and so of requests encrypted in parallel */
+#define BLOCK_CRYPTO_MAX_THREADS 4
+
+/* Smallest piece of a request that is worth a thread of its own */
+#define BLOCK_CRYPTO_MIN_BATCH (64 * 1024)
+
 typedef struct BlockCrypto BlockCrypto;
 
 struct BlockCrypto {
     QCryptoBlock *block;
     bool updating_keys;
+
+    CoMutex threads_lock;
+    CoQueue thread_task_queue;
+    int nb_threads;
 };
 
 
@@ -299,11 +311,13 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
     if (flags & BDRV_O_NO_IO) {
         cflags |= QCRYPTO_BLOCK_OPEN_NO_IO;
     }
+    qemu_co_mutex_init(&crypto->threads_lock);
+    qemu_co_queue_init(&crypto->thread_task_queue);
     crypto->block = qcrypto_block_open(open_opts, NULL,
                                        block_crypto_read_func,
                                        bs,
                                        cflags,
-                                       1,
+                                       BLOCK_CRYPTO_MAX_THREADS,
                                        errp);
 
     if (!crypto->block) {
@@ -404,6 +418,106 @@ static int block_crypto_reopen_prepare(BDRVReopenState *state,
  */
 #define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
 
+/*
+ * BlockCryptoEncDecFunc: common prototype of qcrypto_block_encrypt() and
+ * qcrypto_block_decrypt() functions.
+ */
+typedef int (*BlockCryptoEncDecFunc)(QCryptoBlock *block, uint64_t offset,
+                                     uint8_t *buf, size_t len, Error **errp);
+
+typedef struct BlockCryptoEncDecTask {
+    AioTask task;
+    BlockDriverState *bs;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+
+    BlockCryptoEncDecFunc func;
+} BlockCryptoEncDecTask;
+
+static int block_crypto_encdec_pool_func(void *opaque)
+{
+    BlockCryptoEncDecTask *t = opaque;
+    BlockCrypto *crypto = t->bs->opaque;
+
+    return t->func(crypto->block, t->offset, t->buf, t->len, NULL);
+}
+
+/*
+ * Run one batch in the thread pool.  At most BLOCK_CRYPTO_MAX_THREADS
+ * batches run at a time, each with a cipher context of its own.
+ */
+static int coroutine_fn block_crypto_co_encdec_task(AioTask *task)
+{
+    BlockCryptoEncDecTask *t = container_of(task, BlockCryptoEncDecTask, task);
+    BlockCrypto *crypto = t->bs->opaque;
+    int ret;
+
+    qemu_co_mutex_lock(&crypto->threads_lock);
+    while (crypto->nb_threads >= BLOCK_CRYPTO_MAX_THREADS) {
+        qemu_co_queue_wait(&crypto->thread_task_queue, &crypto->threads_lock);
+    }
+    crypto->nb_threads++;
+    qemu_co_mutex_unlock(&crypto->threads_lock);
+
+    ret = thread_pool_submit_co(block_crypto_encdec_pool_func, t);
+
+    qemu_co_mutex_lock(&crypto->threads_lock);
+    crypto->nb_threads--;
+    qemu_co_queue_next(&crypto->thread_task_queue);
+    qemu_co_mutex_unlock(&crypto->threads_lock);
+
+    return ret < 0 ? -EIO : 0;
+}
+
+/*
+ * Encrypt or decrypt @len bytes of @buf in place, away from the
+ * request's AioContext.  Large buffers are split in sector-aligned
+ * batches that are processed in parallel.
+ */
+static int coroutine_fn
+block_crypto_co_encdec(BlockDriverState *bs, uint64_t offset, uint8_t *buf,
+                       size_t len, BlockCryptoEncDecFunc func)
+{
+    BlockCrypto *crypto = bs->opaque;
+    uint64_t sector_size = qcrypto_block_get_sector_size(crypto->block);
+    size_t n_batches = MIN(BLOCK_CRYPTO_MAX_THREADS,
+                           MAX(len / BLOCK_CRYPTO_MIN_BATCH, 1));
+    size_t batch_size = ROUND_UP(DIV_ROUND_UP(len, n_batches), sector_size);
+    BlockCryptoEncDecTask tasks[BLOCK_CRYPTO_MAX_THREADS];
+    AioTaskPool *pool;
+    size_t done = 0;
+    int ret;
+
+    if (n_batches == 1) {
+        tasks[0] = (BlockCryptoEncDecTask) {
+            .bs = bs, .offset = offset, .buf = buf, .len = len, .func = func,
+        };
+        return block_crypto_co_encdec_task(&tasks[0].task);
+    }
+
+    pool = aio_task_pool_new(n_batches);
+    for (int i = 0; done < len; i++) {
+        size_t cur = MIN(batch_size, len - done);
+
+        tasks[i] = (BlockCryptoEncDecTask) {
+            .task.func = block_crypto_co_encdec_task,
+            .bs = bs,
+            .offset = offset + done,
+            .buf = buf + done,
+            .len = cur,
+            .func = func,
+        };
+        aio_task_pool_start_task(pool, &tasks[i].task);
+        done += cur;
+    }
+    aio_task_pool_wait_all(pool);
+    ret = aio_task_pool_status(pool);
+    aio_task_pool_free(pool);
+
+    return ret;
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
                        QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -446,9 +560,9 @@ block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto cleanup;
         }
 
-        if (qcrypto_block_decrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(bs, offset + bytes_done, cipher_data,
+                                     cur_bytes, qcrypto_block_decrypt);
+        if (ret < 0) {
             goto cleanup;
         }
 
@@ -503,9 +617,9 @@ block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
         qemu_iovec_to_buf(qiov, bytes_done, cipher_data, cur_bytes);
 
-        if (qcrypto_block_encrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(bs, offset + bytes_done, cipher_data,
+                                     cur_bytes, qcrypto_block_encrypt);
+        if (ret < 0) {
             goto cleanup;
         }
 
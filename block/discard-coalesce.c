@@ -0,0 +1,530 @@
+/*
+ * Discard coalescing block filter
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Discard requests are completed immediately and only remembered in an
+ * interval tree, where adjacent and overlapping ranges are merged.  The
+ * accumulated ranges are sent to the child, aligned to the configured
+ * granularity, once no other I/O has been seen for a while, when too
+ * many bytes are pending, or when the node is drained.  Unaligned
+ * fragments stay pending until they merge with a neighbour or the node
+ * is drained.
+ *
+ * Writes remove the range they cover from the pending set, and wait for
+ * a discard that is in flight on an overlapping range, so that deferred
+ * discards never destroy data written after them.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "qemu/interval-tree.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+#define DISCARD_COALESCE_OPT_GRANULARITY    "granularity"
+#define DISCARD_COALESCE_OPT_IDLE_TIME      "idle-time"
+#define DISCARD_COALESCE_OPT_MAX_PENDING    "max-pending"
+
+/* Limit the size of one discard so that it does not starve other I/O */
+#define DISCARD_COALESCE_MAX_PUNCH          (256 * MiB)
+
+typedef struct BDRVDiscardCoalesceState {
+    BlockDriverState *bs;
+    uint64_t granularity;
+    int64_t idle_ns;
+    uint64_t max_pending;
+
+    QEMUTimer *timer;
+
+    /* The fields below are protected by @lock */
+    QemuMutex lock;
+    IntervalTreeRoot pending;
+    uint64_t pending_bytes;
+    int64_t last_io_ns;
+    bool worker_running;
+    bool drain_all;         /* the running worker must send everything */
+
+    /* Range of the discard in flight, empty if none */
+    uint64_t cur_start;
+    uint64_t cur_end;
+    CoQueue cur_waiters;
+} BDRVDiscardCoalesceState;
+
+static QemuOptsList runtime_opts = {
+    .name = "discard-coalesce",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = DISCARD_COALESCE_OPT_GRANULARITY,
+            .type = QEMU_OPT_SIZE,
+            .help = "alignment of the discards sent to the child, "
+                "default 1M",
+        },
+        {
+            .name = DISCARD_COALESCE_OPT_IDLE_TIME,
+            .type = QEMU_OPT_NUMBER,
+            .help = "milliseconds without I/O before pending discards are "
+                "sent, default 100",
+        },
+        {
+            .name = DISCARD_COALESCE_OPT_MAX_PENDING,
+            .type = QEMU_OPT_SIZE,
+            .help = "amount of pending discards above which they are sent "
+                "even if the node is busy, default 1G",
+        },
+        { /* end of list */ }
+    },
+};
+
+static int64_t discard_coalesce_now(void)
+{
+    return qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+}
+
+/* Add [start, last] to the pending set, merging it with its neighbours */
+static void discard_coalesce_add_locked(BDRVDiscardCoalesceState *s,
+                                        uint64_t start, uint64_t last)
+{
+    IntervalTreeNode *node, *merged = g_new0(IntervalTreeNode, 1);
+
+    merged->start = start;
+    merged->last = last;
+    s->pending_bytes += last - start + 1;
+
+    while ((node = interval_tree_iter_first(&s->pending,
+                                            start ? start - 1 : 0,
+                                            last == UINT64_MAX ? last
+                                                               : last + 1))) {
+        uint64_t overlap_start = MAX(node->start, start);
+        uint64_t overlap_last = MIN(node->last, last);
+
+        if (overlap_start <= overlap_last) {
+            s->pending_bytes -= overlap_last - overlap_start + 1;
+        }
+        merged->start = MIN(merged->start, node->start);
+        merged->last = MAX(merged->last, node->last);
+        interval_tree_remove(node, &s->pending);
+        g_free(node);
+    }
+
+    interval_tree_insert(merged, &s->pending);
+}
+
+/* Remove [start, last] from the pending set */
+static void discard_coalesce_remove_locked(BDRVDiscardCoalesceState *s,
+                                           uint64_t start, uint64_t last)
+{
+    IntervalTreeNode *node;
+
+    while ((node = interval_tree_iter_first(&s->pending, start, last))) {
+        interval_tree_remove(node, &s->pending);
+        s->pending_bytes -= node->last - node->start + 1;
+
+        if (node->start < start) {
+            discard_coalesce_add_locked(s, node->start, start - 1);
+        }
+        if (node->last > last) {
+            discard_coalesce_add_locked(s, last + 1, node->last);
+        }
+        g_free(node);
+    }
+}
+
+static bool discard_coalesce_due_locked(BDRVDiscardCoalesceState *s)
+{
+    return s->pending_bytes >= s->max_pending ||
+           discard_coalesce_now() - s->last_io_ns >= s->idle_ns;
+}
+
+/*
+ * Pick the next range at or after @pos to send, aligned to the
+ * granularity unless @all is true, and remove it from the pending set.
+ */
+static bool discard_coalesce_pick_locked(BDRVDiscardCoalesceState *s,
+                                         uint64_t pos, bool all,
+                                         uint64_t *start, uint64_t *end)
+{
+    IntervalTreeNode *node;
+
+    for (node = interval_tree_iter_first(&s->pending, pos, UINT64_MAX);
+         node;
+         node = interval_tree_iter_next(node, pos, UINT64_MAX)) {
+        uint64_t node_end = node->last + 1;
+
+        if (all) {
+            *start = node->start;
+            *end = node_end;
+        } else {
+            *start = ROUND_UP(node->start, s->granularity);
+            *end = QEMU_ALIGN_DOWN(node_end, s->granularity);
+        }
+        if (*end > *start) {
+            *end = MIN(*end, *start + DISCARD_COALESCE_MAX_PUNCH);
+            discard_coalesce_remove_locked(s, *start, *end - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void discard_coalesce_arm_timer_locked(BDRVDiscardCoalesceState *s)
+{
+    if (s->timer && !s->worker_running &&
+        !interval_tree_is_empty(&s->pending)) {
+        timer_mod(s->timer, s->last_io_ns + s->idle_ns);
+    }
+}
+
+/*
+ * Send pending discards to the child.  Unless @all is true, stop as soon
+ * as the node turns busy again and only send aligned ranges.
+ */
+static void coroutine_fn GRAPH_RDLOCK
+discard_coalesce_issue(BDRVDiscardCoalesceState *s, bool all)
+{
+    uint64_t pos = 0, start, end;
+    int ret;
+
+    qemu_mutex_lock(&s->lock);
+    for (;;) {
+        if (s->drain_all && !all) {
+            /* Restart from the beginning, now including unaligned ranges */
+            all = true;
+            pos = 0;
+        }
+        if (!all && !discard_coalesce_due_locked(s)) {
+            break;
+        }
+        if (!discard_coalesce_pick_locked(s, pos, all, &start, &end)) {
+            break;
+        }
+
+        s->cur_start = start;
+        s->cur_end = end;
+        qemu_mutex_unlock(&s->lock);
+
+        ret = bdrv_co_pdiscard(s->bs->file, start, end - start);
+        trace_discard_coalesce_issue(s->bs, start, end - start, ret);
+
+        qemu_mutex_lock(&s->lock);
+        s->cur_start = s->cur_end = 0;
+        qemu_co_queue_restart_all(&s->cur_waiters);
+        pos = end;
+    }
+    s->worker_running = false;
+    s->drain_all = false;
+    discard_coalesce_arm_timer_locked(s);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void coroutine_fn discard_coalesce_worker_entry(void *opaque)
+{
+    BDRVDiscardCoalesceState *s = opaque;
+
+    WITH_GRAPH_RDLOCK_GUARD() {
+        discard_coalesce_issue(s, false);
+    }
+    bdrv_dec_in_flight(s->bs);
+}
+
+static void discard_coalesce_timer_cb(void *opaque)
+{
+    BDRVDiscardCoalesceState *s = opaque;
+    Coroutine *co;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        if (s->worker_running || interval_tree_is_empty(&s->pending)) {
+            return;
+        }
+        if (!discard_coalesce_due_locked(s)) {
+            discard_coalesce_arm_timer_locked(s);
+            return;
+        }
+        s->worker_running = true;
+    }
+
+    co = qemu_coroutine_create(discard_coalesce_worker_entry, s);
+    bdrv_inc_in_flight(s->bs);
+    qemu_coroutine_enter(co);
+}
+
+static void coroutine_fn discard_coalesce_drain_entry(void *opaque)
+{
+    BDRVDiscardCoalesceState *s = opaque;
+
+    WITH_GRAPH_RDLOCK_GUARD() {
+        discard_coalesce_issue(s, true);
+    }
+    bdrv_dec_in_flight(s->bs);
+}
+
+static void discard_coalesce_drain_begin(BlockDriverState *bs)
+{
+    BDRVDiscardCoalesceState *s = bs->opaque;
+    Coroutine *co;
+
+    /* Send everything, drain waits for it thanks to the in-flight count */
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        if (s->worker_running) {
+            s->drain_all = true;
+            return;
+        }
+        if (interval_tree_is_empty(&s->pending)) {
+            return;
+        }
+        s->worker_running = true;
+    }
+    if (s->timer) {
+        timer_del(s->timer);
+    }
+
+    co = qemu_coroutine_create(discard_coalesce_drain_entry, s);
+    bdrv_inc_in_flight(bs);
+    aio_co_enter(bdrv_get_aio_context(bs), co);
+}
+
+static void discard_coalesce_detach_aio_context(BlockDriverState *bs)
+{
+    BDRVDiscardCoalesceState *s = bs->opaque;
+
+    timer_free(s->timer);
+    s->timer = NULL;
+}
+
+static void discard_coalesce_attach_aio_context(BlockDriverState *bs,
+                                                AioContext *new_context)
+{
+    BDRVDiscardCoalesceState *s = bs->opaque;
+
+    s->timer = aio_timer_new(new_context, QEMU_CLOCK_REALTIME, SCALE_NS,
+                             discard_coalesce_timer_cb, s);
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        discard_coalesce_arm_timer_locked(s);
+    }
+}
+
+static int discard_coalesce_open(BlockDriverState *bs, QDict *options,
+                                 int flags, Error **errp)
+{
+    BDRVDiscardCoalesceState *s = bs->opaque;
+    QemuOpts *opts;
+    int64_t idle_ms;
+    int ret;
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    s->granularity = qemu_opt_get_size(opts, DISCARD_COALESCE_OPT_GRANULARITY,
+                                       1 * MiB);
+    idle_ms = qemu_opt_get_number(opts, DISCARD_COALESCE_OPT_IDLE_TIME, 100);
+    s->max_pending = qemu_opt_get_size(opts, DISCARD_COALESCE_OPT_MAX_PENDING,
+                                       1 * GiB);
+
+    if (!is_power_of_2(s->granularity) || s->granularity < BDRV_SECTOR_SIZE ||
+        s->granularity > DISCARD_COALESCE_MAX_PUNCH) {
+        error_setg(errp, "Parameter '" DISCARD_COALESCE_OPT_GRANULARITY "' "
+                   "must be a power of two between 512 and 256M");
+        ret = -EINVAL;
+        goto out;
+    }
+    if (idle_ms < 0 || idle_ms > INT64_MAX / SCALE_MS) {
+        error_setg(errp, "Parameter '" DISCARD_COALESCE_OPT_IDLE_TIME "' "
+                   "is out of range");
+        ret = -EINVAL;
+        goto out;
+    }
+    s->idle_ns = idle_ms * SCALE_MS;
+
+    s->bs = bs;
+    qemu_mutex_init(&s->lock);
+    qemu_co_queue_init(&s->cur_waiters);
+    s->last_io_ns = discard_coalesce_now();
+
+    bdrv_graph_rdlock_main_loop();
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+    bdrv_graph_rdunlock_main_loop();
+
+    discard_coalesce_attach_aio_context(bs, bdrv_get_aio_context(bs));
+
+out:
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void discard_coalesce_close(BlockDriverState *bs)
+{
+    BDRVDiscardCoalesceState *s = bs->opaque;
+    IntervalTreeNode *node;
+
+    discard_coalesce_detach_aio_context(bs);
+
+    /* Normally empty, since the node was drained */
+    while ((node = interval_tree_iter_first(&s->pending, 0, UINT64_MAX))) {
+        interval_tree_remove(node, &s->pending);
+        g_free(node);
+    }
+    qemu_mutex_destroy(&s->lock);
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+discard_coalesce_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+static void discard_coalesce_note_io(BDRVDiscardCoalesceState *s)
+{
+    qemu_mutex_lock(&s->lock);
+    s->last_io_ns = discard_coalesce_now();
+    qemu_mutex_unlock(&s->lock);
+}
+
+/*
+ * Called before a request that modifies [offset, offset + bytes): pending
+ * discards of the range are dropped, and a discard in flight that overlaps
+ * it is waited for.
+ */
+static void coroutine_fn discard_coalesce_write_begin(BlockDriverState *bs,
+                                                      uint64_t offset,
+                                                      uint64_t bytes)
+{
+    BDRVDiscardCoalesceState *s = bs->opaque;
+    uint64_t last = bytes ? offset + bytes - 1 : offset;
+
+    qemu_mutex_lock(&s->lock);
+    s->last_io_ns = discard_coalesce_now();
+    discard_coalesce_remove_locked(s, offset, last);
+    while (s->cur_end > s->cur_start &&
+           s->cur_start <= last && offset < s->cur_end) {
+        qemu_co_queue_wait(&s->cur_waiters, &s->lock);
+    }
+    qemu_mutex_unlock(&s->lock);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+discard_coalesce_co_preadv_part(BlockDriverState *bs, int64_t offset,
+                                int64_t bytes, QEMUIOVector *qiov,
+                                size_t qiov_offset, BdrvRequestFlags flags)
+{
+    discard_coalesce_note_io(bs->opaque);
+    return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+discard_coalesce_co_pwritev_part(BlockDriverState *bs, int64_t offset,
+                                 int64_t bytes, QEMUIOVector *qiov,
+                                 size_t qiov_offset, BdrvRequestFlags flags)
+{
+    discard_coalesce_write_begin(bs, offset, bytes);
+    return bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                flags);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+discard_coalesce_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset,
+                                  int64_t bytes, BdrvRequestFlags flags)
+{
+    discard_coalesce_write_begin(bs, offset, bytes);
+    return bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+discard_coalesce_co_pdiscard(BlockDriverState *bs, int64_t offset,
+                             int64_t bytes)
+{
+    BDRVDiscardCoalesceState *s = bs->opaque;
+
+    if (!bytes) {
+        return 0;
+    }
+
+    trace_discard_coalesce_queue(bs, offset, bytes);
+
+    qemu_mutex_lock(&s->lock);
+    discard_coalesce_add_locked(s, offset, offset + bytes - 1);
+    if (s->timer && !s->worker_running) {
+        if (s->pending_bytes >= s->max_pending) {
+            timer_mod(s->timer, discard_coalesce_now());
+        } else if (!timer_pending(s->timer)) {
+            discard_coalesce_arm_timer_locked(s);
+        }
+    }
+    qemu_mutex_unlock(&s->lock);
+
+    return 0;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+discard_coalesce_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
+                             PreallocMode prealloc, BdrvRequestFlags flags,
+                             Error **errp)
+{
+    discard_coalesce_write_begin(bs, offset, UINT64_MAX - offset);
+    return bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+discard_coalesce_co_eject(BlockDriverState *bs, bool eject_flag)
+{
+    bdrv_co_eject(bs->file->bs, eject_flag);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+discard_coalesce_co_lock_medium(BlockDriverState *bs, bool locked)
+{
+    bdrv_co_lock_medium(bs->file->bs, locked);
+}
+
+static BlockDriver bdrv_discard_coalesce = {
+    .format_name                        = "discard-coalesce",
+    .instance_size                      = sizeof(BDRVDiscardCoalesceState),
+
+    .bdrv_open                          = discard_coalesce_open,
+    .bdrv_close                         = discard_coalesce_close,
+    .bdrv_child_perm                    = bdrv_default_perms,
+
+    .bdrv_co_getlength                  = discard_coalesce_co_getlength,
+
+    .bdrv_co_preadv_part                = discard_coalesce_co_preadv_part,
+    .bdrv_co_pwritev_part               = discard_coalesce_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes              = discard_coalesce_co_pwrite_zeroes,
+    .bdrv_co_pdiscard                   = discard_coalesce_co_pdiscard,
+    .bdrv_co_truncate                   = discard_coalesce_co_truncate,
+
+    .bdrv_drain_begin                   = discard_coalesce_drain_begin,
+    .bdrv_detach_aio_context            = discard_coalesce_detach_aio_context,
+    .bdrv_attach_aio_context            = discard_coalesce_attach_aio_context,
+
+    .bdrv_co_eject                      = discard_coalesce_co_eject,
+    .bdrv_co_lock_medium                = discard_coalesce_co_lock_medium,
+
+    .is_filter                          = true,
+};
+
+static void bdrv_discard_coalesce_init(void)
+{
+    bdrv_register(&bdrv_discard_coalesce);
+}
+
+block_init(bdrv_discard_coalesce_init);
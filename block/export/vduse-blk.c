@@ -14,9 +14,12 @@
 #include <sys/eventfd.h>
 
 #include "qapi/error.h"
+#include "qapi/clone-visitor.h"
+#include "qapi/qapi-visit-common.h"
 #include "block/export.h"
 #include "qemu/error-report.h"
 #include "util/block-helpers.h"
+#include "sysemu/iothread.h"
 #include "subprojects/libvduse/libvduse.h"
 #include "virtio-blk-handler.h"
 
@@ -33,6 +36,15 @@ typedef struct VduseBlkExport {
     char *recon_file;
     unsigned int inflight; /* atomic */
     bool vqs_started;
+
+    /*
+     * With iothread-vq-mapping, virtqueue kicks are handled in vq_ctx[i].
+     * libvduse is not thread-safe, so every call into it is then made with
+     * @lock held.
+     */
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
+    AioContext **vq_ctx;
+    QemuRecMutex lock;
 } VduseBlkExport;
 
 typedef struct VduseBlkReq {
@@ -59,10 +71,41 @@ static void vduse_blk_inflight_dec(VduseBlkExport *vblk_exp)
     }
 }
 
-static void vduse_blk_req_complete(VduseBlkReq *req, size_t in_len)
+static void vduse_blk_lock(VduseBlkExport *vblk_exp)
+{
+    if (vblk_exp->vq_ctx) {
+        qemu_rec_mutex_lock(&vblk_exp->lock);
+    }
+}
+
+static void vduse_blk_unlock(VduseBlkExport *vblk_exp)
+{
+    if (vblk_exp->vq_ctx) {
+        qemu_rec_mutex_unlock(&vblk_exp->lock);
+    }
+}
+
+/* The AioContext in which the kick fd of @vq is monitored */
+static AioContext *vduse_blk_vq_ctx(VduseBlkExport *vblk_exp, VduseVirtq *vq)
+{
+    if (vblk_exp->vq_ctx) {
+        for (uint16_t i = 0; i < vblk_exp->num_queues; i++) {
+            if (vduse_dev_get_queue(vblk_exp->dev, i) == vq) {
+                return vblk_exp->vq_ctx[i];
+            }
+        }
+        g_assert_not_reached();
+    }
+    return vblk_exp->export.ctx;
+}
+
+static void vduse_blk_req_complete(VduseBlkExport *vblk_exp, VduseBlkReq *req,
+                                   size_t in_len)
 {
+    vduse_blk_lock(vblk_exp);
     vduse_queue_push(req->vq, &req->elem, in_len);
     vduse_queue_notify(req->vq);
+    vduse_blk_unlock(vblk_exp);
 
     free(req);
 }
@@ -88,7 +131,7 @@ static void coroutine_fn vduse_blk_virtio_process_req(void *opaque)
         return;
     }
 
-    vduse_blk_req_complete(req, in_len);
+    vduse_blk_req_complete(vblk_exp, req, in_len);
     vduse_blk_inflight_dec(vblk_exp);
 }
 
@@ -99,7 +142,12 @@ static void vduse_blk_vq_handler(VduseDev *dev, VduseVirtq *vq)
     while (1) {
         VduseBlkReq *req;
 
+        vduse_blk_lock(vblk_exp);
         req = vduse_queue_pop(vq, sizeof(VduseBlkReq));
+        if (req) {
+            vduse_blk_inflight_inc(vblk_exp);
+        }
+        vduse_blk_unlock(vblk_exp);
         if (!req) {
             break;
         }
@@ -108,7 +156,6 @@ static void vduse_blk_vq_handler(VduseDev *dev, VduseVirtq *vq)
         Coroutine *co =
             qemu_coroutine_create(vduse_blk_virtio_process_req, req);
 
-        vduse_blk_inflight_inc(vblk_exp);
         qemu_coroutine_enter(co);
     }
 }
@@ -136,7 +183,7 @@ static void vduse_blk_enable_queue(VduseDev *dev, VduseVirtq *vq)
         return; /* vduse_blk_drained_end() will start vqs later */
     }
 
-    aio_set_fd_handler(vblk_exp->export.ctx, vduse_queue_get_fd(vq),
+    aio_set_fd_handler(vduse_blk_vq_ctx(vblk_exp, vq), vduse_queue_get_fd(vq),
                        on_vduse_vq_kick, NULL, NULL, NULL, vq);
     /* Make sure we don't miss any kick after reconnecting */
     eventfd_write(vduse_queue_get_fd(vq), 1);
@@ -151,7 +198,7 @@ static void vduse_blk_disable_queue(VduseDev *dev, VduseVirtq *vq)
         return;
     }
 
-    aio_set_fd_handler(vblk_exp->export.ctx, fd,
+    aio_set_fd_handler(vduse_blk_vq_ctx(vblk_exp, vq), fd,
                        NULL, NULL, NULL, NULL, NULL);
 }
 
@@ -163,8 +210,11 @@ static const VduseOps vduse_blk_ops = {
 static void on_vduse_dev_kick(void *opaque)
 {
     VduseDev *dev = opaque;
+    VduseBlkExport *vblk_exp = vduse_dev_get_priv(dev);
 
+    vduse_blk_lock(vblk_exp);
     vduse_dev_handler(dev);
+    vduse_blk_unlock(vblk_exp);
 }
 
 static void vduse_blk_attach_ctx(VduseBlkExport *vblk_exp, AioContext *ctx)
@@ -304,6 +354,12 @@ static int vduse_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
             return -EINVAL;
         }
     }
+
+    if (vblk_opts->iothread_vq_mapping &&
+        !iothread_vq_mapping_validate(vblk_opts->iothread_vq_mapping,
+                                      num_queues, errp)) {
+        return -EINVAL;
+    }
     vblk_exp->num_queues = num_queues;
     vblk_exp->handler.blk = exp->blk;
     vblk_exp->handler.serial = g_strdup(vblk_opts->serial ?: "");
@@ -364,6 +420,16 @@ static int vduse_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
         vduse_dev_setup_queue(vblk_exp->dev, i, queue_size);
     }
 
+    if (vblk_opts->iothread_vq_mapping) {
+        vblk_exp->iothread_vq_mapping_list =
+            QAPI_CLONE(IOThreadVirtQueueMappingList,
+                       vblk_opts->iothread_vq_mapping);
+        vblk_exp->vq_ctx = g_new(AioContext *, num_queues);
+        iothread_vq_mapping_apply(vblk_exp->iothread_vq_mapping_list,
+                                  vblk_exp->vq_ctx, num_queues);
+        qemu_rec_mutex_init(&vblk_exp->lock);
+    }
+
     aio_set_fd_handler(exp->ctx, vduse_dev_get_fd(vblk_exp->dev),
                        on_vduse_dev_kick, NULL, NULL, NULL, vblk_exp->dev);
 
@@ -403,6 +469,14 @@ static void vduse_blk_exp_delete(BlockExport *exp)
     }
     g_free(vblk_exp->recon_file);
     g_free(vblk_exp->handler.serial);
+
+    if (vblk_exp->vq_ctx) {
+        iothread_vq_mapping_cleanup(vblk_exp->iothread_vq_mapping_list);
+        qapi_free_IOThreadVirtQueueMappingList(
+                vblk_exp->iothread_vq_mapping_list);
+        g_free(vblk_exp->vq_ctx);
+        qemu_rec_mutex_destroy(&vblk_exp->lock);
+    }
 }
 
 /* Called with exp->ctx acquired */
@@ -17,7 +17,10 @@
 #include "qemu/vhost-user-server.h"
 #include "vhost-user-blk-server.h"
 #include "qapi/error.h"
+#include "qapi/clone-visitor.h"
+#include "qapi/qapi-visit-common.h"
 #include "qom/object_interfaces.h"
+#include "sysemu/iothread.h"
 #include "util/block-helpers.h"
 #include "virtio-blk-handler.h"
 
@@ -29,6 +32,7 @@ typedef struct VuBlkReq {
     VuVirtqElement elem;
     VuServer *server;
     struct VuVirtq *vq;
+    int vq_idx;
 } VuBlkReq;
 
 /* vhost user block device */
@@ -38,14 +42,17 @@ typedef struct {
     VirtioBlkHandler handler;
     QIOChannelSocket *sioc;
     struct virtio_blk_config blkcfg;
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
 } VuBlkExport;
 
 static void vu_blk_req_complete(VuBlkReq *req, size_t in_len)
 {
     VuDev *vu_dev = &req->server->vu_dev;
 
+    vhost_user_server_vq_lock(req->server, req->vq_idx);
     vu_queue_push(vu_dev, req->vq, &req->elem, in_len);
     vu_queue_notify(vu_dev, req->vq);
+    vhost_user_server_vq_unlock(req->server, req->vq_idx);
 
     free(req);
 }
@@ -94,6 +101,7 @@ static void vu_blk_process_vq(VuDev *vu_dev, int idx)
 
         req->server = server;
         req->vq = vq;
+        req->vq_idx = idx;
 
         Coroutine *co =
             qemu_coroutine_create(vu_blk_virtio_process_req, req);
@@ -349,6 +357,13 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
     vexp->handler.logical_block_size = logical_block_size;
     vexp->handler.writable = opts->writable;
 
+    if (vu_opts->iothread_vq_mapping &&
+        !iothread_vq_mapping_validate(vu_opts->iothread_vq_mapping,
+                                      num_queues, errp)) {
+        g_free(vexp->handler.serial);
+        return -EINVAL;
+    }
+
     vu_blk_initialize_config(blk_bs(exp->blk), &vexp->blkcfg,
                              logical_block_size, num_queues);
 
@@ -365,6 +380,17 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
         return -EADDRNOTAVAIL;
     }
 
+    if (vu_opts->iothread_vq_mapping) {
+        AioContext **vq_ctx = g_new(AioContext *, num_queues);
+
+        vexp->iothread_vq_mapping_list =
+            QAPI_CLONE(IOThreadVirtQueueMappingList,
+                       vu_opts->iothread_vq_mapping);
+        iothread_vq_mapping_apply(vexp->iothread_vq_mapping_list, vq_ctx,
+                                  num_queues);
+        vhost_user_server_set_vq_aio_contexts(&vexp->vu_server, vq_ctx);
+    }
+
     return 0;
 }
 
@@ -375,6 +401,11 @@ static void vu_blk_exp_delete(BlockExport *exp)
     blk_remove_aio_context_notifier(exp->blk, blk_aio_attached, blk_aio_detach,
                                     vexp);
     g_free(vexp->handler.serial);
+
+    if (vexp->iothread_vq_mapping_list) {
+        iothread_vq_mapping_cleanup(vexp->iothread_vq_mapping_list);
+        qapi_free_IOThreadVirtQueueMappingList(vexp->iothread_vq_mapping_list);
+    }
 }
 
 const BlockExportDriver blk_exp_vhost_user_blk = {
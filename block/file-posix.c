@@ -34,6 +34,7 @@
 #include "qemu/memalign.h"
 #include "trace.h"
 #include "block/thread-pool.h"
+#include "block/bounce-pool.h"
 #include "qemu/iov.h"
 #include "block/raw-aio.h"
 #include "qapi/qmp/qdict.h"
@@ -160,6 +161,8 @@ typedef struct BDRVRawState {
     bool has_write_zeroes:1;
     bool use_linux_aio:1;
     bool use_linux_io_uring:1;
+    bool io_uring_fixed_buffers:1;
+    unsigned int io_uring_flags; /* LURING_* flags for reads and writes */
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
@@ -560,6 +563,24 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+#ifdef CONFIG_LINUX_IO_URING
+        {
+            .name = "io-uring-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest memory with io_uring (default: off)",
+        },
+        {
+            .name = "io-uring-iopoll",
+            .type = QEMU_OPT_BOOL,
+            .help = "poll the device for io_uring completions (default: off)",
+        },
+        {
+            .name = "io-uring-sqpoll",
+            .type = QEMU_OPT_BOOL,
+            .help = "poll the io_uring submission queue in a kernel thread "
+                    "(default: off)",
+        },
+#endif
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -637,6 +658,32 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     s->use_linux_aio = (aio == BLOCKDEV_AIO_OPTIONS_NATIVE);
 #ifdef CONFIG_LINUX_IO_URING
     s->use_linux_io_uring = (aio == BLOCKDEV_AIO_OPTIONS_IO_URING);
+    s->io_uring_fixed_buffers =
+        qemu_opt_get_bool(opts, "io-uring-fixed-buffers", false);
+    if (s->io_uring_fixed_buffers && !s->use_linux_io_uring) {
+        error_setg(errp, "io-uring-fixed-buffers requires aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    s->io_uring_flags = 0;
+    if (qemu_opt_get_bool(opts, "io-uring-iopoll", false)) {
+        if (!(bdrv_flags & BDRV_O_NOCACHE)) {
+            error_setg(errp, "io-uring-iopoll requires cache.direct=on");
+            ret = -EINVAL;
+            goto fail;
+        }
+        s->io_uring_flags |= LURING_IOPOLL;
+    }
+    if (qemu_opt_get_bool(opts, "io-uring-sqpoll", false)) {
+        s->io_uring_flags |= LURING_SQPOLL;
+    }
+    if (s->io_uring_flags && !s->use_linux_io_uring) {
+        error_setg(errp, "io-uring-iopoll and io-uring-sqpoll require "
+                   "aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
 #endif
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
@@ -2432,7 +2479,12 @@ static bool bdrv_qiov_is_aligned(BlockDriverState *bs, QEMUIOVector *qiov)
 }
 
 #ifdef CONFIG_LINUX_IO_URING
-static inline bool raw_check_linux_io_uring(BDRVRawState *s)
+/*
+ * Returns in @flags the LURING_* flags of the ring that requests of @type
+ * are submitted to.
+ */
+static inline bool raw_check_linux_io_uring(BDRVRawState *s, int type,
+                                            unsigned int *flags)
 {
     Error *local_err = NULL;
     AioContext *ctx;
@@ -2441,8 +2493,20 @@ static inline bool raw_check_linux_io_uring(BDRVRawState *s)
         return false;
     }
 
+    /* Polled rings only support O_DIRECT reads and writes */
+    *flags = s->io_uring_flags;
+    if (type == QEMU_AIO_FLUSH || !(s->open_flags & O_DIRECT)) {
+        *flags &= ~LURING_IOPOLL;
+    }
+
     ctx = qemu_get_current_aio_context();
-    if (unlikely(!aio_setup_linux_io_uring(ctx, &local_err))) {
+    if (unlikely(!aio_setup_linux_io_uring(ctx, *flags, &local_err))) {
+        if (*flags) {
+            error_reportf_err(local_err, "Unable to use polled io_uring, "
+                                         "falling back to interrupts: ");
+            s->io_uring_flags = 0;
+            return raw_check_linux_io_uring(s, type, flags);
+        }
         error_reportf_err(local_err, "Unable to use linux io_uring, "
                                      "falling back to thread pool: ");
         s->use_linux_io_uring = false;
@@ -2478,8 +2542,13 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr,
 {
     BDRVRawState *s = bs->opaque;
     RawPosixAIOData acb;
+    QEMUIOVector bounce_qiov, *orig_qiov = qiov;
+    void *bounce_buf = NULL;
     int ret;
     uint64_t offset = *offset_ptr;
+#ifdef CONFIG_LINUX_IO_URING
+    unsigned int ring_flags;
+#endif
 
     if (fd_open(bs) < 0)
         return -EIO;
@@ -2494,6 +2563,23 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr,
     }
 #endif
 
+    /*
+     * Small requests with misaligned buffers are copied through a pooled
+     * bounce buffer, so that they can still use libaio or io_uring.
+     */
+    if (s->needs_alignment && bytes <= BOUNCE_POOL_MAX_SIZE &&
+        QEMU_IS_ALIGNED(bytes, bdrv_min_mem_align(bs)) &&
+        !bdrv_qiov_is_aligned(bs, qiov)) {
+        bounce_buf = bdrv_try_bounce_get(bs, bytes);
+        if (bounce_buf) {
+            if (type & (QEMU_AIO_WRITE | QEMU_AIO_ZONE_APPEND)) {
+                qemu_iovec_to_buf(qiov, 0, bounce_buf, bytes);
+            }
+            qemu_iovec_init_buf(&bounce_qiov, bounce_buf, bytes);
+            qiov = &bounce_qiov;
+        }
+    }
+
     /*
      * When using O_DIRECT, the request must be aligned to be able to use
      * either libaio or io_uring interface. If not fail back to regular thread
@@ -2503,9 +2589,19 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr,
     if (s->needs_alignment && !bdrv_qiov_is_aligned(bs, qiov)) {
         type |= QEMU_AIO_MISALIGNED;
 #ifdef CONFIG_LINUX_IO_URING
-    } else if (raw_check_linux_io_uring(s)) {
+    } else if (raw_check_linux_io_uring(s, type, &ring_flags)) {
         assert(qiov->size == bytes);
-        ret = luring_co_submit(bs, s->fd, offset, qiov, type);
+        ret = luring_co_submit(bs, s->fd, offset, qiov, type, ring_flags);
+        if (ret == -EOPNOTSUPP && (ring_flags & LURING_IOPOLL)) {
+            /* The file system or driver cannot poll for completions */
+            warn_report_once("io-uring-iopoll is not supported for '%s', "
+                             "disabling it", bs->filename);
+            s->io_uring_flags &= ~LURING_IOPOLL;
+            if (raw_check_linux_io_uring(s, type, &ring_flags)) {
+                ret = luring_co_submit(bs, s->fd, offset, qiov, type,
+                                       ring_flags);
+            }
+        }
         goto out;
 #endif
 #ifdef CONFIG_LINUX_AIO
@@ -2561,6 +2657,12 @@ out:
         qemu_co_mutex_unlock(&wps->colock);
     }
 #endif
+    if (bounce_buf) {
+        if (ret >= 0 && !(type & (QEMU_AIO_WRITE | QEMU_AIO_ZONE_APPEND))) {
+            qemu_iovec_from_buf(orig_qiov, 0, bounce_buf, bytes);
+        }
+        bdrv_bounce_put(bounce_buf, bytes);
+    }
     return ret;
 }
 
@@ -2583,6 +2685,9 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
     BDRVRawState *s = bs->opaque;
     RawPosixAIOData acb;
     int ret;
+#ifdef CONFIG_LINUX_IO_URING
+    unsigned int ring_flags;
+#endif
 
     ret = fd_open(bs);
     if (ret < 0) {
@@ -2596,13 +2701,23 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
     };
 
 #ifdef CONFIG_LINUX_IO_URING
-    if (raw_check_linux_io_uring(s)) {
-        return luring_co_submit(bs, s->fd, 0, NULL, QEMU_AIO_FLUSH);
+    if (raw_check_linux_io_uring(s, QEMU_AIO_FLUSH, &ring_flags)) {
+        return luring_co_submit(bs, s->fd, 0, NULL, QEMU_AIO_FLUSH,
+                                ring_flags);
     }
 #endif
     return raw_thread_pool_submit(handle_aiocb_flush, &acb);
 }
 
+/* Close a file descriptor that may have been used for AIO */
+static void raw_close_fd(int fd)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    luring_unregister_fd(fd);
+#endif
+    qemu_close(fd);
+}
+
 static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
@@ -2611,11 +2726,37 @@ static void raw_close(BlockDriverState *bs)
 #if defined(CONFIG_BLKZONED)
         g_free(bs->wps);
 #endif
-        qemu_close(s->fd);
+        raw_close_fd(s->fd);
         s->fd = -1;
     }
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+
+    /*
+     * Failing to register with a ring only costs performance, so this is
+     * not reported as an error here.
+     */
+    if (s->io_uring_fixed_buffers) {
+        luring_register_buf(host, size);
+    }
+    return true;
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->io_uring_fixed_buffers) {
+        luring_unregister_buf(host, size);
+    }
+}
+#endif
+
 /**
  * Truncates the given regular file @fd to @offset and, when growing, fills the
  * new space according to @prealloc.
@@ -3802,7 +3943,7 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
-        qemu_close(s->fd);
+        raw_close_fd(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
     }
@@ -3909,6 +4050,10 @@ BlockDriver bdrv_file = {
     .bdrv_check_perm = raw_check_perm,
     .bdrv_set_perm   = raw_set_perm,
     .bdrv_abort_perm_update = raw_abort_perm_update,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
     .create_opts = &raw_create_opts,
     .mutable_opts = mutable_opts,
 };
@@ -4278,6 +4423,10 @@ static BlockDriver bdrv_host_device = {
     .bdrv_check_perm = raw_check_perm,
     .bdrv_set_perm   = raw_set_perm,
     .bdrv_abort_perm_update = raw_abort_perm_update,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
     .bdrv_probe_blocksizes = hdev_probe_blocksizes,
     .bdrv_probe_geometry = hdev_probe_geometry,
 
@@ -4455,7 +4604,7 @@ static int cdrom_reopen(BlockDriverState *bs)
      * FreeBSD seems to not notice sometimes...
      */
     if (s->fd >= 0)
-        qemu_close(s->fd);
+        raw_close_fd(s->fd);
     fd = qemu_open(bs->filename, s->open_flags, NULL);
     if (fd < 0) {
         s->fd = -1;
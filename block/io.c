@@ -26,6 +26,7 @@
 #include "trace.h"
 #include "sysemu/block-backend.h"
 #include "block/aio-wait.h"
+#include "block/bounce-pool.h"
 #include "block/blockjob.h"
 #include "block/blockjob_int.h"
 #include "block/block_int.h"
@@ -37,11 +38,16 @@
 #include "qapi/error.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/stats-counter.h"
 #include "sysemu/replay.h"
 
 /* Maximum bounce buffer for copy-on-read and write zeroes, in bytes */
 #define MAX_BOUNCE_BUFFER (32768 << BDRV_SECTOR_BITS)
 
+/* Requests to all nodes, so one guest request counts once per layer */
+STATS_COUNTER_DEFINE(bdrv_read_requests, "block-node-reads");
+STATS_COUNTER_DEFINE(bdrv_write_requests, "block-node-writes");
+
 static void coroutine_fn GRAPH_RDLOCK
 bdrv_parent_cb_resize(BlockDriverState *bs);
 
@@ -1496,7 +1502,7 @@ static bool bdrv_init_padding(BlockDriverState *bs,
 
     sum = pad->head + bytes + pad->tail;
     pad->buf_len = (sum > align && pad->head && pad->tail) ? 2 * align : align;
-    pad->buf = qemu_blockalign(bs, pad->buf_len);
+    pad->buf = bdrv_bounce_get(bs, pad->buf_len);
     pad->merge_reads = sum == pad->buf_len;
     if (pad->tail) {
         pad->tail_buf = pad->buf + pad->buf_len - align;
@@ -1582,11 +1588,11 @@ static void bdrv_padding_finalize(BdrvRequestPadding *pad)
             qemu_iovec_from_buf(&pad->pre_collapse_qiov, 0,
                                 pad->collapse_bounce_buf, pad->collapse_len);
         }
-        qemu_vfree(pad->collapse_bounce_buf);
+        bdrv_bounce_put(pad->collapse_bounce_buf, pad->collapse_len);
         qemu_iovec_destroy(&pad->pre_collapse_qiov);
     }
     if (pad->buf) {
-        qemu_vfree(pad->buf);
+        bdrv_bounce_put(pad->buf, pad->buf_len);
         qemu_iovec_destroy(&pad->local_qiov);
     }
     memset(pad, 0, sizeof(*pad));
@@ -1667,7 +1673,7 @@ static int bdrv_create_padded_qiov(BlockDriverState *bs,
          * from those elements.  Then add it to `pad->local_qiov`.
          */
         pad->collapse_len = pad->pre_collapse_qiov.size;
-        pad->collapse_bounce_buf = qemu_blockalign(bs, pad->collapse_len);
+        pad->collapse_bounce_buf = bdrv_bounce_get(bs, pad->collapse_len);
         if (pad->write) {
             qemu_iovec_to_buf(&pad->pre_collapse_qiov, 0,
                               pad->collapse_bounce_buf, pad->collapse_len);
@@ -1773,6 +1779,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     IO_CODE();
 
     trace_bdrv_co_preadv_part(bs, offset, bytes, flags);
+    stats_counter_inc(&bdrv_read_requests);
 
     if (!bdrv_co_is_inserted(bs)) {
         return -ENOMEDIUM;
@@ -2222,6 +2229,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
     IO_CODE();
 
     trace_bdrv_co_pwritev_part(child->bs, offset, bytes, flags);
+    stats_counter_inc(&bdrv_write_requests);
 
     if (!bdrv_co_is_inserted(bs)) {
         return -ENOMEDIUM;
@@ -3307,6 +3315,38 @@ void *qemu_try_blockalign(BlockDriverState *bs, size_t size)
     return qemu_try_memalign(align, size);
 }
 
+static BouncePool *bdrv_current_bounce_pool(void)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    return ctx ? aio_get_bounce_pool(ctx) : NULL;
+}
+
+void *bdrv_try_bounce_get(BlockDriverState *bs, size_t size)
+{
+    IO_CODE();
+    return bounce_pool_try_get(bdrv_current_bounce_pool(),
+                               bdrv_opt_mem_align(bs), size);
+}
+
+void *bdrv_bounce_get(BlockDriverState *bs, size_t size)
+{
+    void *buf = bdrv_try_bounce_get(bs, size);
+
+    if (!buf) {
+        /* Same behaviour as qemu_blockalign() */
+        error_report("bounce buffer allocation of %zu bytes failed", size);
+        abort();
+    }
+    return buf;
+}
+
+void bdrv_bounce_put(void *buf, size_t size)
+{
+    IO_CODE();
+    bounce_pool_put(bdrv_current_bounce_pool(), buf, size);
+}
+
 void *qemu_try_blockalign0(BlockDriverState *bs, size_t size)
 {
     void *mem = qemu_try_blockalign(bs, size);
@@ -11,7 +11,9 @@
 #include "qemu/osdep.h"
 #include <liburing.h>
 #include "block/aio.h"
+#include "qemu/lockable.h"
 #include "qemu/queue.h"
+#include "qemu/units.h"
 #include "block/block.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
@@ -26,6 +28,16 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Number of slots in the registered file table of each ring */
+#define MAX_FIXED_FILES 64
+
+/*
+ * The kernel limits the size of a single registered buffer, so large
+ * regions are registered in chunks of this size.
+ */
+#define MAX_FIXED_BUF_SIZE (1 * GiB)
+#define MAX_FIXED_BUFS 1024
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -54,12 +66,60 @@ struct LuringState {
 
     struct io_uring ring;
 
+    /* LURING_* flags the ring was set up with */
+    unsigned int flags;
+
+    /* Has LURING_IOPOLL requests in flight, see aio_context_poll_busy() */
+    bool poll_busy;
+
     /* No locking required, only accessed from AioContext home thread */
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    /*
+     * File descriptor registered in each slot of the ring's file table, or
+     * -1.  Slots are filled by the home thread and emptied by
+     * luring_unregister_fd() with luring_lock held.
+     */
+    bool files_registered;
+    int files[MAX_FIXED_FILES];
+
+    /*
+     * Copy of luring_bufs that is registered with the ring, only accessed
+     * from the home thread.  It is only used while bufs_gen matches
+     * luring_bufs_gen.
+     */
+    struct iovec *bufs;
+    unsigned int nr_bufs;
+    unsigned int bufs_gen;
+
+    QLIST_ENTRY(LuringState) next;
 };
 
+typedef struct LuringBuf {
+    void *host;
+    size_t size;
+    unsigned int refcnt;
+} LuringBuf;
+
+/*
+ * Memory regions registered with luring_register_buf() and all LuringStates,
+ * protected by luring_lock.  luring_bufs_gen is incremented on every change
+ * to luring_bufs, so that each ring can notice that its copy is stale.
+ */
+static QemuMutex luring_lock;
+static QLIST_HEAD(, LuringState) luring_states =
+    QLIST_HEAD_INITIALIZER(luring_states);
+static GArray *luring_bufs;
+static unsigned int luring_bufs_gen;
+
+static void __attribute__((__constructor__)) luring_init_globals(void)
+{
+    qemu_mutex_init(&luring_lock);
+    luring_bufs = g_array_new(false, false, sizeof(LuringBuf));
+}
+
 /**
  * luring_resubmit:
  *
@@ -102,12 +162,35 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 
     /* Update sqe */
     luringcb->sqeq.off += nread;
-    luringcb->sqeq.addr = (uintptr_t)luringcb->resubmit_qiov.iov;
-    luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        /* The buffer index stays valid for the tail of the buffer */
+        luringcb->sqeq.addr += nread;
+        luringcb->sqeq.len = remaining;
+    } else {
+        luringcb->sqeq.addr = (uintptr_t)luringcb->resubmit_qiov.iov;
+        luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+    }
 
     luring_resubmit(s, luringcb);
 }
 
+/**
+ * luring_update_poll_busy:
+ *
+ * Completions of LURING_IOPOLL rings are only reaped by io_uring_enter(),
+ * nothing wakes up the event loop.  Keep it polling while requests are in
+ * flight.
+ */
+static void luring_update_poll_busy(LuringState *s)
+{
+    bool busy = (s->flags & LURING_IOPOLL) && s->io_q.in_flight > 0;
+
+    if (busy != s->poll_busy) {
+        s->poll_busy = busy;
+        aio_context_poll_busy(s->aio_context, busy);
+    }
+}
+
 /**
  * luring_process_completions:
  * @s: AIO state
@@ -222,6 +305,7 @@ end:
     }
 
     qemu_bh_cancel(s->completion_bh);
+    luring_update_poll_busy(s);
 
     defer_call_end();
 }
@@ -259,6 +343,7 @@ static int ioq_submit(LuringState *s)
         s->io_q.in_queue  -= ret;
     }
     s->io_q.blocked = (s->io_q.in_queue > 0);
+    luring_update_poll_busy(s);
 
     if (s->io_q.in_flight) {
         /*
@@ -295,6 +380,12 @@ static bool qemu_luring_poll_cb(void *opaque)
 {
     LuringState *s = opaque;
 
+    if (s->flags & LURING_IOPOLL) {
+        struct io_uring_cqe *cqe;
+
+        /* This enters the kernel to reap completions from the device */
+        return s->io_q.in_flight && io_uring_peek_cqe(&s->ring, &cqe) == 0;
+    }
     return io_uring_cq_ready(&s->ring);
 }
 
@@ -323,6 +414,115 @@ static void luring_deferred_fn(void *opaque)
     }
 }
 
+/**
+ * luring_fixed_file:
+ *
+ * Returns the slot of @fd in the registered file table, registering it in a
+ * free slot if necessary, or -1 if it cannot be used as a fixed file.
+ */
+static int luring_fixed_file(LuringState *s, int fd)
+{
+    int free_slot = -1;
+    int i;
+
+    if (!s->files_registered) {
+        return -1;
+    }
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        int slot_fd = qatomic_read(&s->files[i]);
+
+        if (slot_fd == fd) {
+            return i;
+        }
+        if (slot_fd == -1 && free_slot == -1) {
+            free_slot = i;
+        }
+    }
+
+    if (free_slot == -1 ||
+        io_uring_register_files_update(&s->ring, free_slot, &fd, 1) != 1) {
+        return -1;
+    }
+    qatomic_set(&s->files[free_slot], fd);
+    trace_luring_register_fd(s, fd, free_slot);
+    return free_slot;
+}
+
+/**
+ * luring_sync_bufs:
+ *
+ * Replace the ring's registered buffers with the current contents of
+ * luring_bufs.  Must only be called when no requests are in flight, because
+ * older kernels cannot unregister buffers that are in use.
+ */
+static void luring_sync_bufs(LuringState *s)
+{
+    unsigned int nr_bufs = 0;
+    int ret = 0;
+    guint i;
+
+    if (s->nr_bufs) {
+        io_uring_unregister_buffers(&s->ring);
+        s->nr_bufs = 0;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&luring_lock) {
+        s->bufs_gen = luring_bufs_gen;
+        g_free(s->bufs);
+        s->bufs = g_new(struct iovec, MAX_FIXED_BUFS);
+
+        for (i = 0; i < luring_bufs->len; i++) {
+            LuringBuf *buf = &g_array_index(luring_bufs, LuringBuf, i);
+            size_t done;
+
+            for (done = 0; done < buf->size && nr_bufs < MAX_FIXED_BUFS;
+                 done += MAX_FIXED_BUF_SIZE) {
+                s->bufs[nr_bufs++] = (struct iovec) {
+                    .iov_base = (uint8_t *)buf->host + done,
+                    .iov_len = MIN(buf->size - done, MAX_FIXED_BUF_SIZE),
+                };
+            }
+        }
+    }
+
+    if (nr_bufs) {
+        ret = io_uring_register_buffers(&s->ring, s->bufs, nr_bufs);
+        if (ret == 0) {
+            s->nr_bufs = nr_bufs;
+        }
+    }
+    trace_luring_sync_bufs(s, nr_bufs, ret);
+}
+
+/**
+ * luring_fixed_buf:
+ *
+ * Returns the index of the registered buffer containing all of @qiov, or -1.
+ * Only single-element vectors can be submitted with a fixed buffer.
+ */
+static int luring_fixed_buf(LuringState *s, QEMUIOVector *qiov)
+{
+    uintptr_t base, end;
+    unsigned int i;
+
+    if (!s->nr_bufs || qiov->niov != 1 ||
+        s->bufs_gen != qatomic_read(&luring_bufs_gen)) {
+        return -1;
+    }
+
+    base = (uintptr_t)qiov->iov[0].iov_base;
+    end = base + qiov->iov[0].iov_len;
+    for (i = 0; i < s->nr_bufs; i++) {
+        uintptr_t buf_base = (uintptr_t)s->bufs[i].iov_base;
+
+        if (base >= buf_base && end <= buf_base + s->bufs[i].iov_len) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -339,9 +539,24 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    int slot = luring_fixed_file(s, fd);
+    int buf_index = -1;
+
+    if (slot >= 0) {
+        fd = slot;
+    }
+    if (type == QEMU_AIO_READ || type == QEMU_AIO_WRITE) {
+        buf_index = luring_fixed_buf(s, luringcb->qiov);
+    }
 
     switch (type) {
     case QEMU_AIO_WRITE:
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->iov[0].iov_len, offset,
+                                      buf_index);
+            break;
+        }
         io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
                              luringcb->qiov->niov, offset);
         break;
@@ -350,6 +565,12 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                              luringcb->qiov->niov, offset);
         break;
     case QEMU_AIO_READ:
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->iov[0].iov_len, offset,
+                                     buf_index);
+            break;
+        }
         io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
                             luringcb->qiov->niov, offset);
         break;
@@ -361,6 +582,9 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (slot >= 0) {
+        io_uring_sqe_set_flags(sqes, IOSQE_FIXED_FILE);
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -380,11 +604,12 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 }
 
 int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
-                                  QEMUIOVector *qiov, int type)
+                                  QEMUIOVector *qiov, int type,
+                                  unsigned int flags)
 {
     int ret;
     AioContext *ctx = qemu_get_current_aio_context();
-    LuringState *s = aio_get_linux_io_uring(ctx);
+    LuringState *s = aio_get_linux_io_uring(ctx, flags);
     LuringAIOCB luringcb = {
         .co         = qemu_coroutine_self(),
         .ret        = -EINPROGRESS,
@@ -393,6 +618,12 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
     };
     trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
                            type);
+
+    if (unlikely(s->bufs_gen != qatomic_read(&luring_bufs_gen)) &&
+        !s->io_q.in_flight && !s->io_q.in_queue) {
+        luring_sync_bufs(s);
+    }
+
     ret = luring_do_submit(fd, &luringcb, s, offset, type);
 
     if (ret < 0) {
@@ -407,6 +638,7 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
 
 void luring_detach_aio_context(LuringState *s, AioContext *old_context)
 {
+    assert(!s->poll_busy);
     aio_set_fd_handler(old_context, s->ring.ring_fd,
                        NULL, NULL, NULL, NULL, s);
     qemu_bh_delete(s->completion_bh);
@@ -422,29 +654,112 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
 }
 
-LuringState *luring_init(Error **errp)
+LuringState *luring_init(unsigned int flags, Error **errp)
 {
     int rc;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
+    struct io_uring_params params = {};
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    if (flags & LURING_IOPOLL) {
+        params.flags |= IORING_SETUP_IOPOLL;
+    }
+    if (flags & LURING_SQPOLL) {
+        params.flags |= IORING_SETUP_SQPOLL;
+    }
+
+    rc = io_uring_queue_init_params(MAX_ENTRIES, ring, &params);
     if (rc < 0) {
         error_setg_errno(errp, -rc, "failed to init linux io_uring ring");
         g_free(s);
         return NULL;
     }
+    s->flags = flags;
 
     ioq_init(&s->io_q);
+
+    /* Failure is not fatal, requests then simply use normal fds */
+    memset(s->files, -1, sizeof(s->files));
+    rc = io_uring_register_files(ring, s->files, MAX_FIXED_FILES);
+    s->files_registered = (rc == 0);
+
+    WITH_QEMU_LOCK_GUARD(&luring_lock) {
+        QLIST_INSERT_HEAD(&luring_states, s, next);
+    }
     return s;
 
 }
 
 void luring_cleanup(LuringState *s)
 {
+    WITH_QEMU_LOCK_GUARD(&luring_lock) {
+        QLIST_REMOVE(s, next);
+    }
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
+    g_free(s->bufs);
     g_free(s);
 }
+
+void luring_unregister_fd(int fd)
+{
+    LuringState *s;
+
+    QEMU_LOCK_GUARD(&luring_lock);
+    QLIST_FOREACH(s, &luring_states, next) {
+        int i;
+
+        for (i = 0; i < MAX_FIXED_FILES; i++) {
+            if (qatomic_read(&s->files[i]) == fd) {
+                int empty = -1;
+
+                /* Drop the ring's reference to the file before it's closed */
+                io_uring_register_files_update(&s->ring, i, &empty, 1);
+                qatomic_set(&s->files[i], -1);
+                trace_luring_unregister_fd(s, fd, i);
+            }
+        }
+    }
+}
+
+void luring_register_buf(void *host, size_t size)
+{
+    LuringBuf *buf;
+    guint i;
+
+    QEMU_LOCK_GUARD(&luring_lock);
+    for (i = 0; i < luring_bufs->len; i++) {
+        buf = &g_array_index(luring_bufs, LuringBuf, i);
+        if (buf->host == host && buf->size == size) {
+            buf->refcnt++;
+            return;
+        }
+    }
+
+    g_array_append_val(luring_bufs, ((LuringBuf) {
+        .host = host,
+        .size = size,
+        .refcnt = 1,
+    }));
+    qatomic_inc(&luring_bufs_gen);
+}
+
+void luring_unregister_buf(void *host, size_t size)
+{
+    LuringBuf *buf;
+    guint i;
+
+    QEMU_LOCK_GUARD(&luring_lock);
+    for (i = 0; i < luring_bufs->len; i++) {
+        buf = &g_array_index(luring_bufs, LuringBuf, i);
+        if (buf->host == host && buf->size == size) {
+            if (--buf->refcnt == 0) {
+                g_array_remove_index_fast(luring_bufs, i);
+                qatomic_inc(&luring_bufs_gen);
+            }
+            return;
+        }
+    }
+}
@@ -24,11 +24,18 @@
 #include "qemu/ratelimit.h"
 #include "qemu/bitmap.h"
 #include "qemu/memalign.h"
+#include "qemu/units.h"
 
 #define MAX_IN_FLIGHT 16
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
 
+/* Parameters of the adaptive tuning, see mirror_adapt() */
+#define MIRROR_ADAPT_INTERVAL_NS    (250 * SCALE_MS)
+#define MIRROR_ADAPT_MIN_OPS        4
+#define MIRROR_ADAPT_PROBE_INTERVALS 8
+#define MIRROR_ADAPT_MAX_BUF_SIZE   (256 * MiB)
+
 /* The mirroring buffer is a list of granularity-sized chunks.
  * Free chunks are organized in a list.
  */
@@ -88,6 +95,28 @@ typedef struct MirrorBlockJob {
     bool unmap;
     int target_cluster_size;
     int max_iov;
+
+    /*
+     * Limits for background copy requests.  They only change if @adaptive
+     * is set, and are read with atomics by mirror_query(), as is buf_size.
+     */
+    bool adaptive;
+    unsigned max_in_flight;
+    int max_io_bytes;
+
+    /* State of the adaptive tuning, see mirror_adapt() */
+    size_t adapt_window;
+    size_t adapt_max_window;
+    int64_t adapt_start_ns;
+    uint64_t adapt_bytes;
+    uint64_t adapt_lat_ns;
+    unsigned adapt_ops;
+    uint64_t adapt_last_throughput;
+    uint64_t adapt_last_lat_ns;
+    unsigned adapt_idle;
+    /* Buffers added to the pool while running, in addition to buf */
+    GSList *extra_bufs;
+
     bool initial_zeroing_ongoing;
     int in_active_write_counter;
     int64_t active_write_bytes_in_flight;
@@ -114,6 +143,8 @@ struct MirrorOp {
     bool is_pseudo_op;
     bool is_active_write;
     bool is_in_flight;
+    /* Start time of a background copy, for the adaptive tuning */
+    int64_t start_ns;
     CoQueue waiting_requests;
     Coroutine *co;
     MirrorOp *waiting_for_op;
@@ -193,6 +224,118 @@ static void coroutine_fn mirror_wait_on_conflicts(MirrorOp *self,
     }
 }
 
+static void mirror_init_limits(MirrorBlockJob *s)
+{
+    s->max_in_flight = MAX_IN_FLIGHT;
+    s->max_io_bytes = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
+    s->adapt_window = s->buf_size;
+    s->adapt_max_window = MAX(s->buf_size, MIRROR_ADAPT_MAX_BUF_SIZE);
+}
+
+/* Add @bytes worth of granularity-sized chunks to the buffer pool */
+static bool mirror_grow_buffer(MirrorBlockJob *s, size_t bytes)
+{
+    uint8_t *buf = qemu_try_blockalign(s->mirror_top_bs, bytes);
+    size_t i;
+
+    if (!buf) {
+        return false;
+    }
+
+    s->extra_bufs = g_slist_prepend(s->extra_bufs, buf);
+    for (i = 0; i < bytes; i += s->granularity) {
+        MirrorBuffer *cur = (MirrorBuffer *)(buf + i);
+        QSIMPLEQ_INSERT_TAIL(&s->buf_free, cur, next);
+        s->buf_free_count++;
+    }
+    qatomic_set(&s->buf_size, s->buf_size + bytes);
+    return true;
+}
+
+/*
+ * Split the amount of data that should be in flight into MAX_IN_FLIGHT
+ * requests, or into fewer requests if they would be smaller than the
+ * granularity.
+ */
+static void mirror_adapt_apply(MirrorBlockJob *s)
+{
+    int64_t io_bytes;
+
+    io_bytes = QEMU_ALIGN_DOWN(s->adapt_window / MAX_IN_FLIGHT, s->granularity);
+    io_bytes = MAX(io_bytes, s->granularity);
+
+    qatomic_set(&s->max_io_bytes, io_bytes);
+    qatomic_set(&s->max_in_flight,
+                MAX(MIN(s->adapt_window / io_bytes, MAX_IN_FLIGHT), 1));
+}
+
+/*
+ * Tune the amount of data in flight by hill climbing on the throughput
+ * of the background copy: grow it as long as this pays off, and shrink
+ * it when latency rises without a throughput gain, which means that
+ * requests are only queueing up somewhere.  A stable setting is probed
+ * upwards every few intervals, in case the link or the target got faster.
+ */
+static void mirror_adapt(MirrorBlockJob *s, int64_t now)
+{
+    uint64_t elapsed = now - s->adapt_start_ns;
+    uint64_t throughput = muldiv64(s->adapt_bytes, NANOSECONDS_PER_SECOND,
+                                   elapsed);
+    uint64_t lat_ns = s->adapt_lat_ns / s->adapt_ops;
+    size_t window = s->adapt_window;
+
+    if (throughput > s->adapt_last_throughput +
+                     s->adapt_last_throughput / 8) {
+        window += window / 2;
+        s->adapt_idle = 0;
+    } else if (lat_ns > s->adapt_last_lat_ns + s->adapt_last_lat_ns / 4) {
+        window -= window / 4;
+        s->adapt_idle = 0;
+    } else if (++s->adapt_idle >= MIRROR_ADAPT_PROBE_INTERVALS) {
+        window += window / 4;
+        s->adapt_idle = 0;
+    }
+
+    window = MIN(window, s->adapt_max_window);
+    window = MAX(QEMU_ALIGN_DOWN(window, s->granularity), s->granularity);
+    if (window > s->buf_size) {
+        size_t grow = MIN(s->buf_size, s->adapt_max_window - s->buf_size);
+
+        grow = QEMU_ALIGN_DOWN(grow, s->granularity);
+        if (!grow || !mirror_grow_buffer(s, grow)) {
+            window = s->buf_size;
+        }
+        window = MIN(window, s->buf_size);
+    }
+
+    s->adapt_window = window;
+    s->adapt_last_throughput = throughput;
+    s->adapt_last_lat_ns = lat_ns;
+    s->adapt_start_ns = now;
+    s->adapt_bytes = 0;
+    s->adapt_lat_ns = 0;
+    s->adapt_ops = 0;
+
+    mirror_adapt_apply(s);
+    trace_mirror_adapt(s, throughput, lat_ns, window, s->max_io_bytes,
+                       s->max_in_flight);
+}
+
+static void mirror_adapt_account(MirrorBlockJob *s, uint64_t bytes,
+                                 int64_t start_ns)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    s->adapt_bytes += bytes;
+    s->adapt_lat_ns += now - start_ns;
+    s->adapt_ops++;
+
+    if (s->adapt_ops >= MIRROR_ADAPT_MIN_OPS &&
+        now - s->adapt_start_ns >= MIRROR_ADAPT_INTERVAL_NS) {
+        mirror_adapt(s, now);
+    }
+}
+
 static void coroutine_fn mirror_iteration_done(MirrorOp *op, int ret)
 {
     MirrorBlockJob *s = op->s;
@@ -217,6 +360,9 @@ static void coroutine_fn mirror_iteration_done(MirrorOp *op, int ret)
     bitmap_clear(s->in_flight_bitmap, chunk_num, nb_chunks);
     QTAILQ_REMOVE(&s->ops_in_flight, op, next);
     if (ret >= 0) {
+        if (op->start_ns) {
+            mirror_adapt_account(s, op->bytes, op->start_ns);
+        }
         if (s->cow_bitmap) {
             bitmap_set(s->cow_bitmap, chunk_num, nb_chunks);
         }
@@ -395,6 +541,9 @@ static void coroutine_fn mirror_co_read(void *opaque)
     s->in_flight++;
     s->bytes_in_flight += op->bytes;
     op->is_in_flight = true;
+    if (s->adaptive) {
+        op->start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
     trace_mirror_one_iteration(s, op->offset, op->bytes);
 
     WITH_GRAPH_RDLOCK_GUARD() {
@@ -487,7 +636,7 @@ static void coroutine_fn GRAPH_RDLOCK mirror_iteration(MirrorBlockJob *s)
     /* At least the first dirty chunk is mirrored in one iteration. */
     int nb_chunks = 1;
     bool write_zeroes_ok = bdrv_can_write_zeroes_with_unmap(blk_bs(s->target));
-    int max_io_bytes = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
+    int max_io_bytes = s->max_io_bytes;
 
     bdrv_dirty_bitmap_lock(s->dirty_bitmap);
     offset = bdrv_dirty_iter_next(s->dbi);
@@ -595,7 +744,7 @@ static void coroutine_fn GRAPH_RDLOCK mirror_iteration(MirrorBlockJob *s)
             }
         }
 
-        while (s->in_flight >= MAX_IN_FLIGHT) {
+        while (s->in_flight >= s->max_in_flight) {
             trace_mirror_yield_in_flight(s, offset, s->in_flight);
             mirror_wait_for_free_in_flight_slot(s);
         }
@@ -1009,6 +1158,8 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
     }
 
     mirror_free_init(s);
+    mirror_init_limits(s);
+    s->adapt_start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
 
     s->last_pause_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     if (!s->is_none_mode) {
@@ -1060,7 +1211,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
         }
         if (delta < BLOCK_JOB_SLICE_TIME &&
             iostatus == BLOCK_DEVICE_IO_STATUS_OK) {
-            if (s->in_flight >= MAX_IN_FLIGHT || s->buf_free_count == 0 ||
+            if (s->in_flight >= s->max_in_flight || s->buf_free_count == 0 ||
                 (cnt == 0 && s->in_flight > 0)) {
                 trace_mirror_yield(s, cnt, s->buf_free_count, s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -1155,6 +1306,8 @@ immediate_exit:
 
     assert(s->in_flight == 0);
     qemu_vfree(s->buf);
+    g_slist_free_full(s->extra_bufs, qemu_vfree);
+    s->extra_bufs = NULL;
     g_free(s->cow_bitmap);
     g_free(s->in_flight_bitmap);
     bdrv_dirty_iter_free(s->dbi);
@@ -1290,6 +1443,10 @@ static void mirror_query(BlockJob *job, BlockJobInfo *info)
 
     info->u.mirror = (BlockJobInfoMirror) {
         .actively_synced = qatomic_read(&s->actively_synced),
+        .adaptive = s->adaptive,
+        .buf_size = qatomic_read(&s->buf_size),
+        .chunk_size = qatomic_read(&s->max_io_bytes),
+        .max_in_flight = qatomic_read(&s->max_in_flight),
     };
 }
 
@@ -1715,7 +1872,7 @@ static BlockJob *mirror_start_job(
                              bool is_none_mode, BlockDriverState *base,
                              bool auto_complete, const char *filter_node_name,
                              bool is_mirror, MirrorCopyMode copy_mode,
-                             Error **errp)
+                             bool adaptive, Error **errp)
 {
     MirrorBlockJob *s;
     MirrorBDSOpaque *bs_opaque;
@@ -1877,6 +2034,8 @@ static BlockJob *mirror_start_job(
     s->base_overlay = bdrv_find_overlay(bs, base);
     s->granularity = granularity;
     s->buf_size = ROUND_UP(buf_size, granularity);
+    s->adaptive = adaptive;
+    mirror_init_limits(s);
     s->unmap = unmap;
     if (auto_complete) {
         s->should_complete = true;
@@ -2004,7 +2163,7 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                   BlockdevOnError on_source_error,
                   BlockdevOnError on_target_error,
                   bool unmap, const char *filter_node_name,
-                  MirrorCopyMode copy_mode, Error **errp)
+                  MirrorCopyMode copy_mode, bool adaptive, Error **errp)
 {
     bool is_none_mode;
     BlockDriverState *base;
@@ -2027,7 +2186,7 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                      speed, granularity, buf_size, backing_mode, zero_target,
                      on_source_error, on_target_error, unmap, NULL, NULL,
                      &mirror_job_driver, is_none_mode, base, false,
-                     filter_node_name, true, copy_mode, errp);
+                     filter_node_name, true, copy_mode, adaptive, errp);
 }
 
 BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
@@ -2056,7 +2215,7 @@ BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
                      on_error, on_error, true, cb, opaque,
                      &commit_active_job_driver, false, base, auto_complete,
                      filter_node_name, false, MIRROR_COPY_MODE_BACKGROUND,
-                     errp);
+                     false, errp);
     if (!job) {
         goto error_restore_flags;
     }
@@ -49,6 +49,7 @@
 
 #define EN_OPTSTR ":exportname="
 #define MAX_NBD_REQUESTS    16
+#define MAX_NBD_CONNS       16
 
 #define COOKIE_TO_INDEX(cookie) ((cookie) - 1)
 #define INDEX_TO_COOKIE(index)  ((index) + 1)
@@ -66,7 +67,15 @@ typedef enum NBDClientState {
     NBD_CLIENT_QUIT
 } NBDClientState;
 
-typedef struct BDRVNBDState {
+typedef struct BDRVNBDState BDRVNBDState;
+
+/*
+ * A single connection to the server.  Each connection has its own socket,
+ * request slots and reconnect state; more than one is only opened if the
+ * server advertises NBD_FLAG_CAN_MULTI_CONN.
+ */
+typedef struct NBDConnState {
+    BDRVNBDState *s;
     QIOChannel *ioc; /* The current I/O channel */
     NBDExportInfo info;
 
@@ -91,6 +100,17 @@ typedef struct BDRVNBDState {
     CoMutex receive_mutex;
     NBDReply reply;
 
+    NBDClientConnection *conn;
+} NBDConnState;
+
+struct BDRVNBDState {
+    /* As negotiated on conns[0]; the other connections must agree */
+    NBDExportInfo info;
+
+    NBDConnState *conns[MAX_NBD_CONNS];
+    unsigned nr_conns;
+    unsigned next_conn; /* accessed atomically */
+
     QEMUTimer *open_timer;
 
     BlockDriverState *bs;
@@ -98,6 +118,7 @@ typedef struct BDRVNBDState {
     /* Connection parameters */
     uint32_t reconnect_delay;
     uint32_t open_timeout;
+    uint32_t multi_conn;
     SocketAddress *saddr;
     char *export;
     char *tlscredsid;
@@ -105,23 +126,53 @@ typedef struct BDRVNBDState {
     char *tlshostname;
     char *x_dirty_bitmap;
     bool alloc_depth;
-
-    NBDClientConnection *conn;
-} BDRVNBDState;
+};
 
 static void nbd_yank(void *opaque);
 
+/* Takes ownership of @conn if it is not NULL, otherwise creates one */
+static NBDConnState *nbd_conn_new(BDRVNBDState *s, NBDClientConnection *conn)
+{
+    NBDConnState *cs = g_new0(NBDConnState, 1);
+
+    cs->s = s;
+    qemu_mutex_init(&cs->requests_lock);
+    qemu_co_queue_init(&cs->free_sema);
+    qemu_co_mutex_init(&cs->send_mutex);
+    qemu_co_mutex_init(&cs->receive_mutex);
+    cs->conn = conn ?: nbd_client_connection_new(s->saddr, true, s->export,
+                                                 s->x_dirty_bitmap,
+                                                 s->tlscreds, s->tlshostname);
+    cs->state = NBD_CLIENT_CONNECTING_WAIT;
+
+    return cs;
+}
+
+static void nbd_conn_free(NBDConnState *cs)
+{
+    /* Must not leave timers behind that would access freed data */
+    assert(!cs->reconnect_delay_timer);
+    assert(!cs->ioc);
+
+    nbd_client_connection_release(cs->conn);
+    qemu_mutex_destroy(&cs->requests_lock);
+    g_free(cs);
+}
+
 static void nbd_clear_bdrvstate(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned i;
 
-    nbd_client_connection_release(s->conn);
-    s->conn = NULL;
+    for (i = 0; i < s->nr_conns; i++) {
+        nbd_conn_free(s->conns[i]);
+        s->conns[i] = NULL;
+    }
+    s->nr_conns = 0;
 
     yank_unregister_instance(BLOCKDEV_YANK_INSTANCE(bs->node_name));
 
     /* Must not leave timers behind that would access freed data */
-    assert(!s->reconnect_delay_timer);
     assert(!s->open_timer);
 
     object_unref(OBJECT(s->tlscreds));
@@ -137,7 +188,7 @@ static void nbd_clear_bdrvstate(BlockDriverState *bs)
     s->x_dirty_bitmap = NULL;
 }
 
-/* Called with s->receive_mutex taken.  */
+/* Called with cs->receive_mutex taken.  */
 static bool coroutine_fn nbd_recv_coroutine_wake_one(NBDClientRequest *req)
 {
     if (req->receiving) {
@@ -149,89 +200,95 @@ static bool coroutine_fn nbd_recv_coroutine_wake_one(NBDClientRequest *req)
     return false;
 }
 
-static void coroutine_fn nbd_recv_coroutines_wake(BDRVNBDState *s)
+static void coroutine_fn nbd_recv_coroutines_wake(NBDConnState *cs)
 {
     int i;
 
-    QEMU_LOCK_GUARD(&s->receive_mutex);
+    QEMU_LOCK_GUARD(&cs->receive_mutex);
     for (i = 0; i < MAX_NBD_REQUESTS; i++) {
-        if (nbd_recv_coroutine_wake_one(&s->requests[i])) {
+        if (nbd_recv_coroutine_wake_one(&cs->requests[i])) {
             return;
         }
     }
 }
 
-/* Called with s->requests_lock held.  */
-static void coroutine_fn nbd_channel_error_locked(BDRVNBDState *s, int ret)
+/* Called with cs->requests_lock held.  */
+static void coroutine_fn nbd_channel_error_locked(NBDConnState *cs, int ret)
 {
-    if (s->state == NBD_CLIENT_CONNECTED) {
-        qio_channel_shutdown(s->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    if (cs->state == NBD_CLIENT_CONNECTED) {
+        qio_channel_shutdown(cs->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
     }
 
     if (ret == -EIO) {
-        if (s->state == NBD_CLIENT_CONNECTED) {
-            s->state = s->reconnect_delay ? NBD_CLIENT_CONNECTING_WAIT :
-                                            NBD_CLIENT_CONNECTING_NOWAIT;
+        if (cs->state == NBD_CLIENT_CONNECTED) {
+            cs->state = cs->s->reconnect_delay ? NBD_CLIENT_CONNECTING_WAIT :
+                                                 NBD_CLIENT_CONNECTING_NOWAIT;
         }
     } else {
-        s->state = NBD_CLIENT_QUIT;
+        cs->state = NBD_CLIENT_QUIT;
     }
 }
 
-static void coroutine_fn nbd_channel_error(BDRVNBDState *s, int ret)
+static void coroutine_fn nbd_channel_error(NBDConnState *cs, int ret)
 {
-    QEMU_LOCK_GUARD(&s->requests_lock);
-    nbd_channel_error_locked(s, ret);
+    QEMU_LOCK_GUARD(&cs->requests_lock);
+    nbd_channel_error_locked(cs, ret);
 }
 
-static void reconnect_delay_timer_del(BDRVNBDState *s)
+static void reconnect_delay_timer_del(NBDConnState *cs)
 {
-    if (s->reconnect_delay_timer) {
-        timer_free(s->reconnect_delay_timer);
-        s->reconnect_delay_timer = NULL;
+    if (cs->reconnect_delay_timer) {
+        timer_free(cs->reconnect_delay_timer);
+        cs->reconnect_delay_timer = NULL;
     }
 }
 
 static void reconnect_delay_timer_cb(void *opaque)
 {
-    BDRVNBDState *s = opaque;
+    NBDConnState *cs = opaque;
 
-    reconnect_delay_timer_del(s);
-    WITH_QEMU_LOCK_GUARD(&s->requests_lock) {
-        if (s->state != NBD_CLIENT_CONNECTING_WAIT) {
+    reconnect_delay_timer_del(cs);
+    WITH_QEMU_LOCK_GUARD(&cs->requests_lock) {
+        if (cs->state != NBD_CLIENT_CONNECTING_WAIT) {
             return;
         }
-        s->state = NBD_CLIENT_CONNECTING_NOWAIT;
+        cs->state = NBD_CLIENT_CONNECTING_NOWAIT;
     }
-    nbd_co_establish_connection_cancel(s->conn);
+    nbd_co_establish_connection_cancel(cs->conn);
 }
 
-static void reconnect_delay_timer_init(BDRVNBDState *s, uint64_t expire_time_ns)
+static void reconnect_delay_timer_init(NBDConnState *cs,
+                                       uint64_t expire_time_ns)
 {
-    assert(!s->reconnect_delay_timer);
-    s->reconnect_delay_timer = aio_timer_new(bdrv_get_aio_context(s->bs),
-                                             QEMU_CLOCK_REALTIME,
-                                             SCALE_NS,
-                                             reconnect_delay_timer_cb, s);
-    timer_mod(s->reconnect_delay_timer, expire_time_ns);
+    assert(!cs->reconnect_delay_timer);
+    cs->reconnect_delay_timer = aio_timer_new(bdrv_get_aio_context(cs->s->bs),
+                                              QEMU_CLOCK_REALTIME,
+                                              SCALE_NS,
+                                              reconnect_delay_timer_cb, cs);
+    timer_mod(cs->reconnect_delay_timer, expire_time_ns);
 }
 
 static void nbd_teardown_connection(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned i;
 
-    assert(!s->in_flight);
+    for (i = 0; i < s->nr_conns; i++) {
+        NBDConnState *cs = s->conns[i];
 
-    if (s->ioc) {
-        qio_channel_shutdown(s->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
-        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, s->bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
-    }
+        assert(!cs->in_flight);
+
+        if (cs->ioc) {
+            qio_channel_shutdown(cs->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+            yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
+                                     nbd_yank, cs);
+            object_unref(OBJECT(cs->ioc));
+            cs->ioc = NULL;
+        }
 
-    WITH_QEMU_LOCK_GUARD(&s->requests_lock) {
-        s->state = NBD_CLIENT_QUIT;
+        WITH_QEMU_LOCK_GUARD(&cs->requests_lock) {
+            cs->state = NBD_CLIENT_QUIT;
+        }
     }
 }
 
@@ -247,7 +304,7 @@ static void open_timer_cb(void *opaque)
 {
     BDRVNBDState *s = opaque;
 
-    nbd_co_establish_connection_cancel(s->conn);
+    nbd_co_establish_connection_cancel(s->conns[0]->conn);
     open_timer_del(s);
 }
 
@@ -261,13 +318,13 @@ static void open_timer_init(BDRVNBDState *s, uint64_t expire_time_ns)
     timer_mod(s->open_timer, expire_time_ns);
 }
 
-static bool nbd_client_will_reconnect(BDRVNBDState *s)
+static bool nbd_client_will_reconnect(NBDConnState *cs)
 {
     /*
      * Called only after a socket error, so this is not performance sensitive.
      */
-    QEMU_LOCK_GUARD(&s->requests_lock);
-    return s->state == NBD_CLIENT_CONNECTING_WAIT;
+    QEMU_LOCK_GUARD(&cs->requests_lock);
+    return cs->state == NBD_CLIENT_CONNECTING_WAIT;
 }
 
 /*
@@ -316,131 +373,207 @@ nbd_handle_updated_info(BlockDriverState *bs, Error **errp)
     return 0;
 }
 
-int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
-                                                bool blocking, Error **errp)
+/*
+ * Additional connections are used interchangeably with the first one, so the
+ * server must have presented the same export on them.
+ */
+static int nbd_check_conn_info(NBDConnState *cs, Error **errp)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDExportInfo *info = &cs->s->info;
+
+    if (cs->info.size != info->size || cs->info.flags != info->flags ||
+        cs->info.mode != info->mode ||
+        cs->info.base_allocation != info->base_allocation ||
+        cs->info.min_block != info->min_block ||
+        cs->info.max_block != info->max_block) {
+        error_setg(errp, "Server negotiated different export parameters on "
+                   "an additional connection");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+nbd_conn_establish(NBDConnState *cs, bool blocking, Error **errp)
+{
+    BDRVNBDState *s = cs->s;
     int ret;
-    IO_CODE();
 
-    assert_bdrv_graph_readable();
-    assert(!s->ioc);
+    assert(!cs->ioc);
 
-    s->ioc = nbd_co_establish_connection(s->conn, &s->info, blocking, errp);
-    if (!s->ioc) {
+    cs->ioc = nbd_co_establish_connection(cs->conn, &cs->info, blocking, errp);
+    if (!cs->ioc) {
         return -ECONNREFUSED;
     }
 
     yank_register_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name), nbd_yank,
-                           bs);
+                           cs);
 
-    ret = nbd_handle_updated_info(s->bs, NULL);
+    if (cs == s->conns[0]) {
+        s->info = cs->info;
+        ret = nbd_handle_updated_info(s->bs, NULL);
+    } else {
+        ret = nbd_check_conn_info(cs, errp);
+    }
     if (ret < 0) {
         /*
          * We have connected, but must fail for other reasons.
          * Send NBD_CMD_DISC as a courtesy to the server.
          */
-        NBDRequest request = { .type = NBD_CMD_DISC, .mode = s->info.mode };
+        NBDRequest request = { .type = NBD_CMD_DISC, .mode = cs->info.mode };
 
-        nbd_send_request(s->ioc, &request);
+        nbd_send_request(cs->ioc, &request);
 
         yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+                                 nbd_yank, cs);
+        object_unref(OBJECT(cs->ioc));
+        cs->ioc = NULL;
 
         return ret;
     }
 
-    qio_channel_set_blocking(s->ioc, false, NULL);
-    qio_channel_set_follow_coroutine_ctx(s->ioc, true);
+    qio_channel_set_blocking(cs->ioc, false, NULL);
+    qio_channel_set_follow_coroutine_ctx(cs->ioc, true);
 
     /* successfully connected */
-    WITH_QEMU_LOCK_GUARD(&s->requests_lock) {
-        s->state = NBD_CLIENT_CONNECTED;
+    WITH_QEMU_LOCK_GUARD(&cs->requests_lock) {
+        cs->state = NBD_CLIENT_CONNECTED;
     }
 
     return 0;
 }
 
-/* Called with s->requests_lock held.  */
-static bool nbd_client_connecting(BDRVNBDState *s)
+int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
+                                                unsigned int idx,
+                                                bool blocking, Error **errp)
+{
+    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    IO_CODE();
+
+    assert_bdrv_graph_readable();
+    assert(idx < s->nr_conns);
+
+    return nbd_conn_establish(s->conns[idx], blocking, errp);
+}
+
+/* Called with cs->requests_lock held.  */
+static bool nbd_client_connecting(NBDConnState *cs)
 {
-    return s->state == NBD_CLIENT_CONNECTING_WAIT ||
-        s->state == NBD_CLIENT_CONNECTING_NOWAIT;
+    return cs->state == NBD_CLIENT_CONNECTING_WAIT ||
+        cs->state == NBD_CLIENT_CONNECTING_NOWAIT;
 }
 
-/* Called with s->requests_lock taken.  */
-static void coroutine_fn GRAPH_RDLOCK nbd_reconnect_attempt(BDRVNBDState *s)
+/* Called with cs->requests_lock taken.  */
+static void coroutine_fn GRAPH_RDLOCK nbd_reconnect_attempt(NBDConnState *cs)
 {
+    BDRVNBDState *s = cs->s;
     int ret;
-    bool blocking = s->state == NBD_CLIENT_CONNECTING_WAIT;
+    bool blocking = cs->state == NBD_CLIENT_CONNECTING_WAIT;
 
     /*
      * Now we are sure that nobody is accessing the channel, and no one will
      * try until we set the state to CONNECTED.
      */
-    assert(nbd_client_connecting(s));
-    assert(s->in_flight == 1);
+    assert(nbd_client_connecting(cs));
+    assert(cs->in_flight == 1);
 
     trace_nbd_reconnect_attempt(s->bs->in_flight);
 
-    if (blocking && !s->reconnect_delay_timer) {
+    if (blocking && !cs->reconnect_delay_timer) {
         /*
          * It's the first reconnect attempt after switching to
          * NBD_CLIENT_CONNECTING_WAIT
          */
         g_assert(s->reconnect_delay);
-        reconnect_delay_timer_init(s,
+        reconnect_delay_timer_init(cs,
             qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
             s->reconnect_delay * NANOSECONDS_PER_SECOND);
     }
 
     /* Finalize previous connection if any */
-    if (s->ioc) {
+    if (cs->ioc) {
         yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, s->bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+                                 nbd_yank, cs);
+        object_unref(OBJECT(cs->ioc));
+        cs->ioc = NULL;
     }
 
-    qemu_mutex_unlock(&s->requests_lock);
-    ret = nbd_co_do_establish_connection(s->bs, blocking, NULL);
+    qemu_mutex_unlock(&cs->requests_lock);
+    ret = nbd_conn_establish(cs, blocking, NULL);
     trace_nbd_reconnect_attempt_result(ret, s->bs->in_flight);
-    qemu_mutex_lock(&s->requests_lock);
+    qemu_mutex_lock(&cs->requests_lock);
 
     /*
      * The reconnect attempt is done (maybe successfully, maybe not), so
      * we no longer need this timer.  Delete it so it will not outlive
      * this I/O request (so draining removes all timers).
      */
-    reconnect_delay_timer_del(s);
+    reconnect_delay_timer_del(cs);
 }
 
-static coroutine_fn int nbd_receive_replies(BDRVNBDState *s, uint64_t cookie,
+/*
+ * Pick the connection for a new request: the connected one with the fewest
+ * requests in flight, rotating among equally loaded ones.  The counters are
+ * read without the lock, they only serve as a hint and nbd_co_send_request()
+ * still waits for a free slot if needed.  If no connection is up, fall back
+ * to one that is reconnecting, so that the request goes through the usual
+ * reconnect logic.
+ */
+static NBDConnState *nbd_choose_conn(BDRVNBDState *s)
+{
+    NBDConnState *best = NULL, *fallback = s->conns[0];
+    unsigned start, i;
+
+    if (s->nr_conns == 1) {
+        return s->conns[0];
+    }
+
+    start = qatomic_fetch_inc(&s->next_conn);
+    for (i = 0; i < s->nr_conns; i++) {
+        NBDConnState *cs = s->conns[(start + i) % s->nr_conns];
+        NBDClientState state = qatomic_read(&cs->state);
+
+        if (state != NBD_CLIENT_CONNECTED) {
+            if (state != NBD_CLIENT_QUIT &&
+                qatomic_read(&fallback->state) == NBD_CLIENT_QUIT) {
+                fallback = cs;
+            }
+            continue;
+        }
+        if (!best ||
+            qatomic_read(&cs->in_flight) < qatomic_read(&best->in_flight)) {
+            best = cs;
+        }
+    }
+
+    return best ?: fallback;
+}
+
+static coroutine_fn int nbd_receive_replies(NBDConnState *cs, uint64_t cookie,
                                             Error **errp)
 {
     int ret;
     uint64_t ind = COOKIE_TO_INDEX(cookie), ind2;
-    QEMU_LOCK_GUARD(&s->receive_mutex);
+    QEMU_LOCK_GUARD(&cs->receive_mutex);
 
     while (true) {
-        if (s->reply.cookie == cookie) {
+        if (cs->reply.cookie == cookie) {
             /* We are done */
             return 0;
         }
 
-        if (s->reply.cookie != 0) {
+        if (cs->reply.cookie != 0) {
             /*
              * Some other request is being handled now. It should already be
-             * woken by whoever set s->reply.cookie (or never wait in this
+             * woken by whoever set cs->reply.cookie (or never wait in this
              * yield). So, we should not wake it here.
              */
-            ind2 = COOKIE_TO_INDEX(s->reply.cookie);
-            assert(!s->requests[ind2].receiving);
+            ind2 = COOKIE_TO_INDEX(cs->reply.cookie);
+            assert(!cs->requests[ind2].receiving);
 
-            s->requests[ind].receiving = true;
-            qemu_co_mutex_unlock(&s->receive_mutex);
+            cs->requests[ind].receiving = true;
+            qemu_co_mutex_unlock(&cs->receive_mutex);
 
             qemu_coroutine_yield();
             /*
@@ -448,112 +581,112 @@ static coroutine_fn int nbd_receive_replies(BDRVNBDState *s, uint64_t cookie,
              * 1. From this function, executing in parallel coroutine, when our
              *    cookie is received.
              * 2. From nbd_co_receive_one_chunk(), when previous request is
-             *    finished and s->reply.cookie set to 0.
+             *    finished and cs->reply.cookie set to 0.
              * Anyway, it's OK to lock the mutex and go to the next iteration.
              */
 
-            qemu_co_mutex_lock(&s->receive_mutex);
-            assert(!s->requests[ind].receiving);
+            qemu_co_mutex_lock(&cs->receive_mutex);
+            assert(!cs->requests[ind].receiving);
             continue;
         }
 
         /* We are under mutex and cookie is 0. We have to do the dirty work. */
-        assert(s->reply.cookie == 0);
-        ret = nbd_receive_reply(s->bs, s->ioc, &s->reply, s->info.mode, errp);
+        assert(cs->reply.cookie == 0);
+        ret = nbd_receive_reply(cs->s->bs, cs->ioc, &cs->reply, cs->info.mode,
+                                errp);
         if (ret == 0) {
             ret = -EIO;
             error_setg(errp, "server dropped connection");
         }
         if (ret < 0) {
-            nbd_channel_error(s, ret);
+            nbd_channel_error(cs, ret);
             return ret;
         }
-        if (nbd_reply_is_structured(&s->reply) &&
-            s->info.mode < NBD_MODE_STRUCTURED) {
-            nbd_channel_error(s, -EINVAL);
+        if (nbd_reply_is_structured(&cs->reply) &&
+            cs->info.mode < NBD_MODE_STRUCTURED) {
+            nbd_channel_error(cs, -EINVAL);
             error_setg(errp, "unexpected structured reply");
             return -EINVAL;
         }
-        ind2 = COOKIE_TO_INDEX(s->reply.cookie);
-        if (ind2 >= MAX_NBD_REQUESTS || !s->requests[ind2].coroutine) {
-            nbd_channel_error(s, -EINVAL);
+        ind2 = COOKIE_TO_INDEX(cs->reply.cookie);
+        if (ind2 >= MAX_NBD_REQUESTS || !cs->requests[ind2].coroutine) {
+            nbd_channel_error(cs, -EINVAL);
             error_setg(errp, "unexpected cookie value");
             return -EINVAL;
         }
-        if (s->reply.cookie == cookie) {
+        if (cs->reply.cookie == cookie) {
             /* We are done */
             return 0;
         }
-        nbd_recv_coroutine_wake_one(&s->requests[ind2]);
+        nbd_recv_coroutine_wake_one(&cs->requests[ind2]);
     }
 }
 
 static int coroutine_fn GRAPH_RDLOCK
-nbd_co_send_request(BlockDriverState *bs, NBDRequest *request,
+nbd_co_send_request(NBDConnState *cs, NBDRequest *request,
                     QEMUIOVector *qiov)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
     int rc, i = -1;
 
-    qemu_mutex_lock(&s->requests_lock);
-    while (s->in_flight == MAX_NBD_REQUESTS ||
-           (s->state != NBD_CLIENT_CONNECTED && s->in_flight > 0)) {
-        qemu_co_queue_wait(&s->free_sema, &s->requests_lock);
+    qemu_mutex_lock(&cs->requests_lock);
+    while (cs->in_flight == MAX_NBD_REQUESTS ||
+           (cs->state != NBD_CLIENT_CONNECTED && cs->in_flight > 0)) {
+        qemu_co_queue_wait(&cs->free_sema, &cs->requests_lock);
     }
 
-    s->in_flight++;
-    if (s->state != NBD_CLIENT_CONNECTED) {
-        if (nbd_client_connecting(s)) {
-            nbd_reconnect_attempt(s);
-            qemu_co_queue_restart_all(&s->free_sema);
+    cs->in_flight++;
+    if (cs->state != NBD_CLIENT_CONNECTED) {
+        if (nbd_client_connecting(cs)) {
+            nbd_reconnect_attempt(cs);
+            qemu_co_queue_restart_all(&cs->free_sema);
         }
-        if (s->state != NBD_CLIENT_CONNECTED) {
+        if (cs->state != NBD_CLIENT_CONNECTED) {
             rc = -EIO;
             goto err;
         }
     }
 
     for (i = 0; i < MAX_NBD_REQUESTS; i++) {
-        if (s->requests[i].coroutine == NULL) {
+        if (cs->requests[i].coroutine == NULL) {
             break;
         }
     }
 
     assert(i < MAX_NBD_REQUESTS);
-    s->requests[i].coroutine = qemu_coroutine_self();
-    s->requests[i].offset = request->from;
-    s->requests[i].receiving = false;
-    qemu_mutex_unlock(&s->requests_lock);
+    cs->requests[i].coroutine = qemu_coroutine_self();
+    cs->requests[i].offset = request->from;
+    cs->requests[i].receiving = false;
+    qemu_mutex_unlock(&cs->requests_lock);
 
-    qemu_co_mutex_lock(&s->send_mutex);
+    qemu_co_mutex_lock(&cs->send_mutex);
     request->cookie = INDEX_TO_COOKIE(i);
-    request->mode = s->info.mode;
+    request->mode = cs->info.mode;
 
-    assert(s->ioc);
+    assert(cs->ioc);
 
     if (qiov) {
-        qio_channel_set_cork(s->ioc, true);
-        rc = nbd_send_request(s->ioc, request);
-        if (rc >= 0 && qio_channel_writev_all(s->ioc, qiov->iov, qiov->niov,
+        qio_channel_set_cork(cs->ioc, true);
+        rc = nbd_send_request(cs->ioc, request);
+        if (rc >= 0 && qio_channel_writev_all(cs->ioc, qiov->iov, qiov->niov,
                                               NULL) < 0) {
             rc = -EIO;
         }
-        qio_channel_set_cork(s->ioc, false);
+        qio_channel_set_cork(cs->ioc, false);
     } else {
-        rc = nbd_send_request(s->ioc, request);
+        rc = nbd_send_request(cs->ioc, request);
     }
-    qemu_co_mutex_unlock(&s->send_mutex);
+    qemu_co_mutex_unlock(&cs->send_mutex);
 
     if (rc < 0) {
-        qemu_mutex_lock(&s->requests_lock);
+        qemu_mutex_lock(&cs->requests_lock);
 err:
-        nbd_channel_error_locked(s, rc);
+        nbd_channel_error_locked(cs, rc);
         if (i != -1) {
-            s->requests[i].coroutine = NULL;
+            cs->requests[i].coroutine = NULL;
         }
-        s->in_flight--;
-        qemu_co_queue_next(&s->free_sema);
-        qemu_mutex_unlock(&s->requests_lock);
+        cs->in_flight--;
+        qemu_co_queue_next(&cs->free_sema);
+        qemu_mutex_unlock(&cs->requests_lock);
     }
     return rc;
 }
@@ -614,12 +747,13 @@ static int nbd_parse_offset_hole_payload(BDRVNBDState *s,
  * Based on our request, we expect only one extent in reply, for the
  * base:allocation context.
  */
-static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
+static int nbd_parse_blockstatus_payload(NBDConnState *cs,
                                          NBDStructuredReplyChunk *chunk,
                                          uint8_t *payload, bool wide,
                                          uint64_t orig_length,
                                          NBDExtent64 *extent, Error **errp)
 {
+    BDRVNBDState *s = cs->s;
     uint32_t context_id;
     uint32_t count;
     size_t ext_len = wide ? sizeof(*extent) : sizeof(NBDExtent32);
@@ -633,11 +767,11 @@ static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
     }
 
     context_id = payload_advance32(&payload);
-    if (s->info.context_id != context_id) {
+    if (cs->info.context_id != context_id) {
         error_setg(errp, "Protocol error: unexpected context id %d for "
                          "NBD_REPLY_TYPE_BLOCK_STATUS, when negotiated context "
                          "id is %d", context_id,
-                         s->info.context_id);
+                         cs->info.context_id);
         return -EINVAL;
     }
 
@@ -755,16 +889,17 @@ static int nbd_parse_error_payload(NBDStructuredReplyChunk *chunk,
 }
 
 static int coroutine_fn
-nbd_co_receive_offset_data_payload(BDRVNBDState *s, uint64_t orig_offset,
+nbd_co_receive_offset_data_payload(NBDConnState *cs, uint64_t orig_offset,
                                    QEMUIOVector *qiov, Error **errp)
 {
+    BDRVNBDState *s = cs->s;
     QEMUIOVector sub_qiov;
     uint64_t offset;
     size_t data_size;
     int ret;
-    NBDStructuredReplyChunk *chunk = &s->reply.structured;
+    NBDStructuredReplyChunk *chunk = &cs->reply.structured;
 
-    assert(nbd_reply_is_structured(&s->reply));
+    assert(nbd_reply_is_structured(&cs->reply));
 
     /* The NBD spec requires at least one byte of payload */
     if (chunk->length <= sizeof(offset)) {
@@ -773,7 +908,7 @@ nbd_co_receive_offset_data_payload(BDRVNBDState *s, uint64_t orig_offset,
         return -EINVAL;
     }
 
-    if (nbd_read64(s->ioc, &offset, "OFFSET_DATA offset", errp) < 0) {
+    if (nbd_read64(cs->ioc, &offset, "OFFSET_DATA offset", errp) < 0) {
         return -EIO;
     }
 
@@ -791,7 +926,7 @@ nbd_co_receive_offset_data_payload(BDRVNBDState *s, uint64_t orig_offset,
 
     qemu_iovec_init(&sub_qiov, qiov->niov);
     qemu_iovec_concat(&sub_qiov, qiov, offset - orig_offset, data_size);
-    ret = qio_channel_readv_all(s->ioc, sub_qiov.iov, sub_qiov.niov, errp);
+    ret = qio_channel_readv_all(cs->ioc, sub_qiov.iov, sub_qiov.niov, errp);
     qemu_iovec_destroy(&sub_qiov);
 
     return ret < 0 ? -EIO : 0;
@@ -799,14 +934,14 @@ nbd_co_receive_offset_data_payload(BDRVNBDState *s, uint64_t orig_offset,
 
 #define NBD_MAX_MALLOC_PAYLOAD 1000
 static coroutine_fn int nbd_co_receive_structured_payload(
-        BDRVNBDState *s, void **payload, Error **errp)
+        NBDConnState *cs, void **payload, Error **errp)
 {
     int ret;
     uint32_t len;
 
-    assert(nbd_reply_is_structured(&s->reply));
+    assert(nbd_reply_is_structured(&cs->reply));
 
-    len = s->reply.structured.length;
+    len = cs->reply.structured.length;
 
     if (len == 0) {
         return 0;
@@ -823,7 +958,7 @@ static coroutine_fn int nbd_co_receive_structured_payload(
     }
 
     *payload = g_new(char, len);
-    ret = nbd_read(s->ioc, *payload, len, "structured payload", errp);
+    ret = nbd_read(cs->ioc, *payload, len, "structured payload", errp);
     if (ret < 0) {
         g_free(*payload);
         *payload = NULL;
@@ -849,7 +984,7 @@ static coroutine_fn int nbd_co_receive_structured_payload(
  * corresponding to the server's error reply), and errp is unchanged.
  */
 static coroutine_fn int nbd_co_do_receive_one_chunk(
-        BDRVNBDState *s, uint64_t cookie, bool only_structured,
+        NBDConnState *cs, uint64_t cookie, bool only_structured,
         int *request_ret, QEMUIOVector *qiov, void **payload, Error **errp)
 {
     int ret;
@@ -862,34 +997,34 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
     }
     *request_ret = 0;
 
-    ret = nbd_receive_replies(s, cookie, errp);
+    ret = nbd_receive_replies(cs, cookie, errp);
     if (ret < 0) {
         error_prepend(errp, "Connection closed: ");
         return -EIO;
     }
-    assert(s->ioc);
+    assert(cs->ioc);
 
-    assert(s->reply.cookie == cookie);
+    assert(cs->reply.cookie == cookie);
 
-    if (nbd_reply_is_simple(&s->reply)) {
+    if (nbd_reply_is_simple(&cs->reply)) {
         if (only_structured) {
             error_setg(errp, "Protocol error: simple reply when structured "
                              "reply chunk was expected");
             return -EINVAL;
         }
 
-        *request_ret = -nbd_errno_to_system_errno(s->reply.simple.error);
+        *request_ret = -nbd_errno_to_system_errno(cs->reply.simple.error);
         if (*request_ret < 0 || !qiov) {
             return 0;
         }
 
-        return qio_channel_readv_all(s->ioc, qiov->iov, qiov->niov,
+        return qio_channel_readv_all(cs->ioc, qiov->iov, qiov->niov,
                                      errp) < 0 ? -EIO : 0;
     }
 
     /* handle structured reply chunk */
-    assert(s->info.mode >= NBD_MODE_STRUCTURED);
-    chunk = &s->reply.structured;
+    assert(cs->info.mode >= NBD_MODE_STRUCTURED);
+    chunk = &cs->reply.structured;
 
     if (chunk->type == NBD_REPLY_TYPE_NONE) {
         if (!(chunk->flags & NBD_REPLY_FLAG_DONE)) {
@@ -911,7 +1046,7 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
             return -EINVAL;
         }
 
-        return nbd_co_receive_offset_data_payload(s, s->requests[i].offset,
+        return nbd_co_receive_offset_data_payload(cs, cs->requests[i].offset,
                                                   qiov, errp);
     }
 
@@ -919,7 +1054,7 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
         payload = &local_payload;
     }
 
-    ret = nbd_co_receive_structured_payload(s, payload, errp);
+    ret = nbd_co_receive_structured_payload(cs, payload, errp);
     if (ret < 0) {
         return ret;
     }
@@ -939,23 +1074,23 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
  * Return value is a fatal error code or normal nbd reply error code
  */
 static coroutine_fn int nbd_co_receive_one_chunk(
-        BDRVNBDState *s, uint64_t cookie, bool only_structured,
+        NBDConnState *cs, uint64_t cookie, bool only_structured,
         int *request_ret, QEMUIOVector *qiov, NBDReply *reply, void **payload,
         Error **errp)
 {
-    int ret = nbd_co_do_receive_one_chunk(s, cookie, only_structured,
+    int ret = nbd_co_do_receive_one_chunk(cs, cookie, only_structured,
                                           request_ret, qiov, payload, errp);
 
     if (ret < 0) {
         memset(reply, 0, sizeof(*reply));
-        nbd_channel_error(s, ret);
+        nbd_channel_error(cs, ret);
     } else {
         /* For assert at loop start in nbd_connection_entry */
-        *reply = s->reply;
+        *reply = cs->reply;
     }
-    s->reply.cookie = 0;
+    cs->reply.cookie = 0;
 
-    nbd_recv_coroutines_wake(s);
+    nbd_recv_coroutines_wake(cs);
 
     return ret;
 }
@@ -996,16 +1131,16 @@ static void nbd_iter_request_error(NBDReplyChunkIter *iter, int ret)
  * NBD_FOREACH_REPLY_CHUNK
  * The pointer stored in @payload requires g_free() to free it.
  */
-#define NBD_FOREACH_REPLY_CHUNK(s, iter, cookie, structured, \
+#define NBD_FOREACH_REPLY_CHUNK(cs, iter, cookie, structured, \
                                 qiov, reply, payload) \
     for (iter = (NBDReplyChunkIter) { .only_structured = structured }; \
-         nbd_reply_chunk_iter_receive(s, &iter, cookie, qiov, reply, payload);)
+         nbd_reply_chunk_iter_receive(cs, &iter, cookie, qiov, reply, payload);)
 
 /*
  * nbd_reply_chunk_iter_receive
  * The pointer stored in @payload requires g_free() to free it.
  */
-static bool coroutine_fn nbd_reply_chunk_iter_receive(BDRVNBDState *s,
+static bool coroutine_fn nbd_reply_chunk_iter_receive(NBDConnState *cs,
                                                       NBDReplyChunkIter *iter,
                                                       uint64_t cookie,
                                                       QEMUIOVector *qiov,
@@ -1026,7 +1161,7 @@ static bool coroutine_fn nbd_reply_chunk_iter_receive(BDRVNBDState *s,
         reply = &local_reply;
     }
 
-    ret = nbd_co_receive_one_chunk(s, cookie, iter->only_structured,
+    ret = nbd_co_receive_one_chunk(cs, cookie, iter->only_structured,
                                    &request_ret, qiov, reply, payload,
                                    &local_err);
     if (ret < 0) {
@@ -1058,22 +1193,22 @@ static bool coroutine_fn nbd_reply_chunk_iter_receive(BDRVNBDState *s,
     return true;
 
 break_loop:
-    qemu_mutex_lock(&s->requests_lock);
-    s->requests[COOKIE_TO_INDEX(cookie)].coroutine = NULL;
-    s->in_flight--;
-    qemu_co_queue_next(&s->free_sema);
-    qemu_mutex_unlock(&s->requests_lock);
+    qemu_mutex_lock(&cs->requests_lock);
+    cs->requests[COOKIE_TO_INDEX(cookie)].coroutine = NULL;
+    cs->in_flight--;
+    qemu_co_queue_next(&cs->free_sema);
+    qemu_mutex_unlock(&cs->requests_lock);
 
     return false;
 }
 
 static int coroutine_fn
-nbd_co_receive_return_code(BDRVNBDState *s, uint64_t cookie,
+nbd_co_receive_return_code(NBDConnState *cs, uint64_t cookie,
                            int *request_ret, Error **errp)
 {
     NBDReplyChunkIter iter;
 
-    NBD_FOREACH_REPLY_CHUNK(s, iter, cookie, false, NULL, NULL, NULL) {
+    NBD_FOREACH_REPLY_CHUNK(cs, iter, cookie, false, NULL, NULL, NULL) {
         /* nbd_reply_chunk_iter_receive does all the work */
     }
 
@@ -1083,7 +1218,7 @@ nbd_co_receive_return_code(BDRVNBDState *s, uint64_t cookie,
 }
 
 static int coroutine_fn
-nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t cookie,
+nbd_co_receive_cmdread_reply(NBDConnState *cs, uint64_t cookie,
                              uint64_t offset, QEMUIOVector *qiov,
                              int *request_ret, Error **errp)
 {
@@ -1092,8 +1227,8 @@ nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t cookie,
     void *payload = NULL;
     Error *local_err = NULL;
 
-    NBD_FOREACH_REPLY_CHUNK(s, iter, cookie,
-                            s->info.mode >= NBD_MODE_STRUCTURED,
+    NBD_FOREACH_REPLY_CHUNK(cs, iter, cookie,
+                            cs->info.mode >= NBD_MODE_STRUCTURED,
                             qiov, &reply, &payload)
     {
         int ret;
@@ -1109,17 +1244,18 @@ nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t cookie,
              */
             break;
         case NBD_REPLY_TYPE_OFFSET_HOLE:
-            ret = nbd_parse_offset_hole_payload(s, &reply.structured, payload,
-                                                offset, qiov, &local_err);
+            ret = nbd_parse_offset_hole_payload(cs->s, &reply.structured,
+                                                payload, offset, qiov,
+                                                &local_err);
             if (ret < 0) {
-                nbd_channel_error(s, ret);
+                nbd_channel_error(cs, ret);
                 nbd_iter_channel_error(&iter, ret, &local_err);
             }
             break;
         default:
             if (!nbd_reply_type_is_error(chunk->type)) {
                 /* not allowed reply type */
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(cs, -EINVAL);
                 error_setg(&local_err,
                            "Unexpected reply type: %d (%s) for CMD_READ",
                            chunk->type, nbd_reply_type_lookup(chunk->type));
@@ -1137,7 +1273,7 @@ nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t cookie,
 }
 
 static int coroutine_fn
-nbd_co_receive_blockstatus_reply(BDRVNBDState *s, uint64_t cookie,
+nbd_co_receive_blockstatus_reply(NBDConnState *cs, uint64_t cookie,
                                  uint64_t length, NBDExtent64 *extent,
                                  int *request_ret, Error **errp)
 {
@@ -1148,7 +1284,7 @@ nbd_co_receive_blockstatus_reply(BDRVNBDState *s, uint64_t cookie,
     bool received = false;
 
     assert(!extent->length);
-    NBD_FOREACH_REPLY_CHUNK(s, iter, cookie, false, NULL, &reply, &payload) {
+    NBD_FOREACH_REPLY_CHUNK(cs, iter, cookie, false, NULL, &reply, &payload) {
         int ret;
         NBDStructuredReplyChunk *chunk = &reply.structured;
         bool wide;
@@ -1159,27 +1295,27 @@ nbd_co_receive_blockstatus_reply(BDRVNBDState *s, uint64_t cookie,
         case NBD_REPLY_TYPE_BLOCK_STATUS_EXT:
         case NBD_REPLY_TYPE_BLOCK_STATUS:
             wide = chunk->type == NBD_REPLY_TYPE_BLOCK_STATUS_EXT;
-            if ((s->info.mode >= NBD_MODE_EXTENDED) != wide) {
+            if ((cs->info.mode >= NBD_MODE_EXTENDED) != wide) {
                 trace_nbd_extended_headers_compliance("block_status");
             }
             if (received) {
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(cs, -EINVAL);
                 error_setg(&local_err, "Several BLOCK_STATUS chunks in reply");
                 nbd_iter_channel_error(&iter, -EINVAL, &local_err);
             }
             received = true;
 
             ret = nbd_parse_blockstatus_payload(
-                s, &reply.structured, payload, wide,
+                cs, &reply.structured, payload, wide,
                 length, extent, &local_err);
             if (ret < 0) {
-                nbd_channel_error(s, ret);
+                nbd_channel_error(cs, ret);
                 nbd_iter_channel_error(&iter, ret, &local_err);
             }
             break;
         default:
             if (!nbd_reply_type_is_error(chunk->type)) {
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(cs, -EINVAL);
                 error_setg(&local_err,
                            "Unexpected reply type: %d (%s) "
                            "for CMD_BLOCK_STATUS",
@@ -1209,6 +1345,7 @@ nbd_co_request(BlockDriverState *bs, NBDRequest *request,
     int ret, request_ret;
     Error *local_err = NULL;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs;
 
     assert(request->type != NBD_CMD_READ);
     if (write_qiov) {
@@ -1219,12 +1356,13 @@ nbd_co_request(BlockDriverState *bs, NBDRequest *request,
     }
 
     do {
-        ret = nbd_co_send_request(bs, request, write_qiov);
+        cs = nbd_choose_conn(s);
+        ret = nbd_co_send_request(cs, request, write_qiov);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_return_code(s, request->cookie,
+        ret = nbd_co_receive_return_code(cs, request->cookie,
                                          &request_ret, &local_err);
         if (local_err) {
             trace_nbd_co_request_fail(request->from, request->len,
@@ -1235,7 +1373,7 @@ nbd_co_request(BlockDriverState *bs, NBDRequest *request,
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_will_reconnect(s));
+    } while (ret < 0 && nbd_client_will_reconnect(cs));
 
     return ret ? ret : request_ret;
 }
@@ -1247,6 +1385,7 @@ nbd_client_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
     int ret, request_ret;
     Error *local_err = NULL;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs;
     NBDRequest request = {
         .type = NBD_CMD_READ,
         .from = offset,
@@ -1278,12 +1417,13 @@ nbd_client_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
     }
 
     do {
-        ret = nbd_co_send_request(bs, &request, NULL);
+        cs = nbd_choose_conn(s);
+        ret = nbd_co_send_request(cs, &request, NULL);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_cmdread_reply(s, request.cookie, offset, qiov,
+        ret = nbd_co_receive_cmdread_reply(cs, request.cookie, offset, qiov,
                                            &request_ret, &local_err);
         if (local_err) {
             trace_nbd_co_request_fail(request.from, request.len, request.cookie,
@@ -1293,7 +1433,7 @@ nbd_client_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_will_reconnect(s));
+    } while (ret < 0 && nbd_client_will_reconnect(cs));
 
     return ret ? ret : request_ret;
 }
@@ -1403,6 +1543,7 @@ static int coroutine_fn GRAPH_RDLOCK nbd_client_co_block_status(
     int ret, request_ret;
     NBDExtent64 extent = { 0 };
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs;
     Error *local_err = NULL;
 
     NBDRequest request = {
@@ -1441,12 +1582,13 @@ static int coroutine_fn GRAPH_RDLOCK nbd_client_co_block_status(
         assert(QEMU_IS_ALIGNED(request.len, s->info.min_block));
     }
     do {
-        ret = nbd_co_send_request(bs, &request, NULL);
+        cs = nbd_choose_conn(s);
+        ret = nbd_co_send_request(cs, &request, NULL);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_blockstatus_reply(s, request.cookie, bytes,
+        ret = nbd_co_receive_blockstatus_reply(cs, request.cookie, bytes,
                                                &extent, &request_ret,
                                                &local_err);
         if (local_err) {
@@ -1457,7 +1599,7 @@ static int coroutine_fn GRAPH_RDLOCK nbd_client_co_block_status(
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_will_reconnect(s));
+    } while (ret < 0 && nbd_client_will_reconnect(cs));
 
     if (ret < 0 || request_ret < 0) {
         return ret ? ret : request_ret;
@@ -1486,21 +1628,25 @@ static int nbd_client_reopen_prepare(BDRVReopenState *state,
 
 static void nbd_yank(void *opaque)
 {
-    BlockDriverState *bs = opaque;
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs = opaque;
 
-    QEMU_LOCK_GUARD(&s->requests_lock);
-    qio_channel_shutdown(s->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
-    s->state = NBD_CLIENT_QUIT;
+    QEMU_LOCK_GUARD(&cs->requests_lock);
+    qio_channel_shutdown(cs->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    cs->state = NBD_CLIENT_QUIT;
 }
 
 static void nbd_client_close(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
-    NBDRequest request = { .type = NBD_CMD_DISC, .mode = s->info.mode };
+    unsigned i;
 
-    if (s->ioc) {
-        nbd_send_request(s->ioc, &request);
+    for (i = 0; i < s->nr_conns; i++) {
+        NBDConnState *cs = s->conns[i];
+        NBDRequest request = { .type = NBD_CMD_DISC, .mode = cs->info.mode };
+
+        if (cs->ioc) {
+            nbd_send_request(cs->ioc, &request);
+        }
     }
 
     nbd_teardown_connection(bs);
@@ -1780,6 +1926,82 @@ static QCryptoTLSCreds *nbd_get_tls_creds(const char *id, Error **errp)
     return creds;
 }
 
+/*
+ * Connections started by nbd_preconnect() for nodes that have not been opened
+ * yet, keyed by node name.  Only accessed in the main loop.
+ */
+static GHashTable *nbd_preconnects;
+
+static void nbd_preconnect(BlockdevOptions *options)
+{
+    BlockdevOptionsNbd *opts = &options->u.nbd;
+    QCryptoTLSCreds *tlscreds = NULL;
+    const char *tlshostname = NULL;
+    NBDClientConnection *conn;
+
+    GLOBAL_STATE_CODE();
+
+    /*
+     * Leave anything unusual to nbd_open(), including errors.  Named file
+     * descriptors are looked up only once, so must be left alone, too.
+     */
+    if (!options->node_name ||
+        opts->server->type == SOCKET_ADDRESS_TYPE_FD ||
+        (opts->export && strlen(opts->export) > NBD_MAX_STRING_SIZE) ||
+        (opts->x_dirty_bitmap &&
+         strlen(opts->x_dirty_bitmap) > NBD_MAX_STRING_SIZE)) {
+        return;
+    }
+
+    if (opts->tls_creds) {
+        tlscreds = nbd_get_tls_creds(opts->tls_creds, NULL);
+        if (!tlscreds) {
+            return;
+        }
+        tlshostname = opts->tls_hostname;
+        if (!tlshostname && opts->server->type == SOCKET_ADDRESS_TYPE_INET) {
+            tlshostname = opts->server->u.inet.host;
+        }
+    }
+
+    conn = nbd_client_connection_new(opts->server, true, opts->export,
+                                     opts->x_dirty_bitmap, tlscreds,
+                                     tlshostname);
+    object_unref(OBJECT(tlscreds));
+    if (opts->has_open_timeout && opts->open_timeout) {
+        nbd_client_connection_enable_retry(conn);
+    }
+    nbd_client_connection_start(conn);
+
+    if (!nbd_preconnects) {
+        nbd_preconnects = g_hash_table_new_full(
+            g_str_hash, g_str_equal, g_free,
+            (GDestroyNotify)nbd_client_connection_release);
+    }
+    g_hash_table_replace(nbd_preconnects, g_strdup(options->node_name), conn);
+    trace_nbd_preconnect(options->node_name);
+}
+
+static NBDClientConnection *nbd_preconnect_take(const char *node_name)
+{
+    NBDClientConnection *conn;
+    char *key;
+
+    if (!nbd_preconnects ||
+        !g_hash_table_steal_extended(nbd_preconnects, node_name,
+                                     (gpointer *)&key, (gpointer *)&conn)) {
+        return NULL;
+    }
+    g_free(key);
+    return conn;
+}
+
+static void nbd_preconnect_cleanup(void)
+{
+    GLOBAL_STATE_CODE();
+
+    g_clear_pointer(&nbd_preconnects, g_hash_table_destroy);
+}
 
 static QemuOptsList nbd_runtime_opts = {
     .name = "nbd",
@@ -1841,6 +2063,12 @@ static QemuOptsList nbd_runtime_opts = {
                     "attempts until successful or until @open-timeout seconds "
                     "have elapsed. Default 0",
         },
+        {
+            .name = "multi-conn",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of connections to open to the server if it "
+                    "allows several clients to share the export. Default 1",
+        },
         { /* end of list */ }
     },
 };
@@ -1897,6 +2125,13 @@ static int nbd_process_options(BlockDriverState *bs, QDict *options,
     s->reconnect_delay = qemu_opt_get_number(opts, "reconnect-delay", 0);
     s->open_timeout = qemu_opt_get_number(opts, "open-timeout", 0);
 
+    s->multi_conn = qemu_opt_get_number(opts, "multi-conn", 1);
+    if (s->multi_conn < 1 || s->multi_conn > MAX_NBD_CONNS) {
+        error_setg(errp, "multi-conn must be between 1 and %d",
+                   MAX_NBD_CONNS);
+        goto error;
+    }
+
     ret = 0;
 
  error:
@@ -1907,14 +2142,11 @@ static int nbd_process_options(BlockDriverState *bs, QDict *options,
 static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
                     Error **errp)
 {
+    NBDClientConnection *conn;
     int ret;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
 
     s->bs = bs;
-    qemu_mutex_init(&s->requests_lock);
-    qemu_co_queue_init(&s->free_sema);
-    qemu_co_mutex_init(&s->send_mutex);
-    qemu_co_mutex_init(&s->receive_mutex);
 
     if (!yank_register_instance(BLOCKDEV_YANK_INSTANCE(bs->node_name), errp)) {
         return -EEXIST;
@@ -1925,18 +2157,20 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
         goto fail;
     }
 
-    s->conn = nbd_client_connection_new(s->saddr, true, s->export,
-                                        s->x_dirty_bitmap, s->tlscreds,
-                                        s->tlshostname);
+    conn = nbd_preconnect_take(bs->node_name);
+    s->conns[0] = nbd_conn_new(s, conn);
+    s->nr_conns = 1;
 
     if (s->open_timeout) {
-        nbd_client_connection_enable_retry(s->conn);
+        /* nbd_preconnect() already enabled retrying, and started the thread */
+        if (!conn) {
+            nbd_client_connection_enable_retry(s->conns[0]->conn);
+        }
         open_timer_init(s, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
                         s->open_timeout * NANOSECONDS_PER_SECOND);
     }
 
-    s->state = NBD_CLIENT_CONNECTING_WAIT;
-    ret = nbd_do_establish_connection(bs, true, errp);
+    ret = nbd_do_establish_connection(bs, 0, true, errp);
     if (ret < 0) {
         goto fail;
     }
@@ -1948,7 +2182,36 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
      */
     open_timer_del(s);
 
-    nbd_client_connection_enable_retry(s->conn);
+    nbd_client_connection_enable_retry(s->conns[0]->conn);
+
+    /*
+     * Without NBD_FLAG_CAN_MULTI_CONN, a flush on one connection need not
+     * cover the writes done on the others, so stay with a single one.
+     * Failing to open an additional connection is not fatal, requests
+     * are simply spread over fewer connections.
+     */
+    if (s->multi_conn > 1 && !(s->info.flags & NBD_FLAG_CAN_MULTI_CONN)) {
+        trace_nbd_client_multi_conn_unsupported(s->export);
+    } else {
+        while (s->nr_conns < s->multi_conn) {
+            unsigned idx = s->nr_conns;
+            Error *local_err = NULL;
+
+            s->conns[idx] = nbd_conn_new(s, NULL);
+            s->nr_conns++;
+            ret = nbd_do_establish_connection(bs, idx, true, &local_err);
+            if (ret < 0) {
+                trace_nbd_client_multi_conn_failed(idx,
+                                                   error_get_pretty(local_err));
+                error_free(local_err);
+                s->nr_conns--;
+                nbd_conn_free(s->conns[idx]);
+                s->conns[idx] = NULL;
+                break;
+            }
+            nbd_client_connection_enable_retry(s->conns[idx]->conn);
+        }
+    }
 
     return 0;
 
@@ -2100,22 +2363,28 @@ static const char *const nbd_strong_runtime_opts[] = {
 static void nbd_cancel_in_flight(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned i;
 
-    reconnect_delay_timer_del(s);
+    for (i = 0; i < s->nr_conns; i++) {
+        NBDConnState *cs = s->conns[i];
 
-    qemu_mutex_lock(&s->requests_lock);
-    if (s->state == NBD_CLIENT_CONNECTING_WAIT) {
-        s->state = NBD_CLIENT_CONNECTING_NOWAIT;
-    }
-    qemu_mutex_unlock(&s->requests_lock);
+        reconnect_delay_timer_del(cs);
+
+        qemu_mutex_lock(&cs->requests_lock);
+        if (cs->state == NBD_CLIENT_CONNECTING_WAIT) {
+            cs->state = NBD_CLIENT_CONNECTING_NOWAIT;
+        }
+        qemu_mutex_unlock(&cs->requests_lock);
 
-    nbd_co_establish_connection_cancel(s->conn);
+        nbd_co_establish_connection_cancel(cs->conn);
+    }
 }
 
 static void nbd_attach_aio_context(BlockDriverState *bs,
                                    AioContext *new_context)
 {
     BDRVNBDState *s = bs->opaque;
+    unsigned i;
 
     /* The open_timer is used only during nbd_open() */
     assert(!s->open_timer);
@@ -2129,15 +2398,20 @@ static void nbd_attach_aio_context(BlockDriverState *bs,
      * Since the AioContext can only be changed when a node is drained,
      * the reconnect_delay_timer cannot be active here.
      */
-    assert(!s->reconnect_delay_timer);
+    for (i = 0; i < s->nr_conns; i++) {
+        assert(!s->conns[i]->reconnect_delay_timer);
+    }
 }
 
 static void nbd_detach_aio_context(BlockDriverState *bs)
 {
     BDRVNBDState *s = bs->opaque;
+    unsigned i;
 
     assert(!s->open_timer);
-    assert(!s->reconnect_delay_timer);
+    for (i = 0; i < s->nr_conns; i++) {
+        assert(!s->conns[i]->reconnect_delay_timer);
+    }
 }
 
 static BlockDriver bdrv_nbd = {
@@ -2148,6 +2422,8 @@ static BlockDriver bdrv_nbd = {
     .bdrv_co_create_opts        = bdrv_co_create_opts_simple,
     .create_opts                = &bdrv_create_opts_simple,
     .bdrv_file_open             = nbd_open,
+    .bdrv_preconnect            = nbd_preconnect,
+    .bdrv_preconnect_cleanup    = nbd_preconnect_cleanup,
     .bdrv_reopen_prepare        = nbd_client_reopen_prepare,
     .bdrv_co_preadv             = nbd_client_co_preadv,
     .bdrv_co_pwritev            = nbd_client_co_pwritev,
@@ -2176,6 +2452,8 @@ static BlockDriver bdrv_nbd_tcp = {
     .bdrv_co_create_opts        = bdrv_co_create_opts_simple,
     .create_opts                = &bdrv_create_opts_simple,
     .bdrv_file_open             = nbd_open,
+    .bdrv_preconnect            = nbd_preconnect,
+    .bdrv_preconnect_cleanup    = nbd_preconnect_cleanup,
     .bdrv_reopen_prepare        = nbd_client_reopen_prepare,
     .bdrv_co_preadv             = nbd_client_co_preadv,
     .bdrv_co_pwritev            = nbd_client_co_pwritev,
@@ -2204,6 +2482,8 @@ static BlockDriver bdrv_nbd_unix = {
     .bdrv_co_create_opts        = bdrv_co_create_opts_simple,
     .create_opts                = &bdrv_create_opts_simple,
     .bdrv_file_open             = nbd_open,
+    .bdrv_preconnect            = nbd_preconnect,
+    .bdrv_preconnect_cleanup    = nbd_preconnect_cleanup,
     .bdrv_reopen_prepare        = nbd_client_reopen_prepare,
     .bdrv_co_preadv             = nbd_client_co_preadv,
     .bdrv_co_pwritev            = nbd_client_co_pwritev,
@@ -49,6 +49,8 @@ typedef struct BDRVNVMeState BDRVNVMeState;
 #define INDEX_ADMIN     0
 #define INDEX_IO(n)     (1 + n)
 
+#define NVME_MAX_IO_QUEUES 64
+
 /* This driver shares a single MSIX IRQ for the admin and I/O queues */
 enum {
     MSIX_SHARED_IRQ_IDX = 0,
@@ -110,6 +112,12 @@ struct BDRVNVMeState {
      */
     NVMeQueuePair **queues;
     unsigned queue_count;
+    /*
+     * The AioContext each I/O queue is bound to, NULL if none is yet.
+     * Entries are claimed with cmpxchg and only cleared on
+     * nvme_attach_aio_context(), when no requests are in flight.
+     */
+    AioContext *io_queue_ctx[NVME_MAX_IO_QUEUES];
     size_t page_size;
     /* How many uint32_t elements does each doorbell entry take. */
     size_t doorbell_scale;
@@ -143,6 +151,7 @@ struct BDRVNVMeState {
 
 #define NVME_BLOCK_OPT_DEVICE "device"
 #define NVME_BLOCK_OPT_NAMESPACE "namespace"
+#define NVME_BLOCK_OPT_IO_QUEUES "io-queues"
 
 static void nvme_process_completion_bh(void *opaque);
 
@@ -160,6 +169,12 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "NVMe namespace",
         },
+        {
+            .name = NVME_BLOCK_OPT_IO_QUEUES,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of I/O queue pairs, used by different "
+                    "AioContexts (default: 1)",
+        },
         { /* end of list */ }
     },
 };
@@ -629,11 +644,14 @@ static void nvme_poll_queue(NVMeQueuePair *q)
 
     trace_nvme_poll_queue(q->s, q->index);
     /*
-     * Do an early check for completions. q->lock isn't needed because
-     * nvme_process_completion() only runs in the event loop thread and
-     * cannot race with itself.
+     * Do an early check for completions. q->lock isn't needed with a single
+     * I/O queue because nvme_process_completion() then only runs in the
+     * event loop thread and cannot race with itself.  Queues used by other
+     * AioContexts also have completions processed from the submitting
+     * thread, see nvme_deferred_fn(), so check them under the lock.
      */
-    if ((le16_to_cpu(cqe->status) & 0x1) == q->cq_phase) {
+    if (q->s->queue_count <= INDEX_IO(1) &&
+        (le16_to_cpu(cqe->status) & 0x1) == q->cq_phase) {
         return;
     }
 
@@ -648,9 +666,15 @@ static void nvme_poll_queues(BDRVNVMeState *s)
 {
     int i;
 
+    /*
+     * Completion callbacks may notify the guest or submit new requests,
+     * batch those up across all completions of this iteration.
+     */
+    defer_call_begin();
     for (i = 0; i < s->queue_count; i++) {
         nvme_poll_queue(s->queues[i]);
     }
+    defer_call_end();
 }
 
 static void nvme_handle_event(EventNotifier *n)
@@ -737,8 +761,26 @@ static void nvme_poll_ready(EventNotifier *e)
     nvme_poll_queues(s);
 }
 
+/*
+ * Ask for @count I/O queues.  The controller may grant fewer; in that case
+ * creating the surplus queues fails and nvme_init() makes do with what it
+ * got, so the result of the command is not needed.
+ */
+static void nvme_set_queue_count(BlockDriverState *bs, unsigned count)
+{
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_SET_FEATURES,
+        .cdw10 = cpu_to_le32(NVME_NUMBER_OF_QUEUES),
+        .cdw11 = cpu_to_le32(((count - 1) << 16) | (count - 1)),
+    };
+
+    if (nvme_admin_cmd_sync(bs, &cmd)) {
+        trace_nvme_set_queue_count_failed(bs->opaque, count);
+    }
+}
+
 static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
-                     Error **errp)
+                     unsigned io_queues, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     NVMeQueuePair *q;
@@ -878,8 +920,22 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
     }
 
     /* Set up command queues. */
+    if (io_queues > 1) {
+        nvme_set_queue_count(bs, io_queues);
+    }
     if (!nvme_add_io_queue(bs, errp)) {
         ret = -EIO;
+        goto out;
+    }
+    while (s->queue_count < INDEX_IO(io_queues)) {
+        Error *local_err = NULL;
+
+        if (!nvme_add_io_queue(bs, &local_err)) {
+            trace_nvme_io_queues_limited(s, s->queue_count - INDEX_IO(0),
+                                         error_get_pretty(local_err));
+            error_free(local_err);
+            break;
+        }
     }
 out:
     if (regs) {
@@ -970,6 +1026,7 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     const char *device;
     QemuOpts *opts;
     int namespace;
+    uint64_t io_queues;
     int ret;
     BDRVNVMeState *s = bs->opaque;
 
@@ -985,7 +1042,14 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     namespace = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NAMESPACE, 1);
-    ret = nvme_init(bs, device, namespace, errp);
+    io_queues = qemu_opt_get_number(opts, NVME_BLOCK_OPT_IO_QUEUES, 1);
+    if (io_queues < 1 || io_queues > NVME_MAX_IO_QUEUES) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_IO_QUEUES "' must be between 1 "
+                   "and %d", NVME_MAX_IO_QUEUES);
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    ret = nvme_init(bs, device, namespace, io_queues, errp);
     qemu_opts_del(opts);
     if (ret) {
         goto fail;
@@ -1154,6 +1218,32 @@ fail:
     return r;
 }
 
+/*
+ * Return the I/O queue of the current AioContext.  Each AioContext that
+ * submits requests gets a queue pair of its own while there are enough of
+ * them, so that multiqueue BlockBackends do not contend on one q->lock.
+ */
+static NVMeQueuePair *nvme_get_io_queue(BDRVNVMeState *s)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    unsigned n = s->queue_count - INDEX_IO(0);
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        AioContext *cur = qatomic_read(&s->io_queue_ctx[i]);
+
+        if (!cur) {
+            cur = qatomic_cmpxchg(&s->io_queue_ctx[i], NULL, ctx) ?: ctx;
+        }
+        if (cur == ctx) {
+            return s->queues[INDEX_IO(i)];
+        }
+    }
+
+    /* More AioContexts than queues, share them */
+    return s->queues[INDEX_IO(((uintptr_t)ctx >> 6) % n)];
+}
+
 typedef struct {
     Coroutine *co;
     int ret;
@@ -1185,7 +1275,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
 {
     int r;
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
 
     uint32_t cdw12 = (((bytes >> s->blkshift) - 1) & 0xFFFF) |
@@ -1198,7 +1288,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
         .cdw12 = cpu_to_le32(cdw12),
     };
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1306,14 +1396,14 @@ static coroutine_fn int nvme_co_pwritev(BlockDriverState *bs,
 static coroutine_fn int nvme_co_flush(BlockDriverState *bs)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     NvmeCmd cmd = {
         .opcode = NVME_CMD_FLUSH,
         .nsid = cpu_to_le32(s->nsid),
     };
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1337,7 +1427,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
                                               BdrvRequestFlags flags)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     uint32_t cdw12;
 
@@ -1364,7 +1454,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
     };
 
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1400,7 +1490,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
                                          int64_t bytes)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     QEMU_AUTO_VFREE NvmeDsmRange *buf = NULL;
     QEMUIOVector local_qiov;
@@ -1414,7 +1504,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
     };
 
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1562,6 +1652,9 @@ static void nvme_attach_aio_context(BlockDriverState *bs,
     BDRVNVMeState *s = bs->opaque;
 
     s->aio_context = new_context;
+    for (unsigned i = 0; i < NVME_MAX_IO_QUEUES; i++) {
+        qatomic_set(&s->io_queue_ctx[i], NULL);
+    }
     aio_set_event_notifier(new_context, &s->irq_notifier[MSIX_SHARED_IRQ_IDX],
                            nvme_handle_event, nvme_poll_cb,
                            nvme_poll_ready);
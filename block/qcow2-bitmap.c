@@ -1324,6 +1324,14 @@ store_bitmap_data(BlockDriverState *bs, BdrvDirtyBitmap *bitmap,
          */
         offset = QEMU_ALIGN_DOWN(offset, limit);
         end = MIN(bm_size, offset + limit);
+
+        /* Fully dirty clusters need no data, just the all-ones flag. */
+        if (bdrv_dirty_bitmap_next_zero(bitmap, offset, end - offset) < 0) {
+            tb[cluster] = BME_TABLE_ENTRY_FLAG_ALL_ONES;
+            offset = end;
+            continue;
+        }
+
         write_size = bdrv_dirty_bitmap_serialization_size(bitmap, offset,
                                                           end - offset);
         assert(write_size <= s->cluster_size);
@@ -33,9 +33,17 @@ typedef struct Qcow2CachedTable {
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    /* Next entry in the same hash bucket, or -1 */
+    int      hash_next;
 } Qcow2CachedTable;
 
+/*
+ * Entries with a non-zero offset are also linked in a hash table indexed
+ * by offset, so that cache hits do not need to scan the whole cache.
+ * Only looking for a table to evict walks all the entries.
+ */
 struct Qcow2Cache {
+    BDRVQcow2State         *s;
     Qcow2CachedTable       *entries;
     struct Qcow2Cache      *depends;
     int                     size;
@@ -44,6 +52,8 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+    int                    *hash_buckets;
+    unsigned                hash_mask;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -59,6 +69,49 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static inline int *qcow2_cache_hash_bucket(Qcow2Cache *c, uint64_t offset)
+{
+    return &c->hash_buckets[(offset / c->table_size) & c->hash_mask];
+}
+
+static int qcow2_cache_hash_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int i;
+
+    for (i = *qcow2_cache_hash_bucket(c, offset); i >= 0;
+         i = c->entries[i].hash_next) {
+        if (c->entries[i].offset == offset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Move entry @i to @offset, updating the hash table; 0 means unused */
+static void qcow2_cache_set_offset(Qcow2Cache *c, int i, uint64_t offset)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    if (t->offset) {
+        int *link = qcow2_cache_hash_bucket(c, t->offset);
+
+        while (*link != i) {
+            assert(*link >= 0);
+            link = &c->entries[*link].hash_next;
+        }
+        *link = t->hash_next;
+    }
+
+    t->offset = offset;
+    t->hash_next = -1;
+    if (offset) {
+        int *head = qcow2_cache_hash_bucket(c, offset);
+
+        t->hash_next = *head;
+        *head = i;
+    }
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -106,7 +159,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
+            qcow2_cache_set_offset(c, i, 0);
             c->entries[i].lru_counter = 0;
             i++;
             to_clean++;
@@ -124,7 +177,9 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
                                unsigned table_size)
 {
     BDRVQcow2State *s = bs->opaque;
+    unsigned nr_buckets = pow2ceil(num_tables);
     Qcow2Cache *c;
+    int i;
 
     assert(num_tables > 0);
     assert(is_power_of_2(table_size));
@@ -132,17 +187,28 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     assert(table_size <= s->cluster_size);
 
     c = g_new0(Qcow2Cache, 1);
+    c->s = s;
     c->size = num_tables;
     c->table_size = table_size;
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
+    c->hash_buckets = g_try_new(int, nr_buckets);
+    c->hash_mask = nr_buckets - 1;
 
-    if (!c->entries || !c->table_array) {
+    if (!c->entries || !c->table_array || !c->hash_buckets) {
         qemu_vfree(c->table_array);
         g_free(c->entries);
+        g_free(c->hash_buckets);
         g_free(c);
-        c = NULL;
+        return NULL;
+    }
+
+    for (i = 0; i < num_tables; i++) {
+        c->entries[i].hash_next = -1;
+    }
+    for (i = 0; i < nr_buckets; i++) {
+        c->hash_buckets[i] = -1;
     }
 
     return c;
@@ -158,6 +224,7 @@ int qcow2_cache_destroy(Qcow2Cache *c)
 
     qemu_vfree(c->table_array);
     g_free(c->entries);
+    g_free(c->hash_buckets);
     g_free(c);
 
     return 0;
@@ -309,7 +376,7 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
 
     for (i = 0; i < c->size; i++) {
         assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
+        qcow2_cache_set_offset(c, i, 0);
         c->entries[i].lru_counter = 0;
     }
 
@@ -327,7 +394,6 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     BDRVQcow2State *s = bs->opaque;
     int i;
     int ret;
-    int lookup_index;
     uint64_t min_lru_counter = UINT64_MAX;
     int min_lru_index = -1;
 
@@ -344,20 +410,18 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
+    i = qcow2_cache_hash_lookup(c, offset);
+    if (i >= 0) {
+        goto found;
+    }
+
+    for (i = 0; i < c->size; i++) {
         const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
         if (t->ref == 0 && t->lru_counter < min_lru_counter) {
             min_lru_counter = t->lru_counter;
             min_lru_index = i;
         }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+    }
 
     if (min_lru_index == -1) {
         /* This can't happen in current synchronous code, but leave the check
@@ -377,7 +441,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    qcow2_cache_set_offset(c, i, 0);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -390,7 +454,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
         }
     }
 
-    c->entries[i].offset = offset;
+    qcow2_cache_set_offset(c, i, offset);
 
     /* And return the right table */
 found:
@@ -434,18 +498,64 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
     int i = qcow2_cache_get_table_idx(c, table);
     assert(c->entries[i].offset != 0);
     c->entries[i].dirty = true;
+
+    /* Any change to an L2 table may invalidate the cached extents */
+    if (c == c->s->l2_table_cache) {
+        qcow2_extents_invalidate(c->s);
+    }
 }
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int i = qcow2_cache_hash_lookup(c, offset);
+
+    return i >= 0 ? qcow2_cache_get_table_addr(c, i) : NULL;
+}
+
+int qcow2_cache_count_unused(Qcow2Cache *c)
+{
+    int i, n = 0;
 
     for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
+        if (c->entries[i].offset == 0) {
+            n++;
+        }
+    }
+    return n;
+}
+
+/*
+ * Insert @num_tables consecutive tables starting at @offset, which the
+ * caller has just read from disk into @tables, into unused cache entries.
+ * Tables that are already cached are skipped, because the cached copy may
+ * be newer than the one on disk.  Unlike qcow2_cache_get(), this never
+ * evicts a table; it stops when there are no unused entries left.
+ */
+void qcow2_cache_preload(Qcow2Cache *c, uint64_t offset, int num_tables,
+                         const void *tables)
+{
+    int i = 0, n;
+
+    for (n = 0; n < num_tables; n++) {
+        uint64_t table_offset = offset + (uint64_t) n * c->table_size;
+
+        if (qcow2_cache_hash_lookup(c, table_offset) >= 0) {
+            continue;
+        }
+
+        while (i < c->size && c->entries[i].offset != 0) {
+            i++;
         }
+        if (i == c->size) {
+            return;
+        }
+
+        memcpy(qcow2_cache_get_table_addr(c, i),
+               (const uint8_t *) tables + (size_t) n * c->table_size,
+               c->table_size);
+        qcow2_cache_set_offset(c, i, table_offset);
+        c->entries[i].lru_counter = ++c->lru_counter;
     }
-    return NULL;
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
@@ -454,7 +564,7 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
+    qcow2_cache_set_offset(c, i, 0);
     c->entries[i].lru_counter = 0;
     c->entries[i].dirty = false;
 
@@ -32,6 +32,17 @@
 #include "qemu/memalign.h"
 #include "trace.h"
 
+/*
+ * Upper bound for the number of extents that are kept in memory; once it
+ * is reached, the whole index is dropped and rebuilt from later lookups.
+ */
+#define QCOW2_MAX_EXTENTS 65536
+
+typedef struct Qcow2Extent {
+    IntervalTreeNode node;
+    uint64_t host_offset;
+} Qcow2Extent;
+
 int coroutine_fn qcow2_shrink_l1_table(BlockDriverState *bs,
                                        uint64_t exact_size)
 {
@@ -43,6 +54,7 @@ int coroutine_fn qcow2_shrink_l1_table(BlockDriverState *bs,
     }
 
     new_l1_size = exact_size;
+    qcow2_extents_invalidate(s);
 
 #ifdef DEBUG_ALLOC2
     fprintf(stderr, "shrink l1_table from %d to %d\n", s->l1_size, new_l1_size);
@@ -562,6 +574,95 @@ do_perform_cow_write(BlockDriverState *bs, uint64_t cluster_offset,
     return 0;
 }
 
+/*
+ * Drop all cached guest-to-host mappings.  This must be called whenever
+ * the mapping of an already allocated cluster may change, i.e. before an
+ * L2 slice of the active L1 table is modified or the L1 table is replaced.
+ */
+void qcow2_extents_invalidate(BDRVQcow2State *s)
+{
+    IntervalTreeNode *node;
+
+    if (!s->nb_extents) {
+        return;
+    }
+    while ((node = interval_tree_iter_first(&s->extents, 0, UINT64_MAX))) {
+        interval_tree_remove(node, &s->extents);
+        g_free(container_of(node, Qcow2Extent, node));
+    }
+    s->nb_extents = 0;
+}
+
+static bool qcow2_extent_lookup(BDRVQcow2State *s, uint64_t offset,
+                                unsigned int *bytes, uint64_t *host_offset)
+{
+    IntervalTreeNode *node;
+    Qcow2Extent *e;
+
+    node = interval_tree_iter_first(&s->extents, offset, offset);
+    if (!node) {
+        return false;
+    }
+
+    e = container_of(node, Qcow2Extent, node);
+    *host_offset = e->host_offset + (offset - node->start);
+    *bytes = MIN(*bytes, node->last - offset + 1);
+    return true;
+}
+
+/*
+ * Record that the @bytes bytes at guest @offset are stored contiguously at
+ * @host_offset.  @offset must not be covered by an existing extent; the new
+ * range is merged with its neighbours where they are contiguous in the image
+ * file as well.
+ */
+static void qcow2_extent_add(BDRVQcow2State *s, uint64_t offset,
+                             uint64_t bytes, uint64_t host_offset)
+{
+    uint64_t last = offset + bytes - 1;
+    IntervalTreeNode *node;
+    Qcow2Extent *e;
+
+    node = interval_tree_iter_first(&s->extents, offset, last);
+    if (node) {
+        assert(node->start > offset);
+        last = node->start - 1;
+    }
+
+    if (offset > 0) {
+        node = interval_tree_iter_first(&s->extents, offset - 1, offset - 1);
+        e = node ? container_of(node, Qcow2Extent, node) : NULL;
+        if (e && e->host_offset + (offset - node->start) == host_offset) {
+            offset = node->start;
+            host_offset = e->host_offset;
+            interval_tree_remove(node, &s->extents);
+            g_free(e);
+            s->nb_extents--;
+        }
+    }
+
+    if (last < UINT64_MAX) {
+        node = interval_tree_iter_first(&s->extents, last + 1, last + 1);
+        e = node ? container_of(node, Qcow2Extent, node) : NULL;
+        if (e && host_offset + (node->start - offset) == e->host_offset) {
+            last = node->last;
+            interval_tree_remove(node, &s->extents);
+            g_free(e);
+            s->nb_extents--;
+        }
+    }
+
+    if (s->nb_extents >= QCOW2_MAX_EXTENTS) {
+        qcow2_extents_invalidate(s);
+    }
+
+    e = g_new(Qcow2Extent, 1);
+    e->node.start = offset;
+    e->node.last = last;
+    e->host_offset = host_offset;
+    interval_tree_insert(&e->node, &s->extents);
+    s->nb_extents++;
+}
 
 /*
  * get_host_offset
@@ -581,6 +682,10 @@ do_perform_cow_write(BlockDriverState *bs, uint64_t cluster_offset,
  * file. The subcluster type is stored in *subcluster_type.
  * Compressed clusters are always processed one by one.
  *
+ * If the extent-cache option is enabled, ranges of QCOW2_SUBCLUSTER_NORMAL
+ * subclusters are remembered and later lookups inside them do not need to
+ * load the L2 table.  The returned range may then cross L2 slice boundaries.
+ *
  * Returns 0 on success, -errno in error cases.
  */
 int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
@@ -596,6 +701,12 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
     QCow2SubclusterType type;
     int ret;
 
+    if (s->extent_cache && *bytes &&
+        qcow2_extent_lookup(s, offset, bytes, host_offset)) {
+        *subcluster_type = QCOW2_SUBCLUSTER_NORMAL;
+        return 0;
+    }
+
     offset_in_cluster = offset_into_cluster(s, offset);
     bytes_needed = (uint64_t) *bytes + offset_in_cluster;
 
@@ -735,6 +846,10 @@ out:
 
     *subcluster_type = type;
 
+    if (s->extent_cache && type == QCOW2_SUBCLUSTER_NORMAL && *bytes) {
+        qcow2_extent_add(s, offset, *bytes, *host_offset);
+    }
+
     return 0;
 
 fail:
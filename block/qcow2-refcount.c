@@ -888,6 +888,9 @@ update_refcount(BlockDriverState *bs, int64_t offset, int64_t length,
         if (refcount == 0) {
             void *table;
 
+            qcow2_compressed_cache_invalidate(s, cluster_offset,
+                                              s->cluster_size);
+
             table = qcow2_cache_is_table_offset(s->refcount_block_cache,
                                                 offset);
             if (table != NULL) {
@@ -964,12 +967,69 @@ int qcow2_update_cluster_refcount(BlockDriverState *bs,
 
 
 
+/*
+ * Count the clusters with a zero refcount starting at @cluster_index,
+ * up to @max of them and without crossing into another refcount block,
+ * so that the refcount block needs to be looked up only once.
+ *
+ * Returns 0 on success or -errno in error case
+ */
+static int GRAPH_RDLOCK
+count_free_clusters(BlockDriverState *bs, int64_t cluster_index, uint64_t max,
+                    uint64_t *nb_free)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t refcount_table_index, block_index, n;
+    int64_t refcount_block_offset;
+    void *refcount_block;
+    int ret;
+
+    refcount_table_index = cluster_index >> s->refcount_block_bits;
+    block_index = cluster_index & (s->refcount_block_size - 1);
+    max = MIN(max, s->refcount_block_size - block_index);
+
+    if (refcount_table_index >= s->refcount_table_size) {
+        *nb_free = max;
+        return 0;
+    }
+    refcount_block_offset =
+        s->refcount_table[refcount_table_index] & REFT_OFFSET_MASK;
+    if (!refcount_block_offset) {
+        *nb_free = max;
+        return 0;
+    }
+
+    if (offset_into_cluster(s, refcount_block_offset)) {
+        qcow2_signal_corruption(bs, true, -1, -1, "Refblock offset %#" PRIx64
+                                " unaligned (reftable index: %#" PRIx64 ")",
+                                refcount_block_offset, refcount_table_index);
+        return -EIO;
+    }
+
+    ret = qcow2_cache_get(bs, s->refcount_block_cache, refcount_block_offset,
+                          &refcount_block);
+    if (ret < 0) {
+        return ret;
+    }
+
+    for (n = 0; n < max; n++) {
+        if (s->get_refcount(refcount_block, block_index + n) != 0) {
+            break;
+        }
+    }
+
+    qcow2_cache_put(s->refcount_block_cache, &refcount_block);
+
+    *nb_free = n;
+    return 0;
+}
+
 /* return < 0 if error */
 static int64_t GRAPH_RDLOCK
 alloc_clusters_noref(BlockDriverState *bs, uint64_t size, uint64_t max)
 {
     BDRVQcow2State *s = bs->opaque;
-    uint64_t i, nb_clusters, refcount;
+    uint64_t i, nb_clusters;
     int ret;
 
     /* We can't allocate clusters if they may still be queued for discard. */
@@ -978,15 +1038,22 @@ alloc_clusters_noref(BlockDriverState *bs, uint64_t size, uint64_t max)
     }
 
     nb_clusters = size_to_clusters(s, size);
-retry:
-    for(i = 0; i < nb_clusters; i++) {
-        uint64_t next_cluster_index = s->free_cluster_index++;
-        ret = qcow2_get_refcount(bs, next_cluster_index, &refcount);
+    for (i = 0; i < nb_clusters;) {
+        uint64_t nb_free;
 
+        ret = count_free_clusters(bs, s->free_cluster_index, nb_clusters - i,
+                                  &nb_free);
         if (ret < 0) {
             return ret;
-        } else if (refcount != 0) {
-            goto retry;
+        }
+
+        if (nb_free == 0) {
+            /* The cluster is in use; start over right after it */
+            s->free_cluster_index++;
+            i = 0;
+        } else {
+            s->free_cluster_index += nb_free;
+            i += nb_free;
         }
     }
 
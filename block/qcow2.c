@@ -614,6 +614,11 @@ qcow2_co_check_locked(BlockDriverState *bs, BdrvCheckResult *result,
 
     memset(result, 0, sizeof(*result));
 
+    if (fix) {
+        /* Repairs may rewrite L2 tables without going through the cache */
+        qcow2_extents_invalidate(bs->opaque);
+    }
+
     ret = qcow2_check_read_snapshot_table(bs, &snapshot_res, fix);
     if (ret < 0) {
         qcow2_add_check_result(result, &snapshot_res, false);
@@ -701,6 +706,9 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_EXTENT_CACHE,
+    QCOW2_OPT_COMPRESSED_CACHE_SIZE,
+    QCOW2_OPT_L2_CACHE_WARMUP,
     NULL
 };
 
@@ -734,6 +742,24 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_BOOL,
             .help = "Do not unreference discarded clusters",
         },
+        {
+            .name = QCOW2_OPT_EXTENT_CACHE,
+            .type = QEMU_OPT_BOOL,
+            .help = "Keep an in-memory index of contiguous guest-to-host "
+                    "mappings",
+        },
+        {
+            .name = QCOW2_OPT_COMPRESSED_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Maximum size of the decompressed cluster cache "
+                    "(0 to disable)",
+        },
+        {
+            .name = QCOW2_OPT_L2_CACHE_WARMUP,
+            .type = QEMU_OPT_BOOL,
+            .help = "Load L2 tables into the cache in the background after "
+                    "opening the image",
+        },
         {
             .name = QCOW2_OPT_OVERLAP,
             .type = QEMU_OPT_STRING,
@@ -970,6 +996,111 @@ static bool read_cache_sizes(BlockDriverState *bs, QemuOpts *opts,
     return true;
 }
 
+/*
+ * Decompressed cluster cache.  Guests usually read compressed clusters in
+ * pieces much smaller than a cluster, and without the cache every one of
+ * those reads decompresses the whole cluster again.  Entries are keyed by
+ * the host offset and size of the compressed data, which never change for
+ * an allocated compressed cluster; they only go stale once the host
+ * cluster is freed, see qcow2_compressed_cache_invalidate().
+ */
+static void qcow2_compressed_cache_free(BDRVQcow2State *s)
+{
+    int i;
+
+    if (!s->compressed_cache) {
+        return;
+    }
+    for (i = 0; i < s->compressed_cache_size; i++) {
+        qemu_vfree(s->compressed_cache[i].data);
+    }
+    g_free(s->compressed_cache);
+    s->compressed_cache = NULL;
+    s->compressed_cache_gen++;
+}
+
+/*
+ * Drop all cached clusters whose compressed data overlaps the host range
+ * [@offset, @offset + @bytes).  Must be called when that range is freed.
+ */
+void qcow2_compressed_cache_invalidate(BDRVQcow2State *s, uint64_t offset,
+                                       uint64_t bytes)
+{
+    int i;
+
+    /* Even with no array yet, a reader may be about to make the first insert */
+    s->compressed_cache_gen++;
+
+    if (!s->compressed_cache) {
+        return;
+    }
+    for (i = 0; i < s->compressed_cache_size; i++) {
+        Qcow2CompressedCacheEntry *e = &s->compressed_cache[i];
+
+        if (e->csize && e->coffset < offset + bytes &&
+            offset < e->coffset + e->csize) {
+            e->csize = 0;
+        }
+    }
+}
+
+static Qcow2CompressedCacheEntry *
+qcow2_compressed_cache_lookup(BDRVQcow2State *s, uint64_t coffset, int csize)
+{
+    int i;
+
+    if (!s->compressed_cache) {
+        return NULL;
+    }
+    for (i = 0; i < s->compressed_cache_size; i++) {
+        Qcow2CompressedCacheEntry *e = &s->compressed_cache[i];
+
+        if (e->csize == csize && e->coffset == coffset) {
+            e->lru = ++s->compressed_cache_lru;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Insert a decompressed cluster into the cache, replacing the least
+ * recently used entry.  *@data is swapped with the evicted entry's buffer,
+ * so the caller keeps ownership of whatever *@data points to afterwards.
+ */
+static void qcow2_compressed_cache_insert(BDRVQcow2State *s, uint64_t coffset,
+                                          int csize, uint8_t **data)
+{
+    Qcow2CompressedCacheEntry *victim;
+    uint8_t *old;
+    int i;
+
+    if (!s->compressed_cache) {
+        s->compressed_cache = g_new0(Qcow2CompressedCacheEntry,
+                                     s->compressed_cache_size);
+    }
+
+    victim = &s->compressed_cache[0];
+    for (i = 0; i < s->compressed_cache_size; i++) {
+        Qcow2CompressedCacheEntry *e = &s->compressed_cache[i];
+
+        if (!e->csize) {
+            victim = e;
+            break;
+        }
+        if (e->lru < victim->lru) {
+            victim = e;
+        }
+    }
+
+    old = victim->data;
+    victim->data = *data;
+    victim->coffset = coffset;
+    victim->csize = csize;
+    victim->lru = ++s->compressed_cache_lru;
+    *data = old;
+}
+
 typedef struct Qcow2ReopenState {
     Qcow2Cache *l2_table_cache;
     Qcow2Cache *refcount_block_cache;
@@ -978,6 +1109,9 @@ typedef struct Qcow2ReopenState {
     int overlap_check;
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
+    bool extent_cache;
+    int compressed_cache_size;
+    bool l2_cache_warmup;
     uint64_t cache_clean_interval;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
@@ -991,6 +1125,7 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
     const char *opt_overlap_check, *opt_overlap_check_template;
     int overlap_check_template = 0;
     uint64_t l2_cache_size, l2_cache_entry_size, refcount_cache_size;
+    uint64_t compressed_cache_size;
     int i;
     const char *encryptfmt;
     QDict *encryptopts = NULL;
@@ -1157,6 +1292,21 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->extent_cache = qemu_opt_get_bool(opts, QCOW2_OPT_EXTENT_CACHE, false);
+
+    compressed_cache_size = qemu_opt_get_size(opts,
+                                              QCOW2_OPT_COMPRESSED_CACHE_SIZE,
+                                              DEFAULT_COMPRESSED_CACHE_SIZE);
+    if (compressed_cache_size / s->cluster_size > INT_MAX) {
+        error_setg(errp, "Compressed cluster cache size too big");
+        ret = -EINVAL;
+        goto fail;
+    }
+    r->compressed_cache_size = compressed_cache_size / s->cluster_size;
+
+    r->l2_cache_warmup = qemu_opt_get_bool(opts, QCOW2_OPT_L2_CACHE_WARMUP,
+                                           false);
+
     switch (s->crypt_method_header) {
     case QCOW_CRYPT_NONE:
         if (encryptfmt) {
@@ -1239,6 +1389,22 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
 
     s->discard_no_unref = r->discard_no_unref;
 
+    if (!r->extent_cache) {
+        qcow2_extents_invalidate(s);
+    }
+    s->extent_cache = r->extent_cache;
+
+    if (s->compressed_cache_size != r->compressed_cache_size) {
+        qcow2_compressed_cache_free(s);
+        s->compressed_cache_size = r->compressed_cache_size;
+    }
+
+    /* A newly enabled warmup is started by qcow2_l2_warmup_start() */
+    if (r->l2_cache_warmup != s->l2_cache_warmup) {
+        s->l2_warmup_pending = r->l2_cache_warmup;
+        s->l2_cache_warmup = r->l2_cache_warmup;
+    }
+
     if (s->cache_clean_interval != r->cache_clean_interval) {
         cache_clean_timer_del(bs);
         s->cache_clean_interval = r->cache_clean_interval;
@@ -1889,6 +2055,8 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     cleanup_unknown_header_ext(bs);
     qcow2_free_snapshots(bs);
     qcow2_refcount_close(bs);
+    qcow2_extents_invalidate(s);
+    qcow2_compressed_cache_free(s);
     qemu_vfree(s->l1_table);
     /* else pre-write overlap checks in cache_destroy may crash */
     s->l1_table = NULL;
@@ -1904,6 +2072,181 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     return ret;
 }
 
+/* Maximum size of a single read issued by qcow2_co_l2_warmup() */
+#define QCOW2_L2_WARMUP_MAX_READ (1 * MiB)
+
+typedef struct Qcow2L2WarmupTable {
+    uint64_t offset;
+    int l1_index;
+} Qcow2L2WarmupTable;
+
+static gint qcow2_l2_warmup_table_cmp(gconstpointer a, gconstpointer b)
+{
+    const Qcow2L2WarmupTable *ta = a, *tb = b;
+
+    return ta->offset < tb->offset ? -1 : ta->offset > tb->offset;
+}
+
+/*
+ * Fill the unused entries of the L2 cache with the L2 tables of the lowest
+ * guest offsets, so that the first guest accesses after opening the image
+ * do not each have to wait for a metadata read.  The tables are read in
+ * image file order, with runs of adjacent tables merged into one read.
+ *
+ * Each read is done with s->lock held, so that the tables cannot change
+ * between reading and inserting them, but the lock is dropped between
+ * reads to let guest requests through.  Returns -ECANCELED if a drained
+ * section interrupted the warmup.
+ */
+static int coroutine_fn GRAPH_RDLOCK qcow2_co_l2_warmup(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int slices_per_table = s->l2_size / s->l2_slice_size;
+    int max_read = MAX(QCOW2_L2_WARMUP_MAX_READ, s->cluster_size);
+    g_autoptr(GArray) tables =
+        g_array_new(false, false, sizeof(Qcow2L2WarmupTable));
+    uint8_t *buf;
+    int max_tables;
+    int i, j, k;
+    int ret = 0;
+
+    qemu_co_mutex_lock(&s->lock);
+    max_tables = qcow2_cache_count_unused(s->l2_table_cache) /
+                 slices_per_table;
+    for (i = 0; i < s->l1_size && tables->len < max_tables; i++) {
+        Qcow2L2WarmupTable t = {
+            .offset = s->l1_table[i] & L1E_OFFSET_MASK,
+            .l1_index = i,
+        };
+
+        /* Invalid offsets are reported when the table is actually used */
+        if (!t.offset || offset_into_cluster(s, t.offset) ||
+            qcow2_cache_is_table_offset(s->l2_table_cache, t.offset)) {
+            continue;
+        }
+        g_array_append_val(tables, t);
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    if (!tables->len) {
+        return 0;
+    }
+    g_array_sort(tables, qcow2_l2_warmup_table_cmp);
+
+    buf = qemu_try_blockalign(bs->file->bs, max_read);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < tables->len; i = j) {
+        Qcow2L2WarmupTable *first = &g_array_index(tables,
+                                                   Qcow2L2WarmupTable, i);
+        uint64_t bytes;
+
+        for (j = i + 1; j < tables->len; j++) {
+            Qcow2L2WarmupTable *t = &g_array_index(tables,
+                                                   Qcow2L2WarmupTable, j);
+            bytes = (uint64_t) (j - i) * s->cluster_size;
+            if (t->offset != first->offset + bytes ||
+                bytes + s->cluster_size > max_read) {
+                break;
+            }
+        }
+
+        qemu_co_mutex_lock(&s->lock);
+        if (qatomic_read(&s->l2_warmup_cancel)) {
+            qemu_co_mutex_unlock(&s->lock);
+            ret = -ECANCELED;
+            break;
+        }
+
+        /*
+         * The L1 table may have changed while the lock was dropped.  Only
+         * read up to the first table that is no longer in use.
+         */
+        for (k = i; k < j; k++) {
+            Qcow2L2WarmupTable *t = &g_array_index(tables,
+                                                   Qcow2L2WarmupTable, k);
+            if (t->l1_index >= s->l1_size ||
+                (s->l1_table[t->l1_index] & L1E_OFFSET_MASK) != t->offset) {
+                break;
+            }
+        }
+
+        if (k > i) {
+            bytes = (uint64_t) (k - i) * s->cluster_size;
+            BLKDBG_CO_EVENT(bs->file, BLKDBG_L2_LOAD);
+            ret = bdrv_co_pread(bs->file, first->offset, bytes, buf, 0);
+            if (ret == 0) {
+                qcow2_cache_preload(s->l2_table_cache, first->offset,
+                                    (k - i) * slices_per_table, buf);
+            }
+        }
+        qemu_co_mutex_unlock(&s->lock);
+
+        if (ret < 0) {
+            break;
+        }
+        if (k < j) {
+            /* Retry the tables after the stale one as a new run */
+            j = k + 1;
+        }
+    }
+
+    qemu_vfree(buf);
+    return ret;
+}
+
+static void coroutine_fn qcow2_l2_warmup_entry(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVQcow2State *s = bs->opaque;
+    int ret;
+
+    GRAPH_RDLOCK_GUARD();
+
+    ret = qcow2_co_l2_warmup(bs);
+
+    /* The warmup is only an optimization, so give up on errors */
+    if (ret != -ECANCELED) {
+        s->l2_warmup_pending = false;
+    }
+    qatomic_set(&s->l2_warmup_running, false);
+    bdrv_dec_in_flight(bs);
+    aio_wait_kick();
+}
+
+static void qcow2_l2_warmup_start(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (!s->l2_warmup_pending || qatomic_read(&s->l2_warmup_running) ||
+        qatomic_read(&bs->quiesce_counter) ||
+        (bs->open_flags & BDRV_O_INACTIVE)) {
+        return;
+    }
+
+    qatomic_set(&s->l2_warmup_cancel, false);
+    qatomic_set(&s->l2_warmup_running, true);
+    bdrv_inc_in_flight(bs);
+    aio_co_enter(bdrv_get_aio_context(bs),
+                 qemu_coroutine_create(qcow2_l2_warmup_entry, bs));
+}
+
+static void qcow2_drain_begin(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (qatomic_read(&s->l2_warmup_running)) {
+        qatomic_set(&s->l2_warmup_cancel, true);
+    }
+}
+
+static void qcow2_drain_end(BlockDriverState *bs)
+{
+    qcow2_l2_warmup_start(bs);
+}
+
 typedef struct QCow2OpenCo {
     BlockDriverState *bs;
     QDict *options;
@@ -1955,6 +2298,10 @@ static int qcow2_open(BlockDriverState *bs, QDict *options, int flags,
                  qemu_coroutine_create(qcow2_open_entry, &qoc));
     AIO_WAIT_WHILE_UNLOCKED(NULL, qoc.ret == -EINPROGRESS);
 
+    if (qoc.ret >= 0) {
+        qcow2_l2_warmup_start(bs);
+    }
+
     return qoc.ret;
 }
 
@@ -2748,6 +3095,11 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
     int ret, result = 0;
     Error *local_err = NULL;
 
+    /* The tables are dropped when the image is activated again */
+    s->l2_warmup_pending = false;
+    qatomic_set(&s->l2_warmup_cancel, true);
+    BDRV_POLL_WHILE(bs, qatomic_read(&s->l2_warmup_running));
+
     qcow2_store_persistent_dirty_bitmaps(bs, true, &local_err);
     if (local_err != NULL) {
         result = -EINVAL;
@@ -2781,6 +3133,8 @@ static void coroutine_mixed_fn GRAPH_RDLOCK
 qcow2_do_close(BlockDriverState *bs, bool close_data_file)
 {
     BDRVQcow2State *s = bs->opaque;
+    qcow2_extents_invalidate(s);
+    qcow2_compressed_cache_free(s);
     qemu_vfree(s->l1_table);
     /* else pre-write overlap checks in cache_destroy may crash */
     s->l1_table = NULL;
@@ -2872,6 +3226,7 @@ qcow2_co_invalidate_cache(BlockDriverState *bs, Error **errp)
     }
 
     s->crypto = crypto;
+    qcow2_l2_warmup_start(bs);
 }
 
 static size_t header_ext_add(char *buf, uint32_t magic, const void *s,
@@ -4812,12 +5167,29 @@ qcow2_co_preadv_compressed(BlockDriverState *bs,
 {
     BDRVQcow2State *s = bs->opaque;
     int ret = 0, csize;
-    uint64_t coffset;
+    uint64_t coffset, cache_gen = 0;
     uint8_t *buf, *out_buf;
     int offset_in_cluster = offset_into_cluster(s, offset);
 
     qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
 
+    if (s->compressed_cache_size) {
+        Qcow2CompressedCacheEntry *e;
+
+        qemu_co_mutex_lock(&s->lock);
+        e = qcow2_compressed_cache_lookup(s, coffset, csize);
+        if (e) {
+            qemu_iovec_from_buf(qiov, qiov_offset,
+                                e->data + offset_in_cluster, bytes);
+        }
+        cache_gen = s->compressed_cache_gen;
+        qemu_co_mutex_unlock(&s->lock);
+
+        if (e) {
+            return 0;
+        }
+    }
+
     buf = g_try_malloc(csize);
     if (!buf) {
         return -ENOMEM;
@@ -4838,6 +5210,15 @@ qcow2_co_preadv_compressed(BlockDriverState *bs,
 
     qemu_iovec_from_buf(qiov, qiov_offset, out_buf + offset_in_cluster, bytes);
 
+    if (s->compressed_cache_size) {
+        qemu_co_mutex_lock(&s->lock);
+        /* Skip the insertion if the cluster may have been freed meanwhile */
+        if (cache_gen == s->compressed_cache_gen) {
+            qcow2_compressed_cache_insert(s, coffset, csize, &out_buf);
+        }
+        qemu_co_mutex_unlock(&s->lock);
+    }
+
 fail:
     qemu_vfree(out_buf);
     g_free(buf);
@@ -4888,6 +5269,8 @@ static int GRAPH_RDLOCK make_completely_empty(BlockDriverState *bs)
     if (ret < 0) {
         goto fail_broken_refcounts;
     }
+    qcow2_extents_invalidate(s);
+    qcow2_compressed_cache_free(s);
     memset(s->l1_table, 0, l1_size2);
 
     BLKDBG_EVENT(bs->file, BLKDBG_EMPTY_IMAGE_PREPARE);
@@ -6171,6 +6554,8 @@ BlockDriver bdrv_qcow2 = {
     .bdrv_refresh_limits                = qcow2_refresh_limits,
     .bdrv_co_invalidate_cache           = qcow2_co_invalidate_cache,
     .bdrv_inactivate                    = qcow2_inactivate,
+    .bdrv_drain_begin                   = qcow2_drain_begin,
+    .bdrv_drain_end                     = qcow2_drain_end,
 
     .create_opts                        = &qcow2_create_opts,
     .amend_opts                         = &qcow2_amend_opts,
@@ -28,6 +28,7 @@
 #include "crypto/block.h"
 #include "qemu/coroutine.h"
 #include "qemu/units.h"
+#include "qemu/interval-tree.h"
 #include "block/block_int.h"
 
 //#define DEBUG_ALLOC
@@ -128,6 +129,8 @@
 
 #define DEFAULT_CLUSTER_SIZE 65536
 
+#define DEFAULT_COMPRESSED_CACHE_SIZE (1 * MiB)
+
 #define QCOW2_OPT_DATA_FILE "data-file"
 #define QCOW2_OPT_LAZY_REFCOUNTS "lazy-refcounts"
 #define QCOW2_OPT_DISCARD_REQUEST "pass-discard-request"
@@ -150,6 +153,9 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_EXTENT_CACHE "extent-cache"
+#define QCOW2_OPT_COMPRESSED_CACHE_SIZE "compressed-cache-size"
+#define QCOW2_OPT_L2_CACHE_WARMUP "l2-cache-warmup"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -324,6 +330,13 @@ typedef struct Qcow2BitmapHeaderExt {
 
 #define QCOW2_MAX_THREADS 4
 
+typedef struct Qcow2CompressedCacheEntry {
+    uint64_t coffset;   /* host offset of the compressed data */
+    int csize;          /* 0 if the entry is unused */
+    uint64_t lru;
+    uint8_t *data;      /* one decompressed cluster */
+} Qcow2CompressedCacheEntry;
+
 typedef struct BDRVQcow2State {
     int cluster_bits;
     int cluster_size;
@@ -388,6 +401,36 @@ typedef struct BDRVQcow2State {
 
     bool discard_no_unref;
 
+    /*
+     * Guest ranges known to be stored contiguously in the image file,
+     * see qcow2_get_host_offset().  Protected by lock.
+     */
+    bool extent_cache;
+    IntervalTreeRoot extents;
+    unsigned nb_extents;
+
+    /*
+     * Recently decompressed clusters, see qcow2_co_preadv_compressed().
+     * The array is allocated on first use.  compressed_cache_gen is bumped
+     * whenever entries are invalidated, so that a reader that raced with
+     * the invalidation does not insert stale data.  Protected by lock.
+     */
+    Qcow2CompressedCacheEntry *compressed_cache;
+    int compressed_cache_size; /* in entries, 0 if disabled */
+    uint64_t compressed_cache_lru;
+    uint64_t compressed_cache_gen;
+
+    /*
+     * Background loading of L2 tables into unused L2 cache entries, see
+     * qcow2_co_l2_warmup().  l2_warmup_pending is set until a warmup pass
+     * has completed; a pass that is cancelled by a drain is restarted when
+     * the drained section ends.
+     */
+    bool l2_cache_warmup;
+    bool l2_warmup_pending;
+    bool l2_warmup_running;
+    bool l2_warmup_cancel;
+
     int overlap_check; /* bitmask of Qcow2MetadataOverlap values */
     bool signaled_corruption;
 
@@ -834,6 +877,9 @@ int64_t qcow2_refcount_metadata_size(int64_t clusters, size_t cluster_size,
                                      int refcount_order, bool generous_increase,
                                      uint64_t *refblock_count);
 
+void qcow2_compressed_cache_invalidate(BDRVQcow2State *s, uint64_t offset,
+                                       uint64_t bytes);
+
 int GRAPH_RDLOCK qcow2_mark_dirty(BlockDriverState *bs);
 int GRAPH_RDLOCK qcow2_mark_corrupt(BlockDriverState *bs);
 int GRAPH_RDLOCK qcow2_update_header(BlockDriverState *bs);
@@ -927,6 +973,8 @@ int GRAPH_RDLOCK qcow2_write_l1_entry(BlockDriverState *bs, int l1_index);
 int qcow2_encrypt_sectors(BDRVQcow2State *s, int64_t sector_num,
                           uint8_t *buf, int nb_sectors, bool enc, Error **errp);
 
+void qcow2_extents_invalidate(BDRVQcow2State *s);
+
 int GRAPH_RDLOCK
 qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                       unsigned int *bytes, uint64_t *host_offset,
@@ -1020,6 +1068,9 @@ qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
 void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
+int qcow2_cache_count_unused(Qcow2Cache *c);
+void qcow2_cache_preload(Qcow2Cache *c, uint64_t offset, int num_tables,
+                         const void *tables);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
 
 /* qcow2-bitmap.c functions */
@@ -18,6 +18,7 @@
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/memalign.h"
+#include "qemu/timer.h"
 #include "block/block_int.h"
 #include "block/coroutines.h"
 #include "block/qdict.h"
@@ -92,6 +93,15 @@ typedef struct BDRVQuorumState {
                             */
 
     QuorumReadPattern read_pattern;
+
+    /*
+     * read-pattern=latency: moving average of the read latency of each
+     * child, in the same order as @children.  0 means no sample yet,
+     * QUORUM_LATENCY_FAILED that the last read from the child failed.
+     */
+    int64_t *read_latency_ns;
+    /* number of reads issued in latency mode, used to pace probes */
+    uint64_t latency_reads;
 } BDRVQuorumState;
 
 typedef struct QuorumAIOCB QuorumAIOCB;
@@ -669,6 +679,77 @@ static int coroutine_fn GRAPH_RDLOCK read_fifo_child(QuorumAIOCB *acb)
     return ret;
 }
 
+/*
+ * Every QUORUM_LATENCY_PROBE_INTERVAL reads, read-pattern=latency sends
+ * the read to the children in turn so that the estimate of the children
+ * that are not being picked does not go stale.
+ */
+#define QUORUM_LATENCY_PROBE_INTERVAL 64
+#define QUORUM_LATENCY_FAILED INT64_MAX
+
+static int quorum_latency_pick_child(QuorumAIOCB *acb)
+{
+    BDRVQuorumState *s = acb->bs->opaque;
+    int i, best = -1;
+
+    if (acb->children_read == 0 &&
+        ++s->latency_reads % QUORUM_LATENCY_PROBE_INTERVAL == 0) {
+        return s->latency_reads / QUORUM_LATENCY_PROBE_INTERVAL %
+               s->num_children;
+    }
+
+    /* Pick the fastest child that has not been tried by this request */
+    for (i = 0; i < s->num_children; i++) {
+        if (acb->qcrs[i].bs) {
+            continue;
+        }
+        if (best < 0 || s->read_latency_ns[i] < s->read_latency_ns[best]) {
+            best = i;
+        }
+    }
+
+    assert(best >= 0);
+    return best;
+}
+
+static void quorum_latency_account(BDRVQuorumState *s, int i, int64_t ns)
+{
+    int64_t old = s->read_latency_ns[i];
+
+    if (ns == QUORUM_LATENCY_FAILED || !old || old == QUORUM_LATENCY_FAILED) {
+        s->read_latency_ns[i] = ns;
+    } else {
+        /* Exponential moving average, weight 1/8 for the new sample */
+        s->read_latency_ns[i] = old - old / 8 + ns / 8;
+    }
+}
+
+static int coroutine_fn GRAPH_RDLOCK read_latency_child(QuorumAIOCB *acb)
+{
+    BDRVQuorumState *s = acb->bs->opaque;
+    int64_t start, ns;
+    int n, ret;
+
+    /* On failure, fall back to the next fastest child */
+    do {
+        n = quorum_latency_pick_child(acb);
+        acb->children_read++;
+        acb->qcrs[n].bs = s->children[n]->bs;
+        start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        ret = bdrv_co_preadv(s->children[n], acb->offset, acb->bytes,
+                             acb->qiov, 0);
+        if (ret < 0) {
+            quorum_latency_account(s, n, QUORUM_LATENCY_FAILED);
+            quorum_report_bad_acb(&acb->qcrs[n], ret);
+        } else {
+            ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+            quorum_latency_account(s, n, MAX(ns, 1));
+        }
+    } while (ret < 0 && acb->children_read < s->num_children);
+
+    return ret;
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 quorum_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
                  QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -680,10 +761,16 @@ quorum_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
     acb->is_read = true;
     acb->children_read = 0;
 
-    if (s->read_pattern == QUORUM_READ_PATTERN_QUORUM) {
+    switch (s->read_pattern) {
+    case QUORUM_READ_PATTERN_QUORUM:
         ret = read_quorum_children(acb);
-    } else {
+        break;
+    case QUORUM_READ_PATTERN_LATENCY:
+        ret = read_latency_child(acb);
+        break;
+    default:
         ret = read_fifo_child(acb);
+        break;
     }
     quorum_aio_finalize(acb);
 
@@ -917,7 +1004,8 @@ static QemuOptsList quorum_runtime_opts = {
         {
             .name = QUORUM_OPT_READ_PATTERN,
             .type = QEMU_OPT_STRING,
-            .help = "Allowed pattern: quorum, fifo. Quorum is default",
+            .help = "Allowed pattern: quorum, fifo, latency. "
+                    "Quorum is default",
         },
         { /* end of list */ }
     },
@@ -984,7 +1072,7 @@ static int quorum_open(BlockDriverState *bs, QDict *options, int flags,
                               -EINVAL, NULL);
     }
     if (ret < 0) {
-        error_setg(errp, "Please set read-pattern as fifo or quorum");
+        error_setg(errp, "Please set read-pattern as fifo, latency or quorum");
         goto exit;
     }
     s->read_pattern = ret;
@@ -1010,6 +1098,7 @@ static int quorum_open(BlockDriverState *bs, QDict *options, int flags,
 
     /* allocate the children array */
     s->children = g_new0(BdrvChild *, s->num_children);
+    s->read_latency_ns = g_new0(int64_t, s->num_children);
     opened = g_new0(bool, s->num_children);
 
     for (i = 0; i < s->num_children; i++) {
@@ -1046,6 +1135,7 @@ close_exit:
     }
     bdrv_graph_wrunlock();
     g_free(s->children);
+    g_free(s->read_latency_ns);
     g_free(opened);
 exit:
     qemu_opts_del(opts);
@@ -1064,6 +1154,7 @@ static void quorum_close(BlockDriverState *bs)
     bdrv_graph_wrunlock();
 
     g_free(s->children);
+    g_free(s->read_latency_ns);
 }
 
 static void GRAPH_WRLOCK
@@ -1103,6 +1194,9 @@ quorum_add_child(BlockDriverState *bs, BlockDriverState *child_bs, Error **errp)
         return;
     }
     s->children = g_renew(BdrvChild *, s->children, s->num_children + 1);
+    s->read_latency_ns = g_renew(int64_t, s->read_latency_ns,
+                                 s->num_children + 1);
+    s->read_latency_ns[s->num_children] = 0;
     s->children[s->num_children++] = child;
     quorum_refresh_flags(bs);
 }
@@ -1141,7 +1235,11 @@ quorum_del_child(BlockDriverState *bs, BdrvChild *child, Error **errp)
     /* We can safely remove this child now */
     memmove(&s->children[i], &s->children[i + 1],
             (s->num_children - i - 1) * sizeof(BdrvChild *));
+    memmove(&s->read_latency_ns[i], &s->read_latency_ns[i + 1],
+            (s->num_children - i - 1) * sizeof(int64_t));
     s->children = g_renew(BdrvChild *, s->children, --s->num_children);
+    s->read_latency_ns = g_renew(int64_t, s->read_latency_ns,
+                                 s->num_children);
 
     bdrv_unref_child(bs, child);
 
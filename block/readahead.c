@@ -0,0 +1,516 @@
+/*
+ * Read-ahead block filter
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Reads are matched against a small table of streams, each remembering
+ * where its last read ended.  Once a stream has continued sequentially a
+ * few times, the data following it is prefetched from the child into a
+ * buffer, and the window doubles with each prefetch up to "max-window".
+ * The streams are tracked per node rather than per BlockBackend, but since
+ * interleaved streams occupy separate slots the effect is the same for
+ * several guests or jobs reading one image.
+ *
+ * All buffers, including those of prefetches in flight, share a pool of
+ * "pool-size" bytes; when it is full, the buffer of the least recently
+ * used stream is dropped.  Writes, write-zeroes, discards and truncation
+ * drop the buffers they overlap, both before and after reaching the child,
+ * and prefetches in flight on such a range are discarded on completion.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+#define READAHEAD_OPT_MAX_WINDOW    "max-window"
+#define READAHEAD_OPT_POOL_SIZE     "pool-size"
+
+#define READAHEAD_STREAMS           8
+#define READAHEAD_MIN_HITS          2
+#define READAHEAD_INITIAL_WINDOW    (128 * KiB)
+#define READAHEAD_MAX_WINDOW_LIMIT  (64 * MiB)
+
+typedef struct ReadaheadStream {
+    uint64_t next;          /* offset following the last read */
+    uint64_t window;
+    unsigned hits;          /* number of sequential reads */
+    uint64_t last_used;
+    bool in_use;
+
+    /* Buffered data, [buf_offset, buf_offset + buf_len) */
+    uint8_t *buf;
+    uint64_t buf_offset;
+    uint64_t buf_len;
+
+    /*
+     * Prefetch in flight.  Its buffer covers [pf_start, pf_end), of which
+     * [pf_start, pf_offset) was copied from @buf and the rest is being read.
+     */
+    bool prefetching;
+    bool stale;
+    uint8_t *pf_buf;
+    uint64_t pf_start;
+    uint64_t pf_offset;
+    uint64_t pf_end;
+    CoQueue waiters;
+} ReadaheadStream;
+
+typedef struct BDRVReadaheadState {
+    BlockDriverState *bs;
+    uint64_t max_window;
+    uint64_t pool_size;
+
+    /* The fields below are protected by @lock */
+    QemuMutex lock;
+    ReadaheadStream streams[READAHEAD_STREAMS];
+    uint64_t pool_used;
+    uint64_t clock;
+} BDRVReadaheadState;
+
+typedef struct ReadaheadPrefetch {
+    BDRVReadaheadState *s;
+    ReadaheadStream *st;
+} ReadaheadPrefetch;
+
+static QemuOptsList runtime_opts = {
+    .name = "readahead",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = READAHEAD_OPT_MAX_WINDOW,
+            .type = QEMU_OPT_SIZE,
+            .help = "maximum amount of data prefetched for one stream, "
+                "default 2M",
+        },
+        {
+            .name = READAHEAD_OPT_POOL_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "maximum amount of prefetched data kept in memory, "
+                "default 32M",
+        },
+        { /* end of list */ }
+    },
+};
+
+static void readahead_drop_buf_locked(BDRVReadaheadState *s,
+                                      ReadaheadStream *st)
+{
+    if (st->buf) {
+        qemu_vfree(st->buf);
+        s->pool_used -= st->buf_len;
+        st->buf = NULL;
+        st->buf_len = 0;
+    }
+}
+
+static bool readahead_overlaps(uint64_t offset, uint64_t bytes,
+                               uint64_t start, uint64_t end)
+{
+    return offset < end && start < offset + bytes;
+}
+
+/* Drop all prefetched data of [offset, offset + bytes) */
+static void readahead_invalidate(BDRVReadaheadState *s, uint64_t offset,
+                                 uint64_t bytes)
+{
+    QEMU_LOCK_GUARD(&s->lock);
+
+    for (int i = 0; i < READAHEAD_STREAMS; i++) {
+        ReadaheadStream *st = &s->streams[i];
+
+        if (st->buf && readahead_overlaps(offset, bytes, st->buf_offset,
+                                          st->buf_offset + st->buf_len)) {
+            readahead_drop_buf_locked(s, st);
+        }
+        if (st->prefetching &&
+            readahead_overlaps(offset, bytes, st->pf_start, st->pf_end)) {
+            st->stale = true;
+        }
+    }
+}
+
+/* Make room for @bytes in the pool by dropping buffers of other streams */
+static bool readahead_reserve_locked(BDRVReadaheadState *s,
+                                     ReadaheadStream *except, uint64_t bytes)
+{
+    while (s->pool_used + bytes > s->pool_size) {
+        ReadaheadStream *victim = NULL;
+
+        for (int i = 0; i < READAHEAD_STREAMS; i++) {
+            ReadaheadStream *st = &s->streams[i];
+
+            if (st != except && st->buf &&
+                (!victim || st->last_used < victim->last_used)) {
+                victim = st;
+            }
+        }
+        if (!victim) {
+            return false;
+        }
+        readahead_drop_buf_locked(s, victim);
+    }
+    s->pool_used += bytes;
+    return true;
+}
+
+static void coroutine_fn readahead_prefetch_entry(void *opaque)
+{
+    ReadaheadPrefetch *pf = opaque;
+    BDRVReadaheadState *s = pf->s;
+    ReadaheadStream *st = pf->st;
+    BlockDriverState *bs = s->bs;
+    uint64_t read_bytes = st->pf_end - st->pf_offset;
+    int ret;
+
+    /* Only this coroutine changes the pf_* fields while prefetching is set */
+    WITH_GRAPH_RDLOCK_GUARD() {
+        ret = bdrv_co_pread(bs->file, st->pf_offset, read_bytes,
+                            st->pf_buf + (st->pf_offset - st->pf_start), 0);
+    }
+    trace_readahead_prefetch(bs, st->pf_offset, read_bytes, ret);
+
+    qemu_mutex_lock(&s->lock);
+    if (ret >= 0 && !st->stale) {
+        readahead_drop_buf_locked(s, st);
+        st->buf = st->pf_buf;
+        st->buf_offset = st->pf_start;
+        st->buf_len = st->pf_end - st->pf_start;
+    } else {
+        qemu_vfree(st->pf_buf);
+        s->pool_used -= st->pf_end - st->pf_start;
+    }
+    st->pf_buf = NULL;
+    st->prefetching = false;
+    st->stale = false;
+    qemu_co_queue_restart_all(&st->waiters);
+    qemu_mutex_unlock(&s->lock);
+
+    g_free(pf);
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Start a prefetch for @st unless enough data is buffered ahead of its
+ * position already.  Returns the coroutine to enter once the lock is
+ * released, or NULL.
+ */
+static Coroutine *readahead_kick_locked(BDRVReadaheadState *s,
+                                        ReadaheadStream *st)
+{
+    uint64_t length = s->bs->total_sectors * BDRV_SECTOR_SIZE;
+    uint64_t start = st->next, offset = st->next, end;
+    ReadaheadPrefetch *pf;
+    uint8_t *buf;
+
+    if (st->hits < READAHEAD_MIN_HITS || st->prefetching) {
+        return NULL;
+    }
+
+    if (st->buf && st->next >= st->buf_offset &&
+        st->next <= st->buf_offset + st->buf_len) {
+        offset = st->buf_offset + st->buf_len;
+        if (offset - st->next > st->window / 2) {
+            return NULL;
+        }
+        st->window = MIN(st->window * 2, s->max_window);
+    }
+    end = MIN(start + st->window, length);
+    if (end <= offset) {
+        return NULL;
+    }
+
+    if (!readahead_reserve_locked(s, st, end - start)) {
+        return NULL;
+    }
+    buf = qemu_try_blockalign(s->bs, end - start);
+    if (!buf) {
+        s->pool_used -= end - start;
+        return NULL;
+    }
+    if (offset > start) {
+        memcpy(buf, st->buf + (start - st->buf_offset), offset - start);
+    }
+
+    st->prefetching = true;
+    st->stale = false;
+    st->pf_buf = buf;
+    st->pf_start = start;
+    st->pf_offset = offset;
+    st->pf_end = end;
+
+    pf = g_new(ReadaheadPrefetch, 1);
+    *pf = (ReadaheadPrefetch) { .s = s, .st = st };
+    bdrv_inc_in_flight(s->bs);
+    return qemu_coroutine_create(readahead_prefetch_entry, pf);
+}
+
+/* Find the stream that @offset continues, or recycle one for it */
+static ReadaheadStream *readahead_stream_locked(BDRVReadaheadState *s,
+                                                uint64_t offset)
+{
+    ReadaheadStream *victim = NULL;
+
+    for (int i = 0; i < READAHEAD_STREAMS; i++) {
+        ReadaheadStream *st = &s->streams[i];
+
+        if (!st->in_use) {
+            continue;
+        }
+        if (st->next == offset ||
+            (st->buf && offset >= st->buf_offset &&
+             offset < st->buf_offset + st->buf_len)) {
+            st->hits++;
+            return st;
+        }
+    }
+
+    for (int i = 0; i < READAHEAD_STREAMS; i++) {
+        ReadaheadStream *st = &s->streams[i];
+
+        if (st->prefetching) {
+            continue;
+        }
+        if (!st->in_use) {
+            victim = st;
+            break;
+        }
+        if (!victim || st->last_used < victim->last_used) {
+            victim = st;
+        }
+    }
+    if (!victim) {
+        return NULL;
+    }
+
+    trace_readahead_stream_new(s->bs, offset);
+    readahead_drop_buf_locked(s, victim);
+    victim->in_use = true;
+    victim->hits = 0;
+    victim->window = MIN(READAHEAD_INITIAL_WINDOW, s->max_window);
+    return victim;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                         QEMUIOVector *qiov, size_t qiov_offset,
+                         BdrvRequestFlags flags)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    ReadaheadStream *st;
+    Coroutine *co = NULL;
+    bool hit = false;
+
+    /*
+     * A registered buffer only matters to the child's I/O; data copied out
+     * of a prefetch buffer may land in it like in any other.
+     */
+    if ((flags & ~BDRV_REQ_REGISTERED_BUF) || !bytes) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    qemu_mutex_lock(&s->lock);
+retry:
+    for (int i = 0; i < READAHEAD_STREAMS; i++) {
+        st = &s->streams[i];
+        if (st->prefetching &&
+            readahead_overlaps(offset, bytes, st->pf_offset, st->pf_end)) {
+            qemu_co_queue_wait(&st->waiters, &s->lock);
+            goto retry;
+        }
+    }
+
+    st = readahead_stream_locked(s, offset);
+    if (st) {
+        if (st->buf && offset >= st->buf_offset &&
+            offset + bytes <= st->buf_offset + st->buf_len) {
+            qemu_iovec_from_buf(qiov, qiov_offset,
+                                st->buf + (offset - st->buf_offset), bytes);
+            hit = true;
+        }
+        st->next = offset + bytes;
+        st->last_used = ++s->clock;
+        co = readahead_kick_locked(s, st);
+    }
+    qemu_mutex_unlock(&s->lock);
+
+    if (co) {
+        aio_co_enter(qemu_get_current_aio_context(), co);
+    }
+    if (hit) {
+        trace_readahead_hit(bs, offset, bytes);
+        return 0;
+    }
+    return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                          QEMUIOVector *qiov, size_t qiov_offset,
+                          BdrvRequestFlags flags)
+{
+    int ret;
+
+    readahead_invalidate(bs->opaque, offset, bytes);
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    readahead_invalidate(bs->opaque, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset,
+                           int64_t bytes, BdrvRequestFlags flags)
+{
+    int ret;
+
+    readahead_invalidate(bs->opaque, offset, bytes);
+    ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+    readahead_invalidate(bs->opaque, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    int ret;
+
+    readahead_invalidate(bs->opaque, offset, bytes);
+    ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+    readahead_invalidate(bs->opaque, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
+                      PreallocMode prealloc, BdrvRequestFlags flags,
+                      Error **errp)
+{
+    int ret;
+
+    readahead_invalidate(bs->opaque, offset, UINT64_MAX - offset);
+    ret = bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+    readahead_invalidate(bs->opaque, offset, UINT64_MAX - offset);
+    return ret;
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+readahead_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+static int readahead_open(BlockDriverState *bs, QDict *options, int flags,
+                          Error **errp)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    QemuOpts *opts;
+    int ret;
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    s->max_window = qemu_opt_get_size(opts, READAHEAD_OPT_MAX_WINDOW,
+                                      2 * MiB);
+    s->pool_size = qemu_opt_get_size(opts, READAHEAD_OPT_POOL_SIZE, 32 * MiB);
+
+    if (s->max_window < BDRV_SECTOR_SIZE ||
+        s->max_window > READAHEAD_MAX_WINDOW_LIMIT) {
+        error_setg(errp, "Parameter '" READAHEAD_OPT_MAX_WINDOW "' must be "
+                   "between 512 and 64M");
+        ret = -EINVAL;
+        goto out;
+    }
+    if (s->pool_size < s->max_window) {
+        error_setg(errp, "Parameter '" READAHEAD_OPT_POOL_SIZE "' must not "
+                   "be smaller than '" READAHEAD_OPT_MAX_WINDOW "'");
+        ret = -EINVAL;
+        goto out;
+    }
+
+    s->bs = bs;
+    qemu_mutex_init(&s->lock);
+    for (int i = 0; i < READAHEAD_STREAMS; i++) {
+        qemu_co_queue_init(&s->streams[i].waiters);
+    }
+
+    bdrv_graph_rdlock_main_loop();
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+    bdrv_graph_rdunlock_main_loop();
+
+out:
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void readahead_close(BlockDriverState *bs)
+{
+    BDRVReadaheadState *s = bs->opaque;
+
+    /* No prefetch is in flight, the node was drained */
+    for (int i = 0; i < READAHEAD_STREAMS; i++) {
+        readahead_drop_buf_locked(s, &s->streams[i]);
+    }
+    qemu_mutex_destroy(&s->lock);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+readahead_co_eject(BlockDriverState *bs, bool eject_flag)
+{
+    bdrv_co_eject(bs->file->bs, eject_flag);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+readahead_co_lock_medium(BlockDriverState *bs, bool locked)
+{
+    bdrv_co_lock_medium(bs->file->bs, locked);
+}
+
+static BlockDriver bdrv_readahead = {
+    .format_name                        = "readahead",
+    .instance_size                      = sizeof(BDRVReadaheadState),
+
+    .bdrv_open                          = readahead_open,
+    .bdrv_close                         = readahead_close,
+    .bdrv_child_perm                    = bdrv_default_perms,
+
+    .bdrv_co_getlength                  = readahead_co_getlength,
+
+    .bdrv_co_preadv_part                = readahead_co_preadv_part,
+    .bdrv_co_pwritev_part               = readahead_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes              = readahead_co_pwrite_zeroes,
+    .bdrv_co_pdiscard                   = readahead_co_pdiscard,
+    .bdrv_co_truncate                   = readahead_co_truncate,
+
+    .bdrv_co_eject                      = readahead_co_eject,
+    .bdrv_co_lock_medium                = readahead_co_lock_medium,
+
+    .is_filter                          = true,
+};
+
+static void bdrv_readahead_init(void)
+{
+    bdrv_register(&bdrv_readahead);
+}
+
+block_init(bdrv_readahead_init);
@@ -0,0 +1,527 @@
+/*
+ * Shared read cache block filter
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The cache is a file mapped MAP_SHARED by every QEMU process that uses
+ * it, typically in /dev/shm.  It holds a header, a set-associative table
+ * of slot descriptors and the cached clusters.  Each slot is protected by
+ * a sequence counter that is odd while the slot is being filled, so that
+ * readers in other processes can detect and discard torn copies:
+ *
+ *   reader:  seq = load(slot->seq); if (seq & 1) miss;
+ *            check tag, copy data, smp_rmb();
+ *            if (load(slot->seq) != seq) miss;
+ *
+ *   writer:  if (!cmpxchg(&slot->seq, even, even + 1)) give up;
+ *            write tag and data;
+ *            store_release(&slot->seq, even + 2);
+ *
+ * A process that dies while filling a slot leaves it locked, which only
+ * costs the cache that slot.  Nothing is ever invalidated: the cached
+ * images must be immutable, which is why the filter is read-only and
+ * does not share write permissions on its child.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/file.h>
+#include <sys/mman.h>
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "qemu/atomic.h"
+#include "qemu/cutils.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+#define SHARED_CACHE_MAGIC          "QEMUSHC"
+#define SHARED_CACHE_VERSION        1
+#define SHARED_CACHE_WAYS           4
+#define SHARED_CACHE_HEADER_SIZE    4096
+
+#define SHARED_CACHE_OPT_PATH           "path"
+#define SHARED_CACHE_OPT_SIZE           "size"
+#define SHARED_CACHE_OPT_CLUSTER_SIZE   "cluster-size"
+#define SHARED_CACHE_OPT_KEY            "key"
+
+typedef struct SharedCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t cluster_bits;
+    uint64_t nb_sets;
+} SharedCacheHeader;
+
+typedef struct SharedCacheSlot {
+    uint32_t seq;
+    uint32_t reserved;
+    uint64_t key;       /* 0 if the slot has never been filled */
+    uint64_t cluster;
+} SharedCacheSlot;
+
+typedef struct BDRVSharedCacheState {
+    void *map;
+    size_t map_size;
+    SharedCacheSlot *slots;
+    uint8_t *data;
+    uint64_t nb_sets;
+    int cluster_bits;
+    uint64_t key;
+    int64_t length;
+} BDRVSharedCacheState;
+
+static QemuOptsList runtime_opts = {
+    .name = "shared-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = SHARED_CACHE_OPT_PATH,
+            .type = QEMU_OPT_STRING,
+            .help = "path of the shared cache file",
+        },
+        {
+            .name = SHARED_CACHE_OPT_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "amount of data held by the cache, default 256M",
+        },
+        {
+            .name = SHARED_CACHE_OPT_CLUSTER_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "cache granularity, default 64K",
+        },
+        {
+            .name = SHARED_CACHE_OPT_KEY,
+            .type = QEMU_OPT_STRING,
+            .help = "identity of the image in the cache",
+        },
+        { /* end of list */ }
+    },
+};
+
+static size_t shared_cache_map_size(uint64_t nb_sets, int cluster_bits)
+{
+    uint64_t nb_slots = nb_sets * SHARED_CACHE_WAYS;
+
+    return SHARED_CACHE_HEADER_SIZE +
+           ROUND_UP(nb_slots * sizeof(SharedCacheSlot), 4096) +
+           (nb_slots << cluster_bits);
+}
+
+static uint64_t shared_cache_key_mix(uint64_t h, uint64_t v)
+{
+    return (h ^ v) * 0x9e3779b97f4a7c15ULL;
+}
+
+/*
+ * FNV-1a, mixed with the image length and, if @st is given, with the
+ * identity and modification time of the file, so that an image that is
+ * replaced or rewritten in place does not hit on the old one's clusters.
+ */
+static uint64_t shared_cache_image_key(const char *id, int64_t length,
+                                       const struct stat *st)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (; *id; id++) {
+        h = (h ^ (uint8_t)*id) * 0x100000001b3ULL;
+    }
+    h = shared_cache_key_mix(h, length);
+    if (st) {
+        h = shared_cache_key_mix(h, st->st_dev);
+        h = shared_cache_key_mix(h, st->st_ino);
+        h = shared_cache_key_mix(h, st->st_mtime);
+    }
+
+    return h ?: 1;
+}
+
+static int shared_cache_map(BDRVSharedCacheState *s, const char *path,
+                            uint64_t size, uint64_t cluster_size,
+                            bool has_cluster_size, Error **errp)
+{
+    SharedCacheHeader hdr;
+    struct stat st;
+    int fd, ret;
+
+    fd = qemu_create(path, O_RDWR, 0600, errp);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    /* Serialize the creation of the cache with other processes */
+    if (flock(fd, LOCK_EX) < 0) {
+        ret = -errno;
+        error_setg_errno(errp, errno, "Could not lock '%s'", path);
+        goto out;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        ret = -errno;
+        error_setg_errno(errp, errno, "Could not stat '%s'", path);
+        goto out;
+    }
+
+    if (st.st_size == 0) {
+        s->cluster_bits = ctz64(cluster_size);
+        s->nb_sets = MAX(size / cluster_size / SHARED_CACHE_WAYS, 1);
+        s->map_size = shared_cache_map_size(s->nb_sets, s->cluster_bits);
+        if (ftruncate(fd, s->map_size) < 0) {
+            ret = -errno;
+            error_setg_errno(errp, errno, "Could not resize '%s'", path);
+            goto out;
+        }
+    } else {
+        ret = pread(fd, &hdr, sizeof(hdr), 0);
+        if (ret != sizeof(hdr) ||
+            memcmp(hdr.magic, SHARED_CACHE_MAGIC, sizeof(hdr.magic)) ||
+            hdr.version != SHARED_CACHE_VERSION ||
+            hdr.cluster_bits < 12 || hdr.cluster_bits > 21 || !hdr.nb_sets) {
+            error_setg(errp, "'%s' is not a shared cache file", path);
+            ret = -EINVAL;
+            goto out;
+        }
+        if (has_cluster_size && hdr.cluster_bits != ctz64(cluster_size)) {
+            error_setg(errp, "Shared cache '%s' has a cluster size of %llu",
+                       path, 1ULL << hdr.cluster_bits);
+            ret = -EINVAL;
+            goto out;
+        }
+        s->cluster_bits = hdr.cluster_bits;
+        s->nb_sets = hdr.nb_sets;
+        s->map_size = shared_cache_map_size(s->nb_sets, s->cluster_bits);
+        if (st.st_size < s->map_size) {
+            error_setg(errp, "Shared cache '%s' is truncated", path);
+            ret = -EINVAL;
+            goto out;
+        }
+    }
+
+    s->map = mmap(NULL, s->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+    if (s->map == MAP_FAILED) {
+        ret = -errno;
+        s->map = NULL;
+        error_setg_errno(errp, errno, "Could not map '%s'", path);
+        goto out;
+    }
+
+    s->slots = s->map + SHARED_CACHE_HEADER_SIZE;
+    s->data = (uint8_t *)s->slots +
+              ROUND_UP(s->nb_sets * SHARED_CACHE_WAYS * sizeof(SharedCacheSlot),
+                       4096);
+
+    if (st.st_size == 0) {
+        SharedCacheHeader *h = s->map;
+
+        h->version = SHARED_CACHE_VERSION;
+        h->cluster_bits = s->cluster_bits;
+        h->nb_sets = s->nb_sets;
+        memcpy(h->magic, SHARED_CACHE_MAGIC, sizeof(h->magic));
+    }
+    ret = 0;
+
+out:
+    /* Closing the file drops the lock, the mapping stays */
+    qemu_close(fd);
+    return ret;
+}
+
+static int shared_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                             Error **errp)
+{
+    BDRVSharedCacheState *s = bs->opaque;
+    QemuOpts *opts;
+    const char *path, *key;
+    uint64_t size, cluster_size;
+    g_autofree char *filename = NULL;
+    char *real;
+    bool has_cluster_size;
+    int ret;
+
+    if (flags & BDRV_O_RDWR) {
+        error_setg(errp, "The shared-cache filter only supports read-only "
+                   "nodes");
+        return -EINVAL;
+    }
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    path = qemu_opt_get(opts, SHARED_CACHE_OPT_PATH);
+    if (!path) {
+        error_setg(errp, "Parameter '" SHARED_CACHE_OPT_PATH "' is required");
+        ret = -EINVAL;
+        goto out;
+    }
+
+    size = qemu_opt_get_size(opts, SHARED_CACHE_OPT_SIZE, 256 * MiB);
+    has_cluster_size = qemu_opt_get(opts, SHARED_CACHE_OPT_CLUSTER_SIZE);
+    cluster_size = qemu_opt_get_size(opts, SHARED_CACHE_OPT_CLUSTER_SIZE,
+                                     64 * KiB);
+    if (!is_power_of_2(cluster_size) ||
+        cluster_size < 4 * KiB || cluster_size > 2 * MiB) {
+        error_setg(errp, "Parameter '" SHARED_CACHE_OPT_CLUSTER_SIZE "' "
+                   "must be a power of two between 4k and 2M");
+        ret = -EINVAL;
+        goto out;
+    }
+
+    bdrv_graph_rdlock_main_loop();
+    s->length = bdrv_getlength(bs->file->bs);
+    filename = g_strdup(bs->file->bs->filename);
+    bdrv_graph_rdunlock_main_loop();
+
+    if (s->length < 0) {
+        error_setg_errno(errp, -s->length, "Could not get the image length");
+        ret = s->length;
+        goto out;
+    }
+
+    key = qemu_opt_get(opts, SHARED_CACHE_OPT_KEY);
+    if (key) {
+        s->key = shared_cache_image_key(key, s->length, NULL);
+    } else {
+        struct stat st;
+
+        real = realpath(filename, NULL);
+        if (stat(real ?: filename, &st) < 0) {
+            ret = -errno;
+            error_setg_errno(errp, -ret, "Could not stat '%s', set '"
+                             SHARED_CACHE_OPT_KEY "' explicitly", filename);
+            free(real);
+            goto out;
+        }
+        s->key = shared_cache_image_key(real ?: filename, s->length, &st);
+        free(real);
+    }
+
+    ret = shared_cache_map(s, path, size, cluster_size, has_cluster_size,
+                           errp);
+    if (ret < 0) {
+        goto out;
+    }
+
+    trace_shared_cache_open(bs, path, s->nb_sets * SHARED_CACHE_WAYS,
+                            1ULL << s->cluster_bits, s->key);
+
+out:
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void shared_cache_close(BlockDriverState *bs)
+{
+    BDRVSharedCacheState *s = bs->opaque;
+
+    if (s->map) {
+        munmap(s->map, s->map_size);
+    }
+}
+
+static int shared_cache_reopen_prepare(BDRVReopenState *reopen_state,
+                                       BlockReopenQueue *queue, Error **errp)
+{
+    if (reopen_state->flags & BDRV_O_RDWR) {
+        error_setg(errp, "The shared-cache filter only supports read-only "
+                   "nodes");
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static void GRAPH_RDLOCK
+shared_cache_child_perm(BlockDriverState *bs, BdrvChild *c, BdrvChildRole role,
+                        BlockReopenQueue *reopen_queue,
+                        uint64_t perm, uint64_t shared,
+                        uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared,
+                       nperm, nshared);
+
+    /* The cache is never invalidated, so the image must not change */
+    if (!(bs->open_flags & BDRV_O_INACTIVE)) {
+        *nshared &= ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+    }
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+shared_cache_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+static SharedCacheSlot *shared_cache_set(BDRVSharedCacheState *s,
+                                         uint64_t cluster)
+{
+    uint64_t h = (s->key ^ cluster) * 0x9e3779b97f4a7c15ULL;
+
+    return &s->slots[((h >> 32) % s->nb_sets) * SHARED_CACHE_WAYS];
+}
+
+static uint8_t *shared_cache_slot_data(BDRVSharedCacheState *s,
+                                       SharedCacheSlot *slot)
+{
+    return s->data + ((uint64_t)(slot - s->slots) << s->cluster_bits);
+}
+
+/*
+ * Copy @bytes at @offset_in_cluster of @cluster from the cache into
+ * @qiov.  Return false if the cluster is not cached, in which case the
+ * contents of @qiov are undefined.
+ */
+static bool shared_cache_lookup(BDRVSharedCacheState *s, uint64_t cluster,
+                                size_t offset_in_cluster, size_t bytes,
+                                QEMUIOVector *qiov, size_t qiov_offset)
+{
+    SharedCacheSlot *set = shared_cache_set(s, cluster);
+    int i;
+
+    for (i = 0; i < SHARED_CACHE_WAYS; i++) {
+        SharedCacheSlot *slot = &set[i];
+        uint32_t seq = qatomic_load_acquire(&slot->seq);
+
+        /* The tag is checked again by the final sequence count check */
+        if ((seq & 1) || slot->key != s->key || slot->cluster != cluster) {
+            continue;
+        }
+
+        qemu_iovec_from_buf(qiov, qiov_offset,
+                            shared_cache_slot_data(s, slot) + offset_in_cluster,
+                            bytes);
+        smp_rmb();
+        return qatomic_read(&slot->seq) == seq;
+    }
+    return false;
+}
+
+static void shared_cache_insert(BDRVSharedCacheState *s, uint64_t cluster,
+                                const void *buf)
+{
+    SharedCacheSlot *set = shared_cache_set(s, cluster);
+    SharedCacheSlot *slot = NULL;
+    uint32_t seq;
+    int i;
+
+    for (i = 0; i < SHARED_CACHE_WAYS; i++) {
+        if (!set[i].key) {
+            slot = &set[i];
+            break;
+        }
+    }
+    if (!slot) {
+        slot = &set[g_random_int_range(0, SHARED_CACHE_WAYS)];
+    }
+
+    seq = qatomic_read(&slot->seq);
+    if ((seq & 1) || qatomic_cmpxchg(&slot->seq, seq, seq + 1) != seq) {
+        /* Somebody else is filling the slot */
+        return;
+    }
+    smp_wmb();
+
+    slot->key = s->key;
+    slot->cluster = cluster;
+    memcpy(shared_cache_slot_data(s, slot), buf, 1 << s->cluster_bits);
+
+    qatomic_store_release(&slot->seq, seq + 2);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+shared_cache_co_preadv_part(BlockDriverState *bs, int64_t offset,
+                            int64_t bytes, QEMUIOVector *qiov,
+                            size_t qiov_offset, BdrvRequestFlags flags)
+{
+    BDRVSharedCacheState *s = bs->opaque;
+    int64_t cluster_size = 1LL << s->cluster_bits;
+    uint8_t *buf = NULL;
+    int ret = 0;
+
+    while (bytes) {
+        uint64_t cluster = offset >> s->cluster_bits;
+        int64_t cluster_start = cluster << s->cluster_bits;
+        size_t offset_in_cluster = offset - cluster_start;
+        int64_t n = MIN(bytes, cluster_size - offset_in_cluster);
+
+        if (cluster_start + cluster_size > s->length) {
+            /* The partial cluster at the end of the image is not cached */
+            ret = bdrv_co_preadv_part(bs->file, offset, n, qiov, qiov_offset,
+                                      flags);
+        } else if (!shared_cache_lookup(s, cluster, offset_in_cluster, n,
+                                        qiov, qiov_offset)) {
+            trace_shared_cache_miss(bs, cluster);
+            if (!buf) {
+                buf = qemu_try_blockalign(bs->file->bs, cluster_size);
+                if (!buf) {
+                    ret = -ENOMEM;
+                    break;
+                }
+            }
+            /* @buf is our own bounce buffer, not the caller's */
+            ret = bdrv_co_pread(bs->file, cluster_start, cluster_size, buf,
+                                flags & ~BDRV_REQ_REGISTERED_BUF);
+            if (ret == 0) {
+                qemu_iovec_from_buf(qiov, qiov_offset,
+                                    buf + offset_in_cluster, n);
+                shared_cache_insert(s, cluster, buf);
+            }
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        offset += n;
+        bytes -= n;
+        qiov_offset += n;
+    }
+
+    qemu_vfree(buf);
+    return ret;
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+shared_cache_co_eject(BlockDriverState *bs, bool eject_flag)
+{
+    bdrv_co_eject(bs->file->bs, eject_flag);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+shared_cache_co_lock_medium(BlockDriverState *bs, bool locked)
+{
+    bdrv_co_lock_medium(bs->file->bs, locked);
+}
+
+static BlockDriver bdrv_shared_cache = {
+    .format_name                        = "shared-cache",
+    .instance_size                      = sizeof(BDRVSharedCacheState),
+
+    .bdrv_open                          = shared_cache_open,
+    .bdrv_close                         = shared_cache_close,
+    .bdrv_reopen_prepare                = shared_cache_reopen_prepare,
+    .bdrv_child_perm                    = shared_cache_child_perm,
+
+    .bdrv_co_getlength                  = shared_cache_co_getlength,
+
+    .bdrv_co_preadv_part                = shared_cache_co_preadv_part,
+
+    .bdrv_co_eject                      = shared_cache_co_eject,
+    .bdrv_co_lock_medium                = shared_cache_co_lock_medium,
+
+    .is_filter                          = true,
+};
+
+static void bdrv_shared_cache_init(void)
+{
+    bdrv_register(&bdrv_shared_cache);
+}
+
+block_init(bdrv_shared_cache_init);
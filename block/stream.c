@@ -13,6 +13,7 @@
 
 #include "qemu/osdep.h"
 #include "trace.h"
+#include "block/aio_task.h"
 #include "block/block_int.h"
 #include "block/blockjob_int.h"
 #include "qapi/error.h"
@@ -28,8 +29,17 @@ enum {
      * that populating contiguous regions of the image is efficient.
      */
     STREAM_CHUNK = 512 * 1024, /* in bytes */
+
+    /* Maximum number of chunks being copied in parallel */
+    STREAM_MAX_WORKERS = 8,
 };
 
+typedef struct StreamFailedRange {
+    int64_t offset;
+    int64_t bytes;
+    int ret;
+} StreamFailedRange;
+
 typedef struct StreamBlockJob {
     BlockJob common;
     BlockBackend *blk;
@@ -41,8 +51,18 @@ typedef struct StreamBlockJob {
     char *backing_file_str;
     bool backing_mask_protocol;
     bool bs_read_only;
+
+    /* Chunks whose copy failed in a worker, handled by stream_run() */
+    GArray *failed;
 } StreamBlockJob;
 
+typedef struct StreamTask {
+    AioTask task;
+    StreamBlockJob *s;
+    int64_t offset;
+    int64_t bytes;
+} StreamTask;
+
 static int coroutine_fn stream_populate(BlockBackend *blk,
                                         int64_t offset, uint64_t bytes)
 {
@@ -51,6 +71,83 @@ static int coroutine_fn stream_populate(BlockBackend *blk,
     return blk_co_preadv(blk, offset, bytes, NULL, BDRV_REQ_PREFETCH);
 }
 
+static int coroutine_fn stream_task_entry(AioTask *task)
+{
+    StreamTask *t = container_of(task, StreamTask, task);
+    StreamBlockJob *s = t->s;
+    int ret;
+
+    ret = stream_populate(s->blk, t->offset, t->bytes);
+    if (ret < 0) {
+        /*
+         * Leave the error handling to stream_run(), which applies the
+         * on-error policy in order and without other copies in flight.
+         */
+        StreamFailedRange fr = {
+            .offset = t->offset,
+            .bytes = t->bytes,
+            .ret = ret,
+        };
+        g_array_append_val(s->failed, fr);
+        return 0;
+    }
+
+    job_progress_update(&s->common.job, t->bytes);
+    return 0;
+}
+
+static gint stream_failed_range_cmp(gconstpointer a, gconstpointer b)
+{
+    const StreamFailedRange *fa = a, *fb = b;
+
+    return fa->offset < fb->offset ? -1 : fa->offset > fb->offset;
+}
+
+/*
+ * Apply the on-error policy to the chunks that failed in the workers.
+ * Must be called with no copy in flight.  Returns a negative errno if the
+ * job has to stop, 0 otherwise.
+ */
+static int coroutine_fn stream_handle_failed(StreamBlockJob *s, int *error)
+{
+    int ret = 0;
+    guint i;
+
+    g_array_sort(s->failed, stream_failed_range_cmp);
+
+    for (i = 0; i < s->failed->len; i++) {
+        StreamFailedRange *fr = &g_array_index(s->failed, StreamFailedRange, i);
+
+        ret = fr->ret;
+        while (ret < 0) {
+            BlockErrorAction action =
+                block_job_error_action(&s->common, s->on_error, true, -ret);
+            if (action != BLOCK_ERROR_ACTION_STOP) {
+                if (*error == 0) {
+                    *error = ret;
+                }
+                if (action == BLOCK_ERROR_ACTION_REPORT) {
+                    goto out;
+                }
+                break;
+            }
+
+            /* Retry once the job is resumed */
+            block_job_ratelimit_sleep(&s->common);
+            if (job_is_cancelled(&s->common.job)) {
+                goto out;
+            }
+            ret = stream_populate(s->blk, fr->offset, fr->bytes);
+        }
+        job_progress_update(&s->common.job, fr->bytes);
+    }
+    ret = 0;
+
+out:
+    g_array_set_size(s->failed, 0);
+    return ret;
+}
+
 static int stream_prepare(Job *job)
 {
     StreamBlockJob *s = container_of(job, StreamBlockJob, common.job);
@@ -156,6 +253,7 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
 {
     StreamBlockJob *s = container_of(job, StreamBlockJob, common.job);
     BlockDriverState *unfiltered_bs;
+    AioTaskPool *pool;
     int64_t len;
     int64_t offset = 0;
     int error = 0;
@@ -175,6 +273,9 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
     }
     job_progress_set_remaining(&s->common.job, len);
 
+    pool = aio_task_pool_new(STREAM_MAX_WORKERS);
+    s->failed = g_array_new(false, false, sizeof(StreamFailedRange));
+
     for ( ; offset < len; offset += n) {
         bool copy;
         int ret;
@@ -187,10 +288,23 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
             break;
         }
 
+        if (s->failed->len) {
+            aio_task_pool_wait_all(pool);
+            if (stream_handle_failed(s, &error) < 0) {
+                break;
+            }
+        }
+
         copy = false;
 
         WITH_GRAPH_RDLOCK_GUARD() {
-            ret = bdrv_co_is_allocated(unfiltered_bs, offset, STREAM_CHUNK, &n);
+            /*
+             * Query the whole rest of the image, so that long runs that are
+             * allocated in the top or in none of the intermediate images
+             * are skipped in one step.
+             */
+            ret = bdrv_co_is_allocated(unfiltered_bs, offset, len - offset,
+                                       &n);
             if (ret == 1) {
                 /* Allocated in the top, no need to copy.  */
             } else if (ret >= 0) {
@@ -211,7 +325,18 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
         }
         trace_stream_one_iteration(s, offset, n, ret);
         if (copy) {
-            ret = stream_populate(s->blk, offset, n);
+            StreamTask *t = g_new(StreamTask, 1);
+
+            n = MIN(n, STREAM_CHUNK);
+            *t = (StreamTask) {
+                .task.func = stream_task_entry,
+                .s = s,
+                .offset = offset,
+                .bytes = n,
+            };
+            aio_task_pool_start_task(pool, &t->task);
+            block_job_ratelimit_processed_bytes(&s->common, n);
+            continue;
         }
         if (ret < 0) {
             BlockErrorAction action =
@@ -230,11 +355,17 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
 
         /* Publish progress */
         job_progress_update(&s->common.job, n);
-        if (copy) {
-            block_job_ratelimit_processed_bytes(&s->common, n);
-        }
     }
 
+    aio_task_pool_wait_all(pool);
+    aio_task_pool_free(pool);
+    if (s->failed->len && offset >= len) {
+        /* Not if the loop stopped early because of an error or cancel */
+        stream_handle_failed(s, &error);
+    }
+    g_array_free(s->failed, true);
+    s->failed = NULL;
+
     /* Do not remove the backing file if an error was there but ignored. */
     return error;
 }
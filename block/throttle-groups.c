@@ -29,12 +29,20 @@
 #include "qemu/main-loop.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
+#include "qemu/units.h"
 #include "sysemu/qtest.h"
 #include "qapi/error.h"
 #include "qapi/qapi-visit-block-core.h"
 #include "qom/object.h"
 #include "qom/object_interfaces.h"
 
+/* Members are granted this much of the group's budget at once, see
+ * throttle_group_grant_credit().
+ */
+#define THROTTLE_GROUP_CREDIT_NS        (1 * SCALE_MS)
+#define THROTTLE_GROUP_CREDIT_MIN_OPS   4
+#define THROTTLE_GROUP_CREDIT_MIN_BYTES (64 * KiB)
+
 static void throttle_group_obj_init(Object *obj);
 static void throttle_group_obj_complete(UserCreatable *obj, Error **errp);
 static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction);
@@ -62,6 +70,14 @@ static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction);
  * blk_set_aio_context()). Therefore in this file a thread will
  * access some other ThrottleGroupMember's timers only after verifying that
  * that ThrottleGroupMember has throttled requests in the queue.
+ *
+ * With many members in different iothreads, tg->lock becomes contended.
+ * Therefore, when a request passes without waiting and nobody else is
+ * queued, its member is granted the budget that the limits allow in
+ * THROTTLE_GROUP_CREDIT_NS.  The budget is accounted to the group right
+ * away, and the member's following requests consume it under the member's
+ * own credit_lock until it runs out or the group starts throttling.  The
+ * unused part is given back the next time the member takes tg->lock.
  */
 struct ThrottleGroup {
     Object parent_obj;
@@ -70,7 +86,10 @@ struct ThrottleGroup {
     bool is_initialized;
     char *name; /* This is constant during the lifetime of the group */
 
-    QemuMutex lock; /* This lock protects the following four fields */
+    /* This lock protects the following four fields.  any_timer_armed is
+     * also read without it by throttle_group_take_credit().
+     */
+    QemuMutex lock;
     ThrottleState ts;
     QLIST_HEAD(, ThrottleGroupMember) head;
     ThrottleGroupMember *tokens[THROTTLE_MAX];
@@ -286,12 +305,107 @@ static bool throttle_group_schedule_timer(ThrottleGroupMember *tgm,
     /* If a timer just got armed, set tgm as the current token */
     if (must_wait) {
         tg->tokens[direction] = tgm;
-        tg->any_timer_armed[direction] = true;
+        qatomic_set(&tg->any_timer_armed[direction], true);
     }
 
     return must_wait;
 }
 
+/* Admit a request of @bytes with the credit of @tgm, without taking the
+ * group lock.  This fails if the group is throttling requests in
+ * @direction, so that members with credit do not overtake queued requests.
+ *
+ * @ret: whether the request was admitted
+ */
+static bool throttle_group_take_credit(ThrottleGroupMember *tgm,
+                                       int64_t bytes,
+                                       ThrottleDirection direction)
+{
+    ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+    ThrottleCredit *credit = &tgm->credit[direction];
+    double units = 1.0;
+    bool ok;
+
+    if (qatomic_read(&tg->any_timer_armed[direction]) ||
+        qatomic_read(&tgm->pending_reqs[direction])) {
+        return false;
+    }
+
+    qemu_spin_lock(&tgm->credit_lock);
+    if (credit->op_size && bytes > credit->op_size) {
+        units = (double) bytes / credit->op_size;
+    }
+    ok = credit->units >= units && credit->bytes >= bytes;
+    if (ok) {
+        credit->units -= units;
+        credit->bytes -= bytes;
+    }
+    qemu_spin_unlock(&tgm->credit_lock);
+
+    return ok;
+}
+
+/* Give the unused credit of @tgm back to the group.
+ *
+ * This assumes that tg->lock is held.
+ */
+static void throttle_group_return_credit(ThrottleGroupMember *tgm,
+                                         ThrottleDirection direction)
+{
+    ThrottleCredit credit;
+
+    qemu_spin_lock(&tgm->credit_lock);
+    credit = tgm->credit[direction];
+    tgm->credit[direction] = (ThrottleCredit) { 0 };
+    qemu_spin_unlock(&tgm->credit_lock);
+
+    if (credit.units || credit.bytes) {
+        throttle_unreserve(tgm->throttle_state, direction,
+                           credit.units, credit.bytes);
+    }
+}
+
+/* Reserve some of the group's budget for the next requests of @tgm, if that
+ * does not make anybody wait.
+ *
+ * This assumes that tg->lock is held.
+ */
+static void throttle_group_grant_credit(ThrottleGroupMember *tgm,
+                                        ThrottleDirection direction)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    double units, bytes;
+
+    /* qtest drives the virtual clock and expects exact accounting */
+    if (tg->clock_type != QEMU_CLOCK_REALTIME ||
+        qatomic_read(&tgm->io_limits_disabled) ||
+        tg->any_timer_armed[direction] ||
+        tgm->pending_reqs[direction] ||
+        next_throttle_token(tgm, direction) != tgm) {
+        return;
+    }
+
+    throttle_budget_for(ts, direction, THROTTLE_GROUP_CREDIT_NS,
+                        &units, &bytes);
+    if (units < THROTTLE_GROUP_CREDIT_MIN_OPS ||
+        bytes < THROTTLE_GROUP_CREDIT_MIN_BYTES) {
+        return;
+    }
+    if (!throttle_reserve(ts, direction, qemu_clock_get_ns(tg->clock_type),
+                          units, bytes)) {
+        return;
+    }
+
+    qemu_spin_lock(&tgm->credit_lock);
+    tgm->credit[direction] = (ThrottleCredit) {
+        .units = units,
+        .bytes = bytes,
+        .op_size = ts->cfg.op_size,
+    };
+    qemu_spin_unlock(&tgm->credit_lock);
+}
+
 /* Start the next pending I/O request for a ThrottleGroupMember. Return whether
  * any request was actually pending.
  *
@@ -344,7 +458,7 @@ static void coroutine_mixed_fn schedule_next_request(ThrottleGroupMember *tgm,
             ThrottleTimers *tt = &token->throttle_timers;
             int64_t now = qemu_clock_get_ns(tg->clock_type);
             timer_mod(tt->timers[direction], now);
-            tg->any_timer_armed[direction] = true;
+            qatomic_set(&tg->any_timer_armed[direction], true);
         }
         tg->tokens[direction] = token;
     }
@@ -369,7 +483,12 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     assert(bytes >= 0);
     assert(direction < THROTTLE_MAX);
 
+    if (throttle_group_take_credit(tgm, bytes, direction)) {
+        return;
+    }
+
     qemu_mutex_lock(&tg->lock);
+    throttle_group_return_credit(tgm, direction);
 
     /* First we check if this I/O has to be throttled. */
     token = next_throttle_token(tgm, direction);
@@ -393,6 +512,8 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     /* Schedule the next request */
     schedule_next_request(tgm, direction);
 
+    throttle_group_grant_credit(tgm, direction);
+
     qemu_mutex_unlock(&tg->lock);
 }
 
@@ -476,8 +597,15 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
 {
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    ThrottleGroupMember *member;
     qemu_mutex_lock(&tg->lock);
     throttle_config(ts, tg->clock_type, cfg);
+    /* The bucket levels were reset, so outstanding credit is void */
+    QLIST_FOREACH(member, &tg->head, round_robin) {
+        qemu_spin_lock(&member->credit_lock);
+        memset(member->credit, 0, sizeof(member->credit));
+        qemu_spin_unlock(&member->credit_lock);
+    }
     qemu_mutex_unlock(&tg->lock);
 
     throttle_group_restart_tgm(tgm);
@@ -512,7 +640,7 @@ static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction)
 
     /* The timer has just been fired, so we can update the flag */
     qemu_mutex_lock(&tg->lock);
-    tg->any_timer_armed[direction] = false;
+    qatomic_set(&tg->any_timer_armed[direction], false);
     qemu_mutex_unlock(&tg->lock);
 
     /* Run the request that was waiting for this timer */
@@ -551,6 +679,8 @@ void throttle_group_register_tgm(ThrottleGroupMember *tgm,
     tgm->throttle_state = ts;
     tgm->aio_context = ctx;
     qatomic_set(&tgm->restart_pending, 0);
+    qemu_spin_init(&tgm->credit_lock);
+    memset(tgm->credit, 0, sizeof(tgm->credit));
 
     QEMU_LOCK_GUARD(&tg->lock);
     /* If the ThrottleGroup is new set this ThrottleGroupMember as the token */
@@ -602,6 +732,7 @@ void throttle_group_unregister_tgm(ThrottleGroupMember *tgm)
             assert(tgm->pending_reqs[dir] == 0);
             assert(qemu_co_queue_empty(&tgm->throttled_reqs[dir]));
             assert(!timer_pending(tgm->throttle_timers.timers[dir]));
+            throttle_group_return_credit(tgm, dir);
             if (tg->tokens[dir] == tgm) {
                 token = throttle_group_next_tgm(tgm);
                 /* Take care of the case where this is the last tgm in the group */
@@ -645,7 +776,7 @@ void throttle_group_detach_aio_context(ThrottleGroupMember *tgm)
     WITH_QEMU_LOCK_GUARD(&tg->lock) {
         for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
             if (timer_pending(tt->timers[dir])) {
-                tg->any_timer_armed[dir] = false;
+                qatomic_set(&tg->any_timer_armed[dir], false);
                 schedule_next_request(tgm, dir);
             }
         }
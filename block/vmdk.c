@@ -26,6 +26,7 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "block/block_int.h"
+#include "block/thread-pool.h"
 #include "sysemu/block-backend.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qerror.h"
@@ -166,6 +167,10 @@ typedef struct VmdkExtent {
 
 typedef struct BDRVVmdkState {
     CoMutex lock;
+    /* Order of streamOptimized grain writes, see vmdk_co_compress_grain() */
+    uint64_t grain_ticket;
+    uint64_t grain_turn;
+    CoQueue grain_queue;
     uint64_t desc_offset;
     bool cid_updated;
     bool cid_checked;
@@ -1400,6 +1405,7 @@ static int vmdk_open(BlockDriverState *bs, QDict *options, int flags,
         goto fail;
     }
     qemu_co_mutex_init(&s->lock);
+    qemu_co_queue_init(&s->grain_queue);
 
     /* Disable migration when VMDK images are used */
     error_setg(&s->migration_blocker, "The vmdk format used by node '%s' "
@@ -1826,54 +1832,136 @@ vmdk_co_block_status(BlockDriverState *bs, bool want_zero,
     return ret;
 }
 
+typedef struct VmdkZlibTask {
+    Bytef *dest;
+    uLongf dest_len;
+    const Bytef *src;
+    uLong src_len;
+    bool compress;
+} VmdkZlibTask;
+
+static int vmdk_zlib_func(void *opaque)
+{
+    VmdkZlibTask *task = opaque;
+    int ret;
+
+    if (task->compress) {
+        ret = compress(task->dest, &task->dest_len, task->src, task->src_len);
+    } else {
+        ret = uncompress(task->dest, &task->dest_len,
+                         task->src, task->src_len);
+    }
+
+    return ret == Z_OK ? 0 : -EINVAL;
+}
+
+/*
+ * Run @task in the thread pool.  s->lock is dropped meanwhile, so that the
+ * grains of concurrent requests are (de)compressed in parallel.
+ */
+static int coroutine_fn vmdk_co_zlib(BDRVVmdkState *s, VmdkZlibTask *task)
+{
+    int ret;
+
+    qemu_co_mutex_unlock(&s->lock);
+    ret = thread_pool_submit_co(vmdk_zlib_func, task);
+    qemu_co_mutex_lock(&s->lock);
+
+    return ret;
+}
+
+/*
+ * Compress the streamOptimized grain for @n_bytes at guest @offset.  Called
+ * with s->lock held, before the grain is allocated.
+ *
+ * Grains are compressed in parallel but appended to the extent in the
+ * order in which their requests got here: each one waits for its turn
+ * before returning, and the caller then keeps s->lock until the grain is
+ * allocated and written.
+ */
+static int coroutine_fn
+vmdk_co_compress_grain(BDRVVmdkState *s, VmdkExtent *extent,
+                       int64_t offset_in_cluster, QEMUIOVector *qiov,
+                       uint64_t qiov_offset, uint64_t n_bytes,
+                       uint64_t offset, VmdkGrainMarker **grain)
+{
+    uint64_t ticket = s->grain_ticket++;
+    VmdkGrainMarker *data = NULL;
+    void *uncomp_buf = NULL;
+    VmdkZlibTask task;
+    int ret;
+
+    /* Only whole clusters */
+    if (offset_in_cluster ||
+        n_bytes > (extent->cluster_sectors * SECTOR_SIZE) ||
+        (n_bytes < (extent->cluster_sectors * SECTOR_SIZE) &&
+         offset + n_bytes != extent->end_sector * SECTOR_SIZE))
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    if (!extent->has_marker) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    task.dest_len = (extent->cluster_sectors << 9) * 2;
+    data = g_malloc(task.dest_len + sizeof(VmdkGrainMarker));
+
+    uncomp_buf = g_malloc(n_bytes);
+    qemu_iovec_to_buf(qiov, qiov_offset, uncomp_buf, n_bytes);
+
+    task.dest = data->data;
+    task.src = uncomp_buf;
+    task.src_len = n_bytes;
+    task.compress = true;
+    ret = vmdk_co_zlib(s, &task);
+    if (ret == 0 && task.dest_len == 0) {
+        ret = -EINVAL;
+    }
+    if (ret < 0) {
+        goto out;
+    }
+
+    data->lba = cpu_to_le64(offset >> BDRV_SECTOR_BITS);
+    data->size = cpu_to_le32(task.dest_len);
+
+ out:
+    g_free(uncomp_buf);
+
+    while (s->grain_turn != ticket) {
+        qemu_co_queue_wait(&s->grain_queue, &s->lock);
+    }
+    s->grain_turn++;
+    qemu_co_queue_restart_all(&s->grain_queue);
+
+    if (ret < 0) {
+        g_free(data);
+        data = NULL;
+    }
+    *grain = data;
+    return ret;
+}
+
+/*
+ * Write @n_bytes of @qiov to the extent.  For compressed extents @grain is
+ * the grain prepared by vmdk_co_compress_grain() and is written instead.
+ */
 static int coroutine_fn GRAPH_RDLOCK
 vmdk_write_extent(VmdkExtent *extent, int64_t cluster_offset,
                   int64_t offset_in_cluster, QEMUIOVector *qiov,
                   uint64_t qiov_offset, uint64_t n_bytes,
-                  uint64_t offset)
+                  VmdkGrainMarker *grain)
 {
     int ret;
-    VmdkGrainMarker *data = NULL;
-    uLongf buf_len;
     QEMUIOVector local_qiov;
     int64_t write_offset;
     int64_t write_end_sector;
 
     if (extent->compressed) {
-        void *compressed_data;
-
-        /* Only whole clusters */
-        if (offset_in_cluster ||
-            n_bytes > (extent->cluster_sectors * SECTOR_SIZE) ||
-            (n_bytes < (extent->cluster_sectors * SECTOR_SIZE) &&
-             offset + n_bytes != extent->end_sector * SECTOR_SIZE))
-        {
-            ret = -EINVAL;
-            goto out;
-        }
-
-        if (!extent->has_marker) {
-            ret = -EINVAL;
-            goto out;
-        }
-        buf_len = (extent->cluster_sectors << 9) * 2;
-        data = g_malloc(buf_len + sizeof(VmdkGrainMarker));
-
-        compressed_data = g_malloc(n_bytes);
-        qemu_iovec_to_buf(qiov, qiov_offset, compressed_data, n_bytes);
-        ret = compress(data->data, &buf_len, compressed_data, n_bytes);
-        g_free(compressed_data);
-
-        if (ret != Z_OK || buf_len == 0) {
-            ret = -EINVAL;
-            goto out;
-        }
-
-        data->lba = cpu_to_le64(offset >> BDRV_SECTOR_BITS);
-        data->size = cpu_to_le32(buf_len);
-
-        n_bytes = buf_len + sizeof(VmdkGrainMarker);
-        qemu_iovec_init_buf(&local_qiov, data, n_bytes);
+        n_bytes = le32_to_cpu(grain->size) + sizeof(VmdkGrainMarker);
+        qemu_iovec_init_buf(&local_qiov, grain, n_bytes);
 
         BLKDBG_CO_EVENT(extent->file, BLKDBG_WRITE_COMPRESSED);
     } else {
@@ -1901,7 +1989,6 @@ vmdk_write_extent(VmdkExtent *extent, int64_t cluster_offset,
     }
     ret = 0;
  out:
-    g_free(data);
     if (!extent->compressed) {
         qemu_iovec_destroy(&local_qiov);
     }
@@ -1909,7 +1996,7 @@ vmdk_write_extent(VmdkExtent *extent, int64_t cluster_offset,
 }
 
 static int coroutine_fn GRAPH_RDLOCK
-vmdk_read_extent(VmdkExtent *extent, int64_t cluster_offset,
+vmdk_read_extent(BDRVVmdkState *s, VmdkExtent *extent, int64_t cluster_offset,
                  int64_t offset_in_cluster, QEMUIOVector *qiov, int bytes)
 {
     int ret;
@@ -1918,7 +2005,7 @@ vmdk_read_extent(VmdkExtent *extent, int64_t cluster_offset,
     uint8_t *uncomp_buf;
     uint32_t data_len;
     VmdkGrainMarker *marker;
-    uLongf buf_len;
+    VmdkZlibTask task;
 
 
     if (!extent->compressed) {
@@ -1943,7 +2030,6 @@ vmdk_read_extent(VmdkExtent *extent, int64_t cluster_offset,
         goto out;
     }
     compressed_data = cluster_buf;
-    buf_len = cluster_bytes;
     data_len = cluster_bytes;
     if (extent->has_marker) {
         marker = (VmdkGrainMarker *)cluster_buf;
@@ -1954,14 +2040,18 @@ vmdk_read_extent(VmdkExtent *extent, int64_t cluster_offset,
         ret = -EINVAL;
         goto out;
     }
-    ret = uncompress(uncomp_buf, &buf_len, compressed_data, data_len);
-    if (ret != Z_OK) {
-        ret = -EINVAL;
+    /* Grains are never rewritten, so s->lock may be dropped meanwhile */
+    task.dest = uncomp_buf;
+    task.dest_len = cluster_bytes;
+    task.src = compressed_data;
+    task.src_len = data_len;
+    task.compress = false;
+    ret = vmdk_co_zlib(s, &task);
+    if (ret < 0) {
         goto out;
-
     }
     if (offset_in_cluster < 0 ||
-            offset_in_cluster + bytes > buf_len) {
+            offset_in_cluster + bytes > task.dest_len) {
         ret = -EINVAL;
         goto out;
     }
@@ -2027,8 +2117,8 @@ vmdk_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             qemu_iovec_reset(&local_qiov);
             qemu_iovec_concat(&local_qiov, qiov, bytes_done, n_bytes);
 
-            ret = vmdk_read_extent(extent, cluster_offset, offset_in_cluster,
-                                   &local_qiov, n_bytes);
+            ret = vmdk_read_extent(s, extent, cluster_offset,
+                                   offset_in_cluster, &local_qiov, n_bytes);
             if (ret) {
                 goto fail;
             }
@@ -2067,6 +2157,7 @@ vmdk_pwritev(BlockDriverState *bs, uint64_t offset, uint64_t bytes,
     uint64_t cluster_offset;
     uint64_t bytes_done = 0;
     VmdkMetaData m_data;
+    g_autofree VmdkGrainMarker *grain = NULL;
 
     if (DIV_ROUND_UP(offset, BDRV_SECTOR_SIZE) > bs->total_sectors) {
         error_report("Wrong offset: offset=0x%" PRIx64
@@ -2087,6 +2178,15 @@ vmdk_pwritev(BlockDriverState *bs, uint64_t offset, uint64_t bytes,
         n_bytes = MIN(bytes, extent->cluster_sectors * BDRV_SECTOR_SIZE
                              - offset_in_cluster);
 
+        if (extent->compressed && !zeroed) {
+            g_free(grain);
+            ret = vmdk_co_compress_grain(s, extent, offset_in_cluster, qiov,
+                                         bytes_done, n_bytes, offset, &grain);
+            if (ret) {
+                return ret;
+            }
+        }
+
         ret = get_cluster_offset(bs, extent, &m_data, offset,
                                  !(extent->compressed || zeroed),
                                  &cluster_offset, offset_in_cluster,
@@ -2124,7 +2224,7 @@ vmdk_pwritev(BlockDriverState *bs, uint64_t offset, uint64_t bytes,
             }
         } else {
             ret = vmdk_write_extent(extent, cluster_offset, offset_in_cluster,
-                                    qiov, bytes_done, n_bytes, offset);
+                                    qiov, bytes_done, n_bytes, grain);
             if (ret) {
                 return ret;
             }
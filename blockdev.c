@@ -2788,6 +2788,7 @@ static void blockdev_mirror_common(const char *job_id, BlockDriverState *bs,
                                    bool has_unmap, bool unmap,
                                    const char *filter_node_name,
                                    bool has_copy_mode, MirrorCopyMode copy_mode,
+                                   bool has_adaptive, bool adaptive,
                                    bool has_auto_finalize, bool auto_finalize,
                                    bool has_auto_dismiss, bool auto_dismiss,
                                    Error **errp)
@@ -2819,6 +2820,9 @@ static void blockdev_mirror_common(const char *job_id, BlockDriverState *bs,
     if (!has_copy_mode) {
         copy_mode = MIRROR_COPY_MODE_BACKGROUND;
     }
+    if (!has_adaptive) {
+        adaptive = false;
+    }
     if (has_auto_finalize && !auto_finalize) {
         job_flags |= JOB_MANUAL_FINALIZE;
     }
@@ -2892,7 +2896,7 @@ static void blockdev_mirror_common(const char *job_id, BlockDriverState *bs,
                  replaces, job_flags,
                  speed, granularity, buf_size, sync, backing_mode, zero_target,
                  on_source_error, on_target_error, unmap, filter_node_name,
-                 copy_mode, errp);
+                 copy_mode, adaptive, errp);
 }
 
 void qmp_drive_mirror(DriveMirror *arg, Error **errp)
@@ -3043,6 +3047,7 @@ void qmp_drive_mirror(DriveMirror *arg, Error **errp)
                            arg->has_unmap, arg->unmap,
                            NULL,
                            arg->has_copy_mode, arg->copy_mode,
+                           arg->has_adaptive, arg->adaptive,
                            arg->has_auto_finalize, arg->auto_finalize,
                            arg->has_auto_dismiss, arg->auto_dismiss,
                            errp);
@@ -3062,6 +3067,7 @@ void qmp_blockdev_mirror(const char *job_id,
                          BlockdevOnError on_target_error,
                          const char *filter_node_name,
                          bool has_copy_mode, MirrorCopyMode copy_mode,
+                         bool has_adaptive, bool adaptive,
                          bool has_auto_finalize, bool auto_finalize,
                          bool has_auto_dismiss, bool auto_dismiss,
                          Error **errp)
@@ -3101,6 +3107,7 @@ void qmp_blockdev_mirror(const char *job_id,
                            has_on_target_error, on_target_error,
                            true, true, filter_node_name,
                            has_copy_mode, copy_mode,
+                           has_adaptive, adaptive,
                            has_auto_finalize, auto_finalize,
                            has_auto_dismiss, auto_dismiss,
                            errp);
@@ -23,6 +23,7 @@
  */
 #include "qemu/osdep.h"
 #include "chardev/char-io.h"
+#include "qemu/iov.h"
 
 typedef struct IOWatchPoll {
     GSource parent;
@@ -109,19 +110,21 @@ void remove_fd_in_watch(Chardev *chr)
     }
 }
 
-int io_channel_send_full(QIOChannel *ioc,
-                         const void *buf, size_t len,
-                         int *fds, size_t nfds)
+int io_channel_sendv_full(QIOChannel *ioc,
+                          const struct iovec *iov, size_t niov,
+                          int *fds, size_t nfds)
 {
+    g_autofree struct iovec *local = g_memdup2(iov, niov * sizeof(*iov));
+    struct iovec *cur = local;
+    unsigned int cnt = niov;
+    size_t len = iov_size(iov, niov);
     size_t offset = 0;
 
     while (offset < len) {
         ssize_t ret = 0;
-        struct iovec iov = { .iov_base = (char *)buf + offset,
-                             .iov_len = len - offset };
 
         ret = qio_channel_writev_full(
-            ioc, &iov, 1,
+            ioc, cur, cnt,
             fds, nfds, 0, NULL);
         if (ret == QIO_CHANNEL_ERR_BLOCK) {
             if (offset) {
@@ -136,11 +139,21 @@ int io_channel_send_full(QIOChannel *ioc,
         }
 
         offset += ret;
+        iov_discard_front(&cur, &cnt, ret);
     }
 
     return offset;
 }
 
+int io_channel_send_full(QIOChannel *ioc,
+                         const void *buf, size_t len,
+                         int *fds, size_t nfds)
+{
+    struct iovec iov = { .iov_base = (char *)buf, .iov_len = len };
+
+    return io_channel_sendv_full(ioc, &iov, 1, fds, nfds);
+}
+
 int io_channel_send(QIOChannel *ioc, const void *buf, size_t len)
 {
     return io_channel_send_full(ioc, buf, len, NULL, 0);
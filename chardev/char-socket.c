@@ -104,14 +104,14 @@ static int tcp_chr_read_poll(void *opaque);
 static void tcp_chr_disconnect_locked(Chardev *chr);
 
 /* Called with chr_write_lock held.  */
-static int tcp_chr_write(Chardev *chr, const uint8_t *buf, int len)
+static int tcp_chr_writev(Chardev *chr, const struct iovec *iov, int iovcnt)
 {
     SocketChardev *s = SOCKET_CHARDEV(chr);
 
     if (s->state == TCP_CHARDEV_STATE_CONNECTED) {
-        int ret =  io_channel_send_full(s->ioc, buf, len,
-                                        s->write_msgfds,
-                                        s->write_msgfds_num);
+        int ret =  io_channel_sendv_full(s->ioc, iov, iovcnt,
+                                         s->write_msgfds,
+                                         s->write_msgfds_num);
 
         /* free the written msgfds in any cases
          * other than ret < 0 && errno == EAGAIN
@@ -138,6 +138,13 @@ static int tcp_chr_write(Chardev *chr, const uint8_t *buf, int len)
     }
 }
 
+static int tcp_chr_write(Chardev *chr, const uint8_t *buf, int len)
+{
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = len };
+
+    return tcp_chr_writev(chr, &iov, 1);
+}
+
 static int tcp_chr_read_poll(void *opaque)
 {
     Chardev *chr = CHARDEV(opaque);
@@ -1537,6 +1544,7 @@ static void char_socket_class_init(ObjectClass *oc, void *data)
     cc->open = qmp_chardev_open_socket;
     cc->chr_wait_connected = tcp_chr_wait_connected;
     cc->chr_write = tcp_chr_write;
+    cc->chr_writev = tcp_chr_writev;
     cc->chr_sync_read = tcp_chr_sync_read;
     cc->chr_disconnect = tcp_chr_disconnect;
     cc->get_msgfds = tcp_get_msgfds;
@@ -38,6 +38,7 @@
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/id.h"
+#include "qemu/iov.h"
 #include "qemu/coroutine.h"
 #include "qemu/yank.h"
 
@@ -195,6 +196,53 @@ int qemu_chr_write(Chardev *s, const uint8_t *buf, int len, bool write_all)
     return offset;
 }
 
+/* Log the first @len bytes of @iov */
+static void qemu_chr_write_log_iov(Chardev *s, const struct iovec *iov,
+                                   int iovcnt, size_t len)
+{
+    for (int i = 0; i < iovcnt && len; i++) {
+        size_t n = MIN(iov[i].iov_len, len);
+
+        qemu_chr_write_log(s, iov[i].iov_base, n);
+        len -= n;
+    }
+}
+
+int qemu_chr_writev(Chardev *s, const struct iovec *iov, int iovcnt)
+{
+    ChardevClass *cc = CHARDEV_GET_CLASS(s);
+    int offset = 0;
+    int res;
+
+    if (!cc->chr_writev || qemu_chr_replay(s) ||
+        replay_mode != REPLAY_MODE_NONE) {
+        /* One buffer at a time, stopping at the first short write */
+        for (int i = 0; i < iovcnt; i++) {
+            res = qemu_chr_write(s, iov[i].iov_base, iov[i].iov_len, false);
+            if (res < 0) {
+                return offset ? offset : res;
+            }
+            offset += res;
+            if (res < iov[i].iov_len) {
+                break;
+            }
+        }
+        return offset;
+    }
+
+    qemu_mutex_lock(&s->chr_write_lock);
+    res = cc->chr_writev(s, iov, iovcnt);
+    if (res > 0) {
+        qemu_chr_write_log_iov(s, iov, iovcnt, res);
+    } else if (res < 0) {
+        /* As in qemu_chr_write_buffer(), the data is not written again */
+        qemu_chr_write_log_iov(s, iov, iovcnt, iov_size(iov, iovcnt));
+    }
+    qemu_mutex_unlock(&s->chr_write_lock);
+
+    return res;
+}
+
 int qemu_chr_be_can_write(Chardev *s)
 {
     CharBackend *be = s->be;
@@ -75,9 +75,10 @@ static void vi_input_send(VuInput *vi, struct virtio_input_event *event)
         elem = vi->queue[i].elem;
         len = iov_from_buf(elem->in_sg, elem->in_num,
                            0, &vi->queue[i].event, sizeof(virtio_input_event));
-        vu_queue_push(dev, vq, elem, len);
+        vu_queue_fill(dev, vq, elem, len, i);
         free(elem);
     }
+    vu_queue_flush(dev, vq, vi->qindex);
 
     vu_queue_notify(&vi->dev.parent, vq);
     vi->qindex = 0;
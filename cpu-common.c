@@ -124,7 +124,7 @@ CPUState *qemu_get_cpu(int index)
 __thread CPUState *current_cpu;
 
 struct qemu_work_item {
-    QSIMPLEQ_ENTRY(qemu_work_item) node;
+    QSLIST_ENTRY(qemu_work_item) node;
     run_on_cpu_func func;
     run_on_cpu_data data;
     bool free, exclusive, done;
@@ -132,10 +132,10 @@ struct qemu_work_item {
 
 static void queue_work_on_cpu(CPUState *cpu, struct qemu_work_item *wi)
 {
-    qemu_mutex_lock(&cpu->work_mutex);
-    QSIMPLEQ_INSERT_TAIL(&cpu->work_list, wi, node);
     wi->done = false;
-    qemu_mutex_unlock(&cpu->work_mutex);
+
+    /* Synchronizes with QSLIST_MOVE_ATOMIC in process_queued_cpu_work() */
+    QSLIST_INSERT_HEAD_ATOMIC(&cpu->work_list, wi, node);
 
     qemu_cpu_kick(cpu);
 }
@@ -333,17 +333,30 @@ void async_safe_run_on_cpu(CPUState *cpu, run_on_cpu_func func,
 
 void process_queued_cpu_work(CPUState *cpu)
 {
+    QSLIST_HEAD(, qemu_work_item) straight, reversed;
     struct qemu_work_item *wi;
 
-    qemu_mutex_lock(&cpu->work_mutex);
-    if (QSIMPLEQ_EMPTY(&cpu->work_list)) {
-        qemu_mutex_unlock(&cpu->work_mutex);
+    if (!qatomic_read(&cpu->work_list.slh_first)) {
         return;
     }
-    while (!QSIMPLEQ_EMPTY(&cpu->work_list)) {
-        wi = QSIMPLEQ_FIRST(&cpu->work_list);
-        QSIMPLEQ_REMOVE_HEAD(&cpu->work_list, node);
-        qemu_mutex_unlock(&cpu->work_mutex);
+
+    QSLIST_INIT(&straight);
+    for (;;) {
+        if (QSLIST_EMPTY(&straight)) {
+            /* Items are pushed newest first, run them in queueing order */
+            QSLIST_MOVE_ATOMIC(&reversed, &cpu->work_list);
+            if (QSLIST_EMPTY(&reversed)) {
+                break;
+            }
+            while (!QSLIST_EMPTY(&reversed)) {
+                wi = QSLIST_FIRST(&reversed);
+                QSLIST_REMOVE_HEAD(&reversed, node);
+                QSLIST_INSERT_HEAD(&straight, wi, node);
+            }
+        }
+
+        wi = QSLIST_FIRST(&straight);
+        QSLIST_REMOVE_HEAD(&straight, node);
         if (wi->exclusive) {
             /* Running work items outside the BQL avoids the following deadlock:
              * 1) start_exclusive() is called with the BQL taken while another
@@ -359,14 +372,12 @@ void process_queued_cpu_work(CPUState *cpu)
         } else {
             wi->func(cpu, wi->data);
         }
-        qemu_mutex_lock(&cpu->work_mutex);
         if (wi->free) {
             g_free(wi);
         } else {
             qatomic_store_release(&wi->done, true);
         }
     }
-    qemu_mutex_unlock(&cpu->work_mutex);
     qemu_cond_broadcast(&qemu_work_cond);
 }
 
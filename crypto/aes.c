@@ -1439,6 +1439,61 @@ int AES_set_decrypt_key(const unsigned char *userKey, const int bits,
         return 0;
 }
 
+/*
+ * Load round key @i of @key in byte order, i.e. in the layout that the
+ * aes-round.h primitives use with be == HOST_BIG_ENDIAN.
+ */
+static inline void aes_load_round_key(AESState *r, const AES_KEY *key, int i)
+{
+    r->w[0] = cpu_to_be32(key->rd_key[4 * i + 0]);
+    r->w[1] = cpu_to_be32(key->rd_key[4 * i + 1]);
+    r->w[2] = cpu_to_be32(key->rd_key[4 * i + 2]);
+    r->w[3] = cpu_to_be32(key->rd_key[4 * i + 3]);
+}
+
+/* Encrypt a single block with the host AES instructions */
+static void aes_encrypt_accel(const unsigned char *in, unsigned char *out,
+                              const AES_KEY *key)
+{
+    AESState st, rk;
+    int r;
+
+    memcpy(&st, in, AES_BLOCK_SIZE);
+    aes_load_round_key(&rk, key, 0);
+    st.v ^= rk.v;
+    for (r = 1; r < key->rounds; r++) {
+        aes_load_round_key(&rk, key, r);
+        aesenc_SB_SR_MC_AK(&st, &st, &rk, HOST_BIG_ENDIAN);
+    }
+    aes_load_round_key(&rk, key, r);
+    aesenc_SB_SR_AK(&st, &st, &rk, HOST_BIG_ENDIAN);
+    memcpy(out, &st, AES_BLOCK_SIZE);
+}
+
+/*
+ * Decrypt a single block with the host AES instructions.  The schedule
+ * built by AES_set_decrypt_key() is already in the form needed by the
+ * equivalent inverse cipher: reversed, with InvMixColumns applied to the
+ * inner round keys.
+ */
+static void aes_decrypt_accel(const unsigned char *in, unsigned char *out,
+                              const AES_KEY *key)
+{
+    AESState st, rk;
+    int r;
+
+    memcpy(&st, in, AES_BLOCK_SIZE);
+    aes_load_round_key(&rk, key, 0);
+    st.v ^= rk.v;
+    for (r = 1; r < key->rounds; r++) {
+        aes_load_round_key(&rk, key, r);
+        aesdec_ISB_ISR_IMC_AK(&st, &st, &rk, HOST_BIG_ENDIAN);
+    }
+    aes_load_round_key(&rk, key, r);
+    aesdec_ISB_ISR_AK(&st, &st, &rk, HOST_BIG_ENDIAN);
+    memcpy(out, &st, AES_BLOCK_SIZE);
+}
+
 #ifndef AES_ASM
 /*
  * Encrypt a single block
@@ -1454,6 +1509,10 @@ void AES_encrypt(const unsigned char *in, unsigned char *out,
 #endif /* ?FULL_UNROLL */
 
         assert(in && out && key);
+        if (HAVE_AES_ACCEL) {
+                aes_encrypt_accel(in, out, key);
+                return;
+        }
         rk = key->rd_key;
 
         /*
@@ -1645,6 +1704,10 @@ void AES_decrypt(const unsigned char *in, unsigned char *out,
 #endif /* ?FULL_UNROLL */
 
         assert(in && out && key);
+        if (HAVE_AES_ACCEL) {
+                aes_decrypt_accel(in, out, key);
+                return;
+        }
         rk = key->rd_key;
 
         /*
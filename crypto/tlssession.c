@@ -33,6 +33,10 @@
 
 #include <gnutls/x509.h>
 
+#ifdef CONFIG_LINUX_TLS_H
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#endif
 
 struct QCryptoTLSSession {
     QCryptoTLSCreds *creds;
@@ -500,6 +504,98 @@ qcrypto_tls_session_check_pending(QCryptoTLSSession *session)
 }
 
 
+#ifdef CONFIG_LINUX_TLS_H
+/*
+ * Hand the write half of the session to the kernel.  The layout of the
+ * crypto_info structures and the way the libgnutls IV and sequence
+ * number map onto it follow what libgnutls itself does for kTLS.
+ */
+static int
+qcrypto_tls_session_set_ktls_tx(QCryptoTLSSession *session, int fd)
+{
+    gnutls_protocol_t version = gnutls_protocol_get_version(session->handle);
+    gnutls_cipher_algorithm_t cipher = gnutls_cipher_get(session->handle);
+    gnutls_datum_t mac_key, iv, cipher_key;
+    unsigned char seq_number[8];
+    union {
+        struct tls12_crypto_info_aes_gcm_128 aes128;
+        struct tls12_crypto_info_aes_gcm_256 aes256;
+    } info;
+    socklen_t info_len;
+
+    if (version != GNUTLS_TLS1_2 && version != GNUTLS_TLS1_3) {
+        return -ENOTSUP;
+    }
+    if (gnutls_record_get_state(session->handle, 0, &mac_key, &iv,
+                                &cipher_key, seq_number) < 0) {
+        return -EIO;
+    }
+
+    memset(&info, 0, sizeof(info));
+    switch (cipher) {
+    case GNUTLS_CIPHER_AES_128_GCM:
+        info.aes128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        if (version == GNUTLS_TLS1_3) {
+            memcpy(info.aes128.iv, iv.data + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
+                   TLS_CIPHER_AES_GCM_128_IV_SIZE);
+        } else {
+            memcpy(info.aes128.iv, seq_number, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+        }
+        memcpy(info.aes128.salt, iv.data, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+        memcpy(info.aes128.rec_seq, seq_number,
+               TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+        memcpy(info.aes128.key, cipher_key.data,
+               TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+        info_len = sizeof(info.aes128);
+        break;
+    case GNUTLS_CIPHER_AES_256_GCM:
+        info.aes256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        if (version == GNUTLS_TLS1_3) {
+            memcpy(info.aes256.iv, iv.data + TLS_CIPHER_AES_GCM_256_SALT_SIZE,
+                   TLS_CIPHER_AES_GCM_256_IV_SIZE);
+        } else {
+            memcpy(info.aes256.iv, seq_number, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+        }
+        memcpy(info.aes256.salt, iv.data, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+        memcpy(info.aes256.rec_seq, seq_number,
+               TLS_CIPHER_AES_GCM_256_REC_SEQ_SIZE);
+        memcpy(info.aes256.key, cipher_key.data,
+               TLS_CIPHER_AES_GCM_256_KEY_SIZE);
+        info_len = sizeof(info.aes256);
+        break;
+    default:
+        return -ENOTSUP;
+    }
+    /* Both structures start with the same struct tls_crypto_info */
+    info.aes128.info.version = version == GNUTLS_TLS1_3 ? TLS_1_3_VERSION
+                                                         : TLS_1_2_VERSION;
+
+    if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0 ||
+        setsockopt(fd, SOL_TLS, TLS_TX, &info, info_len) < 0) {
+        memset(&info, 0, sizeof(info));
+        return -errno;
+    }
+    memset(&info, 0, sizeof(info));
+    return 0;
+}
+#endif
+
+
+bool
+qcrypto_tls_session_ktls_tx(QCryptoTLSSession *session, int fd)
+{
+    int ret = -ENOTSUP;
+
+    assert(session->handshakeComplete);
+
+#ifdef CONFIG_LINUX_TLS_H
+    ret = qcrypto_tls_session_set_ktls_tx(session, fd);
+#endif
+    trace_qcrypto_tls_session_ktls_tx(session, fd, ret);
+    return ret == 0;
+}
+
+
 int
 qcrypto_tls_session_handshake(QCryptoTLSSession *session,
                               Error **errp)
@@ -629,6 +725,13 @@ qcrypto_tls_session_check_pending(QCryptoTLSSession *session)
 }
 
 
+bool
+qcrypto_tls_session_ktls_tx(QCryptoTLSSession *session, int fd)
+{
+    return false;
+}
+
+
 int
 qcrypto_tls_session_handshake(QCryptoTLSSession *sess,
                               Error **errp)
@@ -526,22 +526,59 @@ static void write_data(DumpState *s, void *buf, int length, Error **errp)
     }
 }
 
+/*
+ * Seek over the pending hole of a sparse dump.  With @extend, also
+ * write its last byte so that the file grows to include the hole.
+ */
+static void flush_sparse_hole(DumpState *s, bool extend, Error **errp)
+{
+    off_t hole = s->sparse_hole;
+
+    if (!hole) {
+        return;
+    }
+    s->sparse_hole = 0;
+
+    if (lseek(s->fd, extend ? hole - 1 : hole, SEEK_CUR) == (off_t)-1) {
+        error_setg_errno(errp, errno, "dump: failed to seek");
+        return;
+    }
+    if (extend && qemu_write_full(s->fd, "", 1) != 1) {
+        error_setg_errno(errp, errno, "dump: failed to save memory");
+    }
+}
+
 /* write the memory to vmcore. 1 page per I/O. */
 static void write_memory(DumpState *s, GuestPhysBlock *block, ram_addr_t start,
                          int64_t size, Error **errp)
 {
     ERRP_GUARD();
     int64_t i;
+    uint8_t *page;
 
     for (i = 0; i < size / s->dump_info.page_size; i++) {
-        write_data(s, block->host_addr + start + i * s->dump_info.page_size,
-                   s->dump_info.page_size, errp);
+        page = block->host_addr + start + i * s->dump_info.page_size;
+        if (s->sparse && buffer_is_zero(page, s->dump_info.page_size)) {
+            s->sparse_hole += s->dump_info.page_size;
+            s->written_size += s->dump_info.page_size;
+            continue;
+        }
+
+        flush_sparse_hole(s, false, errp);
+        if (*errp) {
+            return;
+        }
+        write_data(s, page, s->dump_info.page_size, errp);
         if (*errp) {
             return;
         }
     }
 
     if ((size % s->dump_info.page_size) != 0) {
+        flush_sparse_hole(s, false, errp);
+        if (*errp) {
+            return;
+        }
         write_data(s, block->host_addr + start + i * s->dump_info.page_size,
                    size % s->dump_info.page_size, errp);
         if (*errp) {
@@ -768,6 +805,8 @@ static void dump_iterate(DumpState *s, Error **errp)
             return;
         }
     }
+
+    flush_sparse_hole(s, true, errp);
 }
 
 static void dump_end(DumpState *s, Error **errp)
@@ -1466,21 +1505,162 @@ static size_t get_len_buf_out(size_t page_size, uint32_t flag_compress)
     return 0;
 }
 
+/* Pages compressed by a worker thread at once */
+#define DUMP_COMPRESS_BATCH 64
+#define DUMP_COMPRESS_THREADS_MAX 8
+
+typedef struct DumpCompressPage {
+    uint8_t *buf;               /* the page */
+    bool zero;
+    uint32_t flags;             /* compression format, 0 for plaintext */
+    size_t size;                /* size of the page data in the vmcore */
+} DumpCompressPage;
+
+typedef struct DumpCompressWorker {
+    DumpState *s;
+    QemuThread thread;
+    QemuSemaphore sem_work;
+    QemuSemaphore sem_done;
+    bool quit;
+    unsigned int nr_pages;      /* pages submitted, 0 if idle */
+    DumpCompressPage pages[DUMP_COMPRESS_BATCH];
+    uint8_t *copy;              /* for pages that are split between blocks */
+    uint8_t *out;               /* compressed data, len_buf_out per page */
+    size_t len_buf_out;
+#ifdef CONFIG_LZO
+    lzo_bytep wrkmem;
+#endif
+} DumpCompressWorker;
+
+/*
+ * Try each compression format in turn, but only one is set in
+ * s->flag_compress.  When compression fails to work, we fall back to
+ * save in plaintext.
+ */
+static void dump_compress_page(DumpCompressWorker *w, DumpCompressPage *p,
+                               uint8_t *buf_out)
+{
+    DumpState *s = w->s;
+    size_t page_size = s->dump_info.page_size;
+    size_t size_out = w->len_buf_out;
+
+    p->zero = buffer_is_zero(p->buf, page_size);
+    if (p->zero) {
+        return;
+    }
+
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
+        (compress2(buf_out, (uLongf *)&size_out, p->buf, page_size,
+                   Z_BEST_SPEED) == Z_OK) &&
+        (size_out < page_size)) {
+        p->flags = DUMP_DH_COMPRESSED_ZLIB;
+        p->size = size_out;
+#ifdef CONFIG_LZO
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
+               (lzo1x_1_compress(p->buf, page_size, buf_out,
+                                 (lzo_uint *)&size_out,
+                                 w->wrkmem) == LZO_E_OK) &&
+               (size_out < page_size)) {
+        p->flags = DUMP_DH_COMPRESSED_LZO;
+        p->size = size_out;
+#endif
+#ifdef CONFIG_SNAPPY
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
+               (snappy_compress((char *)p->buf, page_size,
+                                (char *)buf_out, &size_out) == SNAPPY_OK) &&
+               (size_out < page_size)) {
+        p->flags = DUMP_DH_COMPRESSED_SNAPPY;
+        p->size = size_out;
+#endif
+    } else {
+        p->flags = 0;
+        p->size = page_size;
+    }
+}
+
+static void *dump_compress_thread(void *opaque)
+{
+    DumpCompressWorker *w = opaque;
+
+    while (true) {
+        qemu_sem_wait(&w->sem_work);
+        if (w->quit) {
+            break;
+        }
+        for (unsigned int i = 0; i < w->nr_pages; i++) {
+            dump_compress_page(w, &w->pages[i], w->out + i * w->len_buf_out);
+        }
+        qemu_sem_post(&w->sem_done);
+    }
+    return NULL;
+}
+
+/* Write the pages compressed by @w, in order, and make @w idle again */
+static int dump_write_compressed(DumpCompressWorker *w, DataCache *page_desc,
+                                 DataCache *page_data,
+                                 const PageDescriptor *pd_zero,
+                                 off_t *offset_data, Error **errp)
+{
+    DumpState *s = w->s;
+    unsigned int nr_pages = w->nr_pages;
+    PageDescriptor pd;
+    int ret;
+
+    qemu_sem_wait(&w->sem_done);
+    w->nr_pages = 0;
+
+    for (unsigned int i = 0; i < nr_pages; i++) {
+        DumpCompressPage *p = &w->pages[i];
+
+        if (p->zero) {
+            /* zero pages all share the first page of the page section */
+            ret = write_cache(page_desc, pd_zero, sizeof(PageDescriptor),
+                              false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page desc");
+                return ret;
+            }
+        } else {
+            ret = write_cache(page_data,
+                              p->flags ? w->out + i * w->len_buf_out : p->buf,
+                              p->size, false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page data");
+                return ret;
+            }
+
+            pd.flags = cpu_to_dump32(s, p->flags);
+            pd.size = cpu_to_dump32(s, p->size);
+            pd.page_flags = cpu_to_dump64(s, 0);
+            pd.offset = cpu_to_dump64(s, *offset_data);
+            *offset_data += p->size;
+
+            ret = write_cache(page_desc, &pd, sizeof(PageDescriptor), false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page desc");
+                return ret;
+            }
+        }
+        s->written_size += s->dump_info.page_size;
+    }
+    return 0;
+}
+
 static void write_dump_pages(DumpState *s, Error **errp)
 {
     int ret = 0;
     DataCache page_desc, page_data;
-    size_t len_buf_out, size_out;
-#ifdef CONFIG_LZO
-    lzo_bytep wrkmem = NULL;
-#endif
-    uint8_t *buf_out = NULL;
+    size_t len_buf_out;
     off_t offset_desc, offset_data;
-    PageDescriptor pd, pd_zero;
+    PageDescriptor pd_zero;
     uint8_t *buf;
     GuestPhysBlock *block_iter = NULL;
     uint64_t pfn_iter;
-    g_autofree uint8_t *page = NULL;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int nr_workers = MAX(MIN(nr_cpus, DUMP_COMPRESS_THREADS_MAX), 1);
+    g_autofree DumpCompressWorker *workers = NULL;
+    unsigned int cur = 0;
+    bool done = false;
 
     /* get offset of page_desc and page_data in dump file */
     offset_desc = s->offset_page;
@@ -1493,12 +1673,6 @@ static void write_dump_pages(DumpState *s, Error **errp)
     len_buf_out = get_len_buf_out(s->dump_info.page_size, s->flag_compress);
     assert(len_buf_out != 0);
 
-#ifdef CONFIG_LZO
-    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
-#endif
-
-    buf_out = g_malloc(len_buf_out);
-
     /*
      * init zero page's page_desc and page_data, because every zero page
      * uses the same page_data
@@ -1512,107 +1686,71 @@ static void write_dump_pages(DumpState *s, Error **errp)
     g_free(buf);
     if (ret < 0) {
         error_setg(errp, "dump: failed to write page data (zero page)");
-        goto out;
+        free_data_cache(&page_desc);
+        free_data_cache(&page_data);
+        return;
     }
 
     offset_data += s->dump_info.page_size;
-    page = g_malloc(s->dump_info.page_size);
 
     /*
-     * dump memory to vmcore page by page. zero page will all be resided in the
-     * first page of page section
+     * Pages are compressed in batches by worker threads, and the batches
+     * are handed out and written back round-robin, so that the vmcore
+     * keeps the order of the pages.
      */
-    for (buf = page; get_next_page(&block_iter, &pfn_iter, &buf, s); buf = page) {
-        /* check zero page */
-        if (buffer_is_zero(buf, s->dump_info.page_size)) {
-            ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
-                              false);
+    workers = g_new0(DumpCompressWorker, nr_workers);
+    for (unsigned int i = 0; i < nr_workers; i++) {
+        DumpCompressWorker *w = &workers[i];
+
+        w->s = s;
+        w->len_buf_out = len_buf_out;
+        w->copy = g_malloc(DUMP_COMPRESS_BATCH * s->dump_info.page_size);
+        w->out = g_malloc(DUMP_COMPRESS_BATCH * len_buf_out);
+#ifdef CONFIG_LZO
+        w->wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+#endif
+        qemu_sem_init(&w->sem_work, 0);
+        qemu_sem_init(&w->sem_done, 0);
+        qemu_thread_create(&w->thread, "dump-compress", dump_compress_thread,
+                           w, QEMU_THREAD_JOINABLE);
+    }
+
+    while (!done) {
+        DumpCompressWorker *w = &workers[cur];
+
+        if (w->nr_pages) {
+            ret = dump_write_compressed(w, &page_desc, &page_data, &pd_zero,
+                                        &offset_data, errp);
             if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
                 goto out;
             }
-        } else {
-            /*
-             * not zero page, then:
-             * 1. compress the page
-             * 2. write the compressed page into the cache of page_data
-             * 3. get page desc of the compressed page and write it into the
-             *    cache of page_desc
-             *
-             * only one compression format will be used here, for
-             * s->flag_compress is set. But when compression fails to work,
-             * we fall back to save in plaintext.
-             */
-             size_out = len_buf_out;
-             if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
-                    (compress2(buf_out, (uLongf *)&size_out, buf,
-                               s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_ZLIB);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#ifdef CONFIG_LZO
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
-                    (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
-                    (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_LZO);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-#ifdef CONFIG_SNAPPY
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
-                    (snappy_compress((char *)buf, s->dump_info.page_size,
-                    (char *)buf_out, &size_out) == SNAPPY_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_SNAPPY);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-            } else {
-                /*
-                 * fall back to save in plaintext, size_out should be
-                 * assigned the target's page size
-                 */
-                pd.flags = cpu_to_dump32(s, 0);
-                size_out = s->dump_info.page_size;
-                pd.size = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf,
-                                  s->dump_info.page_size, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
+        }
+
+        while (w->nr_pages < DUMP_COMPRESS_BATCH) {
+            buf = w->copy + w->nr_pages * s->dump_info.page_size;
+            if (!get_next_page(&block_iter, &pfn_iter, &buf, s)) {
+                done = true;
+                break;
             }
+            w->pages[w->nr_pages++].buf = buf;
+        }
+        if (w->nr_pages) {
+            qemu_sem_post(&w->sem_work);
+        }
+        cur = (cur + 1) % nr_workers;
+    }
 
-            /* get and write page desc here */
-            pd.page_flags = cpu_to_dump64(s, 0);
-            pd.offset = cpu_to_dump64(s, offset_data);
-            offset_data += size_out;
+    /* write what is still in flight, oldest first */
+    for (unsigned int i = 0; i < nr_workers; i++) {
+        DumpCompressWorker *w = &workers[(cur + i) % nr_workers];
 
-            ret = write_cache(&page_desc, &pd, sizeof(PageDescriptor), false);
+        if (w->nr_pages) {
+            ret = dump_write_compressed(w, &page_desc, &page_data, &pd_zero,
+                                        &offset_data, errp);
             if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
                 goto out;
             }
         }
-        s->written_size += s->dump_info.page_size;
     }
 
     ret = write_cache(&page_desc, NULL, 0, true);
@@ -1627,14 +1765,26 @@ static void write_dump_pages(DumpState *s, Error **errp)
     }
 
 out:
-    free_data_cache(&page_desc);
-    free_data_cache(&page_data);
+    for (unsigned int i = 0; i < nr_workers; i++) {
+        DumpCompressWorker *w = &workers[i];
 
+        if (w->nr_pages) {
+            qemu_sem_wait(&w->sem_done);
+        }
+        w->quit = true;
+        qemu_sem_post(&w->sem_work);
+        qemu_thread_join(&w->thread);
+        qemu_sem_destroy(&w->sem_work);
+        qemu_sem_destroy(&w->sem_done);
+        g_free(w->copy);
+        g_free(w->out);
 #ifdef CONFIG_LZO
-    g_free(wrkmem);
+        g_free(w->wrkmem);
 #endif
+    }
 
-    g_free(buf_out);
+    free_data_cache(&page_desc);
+    free_data_cache(&page_data);
 }
 
 static void create_kdump_vmcore(DumpState *s, Error **errp)
@@ -1773,6 +1923,18 @@ static void vmcoreinfo_update_phys_base(DumpState *s)
     g_strfreev(lines);
 }
 
+/*
+ * Zero pages can be left as holes if @fd is a regular file, and nothing
+ * follows the position where the dump starts.
+ */
+static bool dump_fd_can_be_sparse(int fd)
+{
+    struct stat st;
+
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+           lseek(fd, 0, SEEK_CUR) >= st.st_size;
+}
+
 static void dump_init(DumpState *s, int fd, bool has_format,
                       DumpGuestMemoryFormat format, bool paging, bool has_filter,
                       int64_t begin, int64_t length, bool kdump_raw,
@@ -1811,6 +1973,8 @@ static void dump_init(DumpState *s, int fd, bool has_format,
     }
 
     s->fd = fd;
+    s->sparse = dump_fd_can_be_sparse(fd);
+    s->sparse_hole = 0;
     if (has_filter && !length) {
         error_setg(errp, "parameter 'length' expects a non-zero size");
         goto cleanup;
@@ -2825,7 +2825,8 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(&p, s, fmt);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2834,6 +2835,33 @@ float32 float64_to_float32(float64 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    union_float64 ua;
+    union_float32 ur;
+
+    ua.s = a;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float64_input_flush1(&ua.s, s);
+    if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+    ur.h = ua.h;
+    /* Let softfloat raise overflow and underflow.  */
+    if (unlikely(float32_is_infinity(ur.s))) {
+        goto soft;
+    } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && !float64_is_zero(ua.s)) {
+        goto soft;
+    }
+    return ur.s;
+
+ soft:
+    return soft_float64_to_float32(ua.s, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
@@ -2990,7 +3018,8 @@ float16 float16_round_to_int(float16 a, float_status *s)
     return float16_round_pack_canonical(&p, s);
 }
 
-float32 float32_round_to_int(float32 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_f32_round_to_int(float32 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2999,7 +3028,8 @@ float32 float32_round_to_int(float32 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
-float64 float64_round_to_int(float64 a, float_status *s)
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_f64_round_to_int(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -3008,6 +3038,61 @@ float64 float64_round_to_int(float64 a, float_status *s)
     return float64_round_pack_canonical(&p, s);
 }
 
+/*
+ * Rounding to an integral value cannot overflow or underflow, and the
+ * only flag it may raise for a normal input is inexact, which
+ * can_use_fpu() has already found set.
+ */
+float32 QEMU_FLATTEN float32_round_to_int(float32 a, float_status *s)
+{
+    union_float32 ua, ur;
+
+    ua.s = a;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float32_input_flush1(&ua.s, s);
+    if (QEMU_HARDFLOAT_1F32_USE_FP) {
+        if (unlikely(!(fpclassify(ua.h) == FP_NORMAL ||
+                       fpclassify(ua.h) == FP_ZERO))) {
+            goto soft;
+        }
+    } else if (unlikely(!float32_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+    ur.h = rintf(ua.h);
+    return ur.s;
+
+ soft:
+    return soft_f32_round_to_int(ua.s, s);
+}
+
+float64 QEMU_FLATTEN float64_round_to_int(float64 a, float_status *s)
+{
+    union_float64 ua, ur;
+
+    ua.s = a;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float64_input_flush1(&ua.s, s);
+    if (QEMU_HARDFLOAT_1F64_USE_FP) {
+        if (unlikely(!(fpclassify(ua.h) == FP_NORMAL ||
+                       fpclassify(ua.h) == FP_ZERO))) {
+            goto soft;
+        }
+    } else if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+    ur.h = rint(ua.h);
+    return ur.s;
+
+ soft:
+    return soft_f64_round_to_int(ua.s, s);
+}
+
 bfloat16 bfloat16_round_to_int(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
@@ -4279,7 +4364,8 @@ static bfloat16 bfloat16_minmax(bfloat16 a, bfloat16 b,
     return bfloat16_round_pack_canonical(pr, s);
 }
 
-static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_f32_minmax(float32 a, float32 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -4290,7 +4376,45 @@ static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
     return float32_round_pack_canonical(pr, s);
 }
 
-static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
+/*
+ * For zero or normal inputs, min/max raise no flags and return one of
+ * the inputs unchanged, independent of the rounding mode; only NaN and
+ * denormal inputs need the full parts_minmax treatment.
+ * As there, -0 is less than +0, and for ismag the sign only breaks
+ * ties between equal magnitudes.
+ */
+static float32 QEMU_FLATTEN
+float32_minmax(float32 a, float32 b, float_status *s, int flags)
+{
+    union_float32 ua, ub;
+    float ha, hb;
+    bool a_less;
+
+    ua.s = a;
+    ub.s = b;
+    if (QEMU_NO_HARDFLOAT || unlikely(!f32_is_zon2(ua, ub))) {
+        return soft_f32_minmax(a, b, s, flags);
+    }
+
+    ha = ua.h;
+    hb = ub.h;
+    if ((flags & minmax_ismag) && fabsf(ha) != fabsf(hb)) {
+        ha = fabsf(ha);
+        hb = fabsf(hb);
+    }
+    if (ha == hb) {
+        a_less = float32_is_neg(a) && !float32_is_neg(b);
+    } else {
+        a_less = ha < hb;
+    }
+    if (flags & minmax_ismin) {
+        return a_less ? a : b;
+    }
+    return a_less ? b : a;
+}
+
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_f64_minmax(float64 a, float64 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -4301,6 +4425,36 @@ static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
     return float64_round_pack_canonical(pr, s);
 }
 
+static float64 QEMU_FLATTEN
+float64_minmax(float64 a, float64 b, float_status *s, int flags)
+{
+    union_float64 ua, ub;
+    double ha, hb;
+    bool a_less;
+
+    ua.s = a;
+    ub.s = b;
+    if (QEMU_NO_HARDFLOAT || unlikely(!f64_is_zon2(ua, ub))) {
+        return soft_f64_minmax(a, b, s, flags);
+    }
+
+    ha = ua.h;
+    hb = ub.h;
+    if ((flags & minmax_ismag) && fabs(ha) != fabs(hb)) {
+        ha = fabs(ha);
+        hb = fabs(hb);
+    }
+    if (ha == hb) {
+        a_less = float64_is_neg(a) && !float64_is_neg(b);
+    } else {
+        a_less = ha < hb;
+    }
+    if (flags & minmax_ismin) {
+        return a_less ? a : b;
+    }
+    return a_less ? b : a;
+}
+
 static float128 float128_minmax(float128 a, float128 b,
                                 float_status *s, int flags)
 {
@@ -63,6 +63,9 @@ void gdb_init_gdbserver_state(void)
     gdbserver_state.str_buf = g_string_new(NULL);
     gdbserver_state.mem_buf = g_byte_array_sized_new(MAX_PACKET_LENGTH);
     gdbserver_state.last_packet = g_byte_array_sized_new(MAX_PACKET_LENGTH + 4);
+    gdbserver_state.reg_cache =
+        g_hash_table_new_full(NULL, NULL, NULL,
+                              (GDestroyNotify)g_ptr_array_unref);
 
     /*
      * What single-step modes are supported is accelerator dependent.
@@ -500,7 +503,7 @@ const GDBFeature *gdb_find_static_feature(const char *xmlname)
     g_assert_not_reached();
 }
 
-static int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
+static int gdb_read_register_uncached(CPUState *cpu, GByteArray *buf, int reg)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
     CPUArchState *env = cpu_env(cpu);
@@ -521,12 +524,64 @@ static int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
     return 0;
 }
 
+/*
+ * Drop all cached register values. Called whenever the guest may have run
+ * or been reset since the values were read.
+ */
+void gdb_reg_cache_invalidate(void)
+{
+    if (gdbserver_state.reg_cache) {
+        g_hash_table_remove_all(gdbserver_state.reg_cache);
+    }
+}
+
+/*
+ * Registers cannot change while the guest is stopped, except through GDB
+ * itself. Cache them so that scripts walking many threads and registers do
+ * not go through the accelerator and the gdb-xml callbacks every time.
+ */
+static int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
+{
+    GPtrArray *regs;
+    GByteArray *val;
+    int len;
+
+    regs = g_hash_table_lookup(gdbserver_state.reg_cache, cpu);
+    if (!regs) {
+        regs = g_ptr_array_new_with_free_func(
+            (GDestroyNotify)g_byte_array_unref);
+        g_hash_table_insert(gdbserver_state.reg_cache, cpu, regs);
+    }
+
+    if (reg < regs->len) {
+        val = g_ptr_array_index(regs, reg);
+        if (val) {
+            g_byte_array_append(buf, val->data, val->len);
+            return val->len;
+        }
+    }
+
+    len = gdb_read_register_uncached(cpu, buf, reg);
+    if (len) {
+        if (reg >= regs->len) {
+            g_ptr_array_set_size(regs, reg + 1);
+        }
+        val = g_byte_array_sized_new(len);
+        g_byte_array_append(val, buf->data + buf->len - len, len);
+        g_ptr_array_index(regs, reg) = val;
+    }
+    return len;
+}
+
 static int gdb_write_register(CPUState *cpu, uint8_t *mem_buf, int reg)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
     CPUArchState *env = cpu_env(cpu);
     GDBRegisterState *r;
 
+    /* Registers can alias each other, forget everything about this CPU */
+    g_hash_table_remove(gdbserver_state.reg_cache, cpu);
+
     if (reg < cc->gdb_num_core_regs) {
         return cc->gdb_write_register(cpu, mem_buf, reg);
     }
@@ -1264,6 +1319,44 @@ static void handle_read_mem(GArray *params, void *user_ctx)
     gdb_put_strbuf();
 }
 
+/*
+ * 'x' reads memory like 'm' but replies in binary, halving the size of the
+ * reply. The reply may be shorter than requested when escaping would
+ * overflow the packet; GDB then asks for the rest.
+ */
+static void handle_read_mem_bin(GArray *params, void *user_ctx)
+{
+    const char *data;
+    guint i;
+
+    if (params->len != 2) {
+        gdb_put_packet("E22");
+        return;
+    }
+
+    g_byte_array_set_size(gdbserver_state.mem_buf,
+                          MIN(get_param(params, 1)->val_ull,
+                              MAX_PACKET_LENGTH - 1));
+
+    if (gdb_target_memory_rw_debug(gdbserver_state.g_cpu,
+                                   get_param(params, 0)->val_ull,
+                                   gdbserver_state.mem_buf->data,
+                                   gdbserver_state.mem_buf->len, false)) {
+        gdb_put_packet("E14");
+        return;
+    }
+
+    data = (const char *)gdbserver_state.mem_buf->data;
+    g_string_assign(gdbserver_state.str_buf, "b");
+    for (i = 0; i < gdbserver_state.mem_buf->len &&
+                gdbserver_state.str_buf->len + 2 <= MAX_PACKET_LENGTH; i++) {
+        gdb_memtox(gdbserver_state.str_buf, data + i, 1);
+    }
+
+    gdb_put_packet_binary(gdbserver_state.str_buf->str,
+                          gdbserver_state.str_buf->len, true);
+}
+
 static void handle_write_all_regs(GArray *params, void *user_ctx)
 {
     int reg_id;
@@ -1626,7 +1719,8 @@ static void handle_query_supported(GArray *params, void *user_ctx)
         gdbserver_state.multiprocess = true;
     }
 
-    g_string_append(gdbserver_state.str_buf, ";vContSupported+;multiprocess+");
+    g_string_append(gdbserver_state.str_buf,
+                    ";vContSupported+;multiprocess+;binary-upload+");
     gdb_put_strbuf();
 }
 
@@ -2007,6 +2101,17 @@ static int gdb_handle_packet(const char *line_buf)
             cmd_parser = &read_mem_cmd_desc;
         }
         break;
+    case 'x':
+        {
+            static const GdbCmdParseEntry read_mem_bin_cmd_desc = {
+                .handler = handle_read_mem_bin,
+                .cmd = "x",
+                .cmd_startswith = 1,
+                .schema = "L,L0"
+            };
+            cmd_parser = &read_mem_bin_cmd_desc;
+        }
+        break;
     case 'M':
         {
             static const GdbCmdParseEntry write_mem_cmd_desc = {
@@ -11,7 +11,11 @@
 
 #include "exec/cpu-common.h"
 
-#define MAX_PACKET_LENGTH 4096
+/*
+ * Advertised to GDB as PacketSize, which bounds 'm' and 'x' replies. Keep
+ * it large so that bulk memory dumps are not round-trip bound.
+ */
+#define MAX_PACKET_LENGTH 0x10000
 
 /*
  * Shared structures and definitions
@@ -63,6 +67,12 @@ typedef struct GDBState {
     int process_num;
     GString *str_buf;
     GByteArray *mem_buf;
+    /*
+     * Register values read since the guest last stopped, keyed by
+     * CPUState. Each value is a GPtrArray of GByteArray indexed by the
+     * GDB register number.
+     */
+    GHashTable *reg_cache;
     int sstep_flags;
     int supported_sstep_flags;
     /*
@@ -112,6 +122,7 @@ void gdb_hextomem(GByteArray *mem, const char *buf, int len);
 void gdb_memtohex(GString *buf, const uint8_t *mem, int len);
 void gdb_memtox(GString *buf, const char *mem, int len);
 void gdb_read_byte(uint8_t ch);
+void gdb_reg_cache_invalidate(void);
 
 /*
  * Packet acknowledgement - we handle this slightly differently
@@ -21,6 +21,7 @@
 #include "sysemu/cpus.h"
 #include "sysemu/runstate.h"
 #include "sysemu/replay.h"
+#include "sysemu/reset.h"
 #include "hw/core/cpu.h"
 #include "hw/cpu/cluster.h"
 #include "hw/boards.h"
@@ -44,6 +45,7 @@ static void reset_gdbserver_state(void)
     gdbserver_state.processes = NULL;
     gdbserver_state.process_num = 0;
     gdbserver_state.allow_stop_reply = false;
+    gdb_reg_cache_invalidate();
 }
 
 /*
@@ -117,6 +119,11 @@ void gdb_syscall_handling(const char *syscall_packet)
     qemu_cpu_kick(gdbserver_state.c_cpu);
 }
 
+static void gdb_system_reset(void *opaque)
+{
+    gdb_reg_cache_invalidate();
+}
+
 static void gdb_vm_state_change(void *opaque, bool running, RunState state)
 {
     CPUState *cpu = gdbserver_state.c_cpu;
@@ -125,6 +132,8 @@ static void gdb_vm_state_change(void *opaque, bool running, RunState state)
     const char *type;
     int ret;
 
+    gdb_reg_cache_invalidate();
+
     if (running || gdbserver_state.state == RS_INACTIVE) {
         return;
     }
@@ -381,6 +390,8 @@ int gdbserver_start(const char *device)
         gdb_init_gdbserver_state();
 
         qemu_add_vm_change_state_handler(gdb_vm_state_change, NULL);
+        /* A reset while stopped changes registers without resuming */
+        qemu_register_reset(gdb_system_reset, NULL);
 
         /* Initialize a monitor terminal for gdb */
         mon_chr = qemu_chardev_new(NULL, TYPE_CHARDEV_GDB,
@@ -130,6 +130,9 @@ int gdb_handlesig(CPUState *cpu, int sig)
         return sig;
     }
 
+    /* The guest has run since the last stop */
+    gdb_reg_cache_invalidate();
+
     /* disable single step if it was enabled */
     cpu_single_step(cpu, 0);
     tb_flush(cpu);
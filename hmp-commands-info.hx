@@ -269,6 +269,21 @@ SRST
     Show dynamic compiler info.
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "jit-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show samples of host time spent in translated code",
+    },
+#endif
+
+SRST
+  ``info jit-profile``
+    Show the host time samples collected by the ``x-jit-profile`` QMP
+    command, in folded stack format.
+ERST
+
 #if defined(CONFIG_TCG)
     {
         .name       = "opcount",
@@ -285,24 +300,27 @@ ERST
 
     {
         .name       = "sync-profile",
-        .args_type  = "mean:-m,no_coalesce:-n,max:i?",
-        .params     = "[-m] [-n] [max]",
+        .args_type  = "mean:-m,no_coalesce:-n,histogram:-h,max:i?",
+        .params     = "[-m] [-n] [-h] [max]",
         .help       = "show synchronization profiling info, up to max entries "
                       "(default: 10), sorted by total wait time. (-m: sort by "
                       "mean wait time; -n: do not coalesce objects with the "
-                      "same call site)",
+                      "same call site; -h: show histograms of wait times)",
         .cmd        = hmp_info_sync_profile,
     },
 
 SRST
-  ``info sync-profile [-m|-n]`` [*max*]
+  ``info sync-profile [-m|-n|-h]`` [*max*]
     Show synchronization profiling info, up to *max* entries (default: 10),
-    sorted by total wait time.
+    sorted by total wait time.  "BQL held" entries show the time for which
+    the BQL was held after being taken at the call site.
 
     ``-m``
       sort by mean wait time
     ``-n``
       do not coalesce objects with the same call site
+    ``-h``
+      also show a histogram of the wait times of each entry
 
     When different objects that share the same call site are coalesced,
     the "Object" field shows---enclosed in brackets---the number of objects
@@ -766,7 +784,22 @@ ERST
 
 SRST
   ``info ramblock``
-    Dump all the ramblocks of the system.
+    Dump all the ramblocks of the system.  On Linux hosts, the Huge column
+    shows how much of each block is backed by huge pages.
+ERST
+
+    {
+        .name       = "startup",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show where the time was spent while starting up",
+        .cmd_info_hrt = qmp_x_query_startup,
+    },
+
+SRST
+  ``info startup``
+    Show when each machine initialization phase was entered and how long
+    realizing each cold-plugged device took.
 ERST
 
     {
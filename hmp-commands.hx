@@ -626,17 +626,20 @@ SRST
 ERST
     {
         .name       = "sync-profile",
-        .args_type  = "op:s?",
-        .params     = "[on|off|reset]",
+        .args_type  = "op:s?,period:i?",
+        .params     = "[on [period]|off|reset]",
         .help       = "enable, disable or reset synchronization profiling. "
+                      "With a period, profile one in every period operations. "
                       "With no arguments, prints whether profiling is on or off.",
         .cmd        = hmp_sync_profile,
     },
 
 SRST
-``sync-profile [on|off|reset]``
+``sync-profile [on [``\ *period*\ ``]|off|reset]``
   Enable, disable or reset synchronization profiling. With no arguments, prints
-  whether profiling is on or off.
+  whether profiling is on or off.  With *period*, only one in every *period*
+  operations is profiled on average, and the results are scaled accordingly;
+  this keeps the overhead low enough to leave profiling on.
 ERST
 
     {
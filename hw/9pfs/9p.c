@@ -23,6 +23,7 @@
 #include <glib/gprintf.h>
 #include "hw/virtio/virtio.h"
 #include "qapi/error.h"
+#include "block/aio-wait.h"
 #include "qemu/error-report.h"
 #include "qemu/iov.h"
 #include "qemu/main-loop.h"
@@ -1022,6 +1023,9 @@ void pdu_free(V9fsPDU *pdu)
     g_assert(!pdu->cancelled);
     QLIST_REMOVE(pdu, next);
     QLIST_INSERT_HEAD(&s->free_list, pdu, next);
+
+    /* The transport may be draining requests from another thread */
+    aio_wait_kick();
 }
 
 static void coroutine_fn pdu_complete(V9fsPDU *pdu, ssize_t len)
@@ -1582,6 +1586,8 @@ static void coroutine_fn v9fs_getattr(void *opaque)
     struct stat stbuf;
     V9fsFidState *fidp;
     uint64_t request_mask;
+    uint64_t st_gen = 0;
+    int gen_err = 0;
     V9fsStatDotl v9stat_dotl;
     V9fsPDU *pdu = opaque;
 
@@ -1598,9 +1604,14 @@ static void coroutine_fn v9fs_getattr(void *opaque)
     }
     /*
      * Currently we only support BASIC fields in stat, so there is no
-     * need to look at request_mask.
+     * need to look at request_mask other than for st_gen.
      */
-    retval = v9fs_co_lstat(pdu, &fidp->path, &stbuf);
+    if (request_mask & P9_STATS_GEN) {
+        retval = v9fs_co_lstat_gen(pdu, &fidp->path, &stbuf, &st_gen,
+                                   &gen_err);
+    } else {
+        retval = v9fs_co_lstat(pdu, &fidp->path, &stbuf);
+    }
     if (retval < 0) {
         goto out;
     }
@@ -1609,21 +1620,13 @@ static void coroutine_fn v9fs_getattr(void *opaque)
         goto out;
     }
 
-    /*  fill st_gen if requested and supported by underlying fs */
-    if (request_mask & P9_STATS_GEN) {
-        retval = v9fs_co_st_gen(pdu, &fidp->path, stbuf.st_mode, &v9stat_dotl);
-        switch (retval) {
-        case 0:
-            /* we have valid st_gen: update result mask */
-            v9stat_dotl.st_result_mask |= P9_STATS_GEN;
-            break;
-        case -EINTR:
-            /* request cancelled, e.g. by Tflush */
-            goto out;
-        default:
-            /* failed to get st_gen: not fatal, ignore */
-            break;
-        }
+    /*
+     * fill st_gen if requested and supported by underlying fs; failing to
+     * get it is not fatal
+     */
+    if ((request_mask & P9_STATS_GEN) && gen_err == 0) {
+        v9stat_dotl.st_gen = st_gen;
+        v9stat_dotl.st_result_mask |= P9_STATS_GEN;
     }
     retval = pdu_marshal(pdu, offset, "A", &v9stat_dotl);
     if (retval < 0) {
@@ -22,27 +22,41 @@
 #include "qemu/main-loop.h"
 #include "coth.h"
 
-int coroutine_fn v9fs_co_st_gen(V9fsPDU *pdu, V9fsPath *path, mode_t st_mode,
-                                V9fsStatDotl *v9stat)
+/*
+ * Like v9fs_co_lstat(), but also get the generation number of @path into
+ * @st_gen within the same trip to the worker thread, which saves a
+ * round-trip on Tgetattr requests that ask for it.  The result of getting
+ * the generation number, which callers may ignore, goes to @gen_err; it is
+ * 0 without touching @st_gen if the fs driver does not support it.
+ */
+int coroutine_fn v9fs_co_lstat_gen(V9fsPDU *pdu, V9fsPath *path,
+                                   struct stat *stbuf, uint64_t *st_gen,
+                                   int *gen_err)
 {
-    int err = 0;
+    int err;
     V9fsState *s = pdu->s;
 
     if (v9fs_request_cancelled(pdu)) {
         return -EINTR;
     }
-    if (s->ctx.exops.get_st_gen) {
-        v9fs_path_read_lock(s);
-        v9fs_co_run_in_worker(
-            {
-                err = s->ctx.exops.get_st_gen(&s->ctx, path, st_mode,
-                                              &v9stat->st_gen);
-                if (err < 0) {
-                    err = -errno;
+    *gen_err = 0;
+    v9fs_path_read_lock(s);
+    v9fs_co_run_in_worker(
+        {
+            err = s->ops->lstat(&s->ctx, path, stbuf);
+            if (err < 0) {
+                err = -errno;
+                break;
+            }
+            if (s->ctx.exops.get_st_gen) {
+                *gen_err = s->ctx.exops.get_st_gen(&s->ctx, path,
+                                                   stbuf->st_mode, st_gen);
+                if (*gen_err < 0) {
+                    *gen_err = -errno;
                 }
-            });
-        v9fs_path_unlock(s);
-    }
+            }
+        });
+    v9fs_path_unlock(s);
     return err;
 }
 
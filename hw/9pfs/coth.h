@@ -16,6 +16,7 @@
 #define QEMU_9P_COTH_H
 
 #include "qemu/thread.h"
+#include "block/aio.h"
 #include "qemu/coroutine-core.h"
 #include "9p.h"
 
@@ -29,6 +30,11 @@
  * we cannot swap step 1 and 2, because that would imply worker thread
  * can enter coroutine while step1 is still running
  *
+ * The QEMU thread is the one whose AioContext processes the request: the
+ * main loop, or the IOThread of a virtio-9p device with an iothread.  The
+ * worker comes from that AioContext's thread pool and the coroutine is
+ * re-entered there once the worker is done.
+ *
  * PERFORMANCE CONSIDERATIONS: As a rule of thumb, keep in mind
  * that hopping between threads adds @b latency! So when handling a
  * 9pfs request, avoid calling v9fs_co_run_in_worker() too often, because
@@ -41,16 +47,14 @@
  */
 #define v9fs_co_run_in_worker(code_block)                               \
     do {                                                                \
-        QEMUBH *co_bh;                                                  \
-        co_bh = qemu_bh_new(co_run_in_worker_bh,                        \
-                            qemu_coroutine_self());                     \
-        qemu_bh_schedule(co_bh);                                        \
+        aio_bh_schedule_oneshot(qemu_get_current_aio_context(),        \
+                                co_run_in_worker_bh,                    \
+                                qemu_coroutine_self());                 \
         /*                                                              \
          * yield in qemu thread and re-enter back                       \
          * in worker thread                                             \
          */                                                             \
         qemu_coroutine_yield();                                         \
-        qemu_bh_delete(co_bh);                                          \
         do {                                                            \
             code_block;                                                 \
         } while (0);                                                    \
@@ -107,7 +111,8 @@ int coroutine_fn v9fs_co_preadv(V9fsPDU *, V9fsFidState *,
                                 struct iovec *, int, int64_t);
 int coroutine_fn v9fs_co_name_to_path(V9fsPDU *, V9fsPath *,
                                       const char *, V9fsPath *);
-int coroutine_fn v9fs_co_st_gen(V9fsPDU *pdu, V9fsPath *path, mode_t,
-                                V9fsStatDotl *v9stat);
+int coroutine_fn v9fs_co_lstat_gen(V9fsPDU *pdu, V9fsPath *path,
+                                   struct stat *stbuf, uint64_t *st_gen,
+                                   int *gen_err);
 
 #endif
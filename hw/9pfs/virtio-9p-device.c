@@ -17,7 +17,10 @@
  */
 
 #include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "block/aio-wait.h"
 #include "hw/virtio/virtio.h"
+#include "hw/virtio/virtio-bus.h"
 #include "qemu/sockets.h"
 #include "virtio-9p.h"
 #include "fsdev/qemu-fsdev.h"
@@ -25,7 +28,9 @@
 #include "hw/qdev-properties.h"
 #include "hw/virtio/virtio-access.h"
 #include "qemu/iov.h"
+#include "qemu/error-report.h"
 #include "qemu/module.h"
+#include "sysemu/iothread.h"
 #include "sysemu/qtest.h"
 
 static void virtio_9p_push_and_notify(V9fsPDU *pdu)
@@ -40,7 +45,11 @@ static void virtio_9p_push_and_notify(V9fsPDU *pdu)
     v->elems[pdu->idx] = NULL;
 
     /* FIXME: we should batch these completions */
-    virtio_notify(VIRTIO_DEVICE(v), v->vq);
+    if (v->ioeventfd_started) {
+        virtio_notify_irqfd(VIRTIO_DEVICE(v), v->vq);
+    } else {
+        virtio_notify(VIRTIO_DEVICE(v), v->vq);
+    }
 }
 
 static void handle_9p_output(VirtIODevice *vdev, VirtQueue *vq)
@@ -117,6 +126,99 @@ static void virtio_9p_reset(VirtIODevice *vdev)
     v9fs_reset(&v->state);
 }
 
+/* Context: BQL held */
+static int virtio_9p_start_ioeventfd(VirtIODevice *vdev)
+{
+    V9fsVirtioState *v = VIRTIO_9P(vdev);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int r;
+
+    if (!v->iothread) {
+        return virtio_device_start_ioeventfd_impl(vdev);
+    }
+
+    /* Set up guest notifier (irq) */
+    r = k->set_guest_notifiers(qbus->parent, 1, true);
+    if (r != 0) {
+        error_report("virtio-9p failed to set guest notifier (%d), "
+                     "ensure -accel kvm is set.", r);
+        return r;
+    }
+
+    /* Set up virtqueue notify */
+    r = virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), 0, true);
+    if (r != 0) {
+        error_report("virtio-9p failed to set host notifier (%d)", r);
+        k->set_guest_notifiers(qbus->parent, 1, false);
+        return r;
+    }
+
+    /*
+     * Must be visible to the IOThread before it processes the virtqueue,
+     * otherwise completions would not go through the irqfd.
+     */
+    v->ioeventfd_started = true;
+    smp_wmb(); /* paired with aio_notify_accept() on the read side */
+
+    /* Kick right away to begin processing requests already in vring */
+    event_notifier_set(virtio_queue_get_host_notifier(v->vq));
+    virtio_queue_aio_attach_host_notifier(v->vq, v->ctx);
+    return 0;
+}
+
+/* Stop notifications for new requests from guest.
+ *
+ * Context: BH in IOThread
+ */
+static void virtio_9p_ioeventfd_stop_bh(void *opaque)
+{
+    VirtQueue *vq = opaque;
+    EventNotifier *host_notifier = virtio_queue_get_host_notifier(vq);
+
+    virtio_queue_aio_detach_host_notifier(vq, qemu_get_current_aio_context());
+
+    /*
+     * Test and clear notifier after disabling event, in case poll callback
+     * didn't have time to run.
+     */
+    virtio_queue_host_notifier_read(host_notifier);
+}
+
+/* Context: BQL held */
+static void virtio_9p_stop_ioeventfd(VirtIODevice *vdev)
+{
+    V9fsVirtioState *v = VIRTIO_9P(vdev);
+    V9fsState *s = &v->state;
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+
+    if (!v->iothread) {
+        virtio_device_stop_ioeventfd_impl(vdev);
+        return;
+    }
+    if (!v->ioeventfd_started) {
+        return;
+    }
+
+    aio_wait_bh_oneshot(v->ctx, virtio_9p_ioeventfd_stop_bh, v->vq);
+
+    virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), 0, false);
+    virtio_bus_cleanup_host_notifier(VIRTIO_BUS(qbus), 0);
+
+    /*
+     * No new requests can arrive now, but those already popped are still
+     * running in the IOThread.  Wait for them before the main loop takes
+     * over the virtqueue; pdu_free() kicks us.
+     */
+    AIO_WAIT_WHILE_UNLOCKED(NULL, !QLIST_EMPTY(&s->active_list));
+
+    v->ioeventfd_started = false;
+
+    /* Clean up guest notifier (irq) */
+    k->set_guest_notifiers(qbus->parent, 1, false);
+}
+
 static ssize_t virtio_pdu_vmarshal(V9fsPDU *pdu, size_t offset,
                                    const char *fmt, va_list ap)
 {
@@ -211,6 +313,27 @@ static void virtio_9p_device_realize(DeviceState *dev, Error **errp)
         fse->export_flags |= V9FS_NO_PERF_WARN;
     }
 
+    if (v->iothread) {
+        BusState *qbus = qdev_get_parent_bus(dev);
+        VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+
+        if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+            error_setg(errp,
+                       "device is incompatible with iothread "
+                       "(transport does not support notifiers)");
+            return;
+        }
+        if (!virtio_device_ioeventfd_enabled(vdev)) {
+            error_setg(errp, "ioeventfd is required for iothread");
+            return;
+        }
+        /* The throttle timers run in the main loop */
+        if (fse && throttle_enabled(&fse->fst.cfg)) {
+            error_setg(errp, "fsdev throttling is not supported with iothread");
+            return;
+        }
+    }
+
     if (v9fs_device_realize_common(s, &virtio_9p_transport, errp)) {
         return;
     }
@@ -218,6 +341,11 @@ static void virtio_9p_device_realize(DeviceState *dev, Error **errp)
     v->config_size = sizeof(struct virtio_9p_config) + strlen(s->fsconf.tag);
     virtio_init(vdev, VIRTIO_ID_9P, v->config_size);
     v->vq = virtio_add_queue(vdev, MAX_REQ, handle_9p_output);
+
+    if (v->iothread) {
+        object_ref(OBJECT(v->iothread));
+        v->ctx = iothread_get_aio_context(v->iothread);
+    }
 }
 
 static void virtio_9p_device_unrealize(DeviceState *dev)
@@ -229,6 +357,9 @@ static void virtio_9p_device_unrealize(DeviceState *dev)
     virtio_delete_queue(v->vq);
     virtio_cleanup(vdev);
     v9fs_device_unrealize_common(s);
+    if (v->iothread) {
+        object_unref(OBJECT(v->iothread));
+    }
 }
 
 /* virtio-9p device */
@@ -246,6 +377,8 @@ static const VMStateDescription vmstate_virtio_9p = {
 static Property virtio_9p_properties[] = {
     DEFINE_PROP_STRING("mount_tag", V9fsVirtioState, state.fsconf.tag),
     DEFINE_PROP_STRING("fsdev", V9fsVirtioState, state.fsconf.fsdev_id),
+    DEFINE_PROP_LINK("iothread", V9fsVirtioState, iothread, TYPE_IOTHREAD,
+                     IOThread *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -262,6 +395,8 @@ static void virtio_9p_class_init(ObjectClass *klass, void *data)
     vdc->get_features = virtio_9p_get_features;
     vdc->get_config = virtio_9p_get_config;
     vdc->reset = virtio_9p_reset;
+    vdc->start_ioeventfd = virtio_9p_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_9p_stop_ioeventfd;
 }
 
 static const TypeInfo virtio_device_info = {
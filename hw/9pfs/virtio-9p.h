@@ -3,6 +3,7 @@
 
 #include "standard-headers/linux/virtio_9p.h"
 #include "hw/virtio/virtio.h"
+#include "sysemu/iothread.h"
 #include "9p.h"
 #include "qom/object.h"
 
@@ -11,6 +12,9 @@ struct V9fsVirtioState {
     VirtQueue *vq;
     size_t config_size;
     VirtQueueElement *elems[MAX_REQ];
+    IOThread *iothread;
+    AioContext *ctx;
+    bool ioeventfd_started;
     V9fsState state;
 };
 
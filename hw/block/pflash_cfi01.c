@@ -90,6 +90,17 @@ struct PFlashCFI01 {
     /* block update buffer */
     unsigned char *blk_bytes;
     uint32_t blk_offset;
+
+    /*
+     * Flash content not yet written back to the block backend.  The range
+     * is empty if dirty_start == dirty_end.  At most one write is in
+     * flight, from a copy of the range taken when it was issued.
+     */
+    uint64_t dirty_start;
+    uint64_t dirty_end;
+    bool update_busy;
+    void *update_buf;
+    QEMUIOVector update_qiov;
 };
 
 static int pflash_post_load(void *opaque, int version_id);
@@ -383,23 +394,71 @@ static uint32_t pflash_read(PFlashCFI01 *pfl, hwaddr offset,
     return ret;
 }
 
-/* update flash content on disk */
+static void pflash_update_kick(PFlashCFI01 *pfl);
+
+static void pflash_update_cb(void *opaque, int ret)
+{
+    PFlashCFI01 *pfl = opaque;
+
+    qemu_vfree(pfl->update_buf);
+    pfl->update_buf = NULL;
+    pfl->update_busy = false;
+
+    if (ret < 0) {
+        /* TODO set error bit in status */
+        error_report("Could not update PFLASH: %s", strerror(-ret));
+    }
+
+    /* Write back whatever the guest programmed in the meantime */
+    pflash_update_kick(pfl);
+}
+
+/* issue the write back of the dirty range unless one is in flight */
+static void pflash_update_kick(PFlashCFI01 *pfl)
+{
+    uint64_t offset = pfl->dirty_start;
+    uint64_t len = pfl->dirty_end - pfl->dirty_start;
+
+    if (pfl->update_busy || !len) {
+        return;
+    }
+
+    pfl->update_buf = blk_blockalign(pfl->blk, len);
+    memcpy(pfl->update_buf, pfl->storage + offset, len);
+    qemu_iovec_init_buf(&pfl->update_qiov, pfl->update_buf, len);
+    pfl->dirty_start = pfl->dirty_end = 0;
+    pfl->update_busy = true;
+
+    blk_aio_pwritev(pfl->blk, offset, &pfl->update_qiov, 0,
+                    pflash_update_cb, pfl);
+}
+
+/*
+ * update flash content on disk
+ *
+ * The guest does not wait for the write: storage stays authoritative and
+ * updates that arrive while a write is in flight are merged into a single
+ * follow-up write.  Draining the backend, as done when the VM stops or
+ * QEMU exits, waits for the whole chain to complete.
+ */
 static void pflash_update(PFlashCFI01 *pfl, int offset,
                           int size)
 {
-    int offset_end;
-    int ret;
+    uint64_t offset_end;
+
     if (pfl->blk) {
         offset_end = offset + size;
         /* widen to sector boundaries */
         offset = QEMU_ALIGN_DOWN(offset, BDRV_SECTOR_SIZE);
         offset_end = QEMU_ALIGN_UP(offset_end, BDRV_SECTOR_SIZE);
-        ret = blk_pwrite(pfl->blk, offset, offset_end - offset,
-                         pfl->storage + offset, 0);
-        if (ret < 0) {
-            /* TODO set error bit in status */
-            error_report("Could not update PFLASH: %s", strerror(-ret));
+        if (pfl->dirty_start == pfl->dirty_end) {
+            pfl->dirty_start = offset;
+            pfl->dirty_end = offset_end;
+        } else {
+            pfl->dirty_start = MIN(pfl->dirty_start, offset);
+            pfl->dirty_end = MAX(pfl->dirty_end, offset_end);
         }
+        pflash_update_kick(pfl);
     }
 }
 
@@ -843,6 +902,12 @@ static void pflash_cfi01_realize(DeviceState *dev, Error **errp)
         if (ret < 0) {
             return;
         }
+        /*
+         * pflash_update_cb() issues the next write back from the completion
+         * of the previous one, which must not wait for the drain that is
+         * waiting for it.
+         */
+        blk_set_disable_request_queuing(pfl->blk, true);
     } else {
         pfl->ro = false;
     }
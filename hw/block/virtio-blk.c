@@ -46,6 +46,22 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
     req->in_len = 0;
     req->next = NULL;
     req->mr_next = NULL;
+    req->pop_ns = trace_event_get_state_backends(TRACE_VIRTIO_BLK_REQ_LATENCY) ?
+                  qemu_clock_get_ns(QEMU_CLOCK_REALTIME) : 0;
+    req->submit_ns = 0;
+}
+
+/* Record when @req and the requests merged into it reach the block layer */
+static void virtio_blk_req_submitted(VirtIOBlockReq *req)
+{
+    int64_t now_ns = 0;
+
+    for (; req; req = req->mr_next) {
+        if (req->pop_ns) {
+            now_ns = now_ns ?: qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+            req->submit_ns = now_ns;
+        }
+    }
 }
 
 static void virtio_blk_free_request(VirtIOBlockReq *req)
@@ -69,6 +85,20 @@ static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
     } else {
         virtio_notify(vdev, req->vq);
     }
+
+    if (req->pop_ns) {
+        int64_t now_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        int64_t submit_ns = req->submit_ns ?: now_ns;
+
+        /*
+         * Split the time since the request was popped into the part spent
+         * in the device before it was submitted (parsing, merging, waiting
+         * for the batch) and the part from submission to guest notification.
+         */
+        trace_virtio_blk_req_latency(vdev, req, req->elem.index,
+                                     submit_ns - req->pop_ns,
+                                     now_ns - submit_ns);
+    }
 }
 
 static int virtio_blk_handle_rw_error(VirtIOBlockReq *req, int error,
@@ -221,14 +251,17 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
+static unsigned int virtio_blk_get_requests(VirtIOBlock *s, VirtQueue *vq,
+                                            VirtIOBlockReq **reqs,
+                                            unsigned int num)
 {
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
+    unsigned int i, n;
 
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
+    n = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq), (void **)reqs, num);
+    for (i = 0; i < n; i++) {
+        virtio_blk_init_request(s, vq, reqs[i]);
     }
-    return req;
+    return n;
 }
 
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
@@ -320,6 +353,7 @@ static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
     ioctl_req->hdr.sbp = elem->in_sg[elem->in_num - 3].iov_base;
     ioctl_req->hdr.mx_sb_len = elem->in_sg[elem->in_num - 3].iov_len;
 
+    virtio_blk_req_submitted(req);
     acb = blk_aio_ioctl(blk->blk, SG_IO, &ioctl_req->hdr,
                         virtio_blk_ioctl_complete, ioctl_req);
     if (!acb) {
@@ -393,6 +427,7 @@ static inline void submit_requests(VirtIOBlock *s, MultiReqBuffer *mrb,
         flags |= BDRV_REQ_REGISTERED_BUF;
     }
 
+    virtio_blk_req_submitted(mrb->reqs[start]);
     if (is_write) {
         blk_aio_pwritev(blk, sector_num << BDRV_SECTOR_BITS, qiov,
                         flags, virtio_blk_rw_complete,
@@ -486,6 +521,7 @@ static void virtio_blk_handle_flush(VirtIOBlockReq *req, MultiReqBuffer *mrb)
     if (mrb->is_write && mrb->num_reqs > 0) {
         virtio_blk_submit_multireq(s, mrb);
     }
+    virtio_blk_req_submitted(req);
     blk_aio_flush(s->blk, virtio_blk_flush_complete, req);
 }
 
@@ -563,6 +599,7 @@ static uint8_t virtio_blk_handle_discard_write_zeroes(VirtIOBlockReq *req,
         block_acct_start(blk_get_stats(s->blk), &req->acct, bytes,
                          BLOCK_ACCT_WRITE);
 
+        virtio_blk_req_submitted(req);
         blk_aio_pwrite_zeroes(s->blk, sector << BDRV_SECTOR_BITS,
                               bytes, blk_aio_flags,
                               virtio_blk_discard_write_zeroes_complete, req);
@@ -576,6 +613,7 @@ static uint8_t virtio_blk_handle_discard_write_zeroes(VirtIOBlockReq *req,
             goto err;
         }
 
+        virtio_blk_req_submitted(req);
         blk_aio_pdiscard(s->blk, sector << BDRV_SECTOR_BITS, bytes,
                          virtio_blk_discard_write_zeroes_complete, req);
     }
@@ -788,6 +826,7 @@ static void virtio_blk_handle_zone_report(VirtIOBlockReq *req,
     data->zone_report_data.nr_zones = nr_zones;
     data->zone_report_data.zones = g_malloc(zone_size),
 
+    virtio_blk_req_submitted(req);
     blk_aio_zone_report(s->blk, offset, &data->zone_report_data.nr_zones,
                         data->zone_report_data.zones,
                         virtio_blk_zone_report_complete, data);
@@ -846,6 +885,7 @@ static int virtio_blk_handle_zone_mgmt(VirtIOBlockReq *req, BlockZoneOp op)
         goto out;
     }
 
+    virtio_blk_req_submitted(req);
     blk_aio_zone_mgmt(s->blk, op, offset, len,
                       virtio_blk_zone_mgmt_complete, req);
 
@@ -914,6 +954,7 @@ static int virtio_blk_handle_zone_append(VirtIOBlockReq *req,
     block_acct_start(blk_get_stats(s->blk), &req->acct, len,
                      BLOCK_ACCT_ZONE_APPEND);
 
+    virtio_blk_req_submitted(req);
     blk_aio_zone_append(s->blk, &data->zone_append_data.offset, &req->qiov, 0,
                         virtio_blk_zone_append_complete, data);
     return 0;
@@ -1106,7 +1147,8 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i, n;
     MultiReqBuffer mrb = {};
     bool suppress_notifications = virtio_queue_get_notification(vq);
 
@@ -1117,10 +1159,18 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+        while ((n = virtio_blk_get_requests(s, vq, reqs, ARRAY_SIZE(reqs)))) {
+            for (i = 0; i < n; i++) {
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    break;
+                }
+            }
+            if (i < n) {
+                /* The device is broken, drop the rest of the batch */
+                for (; i < n; i++) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                }
                 break;
             }
         }
@@ -1485,68 +1535,6 @@ static int virtio_blk_load_device(VirtIODevice *vdev, QEMUFile *f,
     return 0;
 }
 
-static bool
-validate_iothread_vq_mapping_list(IOThreadVirtQueueMappingList *list,
-        uint16_t num_queues, Error **errp)
-{
-    g_autofree unsigned long *vqs = bitmap_new(num_queues);
-    g_autoptr(GHashTable) iothreads =
-        g_hash_table_new(g_str_hash, g_str_equal);
-
-    for (IOThreadVirtQueueMappingList *node = list; node; node = node->next) {
-        const char *name = node->value->iothread;
-        uint16List *vq;
-
-        if (!iothread_by_id(name)) {
-            error_setg(errp, "IOThread \"%s\" object does not exist", name);
-            return false;
-        }
-
-        if (!g_hash_table_add(iothreads, (gpointer)name)) {
-            error_setg(errp,
-                    "duplicate IOThread name \"%s\" in iothread-vq-mapping",
-                    name);
-            return false;
-        }
-
-        if (node != list) {
-            if (!!node->value->vqs != !!list->value->vqs) {
-                error_setg(errp, "either all items in iothread-vq-mapping "
-                                 "must have vqs or none of them must have it");
-                return false;
-            }
-        }
-
-        for (vq = node->value->vqs; vq; vq = vq->next) {
-            if (vq->value >= num_queues) {
-                error_setg(errp, "vq index %u for IOThread \"%s\" must be "
-                        "less than num_queues %u in iothread-vq-mapping",
-                        vq->value, name, num_queues);
-                return false;
-            }
-
-            if (test_and_set_bit(vq->value, vqs)) {
-                error_setg(errp, "cannot assign vq %u to IOThread \"%s\" "
-                        "because it is already assigned", vq->value, name);
-                return false;
-            }
-        }
-    }
-
-    if (list->value->vqs) {
-        for (uint16_t i = 0; i < num_queues; i++) {
-            if (!test_bit(i, vqs)) {
-                error_setg(errp,
-                        "missing vq %u IOThread assignment in iothread-vq-mapping",
-                        i);
-                return false;
-            }
-        }
-    }
-
-    return true;
-}
-
 static void virtio_resize_cb(void *opaque)
 {
     VirtIODevice *vdev = opaque;
@@ -1613,45 +1601,6 @@ static const BlockDevOps virtio_block_ops = {
     .drained_end   = virtio_blk_drained_end,
 };
 
-/* Generate vq:AioContext mappings from a validated iothread-vq-mapping list */
-static void
-apply_vq_mapping(IOThreadVirtQueueMappingList *iothread_vq_mapping_list,
-                 AioContext **vq_aio_context, uint16_t num_queues)
-{
-    IOThreadVirtQueueMappingList *node;
-    size_t num_iothreads = 0;
-    size_t cur_iothread = 0;
-
-    for (node = iothread_vq_mapping_list; node; node = node->next) {
-        num_iothreads++;
-    }
-
-    for (node = iothread_vq_mapping_list; node; node = node->next) {
-        IOThread *iothread = iothread_by_id(node->value->iothread);
-        AioContext *ctx = iothread_get_aio_context(iothread);
-
-        /* Released in virtio_blk_vq_aio_context_cleanup() */
-        object_ref(OBJECT(iothread));
-
-        if (node->value->vqs) {
-            uint16List *vq;
-
-            /* Explicit vq:IOThread assignment */
-            for (vq = node->value->vqs; vq; vq = vq->next) {
-                vq_aio_context[vq->value] = ctx;
-            }
-        } else {
-            /* Round-robin vq:IOThread assignment */
-            for (unsigned i = cur_iothread; i < num_queues;
-                 i += num_iothreads) {
-                vq_aio_context[i] = ctx;
-            }
-        }
-
-        cur_iothread++;
-    }
-}
-
 /* Context: BQL held */
 static bool virtio_blk_vq_aio_context_init(VirtIOBlock *s, Error **errp)
 {
@@ -1685,8 +1634,8 @@ static bool virtio_blk_vq_aio_context_init(VirtIOBlock *s, Error **errp)
     s->vq_aio_context = g_new(AioContext *, conf->num_queues);
 
     if (conf->iothread_vq_mapping_list) {
-        apply_vq_mapping(conf->iothread_vq_mapping_list, s->vq_aio_context,
-                         conf->num_queues);
+        iothread_vq_mapping_apply(conf->iothread_vq_mapping_list,
+                                  s->vq_aio_context, conf->num_queues);
     } else if (conf->iothread) {
         AioContext *ctx = iothread_get_aio_context(conf->iothread);
         for (unsigned i = 0; i < conf->num_queues; i++) {
@@ -1713,12 +1662,7 @@ static void virtio_blk_vq_aio_context_cleanup(VirtIOBlock *s)
     assert(!s->ioeventfd_started);
 
     if (conf->iothread_vq_mapping_list) {
-        IOThreadVirtQueueMappingList *node;
-
-        for (node = conf->iothread_vq_mapping_list; node; node = node->next) {
-            IOThread *iothread = iothread_by_id(node->value->iothread);
-            object_unref(OBJECT(iothread));
-        }
+        iothread_vq_mapping_cleanup(conf->iothread_vq_mapping_list);
     }
 
     if (conf->iothread) {
@@ -2003,8 +1947,8 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
             return;
         }
 
-        if (!validate_iothread_vq_mapping_list(conf->iothread_vq_mapping_list,
-                                               conf->num_queues, errp)) {
+        if (!iothread_vq_mapping_validate(conf->iothread_vq_mapping_list,
+                                          conf->num_queues, errp)) {
             return;
         }
     }
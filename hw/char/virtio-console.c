@@ -13,6 +13,7 @@
 #include "qemu/osdep.h"
 #include "chardev/char-fe.h"
 #include "qemu/error-report.h"
+#include "qemu/iov.h"
 #include "qemu/module.h"
 #include "trace.h"
 #include "hw/qdev-properties.h"
@@ -48,19 +49,12 @@ static gboolean chr_write_unblocked(void *do_not_use, GIOCondition cond,
     return G_SOURCE_REMOVE;
 }
 
-/* Callback function that's called when the guest sends us data */
-static ssize_t flush_buf(VirtIOSerialPort *port,
-                         const uint8_t *buf, ssize_t len)
+/* Handle the result @ret of writing @len bytes to the backend */
+static ssize_t flush_buf_done(VirtIOSerialPort *port, ssize_t len,
+                              ssize_t ret)
 {
     VirtConsole *vcon = VIRTIO_CONSOLE(port);
-    ssize_t ret;
-
-    if (!qemu_chr_fe_backend_connected(&vcon->chr)) {
-        /* If there's no backend, we can just say we consumed all data. */
-        return len;
-    }
 
-    ret = qemu_chr_fe_write(&vcon->chr, buf, len);
     trace_virtio_console_flush_buf(port->id, len, ret);
 
     if (ret < len) {
@@ -107,6 +101,35 @@ static ssize_t flush_buf(VirtIOSerialPort *port,
     return ret;
 }
 
+/* Callback function that's called when the guest sends us data */
+static ssize_t flush_buf(VirtIOSerialPort *port,
+                         const uint8_t *buf, ssize_t len)
+{
+    VirtConsole *vcon = VIRTIO_CONSOLE(port);
+
+    if (!qemu_chr_fe_backend_connected(&vcon->chr)) {
+        /* If there's no backend, we can just say we consumed all data. */
+        return len;
+    }
+
+    return flush_buf_done(port, len, qemu_chr_fe_write(&vcon->chr, buf, len));
+}
+
+/* Same as flush_buf, for all buffers of a virtqueue element at once */
+static ssize_t flush_buf_iov(VirtIOSerialPort *port,
+                             const struct iovec *iov, unsigned int iovcnt)
+{
+    VirtConsole *vcon = VIRTIO_CONSOLE(port);
+    ssize_t len = iov_size(iov, iovcnt);
+
+    if (!qemu_chr_fe_backend_connected(&vcon->chr)) {
+        return len;
+    }
+
+    return flush_buf_done(port, len,
+                          qemu_chr_fe_writev(&vcon->chr, iov, iovcnt));
+}
+
 /* Callback function that's called when the guest opens/closes the port */
 static void set_guest_connected(VirtIOSerialPort *port, int guest_connected)
 {
@@ -287,6 +310,7 @@ static void virtserialport_class_init(ObjectClass *klass, void *data)
     k->realize = virtconsole_realize;
     k->unrealize = virtconsole_unrealize;
     k->have_data = flush_buf;
+    k->have_data_iov = flush_buf_iov;
     k->set_guest_connected = set_guest_connected;
     k->enable_backend = virtconsole_enable_backend;
     k->guest_writable = guest_writable;
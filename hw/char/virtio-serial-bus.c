@@ -32,6 +32,9 @@
 #include "hw/virtio/virtio-serial.h"
 #include "hw/virtio/virtio-access.h"
 
+/* Number of buffers passed to have_data_iov at once */
+#define VIRTIO_SERIAL_IOV_BATCH 64
+
 static struct VirtIOSerialDevices {
     QLIST_HEAD(, VirtIOSerial) devices;
 } vserdevices;
@@ -157,6 +160,59 @@ static void discard_throttle_data(VirtIOSerialPort *port)
     }
 }
 
+/* Advance the position of @port in its current element by @len bytes */
+static void port_elem_advance(VirtIOSerialPort *port, size_t len)
+{
+    while (len && port->iov_idx < port->elem->out_num) {
+        size_t left = port->elem->out_sg[port->iov_idx].iov_len -
+                      port->iov_offset;
+
+        if (len < left) {
+            port->iov_offset += len;
+            return;
+        }
+        len -= left;
+        port->iov_idx++;
+        port->iov_offset = 0;
+    }
+}
+
+/*
+ * Pass the rest of the current element to the port in batches of up to
+ * VIRTIO_SERIAL_IOV_BATCH buffers.  Return false if the port got
+ * disconnected meanwhile.
+ */
+static bool flush_elem_iov(VirtIOSerialPort *port, VirtIOSerialPortClass *vsc)
+{
+    struct iovec iov[VIRTIO_SERIAL_IOV_BATCH];
+
+    while (!port->throttled) {
+        unsigned int cnt;
+        size_t size;
+        ssize_t ret;
+
+        cnt = iov_copy(iov, ARRAY_SIZE(iov),
+                       port->elem->out_sg + port->iov_idx,
+                       port->elem->out_num - port->iov_idx,
+                       port->iov_offset, SIZE_MAX);
+        size = iov_size(iov, cnt);
+        if (!size) {
+            break;
+        }
+
+        ret = vsc->have_data_iov(port, iov, cnt);
+        if (!port->elem) { /* bail if we got disconnected */
+            return false;
+        }
+        if (port->throttled) {
+            port_elem_advance(port, MAX(ret, 0));
+        } else {
+            port_elem_advance(port, size);
+        }
+    }
+    return true;
+}
+
 static void do_flush_queued_data(VirtIOSerialPort *port, VirtQueue *vq,
                                  VirtIODevice *vdev)
 {
@@ -180,6 +236,19 @@ static void do_flush_queued_data(VirtIOSerialPort *port, VirtQueue *vq,
             port->iov_offset = 0;
         }
 
+        if (vsc->have_data_iov) {
+            if (!flush_elem_iov(port, vsc)) {
+                return;
+            }
+            if (port->throttled) {
+                break;
+            }
+            virtqueue_push(vq, port->elem, 0);
+            g_free(port->elem);
+            port->elem = NULL;
+            continue;
+        }
+
         for (i = port->iov_idx; i < port->elem->out_num; i++) {
             size_t buf_size;
             ssize_t ret;
@@ -251,9 +251,8 @@ static void cpu_common_initfn(Object *obj)
     cpu->nr_threads = 1;
     cpu->cflags_next_tb = -1;
 
-    qemu_mutex_init(&cpu->work_mutex);
     qemu_lockcnt_init(&cpu->in_ioctl_lock);
-    QSIMPLEQ_INIT(&cpu->work_list);
+    QSLIST_INIT(&cpu->work_list);
     QTAILQ_INIT(&cpu->breakpoints);
     QTAILQ_INIT(&cpu->watchpoints);
 
@@ -265,7 +264,6 @@ static void cpu_common_finalize(Object *obj)
     CPUState *cpu = CPU(obj);
 
     qemu_lockcnt_destroy(&cpu->in_ioctl_lock);
-    qemu_mutex_destroy(&cpu->work_mutex);
 }
 
 static int64_t cpu_common_get_arch_id(CPUState *cpu)
@@ -330,6 +330,13 @@ HumanReadableText *qmp_x_query_ramblock(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+HumanReadableText *qmp_x_query_startup(Error **errp)
+{
+    g_autoptr(GString) buf = phase_timing_format();
+
+    return human_readable_text_from_str(buf);
+}
+
 static int qmp_x_query_irq_foreach(Object *obj, void *opaque)
 {
     InterruptStatsProvider *intc;
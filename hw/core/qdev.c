@@ -467,6 +467,45 @@ static bool check_only_migratable(Object *obj, Error **errp)
     return true;
 }
 
+typedef struct RealizeTime {
+    char *type;
+    char *name;
+    int64_t us;
+} RealizeTime;
+
+/* Realize time of devices that were created before PHASE_MACHINE_READY */
+static GArray *cold_plug_realize_times;
+
+/* Bumped whenever a device is plugged or unplugged at runtime */
+static uint64_t topology_generation;
+
+uint64_t qdev_topology_generation(void)
+{
+    return topology_generation;
+}
+
+static void device_realize_timed(DeviceState *dev, int64_t start_us)
+{
+    int64_t us = g_get_monotonic_time() - start_us;
+    RealizeTime t;
+
+    trace_qdev_realize(object_get_typename(OBJECT(dev)),
+                       dev->canonical_path, us);
+
+    if (phase_check(PHASE_MACHINE_READY)) {
+        topology_generation++;
+        return;
+    }
+    if (!cold_plug_realize_times) {
+        cold_plug_realize_times = g_array_new(false, false,
+                                              sizeof(RealizeTime));
+    }
+    t.type = g_strdup(object_get_typename(OBJECT(dev)));
+    t.name = qdev_get_human_name(dev);
+    t.us = us;
+    g_array_append_val(cold_plug_realize_times, t);
+}
+
 static void device_set_realized(Object *obj, bool value, Error **errp)
 {
     DeviceState *dev = DEVICE(obj);
@@ -477,6 +516,7 @@ static void device_set_realized(Object *obj, bool value, Error **errp)
     Error *local_err = NULL;
     bool unattached_parent = false;
     static int unattached_count;
+    int64_t start_us = g_get_monotonic_time();
 
     if (dev->hotplugged && !dc->hotpluggable) {
         error_setg(errp, QERR_DEVICE_NO_HOTPLUG, object_get_typename(obj));
@@ -571,6 +611,7 @@ static void device_set_realized(Object *obj, bool value, Error **errp)
        }
 
        qatomic_store_release(&dev->realized, value);
+       device_realize_timed(dev, start_us);
 
     } else if (!value && dev->realized) {
 
@@ -600,6 +641,9 @@ static void device_set_realized(Object *obj, bool value, Error **errp)
         }
         dev->pending_deleted_event = true;
         DEVICE_LISTENER_CALL(unrealize, Reverse, dev);
+        if (phase_check(PHASE_MACHINE_READY)) {
+            topology_generation++;
+        }
     }
 
     assert(local_err == NULL);
@@ -889,6 +933,23 @@ char *qdev_get_human_name(DeviceState *dev)
 
 static MachineInitPhase machine_phase;
 
+static const char *const phase_names[] = {
+    [PHASE_NO_MACHINE] = "process-start",
+    [PHASE_MACHINE_CREATED] = "machine-created",
+    [PHASE_ACCEL_CREATED] = "accel-created",
+    [PHASE_LATE_BACKENDS_CREATED] = "late-backends-created",
+    [PHASE_MACHINE_INITIALIZED] = "machine-initialized",
+    [PHASE_MACHINE_READY] = "machine-ready",
+};
+
+/* Monotonic time in microseconds at which each phase was entered */
+static int64_t phase_start_us[PHASE_MACHINE_READY + 1];
+
+static void __attribute__((__constructor__)) phase_timing_init(void)
+{
+    phase_start_us[PHASE_NO_MACHINE] = g_get_monotonic_time();
+}
+
 bool phase_check(MachineInitPhase phase)
 {
     return machine_phase >= phase;
@@ -898,6 +959,45 @@ void phase_advance(MachineInitPhase phase)
 {
     assert(machine_phase == phase - 1);
     machine_phase = phase;
+    phase_start_us[phase] = g_get_monotonic_time();
+    trace_phase_advance(phase_names[phase],
+                        phase_start_us[phase] -
+                        phase_start_us[PHASE_NO_MACHINE]);
+}
+
+GString *phase_timing_format(void)
+{
+    GString *buf = g_string_new("");
+    int64_t start = phase_start_us[PHASE_NO_MACHINE];
+    int64_t prev = start;
+    MachineInitPhase phase;
+    guint i;
+
+    g_string_append_printf(buf, "%-24s %12s %12s\n",
+                           "phase", "elapsed-ms", "delta-ms");
+    for (phase = PHASE_MACHINE_CREATED; phase <= machine_phase; phase++) {
+        g_string_append_printf(buf, "%-24s %12.3f %12.3f\n",
+                               phase_names[phase],
+                               (phase_start_us[phase] - start) / 1000.0,
+                               (phase_start_us[phase] - prev) / 1000.0);
+        prev = phase_start_us[phase];
+    }
+
+    if (!cold_plug_realize_times) {
+        return buf;
+    }
+
+    /* Parents include the time spent realizing the devices on their buses */
+    g_string_append_printf(buf, "\n%12s  %s\n", "realize-ms", "device");
+    for (i = 0; i < cold_plug_realize_times->len; i++) {
+        RealizeTime *t = &g_array_index(cold_plug_realize_times,
+                                        RealizeTime, i);
+
+        g_string_append_printf(buf, "%12.3f  %s (%s)\n",
+                               t->us / 1000.0, t->name, t->type);
+    }
+
+    return buf;
 }
 
 static const TypeInfo device_type_info = {
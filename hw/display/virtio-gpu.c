@@ -177,7 +177,12 @@ void virtio_gpu_ctrl_response(VirtIOGPU *g,
                       __func__, s, resp_len);
     }
     virtqueue_push(cmd->vq, &cmd->elem, s);
-    virtio_notify(VIRTIO_DEVICE(g), cmd->vq);
+    if (g->processing_cmdq) {
+        /* virtio_gpu_process_cmdq() notifies once for the whole batch */
+        g->cmdq_notify_vq = cmd->vq;
+    } else {
+        virtio_notify(VIRTIO_DEVICE(g), cmd->vq);
+    }
     cmd->finished = true;
 }
 
@@ -481,11 +486,26 @@ static void virtio_gpu_transfer_to_host_2d(VirtIOGPU *g,
     img_data = pixman_image_get_data(res->image);
 
     if (t2d.r.x || t2d.r.width != pixman_image_get_width(res->image)) {
+        /*
+         * The backing store is usually made of one entry per guest page,
+         * so do not search it from the start for every line: lines are
+         * copied in increasing source order, so resume from the entry
+         * that held the previous line.
+         */
+        unsigned int iov_idx = 0;
+        size_t iov_base = 0;
+
         for (h = 0; h < t2d.r.height; h++) {
             src_offset = t2d.offset + stride * h;
             dst_offset = (t2d.r.y + h) * stride + (t2d.r.x * bpp);
 
-            iov_to_buf(res->iov, res->iov_cnt, src_offset,
+            while (iov_idx < res->iov_cnt &&
+                   iov_base + res->iov[iov_idx].iov_len <= src_offset) {
+                iov_base += res->iov[iov_idx].iov_len;
+                iov_idx++;
+            }
+            iov_to_buf(res->iov + iov_idx, res->iov_cnt - iov_idx,
+                       src_offset - iov_base,
                        (uint8_t *)img_data + dst_offset,
                        t2d.r.width * bpp);
         }
@@ -1068,6 +1088,11 @@ void virtio_gpu_process_cmdq(VirtIOGPU *g)
         }
     }
     g->processing_cmdq = false;
+
+    if (g->cmdq_notify_vq) {
+        virtio_notify(VIRTIO_DEVICE(g), g->cmdq_notify_vq);
+        g->cmdq_notify_vq = NULL;
+    }
 }
 
 static void virtio_gpu_process_fenceq(VirtIOGPU *g)
@@ -1129,6 +1154,7 @@ static void virtio_gpu_handle_cursor(VirtIODevice *vdev, VirtQueue *vq)
     VirtQueueElement *elem;
     size_t s;
     struct virtio_gpu_update_cursor cursor_info;
+    bool notify = false;
 
     if (!virtio_queue_ready(vq)) {
         return;
@@ -1150,9 +1176,12 @@ static void virtio_gpu_handle_cursor(VirtIODevice *vdev, VirtQueue *vq)
             update_cursor(g, &cursor_info);
         }
         virtqueue_push(vq, elem, 0);
-        virtio_notify(vdev, vq);
+        notify = true;
         g_free(elem);
     }
+    if (notify) {
+        virtio_notify(vdev, vq);
+    }
 }
 
 static void virtio_gpu_cursor_bh(void *opaque)
@@ -78,6 +78,7 @@
 #include "hw/acpi/viot.h"
 
 #include CONFIG_DEVICES
+#include "trace.h"
 
 /* These are used to size the ACPI tables for -M pc-i440fx-1.7 and
  * -M pc-i440fx-2.0.  Even if the actual amount of AML generated grows
@@ -2435,6 +2436,8 @@ struct AcpiBuildState {
     MemoryRegion *table_mr;
     /* Is table patched? */
     uint8_t patched;
+    /* acpi_build_key() of the exposed tables, NULL if unknown */
+    GByteArray *key;
     void *rsdp;
     MemoryRegion *rsdp_mr;
     MemoryRegion *linker_mr;
@@ -2487,6 +2490,7 @@ void acpi_build(AcpiBuildTables *tables, MachineState *machine)
     Object *vmgenid_dev;
     char *oem_id;
     char *oem_table_id;
+    int64_t start_us = g_get_monotonic_time();
 
     acpi_get_pm_info(machine, &pm);
     acpi_get_misc_info(&misc);
@@ -2720,6 +2724,133 @@ void acpi_build(AcpiBuildTables *tables, MachineState *machine)
     g_array_free(table_offsets, true);
     g_free(slic_oem.id);
     g_free(slic_oem.table_id);
+
+    trace_acpi_build(tables_blob->len, g_get_monotonic_time() - start_us);
+}
+
+/*
+ * Keys are compared bytewise, so structures are added one field at a time
+ * rather than with their padding.
+ */
+#define ACPI_BUILD_KEY_ADD(key, field) \
+    g_byte_array_append(key, (const guint8 *)&(field), sizeof(field))
+
+static void acpi_build_key_add_gas(GByteArray *key,
+                                   const struct AcpiGenericAddress *gas)
+{
+    ACPI_BUILD_KEY_ADD(key, gas->space_id);
+    ACPI_BUILD_KEY_ADD(key, gas->bit_width);
+    ACPI_BUILD_KEY_ADD(key, gas->bit_offset);
+    ACPI_BUILD_KEY_ADD(key, gas->access_width);
+    ACPI_BUILD_KEY_ADD(key, gas->address);
+}
+
+/* The table offset pointers are only filled in while building */
+static void acpi_build_key_add_pm(GByteArray *key, const AcpiPmInfo *pm)
+{
+    const AcpiFadtData *fadt = &pm->fadt;
+
+    ACPI_BUILD_KEY_ADD(key, pm->s3_disabled);
+    ACPI_BUILD_KEY_ADD(key, pm->s4_disabled);
+    ACPI_BUILD_KEY_ADD(key, pm->pcihp_bridge_en);
+    ACPI_BUILD_KEY_ADD(key, pm->smi_on_cpuhp);
+    ACPI_BUILD_KEY_ADD(key, pm->smi_on_cpu_unplug);
+    ACPI_BUILD_KEY_ADD(key, pm->pcihp_root_en);
+    ACPI_BUILD_KEY_ADD(key, pm->s4_val);
+    ACPI_BUILD_KEY_ADD(key, pm->cpu_hp_io_base);
+    ACPI_BUILD_KEY_ADD(key, pm->pcihp_io_base);
+    ACPI_BUILD_KEY_ADD(key, pm->pcihp_io_len);
+
+    acpi_build_key_add_gas(key, &fadt->pm1a_cnt);
+    acpi_build_key_add_gas(key, &fadt->pm1a_evt);
+    acpi_build_key_add_gas(key, &fadt->pm_tmr);
+    acpi_build_key_add_gas(key, &fadt->gpe0_blk);
+    acpi_build_key_add_gas(key, &fadt->reset_reg);
+    acpi_build_key_add_gas(key, &fadt->sleep_ctl);
+    acpi_build_key_add_gas(key, &fadt->sleep_sts);
+    ACPI_BUILD_KEY_ADD(key, fadt->reset_val);
+    ACPI_BUILD_KEY_ADD(key, fadt->rev);
+    ACPI_BUILD_KEY_ADD(key, fadt->flags);
+    ACPI_BUILD_KEY_ADD(key, fadt->smi_cmd);
+    ACPI_BUILD_KEY_ADD(key, fadt->sci_int);
+    ACPI_BUILD_KEY_ADD(key, fadt->int_model);
+    ACPI_BUILD_KEY_ADD(key, fadt->acpi_enable_cmd);
+    ACPI_BUILD_KEY_ADD(key, fadt->acpi_disable_cmd);
+    ACPI_BUILD_KEY_ADD(key, fadt->rtc_century);
+    ACPI_BUILD_KEY_ADD(key, fadt->plvl2_lat);
+    ACPI_BUILD_KEY_ADD(key, fadt->plvl3_lat);
+    ACPI_BUILD_KEY_ADD(key, fadt->arm_boot_arch);
+    ACPI_BUILD_KEY_ADD(key, fadt->iapc_boot_arch);
+    ACPI_BUILD_KEY_ADD(key, fadt->minor_ver);
+}
+
+static void acpi_build_key_add_device(PCIBus *bus, PCIDevice *dev,
+                                      void *opaque)
+{
+    GByteArray *key = opaque;
+    uint8_t id[2] = { pci_dev_bus_num(dev), dev->devfn };
+    int i;
+
+    g_byte_array_append(key, id, sizeof(id));
+    g_byte_array_append(key, dev->config + PCI_COMMAND, 2);
+    for (i = 0; i < PCI_NUM_REGIONS; i++) {
+        if (dev->io_regions[i].size) {
+            ACPI_BUILD_KEY_ADD(key, dev->io_regions[i].addr);
+        }
+    }
+    if (IS_PCI_BRIDGE(dev)) {
+        /* Bus numbers and forwarding windows */
+        g_byte_array_append(key, dev->config + PCI_PRIMARY_BUS,
+                            PCI_CAPABILITY_LIST - PCI_PRIMARY_BUS);
+    }
+}
+
+static void acpi_build_key_add_bus(PCIBus *bus, void *opaque)
+{
+    pci_for_each_device_under_bus(bus, acpi_build_key_add_device, opaque);
+}
+
+/*
+ * Collect everything acpi_build() depends on that can change after
+ * machine init: device hotplug, and the PCI and chipset configuration
+ * that firmware programs before it loads the tables.  If the result
+ * matches the one for the tables already exposed, they are still up to
+ * date and need not be rebuilt.
+ */
+static GByteArray *acpi_build_key(MachineState *machine)
+{
+    PCMachineState *pcms = PC_MACHINE(machine);
+    GByteArray *key = g_byte_array_new();
+    uint64_t gen = qdev_topology_generation();
+    Range pci_hole = {}, pci_hole64 = {};
+    AcpiMcfgInfo mcfg = {};
+    AcpiPmInfo pm;
+
+    ACPI_BUILD_KEY_ADD(key, gen);
+
+    memset(&pm, 0, sizeof(pm));
+    acpi_get_pm_info(machine, &pm);
+    acpi_build_key_add_pm(key, &pm);
+
+    if (acpi_get_mcfg(&mcfg)) {
+        ACPI_BUILD_KEY_ADD(key, mcfg.base);
+        ACPI_BUILD_KEY_ADD(key, mcfg.size);
+    }
+
+    acpi_get_pci_holes(&pci_hole, &pci_hole64);
+    /* Two uint64_t without padding, whose members are private */
+    ACPI_BUILD_KEY_ADD(key, pci_hole);
+    ACPI_BUILD_KEY_ADD(key, pci_hole64);
+
+    if (pcms->bus) {
+        pci_for_each_bus(pcms->bus, acpi_build_key_add_bus, key);
+    }
+    return key;
+}
+
+static bool acpi_build_key_equal(GByteArray *a, GByteArray *b)
+{
+    return a && b && a->len == b->len && !memcmp(a->data, b->data, a->len);
 }
 
 static void acpi_ram_update(MemoryRegion *mr, GArray *data)
@@ -2736,7 +2867,9 @@ static void acpi_ram_update(MemoryRegion *mr, GArray *data)
 static void acpi_build_update(void *build_opaque)
 {
     AcpiBuildState *build_state = build_opaque;
+    MachineState *machine = MACHINE(qdev_get_machine());
     AcpiBuildTables tables;
+    GByteArray *key;
 
     /* No state to update or already patched? Nothing to do. */
     if (!build_state || build_state->patched) {
@@ -2744,9 +2877,21 @@ static void acpi_build_update(void *build_opaque)
     }
     build_state->patched = 1;
 
+    /* Typically a reboot with nothing plugged or reprogrammed since */
+    key = acpi_build_key(machine);
+    if (acpi_build_key_equal(key, build_state->key)) {
+        trace_acpi_build_update_cached();
+        g_byte_array_unref(key);
+        return;
+    }
+    if (build_state->key) {
+        g_byte_array_unref(build_state->key);
+    }
+    build_state->key = key;
+
     acpi_build_tables_init(&tables);
 
-    acpi_build(&tables, MACHINE(qdev_get_machine()));
+    acpi_build(&tables, machine);
 
     acpi_ram_update(build_state->table_mr, tables.table_data);
 
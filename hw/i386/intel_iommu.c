@@ -61,13 +61,6 @@ struct vtd_as_key {
     uint32_t pasid;
 };
 
-struct vtd_iotlb_key {
-    uint64_t gfn;
-    uint32_t pasid;
-    uint16_t sid;
-    uint8_t level;
-};
-
 static void vtd_address_space_refresh_all(IntelIOMMUState *s);
 static void vtd_address_space_unmap(VTDAddressSpace *as, IOMMUNotifier *n);
 
@@ -209,8 +202,8 @@ static inline gboolean vtd_as_has_map_notifier(VTDAddressSpace *as)
 /* GHashTable functions */
 static gboolean vtd_iotlb_equal(gconstpointer v1, gconstpointer v2)
 {
-    const struct vtd_iotlb_key *key1 = v1;
-    const struct vtd_iotlb_key *key2 = v2;
+    const VTDIOTLBEntry *key1 = v1;
+    const VTDIOTLBEntry *key2 = v2;
 
     return key1->sid == key2->sid &&
            key1->pasid == key2->pasid &&
@@ -220,7 +213,7 @@ static gboolean vtd_iotlb_equal(gconstpointer v1, gconstpointer v2)
 
 static guint vtd_iotlb_hash(gconstpointer v)
 {
-    const struct vtd_iotlb_key *key = v;
+    const VTDIOTLBEntry *key = v;
     uint64_t hash64 = key->gfn | ((uint64_t)(key->sid) << VTD_IOTLB_SID_SHIFT) |
         (uint64_t)(key->level - 1) << VTD_IOTLB_LVL_SHIFT |
         (uint64_t)(key->pasid) << VTD_IOTLB_PASID_SHIFT;
@@ -250,14 +243,6 @@ static guint vtd_as_hash(gconstpointer v)
     return (guint)(value << 8 | key->devfn);
 }
 
-static gboolean vtd_hash_remove_by_domain(gpointer key, gpointer value,
-                                          gpointer user_data)
-{
-    VTDIOTLBEntry *entry = (VTDIOTLBEntry *)value;
-    uint16_t domain_id = *(uint16_t *)user_data;
-    return entry->domain_id == domain_id;
-}
-
 /* The shift of an addr for a certain level of paging structure */
 static inline uint32_t vtd_slpt_level_shift(uint32_t level)
 {
@@ -270,11 +255,9 @@ static inline uint64_t vtd_slpt_level_page_mask(uint32_t level)
     return ~((1ULL << vtd_slpt_level_shift(level)) - 1);
 }
 
-static gboolean vtd_hash_remove_by_page(gpointer key, gpointer value,
-                                        gpointer user_data)
+static bool vtd_iotlb_page_match(VTDIOTLBEntry *entry,
+                                 VTDIOTLBPageInvInfo *info)
 {
-    VTDIOTLBEntry *entry = (VTDIOTLBEntry *)value;
-    VTDIOTLBPageInvInfo *info = (VTDIOTLBPageInvInfo *)user_data;
     uint64_t gfn = (info->addr >> VTD_PAGE_SHIFT_4K) & info->mask;
     uint64_t gfn_tlb = (info->addr & entry->mask) >> VTD_PAGE_SHIFT_4K;
     return (entry->domain_id == info->domain_id) &&
@@ -282,6 +265,29 @@ static gboolean vtd_hash_remove_by_page(gpointer key, gpointer value,
              (entry->gfn == gfn_tlb));
 }
 
+/*
+ * Make the last translation cached in each VTDAddressSpace stale.  Must be
+ * called with IOMMU lock held.
+ */
+static void vtd_invalidate_last_translations_locked(IntelIOMMUState *s)
+{
+    VTDAddressSpace *vtd_as;
+    GHashTableIter as_it;
+    uint32_t gen = s->iotlb_gen + 1;
+
+    if (gen == 0) {
+        /* Wrapped around, so old generations could match again */
+        g_hash_table_iter_init(&as_it, s->vtd_address_spaces);
+        while (g_hash_table_iter_next(&as_it, NULL, (void **)&vtd_as)) {
+            seqlock_write_begin(&vtd_as->iotlb_last_seq);
+            vtd_as->iotlb_last_gen = 0;
+            seqlock_write_end(&vtd_as->iotlb_last_seq);
+        }
+        gen = 1;
+    }
+    qatomic_set(&s->iotlb_gen, gen);
+}
+
 /* Reset all the gen of VTDAddressSpace to zero and set the gen of
  * IntelIOMMUState to 1.  Must be called with IOMMU lock held.
  */
@@ -298,13 +304,29 @@ static void vtd_reset_context_cache_locked(IntelIOMMUState *s)
         vtd_as->context_cache_entry.context_cache_gen = 0;
     }
     s->context_cache_gen = 1;
+    vtd_invalidate_last_translations_locked(s);
+}
+
+/* Must be called with IOMMU lock held. */
+static void vtd_iotlb_remove_locked(IntelIOMMUState *s, VTDIOTLBEntry *entry)
+{
+    g_hash_table_remove(s->iotlb, entry);
+    QTAILQ_REMOVE(&s->iotlb_lru, entry, lru);
+    g_free(entry);
 }
 
 /* Must be called with IOMMU lock held. */
 static void vtd_reset_iotlb_locked(IntelIOMMUState *s)
 {
+    VTDIOTLBEntry *entry, *next;
+
     assert(s->iotlb);
     g_hash_table_remove_all(s->iotlb);
+    QTAILQ_FOREACH_SAFE(entry, &s->iotlb_lru, lru, next) {
+        g_free(entry);
+    }
+    QTAILQ_INIT(&s->iotlb_lru);
+    vtd_invalidate_last_translations_locked(s);
 }
 
 static void vtd_reset_iotlb(IntelIOMMUState *s)
@@ -331,7 +353,7 @@ static uint64_t vtd_get_iotlb_gfn(hwaddr addr, uint32_t level)
 static VTDIOTLBEntry *vtd_lookup_iotlb(IntelIOMMUState *s, uint16_t source_id,
                                        uint32_t pasid, hwaddr addr)
 {
-    struct vtd_iotlb_key key;
+    VTDIOTLBEntry key;
     VTDIOTLBEntry *entry;
     int level;
 
@@ -347,6 +369,10 @@ static VTDIOTLBEntry *vtd_lookup_iotlb(IntelIOMMUState *s, uint16_t source_id,
     }
 
 out:
+    if (entry && entry != QTAILQ_FIRST(&s->iotlb_lru)) {
+        QTAILQ_REMOVE(&s->iotlb_lru, entry, lru);
+        QTAILQ_INSERT_HEAD(&s->iotlb_lru, entry, lru);
+    }
     return entry;
 }
 
@@ -356,29 +382,76 @@ static void vtd_update_iotlb(IntelIOMMUState *s, uint16_t source_id,
                              uint8_t access_flags, uint32_t level,
                              uint32_t pasid)
 {
-    VTDIOTLBEntry *entry = g_malloc(sizeof(*entry));
-    struct vtd_iotlb_key *key = g_malloc(sizeof(*key));
-    uint64_t gfn = vtd_get_iotlb_gfn(addr, level);
+    VTDIOTLBEntry key = {
+        .gfn = vtd_get_iotlb_gfn(addr, level),
+        .sid = source_id,
+        .level = level,
+        .pasid = pasid,
+    };
+    VTDIOTLBEntry *entry;
 
     trace_vtd_iotlb_page_update(source_id, addr, slpte, domain_id);
-    if (g_hash_table_size(s->iotlb) >= VTD_IOTLB_MAX_SIZE) {
-        trace_vtd_iotlb_reset("iotlb exceeds size limit");
-        vtd_reset_iotlb_locked(s);
+
+    entry = g_hash_table_lookup(s->iotlb, &key);
+    if (entry) {
+        QTAILQ_REMOVE(&s->iotlb_lru, entry, lru);
+    } else {
+        if (g_hash_table_size(s->iotlb) >= VTD_IOTLB_MAX_SIZE) {
+            VTDIOTLBEntry *victim = QTAILQ_LAST(&s->iotlb_lru);
+
+            trace_vtd_iotlb_evict(victim->sid, victim->gfn, victim->level);
+            vtd_iotlb_remove_locked(s, victim);
+        }
+        entry = g_new(VTDIOTLBEntry, 1);
+        *entry = key;
+        g_hash_table_add(s->iotlb, entry);
     }
 
-    entry->gfn = gfn;
     entry->domain_id = domain_id;
     entry->slpte = slpte;
     entry->access_flags = access_flags;
     entry->mask = vtd_slpt_level_page_mask(level);
-    entry->pasid = pasid;
+    QTAILQ_INSERT_HEAD(&s->iotlb_lru, entry, lru);
+}
+
+/*
+ * Look up @addr in the last translation of @vtd_as.  This runs without
+ * the IOMMU lock, so that repeated DMA to the same page does not contend
+ * on it.
+ */
+static bool vtd_lookup_last_translation(VTDAddressSpace *vtd_as, hwaddr addr,
+                                        IOMMUTLBEntry *entry)
+{
+    IntelIOMMUState *s = vtd_as->iommu_state;
+    IOMMUTLBEntry last;
+    unsigned start;
+    bool hit;
+
+    do {
+        start = seqlock_read_begin(&vtd_as->iotlb_last_seq);
+        hit = vtd_as->iotlb_last_gen == qatomic_read(&s->iotlb_gen);
+        last = vtd_as->iotlb_last;
+    } while (seqlock_read_retry(&vtd_as->iotlb_last_seq, start));
+
+    if (!hit || (addr & ~last.addr_mask) != last.iova) {
+        return false;
+    }
 
-    key->gfn = gfn;
-    key->sid = source_id;
-    key->level = level;
-    key->pasid = pasid;
+    entry->iova = last.iova;
+    entry->translated_addr = last.translated_addr;
+    entry->addr_mask = last.addr_mask;
+    entry->perm = last.perm;
+    return true;
+}
 
-    g_hash_table_replace(s->iotlb, key, entry);
+/* Must be called with IOMMU lock held */
+static void vtd_update_last_translation(VTDAddressSpace *vtd_as,
+                                        IOMMUTLBEntry *entry)
+{
+    seqlock_write_begin(&vtd_as->iotlb_last_seq);
+    vtd_as->iotlb_last = *entry;
+    vtd_as->iotlb_last_gen = vtd_as->iommu_state->iotlb_gen;
+    seqlock_write_end(&vtd_as->iotlb_last_seq);
 }
 
 /* Given the reg addr of both the message data and address, generate an
@@ -1886,6 +1959,10 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
      */
     assert(!vtd_is_interrupt_addr(addr));
 
+    if (vtd_lookup_last_translation(vtd_as, addr, entry)) {
+        return true;
+    }
+
     vtd_iommu_lock(s);
 
     cc_entry = &vtd_as->context_cache_entry;
@@ -1994,11 +2071,12 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
     vtd_update_iotlb(s, source_id, vtd_get_domain_id(s, &ce, pasid),
                      addr, slpte, access_flags, level, pasid);
 out:
-    vtd_iommu_unlock(s);
     entry->iova = addr & page_mask;
     entry->translated_addr = vtd_get_slpte_addr(slpte, s->aw_bits) & page_mask;
     entry->addr_mask = ~page_mask;
     entry->perm = access_flags;
+    vtd_update_last_translation(vtd_as, entry);
+    vtd_iommu_unlock(s);
     return true;
 
 error:
@@ -2058,6 +2136,7 @@ static void vtd_context_global_invalidate(IntelIOMMUState *s)
     if (s->context_cache_gen == VTD_CONTEXT_CACHE_GEN_MAX) {
         vtd_reset_context_cache_locked(s);
     }
+    vtd_invalidate_last_translations_locked(s);
     vtd_iommu_unlock(s);
     vtd_address_space_refresh_all(s);
     /*
@@ -2113,6 +2192,7 @@ static void vtd_context_device_invalidate(IntelIOMMUState *s,
                                          VTD_PCI_FUNC(vtd_as->devfn));
             vtd_iommu_lock(s);
             vtd_as->context_cache_entry.context_cache_gen = 0;
+            vtd_invalidate_last_translations_locked(s);
             vtd_iommu_unlock(s);
             /*
              * Do switch address space when needed, in case if the
@@ -2173,12 +2253,17 @@ static void vtd_iotlb_domain_invalidate(IntelIOMMUState *s, uint16_t domain_id)
 {
     VTDContextEntry ce;
     VTDAddressSpace *vtd_as;
+    VTDIOTLBEntry *entry, *next;
 
     trace_vtd_inv_desc_iotlb_domain(domain_id);
 
     vtd_iommu_lock(s);
-    g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_domain,
-                                &domain_id);
+    QTAILQ_FOREACH_SAFE(entry, &s->iotlb_lru, lru, next) {
+        if (entry->domain_id == domain_id) {
+            vtd_iotlb_remove_locked(s, entry);
+        }
+    }
+    vtd_invalidate_last_translations_locked(s);
     vtd_iommu_unlock(s);
 
     QLIST_FOREACH(vtd_as, &s->vtd_as_with_notifiers, next) {
@@ -2239,6 +2324,7 @@ static void vtd_iotlb_page_invalidate(IntelIOMMUState *s, uint16_t domain_id,
                                       hwaddr addr, uint8_t am)
 {
     VTDIOTLBPageInvInfo info;
+    VTDIOTLBEntry *entry, *next;
 
     trace_vtd_inv_desc_iotlb_pages(domain_id, addr, am);
 
@@ -2247,7 +2333,12 @@ static void vtd_iotlb_page_invalidate(IntelIOMMUState *s, uint16_t domain_id,
     info.addr = addr;
     info.mask = ~((1 << am) - 1);
     vtd_iommu_lock(s);
-    g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_page, &info);
+    QTAILQ_FOREACH_SAFE(entry, &s->iotlb_lru, lru, next) {
+        if (vtd_iotlb_page_match(entry, &info)) {
+            vtd_iotlb_remove_locked(s, entry);
+        }
+    }
+    vtd_invalidate_last_translations_locked(s);
     vtd_iommu_unlock(s);
     vtd_iotlb_page_invalidate_notify(s, domain_id, addr, am, PCI_NO_PASID);
 }
@@ -3738,6 +3829,7 @@ VTDAddressSpace *vtd_find_add_as(IntelIOMMUState *s, PCIBus *bus,
         vtd_dev_as->pasid = pasid;
         vtd_dev_as->iommu_state = s;
         vtd_dev_as->context_cache_entry.context_cache_gen = 0;
+        seqlock_init(&vtd_dev_as->iotlb_last_seq);
         vtd_dev_as->iova_tree = iova_tree_new();
 
         memory_region_init(&vtd_dev_as->root, OBJECT(s), name, UINT64_MAX);
@@ -4226,8 +4318,9 @@ static void vtd_realize(DeviceState *dev, Error **errp)
                                         VTD_INTERRUPT_ADDR_FIRST,
                                         &s->mr_ir, 1);
     /* No corresponding destroy */
-    s->iotlb = g_hash_table_new_full(vtd_iotlb_hash, vtd_iotlb_equal,
-                                     g_free, g_free);
+    s->iotlb = g_hash_table_new(vtd_iotlb_hash, vtd_iotlb_equal);
+    QTAILQ_INIT(&s->iotlb_lru);
+    s->iotlb_gen = 1;
     s->vtd_address_spaces = g_hash_table_new_full(vtd_as_hash, vtd_as_equal,
                                       g_free, g_free);
     vtd_init(s);
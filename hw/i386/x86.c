@@ -1058,15 +1058,37 @@ void x86_load_linux(X86MachineState *x86ms,
     kernel_size -= setup_size;
 
     setup  = g_malloc(setup_size);
-    kernel = g_malloc(kernel_size);
     fseek(f, 0, SEEK_SET);
     if (fread(setup, 1, setup_size, f) != setup_size) {
         fprintf(stderr, "fread() failed\n");
         exit(1);
     }
-    if (fread(kernel, 1, kernel_size, f) != kernel_size) {
-        fprintf(stderr, "fread() failed\n");
-        exit(1);
+
+    /*
+     * Unless a dtb has to be appended, the kernel is handed to the guest
+     * exactly as it is on disk, so serve it from a mapping of the file
+     * instead of copying it to the heap.
+     */
+    kernel = NULL;
+    if (!dtb_filename) {
+        GMappedFile *mapped_file;
+
+        mapped_file = g_mapped_file_new(kernel_filename, false, NULL);
+        if (mapped_file &&
+            g_mapped_file_get_length(mapped_file) == setup_size + kernel_size) {
+            x86ms->kernel_mapped_file = mapped_file;
+            kernel = (uint8_t *)g_mapped_file_get_contents(mapped_file) +
+                     setup_size;
+        } else if (mapped_file) {
+            g_mapped_file_unref(mapped_file);
+        }
+    }
+    if (!kernel) {
+        kernel = g_malloc(kernel_size);
+        if (fread(kernel, 1, kernel_size, f) != kernel_size) {
+            fprintf(stderr, "fread() failed\n");
+            exit(1);
+        }
     }
     fclose(f);
 
@@ -56,6 +56,9 @@
 
 #define E1000E_MAX_TX_FRAGS (64)
 
+/* Number of contiguous TX descriptors fetched with a single DMA read */
+#define E1000E_TX_DESC_BATCH (16)
+
 union e1000_rx_desc_union {
     struct e1000_rx_desc legacy;
     union e1000_rx_desc_extended extended;
@@ -790,8 +793,8 @@ e1000e_rx_wb_interrupt_cause(E1000ECore *core, int queue_idx,
 }
 
 static uint32_t
-e1000e_txdesc_writeback(E1000ECore *core, dma_addr_t base,
-                        struct e1000_tx_desc *dp, bool *ide, int queue_idx)
+e1000e_txdesc_writeback(E1000ECore *core, struct e1000_tx_desc *dp,
+                        bool *ide, int queue_idx)
 {
     uint32_t txd_upper, txd_lower = le32_to_cpu(dp->lower.data);
 
@@ -805,11 +808,27 @@ e1000e_txdesc_writeback(E1000ECore *core, dma_addr_t base,
     txd_upper = le32_to_cpu(dp->upper.data) | E1000_TXD_STAT_DD;
 
     dp->upper.data = cpu_to_le32(txd_upper);
-    pci_dma_write(core->owner, base + ((char *)&dp->upper - (char *)dp),
-                  &dp->upper, sizeof(dp->upper));
     return e1000e_tx_wb_interrupt_cause(core, queue_idx);
 }
 
+static void
+e1000e_txdesc_flush(E1000ECore *core, dma_addr_t base,
+                    struct e1000_tx_desc *desc, uint32_t count)
+{
+    /*
+     * A single descriptor only gets its status written back. A run of
+     * them is written back whole: the other fields still hold what the
+     * guest posted, so one DMA replaces one per descriptor.
+     */
+    if (count == 1) {
+        pci_dma_write(core->owner,
+                      base + ((char *)&desc->upper - (char *)desc),
+                      &desc->upper, sizeof(desc->upper));
+    } else if (count > 1) {
+        pci_dma_write(core->owner, base, desc, count * sizeof(*desc));
+    }
+}
+
 typedef struct E1000ERingInfo {
     int dbah;
     int dbal;
@@ -851,6 +870,26 @@ e1000e_ring_advance(E1000ECore *core, const E1000ERingInfo *r, uint32_t count)
     }
 }
 
+static inline uint32_t
+e1000e_ring_contig_descr_num(E1000ECore *core, const E1000ERingInfo *r,
+                             uint32_t max)
+{
+    uint32_t ring_size = core->mac[r->dlen] / E1000_RING_DESC_LEN;
+    uint32_t dh = core->mac[r->dh];
+    uint32_t dt = core->mac[r->dt];
+    uint32_t num;
+
+    if (dh < dt) {
+        num = dt - dh;
+    } else if (dh < ring_size) {
+        num = ring_size - dh;
+    } else {
+        num = 1;
+    }
+
+    return MIN(num, max);
+}
+
 static inline uint32_t
 e1000e_ring_free_descr_num(E1000ECore *core, const E1000ERingInfo *r)
 {
@@ -928,10 +967,12 @@ static void
 e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
 {
     dma_addr_t base;
-    struct e1000_tx_desc desc;
+    struct e1000_tx_desc desc[E1000E_TX_DESC_BATCH];
     bool ide = false;
     const E1000ERingInfo *txi = txr->i;
     uint32_t cause = E1000_ICS_TXQE;
+    uint32_t wb_cause, wb_start, wb_count;
+    uint32_t i, n;
 
     if (!(core->mac[TCTL] & E1000_TCTL_EN)) {
         trace_e1000e_tx_disabled();
@@ -940,16 +981,38 @@ e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
 
     while (!e1000e_ring_empty(core, txi)) {
         base = e1000e_ring_head_descr(core, txi);
+        n = e1000e_ring_contig_descr_num(core, txi, E1000E_TX_DESC_BATCH);
+
+        trace_e1000e_tx_descr_batch(txi->idx, core->mac[txi->dh], n);
+        pci_dma_read(core->owner, base, desc, n * sizeof(desc[0]));
+
+        wb_start = 0;
+        wb_count = 0;
+        for (i = 0; i < n; i++) {
+            trace_e1000e_tx_descr((void *)(intptr_t)desc[i].buffer_addr,
+                                  desc[i].lower.data, desc[i].upper.data);
+
+            e1000e_process_tx_desc(core, txr->tx, &desc[i], txi->idx);
+            wb_cause = e1000e_txdesc_writeback(core, &desc[i], &ide,
+                                               txi->idx);
+            if (wb_cause) {
+                if (!wb_count) {
+                    wb_start = i;
+                }
+                wb_count++;
+                cause |= wb_cause;
+            } else {
+                e1000e_txdesc_flush(core,
+                                    base + wb_start * sizeof(desc[0]),
+                                    &desc[wb_start], wb_count);
+                wb_count = 0;
+            }
 
-        pci_dma_read(core->owner, base, &desc, sizeof(desc));
-
-        trace_e1000e_tx_descr((void *)(intptr_t)desc.buffer_addr,
-                              desc.lower.data, desc.upper.data);
-
-        e1000e_process_tx_desc(core, txr->tx, &desc, txi->idx);
-        cause |= e1000e_txdesc_writeback(core, base, &desc, &ide, txi->idx);
+            e1000e_ring_advance(core, txi, 1);
+        }
 
-        e1000e_ring_advance(core, txi, 1);
+        e1000e_txdesc_flush(core, base + wb_start * sizeof(desc[0]),
+                            &desc[wb_start], wb_count);
     }
 
     if (!ide || !e1000e_intrmgr_delay_tx_causes(core, &cause)) {
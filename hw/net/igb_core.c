@@ -57,6 +57,9 @@
 
 #define E1000E_MAX_TX_FRAGS (64)
 
+/* Number of contiguous TX descriptors fetched with a single DMA read */
+#define IGB_TX_DESC_BATCH (16)
+
 union e1000_rx_desc_union {
     struct e1000_rx_desc legacy;
     union e1000_adv_rx_desc adv;
@@ -749,6 +752,25 @@ igb_ring_advance(IGBCore *core, const E1000ERingInfo *r, uint32_t count)
     }
 }
 
+static inline uint32_t
+igb_ring_contig_descr_num(IGBCore *core, const E1000ERingInfo *r, uint32_t max)
+{
+    uint32_t ring_size = core->mac[r->dlen] / E1000_RING_DESC_LEN;
+    uint32_t dh = core->mac[r->dh];
+    uint32_t dt = core->mac[r->dt];
+    uint32_t num;
+
+    if (dh < dt) {
+        num = dt - dh;
+    } else if (dh < ring_size) {
+        num = ring_size - dh;
+    } else {
+        num = 1;
+    }
+
+    return MIN(num, max);
+}
+
 static inline uint32_t
 igb_ring_free_descr_num(IGBCore *core, const E1000ERingInfo *r)
 {
@@ -844,41 +866,60 @@ igb_rx_ring_init(IGBCore *core, E1000E_RxRing *rxr, int idx)
     rxr->i      = &i[idx];
 }
 
-static uint32_t
-igb_txdesc_writeback(IGBCore *core, dma_addr_t base,
-                     union e1000_adv_tx_desc *tx_desc,
-                     const E1000ERingInfo *txi)
+static inline uint64_t
+igb_tx_wb_addr(IGBCore *core, const E1000ERingInfo *txi)
 {
-    PCIDevice *d;
-    uint32_t cmd_type_len = le32_to_cpu(tx_desc->read.cmd_type_len);
     uint64_t tdwba;
 
     tdwba = core->mac[E1000_TDWBAL(txi->idx) >> 2];
     tdwba |= (uint64_t)core->mac[E1000_TDWBAH(txi->idx) >> 2] << 32;
 
+    return tdwba;
+}
+
+static uint32_t
+igb_txdesc_writeback(IGBCore *core, union e1000_adv_tx_desc *tx_desc,
+                     const E1000ERingInfo *txi)
+{
+    uint32_t cmd_type_len = le32_to_cpu(tx_desc->read.cmd_type_len);
+
     if (!(cmd_type_len & E1000_TXD_CMD_RS)) {
         return 0;
     }
 
-    d = pcie_sriov_get_vf_at_index(core->owner, txi->idx % 8);
-    if (!d) {
-        d = core->owner;
-    }
-
-    if (tdwba & 1) {
-        uint32_t buffer = cpu_to_le32(core->mac[txi->dh]);
-        pci_dma_write(d, tdwba & ~3, &buffer, sizeof(buffer));
-    } else {
+    if (!(igb_tx_wb_addr(core, txi) & 1)) {
         uint32_t status = le32_to_cpu(tx_desc->wb.status) | E1000_TXD_STAT_DD;
 
         tx_desc->wb.status = cpu_to_le32(status);
-        pci_dma_write(d, base + offsetof(union e1000_adv_tx_desc, wb),
-            &tx_desc->wb, sizeof(tx_desc->wb));
     }
 
     return igb_tx_wb_eic(core, txi->idx);
 }
 
+static void
+igb_txdesc_flush(IGBCore *core, PCIDevice *d, const E1000ERingInfo *txi,
+                 dma_addr_t base, union e1000_adv_tx_desc *desc,
+                 uint32_t count, uint32_t head)
+{
+    uint64_t tdwba;
+
+    if (!count) {
+        return;
+    }
+
+    tdwba = igb_tx_wb_addr(core, txi);
+    if (tdwba & 1) {
+        /* Head write-back: only the last head value is visible anyway */
+        uint32_t buffer = cpu_to_le32(head);
+        pci_dma_write(d, tdwba & ~3, &buffer, sizeof(buffer));
+    } else {
+        /* The write-back format covers the whole descriptor */
+        QEMU_BUILD_BUG_ON(offsetof(union e1000_adv_tx_desc, wb) != 0 ||
+                          sizeof(desc->wb) != sizeof(*desc));
+        pci_dma_write(d, base, desc, count * sizeof(*desc));
+    }
+}
+
 static inline bool
 igb_tx_enabled(IGBCore *core, const E1000ERingInfo *txi)
 {
@@ -896,9 +937,11 @@ igb_start_xmit(IGBCore *core, const IGB_TxRing *txr)
 {
     PCIDevice *d;
     dma_addr_t base;
-    union e1000_adv_tx_desc desc;
+    union e1000_adv_tx_desc desc[IGB_TX_DESC_BATCH];
     const E1000ERingInfo *txi = txr->i;
     uint32_t eic = 0;
+    uint32_t wb_eic, wb_start, wb_count, wb_head = 0;
+    uint32_t i, n;
 
     if (!igb_tx_enabled(core, txi)) {
         trace_e1000e_tx_disabled();
@@ -912,15 +955,38 @@ igb_start_xmit(IGBCore *core, const IGB_TxRing *txr)
 
     while (!igb_ring_empty(core, txi)) {
         base = igb_ring_head_descr(core, txi);
+        n = igb_ring_contig_descr_num(core, txi, IGB_TX_DESC_BATCH);
+
+        trace_e1000e_tx_descr_batch(txi->idx, core->mac[txi->dh], n);
+        pci_dma_read(d, base, desc, n * sizeof(desc[0]));
+
+        wb_start = 0;
+        wb_count = 0;
+        for (i = 0; i < n; i++) {
+            trace_e1000e_tx_descr((void *)(intptr_t)desc[i].read.buffer_addr,
+                                  desc[i].read.cmd_type_len,
+                                  desc[i].wb.status);
+
+            igb_process_tx_desc(core, d, txr->tx, &desc[i], txi->idx);
+            igb_ring_advance(core, txi, 1);
+            wb_eic = igb_txdesc_writeback(core, &desc[i], txi);
+            if (wb_eic) {
+                if (!wb_count) {
+                    wb_start = i;
+                }
+                wb_count++;
+                wb_head = core->mac[txi->dh];
+                eic |= wb_eic;
+            } else {
+                igb_txdesc_flush(core, d, txi,
+                                 base + wb_start * sizeof(desc[0]),
+                                 &desc[wb_start], wb_count, wb_head);
+                wb_count = 0;
+            }
+        }
 
-        pci_dma_read(d, base, &desc, sizeof(desc));
-
-        trace_e1000e_tx_descr((void *)(intptr_t)desc.read.buffer_addr,
-                              desc.read.cmd_type_len, desc.wb.status);
-
-        igb_process_tx_desc(core, d, txr->tx, &desc, txi->idx);
-        igb_ring_advance(core, txi, 1);
-        eic |= igb_txdesc_writeback(core, base, &desc, txi);
+        igb_txdesc_flush(core, d, txi, base + wb_start * sizeof(desc[0]),
+                         &desc[wb_start], wb_count, wb_head);
     }
 
     if (eic) {
@@ -12,6 +12,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "block/aio-wait.h"
 #include "qemu/atomic.h"
 #include "qemu/iov.h"
 #include "qemu/log.h"
@@ -20,6 +21,7 @@
 #include "hw/virtio/virtio.h"
 #include "net/net.h"
 #include "net/checksum.h"
+#include "net/gro.h"
 #include "net/tap.h"
 #include "qemu/error-report.h"
 #include "qemu/timer.h"
@@ -34,16 +36,20 @@
 #include "qapi/error.h"
 #include "qapi/qapi-events-net.h"
 #include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
 #include "qapi/qapi-types-migration.h"
 #include "qapi/qapi-events-migration.h"
 #include "hw/virtio/virtio-access.h"
 #include "migration/misc.h"
 #include "standard-headers/linux/ethtool.h"
+#include "sysemu/iothread.h"
 #include "sysemu/sysemu.h"
 #include "trace.h"
+#include "monitor/monitor.h"
 #include "monitor/qdev.h"
 #include "hw/pci/pci_device.h"
 #include "net_rx_pkt.h"
+#include "net_tx_pkt.h"
 #include "hw/virtio/vhost.h"
 #include "sysemu/qtest.h"
 
@@ -371,11 +377,258 @@ static void virtio_net_vnet_endian_status(VirtIONet *n, uint8_t status)
     }
 }
 
+/*
+ * With iothread-vq-mapping, each queue pair is processed in its IOThread
+ * while ioeventfd is active: the host notifiers, the TX bottom half and the
+ * peer's fd handlers all live in q->ctx, so a queue pair only ever runs in
+ * one thread and the datapath does not need the BQL.  The main loop pauses
+ * the dataplane around anything that modifies state the datapath reads,
+ * i.e. the control virtqueue and status changes.
+ */
+
+static void virtio_net_tx_bh(void *opaque);
+
+static int virtio_net_dataplane_queue_pairs(VirtIONet *n)
+{
+    return n->multiqueue ? n->max_queue_pairs : 1;
+}
+
+static uint8_t virtio_net_queue_status(VirtIONet *n, int i, uint8_t status)
+{
+    if ((!n->multiqueue && i != 0) || i >= n->curr_queue_pairs) {
+        return 0;
+    }
+    return status;
+}
+
+/* Interrupt injection from an IOThread must go through the irqfd */
+static void virtio_net_notify(VirtIONet *n, VirtQueue *vq)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+
+    if (n->dataplane_started) {
+        virtio_notify_irqfd(vdev, vq);
+    } else {
+        virtio_notify(vdev, vq);
+    }
+}
+
+static void virtio_net_set_tx_bh_context(VirtIONetQueue *q, AioContext *ctx)
+{
+    qemu_bh_delete(q->tx_bh);
+    q->tx_bh = aio_bh_new_guarded(ctx, virtio_net_tx_bh, q,
+                                  &DEVICE(q->n)->mem_reentrancy_guard);
+}
+
+/* Context: BQL held, the queue pairs are not running anywhere */
+static void virtio_net_dataplane_attach(VirtIONet *n, uint8_t status)
+{
+    int i;
+
+    for (i = 0; i < virtio_net_dataplane_queue_pairs(n); i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+        NetClientState *peer = qemu_get_subqueue(n->nic, i)->peer;
+
+        peer->info->set_aio_context(peer, q->ctx);
+        virtio_queue_aio_attach_host_notifier_no_poll(q->rx_vq, q->ctx);
+        virtio_queue_aio_attach_host_notifier(q->tx_vq, q->ctx);
+
+        /* Pick up buffers and kicks that arrived while detached */
+        event_notifier_set(virtio_queue_get_host_notifier(q->rx_vq));
+        event_notifier_set(virtio_queue_get_host_notifier(q->tx_vq));
+        if (q->tx_waiting &&
+            virtio_net_started(n, virtio_net_queue_status(n, i, status))) {
+            qemu_bh_schedule(q->tx_bh);
+        }
+    }
+}
+
+/* Context: BH in IOThread */
+static void virtio_net_dataplane_detach_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    VirtIONet *n = q->n;
+    NetClientState *peer = qemu_get_subqueue(n->nic, q - n->vqs)->peer;
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    virtio_queue_aio_detach_host_notifier(q->rx_vq, ctx);
+    virtio_queue_aio_detach_host_notifier(q->tx_vq, ctx);
+    /* q->tx_waiting stays set, virtio_net_dataplane_attach() reschedules */
+    qemu_bh_cancel(q->tx_bh);
+    peer->info->set_aio_context(peer, NULL);
+}
+
+/* Context: BQL held */
+static void virtio_net_dataplane_detach(VirtIONet *n)
+{
+    int i;
+
+    for (i = 0; i < virtio_net_dataplane_queue_pairs(n); i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+
+        aio_wait_bh_oneshot(q->ctx, virtio_net_dataplane_detach_bh, q);
+    }
+}
+
+/*
+ * Stop the IOThreads from touching the device until the matching
+ * virtio_net_dataplane_resume().  Calls nest.
+ *
+ * Context: BQL held
+ */
+static void virtio_net_dataplane_pause(VirtIONet *n)
+{
+    if (n->dataplane_pause_count++ == 0 && n->dataplane_started) {
+        virtio_net_dataplane_detach(n);
+    }
+}
+
+/* @status is the device status that the queue pairs should run with */
+static void virtio_net_dataplane_resume(VirtIONet *n, uint8_t status)
+{
+    assert(n->dataplane_pause_count > 0);
+    if (--n->dataplane_pause_count == 0 && n->dataplane_started) {
+        virtio_net_dataplane_attach(n, status);
+    }
+}
+
+/* Context: BQL held */
+static int virtio_net_start_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int nvqs = virtio_net_dataplane_queue_pairs(n) * 2;
+    int i, r;
+
+    r = virtio_device_start_ioeventfd_impl(vdev);
+    if (r < 0 || !n->net_conf.iothread_vq_mapping_list ||
+        n->dataplane_started) {
+        return r;
+    }
+
+    r = k->set_guest_notifiers(qbus->parent, nvqs, true);
+    if (r < 0) {
+        warn_report("virtio-net failed to set guest notifier (%d), "
+                    "queues stay in the main loop", r);
+        return 0;
+    }
+
+    /* Take the host notifiers away from the main loop */
+    for (i = 0; i < virtio_net_dataplane_queue_pairs(n); i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq),
+                                   NULL);
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq),
+                                   NULL);
+        virtio_net_set_tx_bh_context(q, q->ctx);
+    }
+
+    n->dataplane_started = true;
+    smp_wmb(); /* paired with aio_notify_accept() on the read side */
+
+    virtio_net_dataplane_attach(n, vdev->status);
+    return 0;
+}
+
+/* Context: BQL held */
+static void virtio_net_stop_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int i;
+
+    if (n->dataplane_started) {
+        assert(n->dataplane_pause_count == 0);
+        virtio_net_dataplane_detach(n);
+        n->dataplane_started = false;
+
+        for (i = 0; i < virtio_net_dataplane_queue_pairs(n); i++) {
+            VirtIONetQueue *q = &n->vqs[i];
+
+            virtio_net_set_tx_bh_context(q, qemu_get_aio_context());
+            if (q->tx_waiting &&
+                virtio_net_started(n, virtio_net_queue_status(n, i,
+                                                              vdev->status))) {
+                qemu_bh_schedule(q->tx_bh);
+            }
+        }
+        k->set_guest_notifiers(qbus->parent,
+                               virtio_net_dataplane_queue_pairs(n) * 2, false);
+    }
+
+    virtio_device_stop_ioeventfd_impl(vdev);
+}
+
+/* Context: BQL held, from realize */
+static bool virtio_net_dataplane_init(VirtIONet *n, Error **errp)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    IOThreadVirtQueueMappingList *list = n->net_conf.iothread_vq_mapping_list;
+    g_autofree AioContext **ctx = NULL;
+    int i;
+
+    if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+        error_setg(errp,
+                   "device is incompatible with iothread "
+                   "(transport does not support notifiers)");
+        return false;
+    }
+    if (!virtio_device_ioeventfd_enabled(vdev)) {
+        error_setg(errp, "ioeventfd is required for iothread");
+        return false;
+    }
+    if (n->net_conf.tx && !strcmp(n->net_conf.tx, "timer")) {
+        error_setg(errp, "iothread-vq-mapping requires tx=bh");
+        return false;
+    }
+    if (virtio_has_feature(n->host_features, VIRTIO_NET_F_RSC_EXT) ||
+        virtio_has_feature(n->host_features, VIRTIO_NET_F_HASH_REPORT)) {
+        error_setg(errp, "iothread-vq-mapping is incompatible with "
+                   "guest_rsc_ext and hash");
+        return false;
+    }
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        NetClientState *peer = n->nic_conf.peers.ncs[i];
+
+        if (!peer || !peer->info->set_aio_context) {
+            error_setg(errp, "iothread-vq-mapping requires a netdev that "
+                       "supports iothreads (tap, af-xdp or netmap)");
+            return false;
+        }
+        if (get_vhost_net(peer)) {
+            error_setg(errp, "iothread-vq-mapping is incompatible with vhost");
+            return false;
+        }
+    }
+
+    if (!iothread_vq_mapping_validate(list, n->max_queue_pairs, errp)) {
+        return false;
+    }
+
+    ctx = g_new(AioContext *, n->max_queue_pairs);
+    iothread_vq_mapping_apply(list, ctx, n->max_queue_pairs);
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        n->vqs[i].ctx = ctx[i];
+    }
+
+    /*
+     * Without vhost there is no one to mask notifiers for us, let the
+     * transport release and re-add irqfds itself.
+     */
+    vdev->use_guest_notifier_mask = false;
+    return true;
+}
+
 static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
 {
     unsigned int dropped = virtqueue_drop_all(vq);
     if (dropped) {
-        virtio_notify(vdev, vq);
+        virtio_net_notify(VIRTIO_NET(vdev), vq);
     }
 }
 
@@ -388,17 +641,14 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
 
     virtio_net_vnet_endian_status(n, status);
     virtio_net_vhost_status(n, status);
+    virtio_net_dataplane_pause(n);
 
     for (i = 0; i < n->max_queue_pairs; i++) {
         NetClientState *ncs = qemu_get_subqueue(n->nic, i);
         bool queue_started;
         q = &n->vqs[i];
 
-        if ((!n->multiqueue && i != 0) || i >= n->curr_queue_pairs) {
-            queue_status = 0;
-        } else {
-            queue_status = status;
-        }
+        queue_status = virtio_net_queue_status(n, i, status);
         queue_started =
             virtio_net_started(n, queue_status) && !n->vhost_started;
 
@@ -414,7 +664,7 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             if (q->tx_timer) {
                 timer_mod(q->tx_timer,
                                qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + n->tx_timeout);
-            } else {
+            } else if (!n->dataplane_started) {
                 qemu_bh_schedule(q->tx_bh);
             }
         } else {
@@ -434,6 +684,8 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             }
         }
     }
+
+    virtio_net_dataplane_resume(n, status);
 }
 
 static void virtio_net_set_link_status(NetClientState *nc)
@@ -629,6 +881,9 @@ static void virtio_net_reset(VirtIODevice *vdev)
     /* Flush any async TX */
     for (i = 0;  i < n->max_queue_pairs; i++) {
         flush_or_purge_queued_packets(qemu_get_subqueue(n->nic, i));
+        if (n->vqs[i].gro) {
+            net_gro_configure(n->vqs[i].gro, false, false);
+        }
     }
 }
 
@@ -798,14 +1053,17 @@ static uint64_t virtio_net_get_features(VirtIODevice *vdev, uint64_t features,
     virtio_add_feature(&features, VIRTIO_NET_F_MAC);
 
     if (!peer_has_vnet_hdr(n)) {
-        virtio_clear_feature(&features, VIRTIO_NET_F_CSUM);
-        virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO4);
-        virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO6);
+        /* With sw-offload, checksums and TCP segmentation are done here */
+        if (!n->net_conf.sw_offload) {
+            virtio_clear_feature(&features, VIRTIO_NET_F_CSUM);
+            virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO4);
+            virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO6);
+
+            virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_CSUM);
+            virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO4);
+            virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO6);
+        }
         virtio_clear_feature(&features, VIRTIO_NET_F_HOST_ECN);
-
-        virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_CSUM);
-        virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO4);
-        virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO6);
         virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_ECN);
 
         virtio_clear_feature(&features, VIRTIO_NET_F_HOST_USO);
@@ -826,6 +1084,11 @@ static uint64_t virtio_net_get_features(VirtIODevice *vdev, uint64_t features,
         virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_USO6);
     }
 
+    if (n->net_conf.iothread_vq_mapping_list) {
+        /* Queue resets would race with the IOThreads */
+        virtio_clear_feature(&features, VIRTIO_F_RING_RESET);
+    }
+
     if (!get_vhost_net(nc->peer)) {
         return features;
     }
@@ -876,6 +1139,20 @@ static uint64_t virtio_net_bad_features(VirtIODevice *vdev)
 
 static void virtio_net_apply_guest_offloads(VirtIONet *n)
 {
+    if (!n->has_vnet_hdr) {
+        bool csum = n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_CSUM);
+        bool tso4 = n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_TSO4);
+        bool tso6 = n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_TSO6);
+        int i;
+
+        for (i = 0; i < n->max_queue_pairs; i++) {
+            if (n->vqs[i].gro) {
+                net_gro_configure(n->vqs[i].gro, csum && tso4, csum && tso6);
+            }
+        }
+        return;
+    }
+
     qemu_set_offload(qemu_get_queue(n->nic)->peer,
             !!(n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_CSUM)),
             !!(n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_TSO4)),
@@ -1011,7 +1288,7 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
         virtio_has_feature(features, VIRTIO_NET_F_GUEST_TSO6);
     n->rss_data.redirect = virtio_has_feature(features, VIRTIO_NET_F_RSS);
 
-    if (n->has_vnet_hdr) {
+    if (n->has_vnet_hdr || n->net_conf.sw_offload) {
         n->curr_guest_offloads =
             virtio_net_guest_offloads_by_features(features);
         virtio_net_apply_guest_offloads(n);
@@ -1104,7 +1381,7 @@ static int virtio_net_handle_offloads(VirtIONet *n, uint8_t cmd,
 
         offloads = virtio_ldq_p(vdev, &offloads);
 
-        if (!n->has_vnet_hdr) {
+        if (!n->has_vnet_hdr && !n->net_conf.sw_offload) {
             return VIRTIO_NET_ERR;
         }
 
@@ -1328,14 +1605,54 @@ static void virtio_net_detach_epbf_rss(VirtIONet *n)
     virtio_net_attach_ebpf_to_backend(n->nic, -1);
 }
 
-static bool virtio_net_load_ebpf(VirtIONet *n)
+static bool virtio_net_load_ebpf_fds(VirtIONet *n, Error **errp)
+{
+    int fds[EBPF_RSS_MAX_FDS] = { [0 ... EBPF_RSS_MAX_FDS - 1] = -1 };
+    bool ret = false;
+    int i;
+
+    if (n->nr_ebpf_rss_fds != EBPF_RSS_MAX_FDS) {
+        error_setg(errp, "Expected %d eBPF RSS file descriptors but got %d",
+                   EBPF_RSS_MAX_FDS, n->nr_ebpf_rss_fds);
+        return false;
+    }
+
+    for (i = 0; i < EBPF_RSS_MAX_FDS; i++) {
+        fds[i] = monitor_fd_param(monitor_cur(), n->ebpf_rss_fds[i], errp);
+        if (fds[i] < 0) {
+            goto out;
+        }
+    }
+
+    ret = ebpf_rss_load_fds(&n->ebpf_rss, fds[0], fds[1], fds[2], fds[3],
+                            errp);
+
+out:
+    if (!ret) {
+        for (i = 0; i < EBPF_RSS_MAX_FDS && fds[i] >= 0; i++) {
+            close(fds[i]);
+        }
+    }
+    return ret;
+}
+
+static bool virtio_net_load_ebpf(VirtIONet *n, Error **errp)
 {
     if (!virtio_net_attach_ebpf_to_backend(n->nic, -1)) {
         /* backend doesn't support steering ebpf */
+        error_setg(errp, "Backend does not support steering eBPF");
         return false;
     }
 
-    return ebpf_rss_load(&n->ebpf_rss);
+    if (n->ebpf_rss_fds) {
+        return virtio_net_load_ebpf_fds(n, errp);
+    }
+
+    if (!ebpf_rss_load(&n->ebpf_rss)) {
+        error_setg(errp, "Can't load eBPF RSS program");
+        return false;
+    }
+    return true;
 }
 
 static void virtio_net_unload_ebpf(VirtIONet *n)
@@ -1456,17 +1773,25 @@ static uint16_t virtio_net_handle_rss(VirtIONet *n,
         goto error;
     }
     n->rss_data.enabled = true;
+    n->rss_data.enabled_software_rss = false;
 
     if (!n->rss_data.populate_hash) {
+        /* An attached program picks up the new maps in place */
         if (!virtio_net_attach_epbf_rss(n)) {
             /* EBPF must be loaded for vhost */
             if (get_vhost_net(qemu_get_queue(n->nic)->peer)) {
                 warn_report("Can't load eBPF RSS for vhost");
                 goto error;
             }
-            /* fallback to software RSS */
-            warn_report("Can't load eBPF RSS - fallback to software RSS");
-            n->rss_data.enabled_software_rss = true;
+            if (n->net_conf.iothread_vq_mapping_list) {
+                /* software RSS would hand packets to other IOThreads */
+                warn_report("Can't load eBPF RSS - packets stay on the "
+                            "queue they were received on");
+            } else {
+                /* fallback to software RSS */
+                warn_report("Can't load eBPF RSS - fallback to software RSS");
+                n->rss_data.enabled_software_rss = true;
+            }
         }
     } else {
         /* use software RSS for hash populating */
@@ -1492,7 +1817,17 @@ static int virtio_net_handle_mq(VirtIONet *n, uint8_t cmd,
     uint16_t queue_pairs;
     NetClientState *nc = qemu_get_queue(n->nic);
 
-    virtio_net_disable_rss(n);
+    if (cmd == VIRTIO_NET_CTRL_MQ_HASH_CONFIG ||
+        cmd == VIRTIO_NET_CTRL_MQ_RSS_CONFIG) {
+        /*
+         * Keep any steering program attached while the new configuration
+         * is parsed, so that receive steering is not interrupted; it is
+         * detached only if RSS ends up disabled.
+         */
+        n->rss_data.enabled = false;
+    } else {
+        virtio_net_disable_rss(n);
+    }
     if (cmd == VIRTIO_NET_CTRL_MQ_HASH_CONFIG) {
         queue_pairs = virtio_net_handle_rss(n, iov, iov_cnt, false);
         return queue_pairs ? VIRTIO_NET_OK : VIRTIO_NET_ERR;
@@ -1583,8 +1918,12 @@ size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
 
 static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
 {
+    VirtIONet *n = VIRTIO_NET(vdev);
     VirtQueueElement *elem;
 
+    /* Commands change filters and queue state that the datapath reads */
+    virtio_net_dataplane_pause(n);
+
     for (;;) {
         size_t written;
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
@@ -1604,6 +1943,8 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
             break;
         }
     }
+
+    virtio_net_dataplane_resume(n, vdev->status);
 }
 
 /* RX */
@@ -1612,7 +1953,12 @@ static void virtio_net_handle_rx(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     int queue_index = vq2q(virtio_get_queue_index(vq));
+    VirtIONetQueue *q = &n->vqs[queue_index];
 
+    /* Coalesced frames that did not fit go before anything queued later */
+    if (q->gro && !net_gro_flush(q->gro)) {
+        return;
+    }
     qemu_flush_queued_packets(qemu_get_subqueue(n->nic, queue_index));
 }
 
@@ -1697,7 +2043,8 @@ static void work_around_broken_dhclient(struct virtio_net_hdr *hdr,
 }
 
 static void receive_header(VirtIONet *n, const struct iovec *iov, int iov_cnt,
-                           const void *buf, size_t size)
+                           const void *buf, size_t size,
+                           const struct virtio_net_hdr *sw_hdr)
 {
     if (n->has_vnet_hdr) {
         /* FIXME this cast is evil */
@@ -1714,6 +2061,11 @@ static void receive_header(VirtIONet *n, const struct iovec *iov, int iov_cnt,
             .flags = 0,
             .gso_type = VIRTIO_NET_HDR_GSO_NONE
         };
+
+        if (sw_hdr) {
+            hdr = *sw_hdr;
+            virtio_net_hdr_swap(VIRTIO_DEVICE(n), &hdr);
+        }
         iov_from_buf(iov, iov_cnt, 0, &hdr, sizeof hdr);
     }
 }
@@ -1971,7 +2323,7 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
                                     sizeof(mhdr.num_buffers));
             }
 
-            receive_header(n, sg, elem->in_num, buf, size);
+            receive_header(n, sg, elem->in_num, buf, size, q->rx_sw_hdr);
             if (n->rss_data.populate_hash) {
                 offset = sizeof(mhdr);
                 iov_from_buf(sg, elem->in_num, offset,
@@ -2013,12 +2365,18 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
 
     for (j = 0; j < i; j++) {
         /* signal other side */
-        virtqueue_fill(q->rx_vq, elems[j], lens[j], j);
+        virtqueue_fill(q->rx_vq, elems[j], lens[j], q->rx_filled + j);
         g_free(elems[j]);
     }
 
+    if (nc->receiving_batch) {
+        /* Published by virtio_net_receive_batch_end() */
+        q->rx_filled += i;
+        return size;
+    }
+
     virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    virtio_net_notify(n, q->rx_vq);
 
     return size;
 
@@ -2039,6 +2397,66 @@ static ssize_t virtio_net_do_receive(NetClientState *nc, const uint8_t *buf,
     return virtio_net_receive_rcu(nc, buf, size, false);
 }
 
+static bool virtio_net_gro_flush(void *opaque, const struct virtio_net_hdr *hdr,
+                                 const uint8_t *buf, size_t size)
+{
+    VirtIONetQueue *q = opaque;
+    VirtIONet *n = q->n;
+    int queue_index = vq2q(virtio_get_queue_index(q->rx_vq));
+    ssize_t ret;
+
+    RCU_READ_LOCK_GUARD();
+
+    q->rx_sw_hdr = hdr;
+    ret = virtio_net_receive_rcu(qemu_get_subqueue(n->nic, queue_index),
+                                 buf, size, true);
+    q->rx_sw_hdr = NULL;
+
+    return ret != 0;
+}
+
+/*
+ * Frames are only held back while the backend delivers a burst and are
+ * flushed when it ends, so coalescing adds no latency of its own.
+ */
+static ssize_t virtio_net_gro_receive(NetClientState *nc, const uint8_t *buf,
+                                      size_t size)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+
+    /* Software RSS could steer the rest of a flow to another queue */
+    if (!nc->receiving_batch ||
+        (n->rss_data.enabled && n->rss_data.enabled_software_rss) ||
+        !net_gro_receive(q->gro, buf, size)) {
+        if (!net_gro_flush(q->gro)) {
+            return 0;
+        }
+        return virtio_net_do_receive(nc, buf, size);
+    }
+    return size;
+}
+
+static void virtio_net_receive_batch_end(NetClientState *nc)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+
+    /* Still part of the batch; whatever does not fit waits for rx buffers */
+    if (q->gro) {
+        net_gro_flush(q->gro);
+    }
+
+    if (!q->rx_filled) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    virtqueue_flush(q->rx_vq, q->rx_filled);
+    q->rx_filled = 0;
+    virtio_net_notify(n, q->rx_vq);
+}
+
 static void virtio_net_rsc_extract_unit4(VirtioNetRscChain *chain,
                                          const uint8_t *buf,
                                          VirtioNetRscUnit *unit)
@@ -2636,8 +3054,12 @@ static ssize_t virtio_net_receive(NetClientState *nc, const uint8_t *buf,
                                   size_t size)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+
     if ((n->rsc4_enabled || n->rsc6_enabled)) {
         return virtio_net_rsc_receive(nc, buf, size);
+    } else if (!n->has_vnet_hdr && q->gro && net_gro_enabled(q->gro)) {
+        return virtio_net_gro_receive(nc, buf, size);
     } else {
         return virtio_net_do_receive(nc, buf, size);
     }
@@ -2649,11 +3071,10 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     VirtIONetQueue *q = virtio_net_get_subqueue(nc);
-    VirtIODevice *vdev = VIRTIO_DEVICE(n);
     int ret;
 
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
-    virtio_notify(vdev, q->tx_vq);
+    virtio_net_notify(n, q->tx_vq);
 
     g_free(q->async_tx.elem);
     q->async_tx.elem = NULL;
@@ -2677,6 +3098,48 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
     }
 }
 
+static void virtio_net_tx_pkt_free_frag(void *context, void *base, size_t len)
+{
+    /* Fragments point into the element, which is unmapped when pushed */
+}
+
+/*
+ * The peer takes plain frames, so compute the checksum and segment what the
+ * guest handed over with TX offloads.  Only the parsed headers are trusted;
+ * the guest supplies the MSS and nothing else.
+ */
+static void virtio_net_tx_sw_offload(VirtIONetQueue *q,
+                                     const struct virtio_net_hdr *hdr,
+                                     const struct iovec *out_sg,
+                                     unsigned int out_num)
+{
+    VirtIONet *n = q->n;
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+    struct iovec sg[VIRTQUEUE_MAX_SIZE];
+    unsigned int sg_num, i;
+    bool tso = hdr->gso_type != VIRTIO_NET_HDR_GSO_NONE;
+
+    sg_num = iov_copy(sg, ARRAY_SIZE(sg), out_sg, out_num,
+                      n->guest_hdr_len, -1);
+    for (i = 0; i < sg_num; i++) {
+        if (!net_tx_pkt_add_raw_fragment(q->tx_pkt, sg[i].iov_base,
+                                         sg[i].iov_len)) {
+            goto out;
+        }
+    }
+
+    if (!net_tx_pkt_parse(q->tx_pkt) ||
+        !net_tx_pkt_build_vheader(q->tx_pkt, tso, true,
+                                  virtio_tswap16(vdev, hdr->gso_size)) ||
+        !net_tx_pkt_send(q->tx_pkt, qemu_get_subqueue(n->nic, queue_index))) {
+        trace_virtio_net_tx_sw_offload_drop(n, queue_index);
+    }
+
+out:
+    net_tx_pkt_reset(q->tx_pkt, virtio_net_tx_pkt_free_frag, NULL);
+}
+
 /* TX */
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
@@ -2735,6 +3198,21 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
                 out_num += 1;
                 out_sg = sg2;
             }
+        } else if (q->tx_pkt) {
+            struct virtio_net_hdr hdr;
+
+            if (iov_to_buf(out_sg, out_num, 0, &hdr, sizeof(hdr)) <
+                sizeof(hdr)) {
+                virtio_error(vdev, "virtio-net header incorrect");
+                virtqueue_detach_element(q->tx_vq, elem, 0);
+                g_free(elem);
+                return -EINVAL;
+            }
+            if (hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM ||
+                hdr.gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+                virtio_net_tx_sw_offload(q, &hdr, out_sg, out_num);
+                goto drop;
+            }
         }
         /*
          * If host wants to see the guest header as is, we can
@@ -2763,7 +3241,7 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 
 drop:
         virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
+        virtio_net_notify(n, q->tx_vq);
         g_free(elem);
 
         if (++num_packets >= n->tx_burst) {
@@ -2947,6 +3425,11 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
                                                   &DEVICE(vdev)->mem_reentrancy_guard);
     }
 
+    if (n->net_conf.sw_offload) {
+        n->vqs[index].gro = net_gro_new(virtio_net_gro_flush, &n->vqs[index]);
+        net_tx_pkt_init(&n->vqs[index].tx_pkt, VIRTQUEUE_MAX_SIZE);
+    }
+
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
 }
@@ -2968,6 +3451,10 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
         q->tx_bh = NULL;
     }
     q->tx_waiting = 0;
+    net_gro_free(q->gro);
+    q->gro = NULL;
+    net_tx_pkt_uninit(q->tx_pkt);
+    q->tx_pkt = NULL;
     virtio_del_queue(vdev, index * 2 + 1);
 }
 
@@ -3082,6 +3569,9 @@ static int virtio_net_post_load_device(void *opaque, int version_id)
             if (!virtio_net_attach_epbf_rss(n)) {
                 if (get_vhost_net(qemu_get_queue(n->nic)->peer)) {
                     warn_report("Can't post-load eBPF RSS for vhost");
+                } else if (n->net_conf.iothread_vq_mapping_list) {
+                    warn_report("Can't post-load eBPF RSS - packets stay "
+                                "on the queue they were received on");
                 } else {
                     warn_report("Can't post-load eBPF RSS - "
                                 "fallback to software RSS");
@@ -3108,7 +3598,7 @@ static int virtio_net_post_load_virtio(VirtIODevice *vdev)
      * Restore it back and apply the desired offloads.
      */
     n->curr_guest_offloads = n->saved_guest_offloads;
-    if (peer_has_vnet_hdr(n)) {
+    if (peer_has_vnet_hdr(n) || n->net_conf.sw_offload) {
         virtio_net_apply_guest_offloads(n);
     }
 
@@ -3360,6 +3850,7 @@ static NetClientInfo net_virtio_info = {
     .size = sizeof(NICState),
     .can_receive = virtio_net_can_receive,
     .receive = virtio_net_receive,
+    .receive_batch_end = virtio_net_receive_batch_end,
     .link_status_changed = virtio_net_set_link_status,
     .query_rx_filter = virtio_net_query_rxfilter,
     .announce = virtio_net_announce,
@@ -3687,6 +4178,13 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         return;
     }
     n->vqs = g_new0(VirtIONetQueue, n->max_queue_pairs);
+    if (n->net_conf.iothread_vq_mapping_list &&
+        !virtio_net_dataplane_init(n, errp)) {
+        g_free(n->vqs);
+        n->vqs = NULL;
+        virtio_cleanup(vdev);
+        return;
+    }
     n->curr_queue_pairs = 1;
     n->tx_timeout = n->net_conf.txtimer;
 
@@ -3767,7 +4265,14 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
     net_rx_pkt_init(&n->rx_pkt);
 
     if (virtio_has_feature(n->host_features, VIRTIO_NET_F_RSS)) {
-        virtio_net_load_ebpf(n);
+        Error *local_err = NULL;
+
+        if (!virtio_net_load_ebpf(n, &local_err) && n->ebpf_rss_fds) {
+            /* Only worth a warning if eBPF was explicitly provided */
+            warn_report_err(local_err);
+        } else {
+            error_free(local_err);
+        }
     }
 }
 
@@ -3807,6 +4312,9 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     /* delete also control vq */
     virtio_del_queue(vdev, max_queue_pairs * 2);
     qemu_announce_timer_del(&n->announce_timer, false);
+    if (n->net_conf.iothread_vq_mapping_list) {
+        iothread_vq_mapping_cleanup(n->net_conf.iothread_vq_mapping_list);
+    }
     g_free(n->vqs);
     qemu_del_nic(n->nic);
     virtio_net_rsc_cleanup(n);
@@ -3938,6 +4446,11 @@ static Property virtio_net_properties[] = {
                        TX_TIMER_INTERVAL),
     DEFINE_PROP_INT32("x-txburst", VirtIONet, net_conf.txburst, TX_BURST),
     DEFINE_PROP_STRING("tx", VirtIONet, net_conf.tx),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", VirtIONet,
+                                         net_conf.iothread_vq_mapping_list),
+    DEFINE_PROP_BOOL("sw-offload", VirtIONet, net_conf.sw_offload, true),
+    DEFINE_PROP_ARRAY("ebpf-rss-fds", VirtIONet, nr_ebpf_rss_fds,
+                      ebpf_rss_fds, qdev_prop_string, char*),
     DEFINE_PROP_UINT16("rx_queue_size", VirtIONet, net_conf.rx_queue_size,
                        VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE),
     DEFINE_PROP_UINT16("tx_queue_size", VirtIONet, net_conf.tx_queue_size,
@@ -3976,6 +4489,8 @@ static void virtio_net_class_init(ObjectClass *klass, void *data)
     vdc->queue_reset = virtio_net_queue_reset;
     vdc->queue_enable = virtio_net_queue_enable;
     vdc->set_status = virtio_net_set_status;
+    vdc->start_ioeventfd = virtio_net_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_net_stop_ioeventfd;
     vdc->guest_notifier_mask = virtio_net_guest_notifier_mask;
     vdc->guest_notifier_pending = virtio_net_guest_notifier_pending;
     vdc->legacy_features |= (0x1 << VIRTIO_NET_F_GSO);
@@ -685,7 +685,7 @@ static void nvme_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
             return;
         } else {
             assert(cq->vector < 32);
-            if (!n->cq_pending) {
+            if (!qatomic_read(&n->cq_pending)) {
                 n->irq_status &= ~(1 << cq->vector);
             }
             nvme_irq_check(n);
@@ -693,6 +693,20 @@ static void nvme_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
     }
 }
 
+/*
+ * Completion queues processed in the iothread cannot inject interrupts
+ * themselves, as delivering an MSI needs the BQL; kick the main loop.
+ */
+static void nvme_cq_notify(NvmeCtrl *n, NvmeCQueue *cq)
+{
+    if (cq->ctx != qemu_get_aio_context()) {
+        event_notifier_set(&cq->irq_notifier);
+        return;
+    }
+
+    nvme_irq_assert(n, cq);
+}
+
 static void nvme_req_clear(NvmeRequest *req)
 {
     req->ns = NULL;
@@ -1523,10 +1537,10 @@ static void nvme_post_cqes(void *opaque)
     }
     if (cq->tail != cq->head) {
         if (cq->irq_enabled && !pending) {
-            n->cq_pending++;
+            qatomic_inc(&n->cq_pending);
         }
 
-        nvme_irq_assert(n, cq);
+        nvme_cq_notify(n, cq);
     }
 }
 
@@ -4499,7 +4513,7 @@ static void nvme_cq_notifier(EventNotifier *e)
 
     if (cq->tail == cq->head) {
         if (cq->irq_enabled) {
-            n->cq_pending--;
+            qatomic_dec(&n->cq_pending);
         }
 
         nvme_irq_deassert(n, cq);
@@ -4508,6 +4522,15 @@ static void nvme_cq_notifier(EventNotifier *e)
     qemu_bh_schedule(cq->bh);
 }
 
+static void nvme_cq_irq_notifier(EventNotifier *e)
+{
+    NvmeCQueue *cq = container_of(e, NvmeCQueue, irq_notifier);
+
+    if (event_notifier_test_and_clear(e)) {
+        nvme_irq_assert(cq->ctrl, cq);
+    }
+}
+
 static int nvme_init_cq_ioeventfd(NvmeCQueue *cq)
 {
     NvmeCtrl *n = cq->ctrl;
@@ -4519,7 +4542,6 @@ static int nvme_init_cq_ioeventfd(NvmeCQueue *cq)
         return ret;
     }
 
-    event_notifier_set_handler(&cq->notifier, nvme_cq_notifier);
     memory_region_add_eventfd(&n->iomem,
                               0x1000 + offset, 4, false, 0, &cq->notifier);
 
@@ -4537,6 +4559,26 @@ static void nvme_sq_notifier(EventNotifier *e)
     nvme_process_sq(sq);
 }
 
+static void nvme_update_sq_tail(NvmeSQueue *sq);
+
+static bool nvme_sq_notifier_poll(void *opaque)
+{
+    EventNotifier *e = opaque;
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    /* Queues in the iothread always have shadow doorbells */
+    nvme_update_sq_tail(sq);
+
+    return !nvme_sq_empty(sq) && !QTAILQ_EMPTY(&sq->req_list);
+}
+
+static void nvme_sq_notifier_poll_ready(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    nvme_process_sq(sq);
+}
+
 static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
 {
     NvmeCtrl *n = sq->ctrl;
@@ -4548,19 +4590,200 @@ static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
         return ret;
     }
 
-    event_notifier_set_handler(&sq->notifier, nvme_sq_notifier);
     memory_region_add_eventfd(&n->iomem,
                               0x1000 + offset, 4, false, 0, &sq->notifier);
 
     return 0;
 }
 
+/*
+ * With an iothread, I/O queues whose doorbells are ioeventfds are processed
+ * there instead of in the main loop.  The poll-mode and interrupt handling
+ * of those queues relies on shadow doorbells and MSI-X respectively, so
+ * everything else stays in the main loop.
+ *
+ * The iothread is stopped with nvme_iothread_stop() whenever the main loop
+ * touches the queues, which is only done by the admin commands listed in
+ * nvme_admin_cmd_stops_iothread(), controller resets and writes to the
+ * MSI-X enable bit.  Queues are moved in or out of the iothread at that
+ * time, and their ioeventfds are attached by nvme_iothread_start().  As the
+ * iothread only handles queues with MSI-X interrupts, nvme_cq_notifier()
+ * there never touches the pin-based interrupt state in nvme_irq_deassert().
+ */
+static void nvme_cq_update_ctx(NvmeCQueue *cq)
+{
+    NvmeCtrl *n = cq->ctrl;
+    AioContext *main_ctx = qemu_get_aio_context();
+    AioContext *ctx = main_ctx;
+
+    if (n->iothread && cq->ioeventfd_enabled && msix_enabled(PCI_DEVICE(n))) {
+        if (cq->bh && cq->ctx == n->ctx) {
+            return;
+        }
+        if (!event_notifier_init(&cq->irq_notifier, 0)) {
+            ctx = n->ctx;
+        }
+    }
+
+    if (!cq->bh || cq->ctx != ctx) {
+        if (cq->bh) {
+            qemu_bh_delete(cq->bh);
+        }
+        if (cq->bh && cq->ctx != main_ctx) {
+            event_notifier_set_handler(&cq->irq_notifier, NULL);
+            event_notifier_cleanup(&cq->irq_notifier);
+        }
+
+        cq->ctx = ctx;
+        if (ctx == main_ctx) {
+            cq->bh = qemu_bh_new_guarded(nvme_post_cqes, cq,
+                                         &DEVICE(n)->mem_reentrancy_guard);
+        } else {
+            /*
+             * Like virtqueue host notifiers, do not share the reentrancy
+             * guard of the device with another thread.
+             */
+            cq->bh = aio_bh_new(ctx, nvme_post_cqes, cq);
+            event_notifier_set_handler(&cq->irq_notifier,
+                                       nvme_cq_irq_notifier);
+        }
+    }
+
+    if (cq->ioeventfd_enabled) {
+        event_notifier_set_handler(&cq->notifier,
+                                   ctx == main_ctx ? nvme_cq_notifier : NULL);
+    }
+}
+
+static void nvme_sq_update_ctx(NvmeSQueue *sq)
+{
+    NvmeCtrl *n = sq->ctrl;
+    AioContext *main_ctx = qemu_get_aio_context();
+    AioContext *ctx = main_ctx;
+
+    if (n->iothread && sq->ioeventfd_enabled &&
+        n->cq[sq->cqid]->ctx == n->ctx) {
+        ctx = n->ctx;
+    }
+
+    if (!sq->bh || sq->ctx != ctx) {
+        if (sq->bh) {
+            qemu_bh_delete(sq->bh);
+        }
+
+        sq->ctx = ctx;
+        if (ctx == main_ctx) {
+            sq->bh = qemu_bh_new_guarded(nvme_process_sq, sq,
+                                         &DEVICE(n)->mem_reentrancy_guard);
+        } else {
+            sq->bh = aio_bh_new(ctx, nvme_process_sq, sq);
+        }
+    }
+
+    if (sq->ioeventfd_enabled) {
+        event_notifier_set_handler(&sq->notifier,
+                                   ctx == main_ctx ? nvme_sq_notifier : NULL);
+    }
+}
+
+/* Must be called with the iothread stopped */
+static void nvme_update_queue_ctx(NvmeCtrl *n)
+{
+    /* Completion queues first, submission queues follow theirs */
+    for (int i = 1; i <= n->params.max_ioqpairs; i++) {
+        if (n->cq[i]) {
+            nvme_cq_update_ctx(n->cq[i]);
+        }
+    }
+    for (int i = 1; i <= n->params.max_ioqpairs; i++) {
+        if (n->sq[i]) {
+            nvme_sq_update_ctx(n->sq[i]);
+        }
+    }
+}
+
+/* Runs in the iothread */
+static void nvme_iothread_detach_bh(void *opaque)
+{
+    NvmeCtrl *n = opaque;
+
+    for (int i = 1; i <= n->params.max_ioqpairs; i++) {
+        NvmeSQueue *sq = n->sq[i];
+        NvmeCQueue *cq = n->cq[i];
+
+        if (sq && sq->ctx == n->ctx) {
+            aio_set_event_notifier(n->ctx, &sq->notifier, NULL, NULL, NULL);
+            qemu_bh_cancel(sq->bh);
+        }
+        if (cq && cq->ctx == n->ctx) {
+            aio_set_event_notifier(n->ctx, &cq->notifier, NULL, NULL, NULL);
+            qemu_bh_cancel(cq->bh);
+        }
+    }
+}
+
+/* Runs in the iothread */
+static void nvme_iothread_attach_bh(void *opaque)
+{
+    NvmeCtrl *n = opaque;
+
+    for (int i = 1; i <= n->params.max_ioqpairs; i++) {
+        NvmeSQueue *sq = n->sq[i];
+        NvmeCQueue *cq = n->cq[i];
+
+        if (sq && sq->ctx == n->ctx) {
+            aio_set_event_notifier(n->ctx, &sq->notifier, nvme_sq_notifier,
+                                   nvme_sq_notifier_poll,
+                                   nvme_sq_notifier_poll_ready);
+            /* Pick up anything that was left behind while stopped */
+            qemu_bh_schedule(sq->bh);
+        }
+        if (cq && cq->ctx == n->ctx) {
+            aio_set_event_notifier(n->ctx, &cq->notifier, nvme_cq_notifier,
+                                   NULL, NULL);
+            qemu_bh_schedule(cq->bh);
+        }
+    }
+}
+
+static void nvme_iothread_stop(NvmeCtrl *n)
+{
+    if (!n->iothread || n->iothread_stopped++) {
+        return;
+    }
+
+    /*
+     * Stop picking up new commands, then wait for those in flight.  Their
+     * completions may have scheduled bottom halves again, so cancel them a
+     * second time; nvme_iothread_start() reschedules them.
+     */
+    aio_wait_bh_oneshot(n->ctx, nvme_iothread_detach_bh, n);
+    for (int i = 1; i <= NVME_MAX_NAMESPACES; i++) {
+        NvmeNamespace *ns = nvme_ns(n, i);
+
+        if (ns) {
+            nvme_ns_drain(ns);
+        }
+    }
+    aio_wait_bh_oneshot(n->ctx, nvme_iothread_detach_bh, n);
+}
+
+static void nvme_iothread_start(NvmeCtrl *n)
+{
+    if (!n->iothread || --n->iothread_stopped) {
+        return;
+    }
+
+    aio_wait_bh_oneshot(n->ctx, nvme_iothread_attach_bh, n);
+}
+
 static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
 {
     uint16_t offset = sq->sqid << 3;
 
     n->sq[sq->sqid] = NULL;
     qemu_bh_delete(sq->bh);
+    sq->bh = NULL;
     if (sq->ioeventfd_enabled) {
         memory_region_del_eventfd(&n->iomem,
                                   0x1000 + offset, 4, false, 0, &sq->notifier);
@@ -4635,9 +4858,6 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
         QTAILQ_INSERT_TAIL(&(sq->req_list), &sq->io_req[i], entry);
     }
 
-    sq->bh = qemu_bh_new_guarded(nvme_process_sq, sq,
-                                 &DEVICE(sq->ctrl)->mem_reentrancy_guard);
-
     if (n->dbbuf_enabled) {
         sq->db_addr = n->dbbuf_dbs + (sqid << 3);
         sq->ei_addr = n->dbbuf_eis + (sqid << 3);
@@ -4653,6 +4873,7 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
     cq = n->cq[cqid];
     QTAILQ_INSERT_TAIL(&(cq->sq_list), sq, entry);
     n->sq[sqid] = sq;
+    nvme_sq_update_ctx(sq);
 }
 
 static uint16_t nvme_create_sq(NvmeCtrl *n, NvmeRequest *req)
@@ -5216,12 +5437,17 @@ static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
 
     n->cq[cq->cqid] = NULL;
     qemu_bh_delete(cq->bh);
+    cq->bh = NULL;
     if (cq->ioeventfd_enabled) {
         memory_region_del_eventfd(&n->iomem,
                                   0x1000 + offset, 4, false, 0, &cq->notifier);
         event_notifier_set_handler(&cq->notifier, NULL);
         event_notifier_cleanup(&cq->notifier);
     }
+    if (cq->ctx != qemu_get_aio_context()) {
+        event_notifier_set_handler(&cq->irq_notifier, NULL);
+        event_notifier_cleanup(&cq->irq_notifier);
+    }
     if (msix_enabled(pci)) {
         msix_vector_unuse(pci, cq->vector);
     }
@@ -5248,7 +5474,7 @@ static uint16_t nvme_del_cq(NvmeCtrl *n, NvmeRequest *req)
     }
 
     if (cq->irq_enabled && cq->tail != cq->head) {
-        n->cq_pending--;
+        qatomic_dec(&n->cq_pending);
     }
 
     nvme_irq_deassert(n, cq);
@@ -5287,8 +5513,7 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
         }
     }
     n->cq[cqid] = cq;
-    cq->bh = qemu_bh_new_guarded(nvme_post_cqes, cq,
-                                 &DEVICE(cq->ctrl)->mem_reentrancy_guard);
+    nvme_cq_update_ctx(cq);
 }
 
 static uint16_t nvme_create_cq(NvmeCtrl *n, NvmeRequest *req)
@@ -6856,6 +7081,8 @@ static uint16_t nvme_dbbuf_config(NvmeCtrl *n, const NvmeRequest *req)
         }
     }
 
+    nvme_update_queue_ctx(n);
+
     trace_pci_nvme_dbbuf_config(dbs_addr, eis_addr);
 
     return NVME_SUCCESS;
@@ -6991,6 +7218,26 @@ static void nvme_update_sq_tail(NvmeSQueue *sq)
     trace_pci_nvme_update_sq_tail(sq->sqid, sq->tail);
 }
 
+/*
+ * Admin commands that create, delete or move I/O queues or their doorbells,
+ * or change the format of the namespaces that the iothread submits to.  Other
+ * admin commands run alongside the iothread.
+ */
+static bool nvme_admin_cmd_stops_iothread(uint8_t opcode)
+{
+    switch (opcode) {
+    case NVME_ADM_CMD_DELETE_SQ:
+    case NVME_ADM_CMD_CREATE_SQ:
+    case NVME_ADM_CMD_DELETE_CQ:
+    case NVME_ADM_CMD_CREATE_CQ:
+    case NVME_ADM_CMD_DBBUF_CONFIG:
+    case NVME_ADM_CMD_FORMAT_NVM:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static void nvme_process_sq(void *opaque)
 {
     NvmeSQueue *sq = opaque;
@@ -7023,8 +7270,19 @@ static void nvme_process_sq(void *opaque)
         req->cqe.cid = cmd.cid;
         memcpy(&req->cmd, &cmd, sizeof(NvmeCmd));
 
-        status = sq->sqid ? nvme_io_cmd(n, req) :
-            nvme_admin_cmd(n, req);
+        if (sq->sqid) {
+            status = nvme_io_cmd(n, req);
+        } else {
+            bool stop = nvme_admin_cmd_stops_iothread(cmd.opcode);
+
+            if (stop) {
+                nvme_iothread_stop(n);
+            }
+            status = nvme_admin_cmd(n, req);
+            if (stop) {
+                nvme_iothread_start(n);
+            }
+        }
         if (status != NVME_NO_COMPLETE) {
             req->status = status;
             nvme_enqueue_req_completion(cq, req);
@@ -7082,6 +7340,8 @@ static void nvme_ctrl_reset(NvmeCtrl *n, NvmeResetType rst)
     NvmeNamespace *ns;
     int i;
 
+    nvme_iothread_stop(n);
+
     for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
         ns = nvme_ns(n, i);
         if (!ns) {
@@ -7147,6 +7407,8 @@ static void nvme_ctrl_reset(NvmeCtrl *n, NvmeResetType rst)
     n->dbbuf_dbs = 0;
     n->dbbuf_eis = 0;
     n->dbbuf_enabled = false;
+
+    nvme_iothread_start(n);
 }
 
 static void nvme_ctrl_shutdown(NvmeCtrl *n)
@@ -7158,6 +7420,8 @@ static void nvme_ctrl_shutdown(NvmeCtrl *n)
         memory_region_msync(&n->pmr.dev->mr, 0, n->pmr.dev->size);
     }
 
+    nvme_iothread_stop(n);
+
     for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
         ns = nvme_ns(n, i);
         if (!ns) {
@@ -7166,6 +7430,8 @@ static void nvme_ctrl_shutdown(NvmeCtrl *n)
 
         nvme_ns_shutdown(ns);
     }
+
+    nvme_iothread_start(n);
 }
 
 static void nvme_select_iocs(NvmeCtrl *n)
@@ -7607,6 +7873,11 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
         }
 
         cq = n->cq[qid];
+        if (cq->ctx != qemu_get_aio_context()) {
+            /* Only 4-byte writes hit the ioeventfd, ignore anything else */
+            return;
+        }
+
         if (unlikely(new_head >= cq->size)) {
             NVME_GUEST_ERR(pci_nvme_ub_db_wr_invalid_cqhead,
                            "completion queue doorbell write value"
@@ -7640,7 +7911,7 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
 
         if (cq->tail == cq->head) {
             if (cq->irq_enabled) {
-                n->cq_pending--;
+                qatomic_dec(&n->cq_pending);
             }
 
             nvme_irq_deassert(n, cq);
@@ -7668,6 +7939,10 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
         }
 
         sq = n->sq[qid];
+        if (sq->ctx != qemu_get_aio_context()) {
+            return;
+        }
+
         if (unlikely(new_tail >= sq->size)) {
             NVME_GUEST_ERR(pci_nvme_ub_db_wr_invalid_sqtail,
                            "submission queue doorbell write value"
@@ -7797,6 +8072,11 @@ static bool nvme_check_params(NvmeCtrl *n, Error **errp)
         return false;
     }
 
+    if (n->iothread && !params->ioeventfd) {
+        error_setg(errp, "iothread requires ioeventfd=on");
+        return false;
+    }
+
     if (n->pmr.dev) {
         if (host_memory_backend_is_mapped(n->pmr.dev)) {
             error_setg(errp, "can't use already busy memdev: %s",
@@ -7905,6 +8185,9 @@ static void nvme_init_state(NvmeCtrl *n)
     uint8_t max_vfs;
     int i;
 
+    n->ctx = n->iothread ? iothread_get_aio_context(n->iothread) :
+                           qemu_get_aio_context();
+
     if (pci_is_vf(pci)) {
         sctrl = nvme_sctrl(n);
         max_vfs = 0;
@@ -8400,6 +8683,8 @@ static Property nvme_props[] = {
     DEFINE_PROP_BOOL("use-intel-id", NvmeCtrl, params.use_intel_id, false),
     DEFINE_PROP_BOOL("legacy-cmb", NvmeCtrl, params.legacy_cmb, false),
     DEFINE_PROP_BOOL("ioeventfd", NvmeCtrl, params.ioeventfd, false),
+    DEFINE_PROP_LINK("iothread", NvmeCtrl, iothread, TYPE_IOTHREAD,
+                     IOThread *),
     DEFINE_PROP_UINT8("zoned.zasl", NvmeCtrl, params.zasl, 0),
     DEFINE_PROP_BOOL("zoned.auto_transition", NvmeCtrl,
                      params.auto_transition_zones, true),
@@ -8493,9 +8778,27 @@ static void nvme_sriov_pre_write_ctrl(PCIDevice *dev, uint32_t address,
 static void nvme_pci_write_config(PCIDevice *dev, uint32_t address,
                                   uint32_t val, int len)
 {
+    NvmeCtrl *n = NVME(dev);
+    /*
+     * Pin-based interrupts are asserted and deasserted under the BQL, so
+     * queues only stay in the iothread while MSI-X is enabled.
+     */
+    bool msix_write = n->iothread && msix_present(dev) &&
+                      ranges_overlap(address, len,
+                                     dev->msix_cap + PCI_MSIX_FLAGS, 2);
+
+    if (msix_write) {
+        nvme_iothread_stop(n);
+    }
+
     nvme_sriov_pre_write_ctrl(dev, address, val, len);
     pci_default_write_config(dev, address, val, len);
     pcie_cap_flr_write_config(dev, address, val, len);
+
+    if (msix_write) {
+        nvme_update_queue_ctx(n);
+        nvme_iothread_start(n);
+    }
 }
 
 static const VMStateDescription nvme_vmstate = {
@@ -21,6 +21,7 @@
 #include "qemu/uuid.h"
 #include "hw/pci/pci_device.h"
 #include "hw/block/block.h"
+#include "sysemu/iothread.h"
 
 #include "block/nvme.h"
 
@@ -471,6 +472,7 @@ typedef struct NvmeSQueue {
     uint64_t    db_addr;
     uint64_t    ei_addr;
     QEMUBH      *bh;
+    AioContext  *ctx;
     EventNotifier notifier;
     bool        ioeventfd_enabled;
     NvmeRequest *io_req;
@@ -492,7 +494,10 @@ typedef struct NvmeCQueue {
     uint64_t    db_addr;
     uint64_t    ei_addr;
     QEMUBH      *bh;
+    AioContext  *ctx;
     EventNotifier notifier;
+    /* Signalled from the iothread to inject the interrupt in the main loop */
+    EventNotifier irq_notifier;
     bool        ioeventfd_enabled;
     QTAILQ_HEAD(, NvmeSQueue) sq_list;
     QTAILQ_HEAD(, NvmeRequest) req_list;
@@ -531,6 +536,9 @@ typedef struct NvmeCtrl {
     NvmeBar      bar;
     NvmeParams   params;
     NvmeBus      bus;
+    IOThread     *iothread;
+    AioContext   *ctx;
+    unsigned int iothread_stopped;
 
     uint16_t    cntlid;
     bool        qs_created;
@@ -19,9 +19,12 @@
 #include "hw/pci/msix.h"
 #include "hw/pci/pci.h"
 #include "hw/xen/xen.h"
+#include "sysemu/kvm.h"
 #include "sysemu/xen.h"
 #include "migration/qemu-file-types.h"
 #include "migration/vmstate.h"
+#include "qemu/event_notifier.h"
+#include "qemu/main-loop.h"
 #include "qemu/range.h"
 #include "qapi/error.h"
 #include "trace.h"
@@ -33,6 +36,133 @@
 #define MSIX_ENABLE_MASK (PCI_MSIX_FLAGS_ENABLE >> 8)
 #define MSIX_MASKALL_MASK (PCI_MSIX_FLAGS_MASKALL >> 8)
 
+/*
+ * Vectors that are notified often get their own KVM MSI route and irqfd,
+ * so that msix_notify() only writes an eventfd instead of going through
+ * the bus master address space and the interrupt controller's MMIO
+ * handler.  Routes are dropped whenever the vector's message may change.
+ */
+#define MSIX_ROUTE_CACHE_THRESHOLD  256
+#define MSIX_ROUTE_CACHE_MAX        32
+#define MSIX_ROUTE_NONE             (-1)
+#define MSIX_ROUTE_FAILED           (-2)
+
+struct MSIXRouteCacheEntry {
+    unsigned hits;
+    int virq;
+    EventNotifier notifier;
+};
+
+static void msix_route_cache_release(PCIDevice *dev, unsigned int vector)
+{
+    struct MSIXRouteCacheEntry *e;
+
+    if (!dev->msix_route_cache) {
+        return;
+    }
+
+    e = &dev->msix_route_cache[vector];
+    if (e->virq >= 0) {
+        trace_msix_route_cache_release(dev->name, vector, e->virq);
+        kvm_irqchip_remove_irqfd_notifier_gsi(kvm_state, &e->notifier,
+                                              e->virq);
+        kvm_irqchip_release_virq(kvm_state, e->virq);
+        event_notifier_cleanup(&e->notifier);
+        dev->msix_route_cache_nr--;
+    }
+    e->virq = MSIX_ROUTE_NONE;
+    e->hits = 0;
+}
+
+static void msix_route_cache_release_all(PCIDevice *dev)
+{
+    unsigned int vector;
+
+    if (!dev->msix_route_cache) {
+        return;
+    }
+
+    for (vector = 0; vector < dev->msix_entries_nr; vector++) {
+        msix_route_cache_release(dev, vector);
+    }
+    g_free(dev->msix_route_cache);
+    dev->msix_route_cache = NULL;
+}
+
+static void msix_route_cache_add(PCIDevice *dev, unsigned int vector)
+{
+    struct MSIXRouteCacheEntry *e = &dev->msix_route_cache[vector];
+    KVMRouteChange c;
+    int virq;
+
+    if (dev->msix_route_cache_nr >= MSIX_ROUTE_CACHE_MAX ||
+        event_notifier_init(&e->notifier, 0) < 0) {
+        e->virq = MSIX_ROUTE_FAILED;
+        return;
+    }
+
+    c = kvm_irqchip_begin_route_changes(kvm_state);
+    virq = kvm_irqchip_add_msi_route(&c, vector, dev);
+    if (virq < 0) {
+        goto fail;
+    }
+    kvm_irqchip_commit_route_changes(&c);
+
+    if (kvm_irqchip_add_irqfd_notifier_gsi(kvm_state, &e->notifier,
+                                           NULL, virq) < 0) {
+        kvm_irqchip_release_virq(kvm_state, virq);
+        goto fail;
+    }
+
+    trace_msix_route_cache_add(dev->name, vector, virq);
+    e->virq = virq;
+    dev->msix_route_cache_nr++;
+    return;
+
+fail:
+    event_notifier_cleanup(&e->notifier);
+    e->virq = MSIX_ROUTE_FAILED;
+}
+
+/*
+ * Returns true if the vector was signalled through its cached irqfd.
+ * Only used with the BQL held, which also serializes against route
+ * updates; callers from other threads keep using the memory API.
+ */
+static bool msix_route_cache_notify(PCIDevice *dev, unsigned int vector)
+{
+    struct MSIXRouteCacheEntry *e;
+    unsigned int i;
+
+    if (!(dev->cap_present & QEMU_PCI_MSIX_ROUTE_CACHE) ||
+        !kvm_msi_via_irqfd_enabled() || xen_mode == XEN_EMULATE ||
+        dev->msix_vector_use_notifier || !bql_locked() ||
+        !(pci_get_word(dev->config + PCI_COMMAND) & PCI_COMMAND_MASTER)) {
+        return false;
+    }
+
+    if (!dev->msix_route_cache) {
+        dev->msix_route_cache = g_new(struct MSIXRouteCacheEntry,
+                                      dev->msix_entries_nr);
+        for (i = 0; i < dev->msix_entries_nr; i++) {
+            dev->msix_route_cache[i].hits = 0;
+            dev->msix_route_cache[i].virq = MSIX_ROUTE_NONE;
+        }
+    }
+
+    e = &dev->msix_route_cache[vector];
+    if (e->virq == MSIX_ROUTE_NONE &&
+        ++e->hits >= MSIX_ROUTE_CACHE_THRESHOLD) {
+        msix_route_cache_add(dev, vector);
+    }
+    if (e->virq < 0) {
+        return false;
+    }
+
+    event_notifier_set(&e->notifier);
+    return true;
+}
+
 static MSIMessage msix_prepare_message(PCIDevice *dev, unsigned vector)
 {
     uint8_t *table_entry = dev->msix_table + vector * PCI_MSIX_ENTRY_SIZE;
@@ -56,6 +186,7 @@ void msix_set_message(PCIDevice *dev, int vector, struct MSIMessage msg)
 {
     uint8_t *table_entry = dev->msix_table + vector * PCI_MSIX_ENTRY_SIZE;
 
+    msix_route_cache_release(dev, vector);
     pci_set_quad(table_entry + PCI_MSIX_ENTRY_LOWER_ADDR, msg.address);
     pci_set_long(table_entry + PCI_MSIX_ENTRY_DATA, msg.data);
     table_entry[PCI_MSIX_ENTRY_VECTOR_CTRL] &= ~PCI_MSIX_ENTRY_CTRL_MASKBIT;
@@ -227,6 +358,9 @@ static void msix_table_mmio_write(void *opaque, hwaddr addr,
     assert(addr + size <= dev->msix_entries_nr * PCI_MSIX_ENTRY_SIZE);
 
     was_masked = msix_is_masked(dev, vector);
+    if (addr % PCI_MSIX_ENTRY_SIZE < PCI_MSIX_ENTRY_VECTOR_CTRL) {
+        msix_route_cache_release(dev, vector);
+    }
     pci_set_long(dev->msix_table + addr, val);
     msix_handle_mask_update(dev, vector, was_masked);
 }
@@ -452,6 +586,7 @@ void msix_uninit(PCIDevice *dev, MemoryRegion *table_bar, MemoryRegion *pba_bar)
     if (!msix_present(dev)) {
         return;
     }
+    msix_route_cache_release_all(dev);
     pci_del_capability(dev, PCI_CAP_ID_MSIX, MSIX_CAP_LENGTH);
     dev->msix_cap = 0;
     msix_free_irq_entries(dev);
@@ -497,6 +632,7 @@ void msix_load(PCIDevice *dev, QEMUFile *f)
         return;
     }
 
+    msix_route_cache_release_all(dev);
     msix_clear_all_vectors(dev);
     qemu_get_buffer(f, dev->msix_table, n * PCI_MSIX_ENTRY_SIZE);
     qemu_get_buffer(f, dev->msix_pba, DIV_ROUND_UP(n, 8));
@@ -537,6 +673,10 @@ void msix_notify(PCIDevice *dev, unsigned vector)
         return;
     }
 
+    if (msix_route_cache_notify(dev, vector)) {
+        return;
+    }
+
     msg = msix_get_message(dev, vector);
 
     msi_send_message(dev, msg);
@@ -547,6 +687,7 @@ void msix_reset(PCIDevice *dev)
     if (!msix_present(dev)) {
         return;
     }
+    msix_route_cache_release_all(dev);
     msix_clear_all_vectors(dev);
     dev->config[dev->msix_cap + MSIX_CONTROL_OFFSET] &=
             ~dev->wmask[dev->msix_cap + MSIX_CONTROL_OFFSET];
@@ -85,6 +85,8 @@ static Property pci_props[] = {
                     QEMU_PCIE_ERR_UNC_MASK_BITNR, true),
     DEFINE_PROP_BIT("x-pcie-ari-nextfn-1", PCIDevice, cap_present,
                     QEMU_PCIE_ARI_NEXTFN_1_BITNR, false),
+    DEFINE_PROP_BIT("x-msix-route-cache", PCIDevice, cap_present,
+                    QEMU_PCI_MSIX_ROUTE_CACHE_BITNR, true),
     DEFINE_PROP_END_OF_LIST()
 };
 
@@ -1,6 +1,7 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/hw-version.h"
@@ -100,8 +101,14 @@ static void scsi_device_for_each_req_sync(SCSIDevice *s,
     assert(!runstate_is_running());
     assert(qemu_in_main_thread());
 
-    QTAILQ_FOREACH_SAFE(req, &s->requests, next, next_req) {
-        fn(req, opaque);
+    /*
+     * No other thread touches the list while the guest is stopped, but take
+     * the lock anyway for consistency.
+     */
+    WITH_QEMU_LOCK_GUARD(&s->requests_lock) {
+        QTAILQ_FOREACH_SAFE(req, &s->requests, next, next_req) {
+            fn(req, opaque);
+        }
     }
 }
 
@@ -115,57 +122,78 @@ static void scsi_device_for_each_req_async_bh(void *opaque)
 {
     g_autofree SCSIDeviceForEachReqAsyncData *data = opaque;
     SCSIDevice *s = data->s;
-    AioContext *ctx;
-    SCSIRequest *req;
-    SCSIRequest *next;
+    g_autoptr(GList) reqs = NULL;
 
     /*
-     * If the AioContext changed before this BH was called then reschedule into
-     * the new AioContext before accessing ->requests. This can happen when
-     * scsi_device_for_each_req_async() is called and then the AioContext is
-     * changed before BHs are run.
+     * Collect the requests of this AioContext first so that @fn() runs outside
+     * requests_lock; @fn() is free to dequeue the request.
      */
-    ctx = blk_get_aio_context(s->conf.blk);
-    if (ctx != qemu_get_current_aio_context()) {
-        aio_bh_schedule_oneshot(ctx, scsi_device_for_each_req_async_bh,
-                                g_steal_pointer(&data));
-        return;
+    WITH_QEMU_LOCK_GUARD(&s->requests_lock) {
+        AioContext *ctx = qemu_get_current_aio_context();
+        SCSIRequest *req;
+
+        QTAILQ_FOREACH(req, &s->requests, next) {
+            if (req->ctx == ctx) {
+                scsi_req_ref(req); /* dropped after calling fn() */
+                reqs = g_list_prepend(reqs, req);
+            }
+        }
     }
 
-    QTAILQ_FOREACH_SAFE(req, &s->requests, next, next) {
-        data->fn(req, data->fn_opaque);
+    reqs = g_list_reverse(reqs);
+    for (GList *elem = reqs; elem; elem = elem->next) {
+        data->fn(elem->data, data->fn_opaque);
+        scsi_req_unref(elem->data);
     }
 
-    /* Drop the reference taken by scsi_device_for_each_req_async() */
+    /* Drop the references taken by scsi_device_for_each_req_async() */
+    blk_dec_in_flight(s->conf.blk);
     object_unref(OBJECT(s));
 }
 
 /*
  * Schedule @fn() to be invoked for each enqueued request in device @s. @fn()
- * runs in the AioContext that is executing the request.
+ * runs in the AioContext that is executing the request, so one BH is
+ * scheduled for every AioContext that currently has requests.
  */
 static void scsi_device_for_each_req_async(SCSIDevice *s,
                                            void (*fn)(SCSIRequest *, void *),
                                            void *opaque)
 {
+    g_autoptr(GHashTable) aio_contexts = g_hash_table_new(NULL, NULL);
+    GHashTableIter iter;
+    gpointer key;
+
     assert(qemu_in_main_thread());
 
-    SCSIDeviceForEachReqAsyncData *data =
-        g_new(SCSIDeviceForEachReqAsyncData, 1);
+    WITH_QEMU_LOCK_GUARD(&s->requests_lock) {
+        SCSIRequest *req;
 
-    data->s = s;
-    data->fn = fn;
-    data->fn_opaque = opaque;
+        QTAILQ_FOREACH(req, &s->requests, next) {
+            g_hash_table_add(aio_contexts, req->ctx);
+        }
+    }
 
-    /*
-     * Hold a reference to the SCSIDevice until
-     * scsi_device_for_each_req_async_bh() finishes.
-     */
-    object_ref(OBJECT(s));
+    g_hash_table_iter_init(&iter, aio_contexts);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        AioContext *ctx = key;
+        SCSIDeviceForEachReqAsyncData *data =
+            g_new(SCSIDeviceForEachReqAsyncData, 1);
+
+        data->s = s;
+        data->fn = fn;
+        data->fn_opaque = opaque;
 
-    aio_bh_schedule_oneshot(blk_get_aio_context(s->conf.blk),
-                            scsi_device_for_each_req_async_bh,
-                            data);
+        /*
+         * Hold a reference to the SCSIDevice until
+         * scsi_device_for_each_req_async_bh() finishes, and keep the
+         * BlockBackend busy so that blk_drain() waits for the BH.
+         */
+        object_ref(OBJECT(s));
+        blk_inc_in_flight(s->conf.blk);
+
+        aio_bh_schedule_oneshot(ctx, scsi_device_for_each_req_async_bh, data);
+    }
 }
 
 static void scsi_device_realize(SCSIDevice *s, Error **errp)
@@ -787,6 +815,7 @@ SCSIRequest *scsi_req_alloc(const SCSIReqOps *reqops, SCSIDevice *d,
     req->status = -1;
     req->host_status = -1;
     req->ops = reqops;
+    req->ctx = qemu_get_current_aio_context();
     object_ref(OBJECT(d));
     object_ref(OBJECT(qbus->parent));
     notifier_list_init(&req->cancel_notifiers);
@@ -959,7 +988,10 @@ static void scsi_req_enqueue_internal(SCSIRequest *req)
         req->sg = NULL;
     }
     req->enqueued = true;
-    QTAILQ_INSERT_TAIL(&req->dev->requests, req, next);
+
+    WITH_QEMU_LOCK_GUARD(&req->dev->requests_lock) {
+        QTAILQ_INSERT_TAIL(&req->dev->requests, req, next);
+    }
 }
 
 int32_t scsi_req_enqueue(SCSIRequest *req)
@@ -979,7 +1011,9 @@ static void scsi_req_dequeue(SCSIRequest *req)
     trace_scsi_req_dequeue(req->dev->id, req->lun, req->tag);
     req->retry = false;
     if (req->enqueued) {
-        QTAILQ_REMOVE(&req->dev->requests, req, next);
+        WITH_QEMU_LOCK_GUARD(&req->dev->requests_lock) {
+            QTAILQ_REMOVE(&req->dev->requests, req, next);
+        }
         req->enqueued = false;
         scsi_req_unref(req);
     }
@@ -1954,6 +1988,14 @@ static void scsi_dev_instance_init(Object *obj)
     device_add_bootindex_property(obj, &s->conf.bootindex,
                                   "bootindex", NULL,
                                   &s->qdev);
+    qemu_mutex_init(&s->requests_lock);
+}
+
+static void scsi_dev_instance_finalize(Object *obj)
+{
+    SCSIDevice *s = SCSI_DEVICE(obj);
+
+    qemu_mutex_destroy(&s->requests_lock);
 }
 
 static const TypeInfo scsi_device_type_info = {
@@ -1964,6 +2006,7 @@ static const TypeInfo scsi_device_type_info = {
     .class_size = sizeof(SCSIDeviceClass),
     .class_init = scsi_device_class_init,
     .instance_init = scsi_dev_instance_init,
+    .instance_finalize = scsi_dev_instance_finalize,
 };
 
 static void scsi_bus_class_init(ObjectClass *klass, void *data)
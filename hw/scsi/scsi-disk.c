@@ -84,6 +84,7 @@ typedef struct SCSIDiskReq {
 #define SCSI_DISK_F_REMOVABLE             0
 #define SCSI_DISK_F_DPOFUA                1
 #define SCSI_DISK_F_NO_REMOVABLE_DEVOPS   2
+#define SCSI_DISK_F_NATIVE_RW             3
 
 struct SCSIDiskState {
     SCSIDevice qdev;
@@ -273,9 +274,8 @@ static void scsi_aio_complete(void *opaque, int ret)
     SCSIDiskReq *r = (SCSIDiskReq *)opaque;
     SCSIDiskState *s = DO_UPCAST(SCSIDiskState, qdev, r->req.dev);
 
-    /* The request must only run in the BlockBackend's AioContext */
-    assert(blk_get_aio_context(s->qdev.conf.blk) ==
-           qemu_get_current_aio_context());
+    /* The request must only run in its own AioContext */
+    assert(r->req.ctx == qemu_get_current_aio_context());
 
     assert(r->req.aiocb != NULL);
     r->req.aiocb = NULL;
@@ -376,9 +376,8 @@ static void scsi_read_complete_noio(SCSIDiskReq *r, int ret)
     SCSIDiskState *s = DO_UPCAST(SCSIDiskState, qdev, r->req.dev);
     uint32_t n;
 
-    /* The request must only run in the BlockBackend's AioContext */
-    assert(blk_get_aio_context(s->qdev.conf.blk) ==
-           qemu_get_current_aio_context());
+    /* The request must only run in its own AioContext */
+    assert(r->req.ctx == qemu_get_current_aio_context());
 
     assert(r->req.aiocb == NULL);
     if (scsi_disk_req_check_error(r, ret, false)) {
@@ -428,7 +427,7 @@ static void scsi_do_read(SCSIDiskReq *r, int ret)
     if (r->req.sg) {
         dma_acct_start(s->qdev.conf.blk, &r->acct, r->req.sg, BLOCK_ACCT_READ);
         r->req.residual -= r->req.sg->size;
-        r->req.aiocb = dma_blk_io(blk_get_aio_context(s->qdev.conf.blk),
+        r->req.aiocb = dma_blk_io(r->req.ctx,
                                   r->req.sg, r->sector << BDRV_SECTOR_BITS,
                                   BDRV_SECTOR_SIZE,
                                   sdc->dma_readv, r, scsi_dma_complete, r,
@@ -507,9 +506,8 @@ static void scsi_write_complete_noio(SCSIDiskReq *r, int ret)
     SCSIDiskState *s = DO_UPCAST(SCSIDiskState, qdev, r->req.dev);
     uint32_t n;
 
-    /* The request must only run in the BlockBackend's AioContext */
-    assert(blk_get_aio_context(s->qdev.conf.blk) ==
-           qemu_get_current_aio_context());
+    /* The request must only run in its own AioContext */
+    assert(r->req.ctx == qemu_get_current_aio_context());
 
     assert (r->req.aiocb == NULL);
     if (scsi_disk_req_check_error(r, ret, false)) {
@@ -589,7 +587,7 @@ static void scsi_write_data(SCSIRequest *req)
     if (r->req.sg) {
         dma_acct_start(s->qdev.conf.blk, &r->acct, r->req.sg, BLOCK_ACCT_WRITE);
         r->req.residual -= r->req.sg->size;
-        r->req.aiocb = dma_blk_io(blk_get_aio_context(s->qdev.conf.blk),
+        r->req.aiocb = dma_blk_io(r->req.ctx,
                                   r->req.sg, r->sector << BDRV_SECTOR_BITS,
                                   BDRV_SECTOR_SIZE,
                                   sdc->dma_writev, r, scsi_dma_complete, r,
@@ -2904,12 +2902,55 @@ static bool scsi_block_no_fua(SCSICommand *cmd)
     return false;
 }
 
+/*
+ * Plain READ and WRITE commands to a disk can be submitted as ordinary
+ * block layer requests instead of SG_IO.  They then go through the host
+ * device's AIO engine (linux-aio or io_uring) rather than an ioctl in the
+ * thread pool.  The price is that errors are reported with sense data
+ * built from the errno, not the one returned by the device, so this is
+ * only done if the user asked for it with native-rw=on.
+ */
+static bool scsi_block_use_native_rw(SCSIBlockReq *r)
+{
+    SCSIDiskState *s = DO_UPCAST(SCSIDiskState, qdev, r->req.req.dev);
+
+    if (!(s->features & (1 << SCSI_DISK_F_NATIVE_RW)) ||
+        s->qdev.type != TYPE_DISK) {
+        return false;
+    }
+
+    switch (r->cmd) {
+    case READ_6:
+    case READ_10:
+    case READ_12:
+    case READ_16:
+    case WRITE_6:
+    case WRITE_10:
+    case WRITE_12:
+    case WRITE_16:
+        break;
+    default:
+        return false;
+    }
+
+    /* Only DPO and FUA may be set; group numbers are hints for the device */
+    return !(r->cdb1 & ~0x18) && r->group_number == 0;
+}
+
 static BlockAIOCB *scsi_block_dma_readv(int64_t offset,
                                         QEMUIOVector *iov,
                                         BlockCompletionFunc *cb, void *cb_opaque,
                                         void *opaque)
 {
     SCSIBlockReq *r = opaque;
+    SCSIDiskState *s = DO_UPCAST(SCSIDiskState, qdev, r->req.req.dev);
+
+    if (scsi_block_use_native_rw(r)) {
+        trace_scsi_disk_aio_native_rw(r->req.req.tag, r->cmd, offset,
+                                      iov->size);
+        return blk_aio_preadv(s->qdev.conf.blk, offset, iov, 0,
+                              cb, cb_opaque);
+    }
     return scsi_block_do_sgio(r, offset, iov,
                               SG_DXFER_FROM_DEV, cb, cb_opaque);
 }
@@ -2920,6 +2961,17 @@ static BlockAIOCB *scsi_block_dma_writev(int64_t offset,
                                          void *opaque)
 {
     SCSIBlockReq *r = opaque;
+    SCSIDiskState *s = DO_UPCAST(SCSIDiskState, qdev, r->req.req.dev);
+
+    if (scsi_block_use_native_rw(r)) {
+        /* need_fua_emulation is off for scsi-block, so pass FUA down */
+        BdrvRequestFlags flags = (r->cdb1 & 0x08) ? BDRV_REQ_FUA : 0;
+
+        trace_scsi_disk_aio_native_rw(r->req.req.tag, r->cmd, offset,
+                                      iov->size);
+        return blk_aio_pwritev(s->qdev.conf.blk, offset, iov, flags,
+                               cb, cb_opaque);
+    }
     return scsi_block_do_sgio(r, offset, iov,
                               SG_DXFER_TO_DEV, cb, cb_opaque);
 }
@@ -3222,6 +3274,8 @@ static Property scsi_block_properties[] = {
                       -1),
     DEFINE_PROP_UINT32("io_timeout", SCSIDiskState, qdev.io_timeout,
                        DEFAULT_IO_TIMEOUT),
+    DEFINE_PROP_BIT("native-rw", SCSIDiskState, features,
+                    SCSI_DISK_F_NATIVE_RW, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -684,6 +684,46 @@ static void xhci_event(XHCIState *xhci, XHCIEvent *event, int v)
     xhci_intr_raise(xhci, v);
 }
 
+/*
+ * The guest may produce new TRBs at any time, so read-ahead data must not
+ * outlive the kick that read it: a TRB that was not yet valid then has to be
+ * read again when the doorbell is rung for it.
+ */
+static void xhci_trb_cache_flush(XHCIState *xhci)
+{
+    xhci->trb_cache_len = 0;
+}
+
+/*
+ * Read the TRB at @addr. On a miss, the rest of the naturally aligned
+ * XHCI_RING_PREFETCH_BYTES block is read in the same DMA access. Aligned
+ * blocks never cross a page, and both xhci_ring_chain_length() and
+ * xhci_ring_fetch() then walk the same TRBs without another access.
+ */
+static MemTxResult xhci_read_trb(XHCIState *xhci, dma_addr_t addr,
+                                 XHCITRB *trb)
+{
+    dma_addr_t len;
+
+    if (addr < xhci->trb_cache_base ||
+        addr - xhci->trb_cache_base + TRB_SIZE > xhci->trb_cache_len) {
+        len = XHCI_RING_PREFETCH_BYTES - (addr % XHCI_RING_PREFETCH_BYTES);
+        xhci->trb_cache_len = 0;
+        if (len < TRB_SIZE ||
+            dma_memory_read(xhci->as, addr, xhci->trb_cache, len,
+                            MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+            /* Misaligned, or the rest of the block is not readable */
+            return dma_memory_read(xhci->as, addr, trb, TRB_SIZE,
+                                   MEMTXATTRS_UNSPECIFIED);
+        }
+        xhci->trb_cache_base = addr;
+        xhci->trb_cache_len = len;
+    }
+
+    memcpy(trb, xhci->trb_cache + (addr - xhci->trb_cache_base), TRB_SIZE);
+    return MEMTX_OK;
+}
+
 static void xhci_ring_init(XHCIState *xhci, XHCIRing *ring,
                            dma_addr_t base)
 {
@@ -698,8 +738,7 @@ static TRBType xhci_ring_fetch(XHCIState *xhci, XHCIRing *ring, XHCITRB *trb,
 
     while (1) {
         TRBType type;
-        if (dma_memory_read(xhci->as, ring->dequeue, trb, TRB_SIZE,
-                            MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        if (xhci_read_trb(xhci, ring->dequeue, trb) != MEMTX_OK) {
             qemu_log_mask(LOG_GUEST_ERROR, "%s: DMA memory access failed!\n",
                           __func__);
             return 0;
@@ -750,8 +789,7 @@ static int xhci_ring_chain_length(XHCIState *xhci, const XHCIRing *ring)
 
     do {
         TRBType type;
-        if (dma_memory_read(xhci->as, dequeue, &trb, TRB_SIZE,
-                        MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        if (xhci_read_trb(xhci, dequeue, &trb) != MEMTX_OK) {
             qemu_log_mask(LOG_GUEST_ERROR, "%s: DMA memory access failed!\n",
                           __func__);
             return -1;
@@ -1886,6 +1924,7 @@ static void xhci_kick_epctx(XHCIEPContext *epctx, unsigned int streamid)
 
     trace_usb_xhci_ep_kick(epctx->slotid, epctx->epid, streamid);
     assert(!epctx->kick_active);
+    xhci_trb_cache_flush(xhci);
 
     /* If the device has been detached, but the guest has not noticed this
        yet the 2 above checks will succeed, but we must NOT continue */
@@ -2484,6 +2523,7 @@ static void xhci_process_commands(XHCIState *xhci)
     }
 
     xhci->crcr_low |= CRCR_CRR;
+    xhci_trb_cache_flush(xhci);
 
     while ((type = xhci_ring_fetch(xhci, &xhci->cmd_ring, &trb, &addr))) {
         event.ptr = addr;
@@ -2710,6 +2750,7 @@ static void xhci_reset(DeviceState *dev)
     xhci->dcbaap_low = 0;
     xhci->dcbaap_high = 0;
     xhci->config = 0;
+    xhci_trb_cache_flush(xhci);
 
     for (i = 0; i < xhci->numslots; i++) {
         xhci_disable_slot(xhci, i+1);
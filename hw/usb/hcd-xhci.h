@@ -117,6 +117,9 @@ typedef enum TRBCCode {
     CC_SPLIT_TRANSACTION_ERROR
 } TRBCCode;
 
+/* Bytes of a transfer or command ring that are read ahead in one access */
+#define XHCI_RING_PREFETCH_BYTES 512
+
 typedef struct XHCIRing {
     dma_addr_t dequeue;
     bool ccs;
@@ -219,6 +222,14 @@ typedef struct XHCIState {
 
     XHCIRing cmd_ring;
 
+    /*
+     * Ring memory read ahead by xhci_read_trb(). Only valid during a single
+     * endpoint kick or command ring run, see xhci_trb_cache_flush().
+     */
+    dma_addr_t trb_cache_base;
+    uint32_t trb_cache_len;
+    uint8_t trb_cache[XHCI_RING_PREFETCH_BYTES];
+
     bool nec_quirks;
 } XHCIState;
 
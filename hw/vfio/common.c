@@ -567,6 +567,62 @@ static bool vfio_get_section_iova_range(VFIOContainerBase *bcontainer,
     return true;
 }
 
+static void vfio_container_dma_unmap_report(VFIOContainerBase *bcontainer,
+                                            hwaddr iova, hwaddr size)
+{
+    int ret = vfio_container_dma_unmap(bcontainer, iova, size, NULL);
+
+    if (ret) {
+        error_report("vfio_container_dma_unmap(%p, 0x%"HWADDR_PRIx", "
+                     "0x%"HWADDR_PRIx") = %d (%s)",
+                     bcontainer, iova, size, ret, strerror(-ret));
+    }
+}
+
+/*
+ * Sections removed by one memory transaction are usually adjacent, e.g. when
+ * a memory device is unplugged or a large RAM region is split.  Instead of
+ * one unmap ioctl per section, accumulate a run of adjacent ranges and unmap
+ * it at once; both the type1 and the iommufd backends accept a range that
+ * covers several complete mappings.  The run is flushed at commit time and
+ * before anything is mapped, so a new mapping never overlaps a stale one.
+ */
+static void vfio_listener_flush_unmap(VFIOContainerBase *bcontainer)
+{
+    if (!bcontainer->pending_unmap_size) {
+        return;
+    }
+
+    trace_vfio_listener_flush_unmap(bcontainer->pending_unmap_iova,
+                                    bcontainer->pending_unmap_size);
+    vfio_container_dma_unmap_report(bcontainer, bcontainer->pending_unmap_iova,
+                                    bcontainer->pending_unmap_size);
+    bcontainer->pending_unmap_size = 0;
+}
+
+static void vfio_listener_defer_unmap(VFIOContainerBase *bcontainer,
+                                      hwaddr iova, hwaddr size)
+{
+    if (bcontainer->pending_unmap_size &&
+        bcontainer->pending_unmap_iova + bcontainer->pending_unmap_size ==
+        iova) {
+        bcontainer->pending_unmap_size += size;
+        return;
+    }
+
+    vfio_listener_flush_unmap(bcontainer);
+    bcontainer->pending_unmap_iova = iova;
+    bcontainer->pending_unmap_size = size;
+}
+
+static void vfio_listener_commit(MemoryListener *listener)
+{
+    VFIOContainerBase *bcontainer = container_of(listener, VFIOContainerBase,
+                                                 listener);
+
+    vfio_listener_flush_unmap(bcontainer);
+}
+
 static void vfio_listener_region_add(MemoryListener *listener,
                                      MemoryRegionSection *section)
 {
@@ -582,6 +638,8 @@ static void vfio_listener_region_add(MemoryListener *listener,
         return;
     }
 
+    vfio_listener_flush_unmap(bcontainer);
+
     if (!vfio_get_section_iova_range(bcontainer, section, &iova, &end,
                                      &llend)) {
         if (memory_region_is_ram_device(section->mr)) {
@@ -739,7 +797,6 @@ static void vfio_listener_region_del(MemoryListener *listener,
                                                  listener);
     hwaddr iova, end;
     Int128 llend, llsize;
-    int ret;
     bool try_unmap = true;
 
     if (!vfio_listener_valid_section(section, "region_del")) {
@@ -792,24 +849,20 @@ static void vfio_listener_region_del(MemoryListener *listener,
     if (try_unmap) {
         if (int128_eq(llsize, int128_2_64())) {
             /* The unmap ioctl doesn't accept a full 64-bit span. */
+            vfio_listener_flush_unmap(bcontainer);
             llsize = int128_rshift(llsize, 1);
-            ret = vfio_container_dma_unmap(bcontainer, iova,
-                                           int128_get64(llsize), NULL);
-            if (ret) {
-                error_report("vfio_container_dma_unmap(%p, 0x%"HWADDR_PRIx", "
-                             "0x%"HWADDR_PRIx") = %d (%s)",
-                             bcontainer, iova, int128_get64(llsize), ret,
-                             strerror(-ret));
-            }
+            vfio_container_dma_unmap_report(bcontainer, iova,
+                                            int128_get64(llsize));
             iova += int128_get64(llsize);
-        }
-        ret = vfio_container_dma_unmap(bcontainer, iova,
-                                       int128_get64(llsize), NULL);
-        if (ret) {
-            error_report("vfio_container_dma_unmap(%p, 0x%"HWADDR_PRIx", "
-                         "0x%"HWADDR_PRIx") = %d (%s)",
-                         bcontainer, iova, int128_get64(llsize), ret,
-                         strerror(-ret));
+            vfio_container_dma_unmap_report(bcontainer, iova,
+                                            int128_get64(llsize));
+        } else if (bcontainer->ops->del_window) {
+            /* The window goes away below, so the unmap can't wait */
+            vfio_listener_flush_unmap(bcontainer);
+            vfio_container_dma_unmap_report(bcontainer, iova,
+                                            int128_get64(llsize));
+        } else {
+            vfio_listener_defer_unmap(bcontainer, iova, int128_get64(llsize));
         }
     }
 
@@ -1357,6 +1410,7 @@ const MemoryListener vfio_memory_listener = {
     .name = "vfio",
     .region_add = vfio_listener_region_add,
     .region_del = vfio_listener_region_del,
+    .commit = vfio_listener_commit,
     .log_global_start = vfio_listener_log_global_start,
     .log_global_stop = vfio_listener_log_global_stop,
     .log_sync = vfio_listener_log_sync,
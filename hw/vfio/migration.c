@@ -12,6 +12,8 @@
 #include "qemu/cutils.h"
 #include "qemu/units.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/timer.h"
 #include <linux/vfio.h>
 #include <sys/ioctl.h>
 
@@ -58,6 +60,102 @@
 
 static int64_t bytes_transferred;
 
+/*
+ * With x-migration-async-buffer set, device data is moved between the data_fd
+ * and the migration stream by a helper thread per device.  On the source the
+ * thread starts reading the device state as soon as the VM is stopped for
+ * switchover, so that devices are drained in parallel with each other and
+ * with the final RAM pass, and save_live_complete_precopy only copies buffered
+ * chunks to the stream.  On the destination load_state queues the chunks and
+ * the thread writes them to the device.  The stream format is unchanged, so
+ * both sides can enable this independently.  async_lock protects the queue;
+ * async_queued bounds the allocation to the property value (at least one
+ * chunk is always allowed).
+ */
+typedef struct VFIOMigrationChunk {
+    QSIMPLEQ_ENTRY(VFIOMigrationChunk) next;
+    size_t size;
+    uint8_t data[];
+} VFIOMigrationChunk;
+
+static bool vfio_migration_async_enabled(VFIODevice *vbasedev)
+{
+    return vbasedev->migration_async_buffer != 0;
+}
+
+/* Called with async_lock held */
+static bool vfio_migration_async_full(VFIOMigration *migration, size_t size)
+{
+    return migration->async_queued &&
+           migration->async_queued + size >
+           migration->vbasedev->migration_async_buffer;
+}
+
+/* Called with async_lock held */
+static void vfio_migration_async_push(VFIOMigration *migration,
+                                      VFIOMigrationChunk *chunk)
+{
+    QSIMPLEQ_INSERT_TAIL(&migration->async_chunks, chunk, next);
+    migration->async_queued += chunk->size;
+    qemu_cond_broadcast(&migration->async_cond);
+}
+
+/* Called with async_lock held */
+static VFIOMigrationChunk *vfio_migration_async_pop(VFIOMigration *migration)
+{
+    VFIOMigrationChunk *chunk = QSIMPLEQ_FIRST(&migration->async_chunks);
+
+    if (chunk) {
+        QSIMPLEQ_REMOVE_HEAD(&migration->async_chunks, next);
+        migration->async_queued -= chunk->size;
+        qemu_cond_broadcast(&migration->async_cond);
+    }
+
+    return chunk;
+}
+
+static void vfio_migration_async_start(VFIOMigration *migration,
+                                       const char *name,
+                                       void *(*fn)(void *))
+{
+    assert(!migration->async_active);
+
+    migration->async_queued = 0;
+    migration->async_busy = false;
+    migration->async_done = false;
+    migration->async_cancel = false;
+    migration->async_ret = 0;
+    migration->async_start_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    migration->async_bytes = 0;
+    migration->async_active = true;
+
+    qemu_thread_create(&migration->async_thread, name, fn, migration,
+                       QEMU_THREAD_JOINABLE);
+}
+
+/* Stop the helper thread and drop any data it has not handed over yet */
+static void vfio_migration_async_stop(VFIOMigration *migration)
+{
+    VFIOMigrationChunk *chunk;
+
+    if (!migration->async_active) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&migration->async_lock) {
+        migration->async_cancel = true;
+        qemu_cond_broadcast(&migration->async_cond);
+    }
+    qemu_thread_join(&migration->async_thread);
+
+    while ((chunk = QSIMPLEQ_FIRST(&migration->async_chunks))) {
+        QSIMPLEQ_REMOVE_HEAD(&migration->async_chunks, next);
+        g_free(chunk);
+    }
+    migration->async_queued = 0;
+    migration->async_active = false;
+}
+
 static const char *mig_state_to_str(enum vfio_device_mig_state state)
 {
     switch (state) {
@@ -176,13 +274,110 @@ vfio_migration_set_state_or_reset(VFIODevice *vbasedev,
                                     VFIO_DEVICE_STATE_ERROR);
 }
 
+static void *vfio_load_async_thread(void *opaque)
+{
+    VFIOMigration *migration = opaque;
+    VFIOMigrationChunk *chunk;
+
+    QEMU_LOCK_GUARD(&migration->async_lock);
+    while (!migration->async_cancel) {
+        int ret = 0;
+
+        chunk = vfio_migration_async_pop(migration);
+        if (!chunk) {
+            qemu_cond_wait(&migration->async_cond, &migration->async_lock);
+            continue;
+        }
+
+        /* After an error, keep consuming so that load_state never blocks */
+        if (!migration->async_ret) {
+            migration->async_busy = true;
+            qemu_mutex_unlock(&migration->async_lock);
+
+            if (qemu_write_full(migration->data_fd, chunk->data,
+                                chunk->size) != chunk->size) {
+                ret = -errno;
+            }
+
+            qemu_mutex_lock(&migration->async_lock);
+            migration->async_busy = false;
+            migration->async_ret = ret;
+            qemu_cond_broadcast(&migration->async_cond);
+        }
+        g_free(chunk);
+    }
+
+    return NULL;
+}
+
+/* Wait until all queued data was written to the device */
+static int vfio_load_async_flush(VFIOMigration *migration)
+{
+    if (!migration->async_active) {
+        return 0;
+    }
+
+    QEMU_LOCK_GUARD(&migration->async_lock);
+    while (!QSIMPLEQ_EMPTY(&migration->async_chunks) ||
+           migration->async_busy) {
+        qemu_cond_wait(&migration->async_cond, &migration->async_lock);
+    }
+
+    return migration->async_ret;
+}
+
+static int vfio_load_buffer_async(QEMUFile *f, VFIOMigration *migration,
+                                  uint64_t data_size)
+{
+    while (data_size) {
+        size_t size = MIN(data_size, VFIO_MIG_DEFAULT_DATA_BUFFER_SIZE);
+        VFIOMigrationChunk *chunk;
+        int ret;
+
+        WITH_QEMU_LOCK_GUARD(&migration->async_lock) {
+            while (!migration->async_ret &&
+                   vfio_migration_async_full(migration, size)) {
+                qemu_cond_wait(&migration->async_cond, &migration->async_lock);
+            }
+            ret = migration->async_ret;
+        }
+        if (ret) {
+            return ret;
+        }
+
+        chunk = g_try_malloc(sizeof(*chunk) + size);
+        if (!chunk) {
+            return -ENOMEM;
+        }
+
+        chunk->size = size;
+        qemu_get_buffer(f, chunk->data, size);
+        ret = qemu_file_get_error(f);
+        if (ret) {
+            g_free(chunk);
+            return ret;
+        }
+
+        WITH_QEMU_LOCK_GUARD(&migration->async_lock) {
+            vfio_migration_async_push(migration, chunk);
+        }
+        data_size -= size;
+    }
+
+    return 0;
+}
+
 static int vfio_load_buffer(QEMUFile *f, VFIODevice *vbasedev,
                             uint64_t data_size)
 {
     VFIOMigration *migration = vbasedev->migration;
     int ret;
 
-    ret = qemu_file_get_to_fd(f, migration->data_fd, data_size);
+    if (migration->async_active) {
+        ret = vfio_load_buffer_async(f, migration, data_size);
+    } else {
+        ret = qemu_file_get_to_fd(f, migration->data_fd, data_size);
+    }
     trace_vfio_load_state_device_data(vbasedev->name, data_size, ret);
 
     return ret;
@@ -209,10 +404,17 @@ static int vfio_load_device_config_state(QEMUFile *f, void *opaque)
 {
     VFIODevice *vbasedev = opaque;
     uint64_t data;
+    int ret;
 
-    if (vbasedev->ops && vbasedev->ops->vfio_load_config) {
-        int ret;
+    /* The device state must be complete before config space is restored */
+    ret = vfio_load_async_flush(vbasedev->migration);
+    if (ret) {
+        error_report("%s: Failed to write device state, err: %s",
+                     vbasedev->name, strerror(-ret));
+        return ret;
+    }
 
+    if (vbasedev->ops && vbasedev->ops->vfio_load_config) {
         ret = vbasedev->ops->vfio_load_config(vbasedev, f);
         if (ret) {
             error_report("%s: Failed to load device config space",
@@ -314,6 +516,89 @@ static ssize_t vfio_save_block(QEMUFile *f, VFIOMigration *migration)
     return qemu_file_get_error(f) ?: data_size;
 }
 
+static void *vfio_save_async_thread(void *opaque)
+{
+    VFIOMigration *migration = opaque;
+    size_t size = migration->data_buffer_size;
+    int ret = 0;
+
+    while (true) {
+        VFIOMigrationChunk *chunk;
+        ssize_t data_size;
+        bool cancel;
+
+        WITH_QEMU_LOCK_GUARD(&migration->async_lock) {
+            while (!migration->async_cancel &&
+                   vfio_migration_async_full(migration, size)) {
+                qemu_cond_wait(&migration->async_cond, &migration->async_lock);
+            }
+            cancel = migration->async_cancel;
+        }
+        if (cancel) {
+            break;
+        }
+
+        chunk = g_try_malloc(sizeof(*chunk) + size);
+        if (!chunk) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        data_size = read(migration->data_fd, chunk->data, size);
+        if (data_size <= 0) {
+            /* ENOMSG: see vfio_save_block() */
+            ret = data_size < 0 && errno != ENOMSG ? -errno : 0;
+            g_free(chunk);
+            break;
+        }
+
+        chunk->size = data_size;
+        WITH_QEMU_LOCK_GUARD(&migration->async_lock) {
+            vfio_migration_async_push(migration, chunk);
+        }
+    }
+
+    QEMU_LOCK_GUARD(&migration->async_lock);
+    migration->async_ret = ret;
+    migration->async_done = true;
+    qemu_cond_broadcast(&migration->async_cond);
+
+    return NULL;
+}
+
+/*
+ * Like vfio_save_block(), but with data prefetched by vfio_save_async_thread().
+ * Returns the size of saved data on success and -errno on error.
+ */
+static ssize_t vfio_save_async_block(QEMUFile *f, VFIOMigration *migration)
+{
+    VFIOMigrationChunk *chunk;
+    ssize_t data_size;
+
+    WITH_QEMU_LOCK_GUARD(&migration->async_lock) {
+        while (QSIMPLEQ_EMPTY(&migration->async_chunks) &&
+               !migration->async_done) {
+            qemu_cond_wait(&migration->async_cond, &migration->async_lock);
+        }
+        chunk = vfio_migration_async_pop(migration);
+        if (!chunk) {
+            return migration->async_ret;
+        }
+    }
+
+    data_size = chunk->size;
+    qemu_put_be64(f, VFIO_MIG_FLAG_DEV_DATA_STATE);
+    qemu_put_be64(f, data_size);
+    qemu_put_buffer(f, chunk->data, data_size);
+    g_free(chunk);
+    bytes_transferred += data_size;
+    migration->async_bytes += data_size;
+
+    trace_vfio_save_block(migration->vbasedev->name, data_size);
+
+    return qemu_file_get_error(f) ?: data_size;
+}
+
 static void vfio_update_estimated_pending_data(VFIOMigration *migration,
                                                uint64_t data_size)
 {
@@ -430,6 +715,8 @@ static void vfio_save_cleanup(void *opaque)
     VFIODevice *vbasedev = opaque;
     VFIOMigration *migration = vbasedev->migration;
 
+    vfio_migration_async_stop(migration);
+
     /*
      * Changing device state from STOP_COPY to STOP can take time. Do it here,
      * after migration has completed, so it won't increase downtime.
@@ -539,22 +826,39 @@ static int vfio_save_iterate(QEMUFile *f, void *opaque)
 static int vfio_save_complete_precopy(QEMUFile *f, void *opaque)
 {
     VFIODevice *vbasedev = opaque;
+    VFIOMigration *migration = vbasedev->migration;
     ssize_t data_size;
     int ret;
 
-    /* We reach here with device state STOP or STOP_COPY only */
-    ret = vfio_migration_set_state(vbasedev, VFIO_DEVICE_STATE_STOP_COPY,
-                                   VFIO_DEVICE_STATE_STOP);
-    if (ret) {
-        return ret;
-    }
+    if (migration->async_active) {
+        /* vfio_vmstate_change() already went to STOP_COPY */
+        do {
+            data_size = vfio_save_async_block(f, migration);
+            if (data_size < 0) {
+                return data_size;
+            }
+        } while (data_size);
 
-    do {
-        data_size = vfio_save_block(f, vbasedev->migration);
-        if (data_size < 0) {
-            return data_size;
+        vfio_migration_async_stop(migration);
+        trace_vfio_save_complete_precopy_async(
+            vbasedev->name, migration->async_bytes,
+            qemu_clock_get_us(QEMU_CLOCK_REALTIME) -
+            migration->async_start_us);
+    } else {
+        /* We reach here with device state STOP or STOP_COPY only */
+        ret = vfio_migration_set_state(vbasedev, VFIO_DEVICE_STATE_STOP_COPY,
+                                       VFIO_DEVICE_STATE_STOP);
+        if (ret) {
+            return ret;
         }
-    } while (data_size);
+
+        do {
+            data_size = vfio_save_block(f, migration);
+            if (data_size < 0) {
+                return data_size;
+            }
+        } while (data_size);
+    }
 
     qemu_put_be64(f, VFIO_MIG_FLAG_END_OF_STATE);
     ret = qemu_file_get_error(f);
@@ -583,15 +887,27 @@ static void vfio_save_state(QEMUFile *f, void *opaque)
 static int vfio_load_setup(QEMUFile *f, void *opaque)
 {
     VFIODevice *vbasedev = opaque;
+    int ret;
 
-    return vfio_migration_set_state(vbasedev, VFIO_DEVICE_STATE_RESUMING,
+    ret = vfio_migration_set_state(vbasedev, VFIO_DEVICE_STATE_RESUMING,
                                    vbasedev->migration->device_state);
+    if (ret) {
+        return ret;
+    }
+
+    if (vfio_migration_async_enabled(vbasedev)) {
+        vfio_migration_async_start(vbasedev->migration, "vfio-load",
+                                   vfio_load_async_thread);
+    }
+
+    return 0;
 }
 
 static int vfio_load_cleanup(void *opaque)
 {
     VFIODevice *vbasedev = opaque;
 
+    vfio_migration_async_stop(vbasedev->migration);
     vfio_migration_cleanup(vbasedev);
     trace_vfio_load_cleanup(vbasedev->name);
 
@@ -647,6 +963,12 @@ static int vfio_load_state(QEMUFile *f, void *opaque, int version_id)
                 return -EINVAL;
             }
 
+            /* The initial data must have reached the device */
+            ret = vfio_load_async_flush(vbasedev->migration);
+            if (ret) {
+                return ret;
+            }
+
             ret = qemu_loadvm_approve_switchover();
             if (ret) {
                 error_report(
@@ -723,6 +1045,17 @@ static void vfio_vmstate_change_prepare(void *opaque, bool running,
                                       mig_state_to_str(new_state));
 }
 
+/*
+ * Whether to start reading the device state as soon as the VM stops for
+ * switchover, see VFIOMigrationChunk.
+ */
+static bool vfio_save_async_wanted(VFIODevice *vbasedev, RunState state)
+{
+    return vfio_migration_async_enabled(vbasedev) &&
+           state == RUN_STATE_FINISH_MIGRATE &&
+           vbasedev->migration->data_buffer;
+}
+
 static void vfio_vmstate_change(void *opaque, bool running, RunState state)
 {
     VFIODevice *vbasedev = opaque;
@@ -731,6 +1064,8 @@ static void vfio_vmstate_change(void *opaque, bool running, RunState state)
 
     if (running) {
         new_state = VFIO_DEVICE_STATE_RUNNING;
+    } else if (vfio_save_async_wanted(vbasedev, state)) {
+        new_state = VFIO_DEVICE_STATE_STOP_COPY;
     } else {
         new_state =
             (vfio_device_state_is_precopy(vbasedev) &&
@@ -748,6 +1083,10 @@ static void vfio_vmstate_change(void *opaque, bool running, RunState state)
         if (migrate_get_current()->to_dst_file) {
             qemu_file_set_error(migrate_get_current()->to_dst_file, ret);
         }
+    } else if (vfio_save_async_wanted(vbasedev, state) &&
+               !vbasedev->migration->async_active) {
+        vfio_migration_async_start(vbasedev->migration, "vfio-save",
+                                   vfio_save_async_thread);
     }
 
     trace_vfio_vmstate_change(vbasedev->name, running, RunState_str(state),
@@ -774,6 +1113,8 @@ static void vfio_migration_state_notifier(Notifier *notifier, void *data)
 
 static void vfio_migration_free(VFIODevice *vbasedev)
 {
+    qemu_cond_destroy(&vbasedev->migration->async_cond);
+    qemu_mutex_destroy(&vbasedev->migration->async_lock);
     g_free(vbasedev->migration);
     vbasedev->migration = NULL;
 }
@@ -846,6 +1187,9 @@ static int vfio_migration_init(VFIODevice *vbasedev)
     migration->device_state = VFIO_DEVICE_STATE_RUNNING;
     migration->data_fd = -1;
     migration->mig_flags = mig_flags;
+    qemu_mutex_init(&migration->async_lock);
+    qemu_cond_init(&migration->async_cond);
+    QSIMPLEQ_INIT(&migration->async_chunks);
 
     vbasedev->dirty_pages_supported = vfio_dma_logging_supported(vbasedev);
 
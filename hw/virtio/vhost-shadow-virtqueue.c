@@ -210,17 +210,27 @@ static bool vhost_svq_add_split(VhostShadowVirtqueue *svq,
     avail->ring[avail_idx] = cpu_to_le16(*head);
     svq->shadow_avail_idx++;
 
-    /* Update the avail index after write the descriptor */
-    smp_wmb();
-    avail->idx = cpu_to_le16(svq->shadow_avail_idx);
-
     return true;
 }
 
+/**
+ * Expose to the device the entries added since the last kick, and kick it
+ * if it asked for it.
+ */
 static void vhost_svq_kick(VhostShadowVirtqueue *svq)
 {
+    uint16_t old = svq->kicked_avail_idx;
     bool needs_kick;
 
+    if (old == svq->shadow_avail_idx) {
+        return;
+    }
+
+    /* Update the avail index after write the descriptor */
+    smp_wmb();
+    svq->vring.avail->idx = cpu_to_le16(svq->shadow_avail_idx);
+    svq->kicked_avail_idx = svq->shadow_avail_idx;
+
     /*
      * We need to expose the available array entries before checking the used
      * flags
@@ -229,7 +239,7 @@ static void vhost_svq_kick(VhostShadowVirtqueue *svq)
 
     if (virtio_vdev_has_feature(svq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
         uint16_t avail_event = *(uint16_t *)(&svq->vring.used->ring[svq->vring.num]);
-        needs_kick = vring_need_event(avail_event, svq->shadow_avail_idx, svq->shadow_avail_idx - 1);
+        needs_kick = vring_need_event(avail_event, svq->shadow_avail_idx, old);
     } else {
         needs_kick = !(svq->vring.used->flags & VRING_USED_F_NO_NOTIFY);
     }
@@ -241,14 +251,10 @@ static void vhost_svq_kick(VhostShadowVirtqueue *svq)
     event_notifier_set(&svq->hdev_kick);
 }
 
-/**
- * Add an element to a SVQ.
- *
- * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
- */
-int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
-                  size_t out_num, const struct iovec *in_sg, size_t in_num,
-                  VirtQueueElement *elem)
+static int vhost_svq_add_nokick(VhostShadowVirtqueue *svq,
+                                const struct iovec *out_sg, size_t out_num,
+                                const struct iovec *in_sg, size_t in_num,
+                                VirtQueueElement *elem)
 {
     unsigned qemu_head;
     unsigned ndescs = in_num + out_num;
@@ -266,16 +272,33 @@ int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
     svq->num_free -= ndescs;
     svq->desc_state[qemu_head].elem = elem;
     svq->desc_state[qemu_head].ndescs = ndescs;
-    vhost_svq_kick(svq);
     return 0;
 }
 
-/* Convenience wrapper to add a guest's element to SVQ */
+/**
+ * Add an element to a SVQ.
+ *
+ * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
+ */
+int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
+                  size_t out_num, const struct iovec *in_sg, size_t in_num,
+                  VirtQueueElement *elem)
+{
+    int r = vhost_svq_add_nokick(svq, out_sg, out_num, in_sg, in_num, elem);
+
+    vhost_svq_kick(svq);
+    return r;
+}
+
+/*
+ * Convenience wrapper to add a guest's element to SVQ.  The device is
+ * kicked once per forwarding round, by vhost_handle_guest_kick().
+ */
 static int vhost_svq_add_element(VhostShadowVirtqueue *svq,
                                  VirtQueueElement *elem)
 {
-    return vhost_svq_add(svq, elem->out_sg, elem->out_num, elem->in_sg,
-                         elem->in_num, elem);
+    return vhost_svq_add_nokick(svq, elem->out_sg, elem->out_num, elem->in_sg,
+                                elem->in_num, elem);
 }
 
 /**
@@ -336,12 +359,15 @@ static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
                 }
 
                 /* VQ is full or broken, just return and ignore kicks */
+                vhost_svq_kick(svq);
                 return;
             }
             /* elem belongs to SVQ or external caller now */
             elem = NULL;
         }
 
+        /* Expose the whole batch to the device at once */
+        vhost_svq_kick(svq);
         virtio_queue_set_notification(svq->vq, true);
     } while (!virtio_queue_empty(svq->vq));
 }
@@ -501,7 +527,10 @@ static void vhost_svq_flush(VhostShadowVirtqueue *svq,
         }
 
         virtqueue_flush(vq, i);
-        event_notifier_set(&svq->svq_call);
+        /* Honour the guest's used event or interrupt suppression */
+        if (i && virtio_queue_should_notify(vq)) {
+            event_notifier_set(&svq->svq_call);
+        }
 
         if (check_for_avail_queue && svq->next_guest_avail_elem) {
             /*
@@ -662,6 +691,7 @@ void vhost_svq_start(VhostShadowVirtqueue *svq, VirtIODevice *vdev,
     event_notifier_set_handler(&svq->hdev_call, vhost_svq_handle_call);
     svq->next_guest_avail_elem = NULL;
     svq->shadow_avail_idx = 0;
+    svq->kicked_avail_idx = 0;
     svq->shadow_used_idx = 0;
     svq->last_used_idx = 0;
     svq->vdev = vdev;
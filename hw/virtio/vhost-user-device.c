@@ -209,6 +209,7 @@ static void vub_disconnect(DeviceState *dev)
         return;
     }
     vub->connected = false;
+    vhost_user_note_disconnect(&vub->vhost_user);
 
     if (vhost_dev_is_started(&vub->vhost_dev)) {
         vub_stop(vdev);
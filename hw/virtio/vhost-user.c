@@ -22,6 +22,7 @@
 #include "sysemu/kvm.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/timer.h"
 #include "qemu/uuid.h"
 #include "qemu/sockets.h"
 #include "sysemu/runstate.h"
@@ -658,10 +659,43 @@ static void scrub_shadow_regions(struct vhost_dev *dev,
     return;
 }
 
+/*
+ * Read the acknowledgements for @count messages of type @request that were
+ * sent without waiting for their replies.  All replies are consumed even
+ * after a failure, so that the channel stays in sync; the first error is
+ * returned.
+ */
+static int vhost_user_read_acks(struct vhost_dev *dev,
+                                VhostUserRequest request, int count)
+{
+    VhostUserMsg msg_reply;
+    int i, ret, err = 0;
+
+    for (i = 0; i < count; i++) {
+        ret = vhost_user_read(dev, &msg_reply);
+        if (ret < 0) {
+            return ret;
+        }
+
+        if (msg_reply.hdr.request != request) {
+            error_report("Received unexpected msg type. "
+                         "Expected %d received %d",
+                         request, msg_reply.hdr.request);
+            return -EPROTO;
+        }
+
+        if (msg_reply.payload.u64 && !err) {
+            err = -EIO;
+        }
+    }
+
+    return err;
+}
+
 static int send_remove_regions(struct vhost_dev *dev,
                                struct scrub_regions *remove_reg,
                                int nr_rem_reg, VhostUserMsg *msg,
-                               bool reply_supported)
+                               bool reply_supported, int *nr_acks)
 {
     struct vhost_user *u = dev->opaque;
     struct vhost_memory_region *shadow_reg;
@@ -690,17 +724,15 @@ static int send_remove_regions(struct vhost_dev *dev,
                 return ret;
             }
 
-            if (reply_supported) {
-                ret = process_message_reply(dev, msg);
-                if (ret) {
-                    return ret;
-                }
+            if (reply_supported &&
+                (msg->hdr.flags & VHOST_USER_NEED_REPLY_MASK)) {
+                (*nr_acks)++;
             }
         }
 
         /*
-         * At this point we know the backend has unmapped the region. It is now
-         * safe to remove it from the shadow table.
+         * The backend processes messages in order, so once the caller has
+         * collected the acknowledgements it has unmapped the region.
          */
         memmove(&u->shadow_regions[shadow_reg_idx],
                 &u->shadow_regions[shadow_reg_idx + 1],
@@ -715,7 +747,8 @@ static int send_remove_regions(struct vhost_dev *dev,
 static int send_add_regions(struct vhost_dev *dev,
                             struct scrub_regions *add_reg, int nr_add_reg,
                             VhostUserMsg *msg, uint64_t *shadow_pcb,
-                            bool reply_supported, bool track_ramblocks)
+                            bool reply_supported, bool track_ramblocks,
+                            int *nr_acks)
 {
     struct vhost_user *u = dev->opaque;
     int i, fd, ret, reg_idx, reg_fd_idx;
@@ -795,11 +828,9 @@ static int send_add_regions(struct vhost_dev *dev,
                                  dev->mem->regions[reg_idx].guest_phys_addr);
                     return -EPROTO;
                 }
-            } else if (reply_supported) {
-                ret = process_message_reply(dev, msg);
-                if (ret) {
-                    return ret;
-                }
+            } else if (reply_supported &&
+                       (msg->hdr.flags & VHOST_USER_NEED_REPLY_MASK)) {
+                (*nr_acks)++;
             }
         } else if (track_ramblocks) {
             u->region_rb_offset[reg_idx] = 0;
@@ -807,8 +838,9 @@ static int send_add_regions(struct vhost_dev *dev,
         }
 
         /*
-         * At this point, we know the backend has mapped in the new
-         * region, if the region has a valid file descriptor.
+         * Unless postcopy is in use, the backend may not have mapped the
+         * new region yet; the caller waits for all acknowledgements before
+         * the memory listener commit completes.
          *
          * The region should now be added to the shadow table.
          */
@@ -834,7 +866,8 @@ static int vhost_user_add_remove_regions(struct vhost_dev *dev,
     struct scrub_regions rem_reg[VHOST_USER_MAX_RAM_SLOTS];
     uint64_t shadow_pcb[VHOST_USER_MAX_RAM_SLOTS] = {};
     int nr_add_reg, nr_rem_reg;
-    int ret;
+    int nr_rem_acks = 0, nr_add_acks = 0;
+    int ret, ret2;
 
     msg->hdr.size = sizeof(msg->payload.mem_reg);
 
@@ -842,9 +875,24 @@ static int vhost_user_add_remove_regions(struct vhost_dev *dev,
     scrub_shadow_regions(dev, add_reg, &nr_add_reg, rem_reg, &nr_rem_reg,
                          shadow_pcb, track_ramblocks);
 
+    /*
+     * Send all REM_MEM_REG and ADD_MEM_REG messages back to back and wait
+     * for the acknowledgements only once, instead of one round trip per
+     * region.  At most VHOST_USER_MAX_RAM_SLOTS small replies can be
+     * outstanding, which fits in the socket buffer.
+     */
     if (nr_rem_reg) {
         ret = send_remove_regions(dev, rem_reg, nr_rem_reg, msg,
-                                  reply_supported);
+                                  reply_supported, &nr_rem_acks);
+        if (ret < 0) {
+            goto err;
+        }
+    }
+
+    /* With postcopy, the ADD_MEM_REG replies are read as they come */
+    if (track_ramblocks && nr_rem_acks) {
+        ret = vhost_user_read_acks(dev, VHOST_USER_REM_MEM_REG, nr_rem_acks);
+        nr_rem_acks = 0;
         if (ret < 0) {
             goto err;
         }
@@ -852,12 +900,20 @@ static int vhost_user_add_remove_regions(struct vhost_dev *dev,
 
     if (nr_add_reg) {
         ret = send_add_regions(dev, add_reg, nr_add_reg, msg, shadow_pcb,
-                               reply_supported, track_ramblocks);
+                               reply_supported, track_ramblocks,
+                               &nr_add_acks);
         if (ret < 0) {
             goto err;
         }
     }
 
+    ret = vhost_user_read_acks(dev, VHOST_USER_REM_MEM_REG, nr_rem_acks);
+    ret2 = vhost_user_read_acks(dev, VHOST_USER_ADD_MEM_REG, nr_add_acks);
+    if (ret < 0 || ret2 < 0) {
+        ret = ret < 0 ? ret : ret2;
+        goto err;
+    }
+
     if (track_ramblocks) {
         memcpy(u->postcopy_client_bases, shadow_pcb,
                sizeof(uint64_t) * VHOST_USER_MAX_RAM_SLOTS);
@@ -2783,6 +2839,31 @@ static void vhost_user_async_close_bh(void *opaque)
     g_free(data);
 }
 
+void vhost_user_note_disconnect(VhostUserState *user)
+{
+    if (user->dev_started && !user->disconnect_ns) {
+        user->disconnect_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
+}
+
+bool vhost_user_get_reconnect_stats(struct vhost_dev *dev,
+                                    uint64_t *reconnects,
+                                    int64_t *last_reconnect_ms)
+{
+    struct vhost_user *u;
+
+    if (!dev->vhost_ops ||
+        dev->vhost_ops->backend_type != VHOST_BACKEND_TYPE_USER ||
+        !dev->opaque) {
+        return false;
+    }
+
+    u = dev->opaque;
+    *reconnects = u->user->reconnects;
+    *last_reconnect_ms = u->user->last_reconnect_ns / SCALE_MS;
+    return true;
+}
+
 /*
  * We only schedule the work if the machine is running. If suspended
  * we want to keep all the in-flight data as is for migration
@@ -2809,6 +2890,12 @@ void vhost_user_async_close(DeviceState *d,
         data->vhost = vhost;
         data->event_cb = event_cb;
 
+        if (vhost->started) {
+            struct vhost_user *u = vhost->opaque;
+
+            vhost_user_note_disconnect(u->user);
+        }
+
         /* Disable any further notifications on the chardev */
         qemu_chr_fe_set_handlers(chardev,
                                  NULL, NULL, NULL, NULL, NULL, NULL,
@@ -2830,15 +2917,35 @@ void vhost_user_async_close(DeviceState *d,
     }
 }
 
+static void vhost_user_account_reconnect(struct vhost_dev *dev, bool started)
+{
+    struct vhost_user *u = dev->opaque;
+    VhostUserState *user = u->user;
+
+    user->dev_started = started;
+    if (!started || !user->disconnect_ns) {
+        return;
+    }
+
+    user->last_reconnect_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) -
+                              user->disconnect_ns;
+    user->disconnect_ns = 0;
+    user->reconnects++;
+    trace_vhost_user_reconnected(dev, user->reconnects,
+                                 user->last_reconnect_ns);
+}
+
 static int vhost_user_dev_start(struct vhost_dev *dev, bool started)
 {
-    if (!virtio_has_feature(dev->protocol_features,
-                            VHOST_USER_PROTOCOL_F_STATUS)) {
+    /* Account and set device status only for last queue pair */
+    if (dev->vq_index + dev->nvqs != dev->vq_index_end) {
         return 0;
     }
 
-    /* Set device status only for last queue pair */
-    if (dev->vq_index + dev->nvqs != dev->vq_index_end) {
+    vhost_user_account_reconnect(dev, started);
+
+    if (!virtio_has_feature(dev->protocol_features,
+                            VHOST_USER_PROTOCOL_F_STATUS)) {
         return 0;
     }
 
@@ -325,9 +325,56 @@ static void balloon_stats_set_poll_interval(Object *obj, Visitor *v,
     balloon_stats_change_timer(s, 0);
 }
 
+/* A run of reported pages that are contiguous within a RAMBlock */
+typedef struct ReportedRange {
+    RAMBlock *rb;
+    ram_addr_t offset;
+    size_t size;
+} ReportedRange;
+
+static void virtio_balloon_discard_report(VirtIOBalloon *dev,
+                                          ReportedRange *range)
+{
+    if (!range->size) {
+        return;
+    }
+
+    trace_virtio_balloon_discard_report(range->offset, range->size);
+    if (!ram_block_discard_range(range->rb, range->offset, range->size)) {
+        dev->reported_bytes += range->size;
+    }
+    dev->reported_discards++;
+    range->size = 0;
+}
+
+static void virtio_balloon_add_report(VirtIOBalloon *dev, ReportedRange *range,
+                                      RAMBlock *rb, ram_addr_t offset,
+                                      size_t size)
+{
+    if (range->size && range->rb == rb &&
+        range->offset + range->size == offset) {
+        range->size += size;
+        return;
+    }
+
+    virtio_balloon_discard_report(dev, range);
+    range->rb = rb;
+    range->offset = offset;
+    range->size = size;
+}
+
+/*
+ * The guest reports free pages in chunks of its page reporting order, often
+ * adjacent ones in consecutive elements.  Merge them into as large ranges as
+ * possible, so that one discard covers whole (transparent) huge pages and
+ * fewer system calls are needed.  Elements are only returned to the guest
+ * once all their pages were discarded, as the guest may reuse them then.
+ */
 static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIOBalloon *dev = VIRTIO_BALLOON(vdev);
+    g_autoptr(GPtrArray) done = g_ptr_array_new();
+    ReportedRange range = {};
     VirtQueueElement *elem;
 
     while ((elem = virtqueue_pop(vq, sizeof(VirtQueueElement)))) {
@@ -376,14 +423,24 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
                 continue;
             }
 
-            ram_block_discard_range(rb, ram_offset, size);
+            virtio_balloon_add_report(dev, &range, rb, ram_offset, size);
         }
 
 skip_element:
+        g_ptr_array_add(done, elem);
+    }
+
+    virtio_balloon_discard_report(dev, &range);
+
+    if (!done->len) {
+        return;
+    }
+    for (guint i = 0; i < done->len; i++) {
+        elem = g_ptr_array_index(done, i);
         virtqueue_push(vq, elem, 0);
-        virtio_notify(vdev, vq);
         g_free(elem);
     }
+    virtio_notify(vdev, vq);
 }
 
 static void virtio_balloon_handle_output(VirtIODevice *vdev, VirtQueue *vq)
@@ -784,6 +841,13 @@ static void virtio_balloon_stat(void *opaque, BalloonInfo *info)
     VirtIOBalloon *dev = opaque;
     info->actual = get_current_ram_size() - ((uint64_t) dev->actual <<
                                              VIRTIO_BALLOON_PFN_SHIFT);
+
+    if (virtio_has_feature(dev->host_features, VIRTIO_BALLOON_F_REPORTING)) {
+        info->has_reported_bytes = true;
+        info->reported_bytes = dev->reported_bytes;
+        info->has_reported_discards = true;
+        info->reported_discards = dev->reported_discards;
+    }
 }
 
 static void virtio_balloon_to_target(void *opaque, ram_addr_t target)
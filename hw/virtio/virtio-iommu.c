@@ -609,6 +609,7 @@ static int virtio_iommu_unmap(VirtIOIOMMU *s,
     VirtIOIOMMUInterval interval, *iter_key;
     VirtIOIOMMUDomain *domain;
     VirtIOIOMMUEndpoint *ep;
+    uint64_t unmapped_low = UINT64_MAX, unmapped_high = 0;
     int ret = VIRTIO_IOMMU_S_OK;
 
     trace_virtio_iommu_unmap(domain_id, virt_start, virt_end);
@@ -631,10 +632,8 @@ static int virtio_iommu_unmap(VirtIOIOMMU *s,
         uint64_t current_high = iter_key->high;
 
         if (interval.low <= current_low && interval.high >= current_high) {
-            QLIST_FOREACH(ep, &domain->endpoint_list, next) {
-                virtio_iommu_notify_unmap(ep->iommu_mr, current_low,
-                                          current_high);
-            }
+            unmapped_low = MIN(unmapped_low, current_low);
+            unmapped_high = MAX(unmapped_high, current_high);
             g_tree_remove(domain->mappings, iter_key);
             trace_virtio_iommu_unmap_done(domain_id, current_low, current_high);
         } else {
@@ -642,6 +641,20 @@ static int virtio_iommu_unmap(VirtIOIOMMU *s,
             break;
         }
     }
+
+    /*
+     * A mapping that only partially overlaps the request can only stick
+     * out at either end of it, so no remaining mapping lies between the
+     * removed ones.  Notify their whole span at once instead of once per
+     * mapping; since the notifier splits ranges into aligned power-of-two
+     * blocks, each block still covers whole blocks of the original maps.
+     */
+    if (unmapped_low <= unmapped_high) {
+        QLIST_FOREACH(ep, &domain->endpoint_list, next) {
+            virtio_iommu_notify_unmap(ep->iommu_mr, unmapped_low,
+                                      unmapped_high);
+        }
+    }
     return ret;
 }
 
@@ -759,6 +772,7 @@ static void virtio_iommu_handle_command(VirtIODevice *vdev, VirtQueue *vq)
     unsigned int iov_cnt;
     struct iovec *iov;
     void *buf = NULL;
+    bool notify = false;
     size_t sz;
 
     for (;;) {
@@ -766,7 +780,7 @@ static void virtio_iommu_handle_command(VirtIODevice *vdev, VirtQueue *vq)
 
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
         if (!elem) {
-            return;
+            break;
         }
 
         if (iov_size(elem->in_sg, elem->in_num) < sizeof(tail) ||
@@ -820,11 +834,16 @@ out:
         assert(sz == output_size);
 
         virtqueue_push(vq, elem, sz);
-        virtio_notify(vdev, vq);
+        notify = true;
         g_free(elem);
         g_free(buf);
         buf = NULL;
     }
+
+    /* Complete all requests of this kick with a single interrupt */
+    if (notify) {
+        virtio_notify(vdev, vq);
+    }
 }
 
 static void virtio_iommu_report_fault(VirtIOIOMMU *viommu, uint8_t reason,
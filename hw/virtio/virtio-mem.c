@@ -28,6 +28,8 @@
 #include "migration/misc.h"
 #include "hw/boards.h"
 #include "hw/qdev-properties.h"
+#include "block/aio-wait.h"
+#include "block/thread-pool.h"
 #include CONFIG_DEVICES
 #include "trace.h"
 
@@ -576,12 +578,71 @@ static void virtio_mem_deactivate_unplugged_memslots(VirtIOMEM *vmem,
     memory_region_transaction_commit();
 }
 
+/* Can be called without the BQL, see virtio_mem_prealloc_worker() */
+static bool virtio_mem_prealloc_range(VirtIOMEM *vmem, uint64_t offset,
+                                      uint64_t size, Error **errp)
+{
+    void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
+    int fd = memory_region_get_fd(&vmem->memdev->mr);
+
+    return qemu_prealloc_mem(fd, area, size, vmem->memdev->prealloc_threads,
+                             vmem->memdev->prealloc_context, false, errp);
+}
+
+static void virtio_mem_report_prealloc_error(Error *err)
+{
+    static bool warned;
+
+    /*
+     * Warn only once, we don't want to fill the log with these
+     * warnings.
+     */
+    if (!warned) {
+        warn_report_err(err);
+        warned = true;
+    } else {
+        error_free(err);
+    }
+}
+
+/* Plug a range that was preallocated already, if requested */
+static int virtio_mem_plug_range(VirtIOMEM *vmem, uint64_t start_gpa,
+                                 uint64_t size)
+{
+    const uint64_t offset = start_gpa - vmem->addr;
+    int ret;
+
+    /*
+     * Activate before notifying and rollback in case of any errors.
+     *
+     * When activating a yet inactive memslot, memory notifiers will get
+     * notified about the added memory region and can register with the
+     * RamDiscardManager; this will traverse all plugged blocks and skip the
+     * blocks we are plugging here. The following notification will inform
+     * registered listeners about the blocks we're plugging.
+     */
+    if (vmem->dynamic_memslots) {
+        virtio_mem_activate_memslots_to_plug(vmem, offset, size);
+    }
+    ret = virtio_mem_notify_plug(vmem, offset, size);
+    if (ret && vmem->dynamic_memslots) {
+        virtio_mem_deactivate_unplugged_memslots(vmem, offset, size);
+    }
+    if (ret) {
+        /* Could be preallocation or a notifier populated memory. */
+        ram_block_discard_range(vmem->memdev->mr.ram_block, offset, size);
+        return -EBUSY;
+    }
+
+    virtio_mem_set_range_plugged(vmem, start_gpa, size);
+    return 0;
+}
+
 static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
                                       uint64_t size, bool plug)
 {
     const uint64_t offset = start_gpa - vmem->addr;
     RAMBlock *rb = vmem->memdev->mr.ram_block;
-    int ret = 0;
 
     if (virtio_mem_is_busy()) {
         return -EBUSY;
@@ -601,61 +662,22 @@ static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
     }
 
     if (vmem->prealloc) {
-        void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
-        int fd = memory_region_get_fd(&vmem->memdev->mr);
         Error *local_err = NULL;
 
-        if (!qemu_prealloc_mem(fd, area, size, 1, NULL, &local_err)) {
-            static bool warned;
-
-            /*
-             * Warn only once, we don't want to fill the log with these
-             * warnings.
-             */
-            if (!warned) {
-                warn_report_err(local_err);
-                warned = true;
-            } else {
-                error_free(local_err);
-            }
-            ret = -EBUSY;
-        }
-    }
-
-    if (!ret) {
-        /*
-         * Activate before notifying and rollback in case of any errors.
-         *
-         * When activating a yet inactive memslot, memory notifiers will get
-         * notified about the added memory region and can register with the
-         * RamDiscardManager; this will traverse all plugged blocks and skip the
-         * blocks we are plugging here. The following notification will inform
-         * registered listeners about the blocks we're plugging.
-         */
-        if (vmem->dynamic_memslots) {
-            virtio_mem_activate_memslots_to_plug(vmem, offset, size);
-        }
-        ret = virtio_mem_notify_plug(vmem, offset, size);
-        if (ret && vmem->dynamic_memslots) {
-            virtio_mem_deactivate_unplugged_memslots(vmem, offset, size);
+        if (!virtio_mem_prealloc_range(vmem, offset, size, &local_err)) {
+            virtio_mem_report_prealloc_error(local_err);
+            ram_block_discard_range(rb, offset, size);
+            return -EBUSY;
         }
     }
-    if (ret) {
-        /* Could be preallocation or a notifier populated memory. */
-        ram_block_discard_range(vmem->memdev->mr.ram_block, offset, size);
-        return -EBUSY;
-    }
 
-    virtio_mem_set_range_plugged(vmem, start_gpa, size);
-    return 0;
+    return virtio_mem_plug_range(vmem, start_gpa, size);
 }
 
-static int virtio_mem_state_change_request(VirtIOMEM *vmem, uint64_t gpa,
-                                           uint16_t nb_blocks, bool plug)
+/* Returns VIRTIO_MEM_RESP_ACK if the state of the range may be changed */
+static uint16_t virtio_mem_state_change_check(VirtIOMEM *vmem, uint64_t gpa,
+                                              uint64_t size, bool plug)
 {
-    const uint64_t size = nb_blocks * vmem->block_size;
-    int ret;
-
     if (!virtio_mem_valid_range(vmem, gpa, size)) {
         return VIRTIO_MEM_RESP_ERROR;
     }
@@ -670,29 +692,130 @@ static int virtio_mem_state_change_request(VirtIOMEM *vmem, uint64_t gpa,
         return VIRTIO_MEM_RESP_ERROR;
     }
 
-    ret = virtio_mem_set_block_state(vmem, gpa, size, plug);
-    if (ret) {
-        return VIRTIO_MEM_RESP_BUSY;
-    }
+    return VIRTIO_MEM_RESP_ACK;
+}
+
+static void virtio_mem_update_size(VirtIOMEM *vmem, uint64_t size, bool plug)
+{
     if (plug) {
         vmem->size += size;
     } else {
         vmem->size -= size;
     }
     notifier_list_notify(&vmem->size_change_notifiers, &vmem->size);
+}
+
+static int virtio_mem_state_change_request(VirtIOMEM *vmem, uint64_t gpa,
+                                           uint16_t nb_blocks, bool plug)
+{
+    const uint64_t size = nb_blocks * vmem->block_size;
+    uint16_t type;
+    int ret;
+
+    type = virtio_mem_state_change_check(vmem, gpa, size, plug);
+    if (type != VIRTIO_MEM_RESP_ACK) {
+        return type;
+    }
+
+    ret = virtio_mem_set_block_state(vmem, gpa, size, plug);
+    if (ret) {
+        return VIRTIO_MEM_RESP_BUSY;
+    }
+    virtio_mem_update_size(vmem, size, plug);
     return VIRTIO_MEM_RESP_ACK;
 }
 
-static void virtio_mem_plug_request(VirtIOMEM *vmem, VirtQueueElement *elem,
+/*
+ * Preallocating a large range can take long.  With prealloc=on, plug
+ * requests therefore preallocate in the thread pool, without holding the
+ * BQL.  Processing of the request queue stops until the request completes,
+ * so that requests are still answered in order and the plugged state
+ * cannot change under our feet.
+ */
+static int virtio_mem_prealloc_worker(void *opaque)
+{
+    VirtIOMEM *vmem = opaque;
+    const uint64_t offset = vmem->prealloc_gpa - vmem->addr;
+
+    if (!virtio_mem_prealloc_range(vmem, offset, vmem->prealloc_size,
+                                   &vmem->prealloc_err)) {
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+static void virtio_mem_handle_request(VirtIODevice *vdev, VirtQueue *vq);
+
+static void virtio_mem_prealloc_done(void *opaque, int ret)
+{
+    VirtIOMEM *vmem = opaque;
+    VirtQueueElement *elem = vmem->prealloc_elem;
+    const uint64_t gpa = vmem->prealloc_gpa;
+    const uint64_t size = vmem->prealloc_size;
+    RAMBlock *rb = vmem->memdev->mr.ram_block;
+    uint16_t type = VIRTIO_MEM_RESP_BUSY;
+
+    trace_virtio_mem_prealloc_done(gpa, size, ret);
+
+    if (ret) {
+        virtio_mem_report_prealloc_error(vmem->prealloc_err);
+        vmem->prealloc_err = NULL;
+        ram_block_discard_range(rb, gpa - vmem->addr, size);
+    } else if (virtio_mem_is_busy()) {
+        /* Migration started in the meantime */
+        ram_block_discard_range(rb, gpa - vmem->addr, size);
+    } else if (!virtio_mem_plug_range(vmem, gpa, size)) {
+        virtio_mem_update_size(vmem, size, true);
+        type = VIRTIO_MEM_RESP_ACK;
+    }
+
+    vmem->prealloc_elem = NULL;
+    virtio_mem_send_response_simple(vmem, elem, type);
+    g_free(elem);
+
+    if (!vmem->prealloc_draining) {
+        virtio_mem_handle_request(VIRTIO_DEVICE(vmem), vmem->vq);
+    }
+}
+
+/* Wait for a plug request that is preallocating in the thread pool */
+static void virtio_mem_drain_prealloc(VirtIOMEM *vmem)
+{
+    vmem->prealloc_draining = true;
+    AIO_WAIT_WHILE(NULL, vmem->prealloc_elem);
+    vmem->prealloc_draining = false;
+}
+
+/* Returns true if @elem is completed asynchronously */
+static bool virtio_mem_plug_request(VirtIOMEM *vmem, VirtQueueElement *elem,
                                     struct virtio_mem_req *req)
 {
     const uint64_t gpa = le64_to_cpu(req->u.plug.addr);
     const uint16_t nb_blocks = le16_to_cpu(req->u.plug.nb_blocks);
+    const uint64_t size = nb_blocks * vmem->block_size;
     uint16_t type;
 
     trace_virtio_mem_plug_request(gpa, nb_blocks);
-    type = virtio_mem_state_change_request(vmem, gpa, nb_blocks, true);
+
+    if (vmem->prealloc && !vmem->prealloc_draining) {
+        type = virtio_mem_state_change_check(vmem, gpa, size, true);
+        if (type == VIRTIO_MEM_RESP_ACK && virtio_mem_is_busy()) {
+            type = VIRTIO_MEM_RESP_BUSY;
+        }
+        if (type == VIRTIO_MEM_RESP_ACK) {
+            vmem->prealloc_elem = elem;
+            vmem->prealloc_gpa = gpa;
+            vmem->prealloc_size = size;
+            thread_pool_submit_aio(virtio_mem_prealloc_worker, vmem,
+                                   virtio_mem_prealloc_done, vmem);
+            return true;
+        }
+    } else {
+        type = virtio_mem_state_change_request(vmem, gpa, nb_blocks, true);
+    }
+
     virtio_mem_send_response_simple(vmem, elem, type);
+    return false;
 }
 
 static void virtio_mem_unplug_request(VirtIOMEM *vmem, VirtQueueElement *elem,
@@ -734,6 +857,8 @@ static int virtio_mem_unplug_all(VirtIOMEM *vmem)
     const uint64_t region_size = memory_region_size(&vmem->memdev->mr);
     RAMBlock *rb = vmem->memdev->mr.ram_block;
 
+    virtio_mem_drain_prealloc(vmem);
+
     if (vmem->size) {
         if (virtio_mem_is_busy()) {
             return -EBUSY;
@@ -804,7 +929,7 @@ static void virtio_mem_handle_request(VirtIODevice *vdev, VirtQueue *vq)
     struct virtio_mem_req req;
     uint16_t type;
 
-    while (true) {
+    while (!vmem->prealloc_elem) {
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
         if (!elem) {
             return;
@@ -831,7 +956,10 @@ static void virtio_mem_handle_request(VirtIODevice *vdev, VirtQueue *vq)
         type = le16_to_cpu(req.type);
         switch (type) {
         case VIRTIO_MEM_REQ_PLUG:
-            virtio_mem_plug_request(vmem, elem, &req);
+            if (virtio_mem_plug_request(vmem, elem, &req)) {
+                /* Resumed by virtio_mem_prealloc_done() */
+                return;
+            }
             break;
         case VIRTIO_MEM_REQ_UNPLUG:
             virtio_mem_unplug_request(vmem, elem, &req);
@@ -907,6 +1035,12 @@ static void virtio_mem_system_reset(void *opaque)
     virtio_mem_unplug_all(vmem);
 }
 
+static void virtio_mem_device_reset(VirtIODevice *vdev)
+{
+    /* Don't complete a request on the queue after it was reset */
+    virtio_mem_drain_prealloc(VIRTIO_MEM(vdev));
+}
+
 static void virtio_mem_prepare_mr(VirtIOMEM *vmem)
 {
     const uint64_t region_size = memory_region_size(&vmem->memdev->mr);
@@ -1138,6 +1272,8 @@ static void virtio_mem_device_unrealize(DeviceState *dev)
     VirtIODevice *vdev = VIRTIO_DEVICE(dev);
     VirtIOMEM *vmem = VIRTIO_MEM(dev);
 
+    virtio_mem_drain_prealloc(vmem);
+
     /*
      * The unplug handler unmapped the memory region, it cannot be
      * found via an address space anymore. Unset ourselves.
@@ -1248,7 +1384,9 @@ static int virtio_mem_prealloc_range_cb(VirtIOMEM *vmem, void *arg,
     int fd = memory_region_get_fd(&vmem->memdev->mr);
     Error *local_err = NULL;
 
-    if (!qemu_prealloc_mem(fd, area, size, 1, NULL, &local_err)) {
+    if (!qemu_prealloc_mem(fd, area, size, vmem->memdev->prealloc_threads,
+                           vmem->memdev->prealloc_context, false,
+                           &local_err)) {
         error_report_err(local_err);
         return -ENOMEM;
     }
@@ -1385,11 +1523,19 @@ static bool virtio_mem_vmstate_field_exists(void *opaque, int version_id)
     return !vmem->early_migration;
 }
 
+static int virtio_mem_pre_save(void *opaque)
+{
+    /* The queue element of a pending plug request would be lost */
+    virtio_mem_drain_prealloc(VIRTIO_MEM(opaque));
+    return 0;
+}
+
 static const VMStateDescription vmstate_virtio_mem_device = {
     .name = "virtio-mem-device",
     .minimum_version_id = 1,
     .version_id = 1,
     .priority = MIG_PRI_VIRTIO_MEM,
+    .pre_save = virtio_mem_pre_save,
     .post_load = virtio_mem_post_load,
     .fields = (const VMStateField[]) {
         VMSTATE_WITH_TMP_TEST(VirtIOMEM, virtio_mem_vmstate_field_exists,
@@ -1856,6 +2002,7 @@ static void virtio_mem_class_init(ObjectClass *klass, void *data)
     set_bit(DEVICE_CATEGORY_MISC, dc->categories);
     vdc->realize = virtio_mem_device_realize;
     vdc->unrealize = virtio_mem_device_unrealize;
+    vdc->reset = virtio_mem_device_reset;
     vdc->get_config = virtio_mem_get_config;
     vdc->get_features = virtio_mem_get_features;
     vdc->validate_features = virtio_mem_validate_features;
@@ -718,6 +718,16 @@ VirtIODevice *qmp_find_virtio_device(const char *path)
     return VIRTIO_DEVICE(dev);
 }
 
+#ifdef CONFIG_VHOST_USER
+static void qmp_vhost_user_reconnect_stats(VhostStatus *vs,
+                                           struct vhost_dev *hdev)
+{
+    vs->has_reconnects = vs->has_last_reconnect_ms =
+        vhost_user_get_reconnect_stats(hdev, &vs->reconnects,
+                                       &vs->last_reconnect_ms);
+}
+#endif
+
 VirtioStatus *qmp_x_query_virtio_status(const char *path, Error **errp)
 {
     VirtIODevice *vdev;
@@ -787,6 +797,9 @@ VirtioStatus *qmp_x_query_virtio_status(const char *path, Error **errp)
         status->vhost_dev->backend_cap = hdev->backend_cap;
         status->vhost_dev->log_enabled = hdev->log_enabled;
         status->vhost_dev->log_size = hdev->log_size;
+#ifdef CONFIG_VHOST_USER
+        qmp_vhost_user_reconnect_stats(status->vhost_dev, hdev);
+#endif
     }
 
     return status;
@@ -20,6 +20,7 @@
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/stats-counter.h"
 #include "qom/object_interfaces.h"
 #include "hw/core/cpu.h"
 #include "hw/virtio/virtio.h"
@@ -51,6 +52,13 @@
  */
 #define VHOST_USER_MAX_CONFIG_SIZE 256
 
+STATS_COUNTER_DEFINE(virtqueue_kicks, "virtqueue-kicks");
+STATS_COUNTER_DEFINE(virtqueue_notifies, "virtqueue-notifies");
+STATS_COUNTER_DEFINE(virtqueue_notifies_suppressed,
+                     "virtqueue-notifies-suppressed");
+STATS_COUNTER_DEFINE(virtqueue_notifies_moderated,
+                     "virtqueue-notifies-moderated");
+
 /*
  * The alignment to use between consumer and producer parts of vring.
  * x86 pagesize again. This is the default, used by transports like PCI
@@ -151,6 +159,14 @@ struct VirtQueue
     EventNotifier guest_notifier;
     EventNotifier host_notifier;
     bool host_notifier_enabled;
+
+    /* Interrupt moderation, see virtio_notify_moderated() */
+    QEMUTimer *notify_timer;
+    AioContext *notify_timer_ctx;
+    int64_t last_notify_ns;
+    uint32_t notify_pending;
+    bool notify_irqfd;
+
     QLIST_ENTRY(VirtQueue) node;
 };
 
@@ -1495,7 +1511,8 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz,
+                                 bool update_avail_event)
 {
     unsigned int i, head, max;
     VRingMemoryRegionCaches *caches;
@@ -1534,7 +1551,8 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
+    if (update_avail_event &&
+        virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
         vring_set_avail_event(vq, vq->last_avail_idx);
     }
 
@@ -1780,10 +1798,44 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
         return virtqueue_packed_pop(vq, sz);
     } else {
-        return virtqueue_split_pop(vq, sz);
+        return virtqueue_split_pop(vq, sz, true);
     }
 }
 
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int num)
+{
+    VirtIODevice *vdev = vq->vdev;
+    bool packed;
+    unsigned int i;
+
+    if (virtio_device_disabled(vdev)) {
+        return 0;
+    }
+
+    packed = virtio_vdev_has_feature(vdev, VIRTIO_F_RING_PACKED);
+
+    RCU_READ_LOCK_GUARD();
+    for (i = 0; i < num; i++) {
+        /*
+         * The split ring avail event is written once for the whole batch
+         * rather than once per element.
+         */
+        elems[i] = packed ? virtqueue_packed_pop(vq, sz) :
+                            virtqueue_split_pop(vq, sz, false);
+        if (!elems[i]) {
+            break;
+        }
+    }
+
+    if (i && !packed && virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+
+    trace_virtqueue_pop_batch(vq, num, i);
+    return i;
+}
+
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -2070,6 +2122,16 @@ static enum virtio_device_endian virtio_current_cpu_endian(void)
     }
 }
 
+static void virtio_queue_notify_timer_free(VirtQueue *vq)
+{
+    if (vq->notify_timer) {
+        timer_free(vq->notify_timer);
+        vq->notify_timer = NULL;
+    }
+    vq->notify_pending = 0;
+    vq->last_notify_ns = 0;
+}
+
 static void __virtio_queue_reset(VirtIODevice *vdev, uint32_t i)
 {
     vdev->vq[i].vring.desc = 0;
@@ -2087,6 +2149,7 @@ static void __virtio_queue_reset(VirtIODevice *vdev, uint32_t i)
     vdev->vq[i].notification = true;
     vdev->vq[i].vring.num = vdev->vq[i].vring.num_default;
     vdev->vq[i].inuse = 0;
+    virtio_queue_notify_timer_free(&vdev->vq[i]);
     virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
 }
 
@@ -2265,6 +2328,7 @@ static void virtio_queue_notify_vq(VirtQueue *vq)
         }
 
         trace_virtio_queue_notify(vdev, vq - vdev->vq, vq);
+        stats_counter_inc(&virtqueue_kicks);
         vq->handle_output(vdev, vq);
 
         if (unlikely(vdev->start_on_kick)) {
@@ -2283,8 +2347,10 @@ void virtio_queue_notify(VirtIODevice *vdev, int n)
 
     trace_virtio_queue_notify(vdev, vq - vdev->vq, vq);
     if (vq->host_notifier_enabled) {
+        /* Counted by virtio_queue_notify_vq() */
         event_notifier_set(&vq->host_notifier);
     } else if (vq->handle_output) {
+        stats_counter_inc(&virtqueue_kicks);
         vq->handle_output(vdev, vq);
 
         if (unlikely(vdev->start_on_kick)) {
@@ -2340,6 +2406,7 @@ VirtQueue *virtio_add_queue(VirtIODevice *vdev, int queue_size,
 
 void virtio_delete_queue(VirtQueue *vq)
 {
+    virtio_queue_notify_timer_free(vq);
     vq->vring.num = 0;
     vq->vring.num_default = 0;
     vq->handle_output = NULL;
@@ -2456,14 +2523,133 @@ static void virtio_notify_irqfd_deferred_fn(void *opaque)
     event_notifier_set(notifier);
 }
 
-void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
+bool virtio_queue_should_notify(VirtQueue *vq)
+{
+    RCU_READ_LOCK_GUARD();
+    return virtio_should_notify(vq->vdev, vq);
+}
+
+static void virtio_irq(VirtQueue *vq)
+{
+    virtio_set_isr(vq->vdev, 0x1);
+    virtio_notify_vector(vq->vdev, vq->vector);
+}
+
+static void virtio_notify_timer_cb(void *opaque)
 {
+    VirtQueue *vq = opaque;
+    VirtIODevice *vdev = vq->vdev;
+
+    vq->notify_pending = 0;
+    vq->last_notify_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
     WITH_RCU_READ_LOCK_GUARD() {
         if (!virtio_should_notify(vdev, vq)) {
             return;
         }
     }
 
+    trace_virtio_notify_moderated(vdev, vq);
+    stats_counter_inc(&virtqueue_notifies);
+    if (vq->notify_irqfd) {
+        virtio_set_isr(vdev, 0x1);
+        event_notifier_set(&vq->guest_notifier);
+    } else {
+        virtio_irq(vq);
+    }
+}
+
+/*
+ * Interrupt moderation.  A notification is sent at once if none was sent
+ * in the last notify-delay-us microseconds, so an idle queue sees no extra
+ * latency.  Otherwise it is held back until that much time has passed
+ * since the previous one, or until notify-max-pending notifications are
+ * held, whichever comes first.
+ *
+ * Return true if the caller should notify now.
+ */
+static bool virtio_notify_moderated(VirtIODevice *vdev, VirtQueue *vq,
+                                    bool irqfd)
+{
+    uint16_t signalled_used = vq->signalled_used;
+    bool signalled_used_valid = vq->signalled_used_valid;
+    AioContext *ctx;
+    int64_t now, deadline;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        if (!virtio_should_notify(vdev, vq)) {
+            stats_counter_inc(&virtqueue_notifies_suppressed);
+            return false;
+        }
+    }
+
+    if (!vdev->notify_delay_us) {
+        stats_counter_inc(&virtqueue_notifies);
+        return true;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    deadline = vq->last_notify_ns + (int64_t)vdev->notify_delay_us * SCALE_US;
+    if (now >= deadline ||
+        (vdev->notify_max_pending &&
+         ++vq->notify_pending >= vdev->notify_max_pending)) {
+        if (vq->notify_timer) {
+            timer_del(vq->notify_timer);
+        }
+        vq->notify_pending = 0;
+        vq->last_notify_ns = now;
+        stats_counter_inc(&virtqueue_notifies);
+        return true;
+    }
+
+    stats_counter_inc(&virtqueue_notifies_moderated);
+
+    /*
+     * Forget that the guest was signalled, so that the next check (here or
+     * in the timer) still sees the used buffers it would have signalled.
+     */
+    vq->signalled_used = signalled_used;
+    vq->signalled_used_valid = signalled_used_valid;
+    vq->notify_irqfd = irqfd;
+
+    /* The timer runs where the device completes requests */
+    ctx = qemu_get_current_aio_context();
+    if (vq->notify_timer && vq->notify_timer_ctx != ctx) {
+        timer_free(vq->notify_timer);
+        vq->notify_timer = NULL;
+    }
+    if (!vq->notify_timer) {
+        vq->notify_timer = aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL, SCALE_NS,
+                                         virtio_notify_timer_cb, vq);
+        vq->notify_timer_ctx = ctx;
+    }
+    if (!timer_pending(vq->notify_timer)) {
+        timer_mod(vq->notify_timer, deadline);
+    }
+    return false;
+}
+
+/* Send the notifications held back by moderation */
+static void virtio_notify_flush_moderated(VirtIODevice *vdev)
+{
+    int i;
+
+    for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+        VirtQueue *vq = &vdev->vq[i];
+
+        if (vq->notify_timer && timer_pending(vq->notify_timer)) {
+            timer_del(vq->notify_timer);
+            virtio_notify_timer_cb(vq);
+        }
+    }
+}
+
+void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
+{
+    if (!virtio_notify_moderated(vdev, vq, true)) {
+        return;
+    }
+
     trace_virtio_notify_irqfd(vdev, vq);
 
     /*
@@ -2485,18 +2671,10 @@ void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
     defer_call(virtio_notify_irqfd_deferred_fn, &vq->guest_notifier);
 }
 
-static void virtio_irq(VirtQueue *vq)
-{
-    virtio_set_isr(vq->vdev, 0x1);
-    virtio_notify_vector(vq->vdev, vq->vector);
-}
-
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
 {
-    WITH_RCU_READ_LOCK_GUARD() {
-        if (!virtio_should_notify(vdev, vq)) {
-            return;
-        }
+    if (!virtio_notify_moderated(vdev, vq, false)) {
+        return;
     }
 
     trace_virtio_notify(vdev, vq);
@@ -3201,6 +3379,11 @@ static void virtio_vmstate_change(void *opaque, bool running, RunState state)
     if (!backend_run) {
         virtio_set_status(vdev, vdev->status);
     }
+
+    if (!running) {
+        /* Do not leave completions unsignalled across a stop or migration */
+        virtio_notify_flush_moderated(vdev);
+    }
 }
 
 void virtio_instance_init_common(Object *proxy_obj, void *data,
@@ -3707,6 +3890,7 @@ static void virtio_device_free_virtqueues(VirtIODevice *vdev)
     }
 
     for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+        virtio_queue_notify_timer_free(&vdev->vq[i]);
         if (vdev->vq[i].vring.num == 0) {
             break;
         }
@@ -3731,10 +3915,13 @@ static Property virtio_properties[] = {
     DEFINE_PROP_BOOL("use-disabled-flag", VirtIODevice, use_disabled_flag, true),
     DEFINE_PROP_BOOL("x-disable-legacy-check", VirtIODevice,
                      disable_legacy_check, false),
+    DEFINE_PROP_UINT32("notify-delay-us", VirtIODevice, notify_delay_us, 0),
+    DEFINE_PROP_UINT32("notify-max-pending", VirtIODevice, notify_max_pending,
+                       32),
     DEFINE_PROP_END_OF_LIST(),
 };
 
-static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int i, n, r, err;
@@ -3804,7 +3991,7 @@ int virtio_device_start_ioeventfd(VirtIODevice *vdev)
     return virtio_bus_start_ioeventfd(vbus);
 }
 
-static void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int n, r;
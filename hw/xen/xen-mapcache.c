@@ -53,14 +53,20 @@ typedef struct MapCacheRev {
     uint8_t *vaddr_req;
     hwaddr paddr_index;
     hwaddr size;
-    QTAILQ_ENTRY(MapCacheRev) next;
+    /* Older reverse entry for the same vaddr_req */
+    struct MapCacheRev *next;
     bool dma;
 } MapCacheRev;
 
 typedef struct MapCache {
     MapCacheEntry *entry;
     unsigned long nr_buckets;
-    QTAILQ_HEAD(, MapCacheRev) locked_entries;
+    /*
+     * Locked mappings, keyed by the address handed out to the caller so
+     * that unmapping does not have to walk every in-flight DMA buffer.
+     * Each value is the most recent MapCacheRev for that address.
+     */
+    GHashTable *locked_entries;
 
     /* For most cases (>99.9%), the page address is the same. */
     MapCacheEntry *last_entry;
@@ -104,7 +110,7 @@ void xen_map_cache_init(phys_offset_to_gaddr_t f, void *opaque)
     mapcache->opaque = opaque;
     qemu_mutex_init(&mapcache->lock);
 
-    QTAILQ_INIT(&mapcache->locked_entries);
+    mapcache->locked_entries = g_hash_table_new(NULL, NULL);
 
     if (geteuid() == 0) {
         rlimit_as.rlim_cur = RLIM_INFINITY;
@@ -355,7 +361,10 @@ tryagain:
         reventry->vaddr_req = mapcache->last_entry->vaddr_base + address_offset;
         reventry->paddr_index = mapcache->last_entry->paddr_index;
         reventry->size = entry->size;
-        QTAILQ_INSERT_HEAD(&mapcache->locked_entries, reventry, next);
+        reventry->next = g_hash_table_lookup(mapcache->locked_entries,
+                                             reventry->vaddr_req);
+        g_hash_table_insert(mapcache->locked_entries, reventry->vaddr_req,
+                            reventry);
     }
 
     trace_xen_map_cache_return(
@@ -375,33 +384,33 @@ uint8_t *xen_map_cache(hwaddr phys_addr, hwaddr size,
     return p;
 }
 
+#define MAPCACHE_FOREACH_LOCKED(reventry, iter, head)                   \
+    for (g_hash_table_iter_init(&(iter), mapcache->locked_entries);    \
+         g_hash_table_iter_next(&(iter), NULL, (gpointer *)&(head));)  \
+        for ((reventry) = (head); (reventry); (reventry) = (reventry)->next)
+
 ram_addr_t xen_ram_addr_from_mapcache(void *ptr)
 {
     MapCacheEntry *entry = NULL;
-    MapCacheRev *reventry;
+    MapCacheRev *reventry, *head;
+    GHashTableIter iter;
     hwaddr paddr_index;
     hwaddr size;
     ram_addr_t raddr;
-    int found = 0;
 
     mapcache_lock();
-    QTAILQ_FOREACH(reventry, &mapcache->locked_entries, next) {
-        if (reventry->vaddr_req == ptr) {
-            paddr_index = reventry->paddr_index;
-            size = reventry->size;
-            found = 1;
-            break;
-        }
-    }
-    if (!found) {
+    reventry = g_hash_table_lookup(mapcache->locked_entries, ptr);
+    if (!reventry) {
         trace_xen_ram_addr_from_mapcache_not_found(ptr);
-        QTAILQ_FOREACH(reventry, &mapcache->locked_entries, next) {
+        MAPCACHE_FOREACH_LOCKED(reventry, iter, head) {
             trace_xen_ram_addr_from_mapcache_found(reventry->paddr_index,
                                                    reventry->vaddr_req);
         }
         abort();
         return 0;
     }
+    paddr_index = reventry->paddr_index;
+    size = reventry->size;
 
     entry = &mapcache->entry[paddr_index % mapcache->nr_buckets];
     while (entry && (entry->paddr_index != paddr_index || entry->size != size)) {
@@ -421,22 +430,15 @@ ram_addr_t xen_ram_addr_from_mapcache(void *ptr)
 static void xen_invalidate_map_cache_entry_unlocked(uint8_t *buffer)
 {
     MapCacheEntry *entry = NULL, *pentry = NULL;
-    MapCacheRev *reventry;
+    MapCacheRev *reventry, *head;
+    GHashTableIter iter;
     hwaddr paddr_index;
     hwaddr size;
-    int found = 0;
-
-    QTAILQ_FOREACH(reventry, &mapcache->locked_entries, next) {
-        if (reventry->vaddr_req == buffer) {
-            paddr_index = reventry->paddr_index;
-            size = reventry->size;
-            found = 1;
-            break;
-        }
-    }
-    if (!found) {
+
+    reventry = g_hash_table_lookup(mapcache->locked_entries, buffer);
+    if (!reventry) {
         trace_xen_invalidate_map_cache_entry_unlocked_not_found(buffer);
-        QTAILQ_FOREACH(reventry, &mapcache->locked_entries, next) {
+        MAPCACHE_FOREACH_LOCKED(reventry, iter, head) {
             trace_xen_invalidate_map_cache_entry_unlocked_found(
                 reventry->paddr_index,
                 reventry->vaddr_req
@@ -444,7 +446,13 @@ static void xen_invalidate_map_cache_entry_unlocked(uint8_t *buffer)
         }
         return;
     }
-    QTAILQ_REMOVE(&mapcache->locked_entries, reventry, next);
+    paddr_index = reventry->paddr_index;
+    size = reventry->size;
+    if (reventry->next) {
+        g_hash_table_insert(mapcache->locked_entries, buffer, reventry->next);
+    } else {
+        g_hash_table_remove(mapcache->locked_entries, buffer);
+    }
     g_free(reventry);
 
     if (mapcache->last_entry != NULL &&
@@ -486,14 +494,15 @@ void xen_invalidate_map_cache_entry(uint8_t *buffer)
 void xen_invalidate_map_cache(void)
 {
     unsigned long i;
-    MapCacheRev *reventry;
+    MapCacheRev *reventry, *head;
+    GHashTableIter iter;
 
     /* Flush pending AIO before destroying the mapcache */
     bdrv_drain_all();
 
     mapcache_lock();
 
-    QTAILQ_FOREACH(reventry, &mapcache->locked_entries, next) {
+    MAPCACHE_FOREACH_LOCKED(reventry, iter, head) {
         if (!reventry->dma) {
             continue;
         }
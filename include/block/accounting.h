@@ -79,6 +79,18 @@ typedef struct BlockLatencyHistogram {
     uint64_t *bins;
 } BlockLatencyHistogram;
 
+/*
+ * In addition to the optional user-defined histograms above, the
+ * latency of every request is recorded in a fixed log-linear histogram
+ * from which percentiles can be computed: each power of two is split
+ * into 1 << BLOCK_LATENCY_LOG_SUB_BITS linear buckets, so that the
+ * relative error of a bucket's upper bound is at most 12.5%.  Latencies
+ * below 1 << BLOCK_LATENCY_LOG_SUB_BITS nanoseconds have a bucket each.
+ */
+#define BLOCK_LATENCY_LOG_SUB_BITS 3
+#define BLOCK_LATENCY_LOG_BUCKETS \
+    ((64 - BLOCK_LATENCY_LOG_SUB_BITS + 1) << BLOCK_LATENCY_LOG_SUB_BITS)
+
 struct BlockAcctStats {
     QemuMutex lock;
     uint64_t nr_bytes[BLOCK_MAX_IOTYPE];
@@ -92,6 +104,7 @@ struct BlockAcctStats {
     bool account_invalid;
     bool account_failed;
     BlockLatencyHistogram latency_histogram[BLOCK_MAX_IOTYPE];
+    uint64_t latency_log[BLOCK_MAX_IOTYPE][BLOCK_LATENCY_LOG_BUCKETS];
 };
 
 typedef struct BlockAcctCookie {
@@ -120,5 +133,8 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+uint64_t block_acct_latency_percentile(BlockAcctStats *stats,
+                                       enum BlockAcctType type,
+                                       unsigned per_mille);
 
 #endif
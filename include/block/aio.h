@@ -19,6 +19,7 @@
 #endif
 #include "qemu/coroutine-core.h"
 #include "qemu/queue.h"
+#include "qemu/stats64.h"
 #include "qemu/event_notifier.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
@@ -57,6 +58,21 @@ struct ThreadPool;
 struct LinuxAioState;
 typedef struct LuringState LuringState;
 
+/*
+ * Flags for aio_setup_linux_io_uring().  An AioContext has a separate ring
+ * for each combination of them.
+ *
+ * LURING_IOPOLL rings poll the device for completions and only accept
+ * O_DIRECT reads and writes.  Their completions are not signalled through
+ * the ring file descriptor, so the AioContext keeps polling while they
+ * have requests in flight, see aio_context_poll_busy().
+ *
+ * LURING_SQPOLL rings have a kernel thread that polls the submission queue.
+ */
+#define LURING_IOPOLL   (1 << 0)
+#define LURING_SQPOLL   (1 << 1)
+#define LURING_NR_RINGS 4
+
 /* Is polling disabled? */
 bool aio_poll_disabled(AioContext *ctx);
 
@@ -183,6 +199,10 @@ struct AioContext {
     /* Chained BH list slices for each nested aio_bh_poll() call */
     QSIMPLEQ_HEAD(, BHListSlice) bh_slice_list;
 
+    /* Bottom half statistics, see aio_context_get_bh_stats() */
+    Stat64 bh_calls;
+    Stat64 bh_batches;
+
     /* Used by aio_notify.
      *
      * "notified" is used to avoid expensive event_notifier_test_and_clear
@@ -203,20 +223,30 @@ struct AioContext {
 
     int thread_pool_min;
     int thread_pool_max;
+    struct ThreadContext *thread_pool_context;
     /* Thread pool for performing work and receiving completion callbacks.
      * Has its own locking.
      */
     struct ThreadPool *thread_pool;
 
+    /*
+     * Aligned buffers for padding and bouncing requests, created on first
+     * use.  Only used by the thread that runs the AioContext.
+     */
+    struct BouncePool *bounce_pool;
+
 #ifdef CONFIG_LINUX_AIO
     struct LinuxAioState *linux_aio;
 #endif
 #ifdef CONFIG_LINUX_IO_URING
-    LuringState *linux_io_uring;
+    LuringState *linux_io_uring[LURING_NR_RINGS];
 
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+
+    /* Is IORING_OP_POLL_ADD armed multishot?  See fdmon-io_uring.c */
+    bool fdmon_io_uring_multishot;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -227,12 +257,23 @@ struct AioContext {
     /* Number of AioHandlers without .io_poll() */
     int poll_disable_cnt;
 
+    /*
+     * Number of users whose events can only be noticed by .io_poll(); while
+     * it is non-zero aio_poll() never blocks.
+     */
+    int poll_busy_cnt;
+
     /* Polling mode parameters */
-    int64_t poll_ns;        /* current polling time in nanoseconds */
+    int64_t poll_ns;        /* largest handler polling time in nanoseconds */
     int64_t poll_max_ns;    /* maximum polling time in nanoseconds */
     int64_t poll_grow;      /* polling time growth factor */
     int64_t poll_shrink;    /* polling time shrink factor */
 
+    /* Polling mode statistics, see aio_context_get_poll_stats() */
+    Stat64 poll_hits;
+    Stat64 poll_misses;
+    Stat64 poll_wasted_ns;
+
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
 
@@ -497,17 +538,21 @@ GSource *aio_get_g_source(AioContext *ctx);
 /* Return the ThreadPool bound to this AioContext */
 struct ThreadPool *aio_get_thread_pool(AioContext *ctx);
 
+/* Return the BouncePool bound to this AioContext */
+struct BouncePool *aio_get_bounce_pool(AioContext *ctx);
+
 /* Setup the LinuxAioState bound to this AioContext */
 struct LinuxAioState *aio_setup_linux_aio(AioContext *ctx, Error **errp);
 
 /* Return the LinuxAioState bound to this AioContext */
 struct LinuxAioState *aio_get_linux_aio(AioContext *ctx);
 
-/* Setup the LuringState bound to this AioContext */
-LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp);
+/* Setup the LuringState with LURING_* @flags bound to this AioContext */
+LuringState *aio_setup_linux_io_uring(AioContext *ctx, unsigned int flags,
+                                      Error **errp);
 
-/* Return the LuringState bound to this AioContext */
-LuringState *aio_get_linux_io_uring(AioContext *ctx);
+/* Return the LuringState with LURING_* @flags bound to this AioContext */
+LuringState *aio_get_linux_io_uring(AioContext *ctx, unsigned int flags);
 /**
  * aio_timer_new_with_attrs:
  * @ctx: the aio context
@@ -701,12 +746,50 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
  */
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch);
 
+/**
+ * aio_context_get_bh_stats:
+ * @ctx: the aio context
+ * @calls: number of bottom half callbacks invoked
+ * @batches: number of aio_bh_poll() calls that invoked at least one
+ *
+ * May be called from any thread.
+ */
+void aio_context_get_bh_stats(AioContext *ctx, uint64_t *calls,
+                              uint64_t *batches);
+
+/**
+ * aio_context_get_poll_stats:
+ * @ctx: the aio context
+ * @hits: number of times polling found a handler ready
+ * @misses: number of polling rounds that found nothing
+ * @wasted_ns: time spent in polling rounds that found nothing, in nanoseconds
+ *
+ * May be called from any thread.
+ */
+void aio_context_get_poll_stats(AioContext *ctx, uint64_t *hits,
+                                uint64_t *misses, uint64_t *wasted_ns);
+
+/**
+ * aio_context_poll_busy:
+ * @ctx: the aio context
+ * @busy: whether the caller starts or stops needing busy polling
+ *
+ * Calls with @busy true and false must be balanced.  While any caller needs
+ * busy polling, the event loop runs .io_poll() handlers on every iteration
+ * and does not block waiting for file descriptors, even if poll_max_ns is 0.
+ *
+ * Must be called from the AioContext's home thread.
+ */
+void aio_context_poll_busy(AioContext *ctx, bool busy);
+
 /**
  * aio_context_set_thread_pool_params:
  * @ctx: the aio context
  * @min: min number of threads to have readily available in the thread pool
  * @min: max number of threads the thread pool can contain
+ * @tc: thread context to create worker threads in, or NULL
  */
 void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
-                                        int64_t max, Error **errp);
+                                        int64_t max, struct ThreadContext *tc,
+                                        Error **errp);
 #endif
@@ -57,6 +57,9 @@ BlockDriver *bdrv_find_protocol(const char *filename,
                                 Error **errp);
 BlockDriver *bdrv_find_format(const char *format_name);
 
+void bdrv_preconnect(BlockdevOptions *options);
+void bdrv_preconnect_cleanup(void);
+
 int coroutine_fn GRAPH_UNLOCKED
 bdrv_co_create(BlockDriver *drv, const char *filename, QemuOpts *opts,
                Error **errp);
@@ -235,6 +235,15 @@ void *qemu_blockalign0(BlockDriverState *bs, size_t size);
 void *qemu_try_blockalign(BlockDriverState *bs, size_t size);
 void *qemu_try_blockalign0(BlockDriverState *bs, size_t size);
 
+/*
+ * Like qemu_blockalign() and qemu_try_blockalign(), but recycle buffers
+ * through the bounce pool of the current AioContext.  The buffer must be
+ * freed with bdrv_bounce_put() and the same size.
+ */
+void *bdrv_bounce_get(BlockDriverState *bs, size_t size);
+void *bdrv_try_bounce_get(BlockDriverState *bs, size_t size);
+void bdrv_bounce_put(void *buf, size_t size);
+
 void bdrv_enable_copy_on_read(BlockDriverState *bs);
 void bdrv_disable_copy_on_read(BlockDriverState *bs);
 
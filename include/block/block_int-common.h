@@ -253,6 +253,16 @@ struct BlockDriver {
         BlockDriverState *bs, QDict *options, int flags, Error **errp);
     void (*bdrv_close)(BlockDriverState *bs);
 
+    /*
+     * Start connecting to the server of a node that is going to be opened
+     * with @options, so that several nodes can connect in parallel.  The
+     * connection is used when the node named @options->node_name is opened
+     * and dropped by .bdrv_preconnect_cleanup() otherwise.  Errors are
+     * left for opening the node to report.
+     */
+    void (*bdrv_preconnect)(BlockdevOptions *options);
+    void (*bdrv_preconnect_cleanup)(void);
+
     int coroutine_fn GRAPH_UNLOCKED_PTR (*bdrv_co_create)(
         BlockdevCreateOptions *opts, Error **errp);
 
@@ -0,0 +1,38 @@
+/*
+ * Pool of aligned bounce buffers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef BLOCK_BOUNCE_POOL_H
+#define BLOCK_BOUNCE_POOL_H
+
+#include "qemu/units.h"
+
+/* Larger buffers are always allocated and freed directly */
+#define BOUNCE_POOL_MAX_SIZE    (256 * KiB)
+
+typedef struct BouncePool BouncePool;
+
+/*
+ * A BouncePool is owned by an AioContext and must only be used from the
+ * thread that runs it; see aio_get_bounce_pool().  Only the statistics may
+ * be read from other threads.
+ */
+BouncePool *bounce_pool_new(void);
+void bounce_pool_free(BouncePool *pool);
+
+/*
+ * Return a buffer of at least @size bytes aligned to @align, or NULL on
+ * allocation failure.  @pool may be NULL, in which case the buffer is
+ * allocated directly.  The buffer must be returned with bounce_pool_put()
+ * and the same @size.
+ */
+void *bounce_pool_try_get(BouncePool *pool, size_t align, size_t size);
+void bounce_pool_put(BouncePool *pool, void *buf, size_t size);
+
+void bounce_pool_get_stats(BouncePool *pool, uint64_t *hits,
+                           uint64_t *misses);
+
+#endif
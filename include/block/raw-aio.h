@@ -65,14 +65,32 @@ void laio_attach_aio_context(LinuxAioState *s, AioContext *new_context);
 #endif
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
-LuringState *luring_init(Error **errp);
+LuringState *luring_init(unsigned int flags, Error **errp);
 void luring_cleanup(LuringState *s);
 
-/* luring_co_submit: submit I/O requests in the thread's current AioContext. */
+/*
+ * luring_co_submit: submit I/O requests to the ring with LURING_* @flags in
+ * the thread's current AioContext.
+ */
 int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
-                                  QEMUIOVector *qiov, int type);
+                                  QEMUIOVector *qiov, int type,
+                                  unsigned int flags);
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
+
+/*
+ * luring_unregister_fd: drop @fd from the registered file tables of all rings.
+ * Must be called before closing a file descriptor that was used with
+ * luring_co_submit().
+ */
+void luring_unregister_fd(int fd);
+
+/*
+ * luring_register_buf/luring_unregister_buf: add or remove a memory region
+ * that rings register as fixed buffers the next time they are idle.
+ */
+void luring_register_buf(void *host, size_t size);
+void luring_unregister_buf(void *host, size_t size);
 #endif
 
 #ifdef _WIN32
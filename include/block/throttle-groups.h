@@ -33,6 +33,13 @@
  * and holds related data.
  */
 
+/* Budget reserved from the group, see throttle_group_take_credit() */
+typedef struct ThrottleCredit {
+    double units;
+    double bytes;
+    uint64_t op_size;
+} ThrottleCredit;
+
 typedef struct ThrottleGroupMember {
     AioContext   *aio_context;
     /* throttled_reqs_lock protects the CoQueues for throttled requests.  */
@@ -49,6 +56,12 @@ typedef struct ThrottleGroupMember {
      */
     unsigned int restart_pending;
 
+    /* Admits requests without taking the ThrottleGroup lock.  Protected by
+     * credit_lock, which nests inside the ThrottleGroup lock.
+     */
+    QemuSpin       credit_lock;
+    ThrottleCredit credit[THROTTLE_MAX];
+
     /* The following fields are protected by the ThrottleGroup lock.
      * See the ThrottleGroup documentation for details.
      * throttle_state tells us if I/O limits are configured. */
@@ -231,6 +231,19 @@ guint qemu_chr_fe_add_watch(CharBackend *be, GIOCondition cond,
  */
 int qemu_chr_fe_write(CharBackend *be, const uint8_t *buf, int len);
 
+/**
+ * qemu_chr_fe_writev:
+ * @iov: the buffers
+ * @iovcnt: the number of buffers in @iov
+ *
+ * Like @qemu_chr_fe_write, but send data from several buffers.  Back ends
+ * that support it write all buffers with a single system call.  This
+ * function is thread-safe.
+ *
+ * Returns: the number of bytes consumed (0 if no associated Chardev)
+ */
+int qemu_chr_fe_writev(CharBackend *be, const struct iovec *iov, int iovcnt);
+
 /**
  * qemu_chr_fe_write_all:
  * @buf: the data
@@ -225,6 +225,7 @@ QemuOpts *qemu_chr_parse_compat(const char *label, const char *filename,
                                 bool permit_mux_mon);
 int qemu_chr_write(Chardev *s, const uint8_t *buf, int len, bool write_all);
 #define qemu_chr_write_all(s, buf, len) qemu_chr_write(s, buf, len, true)
+int qemu_chr_writev(Chardev *s, const struct iovec *iov, int iovcnt);
 int qemu_chr_wait_connected(Chardev *chr, Error **errp);
 
 #define TYPE_CHARDEV "chardev"
@@ -265,6 +266,9 @@ struct ChardevClass {
     /* write buf to the backend */
     int (*chr_write)(Chardev *s, const uint8_t *buf, int len);
 
+    /* optional, write the buffers of iov to the backend in one go */
+    int (*chr_writev)(Chardev *s, const struct iovec *iov, int iovcnt);
+
     /*
      * Read from the backend (blocking). A typical front-end will instead rely
      * on chr_can_read/chr_read being called when polling/looping.
@@ -259,6 +259,26 @@ ssize_t qcrypto_tls_session_read(QCryptoTLSSession *sess,
  */
 size_t qcrypto_tls_session_check_pending(QCryptoTLSSession *sess);
 
+/**
+ * qcrypto_tls_session_ktls_tx:
+ * @sess: the TLS session object
+ * @fd: the TCP socket that carries the session
+ *
+ * Try to move encryption of outgoing records into the kernel, so
+ * that plain text written to @fd is sent as TLS application data.
+ * This needs Linux kernel TLS support and an AES-GCM cipher suite.
+ *
+ * On success qcrypto_tls_session_write() must not be used anymore;
+ * incoming data is still decrypted by qcrypto_tls_session_read().
+ *
+ * It is an error to call this before
+ * qcrypto_tls_session_get_handshake_status() returns
+ * QCRYPTO_TLS_HANDSHAKE_COMPLETE
+ *
+ * Returns: true if the kernel now encrypts outgoing data
+ */
+bool qcrypto_tls_session_ktls_tx(QCryptoTLSSession *sess, int fd);
+
 /**
  * qcrypto_tls_session_handshake:
  * @sess: the TLS session object
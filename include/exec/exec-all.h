@@ -278,6 +278,59 @@ void tlb_set_page_with_attrs(CPUState *cpu, vaddr addr,
 void tlb_set_page(CPUState *cpu, vaddr addr,
                   hwaddr paddr, int prot,
                   int mmu_idx, vaddr size);
+
+/**
+ * tlb_walk_cache_lookup:
+ * @cpu: CPU context
+ * @addr: virtual address being translated
+ * @shift: number of low bits of @addr not translated by the entry
+ * @root: root of the page tables, e.g. the page directory base register
+ * @mode: target-defined translation regime
+ *
+ * Look up an intermediate page table entry, which maps the bits of
+ * @addr above @shift, that was cached by tlb_walk_cache_insert() for
+ * the same @root and @mode.  This lets the target tlb_fill function
+ * resume the page table walk at the next level, much like the paging
+ * structure caches of real hardware.
+ *
+ * The cache is emptied by every TLB flush, of any page or mmu_idx,
+ * so it is only valid for targets that are allowed to retain entries
+ * until then.  The target is responsible for not caching an entry
+ * that could fault, and for calling tlb_walk_cache_remove() when a
+ * page fault must guarantee a fresh walk.  Must be called by @cpu.
+ *
+ * Returns the entry, or NULL if none is cached.
+ */
+const CPUTLBWalkEntry *tlb_walk_cache_lookup(CPUState *cpu, vaddr addr,
+                                             unsigned shift, uint64_t root,
+                                             uint32_t mode);
+
+/**
+ * tlb_walk_cache_insert:
+ * @cpu: CPU context
+ * @addr: virtual address being translated
+ * @shift: number of low bits of @addr not translated by the entry
+ * @root: root of the page tables
+ * @mode: target-defined translation regime
+ * @entry: the page table entry
+ * @attrs: target-defined attributes accumulated down to @entry
+ *
+ * Cache an intermediate page table entry for tlb_walk_cache_lookup().
+ * Must be called by @cpu.
+ */
+void tlb_walk_cache_insert(CPUState *cpu, vaddr addr, unsigned shift,
+                           uint64_t root, uint32_t mode,
+                           uint64_t entry, uint64_t attrs);
+
+/**
+ * tlb_walk_cache_remove:
+ * @cpu: CPU context
+ * @addr: virtual address
+ *
+ * Drop the cached intermediate page table entries that map @addr.
+ * Must be called by @cpu.
+ */
+void tlb_walk_cache_remove(CPUState *cpu, vaddr addr);
 #else
 static inline void tlb_init(CPUState *cpu)
 {
@@ -829,6 +829,8 @@ struct MemoryRegion {
 
     /* For devices designed to perform re-entrant IO into their own IO MRs */
     bool disable_reentrancy_guard;
+    /* Accesses are dispatched without taking the BQL */
+    bool lockless_io;
 };
 
 struct IOMMUMemoryRegion {
@@ -2243,6 +2245,24 @@ void memory_region_clear_coalescing(MemoryRegion *mr);
  */
 void memory_region_set_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_enable_lockless_io: Dispatch accesses without the BQL
+ *
+ * Accesses from vCPUs that do not hold the BQL, for example KVM MMIO and
+ * PIO exits, are normally serialized by taking the BQL around the
+ * #MemoryRegionOps callbacks.  After this call, the callbacks of @mr are
+ * invoked without it and the device must protect its state by other
+ * means, for example with a lock of its own.
+ *
+ * Only use this for registers whose accessors neither touch state that is
+ * protected by the BQL nor raise interrupts.  It must not be combined with
+ * memory_region_set_flush_coalesced().  The device's re-entrancy guard is
+ * not applied to @mr, so its accessors must not start DMA either.
+ *
+ * @mr: the memory region to be updated.
+ */
+void memory_region_enable_lockless_io(MemoryRegion *mr);
+
 /**
  * memory_region_clear_flush_coalesced: Disable memory coalescing flush before
  *                                      accesses.
@@ -43,7 +43,8 @@ static inline long clear_bmap_size(uint64_t pages, uint8_t shift)
 
 /**
  * clear_bmap_set: set clear bitmap for the page range.  Must be with
- * bitmap_mutex held.
+ * bitmap_mutex held.  The bits are set atomically, because parallel
+ * bitmap syncs may set bits of the same word for adjacent ranges.
  *
  * @rb: the ramblock to operate on
  * @start: the start page number
@@ -56,7 +57,8 @@ static inline void clear_bmap_set(RAMBlock *rb, uint64_t start,
 {
     uint8_t shift = rb->clear_bmap_shift;
 
-    bitmap_set(rb->clear_bmap, start >> shift, clear_bmap_size(npages, shift));
+    bitmap_set_atomic(rb->clear_bmap, start >> shift,
+                      clear_bmap_size(npages, shift));
 }
 
 /**
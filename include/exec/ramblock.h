@@ -46,6 +46,17 @@ struct RAMBlock {
     unsigned long *bmap;
     /* bitmap of already received pages in postcopy */
     unsigned long *receivedmap;
+    /*
+     * bitmap of pages present in the migration file, only used with
+     * the mapped-ram capability
+     */
+    unsigned long *file_bmap;
+    /*
+     * offsets of the bitmap and of the page array of this block in
+     * the migration file, only used with the mapped-ram capability
+     */
+    off_t bitmap_offset;
+    uint64_t pages_offset;
 
     /*
      * bitmap to track already cleared dirty bitmap.  When the bit is
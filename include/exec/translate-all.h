@@ -28,6 +28,10 @@ void tb_check_watchpoint(CPUState *cpu, uintptr_t retaddr);
 #ifdef CONFIG_USER_ONLY
 void page_protect(tb_page_addr_t page_addr);
 int page_unprotect(target_ulong address, uintptr_t pc);
+
+/* Print TCG statistics to stderr at exit, see -tcg-stats */
+void tcg_user_stats_enable(void);
+void tcg_user_stats_exit(void);
 #endif
 
 #endif /* TRANSLATE_ALL_H */
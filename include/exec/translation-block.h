@@ -88,6 +88,16 @@ struct TranslationBlock {
     uint16_t size;
     uint16_t icount;
 
+    /*
+     * Number of times this TB was entered other than through a direct
+     * chained jump, i.e. from the main loop or via lookup_tb_ptr.
+     * Only maintained when the "hot-tb-threshold" accel property is set.
+     * Updated with qatomic_read() and qatomic_set() rather than an atomic
+     * increment, so concurrent entries under MTTCG may lose counts and the
+     * value is approximate.
+     */
+    uint32_t exec_count;
+
     struct tb_tc tc;
 
     /*
@@ -230,6 +230,19 @@ translator_ldq_swap(CPUArchState *env, DisasContextBase *db,
  */
 void translator_fake_ldb(uint8_t insn8, abi_ptr pc);
 
+#ifdef CONFIG_USER_ONLY
+/**
+ * translator_add_native_pc - run a host function in place of guest code
+ * @pc: guest address of the function
+ *
+ * TBs never run guest code at @pc.  They exit to the cpu loop with
+ * EXCP_NATIVE instead, so that it can make the call on the host and
+ * return to the guest caller.  Must be called before any code at @pc
+ * is translated.
+ */
+void translator_add_native_pc(vaddr pc);
+#endif
+
 /*
  * Return whether addr is on the same page as where disassembly started.
  * Translators can use this to enforce the rule that only single-insn
@@ -202,6 +202,13 @@ struct CPUClass {
 /* Use a fully associative victim tlb of 8 entries. */
 #define CPU_VTLB_SIZE 8
 
+/* Remember up to 8 large pages per mmu mode, also fully associative. */
+#define CPU_TLB_LARGE_SIZE 8
+
+/* Cache up to 32 intermediate page table entries, direct mapped. */
+#define CPU_TLB_WALK_BITS 5
+#define CPU_TLB_WALK_SIZE (1 << CPU_TLB_WALK_BITS)
+
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
  * so the layout is not as critical as that of CPUTLBEntry. This is
@@ -262,6 +269,33 @@ typedef struct CPUTLBEntryFull {
     } extra;
 } CPUTLBEntryFull;
 
+/*
+ * A large page installed by the target, kept after the page-granular
+ * entries derived from it have been evicted or flushed, so that they
+ * can be refilled without a page table walk.  @addr is the virtual
+ * address of the start of the page, or -1 if the entry is unused.
+ * @full.phys_addr is the physical address of the start of the page.
+ */
+typedef struct CPUTLBLargePage {
+    vaddr addr;
+    vaddr mask;
+    CPUTLBEntryFull full;
+} CPUTLBLargePage;
+
+/*
+ * An intermediate page table entry, see tlb_walk_cache_lookup().
+ * @tag holds the virtual address bits translated so far, with the
+ * shift of the first untranslated bit in the page offset; it is -1
+ * if the entry is unused.
+ */
+typedef struct CPUTLBWalkEntry {
+    vaddr tag;
+    uint64_t root;
+    uint64_t entry;
+    uint64_t attrs;
+    uint32_t mode;
+} CPUTLBWalkEntry;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
@@ -286,11 +320,21 @@ typedef struct CPUTLBDesc {
     CPUTLBEntry vtable[CPU_VTLB_SIZE];
     CPUTLBEntryFull vfulltlb[CPU_VTLB_SIZE];
     CPUTLBEntryFull *fulltlb;
+    /* The next index to use in the large page table.  */
+    size_t lindex;
+    CPUTLBLargePage ltable[CPU_TLB_LARGE_SIZE];
 } CPUTLBDesc;
 
 /*
  * Data elements that are shared between all MMU modes.
  */
+#define CPU_TLB_PENDING_FLUSH_MAX 16
+
+typedef struct CPUTLBPendingFlush {
+    vaddr addr;
+    uint16_t idxmap;
+} CPUTLBPendingFlush;
+
 typedef struct CPUTLBCommon {
     /* Serialize updates to f.table and d.vtable, and others as noted. */
     QemuSpin lock;
@@ -300,6 +344,17 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * Page flushes requested by other cpus and not yet performed.
+     * They are batched so that a burst of requests is handled by a
+     * single async work item; pending_full accumulates the mmu_idx
+     * that must be flushed entirely once the batch overflows.
+     * Protected by tlb_c.lock.
+     */
+    bool pending_scheduled;
+    uint8_t pending_count;
+    uint16_t pending_full;
+    CPUTLBPendingFlush pending[CPU_TLB_PENDING_FLUSH_MAX];
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -308,6 +363,13 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /*
+     * Page table walk cache.  Since all flushes are performed by the
+     * cpu itself, this is only accessed by the cpu thread and needs
+     * no locking.
+     */
+    bool walk_used;
+    CPUTLBWalkEntry walk[CPU_TLB_WALK_SIZE];
 } CPUTLBCommon;
 
 /*
@@ -421,6 +483,10 @@ struct qemu_work_item;
  * @crash_occurred: Indicates the OS reported a crash (panic) for this CPU
  * @singlestep_enabled: Flags for single-stepping.
  * @icount_extra: Instructions until next timer event.
+ * @icount_quantum: Instructions executed in the current lock-step quantum.
+ * @icount_quantum_done: The current lock-step quantum is complete.
+ * @halt_poll_ns: Current TCG halt-polling window in nanoseconds.
+ * @halt_poll_stats: TCG halt-polling counters, updated by the vCPU thread.
  * @neg.can_do_io: True if memory-mapped IO is allowed.
  * @cpu_ases: Pointer to array of CPUAddressSpaces (which define the
  *            AddressSpaces this CPU has)
@@ -435,8 +501,8 @@ struct qemu_work_item;
  * @mem_io_pc: Host Program Counter at which the memory was accessed.
  * @accel: Pointer to accelerator specific state.
  * @kvm_fd: vCPU file descriptor for KVM.
- * @work_mutex: Lock to prevent multiple access to @work_list.
- * @work_list: List of pending asynchronous work.
+ * @work_list: List of pending asynchronous work, newest first.  Any thread
+ *   may push to it locklessly; only the thread running @cpu empties it.
  * @plugin_mask: Plugin event bitmap. Modified only via async work.
  * @ignore_memory_transaction_failures: Cached copy of the MachineState
  *    flag of the same name: allows the board to suppress calling of the
@@ -486,11 +552,20 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    int64_t icount_quantum;
+    bool icount_quantum_done;
+    uint32_t halt_poll_ns;
+    struct {
+        uint64_t attempted;
+        uint64_t successful;
+        uint64_t wakeups;
+        uint64_t success_ns;
+        uint64_t fail_ns;
+    } halt_poll_stats;
     uint64_t random_seed;
     sigjmp_buf jmp_env;
 
-    QemuMutex work_mutex;
-    QSIMPLEQ_HEAD(, qemu_work_item) work_list;
+    QSLIST_HEAD(, qemu_work_item) work_list;
 
     CPUAddressSpace *cpu_ases;
     int num_ases;
@@ -524,6 +599,7 @@ struct CPUState {
     struct kvm_dirty_gfn *kvm_dirty_gfns;
     uint32_t kvm_fetch_index;
     uint64_t dirty_pages;
+    uint64_t dirty_ring_full_exits;
     int kvm_vcpu_stats_fd;
 
     /* Use by accel-block: CPU is executing an ioctl() */
@@ -24,6 +24,8 @@
 
 #include "hw/i386/x86-iommu.h"
 #include "qemu/iova-tree.h"
+#include "qemu/queue.h"
+#include "qemu/seqlock.h"
 #include "qom/object.h"
 
 #define TYPE_INTEL_IOMMU_DEVICE "intel-iommu"
@@ -106,6 +108,14 @@ struct VTDAddressSpace {
     MemoryRegion iommu_ir_fault; /* Interrupt region for catching fault */
     IntelIOMMUState *iommu_state;
     VTDContextCacheEntry context_cache_entry;
+    /*
+     * Last successful translation, looked up without taking the IOMMU
+     * lock.  Valid while iotlb_last_gen matches the IOMMU's iotlb_gen.
+     * Written with the IOMMU lock held.
+     */
+    QemuSeqLock iotlb_last_seq;
+    uint32_t iotlb_last_gen;
+    IOMMUTLBEntry iotlb_last;
     QLIST_ENTRY(VTDAddressSpace) next;
     /* Superset of notifier flags that this address space has */
     IOMMUNotifierFlag notifier_flags;
@@ -149,12 +159,16 @@ struct VTDAddressSpace {
 };
 
 struct VTDIOTLBEntry {
+    /* gfn, sid, level and pasid are the lookup key */
     uint64_t gfn;
+    uint16_t sid;
+    uint8_t level;
     uint16_t domain_id;
     uint32_t pasid;
     uint64_t slpte;
     uint64_t mask;
     uint8_t access_flags;
+    QTAILQ_ENTRY(VTDIOTLBEntry) lru;
 };
 
 /* VT-d Source-ID Qualifier types */
@@ -286,6 +300,8 @@ struct IntelIOMMUState {
 
     uint32_t context_cache_gen;     /* Should be in [1,MAX] */
     GHashTable *iotlb;              /* IOTLB */
+    QTAILQ_HEAD(, VTDIOTLBEntry) iotlb_lru; /* IOTLB, most recent first */
+    uint32_t iotlb_gen;             /* Bumped when translations may change */
 
     GHashTable *vtd_address_spaces;             /* VTD address spaces */
     VTDAddressSpace *vtd_as_cache[VTD_PCI_BUS_MAX]; /* VTD address space cache */
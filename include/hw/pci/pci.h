@@ -212,6 +212,8 @@ enum {
     QEMU_PCIE_ERR_UNC_MASK = (1 << QEMU_PCIE_ERR_UNC_MASK_BITNR),
 #define QEMU_PCIE_ARI_NEXTFN_1_BITNR 12
     QEMU_PCIE_ARI_NEXTFN_1 = (1 << QEMU_PCIE_ARI_NEXTFN_1_BITNR),
+#define QEMU_PCI_MSIX_ROUTE_CACHE_BITNR 13
+    QEMU_PCI_MSIX_ROUTE_CACHE = (1 << QEMU_PCI_MSIX_ROUTE_CACHE_BITNR),
 };
 
 typedef struct PCIINTxRoute {
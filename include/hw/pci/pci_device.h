@@ -130,6 +130,9 @@ struct PCIDevice {
     unsigned *msix_entry_used;
     /* MSIX function mask set or MSIX disabled */
     bool msix_function_masked;
+    /* KVM routes and irqfds for frequently notified MSIX vectors */
+    struct MSIXRouteCacheEntry *msix_route_cache;
+    unsigned msix_route_cache_nr;
     /* Version id needed for VMState */
     int32_t version_id;
 
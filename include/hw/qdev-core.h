@@ -1083,6 +1083,11 @@ typedef enum MachineInitPhase {
      */
     PHASE_ACCEL_CREATED,
 
+    /*
+     * Late backend objects have been created and initialized.
+     */
+    PHASE_LATE_BACKENDS_CREATED,
+
     /*
      * machine_class->init has been called, thus creating any embedded
      * devices and validating machine properties.  Devices created at
@@ -1101,4 +1106,22 @@ typedef enum MachineInitPhase {
 bool phase_check(MachineInitPhase phase);
 void phase_advance(MachineInitPhase phase);
 
+/**
+ * phase_timing_format: Format startup timing statistics
+ *
+ * Returns: a table of the time at which each machine init phase was
+ * entered, followed by the time spent realizing each cold-plugged device.
+ */
+GString *phase_timing_format(void);
+
+/**
+ * qdev_topology_generation: Get the device topology generation
+ *
+ * Returns: a counter that changes whenever a device is realized or
+ * unrealized after the machine is ready, so that code deriving data
+ * from the set of devices (e.g. firmware tables) can tell whether it
+ * is still current.
+ */
+uint64_t qdev_topology_generation(void);
+
 #endif
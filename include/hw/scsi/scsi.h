@@ -24,6 +24,7 @@ struct SCSIRequest {
     SCSIBus           *bus;
     SCSIDevice        *dev;
     const SCSIReqOps  *ops;
+    AioContext        *ctx;
     uint32_t          refcount;
     uint32_t          tag;
     uint32_t          lun;
@@ -77,9 +78,12 @@ struct SCSIDevice
     uint32_t sense_len;
 
     /*
-     * The requests list is only accessed from the AioContext that executes
-     * requests or from the main loop when IOThread processing is stopped.
+     * Requests of one device can be processed in several AioContexts, each
+     * request in the AioContext where it was allocated (SCSIRequest->ctx).
+     * requests_lock protects the list itself; a request must only be
+     * cancelled or restarted from its own AioContext.
      */
+    QemuMutex requests_lock;
     QTAILQ_HEAD(, SCSIRequest) requests;
 
     uint32_t channel;
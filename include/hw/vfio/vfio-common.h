@@ -24,6 +24,7 @@
 #include "exec/memory.h"
 #include "qemu/queue.h"
 #include "qemu/notify.h"
+#include "qemu/thread.h"
 #include "ui/console.h"
 #include "hw/display/ramfb.h"
 #ifdef CONFIG_LINUX
@@ -71,6 +72,20 @@ typedef struct VFIOMigration {
     uint64_t precopy_init_size;
     uint64_t precopy_dirty_size;
     bool initial_data_sent;
+
+    /* Device data transfer with x-migration-async-buffer, see migration.c */
+    QemuThread async_thread;
+    QemuMutex async_lock;
+    QemuCond async_cond;
+    QSIMPLEQ_HEAD(, VFIOMigrationChunk) async_chunks;
+    size_t async_queued;
+    bool async_active;
+    bool async_busy;
+    bool async_done;
+    bool async_cancel;
+    int async_ret;
+    int64_t async_start_us;
+    uint64_t async_bytes;
 } VFIOMigration;
 
 struct VFIOGroup;
@@ -115,6 +130,7 @@ typedef struct VFIODevice {
     bool no_mmap;
     bool ram_block_discard_allowed;
     OnOffAuto enable_migration;
+    uint64_t migration_async_buffer;
     VFIODeviceOps *ops;
     unsigned int num_irqs;
     unsigned int num_regions;
@@ -49,6 +49,9 @@ typedef struct VFIOContainerBase {
     QLIST_ENTRY(VFIOContainerBase) next;
     QLIST_HEAD(, VFIODevice) device_list;
     GList *iova_ranges;
+    /* Unmaps deferred to the end of a memory transaction, see common.c */
+    hwaddr pending_unmap_iova;
+    hwaddr pending_unmap_size;
 } VFIOContainerBase;
 
 typedef struct VFIOGuestIOMMU {
@@ -61,12 +61,21 @@ typedef struct VhostUserHostNotifier {
  * @chr: the character backend for the socket
  * @notifiers: GPtrArray of @VhostUserHostnotifier
  * @memory_slots:
+ * @dev_started: the backend device is started
+ * @disconnect_ns: QEMU_CLOCK_REALTIME stamp of the last drop of a
+ *   started backend, 0 once the backend has been restarted
+ * @reconnects: number of times a dropped backend was restarted
+ * @last_reconnect_ns: time from the last drop to the restart
  */
 typedef struct VhostUserState {
     CharBackend *chr;
     GPtrArray *notifiers;
     int memory_slots;
     bool supports_config;
+    bool dev_started;
+    int64_t disconnect_ns;
+    uint64_t reconnects;
+    int64_t last_reconnect_ns;
 } VhostUserState;
 
 /**
@@ -92,6 +101,28 @@ bool vhost_user_init(VhostUserState *user, CharBackend *chr, Error **errp);
  */
 void vhost_user_cleanup(VhostUserState *user);
 
+/**
+ * vhost_user_note_disconnect() - record a backend connection drop
+ * @user: ptr to use state
+ *
+ * Front-ends call this when the connection to the backend goes away.
+ * If the device was started, the time until it is started again is
+ * accounted as the reconnect time of @user.
+ */
+void vhost_user_note_disconnect(VhostUserState *user);
+
+/**
+ * vhost_user_get_reconnect_stats() - query reconnect statistics
+ * @dev: the vhost device
+ * @reconnects: number of completed reconnects
+ * @last_reconnect_ms: duration of the last reconnect in milliseconds
+ *
+ * Return: false if @dev is not a vhost-user device.
+ */
+bool vhost_user_get_reconnect_stats(struct vhost_dev *dev,
+                                    uint64_t *reconnects,
+                                    int64_t *last_reconnect_ms);
+
 /**
  * vhost_user_async_close() - cleanup vhost-user post connection drop
  * @d: DeviceState for the associated device (passed to callback)
@@ -71,6 +71,10 @@ struct VirtIOBalloon {
 
     bool qemu_4_0_config_size;
     uint32_t poison_val;
+
+    /* free page reporting statistics */
+    uint64_t reported_bytes;
+    uint64_t reported_discards;
 };
 
 #endif
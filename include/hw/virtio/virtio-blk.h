@@ -90,6 +90,9 @@ typedef struct VirtIOBlockReq {
     struct VirtIOBlockReq *next;
     struct VirtIOBlockReq *mr_next;
     BlockAcctCookie acct;
+    /* QEMU_CLOCK_REALTIME, for the virtio_blk_req_latency trace event */
+    int64_t pop_ns;     /* popped from the virtqueue, or 0 if not traced */
+    int64_t submit_ns;  /* passed to the block layer, or 0 */
 } VirtIOBlockReq;
 
 #define VIRTIO_BLK_MAX_MERGE_REQS 32
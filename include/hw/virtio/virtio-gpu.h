@@ -194,6 +194,7 @@ struct VirtIOGPU {
     uint64_t hostmem;
 
     bool processing_cmdq;
+    VirtQueue *cmdq_notify_vq; /* completions not yet notified */
     QEMUTimer *fence_poll;
     QEMUTimer *print_stats;
 
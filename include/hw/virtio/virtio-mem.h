@@ -110,6 +110,13 @@ struct VirtIOMEM {
      */
     bool dynamic_memslots;
 
+    /* plug request that is preallocating memory in the thread pool */
+    VirtQueueElement *prealloc_elem;
+    uint64_t prealloc_gpa;
+    uint64_t prealloc_size;
+    Error *prealloc_err;
+    bool prealloc_draining;
+
     /* notifiers to notify when "size" changes */
     NotifierList size_change_notifiers;
 
@@ -20,6 +20,7 @@
 #include "net/announce.h"
 #include "qemu/option_int.h"
 #include "qom/object.h"
+#include "qapi/qapi-types-common.h"
 
 #include "ebpf/ebpf_rss.h"
 
@@ -56,6 +57,8 @@ typedef struct virtio_net_conf
     char *duplex_str;
     uint8_t duplex;
     char *primary_id_str;
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
+    bool sw_offload;
 } virtio_net_conf;
 
 /* Coalesced packets type & status */
@@ -157,10 +160,18 @@ typedef struct VirtIONetQueue {
     QEMUTimer *tx_timer;
     QEMUBH *tx_bh;
     uint32_t tx_waiting;
+    /* rx elements filled but not yet flushed while receiving a batch */
+    unsigned int rx_filled;
     struct {
         VirtQueueElement *elem;
     } async_tx;
     struct VirtIONet *n;
+    /* IOThread from iothread-vq-mapping, or NULL */
+    AioContext *ctx;
+    /* Offloads done in software for peers without vnet headers */
+    struct NetTxPkt *tx_pkt;
+    struct NetGRO *gro;
+    const struct virtio_net_hdr *rx_sw_hdr;
 } VirtIONetQueue;
 
 struct VirtIONet {
@@ -191,6 +202,9 @@ struct VirtIONet {
     uint8_t nouni;
     uint8_t nobcast;
     uint8_t vhost_started;
+    /* queue pairs are running in their IOThreads, see iothread-vq-mapping */
+    bool dataplane_started;
+    unsigned dataplane_pause_count;
     struct {
         uint32_t in_use;
         uint32_t first_multi;
@@ -225,6 +239,8 @@ struct VirtIONet {
     VirtioNetRssData rss_data;
     struct NetRxPkt *rx_pkt;
     struct EBPFRSSContext ebpf_rss;
+    uint32_t nr_ebpf_rss_fds;
+    char **ebpf_rss_fds;
 };
 
 size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
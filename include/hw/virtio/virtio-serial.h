@@ -80,6 +80,12 @@ struct VirtIOSerialPortClass {
      */
     ssize_t (*have_data)(VirtIOSerialPort *port, const uint8_t *buf,
                          ssize_t len);
+    /*
+     * Optional, like have_data but for several buffers at once, so
+     * that the app can pass them on in a single write.
+     */
+    ssize_t (*have_data_iov)(VirtIOSerialPort *port,
+                             const struct iovec *iov, unsigned int iovcnt);
 };
 
 /*
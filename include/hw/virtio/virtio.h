@@ -146,6 +146,12 @@ struct VirtIODevice
     bool started;
     bool start_on_kick; /* when virtio 1.0 feature has not been negotiated */
     bool disable_legacy_check;
+    /*
+     * @notify_delay_us, @notify_max_pending: virtqueue interrupt
+     * moderation, disabled when @notify_delay_us is 0
+     */
+    uint32_t notify_delay_us;
+    uint32_t notify_max_pending;
     bool vhost_started;
     VMChangeStateEntry *vmstate;
     char *bus_name;
@@ -264,6 +270,13 @@ void virtqueue_fill(VirtQueue *vq, const VirtQueueElement *elem,
 
 void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem);
 void *virtqueue_pop(VirtQueue *vq, size_t sz);
+/*
+ * Pop up to @num elements of @sz bytes into @elems, as if by repeated
+ * virtqueue_pop() calls, and return how many were popped.  Each element
+ * is freed with g_free() as usual.
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int num);
 unsigned int virtqueue_drop_all(VirtQueue *vq);
 void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz);
 void qemu_put_virtqueue_element(VirtIODevice *vdev, QEMUFile *f,
@@ -274,6 +287,11 @@ void virtqueue_get_avail_bytes(VirtQueue *vq, unsigned int *in_bytes,
                                unsigned int *out_bytes,
                                unsigned max_in_bytes, unsigned max_out_bytes);
 
+/*
+ * Whether the driver wants to be notified of the buffers used since the
+ * last notification, for devices that signal the guest notifier directly.
+ */
+bool virtio_queue_should_notify(VirtQueue *vq);
 void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq);
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq);
 
@@ -390,6 +408,9 @@ EventNotifier *virtio_queue_get_guest_notifier(VirtQueue *vq);
 void virtio_queue_set_guest_notifier_fd_handler(VirtQueue *vq, bool assign,
                                                 bool with_irqfd);
 int virtio_device_start_ioeventfd(VirtIODevice *vdev);
+/* Default ->start_ioeventfd()/->stop_ioeventfd(), for devices extending it */
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev);
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev);
 int virtio_device_grab_ioeventfd(VirtIODevice *vdev);
 void virtio_device_release_ioeventfd(VirtIODevice *vdev);
 bool virtio_device_ioeventfd_enabled(VirtIODevice *vdev);
@@ -0,0 +1,43 @@
+/*
+ * Software receive coalescing for network backends without vnet headers
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_NET_GRO_H
+#define QEMU_NET_GRO_H
+
+#include "standard-headers/linux/virtio_net.h"
+
+typedef struct NetGRO NetGRO;
+
+/*
+ * Deliver a frame of @size bytes described by @hdr, whose fields are in
+ * host byte order.  Return false if the frame could not be delivered for
+ * lack of room; it is kept and offered again by the next net_gro_flush().
+ */
+typedef bool (NetGROFlush)(void *opaque, const struct virtio_net_hdr *hdr,
+                           const uint8_t *buf, size_t size);
+
+NetGRO *net_gro_new(NetGROFlush *flush, void *opaque);
+void net_gro_free(NetGRO *gro);
+
+/*
+ * Select which TCP flows are coalesced and drop any frames held so far.
+ * Nothing is coalesced until IPv4 and/or IPv6 are enabled.
+ */
+void net_gro_configure(NetGRO *gro, bool ipv4, bool ipv6);
+
+bool net_gro_enabled(NetGRO *gro);
+
+/*
+ * Offer a frame for coalescing.  Return true if the frame was taken, in
+ * which case it is delivered by a later net_gro_flush() at the latest.
+ * Otherwise the caller must flush and then deliver the frame itself.
+ */
+bool net_gro_receive(NetGRO *gro, const uint8_t *buf, size_t size);
+
+/* Deliver all held frames.  Return false if some could not be delivered. */
+bool net_gro_flush(NetGRO *gro);
+
+#endif
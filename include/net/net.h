@@ -69,6 +69,17 @@ typedef void (SocketReadStateFinalize)(SocketReadState *rs);
 typedef void (NetAnnounce)(NetClientState *);
 typedef bool (SetSteeringEBPF)(NetClientState *, int);
 typedef bool (NetCheckPeerType)(NetClientState *, ObjectClass *, Error **);
+/*
+ * Move the client's fd handlers to @ctx, or back to the main loop if @ctx
+ * is NULL.  The caller guarantees that the client is not being used by
+ * any other thread while this runs.
+ */
+typedef void (NetSetAioContext)(NetClientState *, AioContext *);
+/*
+ * Called when the sender ends a batch of packets, see qemu_net_batch_begin().
+ * Work deferred because nc->receiving_batch was set must be completed here.
+ */
+typedef void (NetReceiveBatchEnd)(NetClientState *);
 
 typedef struct NetClientInfo {
     NetClientDriver type;
@@ -98,6 +109,8 @@ typedef struct NetClientInfo {
     NetAnnounce *announce;
     SetSteeringEBPF *set_steering_ebpf;
     NetCheckPeerType *check_peer_type;
+    NetSetAioContext *set_aio_context;
+    NetReceiveBatchEnd *receive_batch_end;
 } NetClientInfo;
 
 struct NetClientState {
@@ -118,6 +131,7 @@ struct NetClientState {
     bool is_netdev;
     bool do_not_pad; /* do not pad to the minimum ethernet frame length */
     bool is_datapath;
+    bool receiving_batch; /* between qemu_net_batch_begin/end() of the peer */
     QTAILQ_HEAD(, NetFilterState) filters;
 };
 
@@ -184,6 +198,8 @@ ssize_t qemu_receive_packet_iov(NetClientState *nc,
 ssize_t qemu_send_packet_raw(NetClientState *nc, const uint8_t *buf, int size);
 ssize_t qemu_send_packet_async(NetClientState *nc, const uint8_t *buf,
                                int size, NetPacketSent *sent_cb);
+void qemu_net_batch_begin(NetClientState *sender);
+void qemu_net_batch_end(NetClientState *sender);
 void qemu_purge_queued_packets(NetClientState *nc);
 void qemu_flush_queued_packets(NetClientState *nc);
 void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge);
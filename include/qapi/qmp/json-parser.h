@@ -27,7 +27,8 @@ typedef struct JSONMessageParser {
     JSONLexer lexer;
     int brace_count;
     int bracket_count;
-    GQueue tokens;
+    GByteArray *tokens;         /* token arena, reused across messages */
+    uint64_t token_count;
     uint64_t token_size;
 } JSONMessageParser;
 
@@ -15,6 +15,7 @@
 #define JSON_WRITER_H
 
 JSONWriter *json_writer_new(bool pretty);
+JSONWriter *json_writer_new_append(GString *contents, bool pretty);
 const char *json_writer_get(JSONWriter *);
 GString *json_writer_get_and_free(JSONWriter *);
 void json_writer_free(JSONWriter *);
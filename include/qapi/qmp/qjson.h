@@ -27,5 +27,6 @@ QDict *qdict_from_jsonf_nofail(const char *string, ...)
 
 GString *qobject_to_json(const QObject *obj);
 GString *qobject_to_json_pretty(const QObject *obj, bool pretty);
+void qobject_to_json_append(GString *buf, const QObject *obj, bool pretty);
 
 #endif /* QJSON_H */
@@ -35,6 +35,17 @@ extern __thread void *__safestack_unsafe_stack_ptr;
 
 #define COROUTINE_STACK_SIZE (1 << 20)
 
+/*
+ * Allocate and free coroutine stacks, see util/coroutine-stack.c.  The
+ * arguments and return value are like qemu_alloc_stack()/qemu_free_stack().
+ */
+void *qemu_coroutine_alloc_stack(size_t *sz);
+void qemu_coroutine_free_stack(void *stack, size_t sz);
+
+/* Number of stack arenas and of coroutine stacks allocated from them */
+void qemu_coroutine_get_stack_stats(unsigned int *arenas,
+                                    unsigned int *in_use);
+
 typedef enum {
     COROUTINE_YIELD = 1,
     COROUTINE_TERMINATE = 2,
@@ -188,6 +188,7 @@ char *freq_to_str(uint64_t freq_hz);
 #define STR_OR_NULL(str) ((str) ? (str) : "null")
 
 bool buffer_is_zero(const void *buf, size_t len);
+size_t buffer_is_zero_span(const void *buf, size_t unit, size_t n, bool zero);
 bool test_buffer_is_zero_next_accel(void);
 
 /*
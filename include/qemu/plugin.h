@@ -90,13 +90,86 @@ struct qemu_plugin_dyn_cb {
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
+        /*
+         * Inline ops have @cond QEMU_PLUGIN_COND_ALWAYS and update @entry,
+         * or @userp if @entry.score is NULL.
+         * Conditional callbacks are kept with the inline ops, so that they
+         * see the updates of the ops registered before them: @f is called
+         * with @userp when @entry @cond @imm holds, and @op is unused.
+         */
         struct {
             enum qemu_plugin_op op;
+            enum qemu_plugin_cond cond;
+            qemu_plugin_u64 entry;
             uint64_t imm;
         } inline_insn;
     };
 };
 
+struct qemu_plugin_scoreboard {
+    GArray *data;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
+/*
+ * Return the counter that an inline op updates for vCPU 0; the counter of
+ * vCPU n is n * @stride bytes further.
+ */
+static inline void *plugin_inline_op_base(const struct qemu_plugin_dyn_cb *cb,
+                                          size_t *stride)
+{
+    struct qemu_plugin_scoreboard *score = cb->inline_insn.entry.score;
+
+    if (!score) {
+        assert(cb->inline_insn.cond == QEMU_PLUGIN_COND_ALWAYS);
+        *stride = 0;
+        return cb->userp;
+    }
+    *stride = g_array_get_element_size(score->data);
+    return score->data->data + cb->inline_insn.entry.offset;
+}
+
+/*
+ * A memory access buffer is a scoreboard of PluginMemBuffer, whose
+ * @records hold @n_records records.  @pos counts the records since the
+ * last flush; translated code wraps it around @n_records, but the TB
+ * start flushes the buffer before it can overflow.
+ */
+typedef struct PluginMemBuffer {
+    uint64_t pos;
+    struct qemu_plugin_mem_record records[];
+} PluginMemBuffer;
+
+struct qemu_plugin_mem_buffer {
+    struct qemu_plugin_scoreboard *score;
+    size_t n_records;
+    qemu_plugin_mem_buffer_cb_t cb;
+    void *userdata;
+    /* most records that a TB reserves room for at its start */
+    size_t max_tb_records;
+    QLIST_ENTRY(qemu_plugin_mem_buffer) entry;
+};
+
+/*
+ * Memory access buffers are filled by regular mem callbacks that call
+ * plugin_mem_buffer_record() with the buffer as @userdata.  Translated
+ * code does the same inline; the call is made only for the accesses of
+ * helpers.
+ */
+void plugin_mem_buffer_record(unsigned int vcpu_index,
+                              qemu_plugin_meminfo_t info, uint64_t vaddr,
+                              void *userdata);
+
+static inline struct qemu_plugin_mem_buffer *
+plugin_mem_buffer_of(const struct qemu_plugin_dyn_cb *cb)
+{
+    if (cb->type != PLUGIN_CB_REGULAR ||
+        cb->f.vcpu_mem != plugin_mem_buffer_record) {
+        return NULL;
+    }
+    return cb->userp;
+}
+
 /* Internal context for instrumenting an instruction */
 struct qemu_plugin_insn {
     GByteArray *data;
@@ -109,6 +182,9 @@ struct qemu_plugin_insn {
     bool mem_helper;
 
     bool mem_only;
+
+    /* number of memory accesses done by translated code */
+    unsigned int mem_accesses;
 };
 
 /*
@@ -174,6 +250,7 @@ struct qemu_plugin_insn *qemu_plugin_tb_insn_get(struct qemu_plugin_tb *tb,
     g_byte_array_set_size(insn->data, 0);
     insn->calls_helpers = false;
     insn->mem_helper = false;
+    insn->mem_accesses = 0;
     insn->vaddr = pc;
 
     for (i = 0; i < PLUGIN_N_CB_TYPES; i++) {
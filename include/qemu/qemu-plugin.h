@@ -50,11 +50,18 @@ typedef uint64_t qemu_plugin_id_t;
  *
  * The plugins export the API they were built against by exposing the
  * symbol qemu_plugin_version which can be checked.
+ *
+ * version 2:
+ * - added scoreboards: per-vCPU storage that inline ops can update
+ *   without contention, see qemu_plugin_scoreboard_new()
+ * - added QEMU_PLUGIN_INLINE_STORE_U64 and conditional callbacks, see
+ *   qemu_plugin_register_vcpu_tb_exec_cond_cb()
+ * - added memory access buffers, see qemu_plugin_mem_buffer_new()
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 2
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -281,18 +288,109 @@ void qemu_plugin_register_vcpu_tb_exec_cb(struct qemu_plugin_tb *tb,
                                           enum qemu_plugin_cb_flags flags,
                                           void *userdata);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb() - register conditional callback
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to enable callback
+ * @entry: first operand for condition
+ * @imm: second operand for condition
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called when a translated unit executes if
+ * entry @cond imm, for the element of @entry of the executing vCPU.
+ * The condition is evaluated by the translated code, so no call is made
+ * while it does not hold.  Combined with an inline op on the same
+ * @entry this allows, for instance, to sample every n-th execution.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               qemu_plugin_u64 entry,
+                                               uint64_t imm,
+                                               void *userdata);
+
 /**
  * enum qemu_plugin_op - describes an inline op
  *
  * @QEMU_PLUGIN_INLINE_ADD_U64: add an immediate value uint64_t
+ * @QEMU_PLUGIN_INLINE_STORE_U64: store an immediate value uint64_t
  *
- * Note: currently only a single inline op is supported.
+ * Several inline ops and conditional callbacks can be registered for
+ * the same instrumentation point; they run in the order of registration.
  */
 
 enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
+    QEMU_PLUGIN_INLINE_STORE_U64,
+};
+
+/**
+ * enum qemu_plugin_cond - condition to enable callback
+ *
+ * @QEMU_PLUGIN_COND_NEVER: false
+ * @QEMU_PLUGIN_COND_ALWAYS: true
+ * @QEMU_PLUGIN_COND_EQ: is equal?
+ * @QEMU_PLUGIN_COND_NE: is not equal?
+ * @QEMU_PLUGIN_COND_LT: is less than?
+ * @QEMU_PLUGIN_COND_LE: is less than or equal?
+ * @QEMU_PLUGIN_COND_GT: is greater than?
+ * @QEMU_PLUGIN_COND_GE: is greater than or equal?
+ *
+ * Values are compared as unsigned 64-bit integers.
+ */
+enum qemu_plugin_cond {
+    QEMU_PLUGIN_COND_NEVER,
+    QEMU_PLUGIN_COND_ALWAYS,
+    QEMU_PLUGIN_COND_EQ,
+    QEMU_PLUGIN_COND_NE,
+    QEMU_PLUGIN_COND_LT,
+    QEMU_PLUGIN_COND_LE,
+    QEMU_PLUGIN_COND_GT,
+    QEMU_PLUGIN_COND_GE,
 };
 
+/**
+ * struct qemu_plugin_scoreboard - opaque handle for a scoreboard
+ *
+ * A scoreboard holds one element per vCPU, so that each vCPU can update
+ * its own element without racing with the others.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - uint64_t member of the elements of a scoreboard
+ *
+ * Designates the uint64_t located at @offset in every element of @score.
+ * The per-vCPU inline ops take this as the counter to update.
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
+/**
+ * qemu_plugin_scoreboard_u64_in_struct() - qemu_plugin_u64 for a struct member
+ * @handle: scoreboard whose elements are of type @type
+ * @type: type of the scoreboard elements
+ * @member: uint64_t member of @type
+ */
+#define qemu_plugin_scoreboard_u64_in_struct(handle, type, member) \
+    ((qemu_plugin_u64) {                                           \
+        .score = handle,                                           \
+        .offset = offsetof(type, member)                           \
+    })
+
+/**
+ * qemu_plugin_scoreboard_u64() - qemu_plugin_u64 for a scoreboard of uint64_t
+ * @handle: scoreboard whose elements are of type uint64_t
+ */
+#define qemu_plugin_scoreboard_u64(handle) \
+    ((qemu_plugin_u64) { .score = handle, .offset = 0 })
+
 /**
  * qemu_plugin_register_vcpu_tb_exec_inline() - execution inline op
  * @tb: the opaque qemu_plugin_tb handle for the translation
@@ -312,6 +410,24 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - execution inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry to run op, in the element of the executing vCPU
+ * @imm: the op data (e.g. 1)
+ *
+ * Insert an inline op on a given scoreboard entry every time a translated
+ * unit executes.  As each vCPU only updates its own element, the result is
+ * exact without any atomic operation.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -327,6 +443,29 @@ void qemu_plugin_register_vcpu_insn_exec_cb(struct qemu_plugin_insn *insn,
                                             enum qemu_plugin_cb_flags flags,
                                             void *userdata);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_cond_cb() - conditional insn execution cb
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to enable callback
+ * @entry: first operand for condition
+ * @imm: second operand for condition
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called when an instruction executes if
+ * entry @cond imm, for the element of @entry of the executing vCPU.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_insn_exec_cond_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    enum qemu_plugin_cond cond,
+    qemu_plugin_u64 entry,
+    uint64_t imm,
+    void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_inline() - insn execution inline op
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -342,6 +481,23 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - insn exec inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry to run op, in the element of the executing vCPU
+ * @imm: the op data (e.g. 1)
+ *
+ * Insert an inline op on a given scoreboard entry every time an
+ * instruction executes.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -567,7 +723,120 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - inline op for mem access
+ * @insn: handle for instruction to instrument
+ * @rw: apply to reads, writes or both
+ * @op: the op, of type qemu_plugin_op
+ * @entry: entry to run op, in the element of the executing vCPU
+ * @imm: immediate data for @op
+ *
+ * This registers an inline op on a given scoreboard entry for every memory
+ * access generated by the instruction.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * struct qemu_plugin_mem_buffer - opaque handle for a memory access buffer
+ *
+ * A memory access buffer collects the memory accesses of each vCPU in
+ * translated code, without calling out of it, and hands them to the
+ * plugin in batches.
+ */
+struct qemu_plugin_mem_buffer;
+
+/**
+ * struct qemu_plugin_mem_record - a memory access recorded in a buffer
+ * @vaddr: the virtual address of the access
+ * @info: an opaque handle for further queries about the access
+ */
+struct qemu_plugin_mem_record {
+    uint64_t vaddr;
+    qemu_plugin_meminfo_t info;
+};
+
+/**
+ * typedef qemu_plugin_mem_buffer_cb_t - memory access buffer flush callback
+ * @vcpu_index: the vCPU whose accesses are delivered
+ * @records: the accesses, oldest first
+ * @n: number of @records
+ * @userdata: the userdata passed to qemu_plugin_mem_buffer_new()
+ *
+ * @records are only valid during the callback.
+ */
+typedef void (*qemu_plugin_mem_buffer_cb_t)(
+    unsigned int vcpu_index,
+    const struct qemu_plugin_mem_record *records,
+    size_t n,
+    void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_new() - alloc a new memory access buffer
+ * @n_records: number of records per vCPU, a power of 2 up to 16384
+ * @cb: callback to deliver the records of a vCPU
+ * @userdata: opaque pointer passed to @cb
+ *
+ * @cb is called on the thread of the vCPU: before a translation block
+ * executes if its accesses might not fit in the buffer anymore, when a
+ * helper fills the buffer, when the vCPU goes idle or exits, and from
+ * qemu_plugin_mem_buffer_flush().
+ *
+ * Returns a pointer to a new buffer, or NULL if @n_records is invalid.
+ * It must be freed using qemu_plugin_mem_buffer_free().
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_mem_buffer *
+qemu_plugin_mem_buffer_new(size_t n_records, qemu_plugin_mem_buffer_cb_t cb,
+                           void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_free() - free a memory access buffer
+ * @buf: buffer to free
+ *
+ * Records that were not flushed yet are dropped.  No instruction may be
+ * instrumented with @buf anymore, e.g. free it from the atexit callback.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf);
+
+/**
+ * qemu_plugin_register_vcpu_mem_buffered() - record memory accesses in a buffer
+ * @insn: handle for instruction to instrument
+ * @rw: record reads, writes or both
+ * @buf: buffer to record the accesses in
+ *
+ * This records every memory access generated by the instruction in @buf.
+ * Unlike qemu_plugin_register_vcpu_mem_cb(), translated code only stores
+ * the address and the meminfo handle of the access, and the plugin sees
+ * the accesses in batches: a vCPU has done them by the time @buf's
+ * callback runs, but it might not have executed the next instruction.
+ *
+ * This must be called from the translation callback.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_buffered(struct qemu_plugin_insn *insn,
+                                            enum qemu_plugin_mem_rw rw,
+                                            struct qemu_plugin_mem_buffer *buf);
 
+/**
+ * qemu_plugin_mem_buffer_flush() - deliver the records of a vCPU
+ * @buf: buffer to flush
+ * @vcpu_index: vCPU whose records are delivered
+ *
+ * Call the callback of @buf with the records of @vcpu_index, if any.
+ * This must be called from the thread of the vCPU, e.g. from one of its
+ * callbacks, or while the vCPU is not running, e.g. from the atexit
+ * callback.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                                  unsigned int vcpu_index);
 
 typedef void
 (*qemu_plugin_vcpu_syscall_cb_t)(qemu_plugin_id_t id, unsigned int vcpu_index,
@@ -708,4 +977,81 @@ uint64_t qemu_plugin_end_code(void);
 QEMU_PLUGIN_API
 uint64_t qemu_plugin_entry_code(void);
 
+/**
+ * qemu_plugin_num_vcpus() - number of vCPUs initialized so far
+ *
+ * Returns: one more than the highest index of a vCPU that has been
+ * initialized, i.e. the number of scoreboard elements in use.
+ */
+QEMU_PLUGIN_API
+int qemu_plugin_num_vcpus(void);
+
+/**
+ * qemu_plugin_scoreboard_new() - alloc a new scoreboard
+ * @element_size: size (in bytes) of one element, for each vCPU
+ *
+ * Returns a pointer to a new scoreboard. It must be freed using
+ * qemu_plugin_scoreboard_free.  Elements are zeroed, including those of
+ * vCPUs that are initialized later.
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: scoreboard to free
+ *
+ * No inline op may use @score anymore, e.g. free it from the atexit
+ * callback.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get pointer to an entry of a scoreboard
+ * @score: scoreboard to query
+ * @vcpu_index: entry index
+ *
+ * Returns address of entry of a scoreboard matching a given vcpu_index. This
+ * address can be modified later if scoreboard is resized, so do not keep it.
+ */
+QEMU_PLUGIN_API
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_add() - add a value to a qemu_plugin_u64 for a given vcpu
+ * @entry: entry to query
+ * @vcpu_index: entry index
+ * @added: value to add
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added);
+
+/**
+ * qemu_plugin_u64_get() - get value of a qemu_plugin_u64 for a given vcpu
+ * @entry: entry to query
+ * @vcpu_index: entry index
+ */
+QEMU_PLUGIN_API
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_set() - set value of a qemu_plugin_u64 for a given vcpu
+ * @entry: entry to query
+ * @vcpu_index: entry index
+ * @val: new value
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+
+/**
+ * qemu_plugin_u64_sum() - return sum of all vcpu entries in a scoreboard
+ * @entry: entry to sum
+ */
+QEMU_PLUGIN_API
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
 #endif /* QEMU_QEMU_PLUGIN_H */
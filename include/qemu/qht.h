@@ -24,7 +24,8 @@ struct qht {
  * struct qht_stats - Statistics of a QHT
  * @head_buckets: number of head buckets
  * @used_head_buckets: number of non-empty head buckets
- * @entries: total number of entries
+ * @entries: total number of entries, including those of a map that is being
+ *           incrementally resized away from
  * @chain: frequency distribution representing the number of buckets in each
  *         chain, excluding empty chains.
  * @occupancy: frequency distribution representing chain occupancy rate.
@@ -16,12 +16,46 @@ enum QSPSortBy {
     QSP_SORT_BY_AVG_WAIT_TIME,
 };
 
+/*
+ * Durations are counted in QSP_HIST_BUCKETS buckets.  The first bucket
+ * holds durations below 2^QSP_HIST_SHIFT ns, each following bucket
+ * doubles the upper bound and the last one is unbounded.
+ */
+#define QSP_HIST_BUCKETS 16
+#define QSP_HIST_SHIFT 10
+
+typedef struct QSPStat {
+    const char *typename;
+    char *callsite_at;          /* "file:line" */
+    const void *obj;
+    unsigned int n_objs;        /* count of coalesced objs, or 0 */
+    uint64_t ns;                /* time waited, or held for "BQL held" */
+    uint64_t n_acqs;
+    uint64_t hist[QSP_HIST_BUCKETS];
+} QSPStat;
+
+typedef void QSPStatFunc(const QSPStat *stat, void *opaque);
+
 void qsp_report(size_t max, enum QSPSortBy sort_by,
-                bool callsite_coalesce);
+                bool callsite_coalesce, bool histogram);
+
+/* Like qsp_report(), but pass each entry to @fn instead of printing it */
+void qsp_foreach(size_t max, enum QSPSortBy sort_by, bool callsite_coalesce,
+                 QSPStatFunc *fn, void *opaque);
+
+/* Upper bound of histogram bucket @i in ns, UINT64_MAX for the last one */
+uint64_t qsp_hist_bucket_limit(unsigned int i);
 
 bool qsp_is_enabled(void);
 void qsp_enable(void);
 void qsp_disable(void);
 void qsp_reset(void);
 
+/*
+ * Profile one in every @period operations on average, and weight the
+ * samples by @period.  1, the default, profiles every operation.
+ */
+void qsp_set_sample_period(unsigned int period);
+unsigned int qsp_get_sample_period(void);
+
 #endif /* QEMU_QSP_H */
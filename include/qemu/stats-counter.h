@@ -0,0 +1,91 @@
+/*
+ * Always-on counters for hot paths
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Counters are kept per thread, so that incrementing one is a plain
+ * store to memory that no other thread writes.  The totals are only
+ * computed when the counters are read, e.g. by the query-stats QMP
+ * command under the "qemu" provider.
+ *
+ * Define a counter in the file that uses it and increment it with
+ * stats_counter_inc() or stats_counter_add():
+ *
+ * .. code-block:: c
+ *
+ *   STATS_COUNTER_DEFINE(bh_runs, "bh-runs");
+ *   ...
+ *   stats_counter_inc(&bh_runs);
+ *
+ * Incrementing a counter is safe in coroutines.
+ */
+
+#ifndef QEMU_STATS_COUNTER_H
+#define QEMU_STATS_COUNTER_H
+
+#include "qemu/coroutine-tls.h"
+#include "qemu/notify.h"
+#include "qemu/queue.h"
+#include "qemu/stats64.h"
+
+#define STATS_COUNTER_MAX 64
+
+typedef struct StatsCounter {
+    const char *name;
+    unsigned int index;
+} StatsCounter;
+
+typedef struct StatsCounterThread {
+    Stat64 counts[STATS_COUNTER_MAX];
+    Notifier exit_notifier;
+    QLIST_ENTRY(StatsCounterThread) next;
+} StatsCounterThread;
+
+QEMU_DECLARE_CO_TLS(StatsCounterThread *, stats_counter_thread)
+
+void stats_counter_register(StatsCounter *counter);
+StatsCounterThread *stats_counter_thread_new(void);
+
+/**
+ * STATS_COUNTER_DEFINE:
+ * @var: the name of the static StatsCounter variable
+ * @counter_name: the name of the counter in query-stats
+ */
+#define STATS_COUNTER_DEFINE(var, counter_name)                             \
+    static StatsCounter var = { .name = counter_name };                     \
+    static void __attribute__((__constructor__)) var##_register(void)       \
+    {                                                                       \
+        stats_counter_register(&var);                                       \
+    }
+
+static inline void stats_counter_add(StatsCounter *counter, uint64_t n)
+{
+    StatsCounterThread *t = get_stats_counter_thread();
+    Stat64 *s;
+
+    if (unlikely(!t)) {
+        t = stats_counter_thread_new();
+    }
+    s = &t->counts[counter->index];
+#ifdef CONFIG_ATOMIC64
+    /* Only this thread writes the counter, no need for an atomic add */
+    qatomic_set__nocheck(&s->value, qatomic_read__nocheck(&s->value) + n);
+#else
+    stat64_add(s, n);
+#endif
+}
+
+static inline void stats_counter_inc(StatsCounter *counter)
+{
+    stats_counter_add(counter, 1);
+}
+
+typedef void StatsCounterFunc(const char *name, uint64_t value, void *opaque);
+
+/*
+ * Call @fn with the name and total value of each counter, in order of
+ * registration.
+ */
+void stats_counter_foreach(StatsCounterFunc *fn, void *opaque);
+
+#endif /* QEMU_STATS_COUNTER_H */
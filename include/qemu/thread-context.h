@@ -47,6 +47,13 @@ struct ThreadContext {
     /* CPU affinity bitmap used for initialization. */
     unsigned long *init_cpu_bitmap;
     int init_cpu_nbits;
+
+    /* Scheduling parameters, inherited by threads created in the context. */
+    bool sched_set;
+    int sched_policy;
+    uint8_t sched_priority;
+    bool nice_set;
+    int8_t nice;
 };
 
 void thread_context_create_thread(ThreadContext *tc, QemuThread *thread,
@@ -158,6 +158,13 @@ bool throttle_schedule_timer(ThrottleState *ts,
 
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size);
+
+void throttle_budget_for(ThrottleState *ts, ThrottleDirection direction,
+                         int64_t ns, double *units, double *size);
+bool throttle_reserve(ThrottleState *ts, ThrottleDirection direction,
+                      int64_t now, double units, double size);
+void throttle_unreserve(ThrottleState *ts, ThrottleDirection direction,
+                        double units, double size);
 void throttle_limits_to_config(ThrottleLimits *arg, ThrottleConfig *cfg,
                                Error **errp);
 void throttle_config_to_limits(ThrottleConfig *cfg, ThrottleLimits *var);
@@ -24,6 +24,8 @@ typedef struct VuFdWatch {
     int fd; /*kick fd*/
     void *pvt;
     vu_watch_cb cb;
+    /* Set by remove_watch() if kicks may still be dispatched in another thread */
+    bool removed;
     QTAILQ_ENTRY(VuFdWatch) next;
 } VuFdWatch;
 
@@ -31,7 +33,8 @@ typedef struct VuFdWatch {
  * VuServer:
  * A vhost-user server instance with user-defined VuDevIface callbacks.
  * Vhost-user device backends can be implemented using VuServer. VuDevIface
- * callbacks and virtqueue kicks run in the given AioContext.
+ * callbacks and virtqueue kicks run in the given AioContext, unless
+ * vhost_user_server_set_vq_aio_contexts() moves the kicks elsewhere.
  */
 typedef struct {
     QIONetListener *listener;
@@ -52,6 +55,15 @@ typedef struct {
     QTAILQ_HEAD(, VuFdWatch) vu_fd_watches;
 
     Coroutine *co_trip; /* coroutine for processing VhostUserMsg */
+
+    /*
+     * Per-virtqueue AioContexts, NULL if all virtqueues are processed in
+     * @ctx.  Virtqueue i is then only accessed with vq_lock[i] held, and
+     * vhost-user messages are processed with all of them held.
+     */
+    AioContext **vq_ctx;
+    QemuRecMutex *vq_lock;
+    bool vq_locked; /* only accessed by co_trip */
 } VuServer;
 
 bool vhost_user_server_start(VuServer *server,
@@ -63,6 +75,11 @@ bool vhost_user_server_start(VuServer *server,
 
 void vhost_user_server_stop(VuServer *server);
 
+void vhost_user_server_set_vq_aio_contexts(VuServer *server,
+                                           AioContext **vq_ctx);
+void vhost_user_server_vq_lock(VuServer *server, int idx);
+void vhost_user_server_vq_unlock(VuServer *server, int idx);
+
 void vhost_user_server_inc_in_flight(VuServer *server);
 void vhost_user_server_dec_in_flight(VuServer *server);
 bool vhost_user_server_has_in_flight(VuServer *server);
@@ -136,6 +136,10 @@ struct ObjectClass
     ObjectUnparent *unparent;
 
     GHashTable *properties;
+
+    /* Properties of this class and all its parents, built on demand */
+    GHashTable *properties_cache;
+    unsigned properties_cache_gen;
 };
 
 /**
@@ -68,6 +68,14 @@ bool icount_configure(QemuOpts *opts, Error **errp);
 /* used by tcg vcpu thread to calc icount budget */
 int64_t icount_round(int64_t count);
 
+/*
+ * icount_enable_lockstep: run the vCPUs in parallel, in lock-step quanta
+ * of instructions.  Requires a fixed shift.
+ */
+void icount_enable_lockstep(void);
+/* end of a lock-step quantum, advance the icount by @insns */
+void icount_lockstep_advance(int64_t insns);
+
 /* if the CPUs are idle, start accounting real time to virtual clock. */
 void icount_start_warp_timer(void);
 void icount_account_warp_timer(void);
@@ -160,6 +160,8 @@ typedef struct DumpState {
     bool kdump_raw;
     hwaddr memory_offset;
     int fd;
+    bool sparse;                /* zero pages of ELF dumps become holes */
+    off_t sparse_hole;          /* size of the hole not yet seeked over */
 
     /*
      * Dump filter area variables
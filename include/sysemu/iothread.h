@@ -15,6 +15,7 @@
 #define IOTHREAD_H
 
 #include "block/aio.h"
+#include "qapi/qapi-types-common.h"
 #include "qemu/thread.h"
 #include "qom/object.h"
 #include "sysemu/event-loop-base.h"
@@ -38,6 +39,9 @@ struct IOThread {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+
+    /* Context to create the thread (and by default its thread pool) in */
+    ThreadContext *thread_context;
 };
 typedef struct IOThread IOThread;
 
@@ -64,4 +68,19 @@ void iothread_destroy(IOThread *iothread);
  */
 bool qemu_in_iothread(void);
 
+/*
+ * Helpers for devices and exports with an iothread-vq-mapping property.
+ * iothread_vq_mapping_validate() checks that the IOThreads exist and that
+ * each of @num_queues virtqueues is assigned exactly once.
+ * iothread_vq_mapping_apply() then fills @vq_aio_context[0..num_queues-1]
+ * and takes references on the IOThreads, which
+ * iothread_vq_mapping_cleanup() drops again.
+ */
+bool iothread_vq_mapping_validate(IOThreadVirtQueueMappingList *list,
+                                  uint16_t num_queues, Error **errp);
+void iothread_vq_mapping_apply(IOThreadVirtQueueMappingList *list,
+                               AioContext **vq_aio_context,
+                               uint16_t num_queues);
+void iothread_vq_mapping_cleanup(IOThreadVirtQueueMappingList *list);
+
 #endif /* IOTHREAD_H */
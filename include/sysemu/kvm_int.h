@@ -65,6 +65,10 @@ struct KVMDirtyRingReaper {
     QemuThread reaper_thr;
     volatile uint64_t reaper_iteration; /* iteration number of reaper thr */
     volatile enum KVMDirtyRingReaperState reaper_state; /* reap thr state */
+    /* Posted by vCPUs whose dirty ring filled up */
+    QemuSemaphore reaper_sem;
+    /* Time between two iterations, shrinks while rings keep filling up */
+    unsigned int reaper_interval_ms;
 };
 struct KVMState
 {
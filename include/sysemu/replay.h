@@ -50,6 +50,7 @@ typedef struct ReplayNetState ReplayNetState;
 
 /* Name of the initial VM snapshot */
 extern char *replay_snapshot;
+extern uint64_t replay_snapshot_period;
 
 /* Replay locking
  *
@@ -25,6 +25,15 @@ void add_stats_callbacks(StatsProvider provider,
                          StatRetrieveFunc *stats_fn,
                          SchemaRetrieveFunc *schemas_fn);
 
+/*
+ * Like add_stats_callbacks(), for providers whose @stats_fn may also be
+ * called without the BQL, when query-stats is executed out-of-band.
+ * It must only read state that is safe to access from any thread.
+ */
+void add_stats_callbacks_thread_safe(StatsProvider provider,
+                                     StatRetrieveFunc *stats_fn,
+                                     SchemaRetrieveFunc *schemas_fn);
+
 /*
  * Helper routines for adding stats entries to the results lists.
  */
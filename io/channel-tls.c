@@ -21,6 +21,7 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/module.h"
+#include "io/channel-socket.h"
 #include "io/channel-tls.h"
 #include "trace.h"
 #include "qemu/atomic.h"
@@ -155,6 +156,28 @@ static gboolean qio_channel_tls_handshake_io(QIOChannel *ioc,
                                              GIOCondition condition,
                                              gpointer user_data);
 
+/*
+ * Once the kernel encrypts outgoing records, writes go straight to the
+ * socket, which lets them use MSG_ZEROCOPY like a plain socket does.
+ */
+static void qio_channel_tls_try_ktls(QIOChannelTLS *ioc)
+{
+    QIOChannelSocket *sioc = (QIOChannelSocket *)
+        object_dynamic_cast(OBJECT(ioc->master), TYPE_QIO_CHANNEL_SOCKET);
+
+    if (!sioc || !qcrypto_tls_session_ktls_tx(ioc->session, sioc->fd)) {
+        return;
+    }
+
+    trace_qio_channel_tls_ktls_tx(ioc);
+    ioc->ktls_tx = true;
+    if (qio_channel_has_feature(ioc->master,
+                                QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        qio_channel_set_feature(QIO_CHANNEL(ioc),
+                                QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+    }
+}
+
 static void qio_channel_tls_handshake_task(QIOChannelTLS *ioc,
                                            QIOTask *task,
                                            GMainContext *context)
@@ -178,6 +201,7 @@ static void qio_channel_tls_handshake_task(QIOChannelTLS *ioc,
             qio_task_set_error(task, err);
         } else {
             trace_qio_channel_tls_credentials_allow(ioc);
+            qio_channel_tls_try_ktls(ioc);
         }
         qio_task_complete(task);
     } else {
@@ -314,6 +338,11 @@ static ssize_t qio_channel_tls_writev(QIOChannel *ioc,
     size_t i;
     ssize_t done = 0;
 
+    if (tioc->ktls_tx) {
+        return qio_channel_writev_full(tioc->master, iov, niov, fds, nfds,
+                                       flags, errp);
+    }
+
     for (i = 0 ; i < niov ; i++) {
         ssize_t ret = qcrypto_tls_session_write(tioc->session,
                                                 iov[i].iov_base,
@@ -339,6 +368,14 @@ static ssize_t qio_channel_tls_writev(QIOChannel *ioc,
     return done;
 }
 
+static int qio_channel_tls_flush(QIOChannel *ioc,
+                                 Error **errp)
+{
+    QIOChannelTLS *tioc = QIO_CHANNEL_TLS(ioc);
+
+    return qio_channel_flush(tioc->master, errp);
+}
+
 static int qio_channel_tls_set_blocking(QIOChannel *ioc,
                                         bool enabled,
                                         Error **errp)
@@ -493,6 +530,7 @@ static void qio_channel_tls_class_init(ObjectClass *klass,
     ioc_klass->io_shutdown = qio_channel_tls_shutdown;
     ioc_klass->io_create_watch = qio_channel_tls_create_watch;
     ioc_klass->io_set_aio_fd_handler = qio_channel_tls_set_aio_fd_handler;
+    ioc_klass->io_flush = qio_channel_tls_flush;
 }
 
 static const TypeInfo qio_channel_tls_info = {
@@ -17,13 +17,16 @@
 #include "qemu/module.h"
 #include "block/aio.h"
 #include "block/block.h"
+#include "block/bounce-pool.h"
 #include "sysemu/event-loop-base.h"
 #include "sysemu/iothread.h"
 #include "qapi/error.h"
+#include "qemu/bitmap.h"
 #include "qapi/qapi-commands-misc.h"
 #include "qemu/error-report.h"
 #include "qemu/rcu.h"
 #include "qemu/main-loop.h"
+#include "qemu/thread-context.h"
 
 
 #ifdef CONFIG_POSIX
@@ -173,7 +176,9 @@ static void iothread_set_aio_context_params(EventLoopBase *base, Error **errp)
                                iothread->parent_obj.aio_max_batch);
 
     aio_context_set_thread_pool_params(iothread->ctx, base->thread_pool_min,
-                                       base->thread_pool_max, errp);
+                                       base->thread_pool_max,
+                                       base->thread_pool_context ?:
+                                       iothread->thread_context, errp);
 }
 
 
@@ -207,11 +212,19 @@ static void iothread_init(EventLoopBase *base, Error **errp)
         return;
     }
 
-    /* This assumes we are called from a thread with useful CPU affinity for us
-     * to inherit.
+    /*
+     * Without a thread context, this assumes we are called from a thread
+     * with useful CPU affinity for us to inherit.
      */
-    qemu_thread_create(&iothread->thread, thread_name, iothread_run,
-                       iothread, QEMU_THREAD_JOINABLE);
+    if (iothread->thread_context) {
+        thread_context_create_thread(iothread->thread_context,
+                                     &iothread->thread, thread_name,
+                                     iothread_run, iothread,
+                                     QEMU_THREAD_JOINABLE);
+    } else {
+        qemu_thread_create(&iothread->thread, thread_name, iothread_run,
+                           iothread, QEMU_THREAD_JOINABLE);
+    }
 
     /* Wait for initialization to complete */
     while (iothread->thread_id == -1) {
@@ -292,6 +305,17 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
     }
 }
 
+static void iothread_check_thread_context(const Object *obj, const char *name,
+                                          Object *val, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread->ctx) {
+        error_setg(errp, "Property '%s' can not be changed after the "
+                   "iothread has been started", name);
+    }
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     EventLoopBaseClass *bc = EVENT_LOOP_BASE_CLASS(klass);
@@ -311,6 +335,10 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add_link(klass, "thread-context",
+        TYPE_THREAD_CONTEXT,
+        offsetof(IOThread, thread_context),
+        iothread_check_thread_context, OBJ_PROP_LINK_STRONG);
 }
 
 static const TypeInfo iothread_info = {
@@ -357,6 +385,12 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
     info->aio_max_batch = iothread->parent_obj.aio_max_batch;
+    bounce_pool_get_stats(qatomic_read(&iothread->ctx->bounce_pool),
+                          &info->bounce_pool_hits, &info->bounce_pool_misses);
+    aio_context_get_poll_stats(iothread->ctx, &info->poll_hits,
+                               &info->poll_misses, &info->poll_wasted_ns);
+    aio_context_get_bh_stats(iothread->ctx, &info->bh_calls,
+                             &info->bh_batches);
 
     QAPI_LIST_APPEND(*tail, info);
     return 0;
@@ -407,3 +441,117 @@ bool qemu_in_iothread(void)
     return qemu_get_current_aio_context() == qemu_get_aio_context() ?
                     false : true;
 }
+
+bool iothread_vq_mapping_validate(IOThreadVirtQueueMappingList *list,
+                                  uint16_t num_queues, Error **errp)
+{
+    g_autofree unsigned long *vqs = bitmap_new(num_queues);
+    g_autoptr(GHashTable) iothreads =
+        g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (IOThreadVirtQueueMappingList *node = list; node; node = node->next) {
+        const char *name = node->value->iothread;
+        uint16List *vq;
+
+        if (!iothread_by_id(name)) {
+            error_setg(errp, "IOThread \"%s\" object does not exist", name);
+            return false;
+        }
+
+        if (!g_hash_table_add(iothreads, (gpointer)name)) {
+            error_setg(errp,
+                    "duplicate IOThread name \"%s\" in iothread-vq-mapping",
+                    name);
+            return false;
+        }
+
+        if (node != list) {
+            if (!!node->value->vqs != !!list->value->vqs) {
+                error_setg(errp, "either all items in iothread-vq-mapping "
+                                 "must have vqs or none of them must have it");
+                return false;
+            }
+        }
+
+        for (vq = node->value->vqs; vq; vq = vq->next) {
+            if (vq->value >= num_queues) {
+                error_setg(errp, "vq index %u for IOThread \"%s\" must be "
+                        "less than num_queues %u in iothread-vq-mapping",
+                        vq->value, name, num_queues);
+                return false;
+            }
+
+            if (test_and_set_bit(vq->value, vqs)) {
+                error_setg(errp, "cannot assign vq %u to IOThread \"%s\" "
+                        "because it is already assigned", vq->value, name);
+                return false;
+            }
+        }
+    }
+
+    if (list->value->vqs) {
+        for (uint16_t i = 0; i < num_queues; i++) {
+            if (!test_bit(i, vqs)) {
+                error_setg(errp,
+                        "missing vq %u IOThread assignment in iothread-vq-mapping",
+                        i);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Generate vq:AioContext mappings from a validated iothread-vq-mapping list.
+ * A reference is taken on each IOThread, drop them with
+ * iothread_vq_mapping_cleanup().
+ */
+void iothread_vq_mapping_apply(
+        IOThreadVirtQueueMappingList *iothread_vq_mapping_list,
+        AioContext **vq_aio_context, uint16_t num_queues)
+{
+    IOThreadVirtQueueMappingList *node;
+    size_t num_iothreads = 0;
+    size_t cur_iothread = 0;
+
+    for (node = iothread_vq_mapping_list; node; node = node->next) {
+        num_iothreads++;
+    }
+
+    for (node = iothread_vq_mapping_list; node; node = node->next) {
+        IOThread *iothread = iothread_by_id(node->value->iothread);
+        AioContext *ctx = iothread_get_aio_context(iothread);
+
+        /* Released in iothread_vq_mapping_cleanup() */
+        object_ref(OBJECT(iothread));
+
+        if (node->value->vqs) {
+            uint16List *vq;
+
+            /* Explicit vq:IOThread assignment */
+            for (vq = node->value->vqs; vq; vq = vq->next) {
+                vq_aio_context[vq->value] = ctx;
+            }
+        } else {
+            /* Round-robin vq:IOThread assignment */
+            for (unsigned i = cur_iothread; i < num_queues;
+                 i += num_iothreads) {
+                vq_aio_context[i] = ctx;
+            }
+        }
+
+        cur_iothread++;
+    }
+}
+
+void iothread_vq_mapping_cleanup(IOThreadVirtQueueMappingList *list)
+{
+    IOThreadVirtQueueMappingList *node;
+
+    for (node = list; node; node = node->next) {
+        IOThread *iothread = iothread_by_id(node->value->iothread);
+        object_unref(OBJECT(iothread));
+    }
+}
@@ -26,6 +26,7 @@
 #include "semihosting/common-semi.h"
 #include "target/arm/syndrome.h"
 #include "target/arm/cpu-features.h"
+#include "native-bypass.h"
 
 #define get_user_code_u32(x, gaddr, env)                \
     ({ abi_long __r = get_user_u32((x), (gaddr));       \
@@ -163,6 +164,21 @@ void cpu_loop(CPUARMState *env)
         case EXCP_YIELD:
             /* nothing to do here for user-mode, just resume guest code */
             break;
+        case EXCP_NATIVE:
+            {
+                abi_ulong ret, fault_addr;
+
+                if (native_bypass_call(env->pc, env->xregs, &ret,
+                                       &fault_addr)) {
+                    /* Return to the caller as the guest function would */
+                    env->xregs[0] = ret;
+                    env->pc = env->xregs[30];
+                } else {
+                    force_sig_fault(TARGET_SIGSEGV, TARGET_SEGV_MAPERR,
+                                    fault_addr);
+                }
+            }
+            break;
         case EXCP_ATOMIC:
             cpu_exec_step_atomic(cs);
             break;
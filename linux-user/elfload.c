@@ -23,6 +23,7 @@
 #include "qemu/error-report.h"
 #include "target_signal.h"
 #include "tcg/debuginfo.h"
+#include "native-bypass.h"
 
 #ifdef TARGET_ARM
 #include "target/arm/cpu-features.h"
@@ -3541,7 +3542,7 @@ static void load_elf_image(const char *image_name, const ImageSource *src,
         info->end_data = info->end_code;
     }
 
-    if (qemu_log_enabled()) {
+    if (qemu_log_enabled() || native_bypass_enabled()) {
         load_symbols(ehdr, src, load_bias);
     }
 
@@ -3752,6 +3753,8 @@ static void load_symbols(struct elfhdr *hdr, const ImageSource *src,
             syms[i].st_value &= ~(target_ulong)1;
 #endif
             syms[i].st_value += load_bias;
+            native_bypass_add_symbol(strings + syms[i].st_name,
+                                     syms[i].st_value);
             i++;
         }
     }
@@ -18,6 +18,7 @@
  */
 #include "qemu/osdep.h"
 #include "tcg/perf.h"
+#include "exec/translate-all.h"
 #include "gdbstub/syscalls.h"
 #include "qemu.h"
 #include "user-internals.h"
@@ -35,4 +36,5 @@ void preexit_cleanup(CPUArchState *env, int code)
         gdb_exit(code);
         qemu_plugin_user_exit();
         perf_exit();
+        tcg_user_stats_exit();
 }
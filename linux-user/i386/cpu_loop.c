@@ -24,6 +24,7 @@
 #include "cpu_loop-common.h"
 #include "signal-common.h"
 #include "user-mmap.h"
+#include "native-bypass.h"
 
 /***********************************************************/
 /* CPUX86 core interface */
@@ -190,6 +191,32 @@ static void emulate_vsyscall(CPUX86State *env)
  sigsegv:
     force_sig(TARGET_SIGSEGV);
 }
+
+/*
+ * Run the host version of the function at eip, then emulate the ret
+ * instruction of the guest function.
+ */
+static void emulate_native_call(CPUX86State *env)
+{
+    abi_ulong args[NATIVE_BYPASS_MAX_ARGS] = {
+        env->regs[R_EDI], env->regs[R_ESI], env->regs[R_EDX],
+    };
+    abi_ulong ret, fault_addr;
+    uint64_t caller;
+
+    if (get_user_u64(caller, env->regs[R_ESP])) {
+        force_sig_fault(TARGET_SIGSEGV, TARGET_SEGV_MAPERR,
+                        env->regs[R_ESP]);
+        return;
+    }
+    if (!native_bypass_call(env->eip, args, &ret, &fault_addr)) {
+        force_sig_fault(TARGET_SIGSEGV, TARGET_SEGV_MAPERR, fault_addr);
+        return;
+    }
+    env->regs[R_EAX] = ret;
+    env->eip = caller;
+    env->regs[R_ESP] += 8;
+}
 #endif
 
 static bool maybe_handle_vm86_trap(CPUX86State *env, int trapnr)
@@ -257,6 +284,9 @@ void cpu_loop(CPUX86State *env)
         case EXCP_VSYSCALL:
             emulate_vsyscall(env);
             break;
+        case EXCP_NATIVE:
+            emulate_native_call(env);
+            break;
 #endif
         case EXCP0B_NOSEG:
         case EXCP0C_STACK:
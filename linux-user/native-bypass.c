@@ -0,0 +1,206 @@
+/*
+ * Call host functions in place of guest functions
+ *
+ * Guest string and memory functions spend most of their time in loops
+ * that TCG translates one instruction at a time.  With -native-bypass,
+ * the ELF loader looks up the configured functions in the symbol tables
+ * of the images it loads, and translation replaces them with an exit to
+ * the cpu loop, which runs the host libc function on guest memory.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "exec/translator.h"
+#include "qemu.h"
+#include "user-internals.h"
+#include "native-bypass.h"
+
+typedef bool NativeBypassFn(const abi_ulong *args, abi_ulong *ret,
+                            abi_ulong *fault_addr);
+
+typedef struct NativeBypass {
+    const char *name;
+    NativeBypassFn *fn;
+} NativeBypass;
+
+static bool native_memmove(const abi_ulong *args, abi_ulong *ret,
+                           abi_ulong *fault_addr)
+{
+    abi_ulong dst = args[0], src = args[1], n = args[2];
+    void *d, *s;
+
+    if (n) {
+        s = lock_user(VERIFY_READ, src, n, 1);
+        if (!s) {
+            *fault_addr = src;
+            return false;
+        }
+        d = lock_user(VERIFY_WRITE, dst, n, 0);
+        if (!d) {
+            unlock_user(s, src, 0);
+            *fault_addr = dst;
+            return false;
+        }
+        /* memmove also covers the guest's memcpy on overlapping buffers */
+        memmove(d, s, n);
+        unlock_user(d, dst, n);
+        unlock_user(s, src, 0);
+    }
+    *ret = dst;
+    return true;
+}
+
+static bool native_memset(const abi_ulong *args, abi_ulong *ret,
+                          abi_ulong *fault_addr)
+{
+    abi_ulong dst = args[0], n = args[2];
+    void *d;
+
+    if (n) {
+        d = lock_user(VERIFY_WRITE, dst, n, 0);
+        if (!d) {
+            *fault_addr = dst;
+            return false;
+        }
+        memset(d, args[1], n);
+        unlock_user(d, dst, n);
+    }
+    *ret = dst;
+    return true;
+}
+
+static bool native_memcmp(const abi_ulong *args, abi_ulong *ret,
+                          abi_ulong *fault_addr)
+{
+    abi_ulong a1 = args[0], a2 = args[1], n = args[2];
+    void *p1, *p2;
+    int r = 0;
+
+    if (n) {
+        p1 = lock_user(VERIFY_READ, a1, n, 1);
+        if (!p1) {
+            *fault_addr = a1;
+            return false;
+        }
+        p2 = lock_user(VERIFY_READ, a2, n, 1);
+        if (!p2) {
+            unlock_user(p1, a1, 0);
+            *fault_addr = a2;
+            return false;
+        }
+        r = memcmp(p1, p2, n);
+        unlock_user(p2, a2, 0);
+        unlock_user(p1, a1, 0);
+    }
+    *ret = (abi_long)r;
+    return true;
+}
+
+static bool native_strlen(const abi_ulong *args, abi_ulong *ret,
+                          abi_ulong *fault_addr)
+{
+    ssize_t len = target_strlen(args[0]);
+
+    if (len < 0) {
+        *fault_addr = args[0];
+        return false;
+    }
+    *ret = len;
+    return true;
+}
+
+static const NativeBypass native_bypasses[] = {
+    { "memcpy", native_memmove },
+    { "memmove", native_memmove },
+    { "memset", native_memset },
+    { "memcmp", native_memcmp },
+    { "strlen", native_strlen },
+};
+
+/* Symbol name -> NativeBypass, filled by native_bypass_parse() */
+static GHashTable *native_symbols;
+/* Guest address -> NativeBypass, filled by native_bypass_add_symbol() */
+static GHashTable *native_addrs;
+
+static const NativeBypass *native_bypass_find(const char *name)
+{
+    for (int i = 0; i < ARRAY_SIZE(native_bypasses); i++) {
+        if (!strcmp(native_bypasses[i].name, name)) {
+            return &native_bypasses[i];
+        }
+    }
+    return NULL;
+}
+
+bool native_bypass_parse(const char *list)
+{
+    g_auto(GStrv) entries = NULL;
+
+#ifndef TARGET_HAS_NATIVE_BYPASS
+    error_report("-native-bypass is not supported for this target");
+    return false;
+#endif
+
+    entries = g_strsplit(list, ",", 0);
+
+    if (!native_symbols) {
+        native_symbols = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, NULL);
+        native_addrs = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                             g_free, NULL);
+    }
+
+    for (char **p = entries; *p; p++) {
+        g_auto(GStrv) fn_sym = g_strsplit(*p, "=", 2);
+        const NativeBypass *nb = native_bypass_find(fn_sym[0]);
+
+        if (!nb) {
+            error_report("-native-bypass: unsupported function '%s'", *p);
+            error_printf("Supported functions:");
+            for (int i = 0; i < ARRAY_SIZE(native_bypasses); i++) {
+                error_printf(" %s", native_bypasses[i].name);
+            }
+            error_printf("\n");
+            return false;
+        }
+        g_hash_table_insert(native_symbols,
+                            g_strdup(fn_sym[1] ? fn_sym[1] : fn_sym[0]),
+                            (gpointer)nb);
+    }
+    return true;
+}
+
+bool native_bypass_enabled(void)
+{
+    return native_symbols != NULL;
+}
+
+void native_bypass_add_symbol(const char *name, abi_ulong addr)
+{
+    const NativeBypass *nb;
+    uint64_t key = addr;
+
+    if (!native_bypass_enabled()) {
+        return;
+    }
+    nb = g_hash_table_lookup(native_symbols, name);
+    if (!nb) {
+        return;
+    }
+    g_hash_table_insert(native_addrs, g_memdup2(&key, sizeof(key)),
+                        (gpointer)nb);
+    translator_add_native_pc(addr);
+}
+
+bool native_bypass_call(abi_ulong pc,
+                        const abi_ulong args[NATIVE_BYPASS_MAX_ARGS],
+                        abi_ulong *ret, abi_ulong *fault_addr)
+{
+    uint64_t key = pc;
+    const NativeBypass *nb = g_hash_table_lookup(native_addrs, &key);
+
+    g_assert(nb);
+    return nb->fn(args, ret, fault_addr);
+}
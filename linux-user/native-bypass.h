@@ -0,0 +1,41 @@
+/*
+ * Call host functions in place of guest functions
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef LINUX_USER_NATIVE_BYPASS_H
+#define LINUX_USER_NATIVE_BYPASS_H
+
+/* Targets whose cpu_loop() handles EXCP_NATIVE */
+#if defined(TARGET_AARCH64) || defined(TARGET_X86_64)
+#define TARGET_HAS_NATIVE_BYPASS
+#endif
+
+/* Number of integer arguments that native_bypass_call() may use */
+#define NATIVE_BYPASS_MAX_ARGS 3
+
+/*
+ * Parse a -native-bypass list of "function[=symbol]" entries.  Return
+ * false after reporting an error if the list is invalid.
+ */
+bool native_bypass_parse(const char *list);
+
+/* Whether the ELF loader should read symbol tables for the bypass */
+bool native_bypass_enabled(void);
+
+/* Called by the ELF loader for each function symbol of a loaded image */
+void native_bypass_add_symbol(const char *name, abi_ulong addr);
+
+/*
+ * Run the host function registered at @pc with the integer arguments
+ * @args of the guest call.  On success, store the return value of the
+ * guest function in @ret and return true.  If the guest function would
+ * have faulted, store the faulting address in @fault_addr and return
+ * false; the caller should raise SIGSEGV.
+ */
+bool native_bypass_call(abi_ulong pc,
+                        const abi_ulong args[NATIVE_BYPASS_MAX_ARGS],
+                        abi_ulong *ret, abi_ulong *fault_addr);
+
+#endif
@@ -201,33 +201,44 @@ int do_sigprocmask(int how, const sigset_t *set, sigset_t *oldset)
     }
 
     if (set) {
+        sigset_t new_mask = ts->signal_mask;
         int i;
 
-        if (block_signals()) {
-            return -QEMU_ERESTARTSYS;
-        }
-
         switch (how) {
         case SIG_BLOCK:
-            sigorset(&ts->signal_mask, &ts->signal_mask, set);
+            sigorset(&new_mask, &new_mask, set);
             break;
         case SIG_UNBLOCK:
             for (i = 1; i <= NSIG; ++i) {
                 if (sigismember(set, i)) {
-                    sigdelset(&ts->signal_mask, i);
+                    sigdelset(&new_mask, i);
                 }
             }
             break;
         case SIG_SETMASK:
-            ts->signal_mask = *set;
+            new_mask = *set;
             break;
         default:
             g_assert_not_reached();
         }
 
         /* Silently ignore attempts to change blocking status of KILL or STOP */
-        sigdelset(&ts->signal_mask, SIGKILL);
-        sigdelset(&ts->signal_mask, SIGSTOP);
+        sigdelset(&new_mask, SIGKILL);
+        sigdelset(&new_mask, SIGSTOP);
+
+        /*
+         * Runtimes often re-set the mask they already have; that cannot
+         * affect signal delivery, so skip blocking host signals (and the
+         * round of process_pending_signals() that it forces).
+         */
+        if (!memcmp(&new_mask, &ts->signal_mask, sizeof(new_mask))) {
+            return 0;
+        }
+
+        if (block_signals()) {
+            return -QEMU_ERESTARTSYS;
+        }
+        ts->signal_mask = new_mask;
     }
     return 0;
 }
@@ -674,6 +674,25 @@ safe_syscall5(int, ppoll, struct pollfd *, ufds, unsigned int, nfds,
 safe_syscall6(int, epoll_pwait, int, epfd, struct epoll_event *, events,
               int, maxevents, int, timeout, const sigset_t *, sigmask,
               size_t, sigsetsize)
+
+/*
+ * If guest and host agree on the layout of a structure, e.g. when the
+ * guest has the same architecture as the host, arrays of it are passed
+ * from guest memory to the host syscall instead of being converted back
+ * and forth.
+ */
+#define TARGET_POLLFD_IS_HOST                                   \
+    (TARGET_BIG_ENDIAN == HOST_BIG_ENDIAN &&                    \
+     sizeof(struct target_pollfd) == sizeof(struct pollfd) &&   \
+     offsetof(struct target_pollfd, revents) ==                 \
+     offsetof(struct pollfd, revents))
+#ifdef CONFIG_EPOLL
+#define TARGET_EPOLL_EVENT_IS_HOST                                      \
+    (TARGET_BIG_ENDIAN == HOST_BIG_ENDIAN &&                            \
+     sizeof(struct target_epoll_event) == sizeof(struct epoll_event) && \
+     offsetof(struct target_epoll_event, data) ==                       \
+     offsetof(struct epoll_event, data))
+#endif
 #if defined(__NR_futex)
 safe_syscall6(int,futex,int *,uaddr,int,op,int,val, \
               const struct timespec *,timeout,int *,uaddr2,int,val3)
@@ -1505,10 +1524,14 @@ static abi_long do_ppoll(abi_long arg1, abi_long arg2, abi_long arg3,
             return -TARGET_EFAULT;
         }
 
-        pfd = alloca(sizeof(struct pollfd) * nfds);
-        for (i = 0; i < nfds; i++) {
-            pfd[i].fd = tswap32(target_pfd[i].fd);
-            pfd[i].events = tswap16(target_pfd[i].events);
+        if (TARGET_POLLFD_IS_HOST) {
+            pfd = (struct pollfd *)target_pfd;
+        } else {
+            pfd = alloca(sizeof(struct pollfd) * nfds);
+            for (i = 0; i < nfds; i++) {
+                pfd[i].fd = tswap32(target_pfd[i].fd);
+                pfd[i].events = tswap16(target_pfd[i].events);
+            }
         }
     }
     if (ppoll) {
@@ -1571,7 +1594,7 @@ static abi_long do_ppoll(abi_long arg1, abi_long arg2, abi_long arg3,
           ret = get_errno(safe_ppoll(pfd, nfds, pts, NULL, 0));
     }
 
-    if (!is_error(ret)) {
+    if (!is_error(ret) && !TARGET_POLLFD_IS_HOST) {
         for (i = 0; i < nfds; i++) {
             target_pfd[i].revents = tswap16(pfd[i].revents);
         }
@@ -13136,10 +13159,14 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
             return -TARGET_EFAULT;
         }
 
-        ep = g_try_new(struct epoll_event, maxevents);
-        if (!ep) {
-            unlock_user(target_ep, arg2, 0);
-            return -TARGET_ENOMEM;
+        if (TARGET_EPOLL_EVENT_IS_HOST) {
+            ep = (struct epoll_event *)target_ep;
+        } else {
+            ep = g_try_new(struct epoll_event, maxevents);
+            if (!ep) {
+                unlock_user(target_ep, arg2, 0);
+                return -TARGET_ENOMEM;
+            }
         }
 
         switch (num) {
@@ -13175,7 +13202,7 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
         }
         if (!is_error(ret)) {
             int i;
-            for (i = 0; i < ret; i++) {
+            for (i = 0; i < ret && !TARGET_EPOLL_EVENT_IS_HOST; i++) {
                 target_ep[i].events = tswap32(ep[i].events);
                 target_ep[i].data.u64 = tswap64(ep[i].data.u64);
             }
@@ -13184,7 +13211,9 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
         } else {
             unlock_user(target_ep, arg2, 0);
         }
-        g_free(ep);
+        if (!TARGET_EPOLL_EVENT_IS_HOST) {
+            g_free(ep);
+        }
         return ret;
     }
 #endif
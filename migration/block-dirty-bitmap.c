@@ -420,6 +420,20 @@ static void send_bitmap_complete(QEMUFile *f, DBMSaveState *s,
     send_bitmap_header(f, s, dbms, DIRTY_BITMAP_MIG_FLAG_COMPLETE);
 }
 
+static void send_bitmap_zeroes(QEMUFile *f, DBMSaveState *s,
+                               SaveBitmapState *dbms,
+                               uint64_t start_sector, uint32_t nr_sectors)
+{
+    uint32_t flags = DIRTY_BITMAP_MIG_FLAG_BITS | DIRTY_BITMAP_MIG_FLAG_ZEROES;
+
+    trace_send_bitmap_bits(flags, start_sector, nr_sectors, 0);
+
+    send_bitmap_header(f, s, dbms, flags);
+
+    qemu_put_be64(f, start_sector);
+    qemu_put_be32(f, nr_sectors);
+}
+
 static void send_bitmap_bits(QEMUFile *f, DBMSaveState *s,
                              SaveBitmapState *dbms,
                              uint64_t start_sector, uint32_t nr_sectors)
@@ -431,7 +445,7 @@ static void send_bitmap_bits(QEMUFile *f, DBMSaveState *s,
             dbms->bitmap, start_sector << BDRV_SECTOR_BITS,
             (uint64_t)nr_sectors << BDRV_SECTOR_BITS);
     uint64_t buf_size = QEMU_ALIGN_UP(unaligned_size, align);
-    uint8_t *buf = g_malloc0(buf_size);
+    g_autofree uint8_t *buf = g_malloc0(buf_size);
     uint32_t flags = DIRTY_BITMAP_MIG_FLAG_BITS;
 
     bdrv_dirty_bitmap_serialize_part(
@@ -439,9 +453,8 @@ static void send_bitmap_bits(QEMUFile *f, DBMSaveState *s,
         (uint64_t)nr_sectors << BDRV_SECTOR_BITS);
 
     if (buffer_is_zero(buf, buf_size)) {
-        g_free(buf);
-        buf = NULL;
-        flags |= DIRTY_BITMAP_MIG_FLAG_ZEROES;
+        send_bitmap_zeroes(f, s, dbms, start_sector, nr_sectors);
+        return;
     }
 
     trace_send_bitmap_bits(flags, start_sector, nr_sectors, buf_size);
@@ -450,18 +463,8 @@ static void send_bitmap_bits(QEMUFile *f, DBMSaveState *s,
 
     qemu_put_be64(f, start_sector);
     qemu_put_be32(f, nr_sectors);
-
-    /* if a block is zero we need to flush here since the network
-     * bandwidth is now a lot higher than the storage device bandwidth.
-     * thus if we queue zero blocks we slow down the migration. */
-    if (flags & DIRTY_BITMAP_MIG_FLAG_ZEROES) {
-        qemu_fflush(f);
-    } else {
-        qemu_put_be64(f, buf_size);
-        qemu_put_buffer(f, buf, buf_size);
-    }
-
-    g_free(buf);
+    qemu_put_be64(f, buf_size);
+    qemu_put_buffer(f, buf, buf_size);
 }
 
 /* Called with the BQL taken.  */
@@ -691,10 +694,35 @@ fail:
 static void bulk_phase_send_chunk(QEMUFile *f, DBMSaveState *s,
                                   SaveBitmapState *dbms)
 {
-    uint32_t nr_sectors = MIN(dbms->total_sectors - dbms->cur_sector,
-                             dbms->sectors_per_chunk);
+    uint64_t left = dbms->total_sectors - dbms->cur_sector;
+    uint32_t nr_sectors = MIN(left, dbms->sectors_per_chunk);
+    uint64_t max_sectors = QEMU_ALIGN_DOWN(UINT32_MAX, dbms->sectors_per_chunk);
+    int64_t next_dirty;
 
-    send_bitmap_bits(f, s, dbms, dbms->cur_sector, nr_sectors);
+    /*
+     * Bitmaps of large disks are mostly clean.  Rather than serializing
+     * and sending them chunk by chunk, cover the whole clean run up to the
+     * chunk that holds the next dirty bit with a single ZEROES message.
+     * The run stays chunk-aligned, so it is also aligned to the bitmap's
+     * serialization granularity as the destination requires.
+     */
+    next_dirty = bdrv_dirty_bitmap_next_dirty(dbms->bitmap,
+                                              dbms->cur_sector <<
+                                              BDRV_SECTOR_BITS,
+                                              left << BDRV_SECTOR_BITS);
+    if (max_sectors &&
+        (next_dirty < 0 ||
+         (next_dirty >> BDRV_SECTOR_BITS) - dbms->cur_sector >=
+         dbms->sectors_per_chunk)) {
+        uint64_t clean = next_dirty < 0 ? left :
+            QEMU_ALIGN_DOWN((next_dirty >> BDRV_SECTOR_BITS) -
+                            dbms->cur_sector, dbms->sectors_per_chunk);
+
+        nr_sectors = MIN(clean, max_sectors);
+        send_bitmap_zeroes(f, s, dbms, dbms->cur_sector, nr_sectors);
+    } else {
+        send_bitmap_bits(f, s, dbms, dbms->cur_sector, nr_sectors);
+    }
 
     dbms->cur_sector += nr_sectors;
     if (dbms->cur_sector >= dbms->total_sectors) {
@@ -8,15 +8,21 @@
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
 #include "qapi/error.h"
+#include "exec/ramblock.h"
 #include "channel.h"
 #include "file.h"
 #include "migration.h"
+#include "options.h"
 #include "io/channel-file.h"
 #include "io/channel-util.h"
 #include "trace.h"
 
 #define OFFSET_OPTION ",offset="
 
+static struct FileOutgoingArgs {
+    char *fname;
+} outgoing_args;
+
 /* Remove the offset option from @filespec and return it in @offsetp. */
 
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
@@ -36,6 +42,29 @@ int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
     return 0;
 }
 
+void file_cleanup_outgoing_migration(void)
+{
+    g_free(outgoing_args.fname);
+    outgoing_args.fname = NULL;
+}
+
+/*
+ * Open another descriptor of the outgoing migration file for a multifd
+ * channel.  No data goes through the channel's stream position; the
+ * channel only writes pages at their mapped-ram offsets.
+ */
+QIOChannel *file_send_channel_create(Error **errp)
+{
+    QIOChannelFile *ioc;
+
+    ioc = qio_channel_file_new_path(outgoing_args.fname, O_WRONLY, 0, errp);
+    if (!ioc) {
+        return NULL;
+    }
+    qio_channel_set_name(QIO_CHANNEL(ioc), "multifd-file-outgoing");
+    return QIO_CHANNEL(ioc);
+}
+
 void file_start_outgoing_migration(MigrationState *s,
                                    FileMigrationArgs *file_args, Error **errp)
 {
@@ -52,6 +81,8 @@ void file_start_outgoing_migration(MigrationState *s,
         return;
     }
 
+    outgoing_args.fname = g_strdup(filename);
+
     ioc = QIO_CHANNEL(fioc);
     if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
         return;
@@ -85,6 +116,7 @@ void file_start_incoming_migration(FileMigrationArgs *file_args, Error **errp)
 
     ioc = QIO_CHANNEL(fioc);
     if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
+        object_unref(OBJECT(fioc));
         return;
     }
     qio_channel_set_name(QIO_CHANNEL(ioc), "migration-file-incoming");
@@ -92,4 +124,66 @@ void file_start_incoming_migration(FileMigrationArgs *file_args, Error **errp)
                                file_accept_incoming_migration,
                                NULL, NULL,
                                g_main_context_get_thread_default());
+
+    if (!migrate_multifd()) {
+        return;
+    }
+
+    /*
+     * The multifd channels read pages at the offsets recorded in the
+     * mapped-ram headers, so each of them just needs its own descriptor
+     * of the same file.  The watches fire in order, so the main channel
+     * is always set up first.
+     */
+    for (int i = 0; i < migrate_multifd_channels(); i++) {
+        fioc = qio_channel_file_new_path(filename, O_RDONLY, 0, errp);
+        if (!fioc) {
+            return;
+        }
+
+        ioc = QIO_CHANNEL(fioc);
+        qio_channel_set_name(ioc, "multifd-file-incoming");
+        qio_channel_add_watch_full(ioc, G_IO_IN,
+                                   file_accept_incoming_migration,
+                                   NULL, NULL,
+                                   g_main_context_get_thread_default());
+    }
+}
+
+/*
+ * Write the pages described by @iov, which all belong to @block, at
+ * their offsets in the mapped-ram region of the block.  Runs of
+ * contiguous pages are written with a single call.
+ */
+int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
+                            int niov, RAMBlock *block, Error **errp)
+{
+    int i, j;
+
+    for (i = 0; i < niov; i = j) {
+        uintptr_t offset = (uintptr_t)iov[i].iov_base - (uintptr_t)block->host;
+        size_t len = iov[i].iov_len;
+        ssize_t ret;
+
+        for (j = i + 1; j < niov; j++) {
+            if (iov[j].iov_base != iov[j - 1].iov_base + iov[j - 1].iov_len) {
+                break;
+            }
+            len += iov[j].iov_len;
+        }
+
+        ret = qio_channel_pwritev(ioc, &iov[i], j - i,
+                                  block->pages_offset + offset, errp);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret != len) {
+            error_setg(errp, "Short write of ramblock %s pages at offset 0x%"
+                       PRIxPTR ": %zd of %zu bytes", block->idstr, offset,
+                       ret, len);
+            return -1;
+        }
+    }
+
+    return 0;
 }
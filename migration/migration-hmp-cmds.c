@@ -113,6 +113,8 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->normal_bytes >> 10);
         monitor_printf(mon, "dirty sync count: %" PRIu64 "\n",
                        info->ram->dirty_sync_count);
+        monitor_printf(mon, "dirty sync time: %" PRIu64 " us\n",
+                       info->ram->dirty_sync_time);
         monitor_printf(mon, "page size: %" PRIu64 " kbytes\n",
                        info->ram->page_size >> 10);
         monitor_printf(mon, "multifd bytes: %" PRIu64 " kbytes\n",
@@ -392,6 +394,22 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %s\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MODE),
             qapi_enum_lookup(&MigMode_lookup, params->mode));
+
+        assert(params->has_zero_page_detection);
+        monitor_printf(mon, "%s: %s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_ZERO_PAGE_DETECTION),
+            qapi_enum_lookup(&ZeroPageDetection_lookup,
+                             params->zero_page_detection));
+
+        assert(params->has_dirty_sync_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DIRTY_SYNC_THREADS),
+            params->dirty_sync_threads);
+
+        assert(params->has_postcopy_prefetch_depth);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_PREFETCH_DEPTH),
+            params->postcopy_prefetch_depth);
     }
 
     qapi_free_MigrationParameters(params);
@@ -681,6 +699,18 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_mode = true;
         visit_type_MigMode(v, param, &p->mode, &err);
         break;
+    case MIGRATION_PARAMETER_ZERO_PAGE_DETECTION:
+        p->has_zero_page_detection = true;
+        visit_type_ZeroPageDetection(v, param, &p->zero_page_detection, &err);
+        break;
+    case MIGRATION_PARAMETER_DIRTY_SYNC_THREADS:
+        p->has_dirty_sync_threads = true;
+        visit_type_uint8(v, param, &p->dirty_sync_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_POSTCOPY_PREFETCH_DEPTH:
+        p->has_postcopy_prefetch_depth = true;
+        visit_type_uint8(v, param, &p->postcopy_prefetch_depth, &err);
+        break;
     default:
         assert(0);
     }
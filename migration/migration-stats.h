@@ -55,6 +55,10 @@ typedef struct {
      * copy.
      */
     Stat64 dirty_sync_missed_zero_copy;
+    /*
+     * Time in microseconds spent in the last bitmap synchronization.
+     */
+    Stat64 dirty_sync_time;
     /*
      * Number of bytes sent at migration completion stage while the
      * guest is stopped.
@@ -128,11 +128,28 @@ static bool migration_needs_multiple_sockets(void)
     return migrate_multifd() || migrate_postcopy_preempt();
 }
 
-static bool transport_supports_multi_channels(SocketAddress *saddr)
+static bool migration_needs_seekable_channel(void)
 {
-    return saddr->type == SOCKET_ADDRESS_TYPE_INET ||
-           saddr->type == SOCKET_ADDRESS_TYPE_UNIX ||
-           saddr->type == SOCKET_ADDRESS_TYPE_VSOCK;
+    return migrate_mapped_ram();
+}
+
+static bool transport_supports_multi_channels(MigrationAddress *addr)
+{
+    if (addr->transport == MIGRATION_ADDRESS_TYPE_SOCKET) {
+        SocketAddress *saddr = &addr->u.socket;
+
+        return saddr->type == SOCKET_ADDRESS_TYPE_INET ||
+               saddr->type == SOCKET_ADDRESS_TYPE_UNIX ||
+               saddr->type == SOCKET_ADDRESS_TYPE_VSOCK;
+    } else if (addr->transport == MIGRATION_ADDRESS_TYPE_FILE) {
+        return migrate_mapped_ram();
+    }
+
+    /*
+     * RDMA is a single QEMUFile transport of its own, it cannot carry
+     * multifd or postcopy-preempt channels.
+     */
+    return false;
 }
 
 static bool
@@ -140,12 +157,17 @@ migration_channels_and_transport_compatible(MigrationAddress *addr,
                                             Error **errp)
 {
     if (migration_needs_multiple_sockets() &&
-        (addr->transport == MIGRATION_ADDRESS_TYPE_SOCKET) &&
-        !transport_supports_multi_channels(&addr->u.socket)) {
+        !transport_supports_multi_channels(addr)) {
         error_setg(errp, "Migration requires multi-channel URIs (e.g. tcp)");
         return false;
     }
 
+    if (migration_needs_seekable_channel() &&
+        addr->transport != MIGRATION_ADDRESS_TYPE_FILE) {
+        error_setg(errp, "Migration requires a seekable transport (e.g. file)");
+        return false;
+    }
+
     return true;
 }
 
@@ -389,11 +411,11 @@ static int migrate_send_rp_message(MigrationIncomingState *mis,
  *   Len: Length in bytes required - must be a multiple of pagesize
  */
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
-                                      RAMBlock *rb, ram_addr_t start)
+                                      RAMBlock *rb, ram_addr_t start,
+                                      size_t len)
 {
     uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
     size_t msglen = 12; /* start + len */
-    size_t len = qemu_ram_pagesize(rb);
     enum mig_rp_message_type msg_type;
     const char *rbname;
     int rbname_len;
@@ -453,7 +475,8 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
         return 0;
     }
 
-    return migrate_send_rp_message_req_pages(mis, rb, start);
+    return migrate_send_rp_message_req_pages(mis, rb, start,
+                                             qemu_ram_pagesize(rb));
 }
 
 static bool migration_colo_enabled;
@@ -1111,6 +1134,7 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         stat64_get(&mig_stats.dirty_sync_count);
     info->ram->dirty_sync_missed_zero_copy =
         stat64_get(&mig_stats.dirty_sync_missed_zero_copy);
+    info->ram->dirty_sync_time = stat64_get(&mig_stats.dirty_sync_time);
     info->ram->postcopy_requests =
         stat64_get(&mig_stats.postcopy_requests);
     info->ram->page_size = page_size;
@@ -1343,6 +1367,7 @@ static void migrate_fd_cleanup(MigrationState *s)
         migration_ioc_unregister_yank_from_file(tmp);
         qemu_fclose(tmp);
     }
+    file_cleanup_outgoing_migration();
 
     /*
      * We already cleaned up to_dst_file, so errors from the return
@@ -2195,6 +2220,18 @@ static void *source_return_path_thread(void *opaque)
     while (migration_is_setup_or_active(ms->state)) {
         trace_source_return_path_thread_loop_top();
 
+        /*
+         * Page requests that were already received are served before the
+         * urgent pages sent for the previous ones are flushed, so that a
+         * burst of faults is answered with one write on the preempt channel.
+         */
+        if (migrate_postcopy_preempt() && migration_in_postcopy() &&
+            !qemu_file_has_buffered_input(rp) &&
+            ram_postcopy_preempt_flush()) {
+            error_setg(&err, "Failed to flush postcopy preempt channel");
+            goto out;
+        }
+
         header_type = qemu_get_be16(rp);
         header_len = qemu_get_be16(rp);
 
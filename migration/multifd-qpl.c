@@ -0,0 +1,443 @@
+/*
+ * Multifd qpl compression accelerator implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/rcu.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "options.h"
+#include "multifd.h"
+#include "qpl/qpl.h"
+
+/*
+ * The packet payload starts with the big endian compressed size of each
+ * normal page, followed by the compressed pages.  A page whose
+ * compressed size equals the page size is sent uncompressed.
+ */
+
+struct qpl_data {
+    /* hardware path jobs, one for each page of a packet */
+    qpl_job **job_array;
+    /* number of jobs in job_array */
+    uint32_t job_num;
+    /* software path job, used when the hardware path is unavailable */
+    qpl_job *sw_job;
+    /* copy of the page being compressed by sw_job */
+    uint8_t *sw_buf;
+    /* compressed pages, one page size slot for each page */
+    uint8_t *zbuf;
+    /* compressed size of each page */
+    uint32_t *zlen;
+};
+
+static qpl_job *qpl_alloc_job(qpl_path_t path)
+{
+    qpl_job *job;
+    uint32_t job_size = 0;
+
+    if (qpl_get_job_size(path, &job_size) != QPL_STS_OK) {
+        return NULL;
+    }
+    job = g_malloc0(job_size);
+    if (qpl_init_job(path, job) != QPL_STS_OK) {
+        g_free(job);
+        return NULL;
+    }
+    return job;
+}
+
+static void qpl_free_job(qpl_job *job)
+{
+    if (job) {
+        qpl_fini_job(job);
+        g_free(job);
+    }
+}
+
+static void qpl_free_data(struct qpl_data *qpl)
+{
+    if (!qpl) {
+        return;
+    }
+    for (int i = 0; i < qpl->job_num; i++) {
+        qpl_free_job(qpl->job_array[i]);
+    }
+    g_free(qpl->job_array);
+    qpl_free_job(qpl->sw_job);
+    g_free(qpl->sw_buf);
+    g_free(qpl->zbuf);
+    g_free(qpl->zlen);
+    g_free(qpl);
+}
+
+/**
+ * qpl_init_data: allocate the jobs and buffers of a channel
+ *
+ * The hardware path is used if an IAA device is available for every
+ * job, otherwise all pages go through the software path.
+ *
+ * Returns the channel data, or NULL on error.
+ *
+ * @id: channel number
+ * @page_count: number of pages in a full packet
+ * @page_size: guest page size
+ * @errp: pointer to an error
+ */
+static struct qpl_data *qpl_init_data(uint8_t id, uint32_t page_count,
+                                      uint32_t page_size, Error **errp)
+{
+    struct qpl_data *qpl = g_new0(struct qpl_data, 1);
+
+    qpl->sw_job = qpl_alloc_job(qpl_path_software);
+    if (!qpl->sw_job) {
+        error_setg(errp, "multifd %u: failed to initialize qpl", id);
+        qpl_free_data(qpl);
+        return NULL;
+    }
+    qpl->sw_buf = g_malloc(page_size);
+
+    qpl->job_array = g_new0(qpl_job *, page_count);
+    for (uint32_t i = 0; i < page_count; i++) {
+        qpl->job_array[i] = qpl_alloc_job(qpl_path_hardware);
+        if (!qpl->job_array[i]) {
+            warn_report_once("multifd: no IAA device available, "
+                             "qpl uses the software path");
+            for (int j = 0; j < i; j++) {
+                qpl_free_job(qpl->job_array[j]);
+            }
+            g_free(qpl->job_array);
+            qpl->job_array = NULL;
+            qpl->job_num = 0;
+            break;
+        }
+        qpl->job_num++;
+    }
+
+    qpl->zbuf = g_malloc(page_count * page_size);
+    qpl->zlen = g_new0(uint32_t, page_count);
+    return qpl;
+}
+
+static void qpl_prepare_comp_job(qpl_job *job, uint8_t *in, uint8_t *out,
+                                 uint32_t size)
+{
+    job->op = qpl_op_compress;
+    job->next_in_ptr = in;
+    job->next_out_ptr = out;
+    job->available_in = size;
+    /* Incompressible pages fail with QPL_STS_MORE_OUTPUT_NEEDED. */
+    job->available_out = size - 1;
+    job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST | QPL_FLAG_OMIT_VERIFY;
+    job->level = 1;
+}
+
+static void qpl_prepare_decomp_job(qpl_job *job, uint8_t *in, uint32_t len,
+                                   uint8_t *out, uint32_t size)
+{
+    job->op = qpl_op_decompress;
+    job->next_in_ptr = in;
+    job->next_out_ptr = out;
+    job->available_in = len;
+    job->available_out = size;
+    job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST;
+}
+
+/**
+ * qpl_compress_page_sw: compress one page with the software path
+ *
+ * Returns the compressed size, p->page_size if the page is sent
+ * uncompressed, or 0 on error.
+ */
+static uint32_t qpl_compress_page_sw(struct qpl_data *qpl, uint8_t *host,
+                                     uint8_t *out, uint32_t size)
+{
+    qpl_status status;
+
+    /*
+     * Since the VM might be running, the page may be changing concurrently
+     * with compression, therefore copy the page first.
+     */
+    memcpy(qpl->sw_buf, host, size);
+    qpl_prepare_comp_job(qpl->sw_job, qpl->sw_buf, out, size);
+    status = qpl_execute_job(qpl->sw_job);
+    if (status == QPL_STS_OK) {
+        return qpl->sw_job->total_out;
+    }
+    return status == QPL_STS_MORE_OUTPUT_NEEDED ? size : 0;
+}
+
+/**
+ * qpl_send_setup: setup send side
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int qpl_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct qpl_data *qpl;
+
+    qpl = qpl_init_data(p->id, p->page_count, p->page_size, errp);
+    if (!qpl) {
+        return -1;
+    }
+    p->data = qpl;
+
+    /* The packet header, the size array and one entry for each page. */
+    g_free(p->iov);
+    p->iov = g_new0(struct iovec, p->page_count + 2);
+    return 0;
+}
+
+/**
+ * qpl_send_cleanup: cleanup send side
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void qpl_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    qpl_free_data(p->data);
+    p->data = NULL;
+}
+
+/**
+ * qpl_send_prepare: prepare data to be able to send
+ *
+ * Compress all normal pages of the packet, submitting the hardware
+ * jobs as one batch before waiting for any of them.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int qpl_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    struct qpl_data *qpl = p->data;
+    uint8_t *host = p->pages->block->host;
+    uint32_t size = p->page_size;
+    uint32_t packet_size;
+    bool *submitted = g_newa(bool, p->normal_num);
+    uint32_t i;
+
+    for (i = 0; i < p->normal_num; i++) {
+        submitted[i] = false;
+        if (qpl->job_array) {
+            qpl_job *job = qpl->job_array[i];
+
+            qpl_prepare_comp_job(job, host + p->normal[i],
+                                 qpl->zbuf + i * size, size);
+            submitted[i] = qpl_submit_job(job) == QPL_STS_OK;
+        }
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint32_t len = 0;
+
+        if (submitted[i]) {
+            qpl_job *job = qpl->job_array[i];
+            qpl_status status = qpl_wait_job(job);
+
+            if (status == QPL_STS_OK) {
+                len = job->total_out;
+            } else if (status == QPL_STS_MORE_OUTPUT_NEEDED) {
+                len = size;
+            }
+        }
+        /* Fall back to software if the device is busy or failed. */
+        if (!len) {
+            len = qpl_compress_page_sw(qpl, host + p->normal[i],
+                                       qpl->zbuf + i * size, size);
+            if (!len) {
+                error_setg(errp, "multifd %u: failed to compress page",
+                           p->id);
+                return -1;
+            }
+        }
+        qpl->zlen[i] = len;
+    }
+
+    p->iov[p->iovs_num].iov_base = qpl->zlen;
+    p->iov[p->iovs_num].iov_len = p->normal_num * sizeof(uint32_t);
+    p->iovs_num++;
+    packet_size = p->normal_num * sizeof(uint32_t);
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint32_t len = qpl->zlen[i];
+
+        if (len == size) {
+            p->iov[p->iovs_num].iov_base = host + p->normal[i];
+        } else {
+            p->iov[p->iovs_num].iov_base = qpl->zbuf + i * size;
+        }
+        p->iov[p->iovs_num].iov_len = len;
+        p->iovs_num++;
+        packet_size += len;
+        qpl->zlen[i] = cpu_to_be32(len);
+    }
+
+    p->next_packet_size = packet_size;
+    p->flags |= MULTIFD_FLAG_QPL;
+    return 0;
+}
+
+/**
+ * qpl_recv_setup: setup receive side
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int qpl_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct qpl_data *qpl;
+
+    qpl = qpl_init_data(p->id, p->page_count, p->page_size, errp);
+    if (!qpl) {
+        return -1;
+    }
+    p->data = qpl;
+    return 0;
+}
+
+/**
+ * qpl_recv_cleanup: cleanup receive side
+ *
+ * @p: Params for the channel that we are using
+ */
+static void qpl_recv_cleanup(MultiFDRecvParams *p)
+{
+    qpl_free_data(p->data);
+    p->data = NULL;
+}
+
+/**
+ * qpl_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed sizes and pages, and decompress them into guest
+ * memory.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int qpl_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    struct qpl_data *qpl = p->data;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t len_size = p->normal_num * sizeof(uint32_t);
+    uint32_t size = p->page_size;
+    uint32_t data_size = 0;
+    bool *submitted = g_newa(bool, p->normal_num);
+    uint8_t *zbuf;
+    uint32_t i;
+    int ret;
+
+    if (flags != MULTIFD_FLAG_QPL) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_QPL);
+        return -1;
+    }
+    if (p->next_packet_size < len_size) {
+        error_setg(errp, "multifd %u: packet size %u too small for %u pages",
+                   p->id, p->next_packet_size, p->normal_num);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)qpl->zlen, len_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+    for (i = 0; i < p->normal_num; i++) {
+        qpl->zlen[i] = be32_to_cpu(qpl->zlen[i]);
+        if (qpl->zlen[i] == 0 || qpl->zlen[i] > size) {
+            error_setg(errp, "multifd %u: invalid compressed page size %u",
+                       p->id, qpl->zlen[i]);
+            return -1;
+        }
+        data_size += qpl->zlen[i];
+    }
+    if (data_size != p->next_packet_size - len_size) {
+        error_setg(errp, "multifd %u: packet size received %u size expected %u",
+                   p->id, p->next_packet_size - len_size, data_size);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)qpl->zbuf, data_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    zbuf = qpl->zbuf;
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *host = p->host + p->normal[i];
+
+        submitted[i] = false;
+        if (qpl->zlen[i] == size) {
+            memcpy(host, zbuf, size);
+        } else if (qpl->job_array) {
+            qpl_job *job = qpl->job_array[i];
+
+            qpl_prepare_decomp_job(job, zbuf, qpl->zlen[i], host, size);
+            submitted[i] = qpl_submit_job(job) == QPL_STS_OK;
+        }
+        zbuf += qpl->zlen[i];
+    }
+
+    zbuf = qpl->zbuf;
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *host = p->host + p->normal[i];
+        uint32_t len = qpl->zlen[i];
+        qpl_job *job;
+
+        if (len == size) {
+            zbuf += len;
+            continue;
+        }
+        if (submitted[i]) {
+            job = qpl->job_array[i];
+            if (qpl_wait_job(job) == QPL_STS_OK && job->total_out == size) {
+                zbuf += len;
+                continue;
+            }
+        }
+        /* Fall back to software if the device is busy or failed. */
+        job = qpl->sw_job;
+        qpl_prepare_decomp_job(job, zbuf, len, host, size);
+        if (qpl_execute_job(job) != QPL_STS_OK || job->total_out != size) {
+            error_setg(errp, "multifd %u: failed to decompress page",
+                       p->id);
+            return -1;
+        }
+        zbuf += len;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_qpl_ops = {
+    .send_setup = qpl_send_setup,
+    .send_cleanup = qpl_send_cleanup,
+    .send_prepare = qpl_send_prepare,
+    .recv_setup = qpl_recv_setup,
+    .recv_cleanup = qpl_recv_cleanup,
+    .recv_pages = qpl_recv_pages
+};
+
+static void multifd_qpl_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_QPL, &multifd_qpl_ops);
+}
+
+migration_init(multifd_qpl_register);
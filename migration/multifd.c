@@ -11,6 +11,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/cutils.h"
 #include "qemu/rcu.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
@@ -21,6 +22,7 @@
 #include "migration.h"
 #include "migration-stats.h"
 #include "socket.h"
+#include "file.h"
 #include "tls.h"
 #include "qemu-file.h"
 #include "trace.h"
@@ -45,6 +47,16 @@ typedef struct {
     uint64_t unused2[4];    /* Reserved for future use */
 } __attribute__((packed)) MultiFDInit_t;
 
+/*
+ * With mapped-ram every page has a fixed offset in the migration file,
+ * so the channels read and write pages there directly instead of
+ * exchanging packets.
+ */
+static bool multifd_use_packets(void)
+{
+    return !migrate_mapped_ram();
+}
+
 /* Multifd without compression */
 
 /**
@@ -131,6 +143,8 @@ static void nocomp_recv_cleanup(MultiFDRecvParams *p)
  * nocomp_recv_pages: read the data from the channel into actual pages
  *
  * For no compression we just need to read things into the correct place.
+ * Pages that are contiguous in the RAMBlock are merged into a single
+ * iovec, so that the kernel copies them out of the socket in one run.
  *
  * Returns 0 for success or -1 for error
  *
@@ -140,6 +154,7 @@ static void nocomp_recv_cleanup(MultiFDRecvParams *p)
 static int nocomp_recv_pages(MultiFDRecvParams *p, Error **errp)
 {
     uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    int niov = 0;
 
     if (flags != MULTIFD_FLAG_NOCOMP) {
         error_setg(errp, "multifd %u: flags received %x flags expected %x",
@@ -147,10 +162,18 @@ static int nocomp_recv_pages(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
     for (int i = 0; i < p->normal_num; i++) {
-        p->iov[i].iov_base = p->host + p->normal[i];
-        p->iov[i].iov_len = p->page_size;
+        uint8_t *host = p->host + p->normal[i];
+
+        if (niov && (uint8_t *)p->iov[niov - 1].iov_base +
+                    p->iov[niov - 1].iov_len == host) {
+            p->iov[niov - 1].iov_len += p->page_size;
+            continue;
+        }
+        p->iov[niov].iov_base = host;
+        p->iov[niov].iov_len = p->page_size;
+        niov++;
     }
-    return qio_channel_readv_all(p->c, p->iov, p->normal_num, errp);
+    return qio_channel_readv_all(p->c, p->iov, niov, errp);
 }
 
 static MultiFDMethods multifd_nocomp_ops = {
@@ -264,6 +287,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->flags = cpu_to_be32(p->flags);
     packet->pages_alloc = cpu_to_be32(p->pages->allocated);
     packet->normal_pages = cpu_to_be32(p->normal_num);
+    packet->zero_pages = cpu_to_be32(p->zero_num);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
 
@@ -277,6 +301,11 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
 
         packet->offset[i] = cpu_to_be64(temp);
     }
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t temp = p->zero[i];
+
+        packet->offset[p->normal_num + i] = cpu_to_be64(temp);
+    }
 }
 
 static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
@@ -322,10 +351,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    p->zero_num = be32_to_cpu(packet->zero_pages);
+    if (p->zero_num > packet->pages_alloc - p->normal_num) {
+        error_setg(errp, "multifd: received packet "
+                   "with %u zero pages and expected maximum pages are %u",
+                   p->zero_num, packet->pages_alloc - p->normal_num) ;
+        return -1;
+    }
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->normal_num == 0) {
+    if (p->normal_num == 0 && p->zero_num == 0) {
         return 0;
     }
 
@@ -351,6 +388,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         p->normal[i] = offset;
     }
 
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t offset = be64_to_cpu(packet->offset[p->normal_num + i]);
+
+        if (offset > (p->block->used_length - p->page_size)) {
+            error_setg(errp, "multifd: offset too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, p->block->used_length);
+            return -1;
+        }
+        p->zero[i] = offset;
+    }
+
     return 0;
 }
 
@@ -510,6 +559,10 @@ static void multifd_send_terminate_threads(Error *err)
 
 static int multifd_send_channel_destroy(QIOChannel *send)
 {
+    if (!multifd_use_packets()) {
+        object_unref(OBJECT(send));
+        return 0;
+    }
     return socket_send_channel_destroy(send);
 }
 
@@ -551,6 +604,8 @@ void multifd_save_cleanup(void)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         multifd_send_state->ops->send_cleanup(p, &local_err);
         if (local_err) {
             migrate_set_error(migrate_get_current(), local_err);
@@ -653,13 +708,16 @@ static void *multifd_send_thread(void *opaque)
     Error *local_err = NULL;
     int ret = 0;
     bool use_zero_copy_send = migrate_zero_copy_send();
+    bool use_zero_page_detection =
+        migrate_zero_page_detection() == ZERO_PAGE_DETECTION_MULTIFD;
+    bool use_packets = multifd_use_packets();
 
     thread = migration_threads_add(p->name, qemu_get_thread_id());
 
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
-    if (multifd_send_initial_packet(p, &local_err) < 0) {
+    if (use_packets && multifd_send_initial_packet(p, &local_err) < 0) {
         ret = -1;
         goto out;
     }
@@ -677,18 +735,45 @@ static void *multifd_send_thread(void *opaque)
 
         if (p->pending_job) {
             uint64_t packet_num = p->packet_num;
+            RAMBlock *block = p->pages->block;
             uint32_t flags;
             p->normal_num = 0;
+            p->zero_num = 0;
 
-            if (use_zero_copy_send) {
+            if (use_zero_copy_send || !use_packets) {
                 p->iovs_num = 0;
             } else {
                 p->iovs_num = 1;
             }
 
+            /*
+             * Checking for zero pages here rather than in the migration
+             * thread spreads the cost of reading every page over the
+             * channels; zero pages are sent as offsets only.
+             */
             for (int i = 0; i < p->pages->num; i++) {
-                p->normal[p->normal_num] = p->pages->offset[i];
-                p->normal_num++;
+                ram_addr_t offset = p->pages->offset[i];
+
+                if (use_zero_page_detection &&
+                    buffer_is_zero(p->pages->block->host + offset,
+                                   p->page_size)) {
+                    p->zero[p->zero_num] = offset;
+                    p->zero_num++;
+                } else {
+                    p->normal[p->normal_num] = offset;
+                    p->normal_num++;
+                }
+            }
+
+            if (!use_packets) {
+                for (int i = 0; i < p->zero_num; i++) {
+                    clear_bit_atomic(p->zero[i] / p->page_size,
+                                     block->file_bmap);
+                }
+                for (int i = 0; i < p->normal_num; i++) {
+                    set_bit_atomic(p->normal[i] / p->page_size,
+                                   block->file_bmap);
+                }
             }
 
             if (p->normal_num) {
@@ -698,39 +783,55 @@ static void *multifd_send_thread(void *opaque)
                     break;
                 }
             }
-            multifd_send_fill_packet(p);
+            if (use_packets) {
+                multifd_send_fill_packet(p);
+            }
             flags = p->flags;
             p->flags = 0;
             p->num_packets++;
             p->total_normal_pages += p->normal_num;
+            p->total_zero_pages += p->zero_num;
             p->pages->num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, p->normal_num, flags,
-                               p->next_packet_size);
+            stat64_add(&mig_stats.normal_pages, p->normal_num);
+            stat64_add(&mig_stats.zero_pages, p->zero_num);
 
-            if (use_zero_copy_send) {
-                /* Send header first, without zerocopy */
-                ret = qio_channel_write_all(p->c, (void *)p->packet,
-                                            p->packet_len, &local_err);
+            trace_multifd_send(p->id, packet_num, p->normal_num, p->zero_num,
+                               flags, p->next_packet_size);
+
+            if (!use_packets) {
+                ret = file_write_ramblock_iov(p->c, p->iov, p->iovs_num,
+                                              block, &local_err);
                 if (ret != 0) {
                     break;
                 }
+                stat64_add(&mig_stats.multifd_bytes, p->next_packet_size);
             } else {
-                /* Send header using the same writev call */
-                p->iov[0].iov_len = p->packet_len;
-                p->iov[0].iov_base = p->packet;
-            }
+                if (use_zero_copy_send) {
+                    /* Send header first, without zerocopy */
+                    ret = qio_channel_write_all(p->c, (void *)p->packet,
+                                                p->packet_len, &local_err);
+                    if (ret != 0) {
+                        break;
+                    }
+                } else {
+                    /* Send header using the same writev call */
+                    p->iov[0].iov_len = p->packet_len;
+                    p->iov[0].iov_base = p->packet;
+                }
 
-            ret = qio_channel_writev_full_all(p->c, p->iov, p->iovs_num, NULL,
-                                              0, p->write_flags, &local_err);
-            if (ret != 0) {
-                break;
-            }
+                ret = qio_channel_writev_full_all(p->c, p->iov, p->iovs_num,
+                                                  NULL, 0, p->write_flags,
+                                                  &local_err);
+                if (ret != 0) {
+                    break;
+                }
 
-            stat64_add(&mig_stats.multifd_bytes,
-                       p->next_packet_size + p->packet_len);
+                stat64_add(&mig_stats.multifd_bytes,
+                           p->next_packet_size + p->packet_len);
+            }
             p->next_packet_size = 0;
             qemu_mutex_lock(&p->mutex);
             p->pending_job--;
@@ -761,7 +862,8 @@ out:
 
     rcu_unregister_thread();
     migration_threads_remove(thread);
-    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages);
 
     return NULL;
 }
@@ -779,7 +881,11 @@ static void multifd_tls_outgoing_handshake(QIOTask *task,
 
     if (!qio_task_propagate_error(task, &err)) {
         trace_multifd_tls_outgoing_handshake_complete(ioc);
-        if (multifd_channel_connect(p, ioc, &err)) {
+        if (migrate_zero_copy_send() &&
+            !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+            error_setg(&err, "Zero copy send with TLS needs kernel TLS "
+                       "support and an AES-GCM cipher");
+        } else if (multifd_channel_connect(p, ioc, &err)) {
             return;
         }
     }
@@ -896,7 +1002,24 @@ static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque)
 
 static void multifd_new_send_channel_create(gpointer opaque)
 {
-    socket_send_channel_create(multifd_new_send_channel_async, opaque);
+    MultiFDSendParams *p = opaque;
+    Error *local_err = NULL;
+    QIOChannel *ioc;
+
+    if (multifd_use_packets()) {
+        socket_send_channel_create(multifd_new_send_channel_async, opaque);
+        return;
+    }
+
+    ioc = file_send_channel_create(&local_err);
+    if (ioc) {
+        p->running = true;
+        if (multifd_channel_connect(p, ioc, &local_err)) {
+            return;
+        }
+    }
+
+    multifd_new_send_channel_cleanup(p, ioc, local_err);
 }
 
 int multifd_save_setup(Error **errp)
@@ -936,6 +1059,7 @@ int multifd_save_setup(Error **errp)
         /* We need one extra place for the packet header */
         p->iov = g_new0(struct iovec, page_count + 1);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
         p->page_size = qemu_target_page_size();
         p->page_count = page_count;
 
@@ -966,6 +1090,8 @@ struct {
     int count;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
+    /* recv channels ready for more work, without packets */
+    QemuSemaphore channels_ready;
     /* global number of generated multifd packets */
     uint64_t packet_num;
     /* multifd ops */
@@ -993,6 +1119,7 @@ static void multifd_recv_terminate_threads(Error *err)
 
         qemu_mutex_lock(&p->mutex);
         p->quit = true;
+        qemu_sem_post(&p->sem);
         /*
          * We could arrive here for two reasons:
          *  - normal quit, i.e. everything went fine, just finished
@@ -1041,6 +1168,7 @@ void multifd_load_cleanup(void)
         object_unref(OBJECT(p->c));
         p->c = NULL;
         qemu_mutex_destroy(&p->mutex);
+        qemu_sem_destroy(&p->sem);
         qemu_sem_destroy(&p->sem_sync);
         g_free(p->name);
         p->name = NULL;
@@ -1051,9 +1179,12 @@ void multifd_load_cleanup(void)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         multifd_recv_state->ops->recv_cleanup(p);
     }
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
+    qemu_sem_destroy(&multifd_recv_state->channels_ready);
     g_free(multifd_recv_state->params);
     multifd_recv_state->params = NULL;
     g_free(multifd_recv_state);
@@ -1067,6 +1198,22 @@ void multifd_recv_sync_main(void)
     if (!migrate_multifd()) {
         return;
     }
+
+    if (!multifd_use_packets()) {
+        /*
+         * Every idle channel holds one count of channels_ready, so
+         * collecting all of them waits for the queued reads to finish.
+         */
+        for (i = 0; i < migrate_multifd_channels(); i++) {
+            trace_multifd_recv_sync_main_wait(i);
+            qemu_sem_wait(&multifd_recv_state->channels_ready);
+        }
+        for (i = 0; i < migrate_multifd_channels(); i++) {
+            qemu_sem_post(&multifd_recv_state->channels_ready);
+        }
+        return;
+    }
+
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDRecvParams *p = &multifd_recv_state->params[i];
 
@@ -1087,15 +1234,92 @@ void multifd_recv_sync_main(void)
     trace_multifd_recv_sync_main(multifd_recv_state->packet_num);
 }
 
+/*
+ * Hand a chunk of guest memory to be read from the migration file to
+ * the next idle channel.  Only used when the channels exchange no
+ * packets, i.e. with mapped-ram.
+ *
+ * Returns false if the channels are shutting down.
+ */
+bool multifd_queue_file_read(void *host, size_t size, uint64_t file_offset)
+{
+    static int next_channel;
+    MultiFDRecvParams *p = NULL;
+    int i;
+
+    assert(!multifd_use_packets());
+
+    qemu_sem_wait(&multifd_recv_state->channels_ready);
+    next_channel %= migrate_multifd_channels();
+    for (i = next_channel;; i = (i + 1) % migrate_multifd_channels()) {
+        p = &multifd_recv_state->params[i];
+
+        qemu_mutex_lock(&p->mutex);
+        if (p->quit) {
+            qemu_mutex_unlock(&p->mutex);
+            return false;
+        }
+        if (!p->pending_job) {
+            next_channel = (i + 1) % migrate_multifd_channels();
+            break;
+        }
+        qemu_mutex_unlock(&p->mutex);
+    }
+
+    p->pending_job = true;
+    p->file_data.opaque = host;
+    p->file_data.size = size;
+    p->file_data.file_offset = file_offset;
+    qemu_mutex_unlock(&p->mutex);
+    qemu_sem_post(&p->sem);
+
+    return true;
+}
+
+static int multifd_recv_file_data(MultiFDRecvParams *p, Error **errp)
+{
+    MultiFDRecvData data;
+    ssize_t ret;
+
+    qemu_mutex_lock(&p->mutex);
+    data = p->file_data;
+    qemu_mutex_unlock(&p->mutex);
+
+    ret = qio_channel_pread(p->c, data.opaque, data.size, data.file_offset,
+                            errp);
+    if (ret < 0) {
+        return -1;
+    }
+    if (ret != data.size) {
+        error_setg(errp, "multifd %u: read 0x%zx bytes at offset 0x%" PRIx64
+                   ", expected 0x%zx", p->id, ret, data.file_offset,
+                   data.size);
+        return -1;
+    }
+    p->total_normal_pages += data.size / p->page_size;
+
+    qemu_mutex_lock(&p->mutex);
+    p->pending_job = false;
+    qemu_mutex_unlock(&p->mutex);
+    qemu_sem_post(&multifd_recv_state->channels_ready);
+
+    return 0;
+}
+
 static void *multifd_recv_thread(void *opaque)
 {
     MultiFDRecvParams *p = opaque;
     Error *local_err = NULL;
+    bool use_packets = multifd_use_packets();
     int ret;
 
     trace_multifd_recv_thread_start(p->id);
     rcu_register_thread();
 
+    if (!use_packets) {
+        qemu_sem_post(&multifd_recv_state->channels_ready);
+    }
+
     while (true) {
         uint32_t flags;
 
@@ -1103,6 +1327,21 @@ static void *multifd_recv_thread(void *opaque)
             break;
         }
 
+        if (!use_packets) {
+            /* Wait for the loader to hand us a chunk of the file. */
+            qemu_sem_wait(&p->sem);
+            if (p->quit) {
+                break;
+            }
+            if (!qatomic_read(&p->pending_job)) {
+                continue;
+            }
+            if (multifd_recv_file_data(p, &local_err)) {
+                break;
+            }
+            continue;
+        }
+
         ret = qio_channel_read_all_eof(p->c, (void *)p->packet,
                                        p->packet_len, &local_err);
         if (ret == 0 || ret == -1) {   /* 0: EOF  -1: Error */
@@ -1119,10 +1358,11 @@ static void *multifd_recv_thread(void *opaque)
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, p->normal_num, flags,
-                           p->next_packet_size);
+        trace_multifd_recv(p->id, p->packet_num, p->normal_num, p->zero_num,
+                           flags, p->next_packet_size);
         p->num_packets++;
         p->total_normal_pages += p->normal_num;
+        p->total_zero_pages += p->zero_num;
         qemu_mutex_unlock(&p->mutex);
 
         if (p->normal_num) {
@@ -1132,6 +1372,10 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        for (int i = 0; i < p->zero_num; i++) {
+            ram_handle_zero(p->host + p->zero[i], p->page_size);
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1142,12 +1386,17 @@ static void *multifd_recv_thread(void *opaque)
         multifd_recv_terminate_threads(local_err);
         error_free(local_err);
     }
+    if (!use_packets) {
+        /* Don't leave the loader waiting for this channel. */
+        qemu_sem_post(&multifd_recv_state->channels_ready);
+    }
     qemu_mutex_lock(&p->mutex);
     p->running = false;
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages);
 
     return NULL;
 }
@@ -1171,12 +1420,14 @@ int multifd_load_setup(Error **errp)
     multifd_recv_state->params = g_new0(MultiFDRecvParams, thread_count);
     qatomic_set(&multifd_recv_state->count, 0);
     qemu_sem_init(&multifd_recv_state->sem_sync, 0);
+    qemu_sem_init(&multifd_recv_state->channels_ready, 0);
     multifd_recv_state->ops = multifd_ops[migrate_multifd_compression()];
 
     for (i = 0; i < thread_count; i++) {
         MultiFDRecvParams *p = &multifd_recv_state->params[i];
 
         qemu_mutex_init(&p->mutex);
+        qemu_sem_init(&p->sem, 0);
         qemu_sem_init(&p->sem_sync, 0);
         p->quit = false;
         p->id = i;
@@ -1186,6 +1437,7 @@ int multifd_load_setup(Error **errp)
         p->name = g_strdup_printf("multifdrecv_%d", i);
         p->iov = g_new0(struct iovec, page_count);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
         p->page_count = page_count;
         p->page_size = qemu_target_page_size();
     }
@@ -1228,7 +1480,12 @@ void multifd_recv_new_channel(QIOChannel *ioc, Error **errp)
     Error *local_err = NULL;
     int id;
 
-    id = multifd_recv_initial_packet(ioc, &local_err);
+    if (multifd_use_packets()) {
+        id = multifd_recv_initial_packet(ioc, &local_err);
+    } else {
+        /* File channels carry no handshake, number them in order. */
+        id = qatomic_read(&multifd_recv_state->count);
+    }
     if (id < 0) {
         multifd_recv_terminate_threads(local_err);
         error_propagate_prepend(errp, local_err,
@@ -59,6 +59,7 @@
 /* The delay time (in ms) between two COLO checkpoints */
 #define DEFAULT_MIGRATE_X_CHECKPOINT_DELAY (200 * 100)
 #define DEFAULT_MIGRATE_MULTIFD_CHANNELS 2
+#define DEFAULT_MIGRATE_DIRTY_SYNC_THREADS 1
 #define DEFAULT_MIGRATE_MULTIFD_COMPRESSION MULTIFD_COMPRESSION_NONE
 /* 0: means nocompress, 1: best speed, ... 9: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL 1
@@ -179,6 +180,14 @@ Property migration_properties[] = {
     DEFINE_PROP_MIG_MODE("mode", MigrationState,
                       parameters.mode,
                       MIG_MODE_NORMAL),
+    DEFINE_PROP_ZERO_PAGE_DETECTION("zero-page-detection", MigrationState,
+                       parameters.zero_page_detection,
+                       ZERO_PAGE_DETECTION_MULTIFD),
+    DEFINE_PROP_UINT8("dirty-sync-threads", MigrationState,
+                      parameters.dirty_sync_threads,
+                      DEFAULT_MIGRATE_DIRTY_SYNC_THREADS),
+    DEFINE_PROP_UINT8("postcopy-prefetch-depth", MigrationState,
+                      parameters.postcopy_prefetch_depth, 0),
 
     /* Migration capabilities */
     DEFINE_PROP_MIG_CAP("x-xbzrle", MIGRATION_CAPABILITY_XBZRLE),
@@ -195,6 +204,7 @@ Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-block", MIGRATION_CAPABILITY_BLOCK),
     DEFINE_PROP_MIG_CAP("x-return-path", MIGRATION_CAPABILITY_RETURN_PATH),
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_MULTIFD),
+    DEFINE_PROP_MIG_CAP("x-ignore-shared", MIGRATION_CAPABILITY_X_IGNORE_SHARED),
     DEFINE_PROP_MIG_CAP("x-background-snapshot",
             MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT),
 #ifdef CONFIG_LINUX
@@ -204,6 +214,9 @@ Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-switchover-ack",
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
+    DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-predictive-converge",
+                        MIGRATION_CAPABILITY_PREDICTIVE_CONVERGE),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -277,6 +290,13 @@ bool migrate_late_block_activate(void)
     return s->capabilities[MIGRATION_CAPABILITY_LATE_BLOCK_ACTIVATE];
 }
 
+bool migrate_mapped_ram(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
 bool migrate_multifd(void)
 {
     MigrationState *s = migrate_get_current();
@@ -312,6 +332,13 @@ bool migrate_postcopy_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_POSTCOPY_RAM];
 }
 
+bool migrate_predictive_converge(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_PREDICTIVE_CONVERGE];
+}
+
 bool migrate_rdma_pin_all(void)
 {
     MigrationState *s = migrate_get_current();
@@ -631,6 +658,13 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_PREDICTIVE_CONVERGE] &&
+        new_caps[MIGRATION_CAPABILITY_AUTO_CONVERGE]) {
+        error_setg(errp, "Capability 'predictive-converge' is not compatible "
+                   "with 'auto-converge'");
+        return false;
+    }
+
     if (new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
         if (new_caps[MIGRATION_CAPABILITY_XBZRLE]) {
             error_setg(errp, "Multifd is not compatible with xbzrle");
@@ -645,6 +679,33 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        if (new_caps[MIGRATION_CAPABILITY_MULTIFD] &&
+            migrate_multifd_compression()) {
+            error_setg(errp,
+                       "Mapped-ram migration is incompatible with multifd compression");
+            return false;
+        }
+
+        if (new_caps[MIGRATION_CAPABILITY_XBZRLE]) {
+            error_setg(errp,
+                       "Mapped-ram migration is incompatible with xbzrle");
+            return false;
+        }
+
+        if (new_caps[MIGRATION_CAPABILITY_COMPRESS]) {
+            error_setg(errp,
+                       "Mapped-ram migration is incompatible with compression");
+            return false;
+        }
+
+        if (new_caps[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+            error_setg(errp,
+                       "Mapped-ram migration is incompatible with postcopy");
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -795,6 +856,13 @@ int migrate_decompress_threads(void)
     return s->parameters.decompress_threads;
 }
 
+int migrate_dirty_sync_threads(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.dirty_sync_threads;
+}
+
 uint64_t migrate_downtime_limit(void)
 {
     MigrationState *s = migrate_get_current();
@@ -830,6 +898,13 @@ uint64_t migrate_max_postcopy_bandwidth(void)
     return s->parameters.max_postcopy_bandwidth;
 }
 
+uint8_t migrate_postcopy_prefetch_depth(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.postcopy_prefetch_depth;
+}
+
 MigMode migrate_mode(void)
 {
     MigrationState *s = migrate_get_current();
@@ -839,6 +914,13 @@ MigMode migrate_mode(void)
     return mode;
 }
 
+ZeroPageDetection migrate_zero_page_detection(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.zero_page_detection;
+}
+
 int migrate_multifd_channels(void)
 {
     MigrationState *s = migrate_get_current();
@@ -1013,6 +1095,12 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->vcpu_dirty_limit = s->parameters.vcpu_dirty_limit;
     params->has_mode = true;
     params->mode = s->parameters.mode;
+    params->has_zero_page_detection = true;
+    params->zero_page_detection = s->parameters.zero_page_detection;
+    params->has_dirty_sync_threads = true;
+    params->dirty_sync_threads = s->parameters.dirty_sync_threads;
+    params->has_postcopy_prefetch_depth = true;
+    params->postcopy_prefetch_depth = s->parameters.postcopy_prefetch_depth;
 
     return params;
 }
@@ -1049,6 +1137,9 @@ void migrate_params_init(MigrationParameters *params)
     params->has_x_vcpu_dirty_limit_period = true;
     params->has_vcpu_dirty_limit = true;
     params->has_mode = true;
+    params->has_zero_page_detection = true;
+    params->has_dirty_sync_threads = true;
+    params->has_postcopy_prefetch_depth = true;
 }
 
 /*
@@ -1140,6 +1231,13 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_dirty_sync_threads && (params->dirty_sync_threads < 1)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "dirty_sync_threads",
+                   "a value between 1 and 255");
+        return false;
+    }
+
     if (params->has_multifd_zlib_level &&
         (params->multifd_zlib_level > 9)) {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "multifd_zlib_level",
@@ -1210,14 +1308,20 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
 
 #ifdef CONFIG_LINUX
     if (migrate_zero_copy_send() &&
-        ((params->has_multifd_compression && params->multifd_compression) ||
-         (params->tls_creds && *params->tls_creds))) {
+        params->has_multifd_compression && params->multifd_compression) {
         error_setg(errp,
-                   "Zero copy only available for non-compressed non-TLS multifd migration");
+                   "Zero copy only available for non-compressed multifd migration");
         return false;
     }
 #endif
 
+    if (migrate_mapped_ram() &&
+        params->has_multifd_compression && params->multifd_compression) {
+        error_setg(errp,
+                   "Mapped-ram migration is incompatible with multifd compression");
+        return false;
+    }
+
     if (params->has_x_vcpu_dirty_limit_period &&
         (params->x_vcpu_dirty_limit_period < 1 ||
          params->x_vcpu_dirty_limit_period > 1000)) {
@@ -1350,6 +1454,18 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_mode) {
         dest->mode = params->mode;
     }
+
+    if (params->has_zero_page_detection) {
+        dest->zero_page_detection = params->zero_page_detection;
+    }
+
+    if (params->has_dirty_sync_threads) {
+        dest->dirty_sync_threads = params->dirty_sync_threads;
+    }
+
+    if (params->has_postcopy_prefetch_depth) {
+        dest->postcopy_prefetch_depth = params->postcopy_prefetch_depth;
+    }
 }
 
 static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
@@ -1494,6 +1610,19 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_mode) {
         s->parameters.mode = params->mode;
     }
+
+    if (params->has_zero_page_detection) {
+        s->parameters.zero_page_detection = params->zero_page_detection;
+    }
+
+    if (params->has_dirty_sync_threads) {
+        s->parameters.dirty_sync_threads = params->dirty_sync_threads;
+    }
+
+    if (params->has_postcopy_prefetch_depth) {
+        s->parameters.postcopy_prefetch_depth =
+            params->postcopy_prefetch_depth;
+    }
 }
 
 void qmp_migrate_set_parameters(MigrateSetParameters *params, Error **errp)
@@ -820,6 +820,78 @@ static int get_mem_fault_cpu_index(uint32_t pid)
     return -1;
 }
 
+/*
+ * Fault pattern of one vCPU, for prefetching.  Only accessed by the
+ * fault thread.
+ */
+typedef struct PostcopyPrefetchState {
+    RAMBlock *rb;
+    ram_addr_t last;
+    int64_t stride;
+    unsigned int hits;
+} PostcopyPrefetchState;
+
+static void postcopy_prefetch_flush(MigrationIncomingState *mis, RAMBlock *rb,
+                                    ram_addr_t start, size_t len)
+{
+    if (len) {
+        trace_postcopy_prefetch(qemu_ram_get_idstr(rb), start, len);
+        migrate_send_rp_message_req_pages(mis, rb, start, len);
+    }
+}
+
+/*
+ * Once two consecutive faults of a vCPU have been the same distance
+ * apart, ask the source for the next postcopy-prefetch-depth pages
+ * along that stride.  Contiguous runs are merged into one request.
+ * Pages that are not received yet are asked for even if they are
+ * already on their way; the source skips those that it has sent.
+ */
+static void postcopy_prefetch(MigrationIncomingState *mis,
+                              PostcopyPrefetchState *ps, RAMBlock *rb,
+                              ram_addr_t rb_offset)
+{
+    unsigned int depth = migrate_postcopy_prefetch_depth();
+    size_t pagesize = qemu_ram_pagesize(rb);
+    int64_t stride = (int64_t)rb_offset - (int64_t)ps->last;
+    ram_addr_t run_start = 0;
+    size_t run_len = 0;
+    unsigned int i;
+
+    if (rb == ps->rb && stride && stride == ps->stride) {
+        ps->hits++;
+    } else {
+        ps->hits = 0;
+    }
+    ps->rb = rb;
+    ps->last = rb_offset;
+    ps->stride = stride;
+
+    if (!depth || !ps->hits) {
+        return;
+    }
+
+    for (i = 1; i <= depth; i++) {
+        int64_t offset = (int64_t)rb_offset + stride * i;
+
+        if (offset < 0 || offset >= rb->used_length) {
+            break;
+        }
+        if (ramblock_recv_bitmap_test_byte_offset(rb, offset)) {
+            continue;
+        }
+        if (run_len && offset == run_start + run_len &&
+            run_len + pagesize <= UINT32_MAX) {
+            run_len += pagesize;
+            continue;
+        }
+        postcopy_prefetch_flush(mis, rb, run_start, run_len);
+        run_start = offset;
+        run_len = pagesize;
+    }
+    postcopy_prefetch_flush(mis, rb, run_start, run_len);
+}
+
 static uint32_t get_low_time_offset(PostcopyBlocktimeContext *dc)
 {
     int64_t start_time_offset = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
@@ -965,6 +1037,11 @@ static void postcopy_pause_fault_thread(MigrationIncomingState *mis)
 static void *postcopy_ram_fault_thread(void *opaque)
 {
     MigrationIncomingState *mis = opaque;
+    MachineState *ms = MACHINE(qdev_get_machine());
+    /* One slot per vCPU, and one for faults from other threads */
+    unsigned int nr_prefetch = ms->smp.cpus + 1;
+    PostcopyPrefetchState *prefetch = g_new0(PostcopyPrefetchState,
+                                             nr_prefetch);
     struct uffd_msg msg;
     int ret;
     size_t index;
@@ -1093,6 +1170,16 @@ retry:
                 postcopy_pause_fault_thread(mis);
                 goto retry;
             }
+
+            if (migrate_postcopy_prefetch_depth()) {
+                int cpu = msg.arg.pagefault.feat.ptid ?
+                    get_mem_fault_cpu_index(msg.arg.pagefault.feat.ptid) : -1;
+
+                if (cpu < 0 || cpu >= nr_prefetch - 1) {
+                    cpu = nr_prefetch - 1;
+                }
+                postcopy_prefetch(mis, &prefetch[cpu], rb, rb_offset);
+            }
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -1153,6 +1240,7 @@ retry:
     }
     rcu_unregister_thread();
     trace_postcopy_ram_fault_thread_exit();
+    g_free(prefetch);
     g_free(pfd);
     return NULL;
 }
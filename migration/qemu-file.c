@@ -747,6 +747,17 @@ bool qemu_file_buffer_empty(QEMUFile *file)
     return !file->iovcnt;
 }
 
+/*
+ * Check if data already read from the channel is waiting in the buffer,
+ * so that the next qemu_get_*() may be served without blocking
+ */
+bool qemu_file_has_buffered_input(QEMUFile *file)
+{
+    assert(!qemu_file_is_writable(file));
+
+    return file->buf_index < file->buf_size;
+}
+
 /*
  * Get a string whose length is determined by a single preceding byte
  * A preallocated 256 byte buffer must be passed in.
@@ -834,3 +845,118 @@ int qemu_file_get_to_fd(QEMUFile *f, int fd, size_t size)
 
     return 0;
 }
+
+/*
+ * Write @buflen bytes of @buf at the absolute position @pos of the
+ * underlying channel, which must be seekable.  Pending buffered data is
+ * flushed first, and the current position of the stream is unchanged.
+ */
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                        off_t pos)
+{
+    Error *err = NULL;
+    ssize_t ret;
+
+    if (f->last_error) {
+        return;
+    }
+
+    qemu_fflush(f);
+    ret = qio_channel_pwrite(f->ioc, (char *)buf, buflen, pos, &err);
+
+    if (err) {
+        qemu_file_set_error_obj(f, -EIO, err);
+        return;
+    }
+
+    if (ret == QIO_CHANNEL_ERR_BLOCK) {
+        qemu_file_set_error_obj(f, -EAGAIN, NULL);
+        return;
+    }
+
+    if (ret != buflen) {
+        error_setg(&err, "Partial write of size %zd, expected %zu",
+                   ret, buflen);
+        qemu_file_set_error_obj(f, -EIO, err);
+        return;
+    }
+
+    stat64_add(&mig_stats.qemu_file_transferred, buflen);
+}
+
+/*
+ * Read @buflen bytes at the absolute position @pos of the underlying
+ * channel into @buf, bypassing the stream buffer.
+ *
+ * Returns @buflen on success, or 0 and sets the file error otherwise.
+ */
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t buflen,
+                          off_t pos)
+{
+    Error *err = NULL;
+    ssize_t ret;
+
+    if (f->last_error) {
+        return 0;
+    }
+
+    ret = qio_channel_pread(f->ioc, (char *)buf, buflen, pos, &err);
+
+    if (ret == QIO_CHANNEL_ERR_BLOCK) {
+        qemu_file_set_error_obj(f, -EAGAIN, NULL);
+        return 0;
+    }
+
+    if (ret < 0 || err) {
+        qemu_file_set_error_obj(f, -EIO, err);
+        return 0;
+    }
+
+    if (ret != buflen) {
+        error_setg(&err, "Unexpected read size %zd, expected %zu",
+                   ret, buflen);
+        qemu_file_set_error_obj(f, -EIO, err);
+        return 0;
+    }
+
+    return buflen;
+}
+
+/*
+ * Move the stream position of @f.  Buffered output is flushed and
+ * buffered input is dropped, so the next access happens at @off.
+ */
+void qemu_set_offset(QEMUFile *f, off_t off, int whence)
+{
+    Error *err = NULL;
+    off_t ret;
+
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    } else {
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+
+    ret = qio_channel_io_seek(f->ioc, off, whence, &err);
+    if (ret == (off_t)-1) {
+        qemu_file_set_error_obj(f, -EPIPE, err);
+    }
+}
+
+/* Return the stream position of the writable file @f. */
+off_t qemu_get_offset(QEMUFile *f)
+{
+    Error *err = NULL;
+    off_t ret;
+
+    g_assert(qemu_file_is_writable(f));
+
+    qemu_fflush(f);
+
+    ret = qio_channel_io_seek(f->ioc, 0, SEEK_CUR, &err);
+    if (ret == (off_t)-1) {
+        qemu_file_set_error_obj(f, -EPIPE, err);
+    }
+    return ret;
+}
@@ -28,6 +28,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
@@ -338,6 +339,11 @@ struct RAMState {
      * Protected by the bitmap_mutex.
      */
     PageSearchStatus pss[RAM_CHANNEL_MAX];
+    /*
+     * Urgent pages are queued on the postcopy preempt channel but not yet
+     * flushed.  Protected by the bitmap_mutex.
+     */
+    bool postcopy_preempt_unflushed;
     /* UFFD file descriptor, used in 'write-tracking' migration */
     int uffdio_fd;
     /* total ram size in bytes */
@@ -350,6 +356,11 @@ struct RAMState {
     uint32_t last_version;
     /* How many times we have dirty too many pages */
     int dirty_rate_high_cnt;
+    /* smoothed dirty and transfer rates in bytes/s, for predictive-converge */
+    double dirty_rate_avg;
+    double xfer_rate_avg;
+    /* per-vCPU dirty-limit quota in MB/s set by predictive-converge */
+    int64_t converge_dirty_quota;
     /* these variables are used for bitmap sync */
     /* last time we did a full bitmap_sync */
     int64_t time_last_bitmap_sync;
@@ -904,6 +915,119 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/*
+ * With dirty-sync-threads > 1, the RAMBlocks are split in chunks that
+ * are synchronized in parallel.  Chunks are a multiple of a bitmap
+ * word, so that no two threads touch the same word of rb->bmap.
+ */
+#define DIRTY_SYNC_CHUNK_SIZE (1 * GiB)
+
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} DirtySyncChunk;
+
+typedef struct {
+    DirtySyncChunk *chunks;
+    unsigned int nchunks;
+    /* index of the next chunk to pick, accessed atomically */
+    unsigned int next;
+} DirtySyncWork;
+
+typedef struct {
+    QemuThread thread;
+    DirtySyncWork *work;
+    uint64_t new_dirty_pages;
+} DirtySyncWorker;
+
+static uint64_t dirty_sync_work_run(DirtySyncWork *work)
+{
+    uint64_t new_dirty_pages = 0;
+    unsigned int i;
+
+    while ((i = qatomic_fetch_inc(&work->next)) < work->nchunks) {
+        DirtySyncChunk *chunk = &work->chunks[i];
+
+        new_dirty_pages +=
+            cpu_physical_memory_sync_dirty_bitmap(chunk->block, chunk->start,
+                                                  chunk->length);
+    }
+    return new_dirty_pages;
+}
+
+static void *dirty_sync_thread(void *opaque)
+{
+    DirtySyncWorker *worker = opaque;
+
+    rcu_register_thread();
+    WITH_RCU_READ_LOCK_GUARD() {
+        worker->new_dirty_pages = dirty_sync_work_run(worker->work);
+    }
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/* Called with RCU critical section and bitmap_mutex held */
+static void ramblock_sync_dirty_bitmaps(RAMState *rs)
+{
+    int nthreads = migrate_dirty_sync_threads();
+    g_autofree DirtySyncWorker *workers = NULL;
+    g_autofree DirtySyncChunk *chunks = NULL;
+    DirtySyncWork work = { };
+    uint64_t new_dirty_pages;
+    unsigned int nchunks = 0;
+    RAMBlock *block;
+    int i;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        nchunks += DIV_ROUND_UP(block->used_length, DIRTY_SYNC_CHUNK_SIZE);
+    }
+
+    if (nthreads <= 1 || nchunks <= 1) {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            ramblock_sync_dirty_bitmap(rs, block);
+        }
+        return;
+    }
+
+    chunks = g_new(DirtySyncChunk, nchunks);
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t start;
+
+        for (start = 0; start < block->used_length;
+             start += DIRTY_SYNC_CHUNK_SIZE) {
+            chunks[work.nchunks++] = (DirtySyncChunk) {
+                .block = block,
+                .start = start,
+                .length = MIN(DIRTY_SYNC_CHUNK_SIZE,
+                              block->used_length - start),
+            };
+        }
+    }
+    work.chunks = chunks;
+
+    /* The calling thread takes its share of the chunks too */
+    nthreads = MIN(nthreads, (int)nchunks) - 1;
+    workers = g_new0(DirtySyncWorker, nthreads);
+    for (i = 0; i < nthreads; i++) {
+        workers[i].work = &work;
+        qemu_thread_create(&workers[i].thread, "mig/dirty-sync",
+                           dirty_sync_thread, &workers[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    new_dirty_pages = dirty_sync_work_run(&work);
+    for (i = 0; i < nthreads; i++) {
+        qemu_thread_join(&workers[i].thread);
+        new_dirty_pages += workers[i].new_dirty_pages;
+    }
+
+    rs->migration_dirty_pages += new_dirty_pages;
+    rs->num_dirty_pages_period += new_dirty_pages;
+    trace_ramblock_sync_dirty_bitmaps(work.nchunks, nthreads + 1);
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -996,7 +1120,99 @@ static void migration_dirty_limit_guest(void)
     trace_migration_dirty_limit_guest(quota_dirtyrate);
 }
 
-static void migration_trigger_throttle(RAMState *rs)
+/* Weight of the latest period in the smoothed rates */
+#define CONVERGE_PREDICT_WEIGHT 0.3
+
+/*
+ * Predictive convergence: smooth the dirty rate measured by the bitmap
+ * syncs and the bandwidth measured from the migration stats, and pick
+ * the mechanism that brings the dirty rate under the share of the
+ * bandwidth given by throttle-trigger-threshold:
+ *
+ *  - nothing, if the dirty rate is already low enough;
+ *  - the dirty-limit, if that capability is on, with a per-vCPU quota
+ *    derived from the bandwidth;
+ *  - otherwise a CPU throttle computed from the rates in one step,
+ *    rather than in cpu-throttle-increment steps;
+ *  - postcopy, if postcopy-ram is on and even the maximum throttle
+ *    would not be enough.
+ */
+static void migration_predict_converge(RAMState *rs,
+                                       uint64_t bytes_dirty_period,
+                                       uint64_t bytes_xfer_period,
+                                       int64_t period_ms)
+{
+    MigrationState *s = migrate_get_current();
+    uint64_t threshold = migrate_throttle_trigger_threshold();
+    int pct_max = migrate_max_cpu_throttle();
+    int throttle_now = cpu_throttle_active() ?
+                       cpu_throttle_get_percentage() : 0;
+    double dirty_rate = bytes_dirty_period * 1000.0 / period_ms;
+    double xfer_rate = bytes_xfer_period * 1000.0 / period_ms;
+    double target, unthrottled, eta_ms;
+    int pct;
+
+    if (!rs->xfer_rate_avg) {
+        rs->dirty_rate_avg = dirty_rate;
+        rs->xfer_rate_avg = xfer_rate;
+    } else {
+        rs->dirty_rate_avg += CONVERGE_PREDICT_WEIGHT *
+                              (dirty_rate - rs->dirty_rate_avg);
+        rs->xfer_rate_avg += CONVERGE_PREDICT_WEIGHT *
+                             (xfer_rate - rs->xfer_rate_avg);
+    }
+
+    target = rs->xfer_rate_avg * threshold / 100;
+    if (rs->dirty_rate_avg <= target) {
+        eta_ms = rs->xfer_rate_avg > rs->dirty_rate_avg ?
+                 ram_bytes_remaining() * 1000.0 /
+                 (rs->xfer_rate_avg - rs->dirty_rate_avg) : 0;
+        trace_migration_predict_converge(rs->dirty_rate_avg,
+                                         rs->xfer_rate_avg, eta_ms, "none");
+        return;
+    }
+
+    /*
+     * The dirty rate scales with the CPU time left to the guest, so
+     * work out the rate without throttle and the throttle that would
+     * bring it down to the target.
+     */
+    unthrottled = rs->dirty_rate_avg * 100 / (100 - throttle_now);
+    pct = 100 - (int)(target * 100 / unthrottled);
+
+    if (pct > pct_max && migrate_postcopy_ram() &&
+        !qatomic_read(&s->start_postcopy)) {
+        trace_migration_predict_converge(rs->dirty_rate_avg,
+                                         rs->xfer_rate_avg, -1, "postcopy");
+        qatomic_set(&s->start_postcopy, true);
+        return;
+    }
+
+    if (migrate_dirty_limit()) {
+        int64_t quota = target / current_machine->smp.cpus / MiB;
+
+        quota = MAX(quota, 1);
+        if (!dirtylimit_in_service() || quota != rs->converge_dirty_quota) {
+            rs->converge_dirty_quota = quota;
+            qmp_set_vcpu_dirty_limit(false, -1, quota, NULL);
+            trace_migration_dirty_limit_guest(quota);
+        }
+        trace_migration_predict_converge(rs->dirty_rate_avg,
+                                         rs->xfer_rate_avg, -1,
+                                         "dirty-limit");
+        return;
+    }
+
+    pct = MAX(pct, (int)migrate_cpu_throttle_initial());
+    pct = MIN(pct, pct_max);
+    if (pct > throttle_now) {
+        cpu_throttle_set(pct);
+    }
+    trace_migration_predict_converge(rs->dirty_rate_avg, rs->xfer_rate_avg,
+                                     -1, "throttle");
+}
+
+static void migration_trigger_throttle(RAMState *rs, int64_t period_ms)
 {
     uint64_t threshold = migrate_throttle_trigger_threshold();
     uint64_t bytes_xfer_period =
@@ -1011,6 +1227,12 @@ static void migration_trigger_throttle(RAMState *rs)
         return;
     }
 
+    if (migrate_predictive_converge()) {
+        migration_predict_converge(rs, bytes_dirty_period, bytes_xfer_period,
+                                   period_ms);
+        return;
+    }
+
     /*
      * The following detection logic can be refined later. For now:
      * Check to see if the ratio between dirtied bytes and the approx.
@@ -1033,7 +1255,7 @@ static void migration_trigger_throttle(RAMState *rs)
 
 static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 {
-    RAMBlock *block;
+    int64_t start_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     int64_t end_time;
 
     stat64_add(&mig_stats.dirty_sync_count, 1);
@@ -1047,21 +1269,21 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
-        }
+        ramblock_sync_dirty_bitmaps(rs);
         stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
     }
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
     memory_global_after_dirty_log_sync();
+    stat64_set(&mig_stats.dirty_sync_time,
+               qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start_us);
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
     /* more than 1 second = 1000 millisecons */
     if (end_time > rs->time_last_bitmap_sync + 1000) {
-        migration_trigger_throttle(rs);
+        migration_trigger_throttle(rs, end_time - rs->time_last_bitmap_sync);
 
         migration_update_rates(rs, end_time);
 
@@ -1123,16 +1345,35 @@ static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
     QEMUFile *file = pss->pss_channel;
     int len = 0;
 
+    switch (migrate_zero_page_detection()) {
+    case ZERO_PAGE_DETECTION_NONE:
+        return 0;
+    case ZERO_PAGE_DETECTION_MULTIFD:
+        /* The multifd sender threads look for zero pages themselves. */
+        if (migrate_multifd() && !migration_in_postcopy()) {
+            return 0;
+        }
+        break;
+    default:
+        break;
+    }
+
     if (!buffer_is_zero(p, TARGET_PAGE_SIZE)) {
         return 0;
     }
 
+    stat64_add(&mig_stats.zero_pages, 1);
+
+    if (migrate_mapped_ram()) {
+        /* zero pages are not written, the file region reads back as zero */
+        clear_bit_atomic(offset >> TARGET_PAGE_BITS, pss->block->file_bmap);
+        return 1;
+    }
+
     len += save_page_header(pss, file, pss->block, offset | RAM_SAVE_FLAG_ZERO);
     qemu_put_byte(file, 0);
     len += 1;
     ram_release_page(pss->block->idstr, offset);
-
-    stat64_add(&mig_stats.zero_pages, 1);
     ram_transferred_add(len);
 
     /*
@@ -1190,14 +1431,20 @@ static int save_normal_page(PageSearchStatus *pss, RAMBlock *block,
 {
     QEMUFile *file = pss->pss_channel;
 
-    ram_transferred_add(save_page_header(pss, pss->pss_channel, block,
-                                         offset | RAM_SAVE_FLAG_PAGE));
-    if (async) {
-        qemu_put_buffer_async(file, buf, TARGET_PAGE_SIZE,
-                              migrate_release_ram() &&
-                              migration_in_postcopy());
+    if (migrate_mapped_ram()) {
+        qemu_put_buffer_at(file, buf, TARGET_PAGE_SIZE,
+                           block->pages_offset + offset);
+        set_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
     } else {
-        qemu_put_buffer(file, buf, TARGET_PAGE_SIZE);
+        ram_transferred_add(save_page_header(pss, pss->pss_channel, block,
+                                             offset | RAM_SAVE_FLAG_PAGE));
+        if (async) {
+            qemu_put_buffer_async(file, buf, TARGET_PAGE_SIZE,
+                                  migrate_release_ram() &&
+                                  migration_in_postcopy());
+        } else {
+            qemu_put_buffer(file, buf, TARGET_PAGE_SIZE);
+        }
     }
     ram_transferred_add(TARGET_PAGE_SIZE);
     stat64_add(&mig_stats.normal_pages, 1);
@@ -1252,10 +1499,10 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss)
 
 static int ram_save_multifd_page(RAMBlock *block, ram_addr_t offset)
 {
+    /* The page is accounted as normal or zero by the sender thread. */
     if (multifd_queue_page(block, offset) < 0) {
         return -1;
     }
-    stat64_add(&mig_stats.normal_pages, 1);
 
     return 1;
 }
@@ -2169,13 +2416,40 @@ static int ram_save_host_page_urgent(PageSearchStatus *pss)
     } while (pss_within_range(pss));
 out:
     pss_host_page_finish(pss);
-    /* For urgent requests, flush immediately if sent */
+    /*
+     * Urgent pages are flushed by ram_postcopy_preempt_flush() once the
+     * return path has no more requests at hand, so that a burst of faults
+     * is answered with one write instead of one per page.
+     */
     if (sent) {
-        qemu_fflush(pss->pss_channel);
+        rs->postcopy_preempt_unflushed = true;
     }
     return ret;
 }
 
+/*
+ * Flush the urgent pages that were queued on the postcopy preempt channel.
+ * Called by the return path thread before it blocks waiting for requests.
+ */
+int ram_postcopy_preempt_flush(void)
+{
+    RAMState *rs = ram_state;
+    int ret = 0;
+
+    if (!rs) {
+        return 0;
+    }
+
+    qemu_mutex_lock(&rs->bitmap_mutex);
+    if (rs->postcopy_preempt_unflushed) {
+        rs->postcopy_preempt_unflushed = false;
+        ret = qemu_fflush(rs->pss[RAM_CHANNEL_POSTCOPY].pss_channel);
+    }
+    qemu_mutex_unlock(&rs->bitmap_mutex);
+
+    return ret;
+}
+
 /**
  * ram_save_host_page: save a whole host page
  *
@@ -2412,6 +2686,8 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
     }
 
     xbzrle_cleanup();
@@ -2746,6 +3022,17 @@ static int ram_state_init(RAMState **rsp)
     return 0;
 }
 
+/*
+ * Never clear the dirty log of less than one host page of @block at a time;
+ * write-protecting part of a huge page forces the host to split it.
+ */
+static uint8_t ram_block_clear_bmap_shift(RAMBlock *block, uint8_t shift)
+{
+    uint8_t page_shift = ctz64(qemu_ram_pagesize(block) >> TARGET_PAGE_BITS);
+
+    return MIN(MAX(shift, page_shift), CLEAR_BITMAP_SHIFT_MAX);
+}
+
 static void ram_list_init_bitmaps(void)
 {
     MigrationState *ms = migrate_get_current();
@@ -2779,8 +3066,12 @@ static void ram_list_init_bitmaps(void)
              */
             block->bmap = bitmap_new(pages);
             bitmap_set(block->bmap, 0, pages);
-            block->clear_bmap_shift = shift;
-            block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
+            block->clear_bmap_shift = ram_block_clear_bmap_shift(block, shift);
+            block->clear_bmap =
+                bitmap_new(clear_bmap_size(pages, block->clear_bmap_shift));
+            if (migrate_mapped_ram()) {
+                block->file_bmap = bitmap_new(pages);
+            }
         }
     }
 }
@@ -2923,6 +3214,113 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
  * granularity of these critical sections.
  */
 
+#define MAPPED_RAM_HDR_VERSION 1
+struct MappedRamHeader {
+    uint32_t version;
+    /*
+     * The target's page size, so we know how many pages are in the
+     * bitmap.
+     */
+    uint64_t page_size;
+    /*
+     * The offset in the migration file where the pages bitmap is
+     * stored.
+     */
+    uint64_t bitmap_offset;
+    /*
+     * The offset in the migration file where the actual pages (data)
+     * are stored.
+     */
+    uint64_t pages_offset;
+} QEMU_PACKED;
+typedef struct MappedRamHeader MappedRamHeader;
+
+/*
+ * Alignment of the region holding the pages of each RAMBlock in the
+ * migration file, so that it can later be accessed with O_DIRECT.
+ */
+#define MAPPED_RAM_FILE_OFFSET_ALIGNMENT 0x100000
+
+static size_t mapped_ram_bitmap_size(ram_addr_t length)
+{
+    return BITS_TO_LONGS(length >> TARGET_PAGE_BITS) * sizeof(unsigned long);
+}
+
+/*
+ * With mapped-ram every RAMBlock owns a region of the migration file
+ * laid out as:
+ *
+ *   | MappedRamHeader | bitmap | padding | pages ... |
+ *
+ * The header goes into the stream right after the block description.
+ * Pages are written at their fixed offset inside the pages region each
+ * time they are sent, and the bitmap of the pages present in the file
+ * is written once, when the migration completes.
+ */
+static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
+{
+    MappedRamHeader header = { };
+
+    block->bitmap_offset = qemu_get_offset(file) + sizeof(header);
+    block->pages_offset = ROUND_UP(block->bitmap_offset +
+                                   mapped_ram_bitmap_size(block->used_length),
+                                   MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+
+    header.version = cpu_to_be32(MAPPED_RAM_HDR_VERSION);
+    header.page_size = cpu_to_be64(TARGET_PAGE_SIZE);
+    header.bitmap_offset = cpu_to_be64(block->bitmap_offset);
+    header.pages_offset = cpu_to_be64(block->pages_offset);
+
+    qemu_put_buffer(file, (uint8_t *)&header, sizeof(header));
+
+    /* The stream continues after the pages region of this block. */
+    qemu_set_offset(file, block->pages_offset + block->used_length, SEEK_SET);
+}
+
+static bool mapped_ram_read_header(QEMUFile *file, MappedRamHeader *header,
+                                   Error **errp)
+{
+    size_t ret, header_size = sizeof(MappedRamHeader);
+
+    ret = qemu_get_buffer(file, (uint8_t *)header, header_size);
+    if (ret != header_size) {
+        error_setg(errp, "Could not read whole mapped-ram migration header "
+                   "(expected %zu, got %zu bytes)", header_size, ret);
+        return false;
+    }
+
+    /* migration stream is big-endian */
+    header->version = be32_to_cpu(header->version);
+
+    if (header->version > MAPPED_RAM_HDR_VERSION) {
+        error_setg(errp, "Migration mapped-ram capability version not "
+                   "supported (expected <= %d, got %d)", MAPPED_RAM_HDR_VERSION,
+                   header->version);
+        return false;
+    }
+
+    header->page_size = be64_to_cpu(header->page_size);
+    header->bitmap_offset = be64_to_cpu(header->bitmap_offset);
+    header->pages_offset = be64_to_cpu(header->pages_offset);
+
+    return true;
+}
+
+static void ram_save_file_bmap(QEMUFile *f)
+{
+    RAMBlock *block;
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        size_t bitmap_size = mapped_ram_bitmap_size(block->used_length);
+
+        qemu_put_buffer_at(f, (uint8_t *)block->file_bmap, bitmap_size,
+                           block->bitmap_offset);
+        ram_transferred_add(bitmap_size);
+    }
+}
+
 /**
  * ram_save_setup: Setup RAM for migration
  *
@@ -2965,6 +3363,10 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+
+            if (migrate_mapped_ram()) {
+                mapped_ram_setup_ramblock(f, block);
+            }
         }
     }
 
@@ -3187,6 +3589,19 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
         return ret;
     }
 
+    /* No multifd channel may update the bitmap once it is written. */
+    if (migrate_mapped_ram()) {
+        ram_save_file_bmap(f);
+
+        if (qemu_file_get_error(f)) {
+            Error *local_err = NULL;
+            int err = qemu_file_get_error_obj(f, &local_err);
+
+            error_reportf_err(local_err, "Failed to write bitmap to file: ");
+            return -err;
+        }
+    }
+
     if (migrate_multifd() && !migrate_multifd_flush_after_each_section()) {
         qemu_put_be64(f, RAM_SAVE_FLAG_MULTIFD_FLUSH);
     }
@@ -3740,8 +4155,86 @@ static bool postcopy_is_running(void)
  * Flush content of RAM cache into SVM's memory.
  * Only flush the pages that be dirtied by PVM or SVM or both.
  */
+/*
+ * With dirty-sync-threads > 1, the dirty pages of the COLO cache are
+ * copied back to RAM by several threads.  Runs of dirty pages are cut
+ * in chunks of at most COLO_FLUSH_CHUNK_SIZE, which the threads pick
+ * one at a time.
+ */
+#define COLO_FLUSH_CHUNK_SIZE (2 * MiB)
+
+typedef struct {
+    void *dst;
+    void *src;
+    size_t len;
+} ColoFlushChunk;
+
+typedef struct {
+    ColoFlushChunk *chunks;
+    unsigned int nchunks;
+    /* index of the next chunk to pick, accessed atomically */
+    unsigned int next;
+} ColoFlushWork;
+
+typedef struct {
+    QemuThread thread;
+    ColoFlushWork *work;
+} ColoFlushWorker;
+
+static void colo_flush_work_run(ColoFlushWork *work)
+{
+    unsigned int i;
+
+    while ((i = qatomic_fetch_inc(&work->next)) < work->nchunks) {
+        ColoFlushChunk *chunk = &work->chunks[i];
+
+        memcpy(chunk->dst, chunk->src, chunk->len);
+    }
+}
+
+static void *colo_flush_thread(void *opaque)
+{
+    ColoFlushWorker *worker = opaque;
+
+    colo_flush_work_run(worker->work);
+    return NULL;
+}
+
+/*
+ * Called with RCU critical section held, which also covers the worker
+ * threads since they are joined before it ends.  @chunks is not empty.
+ */
+static void colo_flush_chunks(GArray *chunks)
+{
+    int nthreads = migrate_dirty_sync_threads();
+    g_autofree ColoFlushWorker *workers = NULL;
+    ColoFlushWork work = {
+        .chunks = &g_array_index(chunks, ColoFlushChunk, 0),
+        .nchunks = chunks->len,
+    };
+    int i;
+
+    /* The calling thread takes its share of the chunks too */
+    nthreads = MIN(nthreads, (int)work.nchunks) - 1;
+    workers = g_new0(ColoFlushWorker, nthreads);
+    for (i = 0; i < nthreads; i++) {
+        workers[i].work = &work;
+        qemu_thread_create(&workers[i].thread, "mig/colo-flush",
+                           colo_flush_thread, &workers[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    colo_flush_work_run(&work);
+    for (i = 0; i < nthreads; i++) {
+        qemu_thread_join(&workers[i].thread);
+    }
+    trace_colo_flush_chunks(work.nchunks, nthreads + 1);
+}
+
 void colo_flush_ram_cache(void)
 {
+    bool parallel = migrate_dirty_sync_threads() > 1;
+    g_autoptr(GArray) chunks = NULL;
     RAMBlock *block = NULL;
     void *dst_host;
     void *src_host;
@@ -3750,9 +4243,11 @@ void colo_flush_ram_cache(void)
     memory_global_dirty_log_sync(false);
     qemu_mutex_lock(&ram_state->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(ram_state, block);
-        }
+        ramblock_sync_dirty_bitmaps(ram_state);
+    }
+
+    if (parallel) {
+        chunks = g_array_new(false, false, sizeof(ColoFlushChunk));
     }
 
     trace_colo_flush_ram_cache_begin(ram_state->migration_dirty_pages);
@@ -3770,6 +4265,7 @@ void colo_flush_ram_cache(void)
                 block = QLIST_NEXT_RCU(block, next);
             } else {
                 unsigned long i = 0;
+                size_t len, done;
 
                 for (i = 0; i < num; i++) {
                     migration_bitmap_clear_dirty(ram_state, block, offset + i);
@@ -3778,15 +4274,148 @@ void colo_flush_ram_cache(void)
                          + (((ram_addr_t)offset) << TARGET_PAGE_BITS);
                 src_host = block->colo_cache
                          + (((ram_addr_t)offset) << TARGET_PAGE_BITS);
-                memcpy(dst_host, src_host, TARGET_PAGE_SIZE * num);
+                len = TARGET_PAGE_SIZE * num;
+                if (!parallel) {
+                    memcpy(dst_host, src_host, len);
+                } else {
+                    for (done = 0; done < len; done += COLO_FLUSH_CHUNK_SIZE) {
+                        ColoFlushChunk chunk = {
+                            .dst = dst_host + done,
+                            .src = src_host + done,
+                            .len = MIN(len - done, COLO_FLUSH_CHUNK_SIZE),
+                        };
+
+                        g_array_append_val(chunks, chunk);
+                    }
+                }
                 offset += num;
             }
         }
+
+        if (parallel && chunks->len) {
+            colo_flush_chunks(chunks);
+        }
     }
     qemu_mutex_unlock(&ram_state->bitmap_mutex);
     trace_colo_flush_ram_cache_end();
 }
 
+#define MAPPED_RAM_LOAD_BUF_SIZE 0x100000 /* 1Mb */
+
+static bool read_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
+                                     long num_pages, unsigned long *bitmap,
+                                     Error **errp)
+{
+    ERRP_GUARD();
+    unsigned long set_bit_idx, clear_bit_idx;
+    ram_addr_t offset;
+    void *host;
+    size_t read, unread, size;
+
+    for (set_bit_idx = find_first_bit(bitmap, num_pages);
+         set_bit_idx < num_pages;
+         set_bit_idx = find_next_bit(bitmap, num_pages, clear_bit_idx + 1)) {
+
+        clear_bit_idx = find_next_zero_bit(bitmap, num_pages, set_bit_idx + 1);
+
+        unread = TARGET_PAGE_SIZE * (clear_bit_idx - set_bit_idx);
+        offset = set_bit_idx << TARGET_PAGE_BITS;
+
+        while (unread > 0) {
+            host = host_from_ram_block_offset(block, offset);
+            if (!host) {
+                error_setg(errp, "page outside of ramblock %s range",
+                           block->idstr);
+                return false;
+            }
+
+            size = MIN(unread, MAPPED_RAM_LOAD_BUF_SIZE);
+            if (migrate_multifd()) {
+                if (!multifd_queue_file_read(host, size,
+                                             block->pages_offset + offset)) {
+                    error_setg(errp, "multifd channels exited while loading "
+                               "ramblock %s", block->idstr);
+                    return false;
+                }
+                read = size;
+            } else {
+                read = qemu_get_buffer_at(f, host, size,
+                                          block->pages_offset + offset);
+                if (!read) {
+                    goto err;
+                }
+            }
+            offset += read;
+            unread -= read;
+        }
+    }
+
+    return true;
+
+err:
+    qemu_file_get_error_obj(f, errp);
+    error_prepend(errp, "(%s) failed to read page " RAM_ADDR_FMT
+                  " from file offset %" PRIx64 ": ", block->idstr, offset,
+                  block->pages_offset + offset);
+    return false;
+}
+
+static bool parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
+                                      ram_addr_t length, Error **errp)
+{
+    g_autofree unsigned long *bitmap = NULL;
+    MappedRamHeader header;
+    size_t bitmap_size;
+    long num_pages;
+
+    if (!mapped_ram_read_header(f, &header, errp)) {
+        return false;
+    }
+
+    if (header.page_size != TARGET_PAGE_SIZE) {
+        error_setg(errp, "Mismatched page size in mapped-ram header of %s "
+                   "(local %d, remote %" PRIu64 ")", block->idstr,
+                   (int)TARGET_PAGE_SIZE, header.page_size);
+        return false;
+    }
+
+    block->pages_offset = header.pages_offset;
+
+    /*
+     * Check the alignment of the file region that contains pages. We
+     * don't enforce MAPPED_RAM_FILE_OFFSET_ALIGNMENT to allow that
+     * value to change in the future. Do only a sanity check with page
+     * size alignment.
+     */
+    if (!QEMU_IS_ALIGNED(block->pages_offset, TARGET_PAGE_SIZE)) {
+        error_setg(errp,
+                   "Error reading ramblock %s pages, region has bad alignment",
+                   block->idstr);
+        return false;
+    }
+
+    num_pages = length / header.page_size;
+    bitmap_size = mapped_ram_bitmap_size(length);
+
+    bitmap = g_malloc0(bitmap_size);
+    if (qemu_get_buffer_at(f, (uint8_t *)bitmap, bitmap_size,
+                           header.bitmap_offset) != bitmap_size) {
+        qemu_file_get_error_obj(f, errp);
+        error_prepend(errp, "Error reading dirty bitmap of %s: ",
+                      block->idstr);
+        return false;
+    }
+
+    if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
+        return false;
+    }
+
+    /* Skip pages array */
+    qemu_set_offset(f, block->pages_offset + length, SEEK_SET);
+
+    return true;
+}
+
 static int parse_ramblock(QEMUFile *f, RAMBlock *block, ram_addr_t length)
 {
     int ret = 0;
@@ -3830,6 +4459,14 @@ static int parse_ramblock(QEMUFile *f, RAMBlock *block, ram_addr_t length)
             return -EINVAL;
         }
     }
+    if (migrate_mapped_ram()) {
+        Error *local_err = NULL;
+
+        if (!parse_ramblock_mapped_ram(f, block, length, &local_err)) {
+            error_report_err(local_err);
+            return -EINVAL;
+        }
+    }
     ret = rdma_block_notification_handle(f, block->idstr);
     if (ret < 0) {
         qemu_file_set_error(f, ret);
@@ -3864,6 +4501,18 @@ static int parse_ramblocks(QEMUFile *f, ram_addr_t total_ram_bytes)
         total_ram_bytes -= length;
     }
 
+    /*
+     * With mapped-ram the multifd channels read the pages of all blocks
+     * in the background; wait for them before the stream goes on.
+     */
+    if (!ret && migrate_mapped_ram() && migrate_multifd()) {
+        multifd_recv_sync_main();
+        if (migrate_has_error(migrate_get_current())) {
+            error_report("Failed to load ramblock pages with multifd");
+            ret = -EIO;
+        }
+    }
+
     return ret;
 }
 
@@ -1698,11 +1698,10 @@ void qemu_savevm_state_cleanup(void)
     }
 }
 
-static int qemu_savevm_state(QEMUFile *f, Error **errp)
+static int qemu_savevm_state_begin(QEMUFile *f, Error **errp)
 {
     int ret;
     MigrationState *ms = migrate_get_current();
-    MigrationStatus status;
 
     if (migration_is_running(ms->state)) {
         error_setg(errp, QERR_MIGRATION_ACTIVE);
@@ -1723,6 +1722,15 @@ static int qemu_savevm_state(QEMUFile *f, Error **errp)
     qemu_savevm_state_header(f);
     qemu_savevm_state_setup(f);
 
+    return 0;
+}
+
+static int qemu_savevm_state_end(QEMUFile *f, Error **errp)
+{
+    int ret;
+    MigrationState *ms = migrate_get_current();
+    MigrationStatus status;
+
     while (qemu_file_get_error(f) == 0) {
         if (qemu_savevm_state_iterate(f, false) > 0) {
             break;
@@ -1753,6 +1761,29 @@ static int qemu_savevm_state(QEMUFile *f, Error **errp)
     return ret;
 }
 
+/* Abandon a save started with qemu_savevm_state_begin() */
+static void qemu_savevm_state_abort(void)
+{
+    MigrationState *ms = migrate_get_current();
+
+    qemu_savevm_state_cleanup();
+    migrate_set_state(&ms->state, MIGRATION_STATUS_SETUP,
+                      MIGRATION_STATUS_FAILED);
+    ms->to_dst_file = NULL;
+}
+
+static int qemu_savevm_state(QEMUFile *f, Error **errp)
+{
+    int ret;
+
+    ret = qemu_savevm_state_begin(f, errp);
+    if (ret) {
+        return ret;
+    }
+
+    return qemu_savevm_state_end(f, errp);
+}
+
 void qemu_savevm_live_state(QEMUFile *f)
 {
     /* save QEMU_VM_SECTION_END section */
@@ -2219,7 +2250,8 @@ static gboolean postcopy_sync_page_req(gpointer key, gpointer value,
         return FALSE;
     }
 
-    ret = migrate_send_rp_message_req_pages(mis, rb, rb_offset);
+    ret = migrate_send_rp_message_req_pages(mis, rb, rb_offset,
+                                            qemu_ram_pagesize(rb));
     if (ret) {
         /* Please refer to above comment. */
         error_report("%s: send rp message failed for addr %p",
@@ -3036,16 +3068,13 @@ int qemu_loadvm_approve_switchover(void)
     return migrate_send_rp_switchover_ack(mis);
 }
 
-bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
-                  bool has_devices, strList *devices, Error **errp)
+static bool save_snapshot_prepare(const char *name, bool overwrite,
+                                  const char *vmstate, bool has_devices,
+                                  strList *devices, BlockDriverState **bsp,
+                                  Error **errp)
 {
     BlockDriverState *bs;
-    QEMUSnapshotInfo sn1, *sn = &sn1;
-    int ret = -1, ret2;
-    QEMUFile *f;
-    RunState saved_state = runstate_get();
-    uint64_t vm_state_size;
-    g_autoptr(GDateTime) now = g_date_time_new_now_local();
+    int ret2;
 
     GLOBAL_STATE_CODE();
 
@@ -3089,6 +3118,27 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
         return false;
     }
 
+    *bsp = bs;
+    return true;
+}
+
+/*
+ * Stop the VM and write the snapshot.  If @live_file is not NULL, the
+ * iterable state was already saved to it while the VM was running and
+ * only the remainder is written here; otherwise the whole VM state is
+ * saved with the VM stopped.
+ */
+static bool save_snapshot_finish(const char *name, BlockDriverState *bs,
+                                 QEMUFile *live_file, bool has_devices,
+                                 strList *devices, Error **errp)
+{
+    QEMUSnapshotInfo sn1, *sn = &sn1;
+    int ret = -1, ret2;
+    QEMUFile *f = live_file;
+    RunState saved_state = runstate_get();
+    uint64_t vm_state_size;
+    g_autoptr(GDateTime) now = g_date_time_new_now_local();
+
     global_state_store();
     vm_stop(RUN_STATE_SAVE_VM);
 
@@ -3114,12 +3164,16 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
     }
 
     /* save the VM state */
-    f = qemu_fopen_bdrv(bs, 1);
-    if (!f) {
-        error_setg(errp, "Could not open VM state file");
-        goto the_end;
+    if (live_file) {
+        ret = qemu_savevm_state_end(f, errp);
+    } else {
+        f = qemu_fopen_bdrv(bs, 1);
+        if (!f) {
+            error_setg(errp, "Could not open VM state file");
+            goto the_end;
+        }
+        ret = qemu_savevm_state(f, errp);
     }
-    ret = qemu_savevm_state(f, errp);
     vm_state_size = qemu_file_transferred(f);
     ret2 = qemu_fclose(f);
     if (ret < 0) {
@@ -3146,6 +3200,19 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
     return ret == 0;
 }
 
+bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
+                  bool has_devices, strList *devices, Error **errp)
+{
+    BlockDriverState *bs;
+
+    if (!save_snapshot_prepare(name, overwrite, vmstate, has_devices, devices,
+                               &bs, errp)) {
+        return false;
+    }
+
+    return save_snapshot_finish(name, bs, NULL, has_devices, devices, errp);
+}
+
 void qmp_xen_save_devices_state(const char *filename, bool has_live, bool live,
                                 Error **errp)
 {
@@ -3360,6 +3427,9 @@ bool vmstate_check_only_migratable(const VMStateDescription *vmsd)
     return !(vmsd && vmsd->unmigratable);
 }
 
+/* Upper bound on the number of passes over RAM for a live snapshot */
+#define SNAPSHOT_LIVE_MAX_PASSES 8
+
 typedef struct SnapshotJob {
     Job common;
     char *tag;
@@ -3368,6 +3438,14 @@ typedef struct SnapshotJob {
     Coroutine *co;
     Error **errp;
     bool ret;
+
+    /* Only used by live snapshot-save */
+    bool live;
+    BlockDriverState *bs;
+    QEMUFile *live_file;
+    int live_passes;
+    int64_t pass_start_ns;
+    uint64_t pass_start_bytes;
 } SnapshotJob;
 
 static void qmp_snapshot_job_free(SnapshotJob *s)
@@ -3399,18 +3477,143 @@ static void snapshot_load_job_bh(void *opaque)
     aio_co_wake(s->co);
 }
 
+/*
+ * Save a chunk of the iterable VM state while the guest keeps running.
+ * Returns 1 once the state that is still dirty can be written within the
+ * downtime limit, 0 if more iterations are needed, negative errno on error.
+ */
+static int snapshot_save_live_iterate(SnapshotJob *s)
+{
+    QEMUFile *f = s->live_file;
+    uint64_t must_precopy, can_postcopy, bytes, threshold;
+    int64_t now, elapsed;
+    int ret;
+
+    ret = qemu_savevm_state_iterate(f, false);
+    if (qemu_file_get_error(f)) {
+        ret = qemu_file_get_error(f);
+        error_setg_errno(s->errp, -ret, "Error while writing VM state");
+        return ret;
+    }
+    if (ret == 0) {
+        return 0;
+    }
+
+    /*
+     * A pass over the dirty state is complete.  Like the migration thread,
+     * sync the dirty bitmaps without the BQL so vCPUs are not held up.
+     */
+    bql_unlock();
+    qemu_savevm_state_pending_exact(&must_precopy, &can_postcopy);
+    bql_lock();
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    elapsed = MAX(now - s->pass_start_ns, 1);
+    bytes = qemu_file_transferred(f) - s->pass_start_bytes;
+    threshold = (double)bytes * migrate_downtime_limit() * SCALE_MS / elapsed;
+    s->live_passes++;
+
+    trace_snapshot_save_live_pass(s->live_passes, must_precopy + can_postcopy,
+                                  threshold);
+
+    if (must_precopy + can_postcopy <= threshold ||
+        s->live_passes >= SNAPSHOT_LIVE_MAX_PASSES) {
+        return 1;
+    }
+
+    s->pass_start_ns = now;
+    s->pass_start_bytes = qemu_file_transferred(f);
+    return 0;
+}
+
+static void snapshot_save_job_done(SnapshotJob *s)
+{
+    job_progress_update(&s->common, 1);
+
+    qmp_snapshot_job_free(s);
+    aio_co_wake(s->co);
+}
+
+/*
+ * Runs once per iteration of a live snapshot, returning to the main loop
+ * in between so that device emulation is not blocked for the whole save.
+ */
+static void snapshot_save_live_bh(void *opaque)
+{
+    Job *job = opaque;
+    SnapshotJob *s = container_of(job, SnapshotJob, common);
+    int ret;
+
+    if (job_is_cancelled(job)) {
+        error_setg(s->errp, "Snapshot cancelled");
+        ret = -ECANCELED;
+    } else {
+        ret = snapshot_save_live_iterate(s);
+    }
+
+    if (ret == 0) {
+        aio_bh_schedule_oneshot(qemu_get_aio_context(),
+                                snapshot_save_live_bh, job);
+        return;
+    }
+
+    if (ret < 0) {
+        qemu_savevm_state_abort();
+        qemu_fclose(s->live_file);
+        s->ret = false;
+    } else {
+        s->ret = save_snapshot_finish(s->tag, s->bs, s->live_file,
+                                      true, s->devices, s->errp);
+    }
+    s->live_file = NULL;
+
+    snapshot_save_job_done(s);
+}
+
+static bool snapshot_save_live_start(SnapshotJob *s)
+{
+    if (!save_snapshot_prepare(s->tag, false, s->vmstate, true, s->devices,
+                               &s->bs, s->errp)) {
+        return false;
+    }
+
+    s->live_file = qemu_fopen_bdrv(s->bs, 1);
+    if (!s->live_file) {
+        error_setg(s->errp, "Could not open VM state file");
+        return false;
+    }
+
+    if (qemu_savevm_state_begin(s->live_file, s->errp) < 0) {
+        qemu_fclose(s->live_file);
+        s->live_file = NULL;
+        return false;
+    }
+
+    s->pass_start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    s->pass_start_bytes = qemu_file_transferred(s->live_file);
+    return true;
+}
+
 static void snapshot_save_job_bh(void *opaque)
 {
     Job *job = opaque;
     SnapshotJob *s = container_of(job, SnapshotJob, common);
 
     job_progress_set_remaining(&s->common, 1);
-    s->ret = save_snapshot(s->tag, false, s->vmstate,
-                           true, s->devices, s->errp);
-    job_progress_update(&s->common, 1);
 
-    qmp_snapshot_job_free(s);
-    aio_co_wake(s->co);
+    if (s->live) {
+        s->ret = snapshot_save_live_start(s);
+        if (s->ret) {
+            aio_bh_schedule_oneshot(qemu_get_aio_context(),
+                                    snapshot_save_live_bh, job);
+            return;
+        }
+    } else {
+        s->ret = save_snapshot(s->tag, false, s->vmstate,
+                               true, s->devices, s->errp);
+    }
+
+    snapshot_save_job_done(s);
 }
 
 static void snapshot_delete_job_bh(void *opaque)
@@ -3483,6 +3686,7 @@ void qmp_snapshot_save(const char *job_id,
                        const char *tag,
                        const char *vmstate,
                        strList *devices,
+                       bool has_live, bool live,
                        Error **errp)
 {
     SnapshotJob *s;
@@ -3497,6 +3701,7 @@ void qmp_snapshot_save(const char *job_id,
     s->tag = g_strdup(tag);
     s->vmstate = g_strdup(vmstate);
     s->devices = QAPI_CLONE(strList, devices);
+    s->live = has_live && live;
 
     job_start(&s->common);
 }
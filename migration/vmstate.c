@@ -18,6 +18,7 @@
 #include "qapi/qmp/json-writer.h"
 #include "qemu-file.h"
 #include "qemu/bitops.h"
+#include "qemu/bswap.h"
 #include "qemu/error-report.h"
 #include "trace.h"
 
@@ -88,6 +89,116 @@ static int vmstate_size(void *opaque, const VMStateField *field)
     return size;
 }
 
+/*
+ * Arrays of plain integers are by far the most common kind of array field.
+ * Rather than calling info->get()/put() once per element, which goes
+ * through the QEMUFile one byte at a time, they are converted to and from
+ * big endian in chunks and transferred with a single buffer call per chunk.
+ * Returns the element size if @field can be handled this way, 0 otherwise.
+ */
+static int vmstate_bulk_elem_size(const VMStateField *field, int size)
+{
+    int elem_size;
+
+    if (field->flags & (VMS_ARRAY_OF_POINTER | VMS_STRUCT | VMS_VSTRUCT)) {
+        return 0;
+    }
+
+    if (field->info == &vmstate_info_uint8 ||
+        field->info == &vmstate_info_int8) {
+        elem_size = 1;
+    } else if (field->info == &vmstate_info_uint16 ||
+               field->info == &vmstate_info_int16) {
+        elem_size = 2;
+    } else if (field->info == &vmstate_info_uint32 ||
+               field->info == &vmstate_info_int32) {
+        elem_size = 4;
+    } else if (field->info == &vmstate_info_uint64 ||
+               field->info == &vmstate_info_int64) {
+        elem_size = 8;
+    } else {
+        return 0;
+    }
+
+    return size == elem_size ? elem_size : 0;
+}
+
+#define VMSTATE_BULK_CHUNK 512
+
+static void vmstate_put_bulk(QEMUFile *f, const uint8_t *elems, int elem_size,
+                             int n_elems)
+{
+    uint8_t buf[VMSTATE_BULK_CHUNK];
+
+    if (elem_size == 1) {
+        qemu_put_buffer(f, elems, n_elems);
+        return;
+    }
+
+    while (n_elems) {
+        int i, n = MIN(n_elems, VMSTATE_BULK_CHUNK / elem_size);
+
+        for (i = 0; i < n; i++) {
+            const uint8_t *src = elems + i * elem_size;
+            uint8_t *dst = buf + i * elem_size;
+
+            switch (elem_size) {
+            case 2:
+                stw_be_p(dst, lduw_he_p(src));
+                break;
+            case 4:
+                stl_be_p(dst, ldl_he_p(src));
+                break;
+            default:
+                stq_be_p(dst, ldq_he_p(src));
+                break;
+            }
+        }
+        qemu_put_buffer(f, buf, n * elem_size);
+        elems += n * elem_size;
+        n_elems -= n;
+    }
+}
+
+static void vmstate_get_bulk(QEMUFile *f, uint8_t *elems, int elem_size,
+                             int n_elems)
+{
+    uint8_t buf[VMSTATE_BULK_CHUNK];
+
+    if (elem_size == 1) {
+        qemu_get_buffer(f, elems, n_elems);
+        return;
+    }
+
+    while (n_elems) {
+        int i, n = MIN(n_elems, VMSTATE_BULK_CHUNK / elem_size);
+        size_t len = n * elem_size;
+        size_t got = qemu_get_buffer(f, buf, len);
+
+        /* On a short read the error is reported through the QEMUFile */
+        memset(buf + got, 0, len - got);
+
+        for (i = 0; i < n; i++) {
+            const uint8_t *src = buf + i * elem_size;
+            uint8_t *dst = elems + i * elem_size;
+
+            switch (elem_size) {
+            case 2:
+                stw_he_p(dst, lduw_be_p(src));
+                break;
+            case 4:
+                stl_he_p(dst, ldl_be_p(src));
+                break;
+            default:
+                stq_he_p(dst, ldq_be_p(src));
+                break;
+            }
+        }
+        elems += len;
+        n_elems -= n;
+    }
+}
+
 static void vmstate_handle_alloc(void *ptr, const VMStateField *field,
                                  void *opaque)
 {
@@ -133,12 +244,24 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
             void *first_elem = opaque + field->offset;
             int i, n_elems = vmstate_n_elems(opaque, field);
             int size = vmstate_size(opaque, field);
+            int bulk_size = vmstate_bulk_elem_size(field, size);
 
             vmstate_handle_alloc(first_elem, field, opaque);
             if (field->flags & VMS_POINTER) {
                 first_elem = *(void **)first_elem;
                 assert(first_elem || !n_elems || !size);
             }
+            if (bulk_size && n_elems > 1) {
+                vmstate_get_bulk(f, first_elem, bulk_size, n_elems);
+                ret = qemu_file_get_error(f);
+                if (ret < 0) {
+                    error_report("Failed to load %s:%s", vmsd->name,
+                                 field->name);
+                    trace_vmstate_load_field_error(field->name, ret);
+                    return ret;
+                }
+                n_elems = 0;
+            }
             for (i = 0; i < n_elems; i++) {
                 void *curr_elem = first_elem + size * i;
 
@@ -375,6 +498,7 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
             void *first_elem = opaque + field->offset;
             int i, n_elems = vmstate_n_elems(opaque, field);
             int size = vmstate_size(opaque, field);
+            int bulk_size = vmstate_bulk_elem_size(field, size);
             uint64_t old_offset, written_bytes;
             JSONWriter *vmdesc_loop = vmdesc;
 
@@ -383,6 +507,14 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                 first_elem = *(void **)first_elem;
                 assert(first_elem || !n_elems || !size);
             }
+            if (bulk_size && n_elems > 1 &&
+                (!vmdesc || vmsd_can_compress(field))) {
+                /* Compressed arrays only describe the first element */
+                vmsd_desc_field_start(vmsd, vmdesc, field, 0, n_elems);
+                vmstate_put_bulk(f, first_elem, bulk_size, n_elems);
+                vmsd_desc_field_end(vmsd, vmdesc, field, bulk_size, 0);
+                n_elems = 0;
+            }
             for (i = 0; i < n_elems; i++) {
                 void *curr_elem = first_elem + size * i;
 
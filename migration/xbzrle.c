@@ -15,10 +15,113 @@
 #include "qemu/host-utils.h"
 #include "xbzrle.h"
 
-#if defined(CONFIG_AVX512BW_OPT)
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
 #include <immintrin.h>
 #include "host/cpuinfo.h"
+#define XBZRLE_ACCEL
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define XBZRLE_ACCEL
+#endif
+
+#ifdef XBZRLE_ACCEL
+/*
+ * Encoder for the vector versions.  @run returns the end of the run of
+ * equal (if @same) or different bytes of @old_buf and @new_buf that
+ * starts at @i; it is inlined into each version so that it is compiled
+ * for the right instruction set.  The output is the same as the one
+ * of the word-at-a-time encoder below.
+ */
+static inline __attribute__((always_inline)) int
+xbzrle_encode_runs(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                   uint8_t *dst, int dlen,
+                   int (*run)(const uint8_t *, const uint8_t *, int, int, bool))
+{
+    int d = 0, i = 0;
+
+    while (i < slen) {
+        int start = i;
+        int nzrun_len;
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        i = run(old_buf, new_buf, i, slen, true);
+
+        /* buffer unchanged */
+        if (i - start == slen) {
+            return 0;
+        }
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += uleb128_encode_small(dst + d, i - start);
+        start = i;
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        i = run(old_buf, new_buf, i, slen, false);
+        nzrun_len = i - start;
+
+        d += uleb128_encode_small(dst + d, nzrun_len);
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + start, nzrun_len);
+        d += nzrun_len;
+    }
+
+    return d;
+}
+
+static inline int xbzrle_run_tail(const uint8_t *old_buf,
+                                  const uint8_t *new_buf,
+                                  int i, int slen, bool same)
+{
+    while (i < slen && (old_buf[i] == new_buf[i]) == same) {
+        i++;
+    }
+    return i;
+}
+#endif
 
+#if defined(CONFIG_AVX2_OPT)
+static inline int __attribute__((target("avx2")))
+xbzrle_run_avx2(const uint8_t *old_buf, const uint8_t *new_buf,
+                int i, int slen, bool same)
+{
+    for (; i + 32 <= slen; i += 32) {
+        __m256i o = _mm256_loadu_si256((const __m256i *)(old_buf + i));
+        __m256i n = _mm256_loadu_si256((const __m256i *)(new_buf + i));
+        uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(o, n));
+        uint32_t stop = same ? ~eq : eq;
+
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return xbzrle_run_tail(old_buf, new_buf, i, slen, same);
+}
+
+static int __attribute__((target("avx2")))
+xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                          uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              xbzrle_run_avx2);
+}
+#endif
+
+#if defined(CONFIG_AVX512BW_OPT)
 static int __attribute__((target("avx512bw")))
 xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
                             uint8_t *dst, int dlen)
@@ -137,6 +240,9 @@ xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+#endif
+
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
 static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
                                     int slen, uint8_t *dst, int dlen);
 
@@ -145,11 +251,20 @@ static int (*accel_func)(uint8_t *, uint8_t *, int, uint8_t *, int);
 static void __attribute__((constructor)) init_accel(void)
 {
     unsigned info = cpuinfo_init();
+
+#if defined(CONFIG_AVX512BW_OPT)
     if (info & CPUINFO_AVX512BW) {
         accel_func = xbzrle_encode_buffer_avx512;
-    } else {
-        accel_func = xbzrle_encode_buffer_int;
+        return;
+    }
+#endif
+#if defined(CONFIG_AVX2_OPT)
+    if (info & CPUINFO_AVX2) {
+        accel_func = xbzrle_encode_buffer_avx2;
+        return;
     }
+#endif
+    accel_func = xbzrle_encode_buffer_int;
 }
 
 int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
@@ -159,6 +274,37 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 }
 
 #define xbzrle_encode_buffer xbzrle_encode_buffer_int
+#elif defined(__aarch64__)
+/* Advanced SIMD is always available on AArch64, no need to probe it. */
+static inline int xbzrle_run_neon(const uint8_t *old_buf,
+                                  const uint8_t *new_buf,
+                                  int i, int slen, bool same)
+{
+    for (; i + 16 <= slen; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(old_buf + i), vld1q_u8(new_buf + i));
+        /* Narrow to 4 bits per byte, so that the mask fits in 64 bits */
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+                            vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        uint64_t stop = same ? ~mask : mask;
+
+        if (stop) {
+            return i + ctz64(stop) / 4;
+        }
+    }
+    return xbzrle_run_tail(old_buf, new_buf, i, slen, same);
+}
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              xbzrle_run_neon);
+}
+
+#define xbzrle_encode_buffer xbzrle_encode_buffer_int
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
+    __attribute__((unused));
 #endif
 
 /*
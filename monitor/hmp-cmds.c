@@ -124,11 +124,18 @@ void hmp_sync_profile(Monitor *mon, const QDict *qdict)
 
     if (op == NULL) {
         bool on = qsp_is_enabled();
+        unsigned int period = qsp_get_sample_period();
 
-        monitor_printf(mon, "sync-profile is %s\n", on ? "on" : "off");
+        if (on && period > 1) {
+            monitor_printf(mon, "sync-profile is on, sampling 1 in %u\n",
+                           period);
+        } else {
+            monitor_printf(mon, "sync-profile is %s\n", on ? "on" : "off");
+        }
         return;
     }
     if (!strcmp(op, "on")) {
+        qsp_set_sample_period(qdict_get_try_int(qdict, "period", 1));
         qsp_enable();
     } else if (!strcmp(op, "off")) {
         qsp_disable();
@@ -227,6 +234,16 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
         monitor_printf(mon, "  aio-max-batch=%" PRId64 "\n",
                        value->aio_max_batch);
+        monitor_printf(mon, "  bounce-pool-hits=%" PRIu64 "\n",
+                       value->bounce_pool_hits);
+        monitor_printf(mon, "  bounce-pool-misses=%" PRIu64 "\n",
+                       value->bounce_pool_misses);
+        monitor_printf(mon, "  poll-hits=%" PRIu64 "\n", value->poll_hits);
+        monitor_printf(mon, "  poll-misses=%" PRIu64 "\n", value->poll_misses);
+        monitor_printf(mon, "  poll-wasted-ns=%" PRIu64 "\n",
+                       value->poll_wasted_ns);
+        monitor_printf(mon, "  bh-calls=%" PRIu64 "\n", value->bh_calls);
+        monitor_printf(mon, "  bh-batches=%" PRIu64 "\n", value->bh_batches);
     }
 
     qapi_free_IOThreadInfoList(info_list);
@@ -247,10 +264,11 @@ void hmp_info_sync_profile(Monitor *mon, const QDict *qdict)
     int64_t max = qdict_get_try_int(qdict, "max", 10);
     bool mean = qdict_get_try_bool(qdict, "mean", false);
     bool coalesce = !qdict_get_try_bool(qdict, "no_coalesce", false);
+    bool histogram = qdict_get_try_bool(qdict, "histogram", false);
     enum QSPSortBy sort_by;
 
     sort_by = mean ? QSP_SORT_BY_AVG_WAIT_TIME : QSP_SORT_BY_TOTAL_WAIT_TIME;
-    qsp_report(max, sort_by, coalesce);
+    qsp_report(max, sort_by, coalesce, histogram);
 }
 
 void hmp_info_history(Monitor *mon, const QDict *qdict)
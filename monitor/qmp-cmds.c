@@ -190,6 +190,60 @@ out:
     return output;
 }
 
+void qmp_x_sync_profile(bool enable, bool has_sample_period,
+                        uint32_t sample_period, bool has_reset, bool reset,
+                        Error **errp)
+{
+    if (has_sample_period && !sample_period) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "sample-period",
+                   "a positive number");
+        return;
+    }
+
+    if (reset) {
+        qsp_reset();
+    }
+    if (enable) {
+        qsp_set_sample_period(has_sample_period ? sample_period : 1);
+        qsp_enable();
+    } else {
+        qsp_disable();
+    }
+}
+
+static void add_sync_profile_entry(const QSPStat *stat, void *opaque)
+{
+    SyncProfileEntryList ***tail = opaque;
+    SyncProfileEntry *entry = g_new0(SyncProfileEntry, 1);
+    uint64List **hist_tail = &entry->histogram;
+
+    entry->type = g_strdup(stat->typename);
+    entry->call_site = g_strdup(stat->callsite_at);
+    entry->objects = stat->n_objs;
+    entry->time_ns = stat->ns;
+    entry->count = stat->n_acqs;
+    for (int i = 0; i < QSP_HIST_BUCKETS; i++) {
+        QAPI_LIST_APPEND(hist_tail, stat->hist[i]);
+    }
+    QAPI_LIST_APPEND(*tail, entry);
+}
+
+SyncProfileEntryList *qmp_x_query_sync_profile(bool has_max, uint32_t max,
+                                               bool has_sort,
+                                               SyncProfileSort sort,
+                                               bool has_coalesce, bool coalesce,
+                                               Error **errp)
+{
+    SyncProfileEntryList *head = NULL, **tail = &head;
+
+    qsp_foreach(has_max ? max : 10,
+                sort == SYNC_PROFILE_SORT_MEAN_TIME ?
+                QSP_SORT_BY_AVG_WAIT_TIME : QSP_SORT_BY_TOTAL_WAIT_TIME,
+                has_coalesce ? coalesce : true,
+                add_sync_profile_entry, &tail);
+    return head;
+}
+
 static void __attribute__((__constructor__)) monitor_init_qmp_commands(void)
 {
     /*
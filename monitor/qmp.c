@@ -134,7 +134,24 @@ void qmp_send_response(MonitorQMP *mon, const QDict *rsp)
     const QObject *data = QOBJECT(rsp);
     GString *json;
 
-    json = qobject_to_json_pretty(data, mon->pretty);
+    if (!mon->pretty) {
+        GString *outbuf = mon->common.outbuf;
+        size_t start;
+
+        /*
+         * Serialize straight into the output buffer.  Compact JSON has
+         * no newlines for monitor_puts() to translate.
+         */
+        QEMU_LOCK_GUARD(&mon->common.mon_lock);
+        start = outbuf->len;
+        qobject_to_json_append(outbuf, data, false);
+        trace_monitor_qmp_respond(mon, outbuf->str + start);
+        g_string_append(outbuf, "\r\n");
+        monitor_flush_locked(&mon->common);
+        return;
+    }
+
+    json = qobject_to_json_pretty(data, true);
     assert(json != NULL);
     trace_monitor_qmp_respond(mon, json->str);
 
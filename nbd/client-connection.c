@@ -272,6 +272,23 @@ void nbd_client_connection_release(NBDClientConnection *conn)
     }
 }
 
+/*
+ * Start connecting in the background, unless a connection attempt is running
+ * or its result has not been picked up yet.  The result is returned by the
+ * next nbd_co_establish_connection().
+ */
+void nbd_client_connection_start(NBDClientConnection *conn)
+{
+    QemuThread thread;
+
+    QEMU_LOCK_GUARD(&conn->mutex);
+    if (!conn->running && !conn->sioc) {
+        conn->running = true;
+        qemu_thread_create(&thread, "nbd-connect",
+                           connect_thread_func, conn, QEMU_THREAD_DETACHED);
+    }
+}
+
 /*
  * Get a new connection in context of @conn:
  *   if the thread is running, wait for completion
@@ -28,6 +28,7 @@
 #include "nbd-internal.h"
 #include "qemu/units.h"
 #include "qemu/memalign.h"
+#include "sysemu/iothread.h"
 
 #define NBD_META_ID_BASE_ALLOCATION 0
 #define NBD_META_ID_ALLOCATION_DEPTH 1
@@ -101,6 +102,11 @@ struct NBDExport {
     bool allocation_depth;
     BdrvDirtyBitmap **export_bitmaps;
     size_t nr_export_bitmaps;
+
+    /* Threads that serve the clients, assigned in round-robin order */
+    IOThread **client_iothreads;
+    size_t nr_client_iothreads;
+    size_t next_client_iothread;
 };
 
 static QTAILQ_HEAD(, NBDExport) exports = QTAILQ_HEAD_INITIALIZER(exports);
@@ -128,6 +134,7 @@ struct NBDClient {
     QemuMutex lock;
 
     NBDExport *exp;
+    AioContext *ctx; /* NULL if the client runs in the export AioContext */
     QCryptoTLSCreds *tlscreds;
     char *tlsauthz;
     QIOChannelSocket *sioc; /* The underlying data channel */
@@ -157,6 +164,25 @@ struct NBDClient {
 
 static void nbd_client_receive_next_request(NBDClient *client);
 
+/* Runs in main loop thread */
+static void nbd_client_set_export(NBDClient *client, NBDExport *exp)
+{
+    client->exp = exp;
+    if (exp->nr_client_iothreads) {
+        IOThread *iothread =
+            exp->client_iothreads[exp->next_client_iothread++ %
+                                  exp->nr_client_iothreads];
+
+        client->ctx = iothread_get_aio_context(iothread);
+    }
+    QTAILQ_INSERT_TAIL(&exp->clients, client, next);
+}
+
+static AioContext *nbd_client_aio_context(NBDClient *client)
+{
+    return client->ctx ?: client->exp->common.ctx;
+}
+
 /* Basic flow for negotiation
 
    Server         Client
@@ -474,6 +500,7 @@ static int nbd_negotiate_handle_export_name(NBDClient *client, bool no_zeroes,
     ERRP_GUARD();
     g_autofree char *name = NULL;
     char buf[NBD_REPLY_EXPORT_NAME_SIZE] = "";
+    NBDExport *exp;
     size_t len;
     int ret;
     uint16_t myflags;
@@ -503,22 +530,22 @@ static int nbd_negotiate_handle_export_name(NBDClient *client, bool no_zeroes,
 
     trace_nbd_negotiate_handle_export_name_request(name);
 
-    client->exp = nbd_export_find(name);
-    if (!client->exp) {
+    exp = nbd_export_find(name);
+    if (!exp) {
         error_setg(errp, "export not found");
         return -EINVAL;
     }
-    nbd_check_meta_export(client, client->exp);
+    nbd_check_meta_export(client, exp);
 
-    myflags = client->exp->nbdflags;
+    myflags = exp->nbdflags;
     if (client->mode >= NBD_MODE_STRUCTURED) {
         myflags |= NBD_FLAG_SEND_DF;
     }
     if (client->mode >= NBD_MODE_EXTENDED && client->contexts.count) {
         myflags |= NBD_FLAG_BLOCK_STAT_PAYLOAD;
     }
-    trace_nbd_negotiate_new_style_size_flags(client->exp->size, myflags);
-    stq_be_p(buf, client->exp->size);
+    trace_nbd_negotiate_new_style_size_flags(exp->size, myflags);
+    stq_be_p(buf, exp->size);
     stw_be_p(buf + 8, myflags);
     len = no_zeroes ? 10 : sizeof(buf);
     ret = nbd_write(client->ioc, buf, len, errp);
@@ -527,7 +554,7 @@ static int nbd_negotiate_handle_export_name(NBDClient *client, bool no_zeroes,
         return ret;
     }
 
-    QTAILQ_INSERT_TAIL(&client->exp->clients, client, next);
+    nbd_client_set_export(client, exp);
     blk_exp_ref(&client->exp->common);
 
     return 0;
@@ -739,9 +766,8 @@ static int nbd_negotiate_handle_info(NBDClient *client, Error **errp)
     }
 
     if (client->opt == NBD_OPT_GO) {
-        client->exp = exp;
         client->check_align = check_align;
-        QTAILQ_INSERT_TAIL(&client->exp->clients, client, next);
+        nbd_client_set_export(client, exp);
         blk_exp_ref(&client->exp->common);
         rc = 1;
     }
@@ -1709,7 +1735,7 @@ static bool nbd_drained_poll(void *opaque)
                  * qio_channel_yield().
                  */
                 if (client->recv_coroutine != NULL && client->read_yielding) {
-                    aio_bh_schedule_oneshot(nbd_export_aio_context(client->exp),
+                    aio_bh_schedule_oneshot(nbd_client_aio_context(client),
                                             nbd_wake_read_bh, client);
                 }
 
@@ -1759,6 +1785,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     uint64_t perm, shared_perm;
     bool readonly = !exp_args->writable;
     BlockDirtyBitmapOrStrList *bitmaps;
+    strList *iothreads;
     size_t i;
     int ret;
 
@@ -1881,11 +1908,30 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
         assert(strlen(bitmap) <= BDRV_BITMAP_MAX_NAME_SIZE);
     }
 
+    for (iothreads = arg->client_iothreads; iothreads;
+         iothreads = iothreads->next) {
+        exp->nr_client_iothreads++;
+    }
+    exp->client_iothreads = g_new0(IOThread *, exp->nr_client_iothreads);
+    for (i = 0, iothreads = arg->client_iothreads; iothreads;
+         i++, iothreads = iothreads->next) {
+        exp->client_iothreads[i] = iothread_by_id(iothreads->value);
+        if (!exp->client_iothreads[i]) {
+            ret = -ENOENT;
+            error_setg(errp, "IOThread '%s' not found", iothreads->value);
+            goto fail;
+        }
+    }
+
     /* Mark bitmaps busy in a separate loop, to simplify roll-back concerns. */
     for (i = 0; i < exp->nr_export_bitmaps; i++) {
         bdrv_dirty_bitmap_set_busy(exp->export_bitmaps[i], true);
     }
 
+    for (i = 0; i < exp->nr_client_iothreads; i++) {
+        object_ref(OBJECT(exp->client_iothreads[i]));
+    }
+
     exp->allocation_depth = arg->allocation_depth;
 
     /*
@@ -1907,6 +1953,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
 
 fail:
     bdrv_graph_rdunlock_main_loop();
+    g_free(exp->client_iothreads);
     g_free(exp->export_bitmaps);
     g_free(exp->name);
     g_free(exp->description);
@@ -1977,6 +2024,11 @@ static void nbd_export_delete(BlockExport *blk_exp)
     for (i = 0; i < exp->nr_export_bitmaps; i++) {
         bdrv_dirty_bitmap_set_busy(exp->export_bitmaps[i], false);
     }
+
+    for (i = 0; i < exp->nr_client_iothreads; i++) {
+        object_unref(OBJECT(exp->client_iothreads[i]));
+    }
+    g_free(exp->client_iothreads);
 }
 
 const BlockExportDriver blk_exp_nbd = {
@@ -3147,7 +3199,7 @@ static void nbd_client_receive_next_request(NBDClient *client)
         !client->quiescing) {
         nbd_client_get(client);
         client->recv_coroutine = qemu_coroutine_create(nbd_trip, client);
-        aio_co_schedule(client->exp->common.ctx, client->recv_coroutine);
+        aio_co_schedule(nbd_client_aio_context(client), client->recv_coroutine);
     }
 }
 
@@ -52,20 +52,58 @@ typedef struct AFXDPState {
     uint32_t             n_queues;
     uint32_t             xdp_flags;
     bool                 inhibit;
+    bool                 busy_poll;
+
+    AioContext           *ctx;
 } AFXDPState;
 
 #define AF_XDP_BATCH_SIZE 64
 
+/* SO_BUSY_POLL timeout, only relevant for the blocking calls we never make */
+#define AF_XDP_BUSY_POLL_USECS 20
+
 static void af_xdp_send(void *opaque);
 static void af_xdp_writable(void *opaque);
 
+/*
+ * AioContext polling: report received packets without a syscall.  With
+ * preferred busy polling the device queue is only processed when we ask
+ * for it, so kick it whenever the ring is found empty.
+ */
+static bool af_xdp_poll_rx(void *opaque)
+{
+    AFXDPState *s = opaque;
+
+    if (xsk_cons_nb_avail(&s->rx, 1)) {
+        return true;
+    }
+    if (s->busy_poll) {
+        recvfrom(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+        return xsk_cons_nb_avail(&s->rx, 1);
+    }
+    return false;
+}
+
+static void af_xdp_set_fd_handler(AFXDPState *s, IOHandler *fd_read,
+                                  IOHandler *fd_write)
+{
+    int fd = xsk_socket__fd(s->xsk);
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, fd, fd_read, fd_write,
+                           fd_read ? af_xdp_poll_rx : NULL,
+                           fd_read, s);
+    } else {
+        qemu_set_fd_handler(fd, fd_read, fd_write, s);
+    }
+}
+
 /* Set the event-loop handlers for the af-xdp backend. */
 static void af_xdp_update_fd_handler(AFXDPState *s)
 {
-    qemu_set_fd_handler(xsk_socket__fd(s->xsk),
-                        s->read_poll ? af_xdp_send : NULL,
-                        s->write_poll ? af_xdp_writable : NULL,
-                        s);
+    af_xdp_set_fd_handler(s,
+                          s->read_poll ? af_xdp_send : NULL,
+                          s->write_poll ? af_xdp_writable : NULL);
 }
 
 /* Update the read handler. */
@@ -97,6 +135,16 @@ static void af_xdp_poll(NetClientState *nc, bool enable)
     }
 }
 
+/* Move the event-loop handlers to another AioContext. */
+static void af_xdp_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    af_xdp_set_fd_handler(s, NULL, NULL);
+    s->ctx = ctx;
+    af_xdp_update_fd_handler(s);
+}
+
 static void af_xdp_complete_tx(AFXDPState *s)
 {
     uint32_t idx = 0;
@@ -175,7 +223,12 @@ static ssize_t af_xdp_receive(NetClientState *nc,
     s->outstanding_tx++;
 
     if (xsk_ring_prod__needs_wakeup(&s->tx)) {
-        af_xdp_write_poll(s, true);
+        if (s->busy_poll) {
+            /* Also processes the device queue, don't wait for a poll */
+            sendto(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+        } else {
+            af_xdp_write_poll(s, true);
+        }
     }
 
     return size;
@@ -226,6 +279,7 @@ static void af_xdp_send(void *opaque)
         return;
     }
 
+    qemu_net_batch_begin(&s->nc);
     for (i = 0; i < n_rx; i++) {
         const struct xdp_desc *desc;
         struct iovec iov;
@@ -251,6 +305,7 @@ static void af_xdp_send(void *opaque)
             break;
         }
     }
+    qemu_net_batch_end(&s->nc);
 
     /* Release actually sent descriptors and try to re-fill. */
     xsk_ring_cons__release(&s->rx, n_rx);
@@ -333,6 +388,30 @@ static int af_xdp_umem_create(AFXDPState *s, int sock_fd, Error **errp)
     return 0;
 }
 
+static int af_xdp_enable_busy_poll(AFXDPState *s, uint32_t budget,
+                                   Error **errp)
+{
+#if defined(SO_PREFER_BUSY_POLL) && defined(SO_BUSY_POLL_BUDGET)
+    int fd = xsk_socket__fd(s->xsk);
+    int one = 1, usecs = AF_XDP_BUSY_POLL_USECS, val = budget;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &val, sizeof(val))) {
+        error_setg_errno(errp, errno,
+                         "failed to enable busy polling for %s queue_index: %d",
+                         s->ifname, s->nc.queue_index);
+        return -1;
+    }
+
+    s->busy_poll = true;
+    return 0;
+#else
+    error_setg(errp, "busy polling is not supported by this host");
+    return -1;
+#endif
+}
+
 static int af_xdp_socket_create(AFXDPState *s,
                                 const NetdevAFXDPOptions *opts, Error **errp)
 {
@@ -393,6 +472,12 @@ static int af_xdp_socket_create(AFXDPState *s,
 
     s->xdp_flags = cfg.xdp_flags;
 
+    if (opts->has_busy_poll_budget && opts->busy_poll_budget) {
+        if (af_xdp_enable_busy_poll(s, opts->busy_poll_budget, errp)) {
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -403,6 +488,7 @@ static NetClientInfo net_af_xdp_info = {
     .receive = af_xdp_receive,
     .poll = af_xdp_poll,
     .cleanup = af_xdp_cleanup,
+    .set_aio_context = af_xdp_set_aio_context,
 };
 
 static int *parse_socket_fds(const char *sock_fds_str,
@@ -16,27 +16,46 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "net/checksum.h"
 #include "net/eth.h"
 
+/*
+ * The ones' complement sum is independent of byte order (RFC 1071), so
+ * add up host-endian words eight bytes at a time and swap the folded
+ * result at the end.  The returned value is at most 0xffff, congruent to
+ * the sum of the big-endian 16-bit words modulo 0xffff.
+ */
 uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
 {
-    uint32_t sum1 = 0, sum2 = 0;
-    int i;
+    uint64_t sum = 0;
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w = ldq_he_p(buf + i);
 
-    for (i = 0; i < len - 1; i += 2) {
-        sum1 += (uint32_t)buf[i];
-        sum2 += (uint32_t)buf[i + 1];
+        sum += (uint32_t)w;
+        sum += w >> 32;
+    }
+    for (; i + 2 <= len; i += 2) {
+        sum += lduw_he_p(buf + i);
     }
     if (i < len) {
-        sum1 += (uint32_t)buf[i];
+        /* The odd final byte is the high half of a big-endian word */
+        sum += HOST_BIG_ENDIAN ? buf[i] << 8 : buf[i];
     }
 
-    if (seq & 1) {
-        return sum1 + (sum2 << 8);
-    } else {
-        return sum2 + (sum1 << 8);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+
+    /* Data starting at an odd offset contributes byte-swapped words */
+    if (!HOST_BIG_ENDIAN ^ (seq & 1)) {
+        sum = bswap16(sum);
     }
+    return sum;
 }
 
 uint16_t net_checksum_finish(uint32_t sum)
@@ -599,11 +599,9 @@ static int colo_packet_compare_other(Packet *spkt, Packet *ppkt)
                                        ppkt->size - offset);
 }
 
-static int colo_old_packet_check_one(Packet *pkt, int64_t *check_time)
+static int colo_old_packet_check_one(Packet *pkt, int64_t *deadline)
 {
-    int64_t now = qemu_clock_get_ms(QEMU_CLOCK_HOST);
-
-    if ((now - pkt->creation_ms) > (*check_time)) {
+    if (pkt->creation_ms < *deadline) {
         trace_colo_old_packet_check_found(pkt->creation_ms);
         return 0;
     } else {
@@ -621,29 +619,22 @@ void colo_compare_unregister_notifier(Notifier *notify)
     notifier_remove(notify);
 }
 
-static int colo_old_packet_check_one_conn(Connection *conn,
-                                          CompareState *s)
+static bool colo_old_packet_check_one_conn(Connection *conn,
+                                           int64_t *deadline)
 {
-    if (!g_queue_is_empty(&conn->primary_list)) {
-        if (g_queue_find_custom(&conn->primary_list,
-                                &s->compare_timeout,
-                                (GCompareFunc)colo_old_packet_check_one))
-            goto out;
+    if (!g_queue_is_empty(&conn->primary_list) &&
+        g_queue_find_custom(&conn->primary_list, deadline,
+                            (GCompareFunc)colo_old_packet_check_one)) {
+        return true;
     }
 
-    if (!g_queue_is_empty(&conn->secondary_list)) {
-        if (g_queue_find_custom(&conn->secondary_list,
-                                &s->compare_timeout,
-                                (GCompareFunc)colo_old_packet_check_one))
-            goto out;
+    if (!g_queue_is_empty(&conn->secondary_list) &&
+        g_queue_find_custom(&conn->secondary_list, deadline,
+                            (GCompareFunc)colo_old_packet_check_one)) {
+        return true;
     }
 
-    return 1;
-
-out:
-    /* Do checkpoint will flush old packet */
-    colo_compare_inconsistency_notify(s);
-    return 0;
+    return false;
 }
 
 /*
@@ -654,13 +645,20 @@ out:
 static void colo_old_packet_check(void *opaque)
 {
     CompareState *s = opaque;
+    /* Read the clock once per scan rather than once per queued packet */
+    int64_t deadline = qemu_clock_get_ms(QEMU_CLOCK_HOST) - s->compare_timeout;
+    GList *l;
 
-    /*
-     * If we find one old packet, stop finding job and notify
-     * COLO frame do checkpoint.
-     */
-    g_queue_find_custom(&s->conn_list, s,
-                        (GCompareFunc)colo_old_packet_check_one_conn);
+    for (l = s->conn_list.head; l; l = l->next) {
+        if (colo_old_packet_check_one_conn(l->data, &deadline)) {
+            /*
+             * If we find one old packet, stop finding job and notify
+             * COLO frame do checkpoint, which will flush old packets.
+             */
+            colo_compare_inconsistency_notify(s);
+            return;
+        }
+    }
 }
 
 static void colo_compare_packet(CompareState *s, Connection *conn,
@@ -45,48 +45,52 @@ struct MirrorState {
 
 typedef struct FilterSendCo {
     MirrorState *s;
-    char *buf;
+    const struct iovec *iov;
+    int iovcnt;
     ssize_t size;
     bool done;
     int ret;
 } FilterSendCo;
 
 static int _filter_send(MirrorState *s,
-                       char *buf,
+                       const struct iovec *iov,
+                       int iovcnt,
                        ssize_t size)
 {
     NetFilterState *nf = NETFILTER(s);
     int ret = 0;
-    uint32_t len = 0;
-
-    len = htonl(size);
-    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)&len, sizeof(len));
-    if (ret != sizeof(len)) {
-        goto err;
-    }
+    uint32_t hdr[2];
+    int hdr_size = sizeof(hdr[0]);
+    int i;
 
+    hdr[0] = htonl(size);
     if (s->vnet_hdr) {
         /*
          * If vnet_hdr = on, we send vnet header len to make other
          * module(like colo-compare) know how to parse net
          * packet correctly.
          */
-        ssize_t vnet_hdr_len;
+        hdr[1] = htonl(nf->netdev->vnet_hdr_len);
+        hdr_size += sizeof(hdr[1]);
+    }
 
-        vnet_hdr_len = nf->netdev->vnet_hdr_len;
+    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)hdr, hdr_size);
+    if (ret != hdr_size) {
+        goto err;
+    }
 
-        len = htonl(vnet_hdr_len);
-        ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)&len, sizeof(len));
-        if (ret != sizeof(len)) {
+    /* The caller waits for us, so the packet can be sent in place */
+    for (i = 0; i < iovcnt; i++) {
+        if (!iov[i].iov_len) {
+            continue;
+        }
+        ret = qemu_chr_fe_write_all(&s->chr_out, iov[i].iov_base,
+                                    iov[i].iov_len);
+        if (ret != iov[i].iov_len) {
             goto err;
         }
     }
 
-    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)buf, size);
-    if (ret != size) {
-        goto err;
-    }
-
     return size;
 
 err:
@@ -97,9 +101,8 @@ static void coroutine_fn filter_send_co(void *opaque)
 {
     FilterSendCo *data = opaque;
 
-    data->ret = _filter_send(data->s, data->buf, data->size);
+    data->ret = _filter_send(data->s, data->iov, data->iovcnt, data->size);
     data->done = true;
-    g_free(data->buf);
     aio_wait_kick();
 }
 
@@ -108,19 +111,16 @@ static int filter_send(MirrorState *s,
                        int iovcnt)
 {
     ssize_t size = iov_size(iov, iovcnt);
-    char *buf = NULL;
 
     if (!size) {
         return 0;
     }
 
-    buf = g_malloc(size);
-    iov_to_buf(iov, iovcnt, 0, buf, size);
-
     FilterSendCo data = {
         .s = s,
+        .iov = iov,
+        .iovcnt = iovcnt,
         .size = size,
-        .buf = buf,
         .ret = 0,
     };
 
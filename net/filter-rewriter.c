@@ -262,7 +262,7 @@ static ssize_t colo_rewriter_receive_iov(NetFilterState *nf,
     Packet *pkt;
     ssize_t size = iov_size(iov, iovcnt);
     ssize_t vnet_hdr_len = 0;
-    char *buf = g_malloc0(size);
+    char *buf = g_malloc(size);
 
     iov_to_buf(iov, iovcnt, 0, buf, size);
 
@@ -0,0 +1,363 @@
+/*
+ * Software receive coalescing for network backends without vnet headers
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Backends such as af-xdp, socket, stream or l2tpv3 hand over one wire
+ * frame at a time.  Consecutive in-order TCP segments of a flow are merged
+ * here into one frame of up to 64 KiB with a GSO header, so that a guest
+ * which negotiated TSO receives super-packets as it would from a tap
+ * backend with the kernel doing GRO.
+ *
+ * Like the kernel, merging stops at anything unusual: IP options or
+ * fragments, IPv6 extension headers, TCP flags other than ACK and PSH,
+ * changed TCP options, an out-of-order sequence number or a short segment.
+ * The checksum of every segment is verified before it is merged, and the
+ * merged frame is handed over with a partial checksum.
+ */
+
+#include "qemu/osdep.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+#include "net/gro.h"
+#include "trace.h"
+
+#define NET_GRO_MAX_FLOWS   4
+#define NET_GRO_MAX_FRAME   (sizeof(struct eth_header) + \
+                             sizeof(struct vlan_header) + \
+                             sizeof(struct ip6_header) + ETH_MAX_IP_DGRAM_LEN)
+
+#define NET_GRO_TCP_FLAGS_OFF   13
+#define NET_GRO_TCP_CSUM_OFF    16
+
+typedef struct NetGROPacket {
+    const uint8_t *buf;
+    size_t size;            /* without link layer padding */
+    size_t l3_off;
+    size_t l4_off;
+    size_t hdr_len;         /* up to the TCP payload */
+    size_t payload_len;
+    uint32_t seq;
+    uint8_t flags;
+    bool ipv6;
+} NetGROPacket;
+
+typedef struct NetGROFlow {
+    uint8_t *buf;
+    size_t len;
+    size_t l3_off;
+    size_t l4_off;
+    size_t hdr_len;
+    uint16_t mss;
+    uint32_t next_seq;
+    unsigned segs;
+    bool ipv6;
+    bool in_use;
+    /* a short segment or PSH ended the flow */
+    bool closed;
+} NetGROFlow;
+
+struct NetGRO {
+    NetGROFlush *flush;
+    void *opaque;
+    bool ipv4;
+    bool ipv6;
+    unsigned nflows;
+    unsigned next_victim;
+    NetGROFlow flows[NET_GRO_MAX_FLOWS];
+};
+
+NetGRO *net_gro_new(NetGROFlush *flush, void *opaque)
+{
+    NetGRO *gro = g_new0(NetGRO, 1);
+
+    gro->flush = flush;
+    gro->opaque = opaque;
+    return gro;
+}
+
+void net_gro_free(NetGRO *gro)
+{
+    if (!gro) {
+        return;
+    }
+    for (int i = 0; i < NET_GRO_MAX_FLOWS; i++) {
+        g_free(gro->flows[i].buf);
+    }
+    g_free(gro);
+}
+
+void net_gro_configure(NetGRO *gro, bool ipv4, bool ipv6)
+{
+    for (int i = 0; i < NET_GRO_MAX_FLOWS; i++) {
+        gro->flows[i].in_use = false;
+    }
+    gro->nflows = 0;
+    gro->ipv4 = ipv4;
+    gro->ipv6 = ipv6;
+}
+
+bool net_gro_enabled(NetGRO *gro)
+{
+    return gro->ipv4 || gro->ipv6;
+}
+
+static bool net_gro_parse(NetGRO *gro, const uint8_t *buf, size_t size,
+                          NetGROPacket *p)
+{
+    size_t l2 = sizeof(struct eth_header);
+    size_t l4_len, doff;
+    uint16_t proto;
+    uint32_t sum;
+
+    if (size < l2) {
+        return false;
+    }
+    proto = lduw_be_p(&PKT_GET_ETH_HDR(buf)->h_proto);
+    if (proto == ETH_P_VLAN) {
+        l2 += sizeof(struct vlan_header);
+        if (size < l2) {
+            return false;
+        }
+        proto = lduw_be_p(&PKT_GET_VLAN_HDR(buf)->h_proto);
+    }
+    p->l3_off = l2;
+
+    if (proto == ETH_P_IP && gro->ipv4) {
+        const struct ip_header *ip = (const struct ip_header *)(buf + l2);
+        size_t ip_len;
+
+        if (size < l2 + sizeof(*ip) ||
+            ip->ip_ver_len != 0x45 || ip->ip_p != IP_PROTO_TCP ||
+            (lduw_be_p(&ip->ip_off) & (IP_OFFMASK | IP_MF)) ||
+            net_raw_checksum((uint8_t *)ip, sizeof(*ip))) {
+            return false;
+        }
+        ip_len = lduw_be_p(&ip->ip_len);
+        if (ip_len < sizeof(*ip) || l2 + ip_len > size) {
+            return false;
+        }
+        p->ipv6 = false;
+        p->l4_off = l2 + sizeof(*ip);
+        p->size = l2 + ip_len;
+        sum = net_checksum_add(2 * sizeof(ip->ip_src), (uint8_t *)&ip->ip_src);
+    } else if (proto == ETH_P_IPV6 && gro->ipv6) {
+        const struct ip6_header *ip6 = (const struct ip6_header *)(buf + l2);
+
+        if (size < l2 + sizeof(*ip6) ||
+            (buf[l2] >> 4) != 6 || ip6->ip6_nxt != IP_PROTO_TCP) {
+            return false;
+        }
+        p->ipv6 = true;
+        p->l4_off = l2 + sizeof(*ip6);
+        p->size = p->l4_off + lduw_be_p(&ip6->ip6_plen);
+        if (p->size > size) {
+            return false;
+        }
+        sum = net_checksum_add(2 * sizeof(ip6->ip6_src),
+                               (uint8_t *)&ip6->ip6_src);
+    } else {
+        return false;
+    }
+
+    l4_len = p->size - p->l4_off;
+    if (l4_len < sizeof(tcp_header)) {
+        return false;
+    }
+    doff = (buf[p->l4_off + 12] >> 4) << 2;
+    p->flags = buf[p->l4_off + NET_GRO_TCP_FLAGS_OFF];
+    if (doff < sizeof(tcp_header) || doff >= l4_len ||
+        !(p->flags & TH_ACK) || (p->flags & ~(TH_ACK | TH_PUSH))) {
+        return false;
+    }
+
+    sum += IP_PROTO_TCP + l4_len;
+    sum += net_checksum_add(l4_len, (uint8_t *)buf + p->l4_off);
+    if (net_checksum_finish(sum)) {
+        return false;
+    }
+
+    p->buf = buf;
+    p->hdr_len = p->l4_off + doff;
+    p->payload_len = p->size - p->hdr_len;
+    p->seq = ldl_be_p(buf + p->l4_off + 4);
+    return true;
+}
+
+/* Addresses and ports */
+static bool net_gro_same_flow(NetGROFlow *f, NetGROPacket *p)
+{
+    size_t l3 = p->l3_off;
+    size_t addr_off = p->ipv6 ? offsetof(struct ip6_header, ip6_src)
+                              : offsetof(struct ip_header, ip_src);
+    size_t addr_len = p->ipv6 ? 2 * sizeof(struct in6_address)
+                              : 2 * sizeof(uint32_t);
+
+    return f->ipv6 == p->ipv6 && f->l3_off == l3 &&
+           !memcmp(f->buf + l3 + addr_off, p->buf + l3 + addr_off,
+                   addr_len) &&
+           !memcmp(f->buf + f->l4_off, p->buf + p->l4_off, 4);
+}
+
+/* Everything else that must not change within a super-packet */
+static bool net_gro_can_merge(NetGROFlow *f, NetGROPacket *p)
+{
+    const uint8_t *fl3 = f->buf + f->l3_off, *pl3 = p->buf + p->l3_off;
+    const uint8_t *fl4 = f->buf + f->l4_off, *pl4 = p->buf + p->l4_off;
+    size_t ip_len = f->len - (p->ipv6 ? f->l4_off : f->l3_off);
+
+    if (f->closed || f->hdr_len != p->hdr_len || p->seq != f->next_seq ||
+        p->payload_len > f->mss ||
+        ip_len + p->payload_len > ETH_MAX_IP_DGRAM_LEN) {
+        return false;
+    }
+    /* Link layer header, including the VLAN tag */
+    if (memcmp(f->buf, p->buf, p->l3_off)) {
+        return false;
+    }
+    if (p->ipv6) {
+        /* traffic class, flow label and hop limit */
+        if (memcmp(fl3, pl3, 4) || fl3[7] != pl3[7]) {
+            return false;
+        }
+    } else {
+        /* TOS, DF and TTL */
+        if (fl3[1] != pl3[1] || fl3[6] != pl3[6] || fl3[8] != pl3[8]) {
+            return false;
+        }
+    }
+    /* ack, data offset, window and options */
+    return !memcmp(fl4 + 8, pl4 + 8, 5) && !memcmp(fl4 + 14, pl4 + 14, 2) &&
+           !memcmp(fl4 + sizeof(tcp_header), pl4 + sizeof(tcp_header),
+                   p->hdr_len - p->l4_off - sizeof(tcp_header));
+}
+
+static bool net_gro_flush_flow(NetGRO *gro, NetGROFlow *f)
+{
+    struct virtio_net_hdr hdr = {
+        .flags = VIRTIO_NET_HDR_F_DATA_VALID,
+        .gso_type = VIRTIO_NET_HDR_GSO_NONE,
+    };
+
+    if (f->segs > 1) {
+        uint8_t *l3 = f->buf + f->l3_off;
+        size_t l4_len = f->len - f->l4_off;
+        uint32_t sum;
+
+        if (f->ipv6) {
+            stw_be_p(l3 + offsetof(struct ip6_header, ip6_plen), l4_len);
+            sum = net_checksum_add(2 * sizeof(struct in6_address),
+                                   l3 + offsetof(struct ip6_header, ip6_src));
+        } else {
+            stw_be_p(l3 + offsetof(struct ip_header, ip_len),
+                     f->len - f->l3_off);
+            eth_fix_ip4_checksum(l3, f->l4_off - f->l3_off);
+            sum = net_checksum_add(2 * sizeof(uint32_t),
+                                   l3 + offsetof(struct ip_header, ip_src));
+        }
+
+        /* Leave the pseudo header sum for the guest to complete */
+        sum += IP_PROTO_TCP + l4_len;
+        stw_be_p(f->buf + f->l4_off + NET_GRO_TCP_CSUM_OFF,
+                 (uint16_t)~net_checksum_finish(sum));
+
+        hdr.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr.gso_type = f->ipv6 ? VIRTIO_NET_HDR_GSO_TCPV6
+                               : VIRTIO_NET_HDR_GSO_TCPV4;
+        hdr.gso_size = f->mss;
+        hdr.hdr_len = f->hdr_len;
+        hdr.csum_start = f->l4_off;
+        hdr.csum_offset = NET_GRO_TCP_CSUM_OFF;
+    }
+
+    if (!gro->flush(gro->opaque, &hdr, f->buf, f->len)) {
+        return false;
+    }
+    trace_net_gro_flush(gro, f->segs, f->len);
+    f->in_use = false;
+    gro->nflows--;
+    return true;
+}
+
+static void net_gro_start_flow(NetGRO *gro, NetGROFlow *f, NetGROPacket *p)
+{
+    if (!f->buf) {
+        f->buf = g_malloc(NET_GRO_MAX_FRAME);
+    }
+    memcpy(f->buf, p->buf, p->size);
+    f->len = p->size;
+    f->l3_off = p->l3_off;
+    f->l4_off = p->l4_off;
+    f->hdr_len = p->hdr_len;
+    f->ipv6 = p->ipv6;
+    f->mss = p->payload_len;
+    f->next_seq = p->seq + p->payload_len;
+    f->segs = 1;
+    f->closed = p->flags & TH_PUSH;
+    f->in_use = true;
+    gro->nflows++;
+}
+
+bool net_gro_receive(NetGRO *gro, const uint8_t *buf, size_t size)
+{
+    NetGROPacket p;
+    NetGROFlow *f, *free_flow = NULL;
+    int i;
+
+    if (!net_gro_parse(gro, buf, size, &p)) {
+        return false;
+    }
+
+    for (i = 0; i < NET_GRO_MAX_FLOWS; i++) {
+        f = &gro->flows[i];
+        if (!f->in_use) {
+            free_flow = free_flow ?: f;
+        } else if (net_gro_same_flow(f, &p)) {
+            break;
+        }
+    }
+
+    if (i == NET_GRO_MAX_FLOWS) {
+        if (!free_flow) {
+            f = &gro->flows[gro->next_victim];
+            gro->next_victim = (gro->next_victim + 1) % NET_GRO_MAX_FLOWS;
+            if (!net_gro_flush_flow(gro, f)) {
+                return false;
+            }
+            free_flow = f;
+        }
+        net_gro_start_flow(gro, free_flow, &p);
+        return true;
+    }
+
+    if (!net_gro_can_merge(f, &p)) {
+        if (!net_gro_flush_flow(gro, f)) {
+            return false;
+        }
+        net_gro_start_flow(gro, f, &p);
+        return true;
+    }
+
+    memcpy(f->buf + f->len, buf + p.hdr_len, p.payload_len);
+    f->len += p.payload_len;
+    f->next_seq += p.payload_len;
+    f->segs++;
+    f->buf[f->l4_off + NET_GRO_TCP_FLAGS_OFF] |= p.flags;
+    if (p.payload_len < f->mss || (p.flags & TH_PUSH)) {
+        f->closed = true;
+        net_gro_flush_flow(gro, f);
+    }
+    return true;
+}
+
+bool net_gro_flush(NetGRO *gro)
+{
+    bool ret = true;
+
+    for (int i = 0; gro->nflows && i < NET_GRO_MAX_FLOWS; i++) {
+        if (gro->flows[i].in_use) {
+            ret &= net_gro_flush_flow(gro, &gro->flows[i]);
+        }
+    }
+    return ret;
+}
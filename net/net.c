@@ -676,6 +676,30 @@ static ssize_t filter_receive(NetClientState *nc,
     return filter_receive_iov(nc, direction, sender, flags, &iov, 1, sent_cb);
 }
 
+/*
+ * Packets that @sender sends until qemu_net_batch_end() form one batch.
+ * The peer may defer per-packet completion work, such as publishing used
+ * buffers and notifying its guest, to the end of the batch.  Packets that
+ * are queued or held by filters are delivered outside the batch as usual.
+ */
+void qemu_net_batch_begin(NetClientState *sender)
+{
+    if (sender->peer && sender->peer->info->receive_batch_end) {
+        sender->peer->receiving_batch = true;
+    }
+}
+
+void qemu_net_batch_end(NetClientState *sender)
+{
+    NetClientState *peer = sender->peer;
+
+    /* The peer may still deliver packets it held back as part of the batch */
+    if (peer && peer->receiving_batch) {
+        peer->info->receive_batch_end(peer);
+        peer->receiving_batch = false;
+    }
+}
+
 void qemu_purge_queued_packets(NetClientState *nc)
 {
     if (!nc->peer) {
@@ -49,6 +49,7 @@ typedef struct NetmapState {
     bool                write_poll;
     struct iovec        iov[IOV_MAX];
     int                 vnet_hdr_len;  /* Current virtio-net header length. */
+    AioContext          *ctx;
 } NetmapState;
 
 #ifndef __FreeBSD__
@@ -103,13 +104,33 @@ static struct nm_desc *netmap_open(const NetdevNetmapOptions *nm_opts,
 static void netmap_send(void *opaque);
 static void netmap_writable(void *opaque);
 
+static void netmap_set_fd_handler(NetmapState *s, IOHandler *fd_read,
+                                  IOHandler *fd_write)
+{
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->nmd->fd, fd_read, fd_write,
+                           NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->nmd->fd, fd_read, fd_write, s);
+    }
+}
+
 /* Set the event-loop handlers for the netmap backend. */
 static void netmap_update_fd_handler(NetmapState *s)
 {
-    qemu_set_fd_handler(s->nmd->fd,
-                        s->read_poll ? netmap_send : NULL,
-                        s->write_poll ? netmap_writable : NULL,
-                        s);
+    netmap_set_fd_handler(s,
+                          s->read_poll ? netmap_send : NULL,
+                          s->write_poll ? netmap_writable : NULL);
+}
+
+/* Move the event-loop handlers to another AioContext. */
+static void netmap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    NetmapState *s = DO_UPCAST(NetmapState, nc, nc);
+
+    netmap_set_fd_handler(s, NULL, NULL);
+    s->ctx = ctx;
+    netmap_update_fd_handler(s);
 }
 
 /* Update the read handler. */
@@ -251,6 +272,8 @@ static void netmap_send(void *opaque)
     struct netmap_ring *ring = s->rx;
     unsigned int tail = ring->tail;
 
+    qemu_net_batch_begin(&s->nc);
+
     /* Keep sending while there are available slots in the netmap
        RX ring and the forwarding path towards the peer is open. */
     while (ring->head != tail) {
@@ -293,6 +316,8 @@ static void netmap_send(void *opaque)
             break;
         }
     }
+
+    qemu_net_batch_end(&s->nc);
 }
 
 /* Flush and close. */
@@ -396,6 +421,7 @@ static NetClientInfo net_netmap_info = {
     .using_vnet_hdr = netmap_using_vnet_hdr,
     .set_offload = netmap_set_offload,
     .set_vnet_hdr_len = netmap_set_vnet_hdr_len,
+    .set_aio_context = netmap_set_aio_context,
 };
 
 /* The exported init function
@@ -84,6 +84,7 @@ struct GuestFwd {
     struct in_addr server;
     int port;
     Slirp *slirp;
+    NetClientState *nc;
 };
 
 typedef struct SlirpState {
@@ -134,7 +135,10 @@ static ssize_t net_slirp_receive(NetClientState *nc, const uint8_t *buf, size_t
 {
     SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
 
+    /* An ACK from the guest can release several queued segments */
+    qemu_net_batch_begin(&s->nc);
     slirp_input(s->slirp, buf, size);
+    qemu_net_batch_end(&s->nc);
 
     return size;
 }
@@ -188,10 +192,13 @@ static int64_t net_slirp_clock_get_ns(void *opaque)
 typedef struct SlirpTimer SlirpTimer;
 struct SlirpTimer {
     QEMUTimer timer;
+    SlirpState *s;
+    void *cb_opaque;
 #if SLIRP_CHECK_VERSION(4,7,0)
     Slirp *slirp;
     SlirpTimerId id;
-    void *cb_opaque;
+#else
+    SlirpTimerCb cb;
 #endif
 };
 
@@ -205,7 +212,11 @@ static void net_slirp_init_completed(Slirp *slirp, void *opaque)
 static void net_slirp_timer_cb(void *opaque)
 {
     SlirpTimer *t = opaque;
+
+    /* Retransmissions and delayed ACKs of all connections form one batch */
+    qemu_net_batch_begin(&t->s->nc);
     slirp_handle_timer(t->slirp, t->id, t->cb_opaque);
+    qemu_net_batch_end(&t->s->nc);
 }
 
 static void *net_slirp_timer_new_opaque(SlirpTimerId id,
@@ -213,6 +224,7 @@ static void *net_slirp_timer_new_opaque(SlirpTimerId id,
 {
     SlirpState *s = opaque;
     SlirpTimer *t = g_new(SlirpTimer, 1);
+    t->s = s;
     t->slirp = s->slirp;
     t->id = id;
     t->cb_opaque = cb_opaque;
@@ -222,13 +234,25 @@ static void *net_slirp_timer_new_opaque(SlirpTimerId id,
     return t;
 }
 #else
+static void net_slirp_timer_cb(void *opaque)
+{
+    SlirpTimer *t = opaque;
+
+    qemu_net_batch_begin(&t->s->nc);
+    t->cb(t->cb_opaque);
+    qemu_net_batch_end(&t->s->nc);
+}
+
 static void *net_slirp_timer_new(SlirpTimerCb cb,
                                  void *cb_opaque, void *opaque)
 {
     SlirpTimer *t = g_new(SlirpTimer, 1);
+    t->s = opaque;
+    t->cb = cb;
+    t->cb_opaque = cb_opaque;
     timer_init_full(&t->timer, NULL, QEMU_CLOCK_VIRTUAL,
                     SCALE_MS, QEMU_TIMER_ATTR_EXTERNAL,
-                    cb, cb_opaque);
+                    net_slirp_timer_cb, t);
     return t;
 }
 #endif
@@ -368,8 +392,11 @@ static void net_slirp_poll_notify(Notifier *notifier, void *data)
         break;
     case MAIN_LOOP_POLL_OK:
     case MAIN_LOOP_POLL_ERR:
+        /* Frames for all sockets that became ready go to the guest at once */
+        qemu_net_batch_begin(&s->nc);
         slirp_pollfds_poll(s->slirp, poll->state == MAIN_LOOP_POLL_ERR,
                            net_slirp_get_revents, poll->pollfds);
+        qemu_net_batch_end(&s->nc);
         break;
     default:
         g_assert_not_reached();
@@ -995,7 +1022,10 @@ static int guestfwd_can_read(void *opaque)
 static void guestfwd_read(void *opaque, const uint8_t *buf, int size)
 {
     struct GuestFwd *fwd = opaque;
+
+    qemu_net_batch_begin(fwd->nc);
     slirp_socket_recv(fwd->slirp, fwd->server, fwd->port, buf, size);
+    qemu_net_batch_end(fwd->nc);
 }
 
 static ssize_t guestfwd_write(const void *buf, size_t len, void *chr)
@@ -1076,6 +1106,7 @@ static int slirp_guestfwd(SlirpState *s, const char *config_str, Error **errp)
         fwd->server = server;
         fwd->port = port;
         fwd->slirp = s->slirp;
+        fwd->nc = &s->nc;
 
         qemu_chr_fe_set_handlers(&fwd->hd, guestfwd_can_read, guestfwd_read,
                                  NULL, NULL, fwd, NULL, true);
@@ -62,6 +62,7 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+    AioContext *ctx;
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -70,12 +71,21 @@ static void launch_script(const char *setup_script, const char *ifname,
 static void tap_send(void *opaque);
 static void tap_writable(void *opaque);
 
+static void tap_set_fd_handler(TAPState *s, IOHandler *fd_read,
+                               IOHandler *fd_write)
+{
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, fd_read, fd_write, NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
+}
+
 static void tap_update_fd_handler(TAPState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll && s->enabled ? tap_send : NULL,
-                        s->write_poll && s->enabled ? tap_writable : NULL,
-                        s);
+    tap_set_fd_handler(s,
+                       s->read_poll && s->enabled ? tap_send : NULL,
+                       s->write_poll && s->enabled ? tap_writable : NULL);
 }
 
 static void tap_read_poll(TAPState *s, bool enable)
@@ -187,6 +197,7 @@ static void tap_send(void *opaque)
     int size;
     int packets = 0;
 
+    qemu_net_batch_begin(&s->nc);
     while (true) {
         uint8_t *buf = s->buf;
         uint8_t min_pkt[ETH_ZLEN];
@@ -228,6 +239,7 @@ static void tap_send(void *opaque)
             break;
         }
     }
+    qemu_net_batch_end(&s->nc);
 }
 
 static bool tap_has_ufo(NetClientState *nc)
@@ -362,6 +374,15 @@ static void tap_cleanup(NetClientState *nc)
     s->fd = -1;
 }
 
+static void tap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    TAPState *s = DO_UPCAST(TAPState, nc, nc);
+
+    tap_set_fd_handler(s, NULL, NULL);
+    s->ctx = ctx;
+    tap_update_fd_handler(s);
+}
+
 static void tap_poll(NetClientState *nc, bool enable)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
@@ -406,6 +427,7 @@ static NetClientInfo net_tap_info = {
     .set_vnet_le = tap_set_vnet_le,
     .set_vnet_be = tap_set_vnet_be,
     .set_steering_ebpf = tap_set_steering_ebpf,
+    .set_aio_context = tap_set_aio_context,
 };
 
 static TAPState *net_tap_fd_init(NetClientState *peer,
@@ -302,6 +302,7 @@ static void net_vhost_user_event(void *opaque, QEMUChrEvent event)
         s->started = true;
         break;
     case CHR_EVENT_CLOSED:
+        vhost_user_note_disconnect(s->vhost_user);
         /* a close event may happen during a read/write, but vhost
          * code assumes the vhost_dev remains setup, so delay the
          * stop & clear to idle.
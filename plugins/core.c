@@ -208,11 +208,53 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+/*
+ * Make room for @cpu in all scoreboards.  Translated code has the address
+ * of the scoreboards built in, so resizing them must wait for all vCPUs
+ * to be out of translated code, and then flush it.  Growing only happens
+ * in user mode, where threads are created outside of translated code;
+ * system mode sizes scoreboards for the maximum number of vCPUs.
+ */
+static void plugin_grow_scoreboards__locked(CPUState *cpu)
+{
+    size_t scoreboard_size = plugin.scoreboard_alloc_size;
+    struct qemu_plugin_scoreboard *score;
+
+    if (cpu->cpu_index < scoreboard_size) {
+        return;
+    }
+    while (cpu->cpu_index >= scoreboard_size) {
+        scoreboard_size *= 2;
+    }
+
+    if (QLIST_EMPTY(&plugin.scoreboards)) {
+        plugin.scoreboard_alloc_size = scoreboard_size;
+        return;
+    }
+
+    /* vCPUs might take the lock in callbacks, drop it while they stop */
+    qemu_rec_mutex_unlock(&plugin.lock);
+    start_exclusive();
+    qemu_rec_mutex_lock(&plugin.lock);
+
+    /* another vCPU might have grown scoreboards in the meantime */
+    if (scoreboard_size > plugin.scoreboard_alloc_size) {
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            g_array_set_size(score->data, scoreboard_size);
+        }
+        plugin.scoreboard_alloc_size = scoreboard_size;
+        tb_flush(cpu);
+    }
+    end_exclusive();
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
 
     qemu_rec_mutex_lock(&plugin.lock);
+    plugin_grow_scoreboards__locked(cpu);
+    plugin.num_vcpus = MAX(plugin.num_vcpus, cpu->cpu_index + 1);
     plugin_cpu_update__locked(&cpu->cpu_index, NULL, NULL);
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
                                   &cpu->cpu_index);
@@ -222,10 +264,26 @@ void qemu_plugin_vcpu_init_hook(CPUState *cpu)
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_INIT);
 }
 
+static void plugin_mem_buffers_flush(CPUState *cpu)
+{
+    struct qemu_plugin_mem_buffer *buf;
+
+    if (QLIST_EMPTY(&plugin.mem_buffers)) {
+        return;
+    }
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_FOREACH(buf, &plugin.mem_buffers, entry) {
+        plugin_mem_buffer_flush(buf, cpu->cpu_index);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
+
 void qemu_plugin_vcpu_exit_hook(CPUState *cpu)
 {
     bool success;
 
+    plugin_mem_buffers_flush(cpu);
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_EXIT);
 
     qemu_rec_mutex_lock(&plugin.lock);
@@ -289,6 +347,47 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->type = PLUGIN_CB_INLINE;
     dyn_cb->rw = rw;
     dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.cond = QEMU_PLUGIN_COND_ALWAYS;
+    dyn_cb->inline_insn.entry = (qemu_plugin_u64) { NULL, 0 };
+    dyn_cb->inline_insn.imm = imm;
+}
+
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = NULL;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->rw = rw;
+    dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.cond = QEMU_PLUGIN_COND_ALWAYS;
+    dyn_cb->inline_insn.entry = entry;
+    dyn_cb->inline_insn.imm = imm;
+}
+
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        enum qemu_plugin_cond cond,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm,
+                                        void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    assert(cond != QEMU_PLUGIN_COND_NEVER && cond != QEMU_PLUGIN_COND_ALWAYS);
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = udata;
+    /* Note flags are discarded as unused. */
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->inline_insn.cond = cond;
+    dyn_cb->inline_insn.entry = entry;
     dyn_cb->inline_insn.imm = imm;
 }
 
@@ -390,6 +489,7 @@ void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret)
 
 void qemu_plugin_vcpu_idle_cb(CPUState *cpu)
 {
+    plugin_mem_buffers_flush(cpu);
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_IDLE);
 }
 
@@ -430,14 +530,18 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index)
 {
-    uint64_t *val = cb->userp;
+    size_t stride;
+    uint64_t *val = plugin_inline_op_base(cb, &stride) + cpu_index * stride;
 
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
         *val += cb->inline_insn.imm;
         break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        *val = cb->inline_insn.imm;
+        break;
     default:
         g_assert_not_reached();
     }
@@ -465,7 +569,7 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
             break;
         default:
             g_assert_not_reached();
@@ -568,5 +672,196 @@ static void __attribute__((__constructor__)) plugin_init(void)
     QTAILQ_INIT(&plugin.ctxs);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
+    QLIST_INIT(&plugin.scoreboards);
+    QLIST_INIT(&plugin.mem_buffers);
+    /* avoid resizing, and flushing translated code, for the first vCPUs */
+    plugin.scoreboard_alloc_size = 16;
     atexit(qemu_plugin_atexit_cb);
 }
+
+int plugin_num_vcpus(void)
+{
+    int num_vcpus;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    num_vcpus = plugin.num_vcpus;
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return num_vcpus;
+}
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score =
+        g_new0(struct qemu_plugin_scoreboard, 1);
+    int max_vcpus = qemu_plugin_n_max_vcpus();
+
+    score->data = g_array_new(false, true, element_size);
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    /* only user mode, which has no maximum, may need to grow scoreboards */
+    while (max_vcpus > plugin.scoreboard_alloc_size) {
+        plugin.scoreboard_alloc_size *= 2;
+    }
+    g_array_set_size(score->data, plugin.scoreboard_alloc_size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    g_array_free(score->data, true);
+    g_free(score);
+}
+
+struct qemu_plugin_mem_buffer *
+plugin_mem_buffer_new(size_t n_records, qemu_plugin_mem_buffer_cb_t cb,
+                      void *userdata)
+{
+    struct qemu_plugin_mem_buffer *buf;
+
+    if (!is_power_of_2(n_records) || n_records > 16384) {
+        return NULL;
+    }
+
+    buf = g_new0(struct qemu_plugin_mem_buffer, 1);
+    buf->score = plugin_scoreboard_new(sizeof(PluginMemBuffer) +
+                                       n_records *
+                                       sizeof(struct qemu_plugin_mem_record));
+    buf->n_records = n_records;
+    buf->cb = cb;
+    buf->userdata = userdata;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_INSERT_HEAD(&plugin.mem_buffers, buf, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return buf;
+}
+
+void plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(buf, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    plugin_scoreboard_free(buf->score);
+    g_free(buf);
+}
+
+static PluginMemBuffer *
+plugin_mem_buffer_vcpu(struct qemu_plugin_mem_buffer *buf,
+                       unsigned int vcpu_index)
+{
+    GArray *data = buf->score->data;
+
+    return (PluginMemBuffer *)(data->data + vcpu_index *
+                               g_array_get_element_size(data));
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                             unsigned int vcpu_index)
+{
+    PluginMemBuffer *mb = plugin_mem_buffer_vcpu(buf, vcpu_index);
+    /* more records than fit were lost, see plugin_register_vcpu_mem_buffered */
+    size_t n = MIN(mb->pos, buf->n_records);
+
+    if (n) {
+        buf->cb(vcpu_index, mb->records, n, buf->userdata);
+    }
+    mb->pos = 0;
+}
+
+static void plugin_mem_buffer_flush_cb(unsigned int vcpu_index, void *udata)
+{
+    plugin_mem_buffer_flush(udata, vcpu_index);
+}
+
+void plugin_mem_buffer_record(unsigned int vcpu_index,
+                              qemu_plugin_meminfo_t info, uint64_t vaddr,
+                              void *userdata)
+{
+    struct qemu_plugin_mem_buffer *buf = userdata;
+    PluginMemBuffer *mb = plugin_mem_buffer_vcpu(buf, vcpu_index);
+
+    /*
+     * Helpers run in the middle of a TB, keep room for the accesses
+     * that translated code might still do before the next TB starts.
+     */
+    if (mb->pos + 1 + qatomic_read(&buf->max_tb_records) > buf->n_records) {
+        plugin_mem_buffer_flush(buf, vcpu_index);
+    }
+    mb->records[mb->pos & (buf->n_records - 1)] =
+        (struct qemu_plugin_mem_record) { .vaddr = vaddr, .info = info };
+    mb->pos++;
+}
+
+/*
+ * Translated code records accesses without checking for room, and wraps
+ * around when the buffer is full.  Every TB that records accesses in @buf
+ * therefore starts with a flush of @buf, if its accesses might not fit.
+ * This assumes that translated code goes through each access at most once
+ * per execution of the TB; otherwise, old records are overwritten.
+ */
+void plugin_register_vcpu_mem_buffered(struct qemu_plugin_tb *ptb,
+                                       struct qemu_plugin_insn *insn,
+                                       enum qemu_plugin_mem_rw rw,
+                                       struct qemu_plugin_mem_buffer *buf)
+{
+    GArray **tb_cbs = &ptb->cbs[PLUGIN_CB_INLINE];
+    struct qemu_plugin_dyn_cb *flush = NULL;
+    uint64_t reserved;
+    size_t i;
+
+    /* also called by helpers that access memory */
+    plugin_register_vcpu_mem_cb(&insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR],
+                                plugin_mem_buffer_record,
+                                QEMU_PLUGIN_CB_NO_REGS, rw, buf);
+    if (!insn->mem_accesses) {
+        return;
+    }
+
+    for (i = 0; *tb_cbs && i < (*tb_cbs)->len; i++) {
+        struct qemu_plugin_dyn_cb *cb =
+            &g_array_index(*tb_cbs, struct qemu_plugin_dyn_cb, i);
+
+        if (cb->f.vcpu_udata == plugin_mem_buffer_flush_cb &&
+            cb->userp == buf) {
+            flush = cb;
+            break;
+        }
+    }
+    if (!flush) {
+        plugin_register_dyn_cond_cb__udata(
+            tb_cbs, plugin_mem_buffer_flush_cb, QEMU_PLUGIN_CB_NO_REGS,
+            QEMU_PLUGIN_COND_GT,
+            qemu_plugin_scoreboard_u64_in_struct(buf->score, PluginMemBuffer,
+                                                 pos),
+            buf->n_records, buf);
+        flush = &g_array_index(*tb_cbs, struct qemu_plugin_dyn_cb,
+                               (*tb_cbs)->len - 1);
+    }
+
+    /* flush if pos > n_records - reserved */
+    reserved = buf->n_records - flush->inline_insn.imm + insn->mem_accesses;
+    reserved = MIN(reserved, buf->n_records);
+    flush->inline_insn.imm = buf->n_records - reserved;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    if (reserved > buf->max_tb_records) {
+        qatomic_set(&buf->max_tb_records, reserved);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
@@ -44,6 +44,15 @@ struct qemu_plugin_state {
      * the code cache is flushed.
      */
     struct qht dyn_cb_arr_ht;
+    /*
+     * Scoreboards have room for @scoreboard_alloc_size vCPUs; @num_vcpus
+     * is one more than the highest vCPU index seen so far.
+     */
+    QLIST_HEAD(, qemu_plugin_scoreboard) scoreboards;
+    size_t scoreboard_alloc_size;
+    int num_vcpus;
+    /* memory access buffers, flushed when a vCPU goes idle or exits */
+    QLIST_HEAD(, qemu_plugin_mem_buffer) mem_buffers;
 };
 
 
@@ -69,6 +78,20 @@ void plugin_register_inline_op(GArray **arr,
                                enum qemu_plugin_op op, void *ptr,
                                uint64_t imm);
 
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm);
+
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        enum qemu_plugin_cond cond,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm,
+                                        void *udata);
+
 void plugin_reset_uninstall(qemu_plugin_id_t id,
                             qemu_plugin_simple_cb_t cb,
                             bool reset);
@@ -95,6 +118,26 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb);
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index);
+
+int plugin_num_vcpus(void);
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+struct qemu_plugin_mem_buffer *
+plugin_mem_buffer_new(size_t n_records, qemu_plugin_mem_buffer_cb_t cb,
+                      void *userdata);
+
+void plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf);
+
+void plugin_register_vcpu_mem_buffered(struct qemu_plugin_tb *ptb,
+                                       struct qemu_plugin_insn *insn,
+                                       enum qemu_plugin_mem_rw rw,
+                                       struct qemu_plugin_mem_buffer *buf);
+
+void plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                             unsigned int vcpu_index);
 
 #endif /* PLUGIN_H */
@@ -24,6 +24,9 @@
 
 #include "qemu/osdep.h"
 #include <getopt.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 #include "qemu/help-texts.h"
 #include "qemu/qemu-progress.h"
@@ -44,6 +47,8 @@
 #include "qemu/sockets.h"
 #include "qemu/units.h"
 #include "qemu/memalign.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
 #include "qom/object_interfaces.h"
 #include "sysemu/block-backend.h"
 #include "block/block_int.h"
@@ -86,6 +91,10 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_IOTHREADS = 278,
+    OPTION_STATS = 279,
+    OPTION_RANDOM = 280,
+    OPTION_WRITE_PERCENT = 281,
 };
 
 typedef enum OutputFormat {
@@ -207,6 +216,10 @@ void help(void)
            "  '-m' specifies how many coroutines work in parallel during the convert\n"
            "       process (defaults to 8)\n"
            "  '-W' allow to write to the target out of order rather than sequential\n"
+           "  '--iothreads' spreads the coroutines over this many threads, each with\n"
+           "       its own event loop, instead of running them all in the main thread\n"
+           "  '--stats' prints the amount of data read and written and the\n"
+           "       throughput at the end of the conversion\n"
            "\n"
            "Parameters to snapshot subcommand:\n"
            "  'snapshot' is the name of the snapshot to create, apply or delete\n"
@@ -1155,10 +1168,10 @@ static int64_t find_nonzero(const uint8_t *buf, int64_t n)
     int64_t i;
     int64_t end = QEMU_ALIGN_DOWN(n, BDRV_SECTOR_SIZE);
 
-    for (i = 0; i < end; i += BDRV_SECTOR_SIZE) {
-        if (!buffer_is_zero(buf + i, BDRV_SECTOR_SIZE)) {
-            return i;
-        }
+    i = buffer_is_zero_span(buf, BDRV_SECTOR_SIZE, end / BDRV_SECTOR_SIZE,
+                            true) * BDRV_SECTOR_SIZE;
+    if (i < end) {
+        return i;
     }
     if (i < n && !buffer_is_zero(buf + i, n - end)) {
         return i;
@@ -1187,12 +1200,8 @@ static int is_allocated_sectors(const uint8_t *buf, int n, int *pnum,
         return 0;
     }
     is_zero = buffer_is_zero(buf, BDRV_SECTOR_SIZE);
-    for(i = 1; i < n; i++) {
-        buf += BDRV_SECTOR_SIZE;
-        if (is_zero != buffer_is_zero(buf, BDRV_SECTOR_SIZE)) {
-            break;
-        }
-    }
+    i = 1 + buffer_is_zero_span(buf + BDRV_SECTOR_SIZE, BDRV_SECTOR_SIZE,
+                                n - 1, is_zero);
 
     if (i == n) {
         /*
@@ -1694,11 +1703,15 @@ typedef struct ImgConvertState {
     size_t cluster_sectors;
     size_t buf_sectors;
     long num_coroutines;
+    long num_iothreads;
     int running_coroutines;
     Coroutine *co[MAX_COROUTINES];
-    int64_t wait_sector_num[MAX_COROUTINES];
     CoMutex lock;
+    CoQueue wr_queue;       /* coroutines waiting for their turn to write */
     int ret;
+    Stat64 bytes_read;
+    Stat64 bytes_written;
+    Stat64 bytes_zeroed;
 } ImgConvertState;
 
 static void convert_select_part(ImgConvertState *s, int64_t sector_num,
@@ -1848,7 +1861,9 @@ static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
         }
 
         ret = blk_co_pread(blk, offset, n << BDRV_SECTOR_BITS, buf, 0);
-        if (ret < 0) {
+        if (ret >= 0) {
+            stat64_add(&s->bytes_read, n << BDRV_SECTOR_BITS);
+        } else {
             if (s->salvage) {
                 if (n > 1) {
                     single_read_until = offset + (n << BDRV_SECTOR_BITS);
@@ -1911,6 +1926,7 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                 if (ret < 0) {
                     return ret;
                 }
+                stat64_add(&s->bytes_written, n << BDRV_SECTOR_BITS);
                 break;
             }
             /* fall-through */
@@ -1927,6 +1943,7 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
             if (ret < 0) {
                 return ret;
             }
+            stat64_add(&s->bytes_zeroed, n << BDRV_SECTOR_BITS);
             break;
         }
 
@@ -1962,6 +1979,8 @@ static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector
         if (ret < 0) {
             return ret;
         }
+        stat64_add(&s->bytes_read, n << BDRV_SECTOR_BITS);
+        stat64_add(&s->bytes_written, n << BDRV_SECTOR_BITS);
 
         sector_num += n;
         nb_sectors -= n;
@@ -1969,22 +1988,17 @@ static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector
     return 0;
 }
 
+/*
+ * With --iothreads, the copy coroutines are spread over several threads.
+ * Everything they share in ImgConvertState is either protected by s->lock,
+ * or only written once an error occurred.
+ */
 static void coroutine_fn convert_co_do_copy(void *opaque)
 {
     ImgConvertState *s = opaque;
     uint8_t *buf = NULL;
-    int ret, i;
-    int index = -1;
-
-    for (i = 0; i < s->num_coroutines; i++) {
-        if (s->co[i] == qemu_coroutine_self()) {
-            index = i;
-            break;
-        }
-    }
-    assert(index >= 0);
+    int ret;
 
-    s->running_coroutines++;
     buf = blk_blockalign(s->target, s->buf_sectors * BDRV_SECTOR_SIZE);
 
     while (1) {
@@ -2015,16 +2029,16 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
         /* increment global sector counter so that other coroutines can
          * already continue reading beyond this request */
         s->sector_num += n;
-        qemu_co_mutex_unlock(&s->lock);
 
         if (status == BLK_DATA || (!s->min_sparse && status == BLK_ZERO)) {
             s->allocated_done += n;
             qemu_progress_print(100.0 * s->allocated_done /
                                         s->allocated_sectors, 0);
         }
+        qemu_co_mutex_unlock(&s->lock);
 
 retry:
-        copy_range = s->copy_range && s->status == BLK_DATA;
+        copy_range = s->copy_range && status == BLK_DATA;
         if (status == BLK_DATA && !copy_range) {
             ret = convert_co_read(s, sector_num, n, buf);
             if (ret < 0) {
@@ -2039,11 +2053,11 @@ retry:
 
         if (s->wr_in_order) {
             /* keep writes in order */
+            qemu_co_mutex_lock(&s->lock);
             while (s->wr_offs != sector_num && s->ret == -EINPROGRESS) {
-                s->wait_sector_num[index] = sector_num;
-                qemu_coroutine_yield();
+                qemu_co_queue_wait(&s->wr_queue, &s->lock);
             }
-            s->wait_sector_num[index] = -1;
+            qemu_co_mutex_unlock(&s->lock);
         }
 
         if (s->ret == -EINPROGRESS) {
@@ -2066,34 +2080,96 @@ retry:
         }
 
         if (s->wr_in_order) {
-            /* reenter the coroutine that might have waited
-             * for this write to complete */
+            /* wake up the coroutine that waits for this write to complete */
+            qemu_co_mutex_lock(&s->lock);
             s->wr_offs = sector_num + n;
-            for (i = 0; i < s->num_coroutines; i++) {
-                if (s->co[i] && s->wait_sector_num[i] == s->wr_offs) {
-                    /*
-                     * A -> B -> A cannot occur because A has
-                     * s->wait_sector_num[i] == -1 during A -> B.  Therefore
-                     * B will never enter A during this time window.
-                     */
-                    qemu_coroutine_enter(s->co[i]);
-                    break;
-                }
-            }
+            qemu_co_queue_restart_all(&s->wr_queue);
+            qemu_co_mutex_unlock(&s->lock);
         }
     }
 
     qemu_vfree(buf);
-    s->co[index] = NULL;
-    s->running_coroutines--;
-    if (!s->running_coroutines && s->ret == -EINPROGRESS) {
-        /* the convert job finished successfully */
-        s->ret = 0;
+    if (qatomic_fetch_dec(&s->running_coroutines) == 1) {
+        if (s->ret == -EINPROGRESS) {
+            /* the convert job finished successfully */
+            s->ret = 0;
+        }
+        aio_wait_kick();
+    }
+}
+
+typedef struct ImgIOThread {
+    QemuThread thread;
+    AioContext *ctx;
+    bool stopping;
+} ImgIOThread;
+
+static void *img_iothread_run(void *opaque)
+{
+    ImgIOThread *t = opaque;
+
+    rcu_register_thread();
+    qemu_set_current_aio_context(t->ctx);
+    while (!qatomic_read(&t->stopping)) {
+        aio_poll(t->ctx, true);
+    }
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void img_iothread_stop_bh(void *opaque)
+{
+    ImgIOThread *t = opaque;
+
+    qatomic_set(&t->stopping, true);
+}
+
+static ImgIOThread *img_iothreads_start(int num)
+{
+    ImgIOThread *threads = g_new0(ImgIOThread, num);
+    int i;
+
+    for (i = 0; i < num; i++) {
+        threads[i].ctx = aio_context_new(&error_abort);
+        qemu_thread_create(&threads[i].thread, "qemu-img-worker",
+                           img_iothread_run, &threads[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+    return threads;
+}
+
+static void img_iothreads_stop(ImgIOThread *threads, int num)
+{
+    int i;
+
+    for (i = 0; i < num; i++) {
+        aio_bh_schedule_oneshot(threads[i].ctx, img_iothread_stop_bh,
+                                &threads[i]);
+        qemu_thread_join(&threads[i].thread);
+        aio_context_unref(threads[i].ctx);
     }
+    g_free(threads);
+}
+
+static void convert_print_stats(ImgConvertState *s, int64_t elapsed_ns)
+{
+    uint64_t rd = stat64_get(&s->bytes_read);
+    uint64_t wr = stat64_get(&s->bytes_written);
+    double secs = MAX(elapsed_ns, 1) / (double)NANOSECONDS_PER_SECOND;
+    g_autofree char *rd_str = size_to_str(rd);
+    g_autofree char *wr_str = size_to_str(wr);
+    g_autofree char *zero_str = size_to_str(stat64_get(&s->bytes_zeroed));
+
+    printf("Converted in %.3f seconds\n"
+           "  read:    %s (%.1f MiB/s)\n"
+           "  written: %s (%.1f MiB/s)\n"
+           "  zeroed:  %s\n",
+           secs, rd_str, rd / secs / MiB, wr_str, wr / secs / MiB, zero_str);
 }
 
 static int convert_do_copy(ImgConvertState *s)
 {
+    ImgIOThread *iothreads = NULL;
     int ret, i, n;
     int64_t sector_num = 0;
 
@@ -2134,14 +2210,24 @@ static int convert_do_copy(ImgConvertState *s)
     s->ret = -EINPROGRESS;
 
     qemu_co_mutex_init(&s->lock);
+    qemu_co_queue_init(&s->wr_queue);
+    s->running_coroutines = s->num_coroutines;
+    if (s->num_iothreads) {
+        iothreads = img_iothreads_start(s->num_iothreads);
+    }
     for (i = 0; i < s->num_coroutines; i++) {
         s->co[i] = qemu_coroutine_create(convert_co_do_copy, s);
-        s->wait_sector_num[i] = -1;
-        qemu_coroutine_enter(s->co[i]);
+        if (iothreads) {
+            aio_co_enter(iothreads[i % s->num_iothreads].ctx, s->co[i]);
+        } else {
+            qemu_coroutine_enter(s->co[i]);
+        }
     }
 
-    while (s->running_coroutines) {
-        main_loop_wait(false);
+    AIO_WAIT_WHILE_UNLOCKED(NULL, qatomic_read(&s->running_coroutines) > 0);
+
+    if (iothreads) {
+        img_iothreads_stop(iothreads, s->num_iothreads);
     }
 
     if (s->compressed && !s->ret) {
@@ -2253,6 +2339,8 @@ static int img_convert(int argc, char **argv)
     bool explict_min_sparse = false;
     bool bitmaps = false;
     bool skip_broken = false;
+    bool stats = false;
+    int64_t start_ns;
     int64_t rate_limit = 0;
 
     ImgConvertState s = (ImgConvertState) {
@@ -2275,6 +2363,8 @@ static int img_convert(int argc, char **argv)
             {"target-is-zero", no_argument, 0, OPTION_TARGET_IS_ZERO},
             {"bitmaps", no_argument, 0, OPTION_BITMAPS},
             {"skip-broken-bitmaps", no_argument, 0, OPTION_SKIP_BROKEN},
+            {"iothreads", required_argument, 0, OPTION_IOTHREADS},
+            {"stats", no_argument, 0, OPTION_STATS},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:O:B:CcF:o:l:S:pt:T:qnm:WUr:",
@@ -2409,6 +2499,17 @@ static int img_convert(int argc, char **argv)
         case OPTION_SKIP_BROKEN:
             skip_broken = true;
             break;
+        case OPTION_IOTHREADS:
+            if (qemu_strtol(optarg, NULL, 0, &s.num_iothreads) ||
+                s.num_iothreads < 1 || s.num_iothreads > MAX_COROUTINES) {
+                error_report("Invalid number of iothreads. Allowed number of"
+                             " iothreads is between 1 and %d", MAX_COROUTINES);
+                goto fail_getopt;
+            }
+            break;
+        case OPTION_STATS:
+            stats = true;
+            break;
         }
     }
 
@@ -2436,6 +2537,17 @@ static int img_convert(int argc, char **argv)
         goto fail_getopt;
     }
 
+    if (s.num_iothreads > s.num_coroutines) {
+        error_report("--iothreads must not exceed the number of coroutines "
+                     "(-m)");
+        goto fail_getopt;
+    }
+
+    if (s.num_iothreads && rate_limit) {
+        error_report("Cannot use a rate limit together with --iothreads");
+        goto fail_getopt;
+    }
+
     if (tgt_image_opts && !skip_create) {
         error_report("--target-image-opts requires use of -n flag");
         goto fail_getopt;
@@ -2783,7 +2895,11 @@ static int img_convert(int argc, char **argv)
         set_rate_limit(s.target, rate_limit);
     }
 
+    start_ns = get_clock();
     ret = convert_do_copy(&s);
+    if (stats && !ret) {
+        convert_print_stats(&s, get_clock() - start_ns);
+    }
 
     /* Now copy the bitmaps */
     if (bitmaps && ret == 0) {
@@ -4410,23 +4526,41 @@ out_no_progress:
     return 0;
 }
 
-typedef struct BenchData {
+typedef struct BenchData BenchData;
+
+typedef struct BenchReq {
+    BenchData *b;
+    QEMUIOVector qiov;
+    int64_t start_ns;
+} BenchReq;
+
+/*
+ * One stream of requests.  With --iothreads there is one per thread, and
+ * everything in it is only accessed from that thread until it completes.
+ */
+struct BenchData {
     BlockBackend *blk;
     uint64_t image_size;
-    bool write;
+    int write_percent;
+    bool random;
+    GRand *rand;
     int bufsize;
     int step;
     int nrreq;
     int n;
     int flush_interval;
     bool drain_on_flush;
-    uint8_t *buf;
-    QEMUIOVector *qiov;
+    BenchReq *reqs;
+    BenchReq **free_reqs;
+    int nr_free;
+    int64_t *latencies;
+    int nr_latencies;
+    int *running;
 
     int in_flight;
     bool in_flush;
     uint64_t offset;
-} BenchData;
+};
 
 static void bench_undrained_flush_cb(void *opaque, int ret)
 {
@@ -4436,6 +4570,31 @@ static void bench_undrained_flush_cb(void *opaque, int ret)
     }
 }
 
+static uint64_t bench_next_offset(BenchData *b)
+{
+    uint64_t offset = b->offset;
+
+    if (b->random) {
+        uint64_t slots = (b->image_size - b->bufsize) / b->step + 1;
+        uint64_t r = ((uint64_t)g_rand_int(b->rand) << 32) |
+                     g_rand_int(b->rand);
+
+        return (r % slots) * b->step;
+    }
+    b->offset += b->step;
+    b->offset %= b->image_size;
+    return offset;
+}
+
+static bool bench_next_is_write(BenchData *b)
+{
+    return b->write_percent == 100 ||
+           (b->write_percent &&
+            g_rand_int_range(b->rand, 0, 100) < b->write_percent);
+}
+
+static void bench_req_cb(void *opaque, int ret);
+
 static void bench_cb(void *opaque, int ret)
 {
     BenchData *b = opaque;
@@ -4456,6 +4615,12 @@ static void bench_cb(void *opaque, int ret)
         b->n--;
         b->in_flight--;
 
+        if (b->n == 0 && b->running) {
+            qatomic_dec(b->running);
+            aio_wait_kick();
+            return;
+        }
+
         /* Time for flush? Drain queue if requested, then flush */
         if (b->flush_interval && remaining % b->flush_interval == 0) {
             if (!b->in_flight || !b->drain_on_flush) {
@@ -4481,18 +4646,21 @@ static void bench_cb(void *opaque, int ret)
     }
 
     while (b->n > b->in_flight && b->in_flight < b->nrreq) {
-        int64_t offset = b->offset;
+        int64_t offset = bench_next_offset(b);
+        BenchReq *req = b->free_reqs[--b->nr_free];
+
         /* blk_aio_* might look for completed I/Os and kick bench_cb
          * again, so make sure this operation is counted by in_flight
          * and b->offset is ready for the next submission.
          */
         b->in_flight++;
-        b->offset += b->step;
-        b->offset %= b->image_size;
-        if (b->write) {
-            acb = blk_aio_pwritev(b->blk, offset, b->qiov, 0, bench_cb, b);
+        req->start_ns = get_clock();
+        if (bench_next_is_write(b)) {
+            acb = blk_aio_pwritev(b->blk, offset, &req->qiov, 0,
+                                  bench_req_cb, req);
         } else {
-            acb = blk_aio_preadv(b->blk, offset, b->qiov, 0, bench_cb, b);
+            acb = blk_aio_preadv(b->blk, offset, &req->qiov, 0,
+                                 bench_req_cb, req);
         }
         if (!acb) {
             error_report("Failed to issue request");
@@ -4501,13 +4669,87 @@ static void bench_cb(void *opaque, int ret)
     }
 }
 
+static void bench_req_cb(void *opaque, int ret)
+{
+    BenchReq *req = opaque;
+    BenchData *b = req->b;
+
+    b->latencies[b->nr_latencies++] = get_clock() - req->start_ns;
+    b->free_reqs[b->nr_free++] = req;
+    bench_cb(b, ret);
+}
+
+static void bench_start_bh(void *opaque)
+{
+    bench_cb(opaque, 0);
+}
+
+static int bench_compare_latency(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void bench_print_stats(BenchData *data, int nr_data, int64_t elapsed_ns,
+                              double cpu_secs)
+{
+    static const double percentiles[] = { 50, 90, 99, 99.9 };
+    double secs = MAX(elapsed_ns, 1) / (double)NANOSECONDS_PER_SECOND;
+    g_autofree int64_t *lat = NULL;
+    int i, n = 0;
+
+    for (i = 0; i < nr_data; i++) {
+        n += data[i].nr_latencies;
+    }
+    if (!n) {
+        return;
+    }
+    lat = g_new(int64_t, n);
+    for (i = 0, n = 0; i < nr_data; i++) {
+        memcpy(lat + n, data[i].latencies,
+               data[i].nr_latencies * sizeof(*lat));
+        n += data[i].nr_latencies;
+    }
+    qsort(lat, n, sizeof(*lat), bench_compare_latency);
+
+    printf("%.0f IOPS, %.1f MiB/s\n",
+           n / secs, (double)n * data[0].bufsize / secs / MiB);
+    printf("Latency (us): min %.1f", lat[0] / 1000.0);
+    for (i = 0; i < ARRAY_SIZE(percentiles); i++) {
+        printf(", p%g %.1f", percentiles[i],
+               lat[MIN((int64_t)(n * percentiles[i] / 100), n - 1)] / 1000.0);
+    }
+    printf(", max %.1f\n", lat[n - 1] / 1000.0);
+    if (cpu_secs >= 0) {
+        printf("CPU time: %.3f seconds, %.1f us per request\n",
+               cpu_secs, cpu_secs * 1e6 / n);
+    }
+}
+
+/* Return the CPU time used by the process so far, or -1 if unknown */
+static double bench_cpu_time(void)
+{
+#ifndef _WIN32
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+               ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    }
+#endif
+    return -1;
+}
+
 static int img_bench(int argc, char **argv)
 {
     int c, ret = 0;
     const char *fmt = NULL, *filename;
     bool quiet = false;
     bool image_opts = false;
-    bool is_write = false;
+    int write_percent = 0;
+    bool random = false;
+    long num_iothreads = 0;
     int count = 75000;
     int depth = 64;
     int64_t offset = 0;
@@ -4518,12 +4760,17 @@ static int img_bench(int argc, char **argv)
     bool drain_on_flush = true;
     int64_t image_size;
     BlockBackend *blk = NULL;
-    BenchData data = {};
+    BenchData *data = NULL;
+    int nr_data = 0;
+    ImgIOThread *iothreads = NULL;
+    int running = 0;
     int flags = 0;
     bool writethrough = false;
-    struct timeval t1, t2;
-    int i;
+    int64_t t1, t2;
+    double cpu1, cpu2;
+    int i, j;
     bool force_share = false;
+    uint8_t *buf = NULL;
     size_t buf_size = 0;
 
     for (;;) {
@@ -4533,6 +4780,10 @@ static int img_bench(int argc, char **argv)
             {"image-opts", no_argument, 0, OPTION_IMAGE_OPTS},
             {"pattern", required_argument, 0, OPTION_PATTERN},
             {"no-drain", no_argument, 0, OPTION_NO_DRAIN},
+            {"object", required_argument, 0, OPTION_OBJECT},
+            {"random", no_argument, 0, OPTION_RANDOM},
+            {"write-percent", required_argument, 0, OPTION_WRITE_PERCENT},
+            {"iothreads", required_argument, 0, OPTION_IOTHREADS},
             {"force-share", no_argument, 0, 'U'},
             {0, 0, 0, 0}
         };
@@ -4634,7 +4885,7 @@ static int img_bench(int argc, char **argv)
             break;
         case 'w':
             flags |= BDRV_O_RDWR;
-            is_write = true;
+            write_percent = 100;
             break;
         case 'U':
             force_share = true;
@@ -4667,6 +4918,34 @@ static int img_bench(int argc, char **argv)
         case OPTION_IMAGE_OPTS:
             image_opts = true;
             break;
+        case OPTION_OBJECT:
+            user_creatable_process_cmdline(optarg);
+            break;
+        case OPTION_RANDOM:
+            random = true;
+            break;
+        case OPTION_WRITE_PERCENT:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > 100) {
+                error_report("Invalid write percentage specified");
+                return 1;
+            }
+            write_percent = res;
+            if (write_percent) {
+                flags |= BDRV_O_RDWR;
+            }
+            break;
+        }
+        case OPTION_IOTHREADS:
+            if (qemu_strtol(optarg, NULL, 0, &num_iothreads) ||
+                num_iothreads < 1 || num_iothreads > MAX_COROUTINES) {
+                error_report("Invalid number of iothreads. Allowed number of"
+                             " iothreads is between 1 and %d", MAX_COROUTINES);
+                return 1;
+            }
+            break;
         }
     }
 
@@ -4675,7 +4954,7 @@ static int img_bench(int argc, char **argv)
     }
     filename = argv[argc - 1];
 
-    if (!is_write && flush_interval) {
+    if (!write_percent && flush_interval) {
         error_report("--flush-interval is only available in write tests");
         ret = -1;
         goto out;
@@ -4699,56 +4978,126 @@ static int img_bench(int argc, char **argv)
         goto out;
     }
 
-    data = (BenchData) {
-        .blk            = blk,
-        .image_size     = image_size,
-        .bufsize        = bufsize,
-        .step           = step ?: bufsize,
-        .nrreq          = depth,
-        .n              = count,
-        .offset         = offset,
-        .write          = is_write,
-        .flush_interval = flush_interval,
-        .drain_on_flush = drain_on_flush,
-    };
-    printf("Sending %d %s requests, %d bytes each, %d in parallel "
-           "(starting at offset %" PRId64 ", step size %d)\n",
-           data.n, data.write ? "write" : "read", data.bufsize, data.nrreq,
-           data.offset, data.step);
+    if (random && image_size < bufsize) {
+        error_report("Image is smaller than the buffer size");
+        ret = -1;
+        goto out;
+    }
+
+    nr_data = num_iothreads ?: 1;
+    if (count < nr_data) {
+        error_report("Request count can't be smaller than the number of "
+                     "iothreads");
+        ret = -1;
+        goto out;
+    }
+
+    printf("Sending %d %s%s requests, %zu bytes each, %d in parallel",
+           count, random ? "random " : "",
+           write_percent == 100 ? "write" :
+           write_percent ? "mixed" : "read", bufsize, depth);
+    if (num_iothreads) {
+        printf(" in each of %ld iothreads", num_iothreads);
+    }
+    if (random) {
+        printf(" (step size %zu)\n", step ?: bufsize);
+    } else {
+        printf(" (starting at offset %" PRId64 ", step size %zu)\n",
+               offset, step ?: bufsize);
+    }
+    if (write_percent && write_percent < 100) {
+        printf("Writing %d%% of the requests\n", write_percent);
+    }
     if (flush_interval) {
         printf("Sending flush every %d requests\n", flush_interval);
     }
 
-    buf_size = data.nrreq * data.bufsize;
-    data.buf = blk_blockalign(blk, buf_size);
-    memset(data.buf, pattern, data.nrreq * data.bufsize);
+    buf_size = nr_data * depth * bufsize;
+    buf = blk_blockalign(blk, buf_size);
+    memset(buf, pattern, buf_size);
 
-    blk_register_buf(blk, data.buf, buf_size, &error_fatal);
+    blk_register_buf(blk, buf, buf_size, &error_fatal);
 
-    data.qiov = g_new(QEMUIOVector, data.nrreq);
-    for (i = 0; i < data.nrreq; i++) {
-        qemu_iovec_init(&data.qiov[i], 1);
-        qemu_iovec_add(&data.qiov[i],
-                       data.buf + i * data.bufsize, data.bufsize);
+    /*
+     * Each stream gets its part of the requests.  Sequential streams are
+     * interleaved so that together they still access the image in order.
+     */
+    data = g_new0(BenchData, nr_data);
+    for (i = 0; i < nr_data; i++) {
+        BenchData *b = &data[i];
+
+        *b = (BenchData) {
+            .blk            = blk,
+            .image_size     = image_size,
+            .bufsize        = bufsize,
+            .step           = (step ?: bufsize) * (random ? 1 : nr_data),
+            .nrreq          = depth,
+            .n              = count / nr_data + (i < count % nr_data),
+            .offset         = (offset + i * (step ?: bufsize)) % image_size,
+            .write_percent  = write_percent,
+            .random         = random,
+            .rand           = g_rand_new_with_seed(i),
+            .flush_interval = flush_interval,
+            .drain_on_flush = drain_on_flush,
+            .running        = num_iothreads ? &running : NULL,
+        };
+        b->latencies = g_new(int64_t, b->n);
+        b->reqs = g_new0(BenchReq, depth);
+        b->free_reqs = g_new(BenchReq *, depth);
+        for (j = 0; j < depth; j++) {
+            BenchReq *req = &b->reqs[j];
+
+            req->b = b;
+            qemu_iovec_init(&req->qiov, 1);
+            qemu_iovec_add(&req->qiov, buf + (i * depth + j) * bufsize,
+                           bufsize);
+            b->free_reqs[b->nr_free++] = req;
+        }
+    }
+
+    cpu1 = bench_cpu_time();
+    t1 = get_clock();
+    if (num_iothreads) {
+        running = num_iothreads;
+        iothreads = img_iothreads_start(num_iothreads);
+        for (i = 0; i < num_iothreads; i++) {
+            aio_bh_schedule_oneshot(iothreads[i].ctx, bench_start_bh,
+                                    &data[i]);
+        }
+        AIO_WAIT_WHILE_UNLOCKED(NULL, qatomic_read(&running) > 0);
+    } else {
+        bench_cb(&data[0], 0);
+        while (data[0].n > 0) {
+            main_loop_wait(false);
+        }
     }
+    t2 = get_clock();
+    cpu2 = bench_cpu_time();
 
-    gettimeofday(&t1, NULL);
-    bench_cb(&data, 0);
-
-    while (data.n > 0) {
-        main_loop_wait(false);
+    if (iothreads) {
+        img_iothreads_stop(iothreads, num_iothreads);
     }
-    gettimeofday(&t2, NULL);
 
     printf("Run completed in %3.3f seconds.\n",
-           (t2.tv_sec - t1.tv_sec)
-           + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
+           (t2 - t1) / (double)NANOSECONDS_PER_SECOND);
+    bench_print_stats(data, nr_data, t2 - t1,
+                      cpu1 >= 0 && cpu2 >= 0 ? cpu2 - cpu1 : -1);
 
 out:
-    if (data.buf) {
-        blk_unregister_buf(blk, data.buf, buf_size);
+    for (i = 0; i < nr_data && data; i++) {
+        for (j = 0; j < depth; j++) {
+            qemu_iovec_destroy(&data[i].reqs[j].qiov);
+        }
+        g_free(data[i].reqs);
+        g_free(data[i].free_reqs);
+        g_free(data[i].latencies);
+        g_rand_free(data[i].rand);
     }
-    qemu_vfree(data.buf);
+    g_free(data);
+    if (buf) {
+        blk_unregister_buf(blk, buf, buf_size);
+    }
+    qemu_vfree(buf);
     blk_unref(blk);
 
     if (ret) {
@@ -187,6 +187,10 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-jmp-cache-bits=n (log2 of TCG per-vCPU jump cache entries, default 12)\n"
+    "                hot-tb-threshold=n (count TCG translation block entries and report hot ones)\n"
+    "                icount-quantum=n (instructions between vCPU synchronizations with multi-threaded icount, default 10000)\n"
+    "                halt-poll-ns=n (maximum TCG vCPU halt-polling time in nanoseconds, default 0)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
@@ -230,13 +234,44 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-jmp-cache-bits=n``
+        Controls the number of entries (as a power of two, between 8
+        and 16) in the per-vCPU TCG jump cache that maps guest virtual
+        addresses to translation blocks.  Guests that execute a large
+        amount of hot code, such as JIT compilers, may benefit from a
+        larger cache.  Hit and miss counters for each vCPU are
+        available through ``query-stats`` with the ``tcg`` provider.
+
+    ``hot-tb-threshold=n``
+        Counts how often each TCG translation block is entered other
+        than through a direct chained jump, and reports a block as hot
+        once the count reaches ``n``, through the ``exec_tb_hot`` trace
+        event and in ``info jit``.  The default of 0 disables counting.
+
+    ``icount-quantum=n``
+        With ``thread=multi`` and ``-icount``, the vCPUs run in lock-step:
+        each executes ``n`` instructions, or fewer up to the next virtual
+        clock timer, and then waits for the others before virtual time
+        advances.  Smaller values keep the vCPUs closer together at the
+        cost of more frequent synchronization.  The default is 10000.
+
+    ``halt-poll-ns=n``
+        With ``thread=multi``, an idle vCPU thread spins for up to ``n``
+        nanoseconds waiting for an interrupt or other work before it goes
+        to sleep, which shortens interrupt latency at the cost of host
+        CPU time.  The polling time adapts to how long the vCPU actually
+        stays idle, and is never longer than ``n``.  Counters for each
+        vCPU are available through ``query-stats`` with the ``tcg``
+        provider.  The default of 0 disables polling.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
         additional host cores. The default is to enable multi-threading
         where both the back-end and front-ends support it and no
         incompatible TCG features have been enabled (e.g.
-        icount/replay).
+        icount/replay).  Multi-threading can be enabled together with
+        ``-icount`` with a fixed ``shift``, see ``icount-quantum``.
 
     ``dirty-ring-size=n``
         When the KVM accelerator is used, it controls the size of the per-vCPU
@@ -1871,6 +1906,12 @@ SRST
     ``mount_tag=mount_tag``
         Specifies the tag name to be used by the guest to mount this
         export point.
+
+    ``iothread=id``
+        Processes requests in the IOThread with the given id instead of
+        the main loop, and runs the fs driver calls in that IOThread's
+        worker threads.  Requires ioeventfd and cannot be combined with
+        fsdev throttling.
 ERST
 
 DEF("virtfs", HAS_ARG, QEMU_OPTION_virtfs,
@@ -2588,7 +2629,9 @@ SRST
         Enable lossy compression methods (gradient, JPEG, ...). If this
         option is set, VNC client may receive lossy framebuffer updates
         depending on its encoding settings. Enabling this option can
-        save a lot of bandwidth at the expense of quality.
+        save a lot of bandwidth at the expense of quality.  It also allows the
+        Open H.264 encoding for clients that support it, if QEMU was
+        built with GStreamer; a hardware encoder is used when available.
 
     ``non-adaptive=on|off``
         Disable adaptive encodings. Adaptive encodings are enabled by
@@ -2904,6 +2947,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
 #ifdef CONFIG_AF_XDP
     "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
     "         [,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]\n"
+    "         [,busy-poll-budget=n]\n"
     "                attach to the existing network interface 'name' with AF_XDP socket\n"
     "                use 'mode=MODE' to specify an XDP program attach mode\n"
     "                use 'force-copy=on|off' to force XDP copy mode even if device supports zero-copy (default: off)\n"
@@ -2913,6 +2957,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                  added to a socket map in XDP program.  One socket per queue.\n"
     "                use 'queues=n' to specify how many queues of a multiqueue interface should be used\n"
     "                use 'start-queue=m' to specify the first queue that should be used\n"
+    "                use 'busy-poll-budget=n' to busy poll the device queues with NAPI budget n\n"
 #endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
@@ -3414,7 +3459,7 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
-``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]``
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z][,busy-poll-budget=n]``
     Configure AF_XDP backend to connect to a network interface 'name'
     using AF_XDP socket.  A specific program attach mode for a default
     XDP program can be forced with 'mode', defaults to best-effort,
@@ -3463,6 +3508,20 @@ SRST
         |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
             -netdev af-xdp,id=n1,ifname=eth0,queues=3,inhibit=on,sock-fds=15:16:17
 
+    'busy-poll-budget' enables preferred busy polling of the device queues.
+    When the queues are processed in IOThreads, for example by a virtio-net
+    device with 'iothread-vq-mapping', AioContext polling checks the rings
+    and drives the device queue from the IOThread instead of waiting for
+    interrupts.
+
+    .. parsed-literal::
+
+        echo 2 > /sys/class/net/eth0/napi_defer_hard_irqs
+        echo 200000 > /sys/class/net/eth0/gro_flush_timeout
+        |qemu_system| linux.img -object iothread,id=io0 \\
+            -device '{"driver":"virtio-net-pci","netdev":"n1","iothread-vq-mapping":[{"iothread":"io0"}]}' \\
+            -netdev af-xdp,id=n1,ifname=eth0,busy-poll-budget=64
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
@@ -4648,13 +4707,13 @@ SRST
 ERST
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>]]\n" \
+    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>][,rrsnapshot-period=N]]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
     "                instruction, enable aligning the host and virtual clocks\n" \
     "                or disable real time cpu sleeping, and optionally enable\n" \
     "                record-and-replay mode\n", QEMU_ARCH_ALL)
 SRST
-``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot]]``
+``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot][,rrsnapshot-period=N]]``
     Enable virtual instruction counter. The virtual cpu will execute one
     instruction every 2^N ns of virtual time. If ``auto`` is specified
     then the virtual cpu speed will be automatically adjusted to keep
@@ -4696,6 +4755,9 @@ SRST
     name. In record mode, a new VM snapshot with the given name is created
     at the start of execution recording. In replay mode this option
     specifies the snapshot name used to load the initial VM state.
+    If ``rrsnapshot-period`` is given, an additional snapshot is created
+    roughly every N instructions, named after the snapshot name (or ``rr``)
+    and the instruction count at which it is taken.
 ERST
 
 DEF("watchdog-action", HAS_ARG, QEMU_OPTION_watchdog_action, \
@@ -5797,7 +5859,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch,thread-context=id``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -5837,6 +5899,19 @@ SRST
         in a batch for the AIO engine, 0 means that the engine will use
         its default.
 
+        The ``thread-context`` parameter names a ``thread-context`` object
+        to create the IOThread in. The IOThread then starts out with the
+        context's ``cpu-affinity`` or ``node-affinity``, ``sched-policy``,
+        ``sched-priority`` and ``nice`` settings, so no pinning is needed
+        after it has been created. The IOThread's thread pool workers are
+        created in the same context unless ``thread-pool-context`` is set.
+        This parameter cannot be changed at run-time.
+
+        ::
+
+            -object thread-context,id=tc1,node-affinity=1,sched-policy=fifo,sched-priority=10 \
+            -object iothread,id=iothread1,thread-context=tc1
+
         The IOThread parameters can be modified at run-time using the
         ``qom-set`` command (where ``iothread1`` is the IOThread's
         ``id``):
@@ -69,6 +69,18 @@ GuestFileHandle *guest_file_handle_find(int64_t id, Error **errp);
 GuestFileRead *guest_file_read_unsafe(GuestFileHandle *gfh,
                                       int64_t count, Error **errp);
 
+#ifndef _WIN32
+/*
+ * Unencoded reads and writes of an open file, shared by guest-file-read,
+ * guest-file-write and the stream channel.  Return the number of bytes
+ * transferred, or a negative errno value.
+ */
+int64_t guest_file_read_raw(GuestFileHandle *gfh, void *buf, size_t count,
+                            bool *eof);
+int64_t guest_file_write_raw(GuestFileHandle *gfh, const void *buf,
+                             size_t count, bool *eof);
+#endif
+
 /**
  * qga_get_host_name:
  * @errp: Error object
@@ -465,44 +465,88 @@ void qmp_guest_file_close(int64_t handle, Error **errp)
     g_free(gfh);
 }
 
-GuestFileRead *guest_file_read_unsafe(GuestFileHandle *gfh,
-                                      int64_t count, Error **errp)
+int64_t guest_file_read_raw(GuestFileHandle *gfh, void *buf, size_t count,
+                            bool *eof)
 {
-    GuestFileRead *read_data = NULL;
-    guchar *buf;
     FILE *fh = gfh->fh;
     size_t read_count;
+    int64_t ret;
 
     /* explicitly flush when switching from writing to reading */
     if (gfh->state == RW_STATE_WRITING) {
-        int ret = fflush(fh);
-        if (ret == EOF) {
-            error_setg_errno(errp, errno, "failed to flush file");
-            return NULL;
+        if (fflush(fh) == EOF) {
+            return -errno;
         }
         gfh->state = RW_STATE_NEW;
     }
 
-    buf = g_malloc0(count + 1);
     read_count = fread(buf, 1, count, fh);
     if (ferror(fh)) {
-        error_setg_errno(errp, errno, "failed to read file");
+        ret = errno ? -errno : -EIO;
+    } else {
+        ret = read_count;
+        *eof = feof(fh);
+        gfh->state = RW_STATE_READING;
+    }
+    clearerr(fh);
+
+    return ret;
+}
+
+GuestFileRead *guest_file_read_unsafe(GuestFileHandle *gfh,
+                                      int64_t count, Error **errp)
+{
+    GuestFileRead *read_data = NULL;
+    guchar *buf;
+    int64_t read_count;
+    bool eof;
+
+    /* No need to clear the buffer, only the bytes read are encoded */
+    buf = g_malloc(count + 1);
+    read_count = guest_file_read_raw(gfh, buf, count, &eof);
+    if (read_count < 0) {
+        error_setg_errno(errp, -read_count, "failed to read file");
     } else {
         buf[read_count] = 0;
         read_data = g_new0(GuestFileRead, 1);
         read_data->count = read_count;
-        read_data->eof = feof(fh);
+        read_data->eof = eof;
         if (read_count) {
             read_data->buf_b64 = g_base64_encode(buf, read_count);
         }
-        gfh->state = RW_STATE_READING;
     }
     g_free(buf);
-    clearerr(fh);
 
     return read_data;
 }
 
+int64_t guest_file_write_raw(GuestFileHandle *gfh, const void *buf,
+                             size_t count, bool *eof)
+{
+    FILE *fh = gfh->fh;
+    size_t write_count;
+    int64_t ret;
+
+    if (gfh->state == RW_STATE_READING) {
+        if (fseek(fh, 0, SEEK_CUR) == -1) {
+            return -errno;
+        }
+        gfh->state = RW_STATE_NEW;
+    }
+
+    write_count = fwrite(buf, 1, count, fh);
+    if (ferror(fh)) {
+        ret = errno ? -errno : -EIO;
+    } else {
+        ret = write_count;
+        *eof = feof(fh);
+        gfh->state = RW_STATE_WRITING;
+    }
+    clearerr(fh);
+
+    return ret;
+}
+
 GuestFileWrite *qmp_guest_file_write(int64_t handle, const char *buf_b64,
                                      bool has_count, int64_t count,
                                      Error **errp)
@@ -510,25 +554,14 @@ GuestFileWrite *qmp_guest_file_write(int64_t handle, const char *buf_b64,
     GuestFileWrite *write_data = NULL;
     guchar *buf;
     gsize buf_len;
-    int write_count;
+    int64_t write_count;
+    bool eof;
     GuestFileHandle *gfh = guest_file_handle_find(handle, errp);
-    FILE *fh;
 
     if (!gfh) {
         return NULL;
     }
 
-    fh = gfh->fh;
-
-    if (gfh->state == RW_STATE_READING) {
-        int ret = fseek(fh, 0, SEEK_CUR);
-        if (ret == -1) {
-            error_setg_errno(errp, errno, "failed to seek file");
-            return NULL;
-        }
-        gfh->state = RW_STATE_NEW;
-    }
-
     buf = qbase64_decode(buf_b64, -1, &buf_len, errp);
     if (!buf) {
         return NULL;
@@ -543,18 +576,16 @@ GuestFileWrite *qmp_guest_file_write(int64_t handle, const char *buf_b64,
         return NULL;
     }
 
-    write_count = fwrite(buf, 1, count, fh);
-    if (ferror(fh)) {
-        error_setg_errno(errp, errno, "failed to write to file");
+    write_count = guest_file_write_raw(gfh, buf, count, &eof);
+    if (write_count < 0) {
+        error_setg_errno(errp, -write_count, "failed to write to file");
         slog("guest-file-write failed, handle: %" PRId64, handle);
     } else {
         write_data = g_new0(GuestFileWrite, 1);
         write_data->count = write_count;
-        write_data->eof = feof(fh);
-        gfh->state = RW_STATE_WRITING;
+        write_data->eof = eof;
     }
     g_free(buf);
-    clearerr(fh);
 
     return write_data;
 }
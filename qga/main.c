@@ -37,6 +37,9 @@
 #include "qga/vss-win32.h"
 #endif
 #include "commands-common.h"
+#ifndef _WIN32
+#include "stream.h"
+#endif
 
 #ifndef _WIN32
 #ifdef CONFIG_BSD
@@ -75,6 +78,9 @@ struct GAState {
     GMainLoop *main_loop;
     GAChannel *channel;
     bool virtio; /* fastpath to check for virtio to deal with poll() quirks */
+#ifndef _WIN32
+    GAStream *stream;
+#endif
     GACommandState *command_state;
     GLogLevelFlags log_level;
     FILE *log_file;
@@ -240,6 +246,12 @@ QEMU_COPYRIGHT "\n"
 "                    %s).\n"
 "                    Socket addresses for vsock-listen are written as\n"
 "                    <cid>:<port>.\n"
+#ifndef _WIN32
+"  --stream-method   transport method of the stream channel for unencoded\n"
+"                    file data, as for --method (default is virtio-serial)\n"
+"  --stream-path     device/socket path of the stream channel; the channel\n"
+"                    is only opened if this is set\n"
+#endif
 "  -l, --logfile     set logfile path, logs to stderr by default\n"
 "  -f, --pidfile     specify pidfile (default is %s)\n"
 #ifdef CONFIG_FSFREEZE
@@ -679,24 +691,34 @@ static gboolean channel_event_cb(GIOCondition condition, gpointer data)
     return true;
 }
 
-static gboolean channel_init(GAState *s, const gchar *method, const gchar *path,
-                             int listen_fd)
+static bool channel_method_parse(const gchar *method,
+                                 GAChannelMethod *channel_method)
 {
-    GAChannelMethod channel_method;
-
     if (strcmp(method, "virtio-serial") == 0) {
-        s->virtio = true; /* virtio requires special handling in some cases */
-        channel_method = GA_CHANNEL_VIRTIO_SERIAL;
+        *channel_method = GA_CHANNEL_VIRTIO_SERIAL;
     } else if (strcmp(method, "isa-serial") == 0) {
-        channel_method = GA_CHANNEL_ISA_SERIAL;
+        *channel_method = GA_CHANNEL_ISA_SERIAL;
     } else if (strcmp(method, "unix-listen") == 0) {
-        channel_method = GA_CHANNEL_UNIX_LISTEN;
+        *channel_method = GA_CHANNEL_UNIX_LISTEN;
     } else if (strcmp(method, "vsock-listen") == 0) {
-        channel_method = GA_CHANNEL_VSOCK_LISTEN;
+        *channel_method = GA_CHANNEL_VSOCK_LISTEN;
     } else {
         g_critical("unsupported channel method/type: %s", method);
         return false;
     }
+    return true;
+}
+
+static gboolean channel_init(GAState *s, const gchar *method, const gchar *path,
+                             int listen_fd)
+{
+    GAChannelMethod channel_method;
+
+    if (!channel_method_parse(method, &channel_method)) {
+        return false;
+    }
+    /* virtio requires special handling in some cases */
+    s->virtio = channel_method == GA_CHANNEL_VIRTIO_SERIAL;
 
     s->channel = ga_channel_new(channel_method, path, listen_fd,
                                 channel_event_cb, s);
@@ -708,6 +730,25 @@ static gboolean channel_init(GAState *s, const gchar *method, const gchar *path,
     return true;
 }
 
+#ifndef _WIN32
+static gboolean stream_init(GAState *s, const gchar *method, const gchar *path)
+{
+    GAChannelMethod channel_method;
+
+    if (!channel_method_parse(method, &channel_method)) {
+        return false;
+    }
+
+    s->stream = ga_stream_new(channel_method, path);
+    if (!s->stream) {
+        g_critical("failed to create guest agent stream channel");
+        return false;
+    }
+
+    return true;
+}
+#endif
+
 #ifdef _WIN32
 DWORD WINAPI handle_serial_device_events(DWORD type, LPVOID data)
 {
@@ -999,6 +1040,10 @@ static GList *split_list(const gchar *str, const gchar *delim)
 struct GAConfig {
     char *channel_path;
     char *method;
+#ifndef _WIN32
+    char *stream_path;
+    char *stream_method;
+#endif
     char *log_filepath;
     char *pid_filepath;
 #ifdef CONFIG_FSFREEZE
@@ -1042,6 +1087,16 @@ static void config_load(GAConfig *config)
         config->channel_path =
             g_key_file_get_string(keyfile, "general", "path", &gerr);
     }
+#ifndef _WIN32
+    if (g_key_file_has_key(keyfile, "general", "stream-method", NULL)) {
+        config->stream_method =
+            g_key_file_get_string(keyfile, "general", "stream-method", &gerr);
+    }
+    if (g_key_file_has_key(keyfile, "general", "stream-path", NULL)) {
+        config->stream_path =
+            g_key_file_get_string(keyfile, "general", "stream-path", &gerr);
+    }
+#endif
     if (g_key_file_has_key(keyfile, "general", "logfile", NULL)) {
         config->log_filepath =
             g_key_file_get_string(keyfile, "general", "logfile", &gerr);
@@ -1136,6 +1191,14 @@ static void config_dump(GAConfig *config)
     if (config->channel_path) {
         g_key_file_set_string(keyfile, "general", "path", config->channel_path);
     }
+#ifndef _WIN32
+    if (config->stream_path) {
+        g_key_file_set_string(keyfile, "general", "stream-method",
+                              config->stream_method);
+        g_key_file_set_string(keyfile, "general", "stream-path",
+                              config->stream_path);
+    }
+#endif
     if (config->log_filepath) {
         g_key_file_set_string(keyfile, "general", "logfile",
                               config->log_filepath);
@@ -1171,6 +1234,12 @@ static void config_dump(GAConfig *config)
     g_key_file_free(keyfile);
 }
 
+/* long options without a short equivalent */
+enum {
+    OPTION_STREAM_METHOD = 256,
+    OPTION_STREAM_PATH,
+};
+
 static void config_parse(GAConfig *config, int argc, char **argv)
 {
     const char *sopt = "hVvdm:p:l:f:F::b:a:s:t:Dr";
@@ -1188,6 +1257,10 @@ static void config_parse(GAConfig *config, int argc, char **argv)
         { "verbose", 0, NULL, 'v' },
         { "method", 1, NULL, 'm' },
         { "path", 1, NULL, 'p' },
+#ifndef _WIN32
+        { "stream-method", 1, NULL, OPTION_STREAM_METHOD },
+        { "stream-path", 1, NULL, OPTION_STREAM_PATH },
+#endif
         { "daemonize", 0, NULL, 'd' },
         { "block-rpcs", 1, NULL, 'b' },
         { "blacklist", 1, NULL, 'b' },  /* deprecated alias for 'block-rpcs' */
@@ -1210,6 +1283,16 @@ static void config_parse(GAConfig *config, int argc, char **argv)
             g_free(config->channel_path);
             config->channel_path = g_strdup(optarg);
             break;
+#ifndef _WIN32
+        case OPTION_STREAM_METHOD:
+            g_free(config->stream_method);
+            config->stream_method = g_strdup(optarg);
+            break;
+        case OPTION_STREAM_PATH:
+            g_free(config->stream_path);
+            config->stream_path = g_strdup(optarg);
+            break;
+#endif
         case 'l':
             g_free(config->log_filepath);
             config->log_filepath = g_strdup(optarg);
@@ -1317,6 +1400,10 @@ static void config_free(GAConfig *config)
     g_free(config->pid_filepath);
     g_free(config->state_dir);
     g_free(config->channel_path);
+#ifndef _WIN32
+    g_free(config->stream_method);
+    g_free(config->stream_path);
+#endif
     g_free(config->bliststr);
     g_free(config->aliststr);
 #ifdef CONFIG_FSFREEZE
@@ -1513,12 +1600,26 @@ static int run_agent_once(GAState *s)
         g_critical("failed to initialize guest agent channel");
         return EXIT_FAILURE;
     }
+#ifndef _WIN32
+    if (s->config->stream_path &&
+        !stream_init(s, s->config->stream_method, s->config->stream_path)) {
+        ga_channel_free(s->channel);
+        s->channel = NULL;
+        return EXIT_FAILURE;
+    }
+#endif
 
     g_main_loop_run(ga_state->main_loop);
 
     if (s->channel) {
         ga_channel_free(s->channel);
     }
+#ifndef _WIN32
+    if (s->stream) {
+        ga_stream_free(s->stream);
+        s->stream = NULL;
+    }
+#endif
 
     return EXIT_SUCCESS;
 }
@@ -1599,6 +1700,11 @@ int main(int argc, char **argv)
     if (config->method == NULL) {
         config->method = g_strdup("virtio-serial");
     }
+#ifndef _WIN32
+    if (config->stream_method == NULL) {
+        config->stream_method = g_strdup("virtio-serial");
+    }
+#endif
 
     socket_activation = check_socket_activation();
     if (socket_activation > 1) {
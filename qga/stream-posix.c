@@ -0,0 +1,280 @@
+/*
+ * QEMU Guest Agent stream channel
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * guest-file-read and guest-file-write carry file data base64 encoded in
+ * JSON messages.  The stream channel is a second port that carries it
+ * unencoded instead.  Files are still opened, positioned and closed with
+ * the guest-file-* commands on the main channel; the stream channel only
+ * reads and writes the handles that guest-file-open returned.
+ *
+ * Every message starts with a GAStreamHeader, in little endian byte order.
+ * Requests are processed one at a time:
+ *
+ *   WRITE   header, then @length bytes to write at the current position.
+ *           Answered by a STATUS with the number of bytes written.
+ *   READ    header only, @length is the number of bytes to read.
+ *           Answered by DATA messages, each a header whose @length bytes
+ *           of file data follow, then by a STATUS with the number of bytes
+ *           read.  Fewer bytes than requested without an error means that
+ *           the end of the file was reached.
+ *
+ * @error in a STATUS is 0 or a positive errno value of the guest.  A
+ * request for a command that is disabled, by --block-rpcs, --allow-rpcs or
+ * while filesystems are frozen, fails with EPERM.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
+#include "guest-agent-core.h"
+#include "commands-common.h"
+#include "stream.h"
+
+#define GA_STREAM_MAGIC     0x53414751 /* "QGAS" */
+#define GA_STREAM_BUF_SIZE  (1 * MiB)
+
+typedef enum GAStreamOp {
+    GA_STREAM_OP_WRITE = 1,
+    GA_STREAM_OP_READ = 2,
+    GA_STREAM_OP_DATA = 3,
+    GA_STREAM_OP_STATUS = 4,
+} GAStreamOp;
+
+typedef struct QEMU_PACKED GAStreamHeader {
+    uint32_t magic;
+    uint32_t op;
+    int64_t handle;
+    uint64_t length;
+    int32_t error;
+    uint32_t reserved;
+} GAStreamHeader;
+
+QEMU_BUILD_BUG_ON(sizeof(GAStreamHeader) != 32);
+
+struct GAStream {
+    GAChannel *channel;
+    bool virtio;
+    GAStreamHeader hdr;     /* request being received */
+    size_t hdr_len;
+    uint64_t remaining;     /* data of a WRITE request still to receive */
+    uint64_t done;
+    int error;
+    guchar *buf;
+};
+
+static void ga_stream_reset(GAStream *st)
+{
+    st->hdr_len = 0;
+    st->remaining = 0;
+}
+
+/*
+ * Framing is lost, so give up on the current connection.  A virtio-serial
+ * port cannot be reopened, keep it and hope for the best.
+ */
+static gboolean ga_stream_fail(GAStream *st, const char *msg)
+{
+    g_warning("stream channel: %s", msg);
+    ga_stream_reset(st);
+    return st->virtio;
+}
+
+static bool ga_stream_send(GAStream *st, GAStreamOp op, int64_t handle,
+                           uint64_t length, int error, const void *data)
+{
+    GAStreamHeader hdr = {
+        .magic = cpu_to_le32(GA_STREAM_MAGIC),
+        .op = cpu_to_le32(op),
+        .handle = cpu_to_le64(handle),
+        .length = cpu_to_le64(length),
+        .error = cpu_to_le32(error),
+    };
+
+    if (ga_channel_write_all(st->channel, (gchar *)&hdr, sizeof(hdr)) !=
+        G_IO_STATUS_NORMAL) {
+        return false;
+    }
+    return !data ||
+           ga_channel_write_all(st->channel, data, length) ==
+           G_IO_STATUS_NORMAL;
+}
+
+/* Honour disabled commands like the main channel does */
+static int ga_stream_check(const char *name)
+{
+    const QmpCommand *cmd = qmp_find_command(&ga_commands, name);
+
+    return cmd && qmp_command_is_enabled(cmd) ? 0 : EPERM;
+}
+
+/* @count bytes of a WRITE request were received into st->buf */
+static gboolean ga_stream_write(GAStream *st, size_t count)
+{
+    st->remaining -= count;
+
+    /* After an error, the rest of the data is received and dropped */
+    if (!st->error) {
+        GuestFileHandle *gfh = guest_file_handle_find(st->hdr.handle, NULL);
+        bool eof;
+        int64_t ret;
+
+        ret = gfh ? guest_file_write_raw(gfh, st->buf, count, &eof) : -EBADF;
+        if (ret < 0) {
+            st->error = -ret;
+        } else {
+            st->done += ret;
+            if ((uint64_t)ret < count) {
+                st->error = EIO;
+            }
+        }
+    }
+
+    if (st->remaining) {
+        return true;
+    }
+    if (!ga_stream_send(st, GA_STREAM_OP_STATUS, st->hdr.handle, st->done,
+                        st->error, NULL)) {
+        return ga_stream_fail(st, "failed to send status");
+    }
+    return true;
+}
+
+static gboolean ga_stream_read(GAStream *st)
+{
+    int64_t handle = st->hdr.handle;
+    uint64_t left = st->hdr.length;
+    GuestFileHandle *gfh = NULL;
+    uint64_t done = 0;
+    bool eof = false;
+    int error;
+
+    error = ga_stream_check("guest-file-read");
+    if (!error) {
+        gfh = guest_file_handle_find(handle, NULL);
+        error = gfh ? 0 : EBADF;
+    }
+
+    while (!error && left && !eof) {
+        int64_t ret = guest_file_read_raw(gfh, st->buf,
+                                          MIN(left, GA_STREAM_BUF_SIZE), &eof);
+
+        if (ret < 0) {
+            error = -ret;
+            break;
+        }
+        if (!ret) {
+            break;
+        }
+        if (!ga_stream_send(st, GA_STREAM_OP_DATA, handle, ret, 0, st->buf)) {
+            return ga_stream_fail(st, "failed to send data");
+        }
+        done += ret;
+        left -= ret;
+    }
+
+    if (!ga_stream_send(st, GA_STREAM_OP_STATUS, handle, done, error, NULL)) {
+        return ga_stream_fail(st, "failed to send status");
+    }
+    return true;
+}
+
+/* A complete request header was received into st->hdr */
+static gboolean ga_stream_request(GAStream *st)
+{
+    GAStreamHeader *hdr = &st->hdr;
+
+    hdr->magic = le32_to_cpu(hdr->magic);
+    hdr->op = le32_to_cpu(hdr->op);
+    hdr->handle = le64_to_cpu(hdr->handle);
+    hdr->length = le64_to_cpu(hdr->length);
+    st->hdr_len = 0;
+
+    if (hdr->magic != GA_STREAM_MAGIC) {
+        return ga_stream_fail(st, "invalid request header");
+    }
+
+    switch (hdr->op) {
+    case GA_STREAM_OP_WRITE:
+        st->remaining = hdr->length;
+        st->done = 0;
+        st->error = ga_stream_check("guest-file-write");
+        return st->remaining ? true : ga_stream_write(st, 0);
+    case GA_STREAM_OP_READ:
+        return ga_stream_read(st);
+    default:
+        return ga_stream_fail(st, "invalid request");
+    }
+}
+
+/* false return signals GAChannel to close the current client connection */
+static gboolean ga_stream_event_cb(GIOCondition condition, gpointer opaque)
+{
+    GAStream *st = opaque;
+    gchar *dst;
+    gsize size, count;
+
+    if (st->remaining) {
+        dst = (gchar *)st->buf;
+        size = MIN(st->remaining, GA_STREAM_BUF_SIZE);
+    } else {
+        dst = (gchar *)&st->hdr + st->hdr_len;
+        size = sizeof(st->hdr) - st->hdr_len;
+    }
+
+    switch (ga_channel_read(st->channel, dst, size, &count)) {
+    case G_IO_STATUS_NORMAL:
+        break;
+    case G_IO_STATUS_EOF:
+        /* A new connection starts with a new request */
+        ga_stream_reset(st);
+        if (!st->virtio) {
+            return false;
+        }
+        /* fall through */
+    case G_IO_STATUS_AGAIN:
+        /* as for the main channel, see channel_event_cb() */
+        if (st->virtio) {
+            g_usleep(G_USEC_PER_SEC / 10);
+        }
+        return true;
+    default:
+        return ga_stream_fail(st, "error reading channel");
+    }
+
+    if (st->remaining) {
+        return ga_stream_write(st, count);
+    }
+
+    st->hdr_len += count;
+    if (st->hdr_len < sizeof(st->hdr)) {
+        return true;
+    }
+    return ga_stream_request(st);
+}
+
+GAStream *ga_stream_new(GAChannelMethod method, const gchar *path)
+{
+    GAStream *st = g_new0(GAStream, 1);
+
+    st->virtio = method == GA_CHANNEL_VIRTIO_SERIAL;
+    st->buf = g_malloc(GA_STREAM_BUF_SIZE);
+    st->channel = ga_channel_new(method, path, -1, ga_stream_event_cb, st);
+    if (!st->channel) {
+        ga_stream_free(st);
+        return NULL;
+    }
+
+    return st;
+}
+
+void ga_stream_free(GAStream *st)
+{
+    if (st->channel) {
+        ga_channel_free(st->channel);
+    }
+    g_free(st->buf);
+    g_free(st);
+}
@@ -0,0 +1,17 @@
+/*
+ * QEMU Guest Agent stream channel declarations
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QGA_STREAM_H
+#define QGA_STREAM_H
+
+#include "channel.h"
+
+typedef struct GAStream GAStream;
+
+GAStream *ga_stream_new(GAChannelMethod method, const gchar *path);
+void ga_stream_free(GAStream *st);
+
+#endif
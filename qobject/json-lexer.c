@@ -342,12 +342,55 @@ static void json_lexer_feed_char(JSONLexer *lexer, char ch, bool flush)
     }
 }
 
-void json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size)
+/*
+ * Inside a string, printable ASCII characters other than the quote and
+ * the backslash leave the lexer state unchanged.  Return the length of
+ * such a run at the start of @buffer, so that large strings can be
+ * appended to the token in bulk instead of character by character.
+ */
+static size_t json_lexer_string_span(JSONLexer *lexer, const char *buffer,
+                                     size_t size)
 {
+    char quote;
     size_t i;
 
+    if (lexer->state == IN_DQ_STRING) {
+        quote = '"';
+    } else if (lexer->state == IN_SQ_STRING) {
+        quote = '\'';
+    } else {
+        return 0;
+    }
+
+    /* Leave the token size limit to json_lexer_feed_char() */
+    if (lexer->token->len >= MAX_TOKEN_SIZE) {
+        return 0;
+    }
+    size = MIN(size, MAX_TOKEN_SIZE - lexer->token->len);
+
     for (i = 0; i < size; i++) {
-        json_lexer_feed_char(lexer, buffer[i], false);
+        uint8_t ch = buffer[i];
+
+        if (ch < 0x20 || ch > 0x7e || ch == '\\' || ch == quote) {
+            break;
+        }
+    }
+    return i;
+}
+
+void json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size)
+{
+    size_t i = 0, n;
+
+    while (i < size) {
+        n = json_lexer_string_span(lexer, buffer + i, size - i);
+        if (n) {
+            g_string_append_len(lexer->token, buffer + i, n);
+            lexer->x += n;
+            i += n;
+            continue;
+        }
+        json_lexer_feed_char(lexer, buffer[i++], false);
     }
 }
 
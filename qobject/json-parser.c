@@ -28,13 +28,14 @@ struct JSONToken {
     JSONTokenType type;
     int x;
     int y;
+    uint32_t size;              /* in the token arena, including padding */
     char str[];
 };
 
 typedef struct JSONParserContext {
     Error *err;
-    JSONToken *current;
-    GQueue *buf;
+    GByteArray *buf;
+    size_t pos;
     va_list *ap;
 } JSONParserContext;
 
@@ -216,6 +217,18 @@ static QString *parse_string(JSONParserContext *ctxt, JSONToken *token)
             }
             /* fall through */
         default:
+            /* Copy runs of plain ASCII characters in one go */
+            len = 0;
+            while (ptr[len] && !(ptr[len] & 0x80) && ptr[len] != '\\' &&
+                   ptr[len] != quote && ptr[len] != '%') {
+                len++;
+            }
+            if (len) {
+                g_string_append_len(str, ptr, len);
+                ptr += len;
+                break;
+            }
+
             cp = mod_utf8_codepoint(ptr, 6, &end);
             if (cp < 0) {
                 parse_error(ctxt, token, "invalid UTF-8 sequence in string");
@@ -235,20 +248,32 @@ out:
     return NULL;
 }
 
-/* Note: the token object returned by parser_context_peek_token or
- * parser_context_pop_token is deleted as soon as parser_context_pop_token
- * is called again.
+/*
+ * Tokens are stored back to back in the token arena, each one padded to
+ * the alignment of JSONToken.  They stay valid until the arena is reset
+ * after the whole message has been parsed.
  */
-static JSONToken *parser_context_pop_token(JSONParserContext *ctxt)
+static size_t json_token_size(size_t len)
 {
-    g_free(ctxt->current);
-    ctxt->current = g_queue_pop_head(ctxt->buf);
-    return ctxt->current;
+    return ROUND_UP(sizeof(JSONToken) + len + 1, __alignof__(JSONToken));
 }
 
 static JSONToken *parser_context_peek_token(JSONParserContext *ctxt)
 {
-    return g_queue_peek_head(ctxt->buf);
+    if (ctxt->pos >= ctxt->buf->len) {
+        return NULL;
+    }
+    return (JSONToken *)(ctxt->buf->data + ctxt->pos);
+}
+
+static JSONToken *parser_context_pop_token(JSONParserContext *ctxt)
+{
+    JSONToken *token = parser_context_peek_token(ctxt);
+
+    if (token) {
+        ctxt->pos += token->size;
+    }
+    return token;
 }
 
 /**
@@ -559,32 +584,31 @@ static QObject *parse_value(JSONParserContext *ctxt)
     }
 }
 
-JSONToken *json_token(JSONTokenType type, int x, int y, GString *tokstr)
+void json_token_append(GByteArray *tokens, JSONTokenType type, int x, int y,
+                       GString *tokstr)
 {
-    JSONToken *token = g_malloc(sizeof(JSONToken) + tokstr->len + 1);
+    size_t pos = tokens->len;
+    size_t size = json_token_size(tokstr->len);
+    JSONToken *token;
 
+    g_byte_array_set_size(tokens, pos + size);
+    token = (JSONToken *)(tokens->data + pos);
     token->type = type;
+    token->size = size;
     memcpy(token->str, tokstr->str, tokstr->len);
     token->str[tokstr->len] = 0;
     token->x = x;
     token->y = y;
-    return token;
 }
 
-QObject *json_parser_parse(GQueue *tokens, va_list *ap, Error **errp)
+QObject *json_parser_parse(GByteArray *tokens, va_list *ap, Error **errp)
 {
     JSONParserContext ctxt = { .buf = tokens, .ap = ap };
     QObject *result;
 
     result = parse_value(&ctxt);
-    assert(ctxt.err || g_queue_is_empty(ctxt.buf));
+    assert(ctxt.err || ctxt.pos == ctxt.buf->len);
 
     error_propagate(errp, ctxt.err);
-
-    while (!g_queue_is_empty(ctxt.buf)) {
-        parser_context_pop_token(&ctxt);
-    }
-    g_free(ctxt.current);
-
     return result;
 }
@@ -24,17 +24,26 @@ struct JSONWriter {
     GByteArray *container_is_array;
 };
 
-JSONWriter *json_writer_new(bool pretty)
+/*
+ * Create a writer that appends to @contents.  Detach it with
+ * json_writer_get_and_free(), json_writer_free() frees @contents, too.
+ */
+JSONWriter *json_writer_new_append(GString *contents, bool pretty)
 {
     JSONWriter *writer = g_new(JSONWriter, 1);
 
     writer->pretty = pretty;
     writer->need_comma = false;
-    writer->contents = g_string_new(NULL);
+    writer->contents = contents;
     writer->container_is_array = g_byte_array_new();
     return writer;
 }
 
+JSONWriter *json_writer_new(bool pretty)
+{
+    return json_writer_new_append(g_string_new(NULL), pretty);
+}
+
 const char *json_writer_get(JSONWriter *writer)
 {
     g_assert(!writer->container_is_array->len);
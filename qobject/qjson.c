@@ -226,6 +226,18 @@ GString *qobject_to_json_pretty(const QObject *obj, bool pretty)
     return json_writer_get_and_free(writer);
 }
 
+/*
+ * Append the JSON representation of @obj to @buf, saving the copy from
+ * a temporary string for callers that collect output in a buffer anyway.
+ */
+void qobject_to_json_append(GString *buf, const QObject *obj, bool pretty)
+{
+    JSONWriter *writer = json_writer_new_append(buf, pretty);
+
+    to_json(writer, NULL, obj);
+    json_writer_get_and_free(writer);
+}
+
 GString *qobject_to_json(const QObject *obj)
 {
     return qobject_to_json_pretty(obj, false);
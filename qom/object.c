@@ -408,6 +408,7 @@ static void type_initialize(TypeImpl *ti)
 
     ti->class->properties = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
                                                   object_property_free);
+    ti->class->properties_cache = NULL;
 
     ti->class->type = ti;
 
@@ -1321,6 +1322,30 @@ object_property_add(Object *obj, const char *name, const char *type,
                                    opaque, &error_abort);
 }
 
+/*
+ * Bumped whenever a class property is added.  This invalidates the
+ * flattened property tables of all classes, since the new property
+ * may be inherited by any number of subclasses.
+ */
+static unsigned class_properties_gen = 1;
+
+static ObjectProperty *object_class_property_find_walk(ObjectClass *klass,
+                                                       const char *name)
+{
+    ObjectClass *parent_klass;
+
+    parent_klass = object_class_get_parent(klass);
+    if (parent_klass) {
+        ObjectProperty *prop =
+            object_class_property_find_walk(parent_klass, name);
+        if (prop) {
+            return prop;
+        }
+    }
+
+    return g_hash_table_lookup(klass->properties, name);
+}
+
 ObjectProperty *
 object_class_property_add(ObjectClass *klass,
                           const char *name,
@@ -1332,7 +1357,7 @@ object_class_property_add(ObjectClass *klass,
 {
     ObjectProperty *prop;
 
-    assert(!object_class_property_find(klass, name));
+    assert(!object_class_property_find_walk(klass, name));
 
     prop = g_malloc0(sizeof(*prop));
 
@@ -1345,6 +1370,7 @@ object_class_property_add(ObjectClass *klass,
     prop->opaque = opaque;
 
     g_hash_table_insert(klass->properties, prop->name, prop);
+    class_properties_gen++;
 
     return prop;
 }
@@ -1400,20 +1426,44 @@ void object_class_property_iter_init(ObjectPropertyIterator *iter,
     iter->nextclass = object_class_get_parent(klass);
 }
 
-ObjectProperty *object_class_property_find(ObjectClass *klass, const char *name)
+/*
+ * Looking up a property by name used to cost one hash table lookup per
+ * level of the class hierarchy.  Instead, keep a single table with the
+ * properties of @klass and all its parents.
+ */
+static GHashTable *object_class_properties_cache(ObjectClass *klass)
 {
-    ObjectClass *parent_klass;
+    GHashTable *cache = klass->properties_cache;
+    ObjectClass *k;
 
-    parent_klass = object_class_get_parent(klass);
-    if (parent_klass) {
-        ObjectProperty *prop =
-            object_class_property_find(parent_klass, name);
-        if (prop) {
-            return prop;
+    if (cache && klass->properties_cache_gen == class_properties_gen) {
+        return cache;
+    }
+
+    if (cache) {
+        g_hash_table_unref(cache);
+    }
+    cache = g_hash_table_new(g_str_hash, g_str_equal);
+
+    /* Parents come last so that they win, like in the hierarchy walk */
+    for (k = klass; k; k = object_class_get_parent(k)) {
+        GHashTableIter iter;
+        gpointer key, value;
+
+        g_hash_table_iter_init(&iter, k->properties);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            g_hash_table_insert(cache, key, value);
         }
     }
 
-    return g_hash_table_lookup(klass->properties, name);
+    klass->properties_cache = cache;
+    klass->properties_cache_gen = class_properties_gen;
+    return cache;
+}
+
+ObjectProperty *object_class_property_find(ObjectClass *klass, const char *name)
+{
+    return g_hash_table_lookup(object_class_properties_cache(klass), name);
 }
 
 ObjectProperty *object_class_property_find_err(ObjectClass *klass,
@@ -212,4 +212,7 @@ G_NORETURN void replay_sync_error(const char *error);
    to make cached timers available for post_load functions. */
 void replay_vmstate_register(void);
 
+/* Starts taking periodic snapshots if rrsnapshot-period was given. */
+void replay_snapshot_timer_init(void);
+
 #endif
@@ -16,8 +16,16 @@
 #include "monitor/monitor.h"
 #include "qapi/qmp/qstring.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
 #include "migration/vmstate.h"
 #include "migration/snapshot.h"
+#include "sysemu/runstate.h"
+
+/* How often to check whether a periodic snapshot is due, in ms */
+#define REPLAY_SNAPSHOT_CHECK_MS 100
+
+static QEMUTimer *replay_snapshot_timer;
+static uint64_t replay_snapshot_next_icount;
 
 static int replay_pre_save(void *opaque)
 {
@@ -97,3 +105,47 @@ bool replay_can_snapshot(void)
     return replay_mode == REPLAY_MODE_NONE
         || !replay_has_events();
 }
+
+/*
+ * Take a snapshot every replay_snapshot_period instructions, so that
+ * replay_seek() never has to replay more than that many instructions.
+ * The snapshots are named after the instruction count at which they are
+ * taken and are found by their icount like any other snapshot.
+ *
+ * In replay mode, seeking backwards rewinds the icount below the next
+ * snapshot point, so existing snapshots are not taken again.
+ */
+static void replay_snapshot_timer_cb(void *opaque)
+{
+    uint64_t icount = replay_get_current_icount();
+    g_autofree char *name = NULL;
+    Error *err = NULL;
+
+    timer_mod(replay_snapshot_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME)
+              + REPLAY_SNAPSHOT_CHECK_MS);
+
+    if (icount < replay_snapshot_next_icount || !runstate_is_running()
+        || !replay_can_snapshot()) {
+        return;
+    }
+
+    name = g_strdup_printf("%s-%" PRIu64, replay_snapshot ?: "rr", icount);
+    replay_snapshot_next_icount = icount + replay_snapshot_period;
+    if (!save_snapshot(name, true, NULL, false, NULL, &err)) {
+        error_reportf_err(err, "Could not create periodic snapshot: ");
+    }
+}
+
+void replay_snapshot_timer_init(void)
+{
+    if (!replay_snapshot_period) {
+        return;
+    }
+
+    replay_snapshot_next_icount = replay_get_current_icount()
+                                  + replay_snapshot_period;
+    replay_snapshot_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                         replay_snapshot_timer_cb, NULL);
+    timer_mod(replay_snapshot_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME)
+              + REPLAY_SNAPSHOT_CHECK_MS);
+}
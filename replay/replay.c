@@ -28,6 +28,7 @@
 
 ReplayMode replay_mode = REPLAY_MODE_NONE;
 char *replay_snapshot;
+uint64_t replay_snapshot_period;
 
 /* Name of replay file  */
 static char *replay_filename;
@@ -422,6 +423,7 @@ void replay_configure(QemuOpts *opts)
     }
 
     replay_snapshot = g_strdup(qemu_opt_get(opts, "rrsnapshot"));
+    replay_snapshot_period = qemu_opt_get_number(opts, "rrsnapshot-period", 0);
     replay_vmstate_register();
     replay_enable(fname, mode);
 
@@ -444,7 +446,7 @@ void replay_start(void)
         exit(1);
     }
 
-    /* Timer for snapshotting will be set up here. */
+    replay_snapshot_timer_init();
 
     replay_enable_events();
 }
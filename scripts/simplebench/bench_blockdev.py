@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+#
+# Benchmark block graphs and workloads with qemu-img bench
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Each test case is a block graph (qcow2 over file, optionally below a
+# throttle, copy-on-read or LUKS layer) combined with a workload (random or
+# sequential, read, write or mixed, queue depth, number of iothreads).
+# Each test env is a qemu-img binary, so that two builds can be compared:
+#
+#   bench_blockdev.py --dir /mnt/ssd old:/path/to/qemu-img new:./qemu-img
+#
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+import simplebench
+from results_to_text import results_to_text
+
+
+IMAGE_SIZE = '4G'
+SECRET = 'secret,id=bench-sec,data=bench'
+THROTTLE = 'throttle-group,id=bench-tg,x-iops-total=1000000'
+
+
+def qemu_img(binary, *args):
+    subprocess.run([binary] + list(args), check=True,
+                   stdout=subprocess.DEVNULL)
+
+
+def create_images(binary, directory):
+    """Create the images used by the graphs, return their paths"""
+    qcow2 = os.path.join(directory, 'bench.qcow2')
+    luks = os.path.join(directory, 'bench.luks.qcow2')
+
+    qemu_img(binary, 'create', '-f', 'qcow2', qcow2, IMAGE_SIZE)
+    qemu_img(binary, 'create', '--object', SECRET, '-f', 'qcow2',
+             '-o', 'encrypt.format=luks,encrypt.key-secret=bench-sec',
+             luks, IMAGE_SIZE)
+
+    # Allocate the images so that reads do not only hit unallocated clusters
+    for img, obj in ((qcow2, []), (luks, ['--object', SECRET])):
+        opts = graph_qcow2(img) if not obj else graph_luks(img)
+        qemu_img(binary, 'bench', *obj, '-w', '-c', '4096', '-s', '1M',
+                 'json:' + json.dumps(opts))
+    return qcow2, luks
+
+
+def graph_qcow2(path):
+    return {'driver': 'qcow2',
+            'file': {'driver': 'file', 'filename': path}}
+
+
+def graph_luks(path):
+    graph = graph_qcow2(path)
+    graph['encrypt.key-secret'] = 'bench-sec'
+    return graph
+
+
+def graph_filter(driver, child, **opts):
+    return dict({'driver': driver, 'file': child}, **opts)
+
+
+def bench_func(env, case):
+    """Run one qemu-img bench for a graph and a workload"""
+    args = [env['qemu_img'], 'bench', '-t', 'none', '-i', 'native',
+            '-c', str(case['count']), '-d', str(case['depth']),
+            '-s', str(case['block_size'])]
+    for obj in case.get('objects', []):
+        args += ['--object', obj]
+    if case['random']:
+        args.append('--random')
+    if case['write_percent']:
+        args.append('--write-percent=%d' % case['write_percent'])
+    if case['iothreads']:
+        args.append('--iothreads=%d' % case['iothreads'])
+    args.append('json:' + json.dumps(case['graph']))
+
+    p = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                       universal_newlines=True)
+    if p.returncode:
+        lines = p.stdout.strip().splitlines()
+        return {'error': lines[-1] if lines else 'qemu-img bench failed'}
+
+    iops = re.search(r'^(\d+) IOPS', p.stdout, re.MULTILINE)
+    lat = re.search(r'p99 ([\d.]+)', p.stdout)
+    cpu = re.search(r'([\d.]+) us per request', p.stdout)
+    if not iops:
+        return {'error': 'cannot parse qemu-img output'}
+
+    result = {'iops': int(iops.group(1))}
+    if lat:
+        result['p99-latency-us'] = float(lat.group(1))
+    if cpu:
+        result['cpu-us-per-request'] = float(cpu.group(1))
+    return result
+
+
+def test_cases(qcow2, luks, count):
+    graphs = {
+        'qcow2': (graph_qcow2(qcow2), []),
+        'throttle': (graph_filter('throttle', graph_qcow2(qcow2),
+                                  **{'throttle-group': 'bench-tg'}),
+                     [THROTTLE]),
+        'cor': (graph_filter('copy-on-read', graph_qcow2(qcow2)), []),
+        'luks': (graph_luks(luks), [SECRET]),
+    }
+    workloads = [
+        # name, random, write %, block size, depth, iothreads
+        ('randread-4k-qd1', True, 0, 4096, 1, 0),
+        ('randread-4k-qd32', True, 0, 4096, 32, 0),
+        ('randrw-4k-qd32', True, 30, 4096, 32, 0),
+        ('randread-4k-qd32-4t', True, 0, 4096, 32, 4),
+        ('seqwrite-64k-qd8', False, 100, 65536, 8, 0),
+    ]
+
+    cases = []
+    for gname, (graph, objects) in graphs.items():
+        for wname, random, write, bs, depth, iothreads in workloads:
+            cases.append({
+                'id': '%s %s' % (gname, wname),
+                'graph': graph,
+                'objects': objects,
+                'random': random,
+                'write_percent': write,
+                'block_size': bs,
+                'depth': depth,
+                'iothreads': iothreads,
+                'count': count,
+            })
+    return cases
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compare qemu-img binaries on block graph workloads')
+    parser.add_argument('--dir', required=True,
+                        help='directory for the test images')
+    parser.add_argument('--count', type=int, default=100000,
+                        help='requests per run')
+    parser.add_argument('--runs', type=int, default=3,
+                        help='runs per test case')
+    parser.add_argument('binaries', nargs='+', metavar='ID:QEMU_IMG',
+                        help='qemu-img binaries to compare')
+    args = parser.parse_args()
+
+    envs = []
+    for b in args.binaries:
+        env_id, _, path = b.rpartition(':')
+        envs.append({'id': env_id or path, 'qemu_img': path})
+
+    qcow2, luks = create_images(envs[0]['qemu_img'], args.dir)
+    try:
+        cases = test_cases(qcow2, luks, args.count)
+        result = simplebench.bench(bench_func, envs, cases,
+                                   count=args.runs)
+        print(results_to_text(result))
+    finally:
+        os.unlink(qcow2)
+        os.unlink(luks)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -31,8 +31,9 @@
 record_type_event = 1
 
 log_header_fmt = '=QQQ'
-rec_header_fmt = '=QQII'
-rec_header_fmt_len = struct.calcsize(rec_header_fmt)
+log_version = 5
+rec_header_fmt = '=QQIII4x'
+rec_header_fmt_v4 = '=QQII'
 
 class SimpleException(Exception):
     pass
@@ -52,32 +53,42 @@ def get_mapping(fobj):
 
     return (event_id, name)
 
-def read_record(fobj):
-    """Deserialize a trace record from a file into a tuple (event_num, timestamp, pid, args)."""
-    event_id, timestamp_ns, record_length, record_pid = read_header(fobj, rec_header_fmt)
-    args_payload = fobj.read(record_length - rec_header_fmt_len)
-    return (event_id, timestamp_ns, record_pid, args_payload)
+def read_record(fobj, version):
+    """Deserialize a trace record from a file into a tuple (event_num, timestamp, pid, tid, args).
+
+    The tid is None for version 4 records, which do not have one."""
+    if version == 4:
+        event_id, timestamp_ns, record_length, record_pid = read_header(fobj, rec_header_fmt_v4)
+        record_tid = None
+        hdr_len = struct.calcsize(rec_header_fmt_v4)
+    else:
+        event_id, timestamp_ns, record_length, record_pid, record_tid = read_header(fobj, rec_header_fmt)
+        hdr_len = struct.calcsize(rec_header_fmt)
+    args_payload = fobj.read(record_length - hdr_len)
+    return (event_id, timestamp_ns, record_pid, record_tid, args_payload)
 
 def read_trace_header(fobj):
-    """Read and verify trace file header"""
-    _header_event_id, _header_magic, log_version = read_header(fobj, log_header_fmt)
+    """Read and verify trace file header, returning the format version"""
+    _header_event_id, _header_magic, version = read_header(fobj, log_header_fmt)
     if _header_event_id != header_event_id:
         raise ValueError(f'Not a valid trace file, header id {_header_event_id} != {header_event_id}')
     if _header_magic != header_magic:
         raise ValueError(f'Not a valid trace file, header magic {_header_magic} != {header_magic}')
 
-    if log_version not in [0, 2, 3, 4]:
-        raise ValueError(f'Unknown version {log_version} of tracelog format!')
-    if log_version != 4:
-        raise ValueError(f'Log format {log_version} not supported with this QEMU release!')
+    if version not in [0, 2, 3, 4, 5]:
+        raise ValueError(f'Unknown version {version} of tracelog format!')
+    if version < 4:
+        raise ValueError(f'Log format {version} not supported with this QEMU release!')
+    return version
 
-def read_trace_records(events, fobj, read_header):
-    """Deserialize trace records from a file, yielding record tuples (event, event_num, timestamp, pid, arg1, ..., arg6).
+def read_trace_records(events, fobj, read_header, version=log_version):
+    """Deserialize trace records from a file, yielding record tuples (event, event_num, timestamp, pid, tid, arg1, ..., arg6).
 
     Args:
         event_mapping (str -> Event): events dict, indexed by name
         fobj (file): input file
         read_header (bool): whether headers were read from fobj
+        version (int): format version of the records
 
     """
     frameinfo = inspect.getframeinfo(inspect.currentframe())
@@ -103,7 +114,7 @@ def read_trace_records(events, fobj, read_header):
             event_id, event_name = get_mapping(fobj)
             event_id_to_name[event_id] = event_name
         else:
-            event_id, timestamp_ns, pid, args_payload = read_record(fobj)
+            event_id, timestamp_ns, pid, tid, args_payload = read_record(fobj, version)
             event_name = event_id_to_name[event_id]
 
             try:
@@ -128,7 +139,7 @@ def read_trace_records(events, fobj, read_header):
                     offset += 8
                     args.append(value)
 
-            yield (event_mapping[event_name], event_name, timestamp_ns, pid) + tuple(args)
+            yield (event_mapping[event_name], event_name, timestamp_ns, pid, tid) + tuple(args)
 
 class Analyzer:
     """[Deprecated. Refer to Analyzer2 instead.]
@@ -239,6 +250,8 @@ class Analyzer2(Analyzer):
         event_id: The id of the event in the current trace file
         timestamp_ns: The timestamp in nanoseconds of the trace
         pid: The process id recorded for the given trace
+        tid: The thread id recorded for the given trace, or None for trace
+             files written by QEMU releases that did not record it
 
     Example:
     The following method handles the runstate_set(int new_state) trace event::
@@ -306,17 +319,19 @@ def _process(events, log_fobj, analyzer, read_header=True):
         read_header (bool, optional): Whether to read header data from the log data. Defaults to True.
     """
 
+    version = log_version
     if read_header:
-        read_trace_header(log_fobj)
+        version = read_trace_header(log_fobj)
 
     with analyzer:
-        for event, event_id, timestamp_ns, record_pid, *rec_args in read_trace_records(events, log_fobj, read_header):
+        for event, event_id, timestamp_ns, record_pid, record_tid, *rec_args in read_trace_records(events, log_fobj, read_header, version):
             analyzer._process_event(
                 rec_args,
                 event=event,
                 event_id=event_id,
                 timestamp_ns=timestamp_ns,
                 pid=record_pid,
+                tid=record_tid,
             )
 
 def run(analyzer):
@@ -340,7 +355,7 @@ class Formatter2(Analyzer2):
         def __init__(self):
             self.last_timestamp_ns = None
 
-        def catchall(self, *rec_args, event, timestamp_ns, pid, event_id):
+        def catchall(self, *rec_args, event, timestamp_ns, pid, event_id, tid=None, **kwargs):
             if self.last_timestamp_ns is None:
                 self.last_timestamp_ns = timestamp_ns
             delta_ns = timestamp_ns - self.last_timestamp_ns
@@ -350,7 +365,8 @@ def catchall(self, *rec_args, event, timestamp_ns, pid, event_id):
                 f'{name}={r}' if is_string(type) else f'{name}=0x{r:x}'
                 for r, (type, name) in zip(rec_args, event.args)
             ]
-            print(f'{event.name} {delta_ns / 1000:0.3f} {pid=} ' + ' '.join(fields))
+            ids = f'{pid=} {tid=} ' if tid is not None else f'{pid=} '
+            print(f'{event.name} {delta_ns / 1000:0.3f} ' + ids + ' '.join(fields))
 
     try:
         run(Formatter2())
@@ -0,0 +1,81 @@
+/*
+ * query-stats provider for QEMU-internal counters
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/module.h"
+#include "qemu/stats-counter.h"
+#include "sysemu/stats.h"
+
+typedef struct StatsCounterQuery {
+    strList *names;
+    StatsList *list;
+} StatsCounterQuery;
+
+static void stats_counter_add_stat(const char *name, uint64_t value,
+                                   void *opaque)
+{
+    StatsCounterQuery *query = opaque;
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, query->names)) {
+        return;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QNUM;
+    stats->value->u.scalar = value;
+    QAPI_LIST_PREPEND(query->list, stats);
+}
+
+static void stats_counter_query_stats_cb(StatsResultList **result,
+                                         StatsTarget target,
+                                         strList *names, strList *targets,
+                                         Error **errp)
+{
+    StatsCounterQuery query = { .names = names };
+
+    if (target != STATS_TARGET_VM) {
+        return;
+    }
+
+    stats_counter_foreach(stats_counter_add_stat, &query);
+    if (query.list) {
+        add_stats_entry(result, STATS_PROVIDER_QEMU, NULL, query.list);
+    }
+}
+
+static void stats_counter_add_schema(const char *name, uint64_t value,
+                                     void *opaque)
+{
+    StatsSchemaValueList **list = opaque;
+    StatsSchemaValue *schema = g_new0(StatsSchemaValue, 1);
+
+    schema->name = g_strdup(name);
+    schema->type = STATS_TYPE_CUMULATIVE;
+    QAPI_LIST_PREPEND(*list, schema);
+}
+
+static void stats_counter_query_schemas_cb(StatsSchemaList **result,
+                                           Error **errp)
+{
+    StatsSchemaValueList *list = NULL;
+
+    stats_counter_foreach(stats_counter_add_schema, &list);
+    if (list) {
+        add_stats_schema(result, STATS_PROVIDER_QEMU, STATS_TARGET_VM, list);
+    }
+}
+
+static void stats_counters_register(void)
+{
+    add_stats_callbacks_thread_safe(STATS_PROVIDER_QEMU,
+                                    stats_counter_query_stats_cb,
+                                    stats_counter_query_schemas_cb);
+}
+
+type_init(stats_counters_register);
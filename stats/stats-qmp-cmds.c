@@ -8,29 +8,49 @@
 #include "qemu/osdep.h"
 #include "sysemu/stats.h"
 #include "qapi/qapi-commands-stats.h"
-#include "qemu/queue.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/rcu_queue.h"
 #include "qapi/error.h"
 
 typedef struct StatsCallbacks {
     StatsProvider provider;
     StatRetrieveFunc *stats_cb;
     SchemaRetrieveFunc *schemas_cb;
+    bool thread_safe;
     QTAILQ_ENTRY(StatsCallbacks) next;
 } StatsCallbacks;
 
+/* Written under the BQL, read under RCU by out-of-band query-stats */
 static QTAILQ_HEAD(, StatsCallbacks) stats_callbacks =
     QTAILQ_HEAD_INITIALIZER(stats_callbacks);
 
-void add_stats_callbacks(StatsProvider provider,
-                         StatRetrieveFunc *stats_fn,
-                         SchemaRetrieveFunc *schemas_fn)
+static void do_add_stats_callbacks(StatsProvider provider,
+                                   StatRetrieveFunc *stats_fn,
+                                   SchemaRetrieveFunc *schemas_fn,
+                                   bool thread_safe)
 {
     StatsCallbacks *entry = g_new(StatsCallbacks, 1);
     entry->provider = provider;
     entry->stats_cb = stats_fn;
     entry->schemas_cb = schemas_fn;
+    entry->thread_safe = thread_safe;
+
+    QTAILQ_INSERT_TAIL_RCU(&stats_callbacks, entry, next);
+}
 
-    QTAILQ_INSERT_TAIL(&stats_callbacks, entry, next);
+void add_stats_callbacks(StatsProvider provider,
+                         StatRetrieveFunc *stats_fn,
+                         SchemaRetrieveFunc *schemas_fn)
+{
+    do_add_stats_callbacks(provider, stats_fn, schemas_fn, false);
+}
+
+void add_stats_callbacks_thread_safe(StatsProvider provider,
+                                     StatRetrieveFunc *stats_fn,
+                                     SchemaRetrieveFunc *schemas_fn)
+{
+    do_add_stats_callbacks(provider, stats_fn, schemas_fn, true);
 }
 
 static bool invoke_stats_cb(StatsCallbacks *entry,
@@ -84,8 +104,25 @@ StatsResultList *qmp_query_stats(StatsFilter *filter, Error **errp)
     StatsResultList *stats_results = NULL;
     StatsCallbacks *entry;
     StatsRequestList *request;
-
-    QTAILQ_FOREACH(entry, &stats_callbacks, next) {
+    bool oob = !bql_locked();
+
+    RCU_READ_LOCK_GUARD();
+
+    QTAILQ_FOREACH_RCU(entry, &stats_callbacks, next) {
+        if (oob && !entry->thread_safe) {
+            /* Skip the provider, unless it was asked for */
+            for (request = filter->has_providers ? filter->providers : NULL;
+                 request; request = request->next) {
+                if (request->value->provider == entry->provider) {
+                    error_setg(errp, "Provider '%s' cannot be queried "
+                               "out-of-band",
+                               StatsProvider_str(entry->provider));
+                    qapi_free_StatsResultList(stats_results);
+                    return NULL;
+                }
+            }
+            continue;
+        }
         if (filter->has_providers) {
             for (request = filter->providers; request; request = request->next) {
                 if (!invoke_stats_cb(entry, &stats_results, filter,
@@ -111,7 +148,9 @@ StatsSchemaList *qmp_query_stats_schemas(bool has_provider,
     StatsSchemaList *stats_results = NULL;
     StatsCallbacks *entry;
 
-    QTAILQ_FOREACH(entry, &stats_callbacks, next) {
+    RCU_READ_LOCK_GUARD();
+
+    QTAILQ_FOREACH_RCU(entry, &stats_callbacks, next) {
         if (!has_provider || provider == entry->provider) {
             entry->schemas_cb(&stats_results, errp);
             if (*errp) {
@@ -240,6 +240,46 @@ qva_to_va(VuDev *dev, uint64_t qemu_addr)
     return NULL;
 }
 
+/* Translate qemu virtual address to guest physical address.  */
+static bool
+qva_to_gpa(VuDev *dev, uint64_t qemu_addr, uint64_t *guest_addr)
+{
+    unsigned int i;
+
+    /* Find matching memory region.  */
+    for (i = 0; i < dev->nregions; i++) {
+        VuDevRegion *r = &dev->regions[i];
+
+        if ((qemu_addr >= r->qva) && (qemu_addr < (r->qva + r->size))) {
+            *guest_addr = qemu_addr - r->qva + r->gpa;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Translate our virtual address to guest physical address.  */
+static bool
+va_to_gpa(VuDev *dev, const void *addr, uint64_t *guest_addr)
+{
+    uint64_t va = (uintptr_t)addr;
+    unsigned int i;
+
+    /* Find matching memory region.  */
+    for (i = 0; i < dev->nregions; i++) {
+        VuDevRegion *r = &dev->regions[i];
+        uint64_t start = r->mmap_addr + r->mmap_offset;
+
+        if ((va >= start) && (va < (start + r->size))) {
+            *guest_addr = va - start + r->gpa;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static void
 vmsg_close_fds(VhostUserMsg *vmsg)
 {
@@ -534,6 +574,13 @@ vu_get_features_exec(VuDev *dev, VhostUserMsg *vmsg)
         1ULL << VHOST_F_LOG_ALL |
         1ULL << VHOST_USER_F_PROTOCOL_FEATURES;
 
+    /* Inflight tracking is only implemented for split virtqueues. */
+    if (!dev->iface->get_protocol_features ||
+        !(dev->iface->get_protocol_features(dev) &
+          (1ULL << VHOST_USER_PROTOCOL_F_INFLIGHT_SHMFD))) {
+        vmsg->payload.u64 |= 1ULL << VIRTIO_F_RING_PACKED;
+    }
+
     if (dev->iface->get_features) {
         vmsg->payload.u64 |= dev->iface->get_features(dev);
     }
@@ -624,6 +671,21 @@ map_ring(VuDev *dev, VuVirtq *vq)
     DPRINT("    vring_used  at %p\n", vq->vring.used);
     DPRINT("    vring_avail at %p\n", vq->vring.avail);
 
+    /*
+     * A packed virtqueue has the descriptor ring in place of the split
+     * descriptor table, and the driver and device event suppression
+     * structures in place of the avail and used rings.
+     */
+    vq->vring.packed_desc = (struct vring_packed_desc *)vq->vring.desc;
+    vq->vring.driver_event =
+        (struct vring_packed_desc_event *)vq->vring.avail;
+    vq->vring.device_event =
+        (struct vring_packed_desc_event *)vq->vring.used;
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED) &&
+        !qva_to_gpa(dev, vq->vra.desc_user_addr, &vq->vring.packed_desc_gpa)) {
+        return true;
+    }
+
     return !(vq->vring.desc && vq->vring.used && vq->vring.avail);
 }
 
@@ -1160,7 +1222,10 @@ vu_set_vring_addr_exec(VuDev *dev, VhostUserMsg *vmsg)
         return false;
     }
 
-    vq->used_idx = le16toh(vq->vring.used->idx);
+    /* A packed virtqueue gets its used index from VHOST_USER_SET_VRING_BASE */
+    if (!vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        vq->used_idx = le16toh(vq->vring.used->idx);
+    }
 
     if (vq->last_avail_idx != vq->used_idx) {
         bool resume = dev->iface->queue_is_processed_in_order &&
@@ -1172,6 +1237,7 @@ vu_set_vring_addr_exec(VuDev *dev, VhostUserMsg *vmsg)
 
         if (resume) {
             vq->shadow_avail_idx = vq->last_avail_idx = vq->used_idx;
+            vq->last_avail_wrap_counter = vq->used_wrap_counter;
         }
     }
 
@@ -1183,10 +1249,25 @@ vu_set_vring_base_exec(VuDev *dev, VhostUserMsg *vmsg)
 {
     unsigned int index = vmsg->payload.state.index;
     unsigned int num = vmsg->payload.state.num;
+    VuVirtq *vq = &dev->vq[index];
 
     DPRINT("State.index: %u\n", index);
     DPRINT("State.num:   %u\n", num);
-    dev->vq[index].shadow_avail_idx = dev->vq[index].last_avail_idx = num;
+
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        /*
+         * The low half holds the last avail index, the high half the used
+         * index, each with its wrap counter in the top bit.
+         */
+        vq->shadow_avail_idx = vq->last_avail_idx = num & 0x7fff;
+        vq->last_avail_wrap_counter = !!(num & 0x8000);
+        vq->used_idx = (num >> 16) & 0x7fff;
+        vq->used_wrap_counter = !!(num & 0x80000000);
+        vq->signalled_used_valid = false;
+        return false;
+    }
+
+    vq->shadow_avail_idx = vq->last_avail_idx = num;
 
     return false;
 }
@@ -1197,7 +1278,15 @@ vu_get_vring_base_exec(VuDev *dev, VhostUserMsg *vmsg)
     unsigned int index = vmsg->payload.state.index;
 
     DPRINT("State.index: %u\n", index);
-    vmsg->payload.state.num = dev->vq[index].last_avail_idx;
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        VuVirtq *vq = &dev->vq[index];
+
+        vmsg->payload.state.num =
+            (vq->last_avail_idx | vq->last_avail_wrap_counter << 15 |
+             (uint32_t)(vq->used_idx | vq->used_wrap_counter << 15) << 16);
+    } else {
+        vmsg->payload.state.num = dev->vq[index].last_avail_idx;
+    }
     vmsg->size = sizeof(vmsg->payload.state);
 
     dev->vq[index].started = false;
@@ -1263,7 +1352,8 @@ vu_check_queue_inflights(VuDev *dev, VuVirtq *vq)
 {
     int i = 0;
 
-    if (!vu_has_protocol_feature(dev, VHOST_USER_PROTOCOL_F_INFLIGHT_SHMFD)) {
+    if (!vu_has_protocol_feature(dev, VHOST_USER_PROTOCOL_F_INFLIGHT_SHMFD) ||
+        vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
         return 0;
     }
 
@@ -1283,7 +1373,17 @@ vu_check_queue_inflights(VuDev *dev, VuVirtq *vq)
     vq->counter = 0;
 
     if (unlikely(vq->inflight->used_idx != vq->used_idx)) {
-        vq->inflight->desc[vq->inflight->last_batch_head].inflight = 0;
+        uint16_t head = vq->inflight->last_batch_head;
+        uint16_t num = vq->used_idx - vq->inflight->used_idx;
+
+        /*
+         * The last batch was published but not cleared: walk its list.
+         * A single vu_queue_push() is a batch of one.
+         */
+        while (num-- && head < vq->inflight->desc_num) {
+            vq->inflight->desc[head].inflight = 0;
+            head = vq->inflight->desc[head].next;
+        }
 
         barrier();
 
@@ -2145,6 +2245,9 @@ vu_deinit(VuDev *dev)
             vq->resubmit_list = NULL;
         }
 
+        free(vq->used_elems);
+        vq->used_elems = NULL;
+
         vq->inflight = NULL;
     }
 
@@ -2362,6 +2465,144 @@ virtqueue_read_next_desc(VuDev *dev, struct vring_desc *desc,
     return VIRTQUEUE_READ_DESC_MORE;
 }
 
+static inline bool
+vring_packed_desc_is_avail(uint16_t flags, bool wrap_counter)
+{
+    bool avail = flags & (1 << VRING_PACKED_DESC_F_AVAIL);
+    bool used = flags & (1 << VRING_PACKED_DESC_F_USED);
+
+    return avail != used && avail == wrap_counter;
+}
+
+static inline void
+vring_packed_advance(VuVirtq *vq, uint16_t *idx, bool *wrap_counter,
+                     unsigned int num)
+{
+    *idx += num;
+    if (*idx >= vq->vring.num) {
+        *idx -= vq->vring.num;
+        *wrap_counter ^= 1;
+    }
+}
+
+static bool
+vu_queue_packed_empty(VuDev *dev, VuVirtq *vq)
+{
+    uint16_t flags = le16toh(vq->vring.packed_desc[vq->last_avail_idx].flags);
+
+    return !vring_packed_desc_is_avail(flags, vq->last_avail_wrap_counter);
+}
+
+/*
+ * Return the indirect table referenced by @desc, copied to @desc_buf if it
+ * is not contiguous in our address space, and its size in @max.
+ */
+static struct vring_packed_desc *
+vring_packed_indirect_table(VuDev *dev, const struct vring_packed_desc *desc,
+                            struct vring_packed_desc *desc_buf,
+                            unsigned int *max)
+{
+    struct vring_packed_desc *table;
+    uint64_t desc_addr = le64toh(desc->addr), read_len;
+    unsigned int desc_len = le32toh(desc->len);
+
+    if (desc_len % sizeof(struct vring_packed_desc)) {
+        vu_panic(dev, "Invalid size for indirect buffer table");
+        return NULL;
+    }
+
+    read_len = desc_len;
+    table = vu_gpa_to_va(dev, &read_len, desc_addr);
+    if (unlikely(table && read_len != desc_len)) {
+        /* Failed to use zero copy */
+        table = NULL;
+        if (!virtqueue_read_indirect_desc(dev, (struct vring_desc *)desc_buf,
+                                          desc_addr, desc_len)) {
+            table = desc_buf;
+        }
+    }
+    if (!table) {
+        vu_panic(dev, "Invalid indirect buffer table");
+        return NULL;
+    }
+
+    *max = desc_len / sizeof(struct vring_packed_desc);
+    return table;
+}
+
+static bool
+vu_queue_packed_get_avail_bytes(VuDev *dev, VuVirtq *vq,
+                                unsigned int *in_total,
+                                unsigned int *out_total,
+                                unsigned max_in_bytes, unsigned max_out_bytes)
+{
+    struct vring_packed_desc *ring = vq->vring.packed_desc;
+    struct vring_packed_desc desc_buf[VIRTQUEUE_MAX_SIZE];
+    uint16_t idx = vq->last_avail_idx;
+    bool wrap_counter = vq->last_avail_wrap_counter;
+    unsigned int total_descs = 0;
+
+    while (total_descs < vq->vring.num &&
+           vring_packed_desc_is_avail(le16toh(ring[idx].flags),
+                                      wrap_counter)) {
+        struct vring_packed_desc *desc = ring;
+        unsigned int max = vq->vring.num, num_bufs = 0, ndescs = 0;
+        unsigned int i = idx;
+        bool indirect = false;
+
+        /* Read the chain only after seeing its head available */
+        smp_rmb();
+
+        if (le16toh(ring[i].flags) & VRING_DESC_F_INDIRECT) {
+            desc = vring_packed_indirect_table(dev, &ring[i], desc_buf, &max);
+            if (!desc) {
+                return false;
+            }
+            indirect = true;
+            ndescs = 1;
+            i = 0;
+        }
+
+        for (;;) {
+            uint16_t flags = le16toh(desc[i].flags);
+
+            /* If we've got too many, that implies a descriptor loop. */
+            if (++num_bufs > max) {
+                vu_panic(dev, "Looped descriptor");
+                return false;
+            }
+
+            if (flags & VRING_DESC_F_WRITE) {
+                *in_total += le32toh(desc[i].len);
+            } else {
+                *out_total += le32toh(desc[i].len);
+            }
+            if (*in_total >= max_in_bytes && *out_total >= max_out_bytes) {
+                return true;
+            }
+
+            if (indirect) {
+                if (++i == max) {
+                    break;
+                }
+            } else {
+                ndescs++;
+                if (!(flags & VRING_DESC_F_NEXT)) {
+                    break;
+                }
+                if (++i == vq->vring.num) {
+                    i = 0;
+                }
+            }
+        }
+
+        total_descs += ndescs;
+        vring_packed_advance(vq, &idx, &wrap_counter, ndescs);
+    }
+
+    return true;
+}
+
 void
 vu_queue_get_avail_bytes(VuDev *dev, VuVirtq *vq, unsigned int *in_bytes,
                          unsigned int *out_bytes,
@@ -2379,6 +2620,14 @@ vu_queue_get_avail_bytes(VuDev *dev, VuVirtq *vq, unsigned int *in_bytes,
         goto done;
     }
 
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        if (!vu_queue_packed_get_avail_bytes(dev, vq, &in_total, &out_total,
+                                             max_in_bytes, max_out_bytes)) {
+            goto err;
+        }
+        goto done;
+    }
+
     while ((rc = virtqueue_num_heads(dev, vq, idx)) > 0) {
         unsigned int max, desc_len, num_bufs, indirect = 0;
         uint64_t desc_addr, read_len;
@@ -2495,6 +2744,10 @@ vu_queue_empty(VuDev *dev, VuVirtq *vq)
         return true;
     }
 
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        return vu_queue_packed_empty(dev, vq);
+    }
+
     if (vq->shadow_avail_idx != vq->last_avail_idx) {
         return false;
     }
@@ -2502,6 +2755,41 @@ vu_queue_empty(VuDev *dev, VuVirtq *vq)
     return vring_avail_idx(vq) == vq->last_avail_idx;
 }
 
+static bool
+vring_packed_notify(VuDev *dev, VuVirtq *vq)
+{
+    struct vring_packed_desc_event *e = vq->vring.driver_event;
+    uint16_t old, new, flags, off_wrap;
+    int off;
+    bool v;
+
+    flags = le16toh(e->flags);
+    if (flags == VRING_PACKED_EVENT_FLAG_DISABLE) {
+        return false;
+    }
+    if (flags == VRING_PACKED_EVENT_FLAG_ENABLE ||
+        !vu_has_feature(dev, VIRTIO_RING_F_EVENT_IDX)) {
+        return true;
+    }
+
+    /* Make sure flags is seen before off_wrap */
+    smp_rmb();
+    off_wrap = le16toh(e->off_wrap);
+
+    v = vq->signalled_used_valid;
+    vq->signalled_used_valid = true;
+    old = vq->signalled_used;
+    new = vq->signalled_used = vq->used_idx;
+
+    /* Bring the event offset into the same lap as the used index */
+    off = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+    if (vq->used_wrap_counter != off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) {
+        off -= vq->vring.num;
+    }
+
+    return !v || vring_need_event(off, new, old);
+}
+
 static bool
 vring_notify(VuDev *dev, VuVirtq *vq)
 {
@@ -2517,6 +2805,10 @@ vring_notify(VuDev *dev, VuVirtq *vq)
         return true;
     }
 
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        return vring_packed_notify(dev, vq);
+    }
+
     if (!vu_has_feature(dev, VIRTIO_RING_F_EVENT_IDX)) {
         return !(vring_avail_flags(vq) & VRING_AVAIL_F_NO_INTERRUPT);
     }
@@ -2624,11 +2916,44 @@ vring_set_avail_event(VuVirtq *vq, uint16_t val)
     memcpy(&vq->vring.used->ring[vq->vring.num], &val_le, sizeof(uint16_t));
 }
 
+static inline void
+vring_packed_set_avail_event(VuVirtq *vq)
+{
+    uint16_t off_wrap = vq->last_avail_idx |
+        vq->last_avail_wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR;
+
+    if (!vq->notification) {
+        return;
+    }
+
+    vq->vring.device_event->off_wrap = htole16(off_wrap);
+}
+
+static void
+vu_queue_packed_set_notification(VuDev *dev, VuVirtq *vq, int enable)
+{
+    uint16_t flags;
+
+    if (!enable) {
+        flags = VRING_PACKED_EVENT_FLAG_DISABLE;
+    } else if (vu_has_feature(dev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_packed_set_avail_event(vq);
+        /* Make sure off_wrap is written before flags */
+        smp_wmb();
+        flags = VRING_PACKED_EVENT_FLAG_DESC;
+    } else {
+        flags = VRING_PACKED_EVENT_FLAG_ENABLE;
+    }
+    vq->vring.device_event->flags = htole16(flags);
+}
+
 void
 vu_queue_set_notification(VuDev *dev, VuVirtq *vq, int enable)
 {
     vq->notification = enable;
-    if (vu_has_feature(dev, VIRTIO_RING_F_EVENT_IDX)) {
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        vu_queue_packed_set_notification(dev, vq, enable);
+    } else if (vu_has_feature(dev, VIRTIO_RING_F_EVENT_IDX)) {
         vring_set_avail_event(vq, vring_avail_idx(vq));
     } else if (enable) {
         vring_used_flags_unset_bit(vq, VRING_USED_F_NO_NOTIFY);
@@ -2694,6 +3019,7 @@ virtqueue_alloc_element(size_t sz,
         DPRINT("%s: failed to malloc virtqueue element\n", __func__);
         return NULL;
     }
+    elem->ndescs = 0;
     elem->out_num = out_num;
     elem->in_num = in_num;
     elem->in_sg = (void *)elem + in_sg_ofs;
@@ -2794,6 +3120,134 @@ vu_queue_map_desc(VuDev *dev, VuVirtq *vq, unsigned int idx, size_t sz)
     return elem;
 }
 
+static void *
+vu_queue_packed_map_desc(VuDev *dev, VuVirtq *vq, unsigned int idx, size_t sz)
+{
+    struct vring_packed_desc *desc = vq->vring.packed_desc;
+    struct vring_packed_desc desc_buf[VIRTQUEUE_MAX_SIZE];
+    struct iovec iov[VIRTQUEUE_MAX_SIZE];
+    unsigned int out_num = 0, in_num = 0, num_bufs = 0, ndescs = 0;
+    unsigned int max = vq->vring.num;
+    unsigned int i = idx;
+    VuVirtqElement *elem;
+    bool indirect = false;
+    uint16_t id = 0;
+
+    if (le16toh(desc[i].flags) & VRING_DESC_F_INDIRECT) {
+        id = le16toh(desc[i].id);
+        desc = vring_packed_indirect_table(dev, &desc[i], desc_buf, &max);
+        if (!desc) {
+            return NULL;
+        }
+        indirect = true;
+        ndescs = 1;
+        i = 0;
+    }
+
+    /* Collect all the descriptors */
+    for (;;) {
+        uint16_t flags = le16toh(desc[i].flags);
+
+        /* If we've got too many, that implies a descriptor loop. */
+        if (++num_bufs > max) {
+            vu_panic(dev, "Looped descriptor");
+            return NULL;
+        }
+
+        if (flags & VRING_DESC_F_WRITE) {
+            if (!virtqueue_map_desc(dev, &in_num, iov + out_num,
+                               VIRTQUEUE_MAX_SIZE - out_num, true,
+                               le64toh(desc[i].addr),
+                               le32toh(desc[i].len))) {
+                return NULL;
+            }
+        } else {
+            if (in_num) {
+                vu_panic(dev, "Incorrect order for descriptors");
+                return NULL;
+            }
+            if (!virtqueue_map_desc(dev, &out_num, iov,
+                               VIRTQUEUE_MAX_SIZE, false,
+                               le64toh(desc[i].addr),
+                               le32toh(desc[i].len))) {
+                return NULL;
+            }
+        }
+
+        if (indirect) {
+            /* The whole table is one buffer; F_NEXT is not used */
+            if (++i == max) {
+                break;
+            }
+        } else {
+            /* The buffer id is in the last descriptor of the chain */
+            id = le16toh(desc[i].id);
+            ndescs++;
+            if (!(flags & VRING_DESC_F_NEXT)) {
+                break;
+            }
+            if (++i == vq->vring.num) {
+                i = 0;
+            }
+        }
+    }
+
+    /* Now copy what we have collected and mapped */
+    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    if (!elem) {
+        return NULL;
+    }
+    elem->index = id;
+    elem->ndescs = ndescs;
+    for (i = 0; i < out_num; i++) {
+        elem->out_sg[i] = iov[i];
+    }
+    for (i = 0; i < in_num; i++) {
+        elem->in_sg[i] = iov[out_num + i];
+    }
+
+    return elem;
+}
+
+static void *
+vu_queue_packed_pop(VuDev *dev, VuVirtq *vq, size_t sz)
+{
+    VuVirtqElement *elem;
+
+    if (vu_queue_packed_empty(dev, vq)) {
+        return NULL;
+    }
+    /* Read the descriptors only after seeing the head available */
+    smp_rmb();
+
+    if (vq->inuse >= vq->vring.num) {
+        vu_panic(dev, "Virtqueue size exceeded");
+        return NULL;
+    }
+
+    elem = vu_queue_packed_map_desc(dev, vq, vq->last_avail_idx, sz);
+    if (!elem) {
+        return NULL;
+    }
+
+    if (vq->inuse + elem->ndescs > vq->vring.num) {
+        vu_panic(dev, "Virtqueue size exceeded");
+        free(elem);
+        return NULL;
+    }
+
+    vring_packed_advance(vq, &vq->last_avail_idx,
+                         &vq->last_avail_wrap_counter, elem->ndescs);
+    vq->shadow_avail_idx = vq->last_avail_idx;
+    vq->inuse += elem->ndescs;
+
+    if (vu_has_feature(dev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_packed_set_avail_event(vq);
+    }
+
+    return elem;
+}
+
 static int
 vu_queue_inflight_get(VuDev *dev, VuVirtq *vq, int desc_idx)
 {
@@ -2827,6 +3281,61 @@ vu_queue_inflight_pre_put(VuDev *dev, VuVirtq *vq, int desc_idx)
     return 0;
 }
 
+/* Chain the batch through the next field for vu_check_queue_inflights() */
+static int
+vu_queue_inflight_pre_put_batch(VuDev *dev, VuVirtq *vq,
+                                VuVirtqElement * const *elems,
+                                unsigned int num)
+{
+    unsigned int i;
+
+    if (!vu_has_protocol_feature(dev, VHOST_USER_PROTOCOL_F_INFLIGHT_SHMFD)) {
+        return 0;
+    }
+
+    if (unlikely(!vq->inflight)) {
+        return -1;
+    }
+
+    for (i = 0; i + 1 < num; i++) {
+        vq->inflight->desc[elems[i]->index].next = elems[i + 1]->index;
+    }
+
+    barrier();
+
+    vq->inflight->last_batch_head = elems[0]->index;
+
+    return 0;
+}
+
+static int
+vu_queue_inflight_post_put_batch(VuDev *dev, VuVirtq *vq,
+                                 VuVirtqElement * const *elems,
+                                 unsigned int num)
+{
+    unsigned int i;
+
+    if (!vu_has_protocol_feature(dev, VHOST_USER_PROTOCOL_F_INFLIGHT_SHMFD)) {
+        return 0;
+    }
+
+    if (unlikely(!vq->inflight)) {
+        return -1;
+    }
+
+    barrier();
+
+    for (i = 0; i < num; i++) {
+        vq->inflight->desc[elems[i]->index].inflight = 0;
+    }
+
+    barrier();
+
+    vq->inflight->used_idx = vq->used_idx;
+
+    return 0;
+}
+
 static int
 vu_queue_inflight_post_put(VuDev *dev, VuVirtq *vq, int desc_idx)
 {
@@ -2861,6 +3370,10 @@ vu_queue_pop(VuDev *dev, VuVirtq *vq, size_t sz)
         return NULL;
     }
 
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        return vu_queue_packed_pop(dev, vq, sz);
+    }
+
     if (unlikely(vq->resubmit_list && vq->resubmit_num > 0)) {
         i = (--vq->resubmit_num);
         elem = vu_queue_map_desc(dev, vq, vq->resubmit_list[i].index, sz);
@@ -2912,15 +3425,34 @@ static void
 vu_queue_detach_element(VuDev *dev, VuVirtq *vq, VuVirtqElement *elem,
                         size_t len)
 {
-    vq->inuse--;
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        vq->inuse -= elem->ndescs;
+    } else {
+        vq->inuse--;
+    }
     /* unmap, when DMA support is added */
 }
 
+static void
+vring_packed_rewind(VuVirtq *vq, unsigned int num)
+{
+    if (vq->last_avail_idx < num) {
+        vq->last_avail_idx += vq->vring.num;
+        vq->last_avail_wrap_counter ^= 1;
+    }
+    vq->last_avail_idx -= num;
+    vq->shadow_avail_idx = vq->last_avail_idx;
+}
+
 void
 vu_queue_unpop(VuDev *dev, VuVirtq *vq, VuVirtqElement *elem,
                size_t len)
 {
-    vq->last_avail_idx--;
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        vring_packed_rewind(vq, elem->ndescs);
+    } else {
+        vq->last_avail_idx--;
+    }
     vu_queue_detach_element(dev, vq, elem, len);
 }
 
@@ -2930,7 +3462,11 @@ vu_queue_rewind(VuDev *dev, VuVirtq *vq, unsigned int num)
     if (num > vq->inuse) {
         return false;
     }
-    vq->last_avail_idx -= num;
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        vring_packed_rewind(vq, num);
+    } else {
+        vq->last_avail_idx -= num;
+    }
     vq->inuse -= num;
     return true;
 }
@@ -3007,6 +3543,58 @@ vu_log_queue_fill(VuDev *dev, VuVirtq *vq,
               == VIRTQUEUE_READ_DESC_MORE));
 }
 
+/*
+ * The descriptors of a packed virtqueue element may already have been
+ * overwritten by used descriptors, so log the mapped buffers instead.
+ */
+static void
+vu_log_queue_packed_fill(VuDev *dev, const VuVirtqElement *elem,
+                         unsigned int len)
+{
+    unsigned int i;
+    uint64_t gpa;
+
+    if (!(dev->features & (1ULL << VHOST_F_LOG_ALL)) || !dev->log_table) {
+        return;
+    }
+
+    for (i = 0; i < elem->in_num && len > 0; i++) {
+        size_t min = MIN(elem->in_sg[i].iov_len, (size_t)len);
+
+        if (!va_to_gpa(dev, elem->in_sg[i].iov_base, &gpa)) {
+            vu_panic(dev, "Invalid address for logged buffer");
+            return;
+        }
+        vu_log_write(dev, gpa, min);
+        len -= min;
+    }
+}
+
+static void
+vu_queue_packed_fill(VuDev *dev, VuVirtq *vq,
+                     const VuVirtqElement *elem,
+                     unsigned int len, unsigned int idx)
+{
+    if (unlikely(!vq->used_elems)) {
+        vq->used_elems = calloc(VIRTQUEUE_MAX_SIZE, sizeof(VuVirtqUsedElem));
+        if (!vq->used_elems) {
+            vu_panic(dev, "Failed to allocate used elements");
+            return;
+        }
+    }
+
+    if (idx >= vq->vring.num) {
+        vu_panic(dev, "Used element offset %u out of range", idx);
+        return;
+    }
+
+    vu_log_queue_packed_fill(dev, elem, len);
+
+    vq->used_elems[idx].id = elem->index;
+    vq->used_elems[idx].len = len;
+    vq->used_elems[idx].ndescs = elem->ndescs;
+}
+
 void
 vu_queue_fill(VuDev *dev, VuVirtq *vq,
               const VuVirtqElement *elem,
@@ -3019,6 +3607,11 @@ vu_queue_fill(VuDev *dev, VuVirtq *vq,
         return;
     }
 
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        vu_queue_packed_fill(dev, vq, elem, len, idx);
+        return;
+    }
+
     vu_log_queue_fill(dev, vq, elem, len);
 
     idx = (idx + vq->used_idx) % vq->vring.num;
@@ -3039,6 +3632,63 @@ void vring_used_idx_set(VuDev *dev, VuVirtq *vq, uint16_t val)
     vq->used_idx = val;
 }
 
+static void
+vring_packed_used_write(VuDev *dev, VuVirtq *vq,
+                        const VuVirtqUsedElem *uelem, unsigned int off,
+                        bool strict_order)
+{
+    struct vring_packed_desc *desc;
+    uint16_t head = vq->used_idx;
+    bool wrap_counter = vq->used_wrap_counter;
+    uint16_t flags = 0;
+
+    vring_packed_advance(vq, &head, &wrap_counter, off);
+    if (wrap_counter) {
+        flags = 1 << VRING_PACKED_DESC_F_AVAIL | 1 << VRING_PACKED_DESC_F_USED;
+    }
+
+    desc = &vq->vring.packed_desc[head];
+    desc->id = htole16(uelem->id);
+    desc->len = htole32(uelem->len);
+    if (strict_order) {
+        /* Make sure id and len, and the rest of the batch, come first */
+        smp_wmb();
+    }
+    desc->flags = htole16(flags);
+
+    vu_log_write(dev, vq->vring.packed_desc_gpa + head * sizeof(*desc),
+                 sizeof(*desc));
+}
+
+static void
+vu_queue_packed_flush(VuDev *dev, VuVirtq *vq, unsigned int count)
+{
+    unsigned int i, ndescs;
+
+    if (!count || unlikely(!vq->used_elems)) {
+        return;
+    }
+
+    /*
+     * The driver polls the first used descriptor, so write it last: the
+     * whole batch then becomes visible with a single flags update.
+     */
+    ndescs = vq->used_elems[0].ndescs;
+    for (i = 1; i < count; i++) {
+        vring_packed_used_write(dev, vq, &vq->used_elems[i], ndescs, false);
+        ndescs += vq->used_elems[i].ndescs;
+    }
+    vring_packed_used_write(dev, vq, &vq->used_elems[0], 0, true);
+
+    vq->inuse -= ndescs;
+    vq->used_idx += ndescs;
+    if (vq->used_idx >= vq->vring.num) {
+        vq->used_idx -= vq->vring.num;
+        vq->used_wrap_counter ^= 1;
+        vq->signalled_used_valid = false;
+    }
+}
+
 void
 vu_queue_flush(VuDev *dev, VuVirtq *vq, unsigned int count)
 {
@@ -3049,6 +3699,11 @@ vu_queue_flush(VuDev *dev, VuVirtq *vq, unsigned int count)
         return;
     }
 
+    if (vu_has_feature(dev, VIRTIO_F_RING_PACKED)) {
+        vu_queue_packed_flush(dev, vq, count);
+        return;
+    }
+
     /* Make sure buffer is written before we update index. */
     smp_wmb();
 
@@ -3070,3 +3725,22 @@ vu_queue_push(VuDev *dev, VuVirtq *vq,
     vu_queue_flush(dev, vq, 1);
     vu_queue_inflight_post_put(dev, vq, elem->index);
 }
+
+void
+vu_queue_push_batch(VuDev *dev, VuVirtq *vq,
+                    VuVirtqElement * const *elems,
+                    const unsigned int *lens, unsigned int num)
+{
+    unsigned int i;
+
+    if (!num) {
+        return;
+    }
+
+    for (i = 0; i < num; i++) {
+        vu_queue_fill(dev, vq, elems[i], lens[i], i);
+    }
+    vu_queue_inflight_pre_put_batch(dev, vq, elems, num);
+    vu_queue_flush(dev, vq, num);
+    vu_queue_inflight_post_put_batch(dev, vq, elems, num);
+}
@@ -248,7 +248,12 @@ typedef int (*vu_set_config_cb) (VuDev *dev, const uint8_t *data,
 typedef int (*vu_get_shared_object_cb) (VuDev *dev, const unsigned char *uuid);
 
 typedef struct VuDevIface {
-    /* called by VHOST_USER_GET_FEATURES to get the features bitmask */
+    /*
+     * called by VHOST_USER_GET_FEATURES to get the features bitmask.
+     * Split and packed virtqueues are both handled by the library;
+     * VIRTIO_F_IN_ORDER may be added by devices that complete elements
+     * in the order they were popped.
+     */
     vu_get_features_cb get_features;
     /* enable vhost implementation features */
     vu_set_features_cb set_features;
@@ -283,6 +288,12 @@ typedef struct VuRing {
     struct vring_desc *desc;
     struct vring_avail *avail;
     struct vring_used *used;
+    /* Packed virtqueue view of the same three areas */
+    struct vring_packed_desc *packed_desc;
+    struct vring_packed_desc_event *driver_event;
+    struct vring_packed_desc_event *device_event;
+    /* Guest address of the packed descriptor ring, for dirty logging */
+    uint64_t packed_desc_gpa;
     uint64_t log_guest_addr;
     uint32_t flags;
 } VuRing;
@@ -333,6 +344,12 @@ typedef struct VuVirtqInflightDesc {
     uint64_t counter;
 } VuVirtqInflightDesc;
 
+typedef struct VuVirtqUsedElem {
+    uint32_t id;
+    uint32_t len;
+    uint32_t ndescs;
+} VuVirtqUsedElem;
+
 typedef struct VuVirtq {
     VuRing vring;
 
@@ -363,6 +380,13 @@ typedef struct VuVirtq {
 
     unsigned int inuse;
 
+    /* Packed virtqueue wrap counters for last_avail_idx and used_idx */
+    bool last_avail_wrap_counter;
+    bool used_wrap_counter;
+
+    /* Packed virtqueue elements filled but not yet flushed */
+    VuVirtqUsedElem *used_elems;
+
     vu_queue_handler_cb handler;
 
     int call_fd;
@@ -453,6 +477,8 @@ struct VuDev {
 
 typedef struct VuVirtqElement {
     unsigned int index;
+    /* Descriptors taken from a packed virtqueue */
+    unsigned int ndescs;
     unsigned int out_num;
     unsigned int in_num;
     struct iovec *in_sg;
@@ -685,7 +711,9 @@ void vu_queue_unpop(VuDev *dev, VuVirtq *vq, VuVirtqElement *elem,
  * @num: number of elements to push back
  *
  * Pretend that elements weren't popped from the virtqueue.  The next
- * virtqueue_pop() will refetch the oldest element.
+ * virtqueue_pop() will refetch the oldest element.  On a packed virtqueue
+ * @num counts descriptors rather than elements, so prefer vu_queue_unpop()
+ * there unless every element uses a single descriptor.
  *
  * Returns: true on success, false if @num is greater than the number of in use
  * elements.
@@ -700,7 +728,11 @@ bool vu_queue_rewind(VuDev *dev, VuVirtq *vq, unsigned int num);
  * @len: length in bytes to write
  * @idx: optional offset for the used ring index (0 in general)
  *
- * Fill the used ring with @elem element.
+ * Fill the used ring with @elem element.  Nothing is visible to the
+ * driver until vu_queue_flush(), so a device completing several elements
+ * at once should fill them at increasing @idx and flush them together:
+ * the driver then sees a single used index (or, on a packed virtqueue,
+ * head descriptor) update for the whole batch.
  */
 void vu_queue_fill(VuDev *dev, VuVirtq *vq,
                    const VuVirtqElement *elem,
@@ -718,6 +750,22 @@ void vu_queue_fill(VuDev *dev, VuVirtq *vq,
 void vu_queue_push(VuDev *dev, VuVirtq *vq,
                    const VuVirtqElement *elem, unsigned int len);
 
+/**
+ * vu_queue_push_batch:
+ * @dev: a VuDev context
+ * @vq: a VuVirtq queue
+ * @elems: array of @num VuVirtqElement
+ * @lens: length in bytes written to each element
+ * @num: number of elements
+ *
+ * Like vu_queue_push() for each element, but publishes all of them with a
+ * single vu_queue_flush().  Inflight tracking, if negotiated, records the
+ * batch so that it can be recovered as a whole after a reconnect.
+ */
+void vu_queue_push_batch(VuDev *dev, VuVirtq *vq,
+                         VuVirtqElement * const *elems,
+                         const unsigned int *lens, unsigned int num);
+
 /**
  * vu_queue_flush:
  * @dev: a VuDev context
@@ -725,7 +773,8 @@ void vu_queue_push(VuDev *dev, VuVirtq *vq,
  * @num: number of elements to flush
  *
  * Mark the last number of elements as done (used.idx is updated by
- * num elements).
+ * num elements).  On a packed virtqueue the used descriptors are written
+ * here, the first one last.
 */
 void vu_queue_flush(VuDev *dev, VuVirtq *vq, unsigned int num);
 
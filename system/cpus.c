@@ -80,7 +80,7 @@ bool cpu_is_stopped(CPUState *cpu)
 
 bool cpu_work_list_empty(CPUState *cpu)
 {
-    return QSIMPLEQ_EMPTY_ATOMIC(&cpu->work_list);
+    return qatomic_read(&cpu->work_list.slh_first) == NULL;
 }
 
 bool cpu_thread_is_idle(CPUState *cpu)
@@ -528,9 +528,11 @@ void bql_lock_impl(const char *file, int line)
 
 void bql_unlock(void)
 {
+    QemuMutexUnlockFunc bql_unlock_fn = qatomic_read(&bql_mutex_unlock_func);
+
     g_assert(bql_locked());
     set_bql_locked(false);
-    qemu_mutex_unlock(&bql);
+    bql_unlock_fn(&bql, __FILE__, __LINE__);
 }
 
 void qemu_cond_wait_bql(QemuCond *cond)
@@ -45,6 +45,11 @@
  * composed of dirty ring full and sleep time.
  */
 #define DIRTYLIMIT_THROTTLE_PCT_MAX 99
+/*
+ * Longest slice a throttled vcpu sleeps before checking whether
+ * it has been asked to stop or the limit has been cancelled.
+ */
+#define DIRTYLIMIT_SLEEP_SLICE_NS   (1 * SCALE_MS)
 
 struct {
     VcpuStat stat;
@@ -60,6 +65,13 @@ typedef struct VcpuDirtyLimitState {
      * zero if not enabled.
      */
     uint64_t quota;
+    /*
+     * Sleep time still owed (positive) or overslept (negative)
+     * by the vcpu on earlier dirty ring full exits, in ns.
+     */
+    int64_t sleep_carry_ns;
+    /* Total time the vcpu has slept since the limit was set, in us */
+    uint64_t throttled_us;
 } VcpuDirtyLimitState;
 
 struct {
@@ -385,6 +397,8 @@ void dirtylimit_set_vcpu(int cpu_index,
     if (enable) {
         dirtylimit_state->states[cpu_index].quota = quota;
         if (!dirtylimit_vcpu_get_state(cpu_index)->enabled) {
+            dirtylimit_state->states[cpu_index].sleep_carry_ns = 0;
+            dirtylimit_state->states[cpu_index].throttled_us = 0;
             dirtylimit_state->limited_nvcpu++;
         }
     } else {
@@ -411,21 +425,59 @@ void dirtylimit_set_all(uint64_t quota,
 
 void dirtylimit_vcpu_execute(CPUState *cpu)
 {
-    if (cpu->throttle_us_per_full) {
-        dirtylimit_state_lock();
+    VcpuDirtyLimitState *state;
+    int64_t sleep_ns, max_carry_ns, start_ns, end_ns, now_ns;
 
-        if (dirtylimit_in_service() &&
-            dirtylimit_vcpu_get_state(cpu->cpu_index)->enabled) {
-            dirtylimit_state_unlock();
-            trace_dirtylimit_vcpu_execute(cpu->cpu_index,
-                    cpu->throttle_us_per_full);
+    if (!cpu->throttle_us_per_full) {
+        return;
+    }
 
-            g_usleep(cpu->throttle_us_per_full);
-            return;
-        }
+    dirtylimit_state_lock();
 
+    if (!dirtylimit_in_service() ||
+        !dirtylimit_vcpu_get_state(cpu->cpu_index)->enabled) {
         dirtylimit_state_unlock();
+        return;
+    }
+
+    /*
+     * Sleeps end late by the host timer slack, or early if the vcpu
+     * is kicked.  Settle the difference on the next ring full so that
+     * the average sleep is what dirtylimit_set_throttle() asked for.
+     */
+    state = dirtylimit_vcpu_get_state(cpu->cpu_index);
+    sleep_ns = cpu->throttle_us_per_full * SCALE_US + state->sleep_carry_ns;
+    dirtylimit_state_unlock();
+
+    trace_dirtylimit_vcpu_execute(cpu->cpu_index, sleep_ns / SCALE_US);
+
+    /*
+     * Sleep in short slices instead of one long sleep, so that a vcpu
+     * that is being paused or whose limit was cancelled does not stall
+     * for the rest of a throttle period that may last seconds.
+     */
+    start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    end_ns = start_ns + sleep_ns;
+    now_ns = start_ns;
+    while (now_ns < end_ns &&
+           !qatomic_read(&cpu->stop) &&
+           !qatomic_read(&dirtylimit_quit)) {
+        g_usleep(MIN(end_ns - now_ns, DIRTYLIMIT_SLEEP_SLICE_NS) / SCALE_US);
+        now_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     }
+
+    dirtylimit_state_lock();
+
+    if (dirtylimit_in_service() &&
+        dirtylimit_vcpu_get_state(cpu->cpu_index)->enabled) {
+        state = dirtylimit_vcpu_get_state(cpu->cpu_index);
+        max_carry_ns = cpu->throttle_us_per_full * SCALE_US;
+        state->sleep_carry_ns = MIN(MAX(end_ns - now_ns, -max_carry_ns),
+                                    max_carry_ns);
+        state->throttled_us += (now_ns - start_ns) / SCALE_US;
+    }
+
+    dirtylimit_state_unlock();
 }
 
 static void dirtylimit_init(void)
@@ -615,11 +667,15 @@ uint64_t dirtylimit_ring_full_time(void)
 static struct DirtyLimitInfo *dirtylimit_query_vcpu(int cpu_index)
 {
     DirtyLimitInfo *info = NULL;
+    CPUState *cpu;
 
     info = g_malloc0(sizeof(*info));
     info->cpu_index = cpu_index;
     info->limit_rate = dirtylimit_vcpu_get_state(cpu_index)->quota;
     info->current_rate = vcpu_dirty_rate_get(cpu_index);
+    cpu = qemu_get_cpu(cpu_index);
+    info->throttle_time_per_full = cpu ? cpu->throttle_us_per_full : 0;
+    info->throttled_time = dirtylimit_vcpu_get_state(cpu_index)->throttled_us;
 
     return info;
 }
@@ -674,9 +730,13 @@ void hmp_info_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
 
     for (info = head; info != NULL; info = info->next) {
         monitor_printf(mon, "vcpu[%"PRIi64"], limit rate %"PRIi64 " (MB/s),"
-                            " current rate %"PRIi64 " (MB/s)\n",
+                            " current rate %"PRIi64 " (MB/s),"
+                            " throttle %"PRIu64 " (us) per ring full,"
+                            " throttled %"PRIu64 " (us)\n",
                             info->value->cpu_index,
                             info->value->limit_rate,
-                            info->value->current_rate);
+                            info->value->current_rate,
+                            info->value->throttle_time_per_full,
+                            info->value->throttled_time);
     }
 }
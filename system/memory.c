@@ -749,8 +749,30 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
     return NULL;
 }
 
-/* Render a memory topology into a list of disjoint absolute ranges. */
-static FlatView *generate_memory_topology(MemoryRegion *mr)
+static bool flatview_equal(FlatView *a, FlatView *b)
+{
+    if (a->nr != b->nr) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < a->nr; i++) {
+        if (!flatrange_equal(&a->ranges[i], &b->ranges[i]) ||
+            a->ranges[i].dirty_log_mask != b->ranges[i].dirty_log_mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Render a memory topology into a list of disjoint absolute ranges.
+ *
+ * If the result is the same as @old_view, the FlatView that @mr had before
+ * the transaction, @old_view is reused to skip rebuilding its dispatch
+ * tables.  Address spaces using it then see no change at all.
+ */
+static FlatView *generate_memory_topology(MemoryRegion *mr,
+                                          FlatView *old_view)
 {
     int i;
     FlatView *view;
@@ -764,6 +786,13 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     flatview_simplify(view);
 
+    if (old_view && flatview_equal(view, old_view) && flatview_ref(old_view)) {
+        trace_flatview_reuse(old_view, mr);
+        flatview_unref(view);
+        g_hash_table_replace(flat_views, mr, old_view);
+        return old_view;
+    }
+
     view->dispatch = address_space_dispatch_new(view);
     for (i = 0; i < view->nr; i++) {
         MemoryRegionSection mrs =
@@ -1021,7 +1050,7 @@ static void flatviews_init(void)
     flat_views = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
                                        (GDestroyNotify) flatview_unref);
     if (!empty_view) {
-        empty_view = generate_memory_topology(NULL);
+        empty_view = generate_memory_topology(NULL, NULL);
         /* We keep it alive forever in the global variable.  */
         flatview_ref(empty_view);
     } else {
@@ -1032,12 +1061,10 @@ static void flatviews_init(void)
 
 static void flatviews_reset(void)
 {
+    GHashTable *old_flat_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
     /* Render unique FVs */
@@ -1048,7 +1075,14 @@ static void flatviews_reset(void)
             continue;
         }
 
-        generate_memory_topology(physmr);
+        generate_memory_topology(physmr,
+                                 old_flat_views ?
+                                 g_hash_table_lookup(old_flat_views, physmr) :
+                                 NULL);
+    }
+
+    if (old_flat_views) {
+        g_hash_table_unref(old_flat_views);
     }
 }
 
@@ -1061,6 +1095,14 @@ static void address_space_set_flatview(AddressSpace *as)
     assert(new_view);
 
     if (old_view == new_view) {
+        /*
+         * The FlatView did not change, but listeners that rebuild their
+         * view of the address space between begin and commit, like vhost,
+         * still need to see every section.
+         */
+        if (!QTAILQ_EMPTY(&as->listeners)) {
+            address_space_update_topology_pass(as, old_view, new_view, true);
+        }
         return;
     }
 
@@ -1103,7 +1145,7 @@ static void address_space_update_topology(AddressSpace *as)
 
     flatviews_init();
     if (!g_hash_table_lookup(flat_views, physmr)) {
-        generate_memory_topology(physmr);
+        generate_memory_topology(physmr, NULL);
     }
     address_space_set_flatview(as);
 }
@@ -2548,6 +2590,18 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr)
     mr->flush_coalesced_mmio = true;
 }
 
+void memory_region_enable_lockless_io(MemoryRegion *mr)
+{
+    assert(!mr->flush_coalesced_mmio);
+    mr->lockless_io = true;
+    /*
+     * The re-entrancy guard is a plain per-device flag.  Lockless accesses
+     * may run concurrently with each other and with BQL-protected accesses
+     * to other regions of the same device, and would see each other's flag.
+     */
+    mr->disable_reentrancy_guard = true;
+}
+
 void memory_region_clear_flush_coalesced(MemoryRegion *mr)
 {
     qemu_flush_coalesced_mmio_buffer();
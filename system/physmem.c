@@ -129,6 +129,8 @@ typedef struct PhysPageMap {
 
 struct AddressSpaceDispatch {
     MemoryRegionSection *mru_section;
+    /* Unique among all dispatch trees built so far, never 0 */
+    uint64_t gen;
     /* This is a multi-level map on the physical address space.
      * The bottom level has pointers to MemoryRegionSections.
      */
@@ -332,6 +334,57 @@ static MemoryRegionSection *phys_page_find(AddressSpaceDispatch *d, hwaddr addr)
     }
 }
 
+/*
+ * Each thread, and therefore each vCPU, caches the last few MMIO sections
+ * it looked up.  Guests tend to hammer a handful of device registers, such
+ * as doorbells, from each vCPU; with the cache those accesses neither walk
+ * the radix tree nor bounce the shared mru_section between vCPUs.
+ *
+ * Entries are tagged with the generation of their dispatch tree.  The
+ * sections of a dispatch tree never change and it can only be freed after
+ * an RCU grace period, so a matching generation means the entry is valid.
+ */
+#define DISPATCH_CACHE_SIZE 4
+
+typedef struct DispatchCacheEntry {
+    uint64_t gen;
+    MemoryRegionSection *section;
+} DispatchCacheEntry;
+
+static __thread DispatchCacheEntry dispatch_cache[DISPATCH_CACHE_SIZE];
+static __thread unsigned int dispatch_cache_next;
+
+/* Dispatch trees are only built with the BQL taken */
+static uint64_t dispatch_gen;
+
+static MemoryRegionSection *dispatch_cache_lookup(AddressSpaceDispatch *d,
+                                                  hwaddr addr)
+{
+    for (int i = 0; i < DISPATCH_CACHE_SIZE; i++) {
+        DispatchCacheEntry *e = &dispatch_cache[i];
+
+        if (e->gen == d->gen && section_covers_addr(e->section, addr)) {
+            return e->section;
+        }
+    }
+    return NULL;
+}
+
+static void dispatch_cache_insert(AddressSpaceDispatch *d,
+                                  MemoryRegionSection *section)
+{
+    DispatchCacheEntry *e;
+
+    if (section == &d->map.sections[PHYS_SECTION_UNASSIGNED] ||
+        memory_region_is_ram(section->mr)) {
+        return;
+    }
+
+    e = &dispatch_cache[dispatch_cache_next++ % DISPATCH_CACHE_SIZE];
+    e->gen = d->gen;
+    e->section = section;
+}
+
 /* Called from RCU critical section */
 static MemoryRegionSection *address_space_lookup_region(AddressSpaceDispatch *d,
                                                         hwaddr addr,
@@ -342,8 +395,12 @@ static MemoryRegionSection *address_space_lookup_region(AddressSpaceDispatch *d,
 
     if (!section || section == &d->map.sections[PHYS_SECTION_UNASSIGNED] ||
         !section_covers_addr(section, addr)) {
-        section = phys_page_find(d, addr);
-        qatomic_set(&d->mru_section, section);
+        section = dispatch_cache_lookup(d, addr);
+        if (!section) {
+            section = phys_page_find(d, addr);
+            qatomic_set(&d->mru_section, section);
+            dispatch_cache_insert(d, section);
+        }
     }
     if (resolve_subpage && section->mr->subpage) {
         subpage = container_of(section->mr, subpage_t, iomem);
@@ -1118,31 +1175,128 @@ void qemu_mutex_unlock_ramlist(void)
     qemu_mutex_unlock(&ram_list.mutex);
 }
 
+#ifdef CONFIG_LINUX
+typedef struct HostHugeMapping {
+    uintptr_t start;
+    uintptr_t end;
+    uint64_t huge_bytes;
+} HostHugeMapping;
+
+/*
+ * Collect the mappings of this process that are at least partly backed by
+ * transparent huge pages, from /proc/self/smaps.  Returns NULL if that
+ * cannot be read.
+ */
+static GArray *host_huge_mappings_read(void)
+{
+    g_autofree char *contents = NULL;
+    g_auto(GStrv) lines = NULL;
+    HostHugeMapping cur = { 0 };
+    GArray *mappings;
+    uint64_t kb;
+    int i;
+
+    if (!g_file_get_contents("/proc/self/smaps", &contents, NULL, NULL)) {
+        return NULL;
+    }
+
+    mappings = g_array_new(false, false, sizeof(HostHugeMapping));
+    lines = g_strsplit(contents, "\n", -1);
+    for (i = 0; lines[i]; i++) {
+        uintptr_t start, end;
+
+        if (sscanf(lines[i], "%" SCNxPTR "-%" SCNxPTR " ", &start, &end) == 2) {
+            if (cur.huge_bytes) {
+                g_array_append_val(mappings, cur);
+            }
+            cur = (HostHugeMapping) { .start = start, .end = end };
+        } else if (sscanf(lines[i], "AnonHugePages: %" SCNu64, &kb) == 1 ||
+                   sscanf(lines[i], "ShmemPmdMapped: %" SCNu64, &kb) == 1) {
+            cur.huge_bytes += kb * KiB;
+        }
+    }
+    if (cur.huge_bytes) {
+        g_array_append_val(mappings, cur);
+    }
+
+    return mappings;
+}
+
+/*
+ * Bytes of the used part of @block that the host backs with huge pages.
+ * smaps only has a total per mapping, so a mapping that straddles the end
+ * of the block is counted in proportion to the overlap.
+ */
+static uint64_t ram_block_huge_bytes(RAMBlock *block, GArray *mappings)
+{
+    uintptr_t start = (uintptr_t)block->host;
+    uintptr_t end = start + block->used_length;
+    uint64_t huge_bytes = 0;
+    int i;
+
+    if (block->page_size > qemu_real_host_page_size()) {
+        /* hugetlbfs */
+        return block->used_length;
+    }
+
+    for (i = 0; i < mappings->len; i++) {
+        HostHugeMapping *m = &g_array_index(mappings, HostHugeMapping, i);
+        uintptr_t overlap_start = MAX(m->start, start);
+        uintptr_t overlap_end = MIN(m->end, end);
+
+        if (overlap_start < overlap_end) {
+            huge_bytes += muldiv64(m->huge_bytes, overlap_end - overlap_start,
+                                   m->end - m->start);
+        }
+    }
+
+    return MIN(huge_bytes, block->used_length);
+}
+#endif
+
 GString *ram_block_format(void)
 {
     RAMBlock *block;
     char *psize;
     GString *buf = g_string_new("");
+    GArray *mappings = NULL;
+
+#ifdef CONFIG_LINUX
+    mappings = host_huge_mappings_read();
+#endif
 
     RCU_READ_LOCK_GUARD();
-    g_string_append_printf(buf, "%24s %8s  %18s %18s %18s %18s %3s\n",
+    g_string_append_printf(buf, "%24s %8s  %18s %18s %18s %18s %3s %18s\n",
                            "Block Name", "PSize", "Offset", "Used", "Total",
-                           "HVA", "RO");
+                           "HVA", "RO", "Huge");
 
     RAMBLOCK_FOREACH(block) {
+        g_autofree char *huge = NULL;
+
         psize = size_to_str(block->page_size);
+#ifdef CONFIG_LINUX
+        if (mappings && block->host) {
+            huge = g_strdup_printf("0x%016" PRIx64,
+                                   ram_block_huge_bytes(block, mappings));
+        }
+#endif
         g_string_append_printf(buf, "%24s %8s  0x%016" PRIx64 " 0x%016" PRIx64
-                               " 0x%016" PRIx64 " 0x%016" PRIx64 " %3s\n",
+                               " 0x%016" PRIx64 " 0x%016" PRIx64 " %3s %18s\n",
                                block->idstr, psize,
                                (uint64_t)block->offset,
                                (uint64_t)block->used_length,
                                (uint64_t)block->max_length,
                                (uint64_t)(uintptr_t)block->host,
-                               block->mr->readonly ? "ro" : "rw");
+                               block->mr->readonly ? "ro" : "rw",
+                               huge ? huge : "-");
 
         g_free(psize);
     }
 
+    if (mappings) {
+        g_array_free(mappings, true);
+    }
+
     return buf;
 }
 
@@ -2464,6 +2618,7 @@ AddressSpaceDispatch *address_space_dispatch_new(FlatView *fv)
     assert(n == PHYS_SECTION_UNASSIGNED);
 
     d->phys_map  = (PhysPageEntry) { .ptr = PHYS_MAP_NODE_NIL, .skip = 1 };
+    d->gen = ++dispatch_gen;
 
     return d;
 }
@@ -2639,7 +2794,7 @@ bool prepare_mmio_access(MemoryRegion *mr)
 {
     bool release_lock = false;
 
-    if (!bql_locked()) {
+    if (!mr->lockless_io && !bql_locked()) {
         bql_lock();
         release_lock = true;
     }
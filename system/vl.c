@@ -447,6 +447,9 @@ static QemuOptsList qemu_icount_opts = {
         }, {
             .name = "rrsnapshot",
             .type = QEMU_OPT_STRING,
+        }, {
+            .name = "rrsnapshot-period",
+            .type = QEMU_OPT_NUMBER,
         },
         { /* end of list */ }
     },
@@ -679,6 +682,8 @@ static void default_drive(int enable, int snapshot, BlockInterfaceType type,
 static void configure_blockdev(BlockdevOptionsQueue *bdo_queue,
                                MachineClass *machine_class, int snapshot)
 {
+    BlockdevOptionsQueueEntry *bdo;
+
     /*
      * If the currently selected machine wishes to override the
      * units-per-bus property of its default HBA interface type, do so
@@ -689,10 +694,17 @@ static void configure_blockdev(BlockdevOptionsQueue *bdo_queue,
                           machine_class->units_per_default_bus);
     }
 
+    /*
+     * Opening a node waits for its network connection to be established.
+     * Start all connections first, so that they are set up in parallel.
+     */
+    QSIMPLEQ_FOREACH(bdo, bdo_queue, entry) {
+        bdrv_preconnect(bdo->bdo);
+    }
+
     /* open the virtual block devices */
     while (!QSIMPLEQ_EMPTY(bdo_queue)) {
-        BlockdevOptionsQueueEntry *bdo = QSIMPLEQ_FIRST(bdo_queue);
-
+        bdo = QSIMPLEQ_FIRST(bdo_queue);
         QSIMPLEQ_REMOVE_HEAD(bdo_queue, entry);
         loc_push_restore(&bdo->loc);
         qmp_blockdev_add(bdo->bdo, &error_fatal);
@@ -700,6 +712,7 @@ static void configure_blockdev(BlockdevOptionsQueue *bdo_queue,
         qapi_free_BlockdevOptions(bdo->bdo);
         g_free(bdo);
     }
+    bdrv_preconnect_cleanup();
     if (snapshot) {
         qemu_opts_foreach(qemu_find_opts("drive"), drive_enable_snapshot,
                           NULL, NULL);
@@ -2644,6 +2657,15 @@ static void qemu_create_cli_devices(void)
         object_unref(OBJECT(dev));
         loc_pop(&opt->loc);
     }
+
+    /*
+     * Memory backends created on the command line preallocate in the
+     * background while the devices above are created; wait for them before
+     * anything can use guest memory.
+     */
+    if (!qemu_finish_async_prealloc_mem(&error_fatal)) {
+        exit(1);
+    }
     rom_reset_order_override();
 }
 
@@ -3699,6 +3721,7 @@ void qemu_init(int argc, char **argv)
      * over memory-backend-file objects).
      */
     qemu_create_late_backends();
+    phase_advance(PHASE_LATE_BACKENDS_CREATED);
 
     /*
      * Note: creates a QOM object, must run only after global and
@@ -1917,6 +1917,15 @@ int hvf_vcpu_exec(CPUState *cpu)
             break;
         }
 
+        /*
+         * Writes to RAM that is write-protected for dirty logging, including
+         * stage 1 page table updates, are retried once the page is writable.
+         */
+        if ((iswrite || s1ptw) &&
+            hvf_dirty_log_write_fault(hvf_exit->exception.physical_address)) {
+            break;
+        }
+
         assert(isv);
 
         if (iswrite) {
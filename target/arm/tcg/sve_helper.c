@@ -5381,6 +5381,47 @@ bool sve_probe_page(SVEHostPage *info, bool nofault, CPUARMState *env,
     return true;
 }
 
+/*
+ * Gathers and scatters often find many elements on the same page.
+ * Remember the last page that sve_probe_page() found to be plain RAM,
+ * so that further elements on it skip the TLB lookup; @info then keeps
+ * the flags and attributes from that probe.
+ */
+typedef struct SVEProbeCache {
+    target_ulong page;          /* -1 if nothing cached */
+    void *host;                 /* host address of the page */
+} SVEProbeCache;
+
+#define SVE_PROBE_CACHE_INIT { .page = -1 }
+
+static bool sve_probe_page_cached(SVEProbeCache *cache, SVEHostPage *info,
+                                  bool nofault, CPUARMState *env,
+                                  target_ulong addr,
+                                  MMUAccessType access_type, int mmu_idx,
+                                  uintptr_t retaddr)
+{
+    target_ulong clean = useronly_clean_ptr(addr);
+    target_ulong page = clean & TARGET_PAGE_MASK;
+
+    if (page == cache->page) {
+        info->host = cache->host + (clean - page);
+        return true;
+    }
+
+    if (!sve_probe_page(info, nofault, env, addr, 0, access_type,
+                        mmu_idx, retaddr)) {
+        cache->page = -1;
+        return false;
+    }
+    if (info->flags & (TLB_INVALID_MASK | TLB_MMIO | TLB_WATCHPOINT)) {
+        cache->page = -1;
+    } else {
+        cache->page = page;
+        cache->host = info->host - (clean - page);
+    }
+    return true;
+}
+
 /*
  * Find first active element on each page, and a loose bound for the
  * final element on each page.  Identify any single element that spans
@@ -6535,6 +6576,7 @@ void sve_ld1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
     ARMVectorReg scratch;
     intptr_t reg_off;
     SVEHostPage info, info2;
+    SVEProbeCache cache = SVE_PROBE_CACHE_INIT;
 
     memset(&scratch, 0, reg_max);
     reg_off = 0;
@@ -6545,8 +6587,8 @@ void sve_ld1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
                 target_ulong addr = base + (off_fn(vm, reg_off) << scale);
                 target_ulong in_page = -(addr | TARGET_PAGE_MASK);
 
-                sve_probe_page(&info, false, env, addr, 0, MMU_DATA_LOAD,
-                               mmu_idx, retaddr);
+                sve_probe_page_cached(&cache, &info, false, env, addr,
+                                      MMU_DATA_LOAD, mmu_idx, retaddr);
 
                 if (likely(in_page >= msize)) {
                     if (unlikely(info.flags & TLB_WATCHPOINT)) {
@@ -6722,6 +6764,7 @@ void sve_ldff1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
     const int msize = 1 << msz;
     intptr_t reg_off;
     SVEHostPage info;
+    SVEProbeCache cache = SVE_PROBE_CACHE_INIT;
     target_ulong addr, in_page;
     ARMVectorReg scratch;
 
@@ -6767,8 +6810,8 @@ void sve_ldff1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
                     goto fault;
                 }
 
-                sve_probe_page(&info, true, env, addr, 0, MMU_DATA_LOAD,
-                               mmu_idx, retaddr);
+                sve_probe_page_cached(&cache, &info, true, env, addr,
+                                      MMU_DATA_LOAD, mmu_idx, retaddr);
                 if (unlikely(info.flags & (TLB_INVALID_MASK | TLB_MMIO))) {
                     goto fault;
                 }
@@ -6926,6 +6969,7 @@ void sve_st1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
     void *host[ARM_MAX_VQ * 4];
     intptr_t reg_off, i;
     SVEHostPage info, info2;
+    SVEProbeCache cache = SVE_PROBE_CACHE_INIT;
 
     /*
      * Probe all of the elements for host addresses and flags.
@@ -6940,8 +6984,8 @@ void sve_st1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
             host[i] = NULL;
             if (likely((pg >> (reg_off & 63)) & 1)) {
                 if (likely(in_page >= msize)) {
-                    sve_probe_page(&info, false, env, addr, 0, MMU_DATA_STORE,
-                                   mmu_idx, retaddr);
+                    sve_probe_page_cached(&cache, &info, false, env, addr,
+                                          MMU_DATA_STORE, mmu_idx, retaddr);
                     if (!(info.flags & TLB_MMIO)) {
                         host[i] = info.host;
                     }
@@ -6956,6 +7000,8 @@ void sve_st1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
                     sve_probe_page(&info2, false, env, addr + in_page, 0,
                                    MMU_DATA_STORE, mmu_idx, retaddr);
                     info.flags |= info2.flags;
+                    /* info no longer describes the cached page */
+                    cache.page = -1;
                 }
 
                 if (unlikely(info.flags & TLB_WATCHPOINT)) {
@@ -1779,6 +1779,10 @@ typedef struct CPUArchState {
     uint32_t intercept_exceptions;
     uint64_t nested_cr3;
     uint32_t nested_pg_mode;
+    /* Nested paging context of the MMU_NESTED_IDX TLB entries */
+    uint64_t nested_tlb_cr3;
+    uint32_t nested_tlb_pg_mode;
+    uint32_t nested_tlb_asid;
     uint8_t v_tpr;
     uint32_t int_ctl;
 
@@ -171,7 +171,13 @@ void cpu_x86_update_cr3(CPUX86State *env, target_ulong new_cr3)
     if (env->cr[0] & CR0_PG_MASK) {
         qemu_log_mask(CPU_LOG_MMU,
                         "CR3 update: CR3=" TARGET_FMT_lx "\n", new_cr3);
-        tlb_flush(env_cpu(env));
+        /*
+         * Stage 2 translations do not depend on CR3, so keep them.
+         * VMRUN flushes them if the nested paging context changes.
+         */
+        tlb_flush_by_mmuidx(env_cpu(env),
+                            MAKE_64BIT_MASK(0, NB_MMU_MODES) &
+                            ~(1 << MMU_NESTED_IDX));
     }
 }
 
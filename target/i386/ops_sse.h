@@ -303,7 +303,6 @@ static inline int satsw(int x)
 #define FMULHUW(a, b) ((a) * (b) >> 16)
 #define FMULHW(a, b) ((int16_t)(a) * (int16_t)(b) >> 16)
 
-#define FAVG(a, b) (((a) + (b) + 1) >> 1)
 #endif
 
 SSE_HELPER_W(helper_pmulhuw, FMULHUW)
@@ -319,18 +318,6 @@ void glue(helper_pmulhrw, SUFFIX)(CPUX86State *env, Reg *d, Reg *s)
 }
 #endif
 
-SSE_HELPER_B(helper_pavgb, FAVG)
-SSE_HELPER_W(helper_pavgw, FAVG)
-
-void glue(helper_pmuludq, SUFFIX)(CPUX86State *env, Reg *d, Reg *v, Reg *s)
-{
-    int i;
-
-    for (i = 0; i < (1 << SHIFT); i++) {
-        d->Q(i) = (uint64_t)s->L(i * 2) * (uint64_t)v->L(i * 2);
-    }
-}
-
 void glue(helper_pmaddwd, SUFFIX)(CPUX86State *env, Reg *d, Reg *v, Reg *s)
 {
     int i;
@@ -1643,15 +1630,6 @@ SSE_HELPER_F(helper_pmovshdup, L, 2 << SHIFT, FMOVSHDUP)
 SSE_HELPER_F(helper_pmovdldup, Q, 1 << SHIFT, FMOVDLDUP)
 #endif
 
-void glue(helper_pmuldq, SUFFIX)(CPUX86State *env, Reg *d, Reg *v, Reg *s)
-{
-    int i;
-
-    for (i = 0; i < 1 << SHIFT; i++) {
-        d->Q(i) = (int64_t)(int32_t) v->L(2 * i) * (int32_t) s->L(2 * i);
-    }
-}
-
 void glue(helper_packusdw, SUFFIX)(CPUX86State *env, Reg *d, Reg *v, Reg *s)
 {
     uint16_t r[8];
@@ -131,6 +131,22 @@ static inline bool ptw_setl(const PTETranslate *in, uint32_t old, uint32_t set)
     return true;
 }
 
+#ifdef TARGET_X86_64
+/*
+ * In long mode, the page directory and page directory pointer table
+ * entries that lead to a translation are kept in the TLB walk cache.
+ * Like the paging-structure caches of real processors, they survive
+ * until the next TLB flush, or a page fault on an address they map.
+ */
+#define PTW_CACHE_PDE_SHIFT    21
+#define PTW_CACHE_PDPTE_SHIFT  30
+
+static inline uint32_t ptw_cache_mode(const TranslateParams *in)
+{
+    return in->pg_mode | (in->ptw_idx << 24);
+}
+#endif
+
 static bool mmu_translate(CPUX86State *env, const TranslateParams *in,
                           TranslateResult *out, TranslateFault *err)
 {
@@ -160,6 +176,24 @@ static bool mmu_translate(CPUX86State *env, const TranslateParams *in,
     if (pg_mode & PG_MODE_PAE) {
 #ifdef TARGET_X86_64
         if (pg_mode & PG_MODE_LMA) {
+            const CPUTLBWalkEntry *w;
+
+            w = tlb_walk_cache_lookup(env_cpu(env), addr, PTW_CACHE_PDE_SHIFT,
+                                      in->cr3, ptw_cache_mode(in));
+            if (w) {
+                pte = w->entry;
+                ptep = w->attrs;
+                goto walk_level_1;
+            }
+            w = tlb_walk_cache_lookup(env_cpu(env), addr,
+                                      PTW_CACHE_PDPTE_SHIFT,
+                                      in->cr3, ptw_cache_mode(in));
+            if (w) {
+                pte = w->entry;
+                ptep = w->attrs;
+                goto walk_level_2;
+            }
+
             if (pg_mode & PG_MODE_LA57) {
                 /*
                  * Page table level 5
@@ -232,6 +266,8 @@ static bool mmu_translate(CPUX86State *env, const TranslateParams *in,
                 page_size = 1024 * 1024 * 1024;
                 goto do_check_protect;
             }
+            tlb_walk_cache_insert(env_cpu(env), addr, PTW_CACHE_PDPTE_SHIFT,
+                                  in->cr3, ptw_cache_mode(in), pte, ptep);
         } else
 #endif
         {
@@ -257,6 +293,9 @@ static bool mmu_translate(CPUX86State *env, const TranslateParams *in,
             ptep = PG_NX_MASK | PG_USER_MASK | PG_RW_MASK;
         }
 
+#ifdef TARGET_X86_64
+    walk_level_2:
+#endif
         /*
          * Page table level 2
          */
@@ -284,6 +323,13 @@ static bool mmu_translate(CPUX86State *env, const TranslateParams *in,
         }
         ptep &= pte ^ PG_NX_MASK;
 
+#ifdef TARGET_X86_64
+        if (pg_mode & PG_MODE_LMA) {
+            tlb_walk_cache_insert(env_cpu(env), addr, PTW_CACHE_PDE_SHIFT,
+                                  in->cr3, ptw_cache_mode(in), pte, ptep);
+        }
+    walk_level_1:
+#endif
         /*
          * Page table level 1
          */
@@ -482,6 +528,8 @@ do_check_protect_pse36:
  do_fault:
     error_code = 0;
  do_fault_cont:
+    /* A page fault invalidates the cached entries for the address.  */
+    tlb_walk_cache_remove(env_cpu(env), addr);
     if (is_user) {
         error_code |= PG_ERROR_U_MASK;
     }
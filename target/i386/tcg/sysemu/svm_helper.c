@@ -283,7 +283,20 @@ void helper_vmrun(CPUX86State *env, int aflag, int next_eip_addend)
 
         env->nested_pg_mode = get_pg_mode(env) & PG_MODE_SVM_MASK;
 
-        tlb_flush_by_mmuidx(cs, 1 << MMU_NESTED_IDX);
+        /*
+         * Stage 2 translations are tagged by ASID, so they can be kept
+         * across world switches as long as the nested paging context
+         * does not change.  The hypervisor asks for a flush through
+         * TLB_CONTROL when it modifies the nested page tables.
+         */
+        if (env->nested_cr3 != env->nested_tlb_cr3 ||
+            env->nested_pg_mode != env->nested_tlb_pg_mode ||
+            asid != env->nested_tlb_asid) {
+            env->nested_tlb_cr3 = env->nested_cr3;
+            env->nested_tlb_pg_mode = env->nested_pg_mode;
+            env->nested_tlb_asid = asid;
+            tlb_flush_by_mmuidx(cs, 1 << MMU_NESTED_IDX);
+        }
     }
 
     /* enable intercepts */
@@ -379,7 +392,12 @@ void helper_vmrun(CPUX86State *env, int aflag, int next_eip_addend)
     case TLB_CONTROL_DO_NOTHING:
         break;
     case TLB_CONTROL_FLUSH_ALL_ASID:
-        /* FIXME: this is not 100% correct but should work for now */
+    case TLB_CONTROL_FLUSH_ASID:
+    case TLB_CONTROL_FLUSH_ASID_LOCAL:
+        /*
+         * The TLB is not tagged by ASID, so flushing everything is the
+         * closest match.  Note that this includes the stage 2 entries.
+         */
         tlb_flush(cs);
         break;
     }
@@ -736,8 +754,11 @@ void do_vmexit(CPUX86State *env)
         x86_stl_phys(cs,
                  env->vm_vmcb + offsetof(struct vmcb, control.int_state), 0);
     }
+    /*
+     * MMU_NESTED_IDX is not used outside the guest; its entries are
+     * kept for the next VMRUN with the same nested paging context.
+     */
     env->hflags2 &= ~HF2_NPT_MASK;
-    tlb_flush_by_mmuidx(cs, 1 << MMU_NESTED_IDX);
 
     /* Save the VM state in the vmcb */
     svm_save_seg(env, MMU_PHYS_IDX,
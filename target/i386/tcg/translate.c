@@ -358,6 +358,14 @@ static void set_cc_op(DisasContext *s, CCOp op)
     s->cc_op = op;
 }
 
+/*
+ * Flush the static CC_OP to env.  This is needed at every TB exit:
+ * the CC globals (cc_dst, cc_src, cc_src2) are also live there, even
+ * if the successor TB is known to overwrite all flags, because an
+ * interrupt or signal may be delivered on entry to any TB and will
+ * compute EFLAGS from them via cpu_compute_eflags().  Dead flags can
+ * only be dropped within a TB, which set_cc_op() does.
+ */
 static void gen_update_cc_op(DisasContext *s)
 {
     if (s->cc_op_dirty) {
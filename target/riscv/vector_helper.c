@@ -251,17 +251,64 @@ GEN_VEXT_ST_STRIDE(vsse64_v, int64_t, ste_d)
  * unit-stride: access elements stored contiguously in memory
  */
 
+/*
+ * Copy the elements of an unmasked, non-segment unit-stride access
+ * directly between guest RAM and the register file, as many pages at a
+ * time as possible.  This relies on the little-endian register layout,
+ * and stops at the first page that is not plain RAM (MMIO, or memory
+ * callbacks from plugins), leaving the rest to the element loop.
+ * env->vstart is kept up to date so that a fault is precise.
+ */
+static void vext_ldst_us_host(void *vd, target_ulong base,
+                              CPURISCVState *env, uint32_t log2_esz,
+                              uint32_t evl, MMUAccessType access_type,
+                              uintptr_t ra)
+{
+#if !defined(CONFIG_USER_ONLY) && !HOST_BIG_ENDIAN
+    int mmu_index = riscv_env_mmu_index(env, false);
+
+    while (env->vstart < evl) {
+        target_ulong addr = adjust_addr(env,
+                                        base + (env->vstart << log2_esz));
+        target_ulong pagelen = -(addr | TARGET_PAGE_MASK);
+        uint32_t elems = MIN(evl - env->vstart, pagelen >> log2_esz);
+        uint32_t len = elems << log2_esz;
+        uint8_t *reg = (uint8_t *)vd + (env->vstart << log2_esz);
+        void *host;
+
+        if (!elems) {
+            /* element crosses the page boundary */
+            return;
+        }
+        host = probe_access(env, addr, len, access_type, mmu_index, ra);
+        if (!host) {
+            return;
+        }
+        if (access_type == MMU_DATA_LOAD) {
+            memcpy(reg, host, len);
+        } else {
+            memcpy(host, reg, len);
+        }
+        env->vstart += elems;
+    }
+#endif
+}
+
 /* unmasked unit-stride load and store operation */
 static void
 vext_ldst_us(void *vd, target_ulong base, CPURISCVState *env, uint32_t desc,
              vext_ldst_elem_fn *ldst_elem, uint32_t log2_esz, uint32_t evl,
-             uintptr_t ra)
+             MMUAccessType access_type, uintptr_t ra)
 {
     uint32_t i, k;
     uint32_t nf = vext_nf(desc);
     uint32_t max_elems = vext_max_elems(desc, log2_esz);
     uint32_t esz = 1 << log2_esz;
 
+    if (nf == 1) {
+        vext_ldst_us_host(vd, base, env, log2_esz, evl, access_type, ra);
+    }
+
     /* load bytes from guest memory */
     for (i = env->vstart; i < evl; i++, env->vstart++) {
         k = 0;
@@ -294,7 +341,7 @@ void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
                   CPURISCVState *env, uint32_t desc)                    \
 {                                                                       \
     vext_ldst_us(vd, base, env, desc, LOAD_FN,                          \
-                 ctzl(sizeof(ETYPE)), env->vl, GETPC());                \
+                 ctzl(sizeof(ETYPE)), env->vl, MMU_DATA_LOAD, GETPC()); \
 }
 
 GEN_VEXT_LD_US(vle8_v,  int8_t,  lde_b)
@@ -315,7 +362,7 @@ void HELPER(NAME)(void *vd, void *v0, target_ulong base,                 \
                   CPURISCVState *env, uint32_t desc)                     \
 {                                                                        \
     vext_ldst_us(vd, base, env, desc, STORE_FN,                          \
-                 ctzl(sizeof(ETYPE)), env->vl, GETPC());                 \
+                 ctzl(sizeof(ETYPE)), env->vl, MMU_DATA_STORE, GETPC()); \
 }
 
 GEN_VEXT_ST_US(vse8_v,  int8_t,  ste_b)
@@ -332,7 +379,7 @@ void HELPER(vlm_v)(void *vd, void *v0, target_ulong base,
     /* evl = ceil(vl/8) */
     uint8_t evl = (env->vl + 7) >> 3;
     vext_ldst_us(vd, base, env, desc, lde_b,
-                 0, evl, GETPC());
+                 0, evl, MMU_DATA_LOAD, GETPC());
 }
 
 void HELPER(vsm_v)(void *vd, void *v0, target_ulong base,
@@ -341,7 +388,7 @@ void HELPER(vsm_v)(void *vd, void *v0, target_ulong base,
     /* evl = ceil(vl/8) */
     uint8_t evl = (env->vl + 7) >> 3;
     vext_ldst_us(vd, base, env, desc, ste_b,
-                 0, evl, GETPC());
+                 0, evl, MMU_DATA_STORE, GETPC());
 }
 
 /*
@@ -58,6 +58,8 @@ typedef struct TempOptInfo {
 typedef struct OptContext {
     TCGContext *tcg;
     TCGOp *prev_mb;
+    /* Ordering bits whose earlier access may follow the last barrier. */
+    TCGBar mb_pending;
     TCGTempSet temps_used;
 
     IntervalTreeRoot mem_copy;
@@ -815,6 +817,7 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
      */
     if (def->flags & TCG_OPF_BB_END) {
         ctx->prev_mb = NULL;
+        ctx->mb_pending = TCG_MO_ALL;
         if (!(def->flags & TCG_OPF_COND_BRANCH)) {
             memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
             remove_mem_copy_all(ctx);
@@ -884,6 +887,12 @@ static bool fold_const2_commutative(OptContext *ctx, TCGOp *op)
     return fold_const2(ctx, op);
 }
 
+/* Return the z_mask of a value known to be unsigned-less-or-equal to @max. */
+static uint64_t zmask_upto(uint64_t max)
+{
+    return max ? MAKE_64BIT_MASK(0, 64 - clz64(max)) : 0;
+}
+
 static bool fold_masks(OptContext *ctx, TCGOp *op)
 {
     uint64_t a_mask = ctx->a_mask;
@@ -1025,11 +1034,21 @@ static bool fold_xx_to_x(OptContext *ctx, TCGOp *op)
 
 static bool fold_add(OptContext *ctx, TCGOp *op)
 {
+    uint64_t z1, z2, sum;
+
     if (fold_const2_commutative(ctx, op) ||
         fold_xi_to_x(ctx, op, 0)) {
         return true;
     }
-    return false;
+
+    /* Each input is at most its z_mask, so the sum is at most theirs. */
+    z1 = arg_info(op->args[1])->z_mask;
+    z2 = arg_info(op->args[2])->z_mask;
+    sum = z1 + z2;
+    if (sum >= z1) {
+        ctx->z_mask = zmask_upto(sum);
+    }
+    return fold_masks(ctx, op);
 }
 
 /* We cannot as yet do_constant_folding with vectors. */
@@ -1372,6 +1391,7 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
 
     /* Stop optimizing MB across calls. */
     ctx->prev_mb = NULL;
+    ctx->mb_pending = TCG_MO_ALL;
     return true;
 }
 
@@ -1483,6 +1503,15 @@ static bool fold_divide(OptContext *ctx, TCGOp *op)
         fold_xi_to_x(ctx, op, 1)) {
         return true;
     }
+
+    /* An unsigned quotient is no larger than the dividend. */
+    switch (op->opc) {
+    CASE_OP_32_64(divu):
+        ctx->z_mask = zmask_upto(arg_info(op->args[1])->z_mask);
+        return fold_masks(ctx, op);
+    default:
+        break;
+    }
     return false;
 }
 
@@ -1658,6 +1687,21 @@ static bool fold_extu(OptContext *ctx, TCGOp *op)
 
 static bool fold_mb(OptContext *ctx, TCGOp *op)
 {
+    /*
+     * A barrier only has to order accesses that were issued since an
+     * earlier barrier with the same ordering bit; anything before that
+     * is already ordered against everything after it.  E.g. in a run of
+     * stores, only the first barrier needs TCG_MO_LD_ST.
+     */
+    TCGBar needed = op->args[0] & (ctx->mb_pending | ~TCG_MO_ALL);
+
+    if (!(needed & TCG_MO_ALL)) {
+        tcg_op_remove(ctx->tcg, op);
+        return true;
+    }
+    op->args[0] = needed;
+    ctx->mb_pending &= ~needed;
+
     /* Eliminate duplicate and redundant fence instructions.  */
     if (ctx->prev_mb) {
         /*
@@ -1756,12 +1800,21 @@ static bool fold_movcond(OptContext *ctx, TCGOp *op)
 
 static bool fold_mul(OptContext *ctx, TCGOp *op)
 {
+    uint64_t lo, hi;
+
     if (fold_const2(ctx, op) ||
         fold_xi_to_i(ctx, op, 0) ||
         fold_xi_to_x(ctx, op, 1)) {
         return true;
     }
-    return false;
+
+    /* As for addition, bound the product by the product of the z_masks. */
+    mulu64(&lo, &hi, arg_info(op->args[1])->z_mask,
+           arg_info(op->args[2])->z_mask);
+    if (hi == 0) {
+        ctx->z_mask = zmask_upto(lo);
+    }
+    return fold_masks(ctx, op);
 }
 
 static bool fold_mul_highpart(OptContext *ctx, TCGOp *op)
@@ -1921,6 +1974,7 @@ static bool fold_qemu_ld(OptContext *ctx, TCGOp *op)
 
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+    ctx->mb_pending |= TCG_MO_LD_LD | TCG_MO_LD_ST;
     return false;
 }
 
@@ -1928,6 +1982,7 @@ static bool fold_qemu_st(OptContext *ctx, TCGOp *op)
 {
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+    ctx->mb_pending |= TCG_MO_ST_LD | TCG_MO_ST_ST;
     return false;
 }
 
@@ -1937,6 +1992,16 @@ static bool fold_remainder(OptContext *ctx, TCGOp *op)
         fold_xx_to_i(ctx, op, 0)) {
         return true;
     }
+
+    /* An unsigned remainder is below the divisor and within the dividend. */
+    switch (op->opc) {
+    CASE_OP_32_64(remu):
+        ctx->z_mask = zmask_upto(MIN(arg_info(op->args[1])->z_mask,
+                                     arg_info(op->args[2])->z_mask));
+        return fold_masks(ctx, op);
+    default:
+        break;
+    }
     return false;
 }
 
@@ -2345,7 +2410,7 @@ void tcg_optimize(TCGContext *s)
 {
     int nb_temps, i;
     TCGOp *op, *op_next;
-    OptContext ctx = { .tcg = s };
+    OptContext ctx = { .tcg = s, .mb_pending = TCG_MO_ALL };
 
     QSIMPLEQ_INIT(&ctx.mem_free);
 
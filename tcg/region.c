@@ -25,6 +25,7 @@
 #include "qemu/osdep.h"
 #include "qemu/units.h"
 #include "qemu/madvise.h"
+#include "qemu/bitmap.h"
 #include "qemu/mprotect.h"
 #include "qemu/memalign.h"
 #include "qemu/cacheinfo.h"
@@ -34,6 +35,9 @@
 #include "exec/translation-block.h"
 #include "tcg-internal.h"
 #include "host/cpuinfo.h"
+#if defined(CONFIG_LINUX) && defined(CONFIG_GETCPU)
+#include <sched.h>
+#endif
 
 
 /*
@@ -57,6 +61,11 @@ struct tcg_region_tree {
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * The memory of a region is placed on the host NUMA node of the thread that
+ * first generates code into it.  Threads prefer free regions on their own
+ * node, then untouched ones, so that on multi-socket hosts each vCPU mostly
+ * executes code from local memory, also after the buffer has been flushed.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -70,7 +79,9 @@ struct tcg_region_state {
     size_t total_size; /* size of entire buffer, >= n * stride */
 
     /* fields protected by the lock */
-    size_t current; /* current region index */
+    size_t n_used; /* number of regions assigned to a context */
+    unsigned long *used; /* bitmap of regions assigned to a context */
+    int *node; /* host node of each region's memory, or -1 if untouched */
     size_t agg_size_full; /* aggregate size of full regions */
 };
 
@@ -191,10 +202,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region containing @p, in the rw buffer */
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
 
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -205,19 +229,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
             return NULL;
         }
     }
-
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -357,13 +369,60 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     s->code_gen_highwater = end - TCG_HIGHWATER;
 }
 
-static bool tcg_region_alloc__locked(TCGContext *s)
+/* Return the host NUMA node of the calling thread, or -1 if unknown */
+static int tcg_region_current_node(void)
+{
+#if defined(CONFIG_LINUX) && defined(CONFIG_GETCPU)
+    unsigned cpu, node;
+
+    if (getcpu(&cpu, &node) == 0) {
+        return node;
+    }
+#endif
+    return -1;
+}
+
+/* Return the host NUMA node of the region @s is using, or -1 */
+static int tcg_region_ctx_node(const TCGContext *s)
 {
-    if (region.current == region.n) {
+    return region.node[tcg_region_index(s->code_gen_buffer)];
+}
+
+/*
+ * Assign a free region to @s.  Prefer regions whose memory is on @node,
+ * then regions that have not been used yet, which will end up on @node.
+ */
+static bool tcg_region_alloc__locked(TCGContext *s, int node)
+{
+    size_t i, untouched = region.n, any = region.n;
+
+    if (region.n_used == region.n) {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    for (i = 0; i < region.n; i++) {
+        if (test_bit(i, region.used)) {
+            continue;
+        }
+        if (region.node[i] == node) {
+            break;
+        }
+        if (region.node[i] < 0 && untouched == region.n) {
+            untouched = i;
+        }
+        if (any == region.n) {
+            any = i;
+        }
+    }
+    if (i == region.n) {
+        i = untouched < region.n ? untouched : any;
+    }
+
+    set_bit(i, region.used);
+    region.n_used++;
+    if (region.node[i] < 0) {
+        region.node[i] = node;
+    }
+    tcg_region_assign(s, i);
     return false;
 }
 
@@ -376,9 +435,13 @@ bool tcg_region_alloc(TCGContext *s)
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    int node = tcg_region_current_node();
 
     qemu_mutex_lock(&region.lock);
-    err = tcg_region_alloc__locked(s);
+    if (node < 0) {
+        node = tcg_region_ctx_node(s);
+    }
+    err = tcg_region_alloc__locked(s, node);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
     }
@@ -390,16 +453,18 @@ bool tcg_region_alloc(TCGContext *s)
  * Perform a context's first region allocation.
  * This function does _not_ increment region.agg_size_full.
  */
-static void tcg_region_initial_alloc__locked(TCGContext *s)
+static void tcg_region_initial_alloc__locked(TCGContext *s, int node)
 {
-    bool err = tcg_region_alloc__locked(s);
+    bool err = tcg_region_alloc__locked(s, node);
     g_assert(!err);
 }
 
 void tcg_region_initial_alloc(TCGContext *s)
 {
+    int node = tcg_region_current_node();
+
     qemu_mutex_lock(&region.lock);
-    tcg_region_initial_alloc__locked(s);
+    tcg_region_initial_alloc__locked(s, node);
     qemu_mutex_unlock(&region.lock);
 }
 
@@ -410,12 +475,14 @@ void tcg_region_reset_all(void)
     unsigned int i;
 
     qemu_mutex_lock(&region.lock);
-    region.current = 0;
+    region.n_used = 0;
+    bitmap_zero(region.used, region.n);
     region.agg_size_full = 0;
 
+    /* Keep each context on the node of the region it was using */
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
-        tcg_region_initial_alloc__locked(s);
+        tcg_region_initial_alloc__locked(s, tcg_region_ctx_node(s));
     }
     qemu_mutex_unlock(&region.lock);
 
@@ -808,6 +875,11 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.used = bitmap_new(region.n);
+    region.node = g_new(int, region.n);
+    for (size_t i = 0; i < region.n; i++) {
+        region.node[i] = -1;
+    }
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
@@ -857,7 +929,8 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
      * This will be the context into which we generate the prologue.
      * It is also the only context for CONFIG_USER_ONLY.
      */
-    tcg_region_initial_alloc__locked(&tcg_init_ctx);
+    tcg_region_initial_alloc__locked(&tcg_init_ctx,
+                                     tcg_region_current_node());
 }
 
 void tcg_region_prologue_set(TCGContext *s)
@@ -4278,6 +4278,44 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
     }
 }
 
+/*
+ * Try to keep the temporary in call-clobbered register 'reg' alive across
+ * a helper call by moving it to a free call-saved register, which costs a
+ * single move instead of a store now and a load at the next use.  Temps
+ * whose memory copy is already current are left to be freed: that costs
+ * nothing now and the next use, if any, is only a load.
+ */
+static bool tcg_reg_move_call_saved(TCGContext *s, TCGReg reg,
+                                    TCGRegSet allocated_regs)
+{
+    TCGTemp *ts = s->reg_to_temp[reg];
+    TCGRegSet set;
+    int i;
+
+    if (ts == NULL || ts->kind == TEMP_CONST || ts->mem_coherent) {
+        return false;
+    }
+
+    set = tcg_target_available_regs[ts->type]
+          & ~tcg_target_call_clobber_regs & ~allocated_regs;
+    if (set == 0) {
+        return false;
+    }
+    for (i = 0; i < ARRAY_SIZE(tcg_target_reg_alloc_order); i++) {
+        TCGReg new_reg = tcg_target_reg_alloc_order[i];
+
+        if (s->reg_to_temp[new_reg] == NULL &&
+            tcg_regset_test_reg(set, new_reg)) {
+            if (!tcg_out_mov(s, ts->type, new_reg, reg)) {
+                return false;
+            }
+            set_temp_val_reg(s, ts, new_reg);
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * tcg_reg_alloc:
  * @required_regs: Set of registers in which we must allocate.
@@ -5343,9 +5381,22 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
         }
     }
 
-    /* Clobber call registers.  */
+    /*
+     * Clobber call registers.  Temps that survive the call in a register
+     * are moved to free call-saved registers rather than spilled; this
+     * excludes globals when the helper may write them, as those are saved
+     * to memory below anyway.
+     */
     for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
         if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i)) {
+            TCGTemp *ts = s->reg_to_temp[i];
+
+            if (ts && (ts->kind != TEMP_GLOBAL ||
+                       (info->flags & (TCG_CALL_NO_READ_GLOBALS |
+                                       TCG_CALL_NO_WRITE_GLOBALS))) &&
+                tcg_reg_move_call_saved(s, i, allocated_regs)) {
+                continue;
+            }
             tcg_reg_free(s, i, allocated_regs);
         }
     }
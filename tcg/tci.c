@@ -18,6 +18,8 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "hw/core/cpu.h"
 #include "tcg/tcg.h"
 #include "tcg/tcg-ldst.h"
 #include <ffi.h>
@@ -62,6 +64,9 @@ static uint64_t tci_uint64(uint32_t high, uint32_t low)
  *   n = immediate (call return length)
  *   r = register
  *   s = signed ldst offset
+ *
+ * Conditional branches take a second word, which holds the label in
+ * the same format as INDEX_op_br.
  */
 
 static void tci_args_l(uint32_t insn, const void *tb_ptr, void **l0)
@@ -181,6 +186,31 @@ static void tci_args_rrrrrc(uint32_t insn, TCGReg *r0, TCGReg *r1,
     *c5 = extract32(insn, 28, 4);
 }
 
+static void tci_args_rrcl(uint32_t insn, const uint32_t **tb_ptr,
+                          TCGReg *r0, TCGReg *r1, TCGCond *c2, void **l3)
+{
+    uint32_t label = *(*tb_ptr)++;
+
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *c2 = extract32(insn, 16, 4);
+    *l3 = sextract32(label, 12, 20) + (void *)*tb_ptr;
+}
+
+static void tci_args_rrrrcl(uint32_t insn, const uint32_t **tb_ptr,
+                            TCGReg *r0, TCGReg *r1, TCGReg *r2, TCGReg *r3,
+                            TCGCond *c4, void **l5)
+{
+    uint32_t label = *(*tb_ptr)++;
+
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *r2 = extract32(insn, 16, 4);
+    *r3 = extract32(insn, 20, 4);
+    *c4 = extract32(insn, 24, 4);
+    *l5 = sextract32(label, 12, 20) + (void *)*tb_ptr;
+}
+
 static void tci_args_rrrrrr(uint32_t insn, TCGReg *r0, TCGReg *r1,
                             TCGReg *r2, TCGReg *r3, TCGReg *r4, TCGReg *r5)
 {
@@ -276,12 +306,84 @@ static bool tci_compare64(uint64_t u0, uint64_t u1, TCGCond condition)
     return result;
 }
 
+#ifdef CONFIG_SOFTMMU
+/*
+ * Look up @taddr in the TLB like the fast path of the native backends,
+ * see prepare_host_addr() in e.g. tcg/aarch64/tcg-target.c.inc.  Return
+ * the host address, or NULL if the access must go through the helpers:
+ * because of a TLB miss, a flagged page (I/O, watchpoint, dirty
+ * tracking...), a misaligned access or one that crosses pages.
+ */
+static void *tci_tlb_lookup(CPUArchState *env, uint64_t taddr,
+                            MemOpIdx oi, bool is_ld)
+{
+    const TCGContext *s = tcg_ctx;
+    MemOp mop = get_memop(oi);
+    uint64_t page_mask = (int64_t)s->page_mask;
+    unsigned a_mask = (1u << get_alignment_bits(mop)) - 1;
+    unsigned s_mask = memop_size(mop) - 1;
+    CPUTLBDescFast *fast;
+    CPUTLBEntry *entry;
+    uint64_t cmp;
+
+    if ((taddr & a_mask) || (((taddr & ~page_mask) + s_mask) & page_mask)) {
+        return NULL;
+    }
+
+    fast = (void *)env - sizeof(CPUNegativeOffsetState)
+         + offsetof(CPUNegativeOffsetState, tlb.f[get_mmuidx(oi)]);
+    entry = (void *)fast->table
+          + ((taddr >> (s->page_bits - CPU_TLB_ENTRY_BITS)) & fast->mask);
+#if TCG_TARGET_REG_BITS == 64
+    cmp = qatomic_read(is_ld ? &entry->addr_read : &entry->addr_write);
+#else
+    cmp = is_ld ? entry->addr_read : entry->addr_write;
+#endif
+    if (cmp != (taddr & page_mask)) {
+        return NULL;
+    }
+    return (void *)(uintptr_t)(taddr + entry->addend);
+}
+#endif
+
 static uint64_t tci_qemu_ld(CPUArchState *env, uint64_t taddr,
                             MemOpIdx oi, const void *tb_ptr)
 {
     MemOp mop = get_memop(oi);
     uintptr_t ra = (uintptr_t)tb_ptr;
 
+#ifdef CONFIG_SOFTMMU
+    void *haddr = tci_tlb_lookup(env, taddr, oi, true);
+
+    if (likely(haddr)) {
+        uint64_t val;
+
+        switch (mop & MO_SIZE) {
+        case MO_8:
+            val = ldub_p(haddr);
+            break;
+        case MO_16:
+            val = lduw_he_p(haddr);
+            val = mop & MO_BSWAP ? bswap16(val) : val;
+            break;
+        case MO_32:
+            val = ldl_he_p(haddr);
+            val = mop & MO_BSWAP ? bswap32(val) : val;
+            break;
+        case MO_64:
+            val = ldq_he_p(haddr);
+            val = mop & MO_BSWAP ? bswap64(val) : val;
+            break;
+        default:
+            g_assert_not_reached();
+        }
+        if (mop & MO_SIGN) {
+            val = sextract64(val, 0, 8 << (mop & MO_SIZE));
+        }
+        return val;
+    }
+#endif
+
     switch (mop & MO_SSIZE) {
     case MO_UB:
         return helper_ldub_mmu(env, taddr, oi, ra);
@@ -308,6 +410,30 @@ static void tci_qemu_st(CPUArchState *env, uint64_t taddr, uint64_t val,
     MemOp mop = get_memop(oi);
     uintptr_t ra = (uintptr_t)tb_ptr;
 
+#ifdef CONFIG_SOFTMMU
+    void *haddr = tci_tlb_lookup(env, taddr, oi, false);
+
+    if (likely(haddr)) {
+        switch (mop & MO_SIZE) {
+        case MO_8:
+            stb_p(haddr, val);
+            break;
+        case MO_16:
+            stw_he_p(haddr, mop & MO_BSWAP ? bswap16(val) : val);
+            break;
+        case MO_32:
+            stl_he_p(haddr, mop & MO_BSWAP ? bswap32(val) : val);
+            break;
+        case MO_64:
+            stq_he_p(haddr, mop & MO_BSWAP ? bswap64(val) : val);
+            break;
+        default:
+            g_assert_not_reached();
+        }
+        return;
+    }
+#endif
+
     switch (mop & MO_SIZE) {
     case MO_UB:
         helper_stb_mmu(env, taddr, val, oi, ra);
@@ -655,11 +781,22 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         case INDEX_op_brcond_i32:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if ((uint32_t)regs[r0]) {
+            tci_args_rrcl(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare32(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            break;
+#if TCG_TARGET_REG_BITS == 32
+        case INDEX_op_brcond2_i32:
+            tci_args_rrrrcl(insn, &tb_ptr, &r0, &r1, &r2, &r3,
+                            &condition, &ptr);
+            T1 = tci_uint64(regs[r1], regs[r0]);
+            T2 = tci_uint64(regs[r3], regs[r2]);
+            if (tci_compare64(T1, T2, condition)) {
                 tb_ptr = ptr;
             }
             break;
+#endif
 #if TCG_TARGET_REG_BITS == 32 || TCG_TARGET_HAS_add2_i32
         case INDEX_op_add2_i32:
             tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
@@ -866,8 +1003,8 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         case INDEX_op_brcond_i64:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if (regs[r0]) {
+            tci_args_rrcl(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare64(regs[r0], regs[r1], condition)) {
                 tb_ptr = ptr;
             }
             break;
@@ -1093,9 +1230,16 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
 
     case INDEX_op_brcond_i32:
     case INDEX_op_brcond_i64:
-        tci_args_rl(insn, tb_ptr, &r0, &ptr);
-        info->fprintf_func(info->stream, "%-12s  %s, 0, ne, %p",
-                           op_name, str_r(r0), ptr);
+        tci_args_rrcl(insn, &tb_ptr, &r0, &r1, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_c(c), ptr);
+        break;
+
+    case INDEX_op_brcond2_i32:
+        tci_args_rrrrcl(insn, &tb_ptr, &r0, &r1, &r2, &r3, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1),
+                           str_r(r2), str_r(r3), str_c(c), ptr);
         break;
 
     case INDEX_op_setcond_i32:
@@ -1315,5 +1459,5 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
         break;
     }
 
-    return sizeof(insn);
+    return (void *)tb_ptr - (void *)(uintptr_t)addr;
 }
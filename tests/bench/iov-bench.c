@@ -0,0 +1,151 @@
+/*
+ * Microbenchmark for the iovec helpers
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "qemu/timer.h"
+
+static unsigned int niov = 1;
+static size_t size = 4096;
+static unsigned int duration = 1;
+
+static const char commands_string[] =
+    " -n = number of iovec elements\n"
+    " -s = total bytes per request\n"
+    " -d = duration in seconds per test";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+typedef struct {
+    QEMUIOVector qiov;
+    void *buf;
+} IovBench;
+
+typedef void IovBenchFn(IovBench *b);
+
+static void bench_to_buf(IovBench *b)
+{
+    qemu_iovec_to_buf(&b->qiov, 0, b->buf, size);
+}
+
+static void bench_from_buf(IovBench *b)
+{
+    qemu_iovec_from_buf(&b->qiov, 0, b->buf, size);
+}
+
+static void bench_memset(IovBench *b)
+{
+    qemu_iovec_memset(&b->qiov, 0, 0, size);
+}
+
+static void bench_slice(IovBench *b)
+{
+    QEMUIOVector slice;
+
+    qemu_iovec_init_slice(&slice, &b->qiov, 1, size - 2);
+    qemu_iovec_destroy(&slice);
+}
+
+static void bench_concat(IovBench *b)
+{
+    QEMUIOVector qiov;
+
+    qemu_iovec_init(&qiov, 1);
+    qemu_iovec_concat(&qiov, &b->qiov, 0, size);
+    qemu_iovec_destroy(&qiov);
+}
+
+static void run_test(const char *name, IovBenchFn *fn, IovBench *b)
+{
+    int64_t start = get_clock(), end, deadline;
+    uint64_t ops = 0;
+    double secs;
+
+    deadline = start + duration * NANOSECONDS_PER_SECOND;
+    do {
+        /* Amortize the clock reads */
+        for (int i = 0; i < 1024; i++) {
+            fn(b);
+        }
+        ops += 1024;
+        end = get_clock();
+    } while (end < deadline);
+
+    secs = (double)(end - start) / NANOSECONDS_PER_SECOND;
+    printf(" %-10s %10.2f Mops/s %10.2f ns/op %10.2f GiB/s\n", name,
+           ops / secs / 1e6, secs * 1e9 / ops,
+           fn == bench_slice || fn == bench_concat ? 0.0 :
+           ops * size / secs / (1024.0 * 1024 * 1024));
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "hd:n:s:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'n':
+            niov = MAX(atoi(optarg), 1);
+            break;
+        case 's':
+            size = MAX(atoll(optarg), 2);
+            break;
+        default:
+            usage_complete(argv);
+            exit(1);
+        }
+    }
+    niov = MIN(niov, size);
+}
+
+int main(int argc, char *argv[])
+{
+    IovBench b;
+    size_t done = 0;
+    uint8_t *data;
+
+    parse_args(argc, argv);
+
+    data = g_malloc0(size);
+    b.buf = g_malloc0(size);
+    qemu_iovec_init(&b.qiov, niov);
+    for (unsigned int i = 0; i < niov; i++) {
+        size_t len = i == niov - 1 ? size - done : size / niov;
+
+        qemu_iovec_add(&b.qiov, data + done, len);
+        done += len;
+    }
+
+    printf("Parameters:\n");
+    printf(" iovec elements:    %u\n", niov);
+    printf(" bytes per request: %zu\n", size);
+    printf(" duration:          %u\n", duration);
+    printf("Results:\n");
+    run_test("to_buf", bench_to_buf, &b);
+    run_test("from_buf", bench_from_buf, &b);
+    run_test("memset", bench_memset, &b);
+    run_test("slice", bench_slice, &b);
+    run_test("concat", bench_concat, &b);
+
+    qemu_iovec_destroy(&b.qiov);
+    g_free(b.buf);
+    g_free(data);
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * Common helpers for the TCG benchmark kernels
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Each kernel runs a fixed amount of work, scaled by an optional
+ * iteration count on the command line, and prints a checksum so that
+ * the compiler cannot drop the work.
+ */
+
+#ifndef TCG_BENCH_H
+#define TCG_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static inline unsigned long bench_iterations(int argc, char **argv,
+                                             unsigned long dflt)
+{
+    return argc > 1 ? strtoul(argv[1], NULL, 0) : dflt;
+}
+
+static inline int bench_result(const char *name, uint64_t checksum)
+{
+    printf("%s: %016llx\n", name, (unsigned long long)checksum);
+    return 0;
+}
+
+#endif
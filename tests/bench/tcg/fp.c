@@ -0,0 +1,25 @@
+/*
+ * TCG benchmark: scalar floating point
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Multiply-add, division and conversion in double and single precision,
+ * which on most targets go through the softfloat helpers.
+ */
+
+#include "bench.h"
+
+int main(int argc, char **argv)
+{
+    unsigned long n = bench_iterations(argc, argv, 10000000);
+    double a = 1.0, b = 0.999999, acc = 0.0;
+    float f = 1.5f, g = 0.0f;
+
+    for (unsigned long i = 0; i < n; i++) {
+        a = a * b + 1e-7;
+        acc += a / (1.0 + (i & 15));
+        f = f * 0.75f + 0.5f;
+        g += f - (float)(int)f;
+    }
+    return bench_result("fp", (uint64_t)(acc * 1e6) ^ (uint64_t)(g * 1e3));
+}
@@ -0,0 +1,28 @@
+/*
+ * TCG benchmark: integer ALU and branches
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * A tight loop of adds, multiplies, shifts and data-dependent branches
+ * that stays inside a handful of TBs, so that the time is dominated by
+ * the execution of generated code.
+ */
+
+#include "bench.h"
+
+int main(int argc, char **argv)
+{
+    unsigned long n = bench_iterations(argc, argv, 50000000);
+    uint32_t x = 1, y = 0x12345678, sum = 0;
+
+    for (unsigned long i = 0; i < n; i++) {
+        x = x * 1103515245 + 12345;
+        y ^= x >> 7;
+        if (x & 0x100) {
+            sum += y;
+        } else {
+            sum -= y << 3;
+        }
+    }
+    return bench_result("intloop", sum);
+}
@@ -0,0 +1,41 @@
+/*
+ * TCG benchmark: memory copies
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Copy and clear buffers of various sizes with the C library, which
+ * exercises the guest load/store fast paths and, for the larger sizes,
+ * the host memory bandwidth.
+ */
+
+#include <string.h>
+#include "bench.h"
+
+#define BUF_SIZE (256 * 1024)
+
+static uint8_t src[BUF_SIZE + 64], dst[BUF_SIZE];
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = { 16, 64, 256, 4096, BUF_SIZE };
+    unsigned long n = bench_iterations(argc, argv, 2000);
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = i * 7;
+    }
+
+    for (unsigned long i = 0; i < n; i++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            size_t len = sizes[s];
+
+            for (size_t off = 0; off + len <= BUF_SIZE; off += BUF_SIZE / 4) {
+                memcpy(dst + off, src + off + (i & 63), len);
+                sum += dst[off + len - 1];
+            }
+        }
+        memset(dst, i, BUF_SIZE / 2);
+        sum += dst[i % (BUF_SIZE / 2)];
+    }
+    return bench_result("memcpy", sum);
+}
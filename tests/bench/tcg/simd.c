@@ -0,0 +1,41 @@
+/*
+ * TCG benchmark: vector operations
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Use GCC vector extensions so that the compiler emits the guest's vector
+ * instructions where it has them, which TCG maps to host vector ops when
+ * the backend supports them.
+ */
+
+#include "bench.h"
+
+#define N 1024
+
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+static v4u32 va[N / 4], vb[N / 4];
+
+int main(int argc, char **argv)
+{
+    unsigned long n = bench_iterations(argc, argv, 50000);
+    v4u32 acc = { 0 };
+    uint64_t sum;
+
+    for (int i = 0; i < N / 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            va[i][j] = i * 4 + j;
+            vb[i][j] = (i * 4 + j) * 0x9e3779b9u;
+        }
+    }
+
+    for (unsigned long k = 0; k < n; k++) {
+        for (int i = 0; i < N / 4; i++) {
+            va[i] = (va[i] + vb[i]) ^ (va[i] >> 3);
+            acc += va[i] & vb[i];
+        }
+    }
+
+    sum = (uint64_t)acc[0] + acc[1] + acc[2] + acc[3];
+    return bench_result("simd", sum);
+}
@@ -0,0 +1,31 @@
+/*
+ * TCG benchmark: system calls
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Cheap system calls in a loop, which measures the cost of leaving the
+ * translated code and of the syscall emulation layer.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "bench.h"
+
+int main(int argc, char **argv)
+{
+    unsigned long n = bench_iterations(argc, argv, 1000000);
+    int fd = open("/dev/null", O_WRONLY);
+    uint64_t sum = 0;
+    char c = 0;
+
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+    for (unsigned long i = 0; i < n; i++) {
+        sum += getppid() != 0;
+        sum += write(fd, &c, 1);
+    }
+    close(fd);
+    return bench_result("syscall", sum);
+}
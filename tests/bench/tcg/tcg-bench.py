@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+#
+# Run the TCG benchmark kernels under qemu-user and report their speed
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Each kernel is run --repeat times with -tcg-stats, and the fastest run
+# is reported together with the counters QEMU printed at exit.  If the
+# insn plugin is given, one extra run counts the guest instructions so
+# that a rate can be computed; the plugin is not loaded for timed runs.
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+STATS_RE = re.compile(r'^tcg-stats: (\S+) (\d+)$')
+INSNS_RE = re.compile(r'^insns: (\d+)$', re.MULTILINE)
+
+
+def run_timed(cmd):
+    start = time.monotonic()
+    proc = subprocess.run(cmd, stdout=subprocess.DEVNULL,
+                          stderr=subprocess.PIPE, text=True, check=True)
+    elapsed = time.monotonic() - start
+    stats = {}
+    for line in proc.stderr.splitlines():
+        m = STATS_RE.match(line)
+        if m:
+            stats[m.group(1)] = int(m.group(2))
+    return elapsed, stats
+
+
+def count_insns(qemu, plugin, kernel):
+    with tempfile.NamedTemporaryFile(mode='r', suffix='.pout') as log:
+        subprocess.run([qemu, '-plugin', plugin + ',inline=true',
+                        '-d', 'plugin', '-D', log.name, kernel],
+                       stdout=subprocess.DEVNULL, check=True)
+        m = INSNS_RE.search(log.read())
+        return int(m.group(1)) if m else None
+
+
+def bench(args, kernel):
+    cmd = [args.qemu, '-tcg-stats', kernel]
+    runs = [run_timed(cmd) for _ in range(args.repeat)]
+    elapsed, stats = min(runs, key=lambda r: r[0])
+
+    result = {
+        'kernel': os.path.basename(kernel),
+        'seconds': elapsed,
+        'stats': stats,
+    }
+
+    ns = stats.get('tb-translation-ns')
+    if ns is not None:
+        result['translation-seconds'] = ns / 1e9
+
+    hits = (stats.get('tb-jmp-cache-hits', 0) +
+            stats.get('tb-jmp-cache-victim-hits', 0))
+    lookups = hits + stats.get('tb-jmp-cache-misses', 0)
+    if lookups:
+        result['jmp-cache-hit-rate'] = hits / lookups
+
+    if args.plugin:
+        insns = count_insns(args.qemu, args.plugin, kernel)
+        if insns is not None:
+            result['insns'] = insns
+            result['insns-per-second'] = insns / elapsed
+
+    return result
+
+
+def print_table(results):
+    print('%-16s %9s %9s %8s %12s %9s' %
+          ('kernel', 'time (s)', 'xlate (s)', 'TBs', 'MIPS', 'jc hits'))
+    for r in results:
+        mips = r.get('insns-per-second')
+        rate = r.get('jmp-cache-hit-rate')
+        print('%-16s %9.3f %9.3f %8d %12s %9s' %
+              (r['kernel'], r['seconds'], r.get('translation-seconds', 0),
+               r['stats'].get('tb-translations', 0),
+               '%.1f' % (mips / 1e6) if mips else '-',
+               '%.2f%%' % (rate * 100) if rate is not None else '-'))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Run the TCG benchmark kernels under qemu-user')
+    parser.add_argument('--qemu', required=True,
+                        help='qemu-user binary for the kernels\' target')
+    parser.add_argument('--plugin',
+                        help='path to libinsn.so, to count instructions')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='number of timed runs per kernel')
+    parser.add_argument('--json', action='store_true',
+                        help='print the results as JSON')
+    parser.add_argument('kernels', nargs='+', help='benchmark kernels')
+    args = parser.parse_args()
+
+    try:
+        results = [bench(args, k) for k in args.kernels]
+    except subprocess.CalledProcessError as e:
+        print('%s failed with status %d' % (' '.join(e.cmd), e.returncode),
+              file=sys.stderr)
+        return 1
+
+    if args.json:
+        json.dump(results, sys.stdout, indent=2)
+        print()
+    else:
+        print_table(results)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
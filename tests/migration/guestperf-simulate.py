@@ -0,0 +1,14 @@
+#!/usr/bin/env python3
+#
+# Migration convergence simulator invocation command
+#
+# SPDX-License-Identifier: LGPL-2.1-or-later
+#
+
+
+import sys
+
+from guestperf.shell import SimulateShell
+
+shell = SimulateShell()
+sys.exit(shell.run(sys.argv[1:]))
@@ -136,6 +136,64 @@ def __init__(self, name, scenarios):
                  multifd=True, multifd_channels=64),
     ]),
 
+    # Looking at effect of multifd compression methods
+    Comparison("multifd-compression", scenarios = [
+        Scenario("multifd-compression-none",
+                 multifd=True, multifd_channels=4,
+                 multifd_compression="none"),
+        Scenario("multifd-compression-zlib",
+                 multifd=True, multifd_channels=4,
+                 multifd_compression="zlib"),
+        Scenario("multifd-compression-zstd",
+                 multifd=True, multifd_channels=4,
+                 multifd_compression="zstd"),
+    ]),
+
+
+    # Looking at effect of zero copy send with multifd,
+    # needs --locked-pages
+    Comparison("zero-copy", scenarios = [
+        Scenario("zero-copy-off",
+                 multifd=True, multifd_channels=4),
+        Scenario("zero-copy-on",
+                 multifd=True, multifd_channels=4, zero_copy=True),
+    ]),
+
+
+    # Looking at convergence as the guest dirties memory
+    # faster, with a 10 Gb/s link
+    Comparison("dirty-rate", scenarios = [
+        Scenario("dirty-rate-100",
+                 bandwidth=1250, dirty_rate=100),
+        Scenario("dirty-rate-500",
+                 bandwidth=1250, dirty_rate=500),
+        Scenario("dirty-rate-1000",
+                 bandwidth=1250, dirty_rate=1000),
+        Scenario("dirty-rate-2000",
+                 bandwidth=1250, dirty_rate=2000),
+    ]),
+
+
+    # Looking at effect of the size of the guest working set
+    Comparison("working-set", scenarios = [
+        Scenario("working-set-10",
+                 bandwidth=1250, working_set=10),
+        Scenario("working-set-25",
+                 bandwidth=1250, working_set=25),
+        Scenario("working-set-50",
+                 bandwidth=1250, working_set=50),
+        Scenario("working-set-100",
+                 bandwidth=1250, working_set=100),
+    ]),
+
+
+    # Looking at effect of zero page detection
+    Comparison("zero-pages", scenarios = [
+        Scenario("zero-pages-0", zero_pages=0),
+        Scenario("zero-pages-50", zero_pages=50),
+        Scenario("zero-pages-90", zero_pages=90),
+    ]),
+
     # Looking at effect of dirty-limit with
     # varying x_vcpu_dirty_limit_period
     Comparison("compr-dirty-limit-period", scenarios = [
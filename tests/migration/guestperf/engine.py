@@ -204,6 +204,19 @@ def _migrate(self, hardware, scenario, src, dst, connect_uri):
                            ])
             resp = dst.cmd("migrate-set-parameters",
                            multifd_channels=scenario._multifd_channels)
+            resp = src.cmd("migrate-set-parameters",
+                           multifd_compression=scenario._multifd_compression)
+            resp = dst.cmd("migrate-set-parameters",
+                           multifd_compression=scenario._multifd_compression)
+
+        if scenario._zero_copy:
+            if not scenario._multifd or not hardware._locked_pages:
+                raise Exception("zero copy needs multifd and locked pages")
+            resp = src.cmd("migrate-set-capabilities",
+                           capabilities = [
+                               { "capability": "zero-copy-send",
+                                 "state": True }
+                           ])
 
         if scenario._dirty_limit:
             if not hardware._dirty_ring_size:
@@ -318,7 +331,7 @@ def _get_qemu_serial_args(self):
             return ["-chardev", "stdio,id=cdev0",
                     "-device", "isa-serial,chardev=cdev0"]
 
-    def _get_common_args(self, hardware, tunnelled=False):
+    def _get_common_args(self, hardware, scenario, tunnelled=False):
         args = [
             "noapic",
             "edd=off",
@@ -336,6 +349,9 @@ def _get_common_args(self, hardware, tunnelled=False):
             args.append("quiet")
 
         args.append("ramsize=%s" % hardware._mem)
+        args.append("dirtyrate=%d" % scenario._dirty_rate)
+        args.append("workingset=%d" % scenario._working_set)
+        args.append("zeropct=%d" % scenario._zero_pages)
 
         cmdline = " ".join(args)
         if tunnelled:
@@ -361,23 +377,23 @@ def _get_common_args(self, hardware, tunnelled=False):
             argv.extend(["-machine", "graphics=off"])
 
         if hardware._prealloc_pages:
-            argv_source += ["-mem-path", "/dev/shm",
-                            "-mem-prealloc"]
+            argv += ["-mem-path", "/dev/shm",
+                     "-mem-prealloc"]
         if hardware._locked_pages:
-            argv_source += ["-overcommit", "mem-lock=on"]
+            argv += ["-overcommit", "mem-lock=on"]
         if hardware._huge_pages:
             pass
 
         return argv
 
-    def _get_src_args(self, hardware):
-        return self._get_common_args(hardware)
+    def _get_src_args(self, hardware, scenario):
+        return self._get_common_args(hardware, scenario)
 
-    def _get_dst_args(self, hardware, uri):
+    def _get_dst_args(self, hardware, scenario, uri):
         tunnelled = False
         if self._dst_host != "localhost":
             tunnelled = True
-        argv = self._get_common_args(hardware, tunnelled)
+        argv = self._get_common_args(hardware, scenario, tunnelled)
         return argv + ["-incoming", uri]
 
     @staticmethod
@@ -446,13 +462,13 @@ def run(self, hardware, scenario, result_dir=os.getcwd()):
         srcmonaddr = "/var/tmp/qemu-src-%d-monitor.sock" % os.getpid()
 
         src = QEMUMachine(self._binary,
-                          args=self._get_src_args(hardware),
+                          args=self._get_src_args(hardware, scenario),
                           wrapper=self._get_src_wrapper(hardware),
                           name="qemu-src-%d" % os.getpid(),
                           monitor_address=srcmonaddr)
 
         dst = QEMUMachine(self._binary,
-                          args=self._get_dst_args(hardware, uri),
+                          args=self._get_dst_args(hardware, scenario, uri),
                           wrapper=self._get_dst_wrapper(hardware),
                           name="qemu-dst-%d" % os.getpid(),
                           monitor_address=dstmonaddr)
@@ -53,8 +53,43 @@ def __init__(self,
         self._transport = transport
         self._sleep = sleep
 
+    def _qemu_cpu_ms(self, start, end):
+        # Source QEMU CPU time between two timestamps, from the samples
+        before = [r for r in self._qemu_timings._records
+                  if r._timestamp <= start]
+        after = [r for r in self._qemu_timings._records
+                 if r._timestamp >= end]
+        if not before or not after:
+            return None
+        return after[0]._value - before[-1]._value
+
+    def summary(self):
+        """Headline numbers of the migration, some may be None"""
+        if not self._progress_history:
+            return {}
+        last = self._progress_history[-1]
+        transferred = last._ram._transferred_bytes
+        secs = last._duration / 1000.0
+        start = last._now - secs
+
+        cpu_ms = self._qemu_cpu_ms(start, last._now)
+        gib = transferred / (1024 * 1024 * 1024)
+        return {
+            "status": last._status,
+            "iterations": last._ram._iterations,
+            "total_time_ms": last._duration,
+            "downtime_ms": last._downtime,
+            "transferred_bytes": transferred,
+            "bandwidth_mibs": (transferred / (1024 * 1024) / secs
+                               if secs else None),
+            "src_cpu_ms": cpu_ms,
+            "src_cpu_ms_per_gib": (cpu_ms / gib
+                                   if cpu_ms is not None and gib else None),
+        }
+
     def serialize(self):
         return {
+            "summary": self.summary(),
             "hardware": self._hardware.serialize(),
             "scenario": self._scenario.serialize(),
             "progress_history": [progress.serialize() for progress in self._progress_history],
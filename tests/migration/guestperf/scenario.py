@@ -31,8 +31,10 @@ def __init__(self, name,
                  compression_mt=False, compression_mt_threads=1,
                  compression_xbzrle=False, compression_xbzrle_cache=10,
                  multifd=False, multifd_channels=2,
+                 multifd_compression="none", zero_copy=False,
                  dirty_limit=False, x_vcpu_dirty_limit_period=500,
-                 vcpu_dirty_limit=1):
+                 vcpu_dirty_limit=1,
+                 dirty_rate=0, working_set=100, zero_pages=0):
 
         self._name = name
 
@@ -61,11 +63,18 @@ def __init__(self, name,
 
         self._multifd = multifd
         self._multifd_channels = multifd_channels
+        self._multifd_compression = multifd_compression # none, zlib, zstd
+        self._zero_copy = zero_copy # needs multifd and locked pages
 
         self._dirty_limit = dirty_limit
         self._x_vcpu_dirty_limit_period = x_vcpu_dirty_limit_period
         self._vcpu_dirty_limit = vcpu_dirty_limit
 
+        # Guest workload
+        self._dirty_rate = dirty_rate # MiB per second, 0 for unlimited
+        self._working_set = working_set # percentage of guest RAM
+        self._zero_pages = zero_pages # percentage of dirtied pages
+
     def serialize(self):
         return {
             "name": self._name,
@@ -85,28 +94,18 @@ def serialize(self):
             "compression_xbzrle_cache": self._compression_xbzrle_cache,
             "multifd": self._multifd,
             "multifd_channels": self._multifd_channels,
+            "multifd_compression": self._multifd_compression,
+            "zero_copy": self._zero_copy,
             "dirty_limit": self._dirty_limit,
             "x_vcpu_dirty_limit_period": self._x_vcpu_dirty_limit_period,
             "vcpu_dirty_limit": self._vcpu_dirty_limit,
+            "dirty_rate": self._dirty_rate,
+            "working_set": self._working_set,
+            "zero_pages": self._zero_pages,
         }
 
     @classmethod
     def deserialize(cls, data):
-        return cls(
-            data["name"],
-            data["downtime"],
-            data["bandwidth"],
-            data["max_iters"],
-            data["max_time"],
-            data["pause"],
-            data["pause_iters"],
-            data["post_copy"],
-            data["post_copy_iters"],
-            data["auto_converge"],
-            data["auto_converge_step"],
-            data["compression_mt"],
-            data["compression_mt_threads"],
-            data["compression_xbzrle"],
-            data["compression_xbzrle_cache"],
-            data["multifd"],
-            data["multifd_channels"])
+        # Reports written by older versions lack the newer fields
+        data = dict(data)
+        return cls(data.pop("name"), **data)
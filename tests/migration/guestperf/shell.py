@@ -20,6 +20,7 @@
 
 import argparse
 import fnmatch
+import json
 import os
 import os.path
 import platform
@@ -32,6 +33,7 @@
 from guestperf.comparison import COMPARISONS
 from guestperf.plot import Plot
 from guestperf.report import Report
+from guestperf.simulate import simulate
 
 
 class BaseShell(object):
@@ -130,6 +132,11 @@ def __init__(self):
                             action="store_true")
         parser.add_argument("--multifd-channels", dest="multifd_channels",
                             default=2, type=int)
+        parser.add_argument("--multifd-compression",
+                            dest="multifd_compression", default="none",
+                            choices=["none", "zlib", "zstd"])
+        parser.add_argument("--zero-copy", dest="zero_copy", default=False,
+                            action="store_true")
 
         parser.add_argument("--dirty-limit", dest="dirty_limit", default=False,
                             action="store_true")
@@ -142,6 +149,17 @@ def __init__(self):
                             dest="vcpu_dirty_limit",
                             default=1, type=int)
 
+        # Guest workload args
+        parser.add_argument("--dirty-rate", dest="dirty_rate",
+                            default=0, type=int,
+                            help="MiB/s dirtied by the guest, 0 for maximum")
+        parser.add_argument("--working-set", dest="working_set",
+                            default=100, type=int,
+                            help="percentage of guest RAM being dirtied")
+        parser.add_argument("--zero-pages", dest="zero_pages",
+                            default=0, type=int,
+                            help="percentage of dirtied pages that are zero")
+
     def get_scenario(self, args):
         return Scenario(name="perfreport",
                         downtime=args.downtime,
@@ -166,11 +184,17 @@ def get_scenario(self, args):
 
                         multifd=args.multifd,
                         multifd_channels=args.multifd_channels,
+                        multifd_compression=args.multifd_compression,
+                        zero_copy=args.zero_copy,
 
                         dirty_limit=args.dirty_limit,
                         x_vcpu_dirty_limit_period=\
                             args.x_vcpu_dirty_limit_period,
-                        vcpu_dirty_limit=args.vcpu_dirty_limit)
+                        vcpu_dirty_limit=args.vcpu_dirty_limit,
+
+                        dirty_rate=args.dirty_rate,
+                        working_set=args.working_set,
+                        zero_pages=args.zero_pages)
 
     def run(self, argv):
         args = self._parser.parse_args(argv)
@@ -198,6 +222,31 @@ def run(self, argv):
             return 1
 
 
+class SimulateShell(Shell):
+
+    def run(self, argv):
+        args = self._parser.parse_args(argv)
+
+        hardware = self.get_hardware(args)
+        scenario = self.get_scenario(args)
+
+        try:
+            result = simulate(hardware, scenario)
+        except Exception as e:
+            print("Error: %s" % str(e), file=sys.stderr)
+            return 1
+
+        result["hardware"] = hardware.serialize()
+        result["scenario"] = scenario.serialize()
+        output = json.dumps(result, indent=4)
+        if args.output is None:
+            print(output)
+        else:
+            with open(args.output, "w") as fh:
+                print(output, file=fh)
+        return 0
+
+
 class BatchShell(BaseShell):
 
     def __init__(self):
@@ -0,0 +1,81 @@
+#
+# Migration convergence simulator
+#
+# SPDX-License-Identifier: LGPL-2.1-or-later
+#
+# Predict how pre-copy migration of the stress workload converges, without
+# running any guest.  The model is deliberately simple:
+#
+#  - the first iteration sends all of guest RAM, later ones send what the
+#    guest dirtied while the previous iteration was being sent;
+#  - the guest dirties distinct pages of its working set at the scenario's
+#    dirty rate, so an iteration never sends more than the working set;
+#  - zero pages cost nothing on the wire, and page headers are ignored;
+#  - auto-converge throttles the vCPUs by one more step per iteration
+#    once it starts, the way the source does after repeated dirty syncs.
+#
+# Migration is complete once the remaining data can be sent within the
+# downtime limit.  Post-copy and pausing are not modelled.
+#
+
+
+MiB = 1024 * 1024
+GiB = 1024 * MiB
+
+
+def simulate(hardware, scenario):
+    if not scenario._dirty_rate:
+        raise Exception("the simulation needs a dirty rate")
+
+    ram = hardware._mem * GiB
+    working_set = ram * scenario._working_set / 100
+    nonzero = 1 - scenario._zero_pages / 100
+    bandwidth = scenario._bandwidth * MiB
+    downtime = scenario._downtime / 1000.0
+
+    iterations = []
+    throttle = 0
+    elapsed = 0.0
+    transferred = 0
+    to_send = ram - working_set * (1 - nonzero)
+
+    while True:
+        secs = to_send / bandwidth
+        if iterations and secs <= downtime:
+            status = "completed"
+            break
+        if (len(iterations) >= scenario._max_iters or
+            elapsed + secs > scenario._max_time):
+            status = "failed"
+            break
+
+        iterations.append({
+            "iteration": len(iterations),
+            "sent_bytes": int(to_send),
+            "time_ms": int(secs * 1000),
+            "throttle_pcent": throttle,
+        })
+        elapsed += secs
+        transferred += to_send
+
+        rate = scenario._dirty_rate * MiB * (100 - throttle) / 100
+        to_send = min(working_set, rate * secs) * nonzero
+
+        if scenario._auto_converge and len(iterations) >= 2:
+            throttle = min(throttle + scenario._auto_converge_step, 99)
+
+    if status == "completed":
+        transferred += to_send
+        elapsed += secs
+
+    return {
+        "iterations": iterations,
+        "summary": {
+            "status": status,
+            "iterations": len(iterations),
+            "total_time_ms": int(elapsed * 1000),
+            "downtime_ms": int(secs * 1000) if status == "completed" else None,
+            "transferred_bytes": int(transferred),
+            "bandwidth_mibs": transferred / MiB / elapsed if elapsed else None,
+        },
+    }
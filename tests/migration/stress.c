@@ -156,16 +156,34 @@ static unsigned long long now(void)
     return (tv.tv_sec * 1000ull) + (tv.tv_usec / 1000ull);
 }
 
+/*
+ * Guest workload.  Each thread rewrites the first workingset percent of
+ * its RAM over and over, writing zeros to zeropct percent of the pages,
+ * and all threads together dirty at most dirtyrate MB per second (0 means
+ * as fast as possible).
+ */
+static unsigned long long dirty_rate_mb;
+static unsigned long long working_set_pct = 100;
+static unsigned long long zero_pct;
+static int nthreads;
+
 static void stressone(unsigned long long ramsizeMB)
 {
     size_t pagesPerMB = 1024 * 1024 / RAM_PAGE_SIZE;
+    size_t wssizeMB = MAX(ramsizeMB * working_set_pct / 100, 1);
+    unsigned long long rateMB = 0;
     g_autofree char *ram = g_malloc(ramsizeMB * 1024 * 1024);
     char *ramptr;
     size_t i, j, k;
     g_autofree char *data = g_malloc(RAM_PAGE_SIZE);
     char *dataptr;
     size_t nMB = 0;
-    unsigned long long before, after;
+    unsigned long long totalMB = 0;
+    unsigned long long before, after, start;
+
+    if (dirty_rate_mb) {
+        rateMB = MAX(dirty_rate_mb / nthreads, 1);
+    }
 
     /* We don't care about initial state, but we do want
      * to fault it all into RAM, otherwise the first iter
@@ -178,18 +196,33 @@ static void stressone(unsigned long long ramsizeMB)
         return;
     }
 
-    before = now();
+    start = before = now();
 
     while (1) {
 
         ramptr = ram;
-        for (i = 0; i < ramsizeMB; i++, nMB++) {
+        for (i = 0; i < wssizeMB; i++, nMB++) {
             for (j = 0; j < pagesPerMB; j++) {
+                if ((i * pagesPerMB + j) % 100 < zero_pct) {
+                    memset(ramptr, 0, RAM_PAGE_SIZE);
+                    ramptr += RAM_PAGE_SIZE;
+                    continue;
+                }
                 dataptr = data;
                 for (k = 0; k < RAM_PAGE_SIZE; k += sizeof(long long)) {
+                    *(unsigned long long *)ramptr ^= *(unsigned long long *)dataptr;
                     ramptr += sizeof(long long);
                     dataptr += sizeof(long long);
-                    *(unsigned long long *)ramptr ^= *(unsigned long long *)dataptr;
+                }
+            }
+
+            totalMB++;
+            if (rateMB) {
+                unsigned long long due = start + totalMB * 1000 / rateMB;
+                unsigned long long t = now();
+
+                if (t < due) {
+                    g_usleep((due - t) * 1000);
                 }
             }
 
@@ -218,6 +251,8 @@ static void stress(unsigned long long ramsizeGB, int ncpus)
 {
     size_t i;
     unsigned long long ramsizeMB = ramsizeGB * 1024 / ncpus;
+
+    nthreads = ncpus;
     ncpus--;
 
     for (i = 0; i < ncpus; i++) {
@@ -266,11 +301,14 @@ int main(int argc, char **argv)
     char *end;
     int ch;
     int opt_ind = 0;
-    const char *sopt = "hr:c:";
+    const char *sopt = "hr:c:d:w:z:";
     struct option lopt[] = {
         { "help", no_argument, NULL, 'h' },
         { "ramsize", required_argument, NULL, 'r' },
         { "cpus", required_argument, NULL, 'c' },
+        { "dirty-rate", required_argument, NULL, 'd' },
+        { "working-set", required_argument, NULL, 'w' },
+        { "zero-pages", required_argument, NULL, 'z' },
         { NULL, 0, NULL, 0 }
     };
     int ret;
@@ -300,9 +338,29 @@ int main(int argc, char **argv)
             }
             break;
 
+        case 'd':
+        case 'w':
+        case 'z':
+        {
+            unsigned long long *val = ch == 'd' ? &dirty_rate_mb :
+                                      ch == 'w' ? &working_set_pct :
+                                      &zero_pct;
+
+            errno = 0;
+            *val = strtoll(optarg, &end, 10);
+            if (errno != 0 || *end) {
+                fprintf(stderr, "%s (%05d): ERROR: Cannot parse %s\n",
+                        argv0, gettid(), optarg);
+                exit_failure();
+            }
+            break;
+        }
+
         case '?':
         case 'h':
-            fprintf(stderr, "%s: [--help][--ramsize GB][--cpus N]\n", argv0);
+            fprintf(stderr, "%s: [--help][--ramsize GB][--cpus N]"
+                    "[--dirty-rate MB/s][--working-set PERCENT]"
+                    "[--zero-pages PERCENT]\n", argv0);
             exit_failure();
         }
     }
@@ -314,6 +372,16 @@ int main(int argc, char **argv)
         ret = get_command_arg_ull("ramsize", &ramsizeGB);
         if (ret < 0)
             exit_failure();
+        if (get_command_arg_ull("dirtyrate", &dirty_rate_mb) < 0 ||
+            get_command_arg_ull("workingset", &working_set_pct) < 0 ||
+            get_command_arg_ull("zeropct", &zero_pct) < 0)
+            exit_failure();
+    }
+
+    if (working_set_pct < 1 || working_set_pct > 100 || zero_pct > 100) {
+        fprintf(stderr, "%s (%05d): ERROR: percentages must be in 0-100, "
+                "and the working set cannot be empty\n", argv0, gettid());
+        exit_failure();
     }
 
     if (ncpus == 0)
@@ -321,6 +389,9 @@ int main(int argc, char **argv)
 
     fprintf(stdout, "%s (%05d): INFO: RAM %llu GiB across %d CPUs\n",
             argv0, gettid(), ramsizeGB, ncpus);
+    fprintf(stdout, "%s (%05d): INFO: working set %llu%%, %llu%% zero pages, "
+            "dirty rate %llu MB/s\n", argv0, gettid(), working_set_pct,
+            zero_pct, dirty_rate_mb);
 
     stress(ramsizeGB, ncpus);
 
@@ -18,8 +18,11 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
 
 static uint64_t inline_mem_count;
 static uint64_t cb_mem_count;
+static uint64_t buffered_mem_count;
 static uint64_t io_count;
-static bool do_inline, do_callback;
+static bool do_inline, do_callback, do_buffered;
+static struct qemu_plugin_mem_buffer *mem_buffer;
+static GMutex lock;
 static bool do_haddr;
 static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
 
@@ -33,6 +36,14 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     if (do_callback) {
         g_string_append_printf(out, "callback mem accesses: %" PRIu64 "\n", cb_mem_count);
     }
+    if (do_buffered) {
+        for (int i = 0; i < qemu_plugin_num_vcpus(); i++) {
+            qemu_plugin_mem_buffer_flush(mem_buffer, i);
+        }
+        g_string_append_printf(out, "buffered mem accesses: %" PRIu64 "\n",
+                               buffered_mem_count);
+        qemu_plugin_mem_buffer_free(mem_buffer);
+    }
     if (do_haddr) {
         g_string_append_printf(out, "io accesses: %" PRIu64 "\n", io_count);
     }
@@ -55,6 +66,15 @@ static void vcpu_mem(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
     }
 }
 
+static void vcpu_mem_buffer(unsigned int cpu_index,
+                            const struct qemu_plugin_mem_record *records,
+                            size_t n, void *udata)
+{
+    g_mutex_lock(&lock);
+    buffered_mem_count += n;
+    g_mutex_unlock(&lock);
+}
+
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 {
     size_t n = qemu_plugin_tb_n_insns(tb);
@@ -73,6 +93,9 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
                                              QEMU_PLUGIN_CB_NO_REGS,
                                              rw, NULL);
         }
+        if (do_buffered) {
+            qemu_plugin_register_vcpu_mem_buffered(insn, rw, mem_buffer);
+        }
     }
 }
 
@@ -111,12 +134,21 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
                 fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
                 return -1;
             }
+        } else if (g_strcmp0(tokens[0], "buffered") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &do_buffered)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
         } else {
             fprintf(stderr, "option parsing failed: %s\n", opt);
             return -1;
         }
     }
 
+    if (do_buffered) {
+        mem_buffer = qemu_plugin_mem_buffer_new(1024, vcpu_mem_buffer, NULL);
+    }
+
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
     return 0;
@@ -0,0 +1,108 @@
+/*
+ * Test locked read-modify-write instructions on unaligned addresses
+ *
+ * x86 allows lock-prefixed instructions at any alignment.  With several
+ * threads, QEMU performs them by a compare-and-swap of the naturally
+ * aligned block around the operand, or stops the world if the operand
+ * crosses all such blocks.  Other threads concurrently increment single
+ * bytes in the same blocks, which the widened compare-and-swap must not
+ * lose.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NR_THREADS 4
+#define NR_ITER    100000
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/*
+ * The counters are unaligned.  All but the last one fit in a naturally
+ * aligned block of 4, 8 or 16 bytes, whose first and last bytes are
+ * incremented on their own.
+ */
+static union {
+    uint8_t b[64];
+    uint64_t align[2] __attribute__((aligned(16)));
+} mem;
+
+#define CTR16   1       /* block 0..3 */
+#define CTR32   10      /* block 8..15 */
+#define CTR64   20      /* block 16..31 */
+#define CTR64X  44      /* crosses into the block at 48 */
+
+static const unsigned bytes[] = { 0, 3, 8, 15, 16, 31 };
+
+static void *thread_fn(void *arg)
+{
+    uint16_t *ctr16 = (uint16_t *)&mem.b[CTR16];
+    uint32_t *ctr32 = (uint32_t *)&mem.b[CTR32];
+    uint64_t *ctr64 = (uint64_t *)&mem.b[CTR64];
+    uint64_t *ctr64x = (uint64_t *)&mem.b[CTR64X];
+    unsigned i, j;
+
+    for (i = 0; i < NR_ITER; i++) {
+        uint16_t one16 = 1;
+        uint64_t old, new;
+
+        asm volatile("lock xaddw %0, %1"
+                     : "+r"(one16), "+m"(*ctr16) : : "memory");
+        asm volatile("lock addl $1, %0" : "+m"(*ctr32) : : "memory");
+
+        old = *ctr64;
+        do {
+            new = old + 1;
+            asm volatile("lock cmpxchgq %2, %1"
+                         : "+a"(old), "+m"(*ctr64)
+                         : "r"(new) : "memory");
+        } while (old + 1 != new);
+
+        asm volatile("lock incq %0" : "+m"(*ctr64x) : : "memory");
+
+        for (j = 0; j < ARRAY_SIZE(bytes); j++) {
+            asm volatile("lock incb %0" : "+m"(mem.b[bytes[j]]) : : "memory");
+        }
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[NR_THREADS];
+    uint16_t ctr16;
+    uint32_t ctr32;
+    uint64_t ctr64, ctr64x;
+    unsigned i;
+    int ret;
+
+    for (i = 0; i < NR_THREADS; i++) {
+        ret = pthread_create(&threads[i], NULL, thread_fn, NULL);
+        assert(ret == 0);
+    }
+    for (i = 0; i < NR_THREADS; i++) {
+        ret = pthread_join(threads[i], NULL);
+        assert(ret == 0);
+    }
+
+    memcpy(&ctr16, &mem.b[CTR16], sizeof(ctr16));
+    memcpy(&ctr32, &mem.b[CTR32], sizeof(ctr32));
+    memcpy(&ctr64, &mem.b[CTR64], sizeof(ctr64));
+    memcpy(&ctr64x, &mem.b[CTR64X], sizeof(ctr64x));
+
+    assert(ctr16 == (uint16_t)(NR_THREADS * NR_ITER));
+    assert(ctr32 == NR_THREADS * NR_ITER);
+    assert(ctr64 == NR_THREADS * NR_ITER);
+    assert(ctr64x == NR_THREADS * NR_ITER);
+    for (i = 0; i < ARRAY_SIZE(bytes); i++) {
+        assert(mem.b[bytes[i]] == (uint8_t)(NR_THREADS * NR_ITER));
+    }
+
+    printf("PASS\n");
+    return 0;
+}
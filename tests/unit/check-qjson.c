@@ -126,6 +126,32 @@ static void string_with_quotes(void)
     }
 }
 
+static void long_string(void)
+{
+    GString *json = g_string_new("'");
+    GString *expected = g_string_new(NULL);
+    QString *str;
+    int i;
+
+    /* Long runs of plain characters broken up by escapes and UTF-8 */
+    for (i = 0; i < 4096; i++) {
+        g_string_append(json, "QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVo=+/\"");
+        g_string_append(expected, "QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVo=+/\"");
+        if (i % 7 == 0) {
+            g_string_append(json, "\\n\\u00A2\xe2\x82\xac\\'");
+            g_string_append(expected, "\n\xc2\xa2\xe2\x82\xac'");
+        }
+    }
+    g_string_append_c(json, '\'');
+
+    str = qobject_to(QString, qobject_from_json(json->str, &error_abort));
+    g_assert_cmpstr(qstring_get_str(str), ==, expected->str);
+
+    qobject_unref(str);
+    g_string_free(json, true);
+    g_string_free(expected, true);
+}
+
 static void utf8_string(void)
 {
     /*
@@ -1270,6 +1296,23 @@ static void simple_whitespace(void)
     }
 }
 
+static void append_to_buffer(void)
+{
+    GString *buf = g_string_new("prefix ");
+    QObject *obj;
+
+    obj = qobject_from_json("{ 'a': [ 1, 'two', null ] }", &error_abort);
+    qobject_to_json_append(buf, obj, false);
+    g_string_append_c(buf, ' ');
+    qobject_to_json_append(buf, obj, false);
+    g_assert_cmpstr(buf->str, ==,
+                    "prefix {\"a\": [1, \"two\", null]}"
+                    " {\"a\": [1, \"two\", null]}");
+
+    qobject_unref(obj);
+    g_string_free(buf, true);
+}
+
 static void simple_interpolation(void)
 {
     QObject *embedded_obj;
@@ -1478,6 +1521,7 @@ int main(int argc, char **argv)
     g_test_add_func("/literals/string/escaped", escaped_string);
     g_test_add_func("/literals/string/quotes", string_with_quotes);
     g_test_add_func("/literals/string/utf8", utf8_string);
+    g_test_add_func("/literals/string/long", long_string);
 
     g_test_add_func("/literals/number/int", int_number);
     g_test_add_func("/literals/number/uint", uint_number);
@@ -1495,6 +1539,7 @@ int main(int argc, char **argv)
 
     g_test_add_func("/mixed/simple_whitespace", simple_whitespace);
     g_test_add_func("/mixed/interpolation", simple_interpolation);
+    g_test_add_func("/mixed/append", append_to_buffer);
 
     g_test_add_func("/errors/empty", empty_input);
     g_test_add_func("/errors/blank", blank_input);
@@ -326,6 +326,13 @@ static const TypeInfo dummy_backend_info = {
     .class_size = sizeof(DummyBackendClass),
 };
 
+#define TYPE_DUMMY_BACKEND_CHILD "qemu-dummy-backend-child"
+
+static const TypeInfo dummy_backend_child_info = {
+    .name          = TYPE_DUMMY_BACKEND_CHILD,
+    .parent        = TYPE_DUMMY_BACKEND,
+};
+
 static QemuOptsList qemu_object_opts = {
     .name = "object",
     .implied_opt_name = "qom-type",
@@ -594,6 +601,24 @@ static void test_dummy_class_iterator(void)
     test_dummy_prop_iterator(&iter, expected, ARRAY_SIZE(expected));
 }
 
+static void test_class_property_find(void)
+{
+    ObjectClass *parent = object_class_by_name(TYPE_DUMMY_BACKEND);
+    ObjectClass *klass = object_class_by_name(TYPE_DUMMY_BACKEND_CHILD);
+    ObjectProperty *prop;
+
+    /* Inherited from TYPE_OBJECT */
+    prop = object_class_property_find(klass, "type");
+    g_assert(prop);
+    g_assert(prop == object_class_property_find(parent, "type"));
+    g_assert(!object_class_property_find(klass, "late"));
+
+    /* Properties added to a parent later must be visible in subclasses */
+    prop = object_class_property_add_bool(parent, "late", NULL, NULL);
+    g_assert(object_class_property_find(parent, "late") == prop);
+    g_assert(object_class_property_find(klass, "late") == prop);
+}
+
 static void test_dummy_delchild(void)
 {
     Object *parent = object_get_objects_root();
@@ -657,6 +682,7 @@ int main(int argc, char **argv)
     type_register_static(&dummy_dev_info);
     type_register_static(&dummy_bus_info);
     type_register_static(&dummy_backend_info);
+    type_register_static(&dummy_backend_child_info);
 
     g_test_add_func("/qom/proplist/createlist", test_dummy_createlist);
     g_test_add_func("/qom/proplist/createv", test_dummy_createv);
@@ -665,6 +691,7 @@ int main(int argc, char **argv)
     g_test_add_func("/qom/proplist/getenum", test_dummy_getenum);
     g_test_add_func("/qom/proplist/iterator", test_dummy_iterator);
     g_test_add_func("/qom/proplist/class_iterator", test_dummy_class_iterator);
+    g_test_add_func("/qom/proplist/class_find", test_class_property_find);
     g_test_add_func("/qom/proplist/delchild", test_dummy_delchild);
     g_test_add_func("/qom/resolve/partial", test_qom_partial_path);
 
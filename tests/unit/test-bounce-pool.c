@@ -0,0 +1,87 @@
+/*
+ * Bounce buffer pool unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/bounce-pool.h"
+
+static void test_reuse(void)
+{
+    BouncePool *pool = bounce_pool_new();
+    uint64_t hits, misses;
+    void *a, *b;
+
+    /* The first use of a class prefills it */
+    a = bounce_pool_try_get(pool, 512, 3000);
+    g_assert_nonnull(a);
+    g_assert_cmpuint((uintptr_t)a % qemu_real_host_page_size(), ==, 0);
+    memset(a, 0xaa, 4096);
+    bounce_pool_put(pool, a, 3000);
+
+    /* Same size class, so the buffer comes back */
+    b = bounce_pool_try_get(pool, 4096, 4096);
+    g_assert(b == a);
+    bounce_pool_put(pool, b, 4096);
+
+    bounce_pool_get_stats(pool, &hits, &misses);
+    g_assert_cmpuint(hits, ==, 2);
+    g_assert_cmpuint(misses, ==, 0);
+
+    bounce_pool_free(pool);
+}
+
+static void test_bypass(void)
+{
+    BouncePool *pool = bounce_pool_new();
+    uint64_t hits, misses;
+    void *buf;
+
+    buf = bounce_pool_try_get(pool, 512, BOUNCE_POOL_MAX_SIZE + 1);
+    g_assert_nonnull(buf);
+    bounce_pool_put(pool, buf, BOUNCE_POOL_MAX_SIZE + 1);
+
+    /* Without a pool, buffers are allocated and freed directly */
+    buf = bounce_pool_try_get(NULL, 512, 8192);
+    g_assert_nonnull(buf);
+    bounce_pool_put(NULL, buf, 8192);
+
+    bounce_pool_get_stats(pool, &hits, &misses);
+    g_assert_cmpuint(hits, ==, 0);
+    g_assert_cmpuint(misses, ==, 1);
+
+    bounce_pool_free(pool);
+}
+
+static void test_drain_class(void)
+{
+    BouncePool *pool = bounce_pool_new();
+    void *bufs[64];
+    uint64_t hits, misses;
+
+    /* More buffers than the prefill must still be handed out */
+    for (size_t i = 0; i < ARRAY_SIZE(bufs); i++) {
+        bufs[i] = bounce_pool_try_get(pool, 512, 64 * KiB);
+        g_assert_nonnull(bufs[i]);
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(bufs); i++) {
+        bounce_pool_put(pool, bufs[i], 64 * KiB);
+    }
+
+    bounce_pool_get_stats(pool, &hits, &misses);
+    g_assert_cmpuint(hits + misses, ==, ARRAY_SIZE(bufs));
+    g_assert_cmpuint(misses, >, 0);
+
+    bounce_pool_free(pool);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/bounce-pool/reuse", test_reuse);
+    g_test_add_func("/bounce-pool/bypass", test_bypass);
+    g_test_add_func("/bounce-pool/drain-class", test_drain_class);
+    return g_test_run();
+}
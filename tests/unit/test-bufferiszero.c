@@ -58,6 +58,33 @@ static void test_1(void)
     }
 }
 
+static void test_span(void)
+{
+    const size_t unit = 4096, n = 16;
+    size_t i;
+
+    memset(buffer, 0, unit * n);
+    g_assert_cmpuint(buffer_is_zero_span(buffer, unit, n, true), ==, n);
+    g_assert_cmpuint(buffer_is_zero_span(buffer, unit, n, false), ==, 0);
+    g_assert_cmpuint(buffer_is_zero_span(buffer, unit, 0, true), ==, 0);
+
+    /* A marker anywhere in block i stops a zero span at i.  */
+    for (i = 0; i < n; i++) {
+        buffer[i * unit + (i * 97) % unit] = 1;
+        g_assert_cmpuint(buffer_is_zero_span(buffer, unit, n, true), ==, i);
+        buffer[i * unit + (i * 97) % unit] = 0;
+    }
+
+    /* Non-zero spans stop at the first all-zero block.  */
+    for (i = 0; i < n / 2; i++) {
+        buffer[i * unit + unit - 1] = 1;
+    }
+    g_assert_cmpuint(buffer_is_zero_span(buffer, unit, n, false), ==, n / 2);
+    g_assert_cmpuint(buffer_is_zero_span(buffer + unit * (n / 2), unit,
+                                         n / 2, true), ==, n / 2);
+    memset(buffer, 0, unit * n);
+}
+
 static void test_2(void)
 {
     if (g_test_perf()) {
@@ -65,6 +92,7 @@ static void test_2(void)
     } else {
         do {
             test_1();
+            test_span();
         } while (test_buffer_is_zero_next_accel());
     }
 }
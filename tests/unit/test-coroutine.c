@@ -449,6 +449,35 @@ static void test_lifecycle(void)
     g_assert(done); /* expect done to be true (second time) */
 }
 
+#if !defined(_WIN32) && !defined(CONFIG_DEBUG_STACK_USAGE)
+/* Check that stacks are reused and that freeing them drops their contents */
+static void test_stack_reuse(void)
+{
+    size_t sz = COROUTINE_STACK_SIZE;
+    size_t sz2 = COROUTINE_STACK_SIZE;
+    unsigned int arenas, in_use, in_use2;
+    char *stack, *stack2;
+
+    stack = qemu_coroutine_alloc_stack(&sz);
+    g_assert_cmpuint(sz, >, COROUTINE_STACK_SIZE);
+    qemu_coroutine_get_stack_stats(&arenas, &in_use);
+    g_assert_cmpuint(arenas, >=, 1);
+    g_assert_cmpuint(in_use, >=, 1);
+
+    stack[sz / 2] = 42;
+    qemu_coroutine_free_stack(stack, sz);
+    qemu_coroutine_get_stack_stats(&arenas, &in_use2);
+    g_assert_cmpuint(in_use2, ==, in_use - 1);
+
+    stack2 = qemu_coroutine_alloc_stack(&sz2);
+    g_assert(stack2 == stack);
+    g_assert_cmpuint(sz2, ==, sz);
+#ifdef CONFIG_LINUX
+    g_assert_cmpint(stack2[sz2 / 2], ==, 0); /* MADV_DONTNEED zeroes it */
+#endif
+    qemu_coroutine_free_stack(stack2, sz2);
+}
+#endif
 
 #define RECORD_SIZE 10 /* Leave some room for expansion */
 struct coroutine_position {
@@ -650,6 +679,9 @@ int main(int argc, char **argv)
     }
 
     g_test_add_func("/basic/lifecycle", test_lifecycle);
+#if !defined(_WIN32) && !defined(CONFIG_DEBUG_STACK_USAGE)
+    g_test_add_func("/basic/stack-reuse", test_stack_reuse);
+#endif
     g_test_add_func("/basic/yield", test_yield);
     g_test_add_func("/basic/nesting", test_nesting);
     g_test_add_func("/basic/self", test_self);
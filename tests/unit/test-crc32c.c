@@ -0,0 +1,67 @@
+/*
+ * QEMU crc32c test
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+
+static uint8_t buffer[4096 + 64];
+
+/* Bit at a time, for reference */
+static uint32_t crc32c_bitwise(const uint8_t *data, size_t length)
+{
+    uint32_t crc = 0xffffffff;
+
+    while (length--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+        }
+    }
+    return crc ^ 0xffffffff;
+}
+
+static void test_1(void)
+{
+    const uint8_t check[] = "123456789";
+    struct iovec iov[3];
+    size_t len, a;
+
+    g_assert_cmphex(crc32c(0xffffffff, check, 9), ==, 0xe3069283);
+
+    for (a = 0; a < 16; a++) {
+        for (len = 0; len < 300; len++) {
+            g_assert_cmphex(crc32c(0xffffffff, buffer + a, len), ==,
+                            crc32c_bitwise(buffer + a, len));
+        }
+    }
+    g_assert_cmphex(crc32c(0xffffffff, buffer + 3, 4096), ==,
+                    crc32c_bitwise(buffer + 3, 4096));
+
+    iov[0] = (struct iovec) { buffer + 1, 7 };
+    iov[1] = (struct iovec) { buffer + 8, 1000 };
+    iov[2] = (struct iovec) { buffer + 1008, 13 };
+    g_assert_cmphex(iov_crc32c(0xffffffff, iov, 3), ==,
+                    crc32c_bitwise(buffer + 1, 1020));
+}
+
+static void test_2(void)
+{
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = i * 31 + (i >> 8);
+    }
+
+    do {
+        test_1();
+    } while (test_crc32c_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/crc32c/accel", test_2);
+
+    return g_test_run();
+}
@@ -793,6 +793,42 @@ static void test_hbitmap_serialize_zeroes(TestHBitmapData *data,
     }
 }
 
+static void test_hbitmap_merge(TestHBitmapData *data, const void *unused)
+{
+    static const uint64_t ranges[][2] = {
+        { 0, 1 }, { L1 - 1, 2 }, { L2 + 5, L1 * 3 }, { L3 - 7, 14 },
+        { L3 * 2 + L2, 1 }, { L3 * 3 - 1, 1 },
+    };
+    HBitmap *src;
+    size_t i;
+
+    hbitmap_test_init(data, L3 * 3, 0);
+    hbitmap_test_set(data, L1 * 2, L1);
+    hbitmap_test_set(data, L3 - 3, 2);
+
+    src = hbitmap_alloc(L3 * 3, 0);
+    for (i = 0; i < ARRAY_SIZE(ranges); i++) {
+        uint64_t first = ranges[i][0], count = ranges[i][1];
+
+        hbitmap_set(src, first, count);
+        while (count-- != 0) {
+            data->bits[first >> LOG_BITS_PER_LONG] |=
+                1UL << (first & (BITS_PER_LONG - 1));
+            first++;
+        }
+    }
+
+    hbitmap_merge(data->hb, src, data->hb);
+    hbitmap_test_check(data, 0);
+    hbitmap_test_check_get(data);
+
+    /* Merging again must not change the count.  */
+    hbitmap_merge(src, data->hb, data->hb);
+    hbitmap_test_check(data, 0);
+
+    hbitmap_free(src);
+}
+
 static void hbitmap_test_add(const char *testpath,
                                    void (*test_func)(TestHBitmapData *data, const void *user_data))
 {
@@ -1094,6 +1130,8 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/serialize/zeroes",
                      test_hbitmap_serialize_zeroes);
 
+    hbitmap_test_add("/hbitmap/merge/in_place", test_hbitmap_merge);
+
     hbitmap_test_add("/hbitmap/iter/iter_and_reset",
                      test_hbitmap_iter_and_reset);
 
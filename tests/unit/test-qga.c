@@ -5,6 +5,7 @@
 #include <sys/un.h>
 
 #include "../qtest/libqtest.h"
+#include "qemu/bswap.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qlist.h"
 
@@ -616,6 +617,143 @@ static void test_qga_file_write_read(gconstpointer fix)
     qobject_unref(ret);
 }
 
+/* Message header of the stream channel, see docs/interop/qemu-ga.rst */
+typedef struct QEMU_PACKED {
+    uint32_t magic;
+    uint32_t op;
+    int64_t handle;
+    uint64_t length;
+    int32_t error;
+    uint32_t reserved;
+} StreamHeader;
+
+#define STREAM_MAGIC        0x53414751
+#define STREAM_OP_WRITE     1
+#define STREAM_OP_READ      2
+#define STREAM_OP_DATA      3
+#define STREAM_OP_STATUS    4
+
+static void stream_recv(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len) {
+        ssize_t n = read(fd, p, len);
+
+        g_assert_cmpint(n, >, 0);
+        p += n;
+        len -= n;
+    }
+}
+
+static void stream_send_request(int fd, uint32_t op, int64_t handle,
+                                uint64_t length)
+{
+    StreamHeader hdr = {
+        .magic = cpu_to_le32(STREAM_MAGIC),
+        .op = cpu_to_le32(op),
+        .handle = cpu_to_le64(handle),
+        .length = cpu_to_le64(length),
+    };
+
+    g_assert_cmpint(qemu_write_full(fd, &hdr, sizeof(hdr)), ==, sizeof(hdr));
+}
+
+static void stream_recv_header(int fd, StreamHeader *hdr, int64_t handle)
+{
+    stream_recv(fd, hdr, sizeof(*hdr));
+    g_assert_cmphex(le32_to_cpu(hdr->magic), ==, STREAM_MAGIC);
+    g_assert_cmpint(le64_to_cpu(hdr->handle), ==, handle);
+    hdr->op = le32_to_cpu(hdr->op);
+    hdr->length = le64_to_cpu(hdr->length);
+    hdr->error = le32_to_cpu(hdr->error);
+}
+
+static void test_qga_stream(gconstpointer data)
+{
+    /* More than the 1 MiB buffer of qemu-ga, and not a multiple of it */
+    const size_t size = 3 * 1024 * 1024 + 123;
+    g_autofree guint8 *wbuf = g_malloc(size);
+    g_autofree guint8 *rbuf = g_malloc(size);
+    g_autofree char *path = NULL;
+    TestFixture fix;
+    StreamHeader hdr;
+    QDict *ret;
+    int64_t id;
+    size_t got;
+    int sfd;
+
+    fixture_setup(&fix, "--stream-method unix-listen --stream-path stream",
+                  NULL);
+    path = g_build_filename(fix.test_dir, "stream", NULL);
+    sfd = connect_qga(path);
+    g_assert_cmpint(sfd, !=, -1);
+
+    for (got = 0; got < size; got++) {
+        wbuf[got] = got * 7;
+    }
+
+    ret = qmp_fd(fix.fd, "{'execute': 'guest-file-open',"
+                 " 'arguments': { 'path': 'foo', 'mode': 'w+' } }");
+    qmp_assert_no_error(ret);
+    id = qdict_get_int(ret, "return");
+    qobject_unref(ret);
+
+    /* write */
+    stream_send_request(sfd, STREAM_OP_WRITE, id, size);
+    g_assert_cmpint(qemu_write_full(sfd, wbuf, size), ==, size);
+    stream_recv_header(sfd, &hdr, id);
+    g_assert_cmpint(hdr.op, ==, STREAM_OP_STATUS);
+    g_assert_cmpint(hdr.error, ==, 0);
+    g_assert_cmpint(hdr.length, ==, size);
+
+    ret = qmp_fd(fix.fd, "{'execute': 'guest-file-seek',"
+                 " 'arguments': { 'handle': %" PRId64 ", "
+                 " 'offset': 0, 'whence': 'set' } }", id);
+    qmp_assert_no_error(ret);
+    qobject_unref(ret);
+
+    /* read past the end of the file */
+    stream_send_request(sfd, STREAM_OP_READ, id, size + 4096);
+    got = 0;
+    for (;;) {
+        stream_recv_header(sfd, &hdr, id);
+        if (hdr.op == STREAM_OP_STATUS) {
+            break;
+        }
+        g_assert_cmpint(hdr.op, ==, STREAM_OP_DATA);
+        g_assert_cmpint(hdr.length, <=, size - got);
+        stream_recv(sfd, rbuf + got, hdr.length);
+        got += hdr.length;
+    }
+    g_assert_cmpint(hdr.error, ==, 0);
+    g_assert_cmpint(hdr.length, ==, size);
+    g_assert_cmpint(got, ==, size);
+    g_assert(memcmp(wbuf, rbuf, size) == 0);
+
+    ret = qmp_fd(fix.fd, "{'execute': 'guest-file-close',"
+                 " 'arguments': {'handle': %" PRId64 "} }", id);
+    qmp_assert_no_error(ret);
+    qobject_unref(ret);
+
+    /* the data of a failed write is still consumed */
+    stream_send_request(sfd, STREAM_OP_WRITE, id, 4096);
+    g_assert_cmpint(qemu_write_full(sfd, wbuf, 4096), ==, 4096);
+    stream_recv_header(sfd, &hdr, id);
+    g_assert_cmpint(hdr.op, ==, STREAM_OP_STATUS);
+    g_assert_cmpint(hdr.error, ==, EBADF);
+    g_assert_cmpint(hdr.length, ==, 0);
+
+    stream_send_request(sfd, STREAM_OP_READ, id, 4096);
+    stream_recv_header(sfd, &hdr, id);
+    g_assert_cmpint(hdr.op, ==, STREAM_OP_STATUS);
+    g_assert_cmpint(hdr.error, ==, EBADF);
+
+    close(sfd);
+    g_unlink(path);
+    fixture_tear_down(&fix, NULL);
+}
+
 static void test_qga_get_time(gconstpointer fix)
 {
     const TestFixture *fixture = fix;
@@ -1122,6 +1260,7 @@ int main(int argc, char **argv)
     g_test_add_data_func("/qga/blockedrpcs", NULL, test_qga_blockedrpcs);
     g_test_add_data_func("/qga/allowedrpcs", NULL, test_qga_allowedrpcs);
     g_test_add_data_func("/qga/config", NULL, test_qga_config);
+    g_test_add_data_func("/qga/stream", NULL, test_qga_stream);
     g_test_add_data_func("/qga/guest-exec", &fix, test_qga_guest_exec);
     g_test_add_data_func("/qga/guest-exec-separated", &fix,
                          test_qga_guest_exec_separated);
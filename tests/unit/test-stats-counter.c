@@ -0,0 +1,79 @@
+/*
+ * Stats counter tests
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/stats-counter.h"
+
+STATS_COUNTER_DEFINE(test_events, "test-events");
+STATS_COUNTER_DEFINE(test_bytes, "test-bytes");
+
+#define NR_THREADS 4
+#define NR_EVENTS 10000
+
+typedef struct {
+    const char *name;
+    uint64_t value;
+    bool found;
+} CounterValue;
+
+static void find_counter(const char *name, uint64_t value, void *opaque)
+{
+    CounterValue *cv = opaque;
+
+    if (g_str_equal(name, cv->name)) {
+        g_assert_false(cv->found);
+        cv->value = value;
+        cv->found = true;
+    }
+}
+
+static uint64_t counter_value(const char *name)
+{
+    CounterValue cv = { .name = name };
+
+    stats_counter_foreach(find_counter, &cv);
+    g_assert_true(cv.found);
+    return cv.value;
+}
+
+static void *count_events(void *opaque)
+{
+    for (int i = 0; i < NR_EVENTS; i++) {
+        stats_counter_inc(&test_events);
+        stats_counter_add(&test_bytes, 512);
+    }
+    return NULL;
+}
+
+static void test_stats_counter_threads(void)
+{
+    QemuThread threads[NR_THREADS];
+    uint64_t events = counter_value("test-events");
+    uint64_t bytes = counter_value("test-bytes");
+
+    for (int i = 0; i < NR_THREADS; i++) {
+        qemu_thread_create(&threads[i], "count-events", count_events, NULL,
+                           QEMU_THREAD_JOINABLE);
+    }
+    count_events(NULL);
+    for (int i = 0; i < NR_THREADS; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+
+    /* Counts of exited threads are kept */
+    g_assert_cmpuint(counter_value("test-events"), ==,
+                     events + (NR_THREADS + 1) * NR_EVENTS);
+    g_assert_cmpuint(counter_value("test-bytes"), ==,
+                     bytes + (NR_THREADS + 1) * NR_EVENTS * 512);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/stats-counter/threads", test_stats_counter_threads);
+    return g_test_run();
+}
@@ -734,6 +734,33 @@ static void test_accounting(void)
                                 (64.0 / 13)));
 }
 
+static void test_reserve(void)
+{
+    double units, size;
+
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_OPS_TOTAL].avg = 1000;
+    throttle_init(&ts);
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+
+    /* 10 ms worth of operations, bytes are not limited */
+    throttle_budget_for(&ts, THROTTLE_READ, 10 * SCALE_MS, &units, &size);
+    g_assert(double_cmp(units, 10));
+    g_assert(isinf(size));
+
+    g_assert(throttle_reserve(&ts, THROTTLE_READ, ts.previous_leak,
+                              units, size));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 10));
+
+    throttle_unreserve(&ts, THROTTLE_READ, 4, size);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 6));
+
+    /* More than the bucket holds is refused and not accounted */
+    g_assert(!throttle_reserve(&ts, THROTTLE_WRITE, ts.previous_leak,
+                               200, size));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 6));
+}
+
 static void test_groups(void)
 {
     ThrottleConfig cfg1, cfg2;
@@ -829,6 +856,7 @@ int main(int argc, char **argv)
                     test_iops_size_is_missing_limit);
     g_test_add_func("/throttle/config_functions",   test_config_functions);
     g_test_add_func("/throttle/accounting",         test_accounting);
+    g_test_add_func("/throttle/reserve",            test_reserve);
     g_test_add_func("/throttle/groups",             test_groups);
     return g_test_run();
 }
@@ -284,12 +284,18 @@ static void test_simple_primitive(void)
 
 typedef struct TestSimpleArray {
     uint16_t u16_1[3];
+    uint8_t u8_1[4];
+    int32_t i32_1[2];
+    uint64_t u64_1[2];
 } TestSimpleArray;
 
 /* Object instantiation, we are going to use it in more than one test */
 
 TestSimpleArray obj_simple_arr = {
     .u16_1 = { 0x42, 0x43, 0x44 },
+    .u8_1 = { 0x01, 0x02, 0x03, 0x04 },
+    .i32_1 = { -2, 0x12345678 },
+    .u64_1 = { 0x0102030405060708ULL, 0xffULL },
 };
 
 /* Description of the values.  If you add a primitive type
@@ -301,6 +307,9 @@ static const VMStateDescription vmstate_simple_arr = {
     .minimum_version_id = 1,
     .fields = (const VMStateField[]) {
         VMSTATE_UINT16_ARRAY(u16_1, TestSimpleArray, 3),
+        VMSTATE_UINT8_ARRAY(u8_1, TestSimpleArray, 4),
+        VMSTATE_INT32_ARRAY(i32_1, TestSimpleArray, 2),
+        VMSTATE_UINT64_ARRAY(u64_1, TestSimpleArray, 2),
         VMSTATE_END_OF_LIST()
     }
 };
@@ -309,6 +318,11 @@ uint8_t wire_simple_arr[] = {
     /* u16_1 */ 0x00, 0x42,
     /* u16_1 */ 0x00, 0x43,
     /* u16_1 */ 0x00, 0x44,
+    /* u8_1 */  0x01, 0x02, 0x03, 0x04,
+    /* i32_1 */ 0xff, 0xff, 0xff, 0xfe,
+    /* i32_1 */ 0x12, 0x34, 0x56, 0x78,
+    /* u64_1 */ 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    /* u64_1 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
     QEMU_VM_EOF, /* just to ensure we won't get EOF reported prematurely */
 };
 
@@ -329,6 +343,7 @@ static void test_simple_array(void)
     SUCCESS(load_vmstate(&vmstate_simple_arr, &obj, &obj_clone,
                          obj_simple_arr_copy, 1, wire_simple_arr,
                          sizeof(wire_simple_arr)));
+    g_assert_cmpmem(&obj, sizeof(obj), &obj_simple_arr, sizeof(obj));
 }
 
 typedef struct TestStruct {
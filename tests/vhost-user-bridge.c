@@ -339,7 +339,7 @@ vubr_backend_recv_cb(int sock, void *ctx)
 
         if (ret == -1) {
             if (errno == EWOULDBLOCK) {
-                vu_queue_rewind(dev, vq, 1);
+                vu_queue_unpop(dev, vq, elem, 0);
                 break;
             }
 
@@ -16,7 +16,9 @@
 #include "trace/control.h"
 #include "trace/simple.h"
 #include "qemu/error-report.h"
+#include "qemu/notify.h"
 #include "qemu/qemu-print.h"
+#include "qemu/thread.h"
 
 /** Trace file header event ID, picked to avoid conflict with real event IDs */
 #define HEADER_EVENT_ID (~(uint64_t)0)
@@ -25,7 +27,7 @@
 #define HEADER_MAGIC 0xf2b177cb0aa429b4ULL
 
 /** Trace file version number, bump if format changes */
-#define HEADER_VERSION 4
+#define HEADER_VERSION 5
 
 /** Records were dropped event ID */
 #define DROPPED_EVENT_ID (~(uint64_t)0 - 1)
@@ -45,14 +47,32 @@ static bool trace_available;
 static bool trace_writeout_enabled;
 
 enum {
-    TRACE_BUF_LEN = 4096 * 64,
+    TRACE_BUF_LEN = 4096 * 16,
     TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
 };
 
-uint8_t trace_buf[TRACE_BUF_LEN];
-static volatile gint trace_idx;
-static unsigned int writeout_idx;
-static volatile gint dropped_events;
+/*
+ * Each thread that emits trace events owns a ring buffer, so that threads
+ * only contend on their own reservation index.  The index is still updated
+ * with compare-and-exchange because a signal handler may trace in the middle
+ * of another record.
+ *
+ * Buffers are never freed.  When a thread exits its buffer is left for the
+ * writeout thread to drain, and may then be taken over by a new thread.
+ */
+struct TraceThreadBuffer {
+    TraceThreadBuffer *next;    /* in all_buffers */
+    gint in_use;                /* owned by a thread */
+    uint32_t tid;
+    volatile gint trace_idx;
+    volatile gint writeout_idx;
+    volatile gint dropped_events;
+    uint8_t buf[TRACE_BUF_LEN];
+};
+
+static TraceThreadBuffer *all_buffers;
+static __thread TraceThreadBuffer *thread_buffer;
+static __thread Notifier thread_buffer_exit_notifier;
 static uint32_t trace_pid;
 static FILE *trace_fp;
 static char *trace_file_name;
@@ -66,6 +86,8 @@ typedef struct {
     uint64_t timestamp_ns;
     uint32_t length;   /*    in bytes */
     uint32_t pid;
+    uint32_t tid;
+    uint32_t reserved;
     uint64_t arguments[];
 } TraceRecord;
 
@@ -76,53 +98,72 @@ typedef struct {
 } TraceLogHeader;
 
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size);
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size);
+static void read_from_buffer(TraceThreadBuffer *tb, unsigned int idx,
+                             void *dataptr, size_t size);
+static unsigned int write_to_buffer(TraceThreadBuffer *tb, unsigned int idx,
+                                    void *dataptr, size_t size);
 
-static void clear_buffer_range(unsigned int idx, size_t len)
+static void clear_buffer_range(TraceThreadBuffer *tb, unsigned int idx,
+                               size_t len)
 {
     uint32_t num = 0;
     while (num < len) {
         if (idx >= TRACE_BUF_LEN) {
             idx = idx % TRACE_BUF_LEN;
         }
-        trace_buf[idx++] = 0;
+        tb->buf[idx++] = 0;
         num++;
     }
 }
+
 /**
- * Read a trace record from the trace buffer
+ * Peek at the next trace record of a trace buffer
  *
- * @idx         Trace buffer index
- * @record      Trace record to fill
+ * @tb              Trace buffer
+ * @timestamp_ns    Filled with the timestamp of the record
  *
- * Returns false if the record is not valid.
+ * Returns false if the record is not valid yet.
  */
-static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
+static bool peek_trace_record(TraceThreadBuffer *tb, uint64_t *timestamp_ns)
 {
-    uint64_t event_flag = 0;
+    unsigned int idx = (unsigned int)tb->writeout_idx % TRACE_BUF_LEN;
     TraceRecord record;
-    /* read the event flag to see if its a valid record */
-    read_from_buffer(idx, &record, sizeof(event_flag));
 
+    read_from_buffer(tb, idx, &record, sizeof(record.event));
     if (!(record.event & TRACE_RECORD_VALID)) {
         return false;
     }
 
     smp_rmb(); /* read memory barrier before accessing record */
+    read_from_buffer(tb, idx, &record, sizeof(TraceRecord));
+    *timestamp_ns = record.timestamp_ns;
+    return true;
+}
+
+/**
+ * Read the next trace record from a trace buffer
+ *
+ * @tb          Trace buffer, whose next record must be valid
+ * @record      Trace record to fill
+ */
+static void get_trace_record(TraceThreadBuffer *tb, TraceRecord **recordptr)
+{
+    unsigned int idx = (unsigned int)tb->writeout_idx % TRACE_BUF_LEN;
+    TraceRecord record;
+
     /* read the record header to know record length */
-    read_from_buffer(idx, &record, sizeof(TraceRecord));
+    read_from_buffer(tb, idx, &record, sizeof(TraceRecord));
     *recordptr = malloc(record.length); /* don't use g_malloc, can deadlock when traced */
     /* make a copy of record to avoid being overwritten */
-    read_from_buffer(idx, *recordptr, record.length);
+    read_from_buffer(tb, idx, *recordptr, record.length);
     smp_rmb(); /* memory barrier before clearing valid flag */
     (*recordptr)->event &= ~TRACE_RECORD_VALID;
     /* clear the trace buffer range for consumed record otherwise any byte
      * with its MSB set may be considered as a valid event id when the writer
      * thread crosses this range of buffer again.
      */
-    clear_buffer_range(idx, record.length);
-    return true;
+    clear_buffer_range(tb, idx, record.length);
+    g_atomic_int_add(&tb->writeout_idx, record.length);
 }
 
 /**
@@ -154,41 +195,73 @@ static void wait_for_trace_records_available(void)
     g_mutex_unlock(&trace_lock);
 }
 
-static gpointer writeout_thread(gpointer opaque)
+static void write_dropped_record(TraceThreadBuffer *tb)
 {
-    TraceRecord *recordptr;
     union {
         TraceRecord rec;
         uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
     } dropped;
-    unsigned int idx = 0;
     int dropped_count;
     size_t unused __attribute__ ((unused));
     uint64_t type = TRACE_RECORD_TYPE_EVENT;
 
+    if (!g_atomic_int_get(&tb->dropped_events)) {
+        return;
+    }
+
+    memset(&dropped, 0, sizeof(dropped));
+    dropped.rec.event = DROPPED_EVENT_ID;
+    dropped.rec.timestamp_ns = get_clock();
+    dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
+    dropped.rec.pid = trace_pid;
+    dropped.rec.tid = tb->tid;
+    do {
+        dropped_count = g_atomic_int_get(&tb->dropped_events);
+    } while (!g_atomic_int_compare_and_exchange(&tb->dropped_events,
+                                                dropped_count, 0));
+    dropped.rec.arguments[0] = dropped_count;
+    unused = fwrite(&type, sizeof(type), 1, trace_fp);
+    unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+}
+
+static gpointer writeout_thread(gpointer opaque)
+{
+    TraceThreadBuffer *tb, *next_tb;
+    TraceRecord *recordptr;
+    uint64_t timestamp_ns, next_timestamp_ns;
+    size_t unused __attribute__ ((unused));
+    uint64_t type = TRACE_RECORD_TYPE_EVENT;
+
     for (;;) {
         wait_for_trace_records_available();
 
-        if (g_atomic_int_get(&dropped_events)) {
-            dropped.rec.event = DROPPED_EVENT_ID;
-            dropped.rec.timestamp_ns = get_clock();
-            dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
-            dropped.rec.pid = trace_pid;
-            do {
-                dropped_count = g_atomic_int_get(&dropped_events);
-            } while (!g_atomic_int_compare_and_exchange(&dropped_events,
-                                                        dropped_count, 0));
-            dropped.rec.arguments[0] = dropped_count;
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+        for (tb = g_atomic_pointer_get(&all_buffers); tb; tb = tb->next) {
+            write_dropped_record(tb);
         }
 
-        while (get_trace_record(idx, &recordptr)) {
+        /*
+         * Merge the thread buffers by timestamp.  A record that is still
+         * being filled in holds back the rest of its buffer, so records of
+         * other threads may be written ahead of it.
+         */
+        for (;;) {
+            next_tb = NULL;
+            next_timestamp_ns = UINT64_MAX;
+            for (tb = g_atomic_pointer_get(&all_buffers); tb; tb = tb->next) {
+                if (peek_trace_record(tb, &timestamp_ns) &&
+                    (!next_tb || timestamp_ns < next_timestamp_ns)) {
+                    next_tb = tb;
+                    next_timestamp_ns = timestamp_ns;
+                }
+            }
+            if (!next_tb) {
+                break;
+            }
+
+            get_trace_record(next_tb, &recordptr);
             unused = fwrite(&type, sizeof(type), 1, trace_fp);
             unused = fwrite(recordptr, recordptr->length, 1, trace_fp);
-            writeout_idx += recordptr->length;
             free(recordptr); /* don't use g_free, can deadlock when traced */
-            idx = writeout_idx % TRACE_BUF_LEN;
         }
 
         fflush(trace_fp);
@@ -196,52 +269,107 @@ static gpointer writeout_thread(gpointer opaque)
     return NULL;
 }
 
+static void trace_thread_buffer_release(Notifier *n, void *unused)
+{
+    g_atomic_int_set(&thread_buffer->in_use, 0);
+    thread_buffer = NULL;
+}
+
+/* Return the trace buffer of the current thread, or NULL if out of memory */
+static TraceThreadBuffer *trace_thread_buffer(void)
+{
+    TraceThreadBuffer *tb = thread_buffer;
+
+    if (likely(tb)) {
+        return tb;
+    }
+
+    /* Take over the buffer of a thread that has exited, if any */
+    for (tb = g_atomic_pointer_get(&all_buffers); tb; tb = tb->next) {
+        if (g_atomic_int_compare_and_exchange(&tb->in_use, 0, 1)) {
+            break;
+        }
+    }
+
+    if (!tb) {
+        tb = calloc(1, sizeof(*tb)); /* don't use g_malloc, can deadlock when traced */
+        if (!tb) {
+            return NULL;
+        }
+        tb->in_use = 1;
+        do {
+            tb->next = g_atomic_pointer_get(&all_buffers);
+        } while (!g_atomic_pointer_compare_and_exchange(&all_buffers,
+                                                        tb->next, tb));
+    }
+
+    tb->tid = qemu_get_thread_id();
+    thread_buffer = tb;
+    thread_buffer_exit_notifier.notify = trace_thread_buffer_release;
+    qemu_thread_atexit_add(&thread_buffer_exit_notifier);
+    return tb;
+}
+
 void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
 {
-    rec->rec_off = write_to_buffer(rec->rec_off, &val, sizeof(uint64_t));
+    rec->rec_off = write_to_buffer(rec->tbuf, rec->rec_off,
+                                   &val, sizeof(uint64_t));
 }
 
 void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
 {
     /* Write string length first */
-    rec->rec_off = write_to_buffer(rec->rec_off, &slen, sizeof(slen));
+    rec->rec_off = write_to_buffer(rec->tbuf, rec->rec_off,
+                                   &slen, sizeof(slen));
     /* Write actual string now */
-    rec->rec_off = write_to_buffer(rec->rec_off, (void*)s, slen);
+    rec->rec_off = write_to_buffer(rec->tbuf, rec->rec_off, (void*)s, slen);
 }
 
 int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
 {
+    TraceThreadBuffer *tb = trace_thread_buffer();
     unsigned int idx, rec_off, old_idx, new_idx;
     uint32_t rec_len = sizeof(TraceRecord) + datasize;
     uint64_t event_u64 = event;
     uint64_t timestamp_ns = get_clock();
+    uint32_t reserved = 0;
+
+    if (!tb) {
+        return -ENOMEM;
+    }
 
     do {
-        old_idx = g_atomic_int_get(&trace_idx);
+        old_idx = g_atomic_int_get(&tb->trace_idx);
         smp_rmb();
         new_idx = old_idx + rec_len;
 
-        if (new_idx - writeout_idx > TRACE_BUF_LEN) {
+        if (new_idx - (unsigned int)g_atomic_int_get(&tb->writeout_idx)
+            > TRACE_BUF_LEN) {
             /* Trace Buffer Full, Event dropped ! */
-            g_atomic_int_inc(&dropped_events);
+            g_atomic_int_inc(&tb->dropped_events);
             return -ENOSPC;
         }
-    } while (!g_atomic_int_compare_and_exchange(&trace_idx, old_idx, new_idx));
+    } while (!g_atomic_int_compare_and_exchange(&tb->trace_idx,
+                                                old_idx, new_idx));
 
     idx = old_idx % TRACE_BUF_LEN;
 
     rec_off = idx;
-    rec_off = write_to_buffer(rec_off, &event_u64, sizeof(event_u64));
-    rec_off = write_to_buffer(rec_off, &timestamp_ns, sizeof(timestamp_ns));
-    rec_off = write_to_buffer(rec_off, &rec_len, sizeof(rec_len));
-    rec_off = write_to_buffer(rec_off, &trace_pid, sizeof(trace_pid));
-
+    rec_off = write_to_buffer(tb, rec_off, &event_u64, sizeof(event_u64));
+    rec_off = write_to_buffer(tb, rec_off, &timestamp_ns, sizeof(timestamp_ns));
+    rec_off = write_to_buffer(tb, rec_off, &rec_len, sizeof(rec_len));
+    rec_off = write_to_buffer(tb, rec_off, &trace_pid, sizeof(trace_pid));
+    rec_off = write_to_buffer(tb, rec_off, &tb->tid, sizeof(tb->tid));
+    rec_off = write_to_buffer(tb, rec_off, &reserved, sizeof(reserved));
+
+    rec->tbuf = tb;
     rec->tbuf_idx = idx;
     rec->rec_off  = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
     return 0;
 }
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
+static void read_from_buffer(TraceThreadBuffer *tb, unsigned int idx,
+                             void *dataptr, size_t size)
 {
     uint8_t *data_ptr = dataptr;
     uint32_t x = 0;
@@ -249,11 +377,12 @@ static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
         if (idx >= TRACE_BUF_LEN) {
             idx = idx % TRACE_BUF_LEN;
         }
-        data_ptr[x++] = trace_buf[idx++];
+        data_ptr[x++] = tb->buf[idx++];
     }
 }
 
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
+static unsigned int write_to_buffer(TraceThreadBuffer *tb, unsigned int idx,
+                                    void *dataptr, size_t size)
 {
     uint8_t *data_ptr = dataptr;
     uint32_t x = 0;
@@ -261,20 +390,22 @@ static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size
         if (idx >= TRACE_BUF_LEN) {
             idx = idx % TRACE_BUF_LEN;
         }
-        trace_buf[idx++] = data_ptr[x++];
+        tb->buf[idx++] = data_ptr[x++];
     }
     return idx; /* most callers wants to know where to write next */
 }
 
 void trace_record_finish(TraceBufferRecord *rec)
 {
+    TraceThreadBuffer *tb = rec->tbuf;
     TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
+    read_from_buffer(tb, rec->tbuf_idx, &record, sizeof(TraceRecord));
     smp_wmb(); /* write barrier before marking as valid */
     record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
+    write_to_buffer(tb, rec->tbuf_idx, &record, sizeof(TraceRecord));
 
-    if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
+    if (((unsigned int)g_atomic_int_get(&tb->trace_idx) -
+         (unsigned int)g_atomic_int_get(&tb->writeout_idx))
         > TRACE_BUF_FLUSH_THRESHOLD) {
         flush_trace_file(false);
     }
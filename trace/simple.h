@@ -18,7 +18,10 @@ bool st_init(void);
 void st_init_group(size_t group);
 void st_flush_trace_buffer(void);
 
+typedef struct TraceThreadBuffer TraceThreadBuffer;
+
 typedef struct {
+    TraceThreadBuffer *tbuf;
     unsigned int tbuf_idx;
     unsigned int rec_off;
 } TraceBufferRecord;
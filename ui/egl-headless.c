@@ -153,7 +153,18 @@ static void egl_scanout_flush(DisplayChangeListener *dcl,
         egl_fb_blit(&edpy->blit_fb, &edpy->guest_fb, edpy->y_0_top);
     }
 
-    egl_fb_read(edpy->ds, &edpy->blit_fb);
+    /*
+     * Only read back the damaged area, the rest of the surface is current.
+     * The cursor is blended into the frame, and moving it damages areas
+     * that the guest does not report, so then read back everything.
+     */
+    if (!edpy->cursor_fb.texture &&
+        surface_width(edpy->ds) == edpy->blit_fb.width &&
+        surface_height(edpy->ds) == edpy->blit_fb.height) {
+        egl_fb_read_rect(edpy->ds, &edpy->blit_fb, x, y, w, h);
+    } else {
+        egl_fb_read(edpy->ds, &edpy->blit_fb);
+    }
     dpy_gfx_update(edpy->dcl.con, x, y, w, h);
 }
 
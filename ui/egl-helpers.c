@@ -181,8 +181,8 @@ void egl_fb_read_rect(DisplaySurface *dst, egl_fb *src, int x, int y, int w, int
     glBindFramebuffer(GL_READ_FRAMEBUFFER, src->framebuffer);
     glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
     glPixelStorei(GL_PACK_ROW_LENGTH, surface_stride(dst) / 4);
-    glReadPixels(x, y, w, h,
-                 GL_BGRA, GL_UNSIGNED_BYTE, surface_data(dst) + x * 4);
+    glReadPixels(x, y, w, h, GL_BGRA, GL_UNSIGNED_BYTE,
+                 surface_data(dst) + y * surface_stride(dst) + x * 4);
     glPixelStorei(GL_PACK_ROW_LENGTH, 0);
 }
 
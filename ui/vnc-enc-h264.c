@@ -0,0 +1,210 @@
+/*
+ * QEMU VNC display driver: Open H.264 encoding
+ *
+ * Frames are encoded by a GStreamer pipeline, which picks a hardware
+ * encoder (VA-API, NVENC) when one is available and falls back to x264
+ * or OpenH264 otherwise.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "vnc.h"
+#include "trace.h"
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+
+/* Flags of an Open H.264 rectangle */
+#define VNC_H264_RESET_CONTEXT       1
+#define VNC_H264_RESET_ALL_CONTEXTS  2
+
+/* How long to wait for the encoder to output a frame */
+#define VNC_H264_PULL_TIMEOUT        (100 * GST_MSECOND)
+
+struct VncH264 {
+    GstElement *pipeline;
+    GstElement *source;
+    GstElement *sink;
+    int width;
+    int height;
+    bool reset;
+};
+
+/* Encoder elements in order of preference, with low-latency settings */
+static const char *const vnc_h264_encoders[] = {
+    "vah264lpenc",
+    "vah264enc",
+    "vaapih264enc",
+    "nvh264enc",
+    "x264enc tune=zerolatency speed-preset=ultrafast threads=4",
+    "openh264enc usage-type=screen complexity=low",
+};
+
+static const char *vnc_h264_encoder;
+
+static void vnc_h264_init(void)
+{
+    static gsize initialized;
+    g_autoptr(GError) err = NULL;
+
+    if (!g_once_init_enter(&initialized)) {
+        return;
+    }
+
+    if (!gst_init_check(NULL, NULL, &err)) {
+        warn_report("VNC: cannot initialize GStreamer: %s", err->message);
+    } else {
+        for (int i = 0; i < ARRAY_SIZE(vnc_h264_encoders); i++) {
+            g_autofree char *name =
+                g_strndup(vnc_h264_encoders[i],
+                          strcspn(vnc_h264_encoders[i], " "));
+            GstElementFactory *factory = gst_element_factory_find(name);
+
+            if (factory) {
+                gst_object_unref(factory);
+                vnc_h264_encoder = vnc_h264_encoders[i];
+                break;
+            }
+        }
+    }
+    trace_vnc_h264_init(vnc_h264_encoder ?: "none");
+    g_once_init_leave(&initialized, 1);
+}
+
+bool vnc_h264_available(void)
+{
+    vnc_h264_init();
+    return vnc_h264_encoder != NULL;
+}
+
+static void vnc_h264_pipeline_free(VncH264 *h264)
+{
+    if (h264->pipeline) {
+        gst_element_set_state(h264->pipeline, GST_STATE_NULL);
+        gst_object_unref(h264->source);
+        gst_object_unref(h264->sink);
+        gst_object_unref(h264->pipeline);
+        h264->pipeline = NULL;
+    }
+}
+
+static bool vnc_h264_pipeline_new(VncH264 *h264, int width, int height)
+{
+    g_autoptr(GError) err = NULL;
+    g_autofree char *desc = NULL;
+
+    desc = g_strdup_printf(
+        "appsrc name=source is-live=true format=time do-timestamp=true "
+        "caps=video/x-raw,format=%s,width=%d,height=%d,framerate=0/1 ! "
+        "videoconvert ! %s ! "
+        "video/x-h264,stream-format=byte-stream,alignment=au ! "
+        "appsink name=sink sync=false max-buffers=1",
+        HOST_BIG_ENDIAN ? "xRGB" : "BGRx", width, height, vnc_h264_encoder);
+
+    h264->pipeline = gst_parse_launch(desc, &err);
+    if (!h264->pipeline) {
+        error_report("VNC: cannot create H.264 pipeline: %s", err->message);
+        return false;
+    }
+    h264->source = gst_bin_get_by_name(GST_BIN(h264->pipeline), "source");
+    h264->sink = gst_bin_get_by_name(GST_BIN(h264->pipeline), "sink");
+    if (gst_element_set_state(h264->pipeline, GST_STATE_PLAYING) ==
+        GST_STATE_CHANGE_FAILURE) {
+        error_report("VNC: cannot start H.264 pipeline");
+        vnc_h264_pipeline_free(h264);
+        return false;
+    }
+
+    h264->width = width;
+    h264->height = height;
+    h264->reset = true;
+    trace_vnc_h264_pipeline_new(h264, width, height);
+    return true;
+}
+
+/*
+ * Encode the whole visible screen as one frame.  A new pipeline, and so
+ * an IDR frame, is started on size changes and on non-incremental update
+ * requests, which is when clients expect to be able to sync.
+ */
+int vnc_h264_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
+{
+    VncH264 *h264;
+    pixman_image_t *server = vs->vd->server;
+    int stride = pixman_image_get_stride(server);
+    uint8_t *src = (uint8_t *)pixman_image_get_data(server);
+    GstBuffer *buf;
+    GstSample *sample;
+    GstMapInfo map;
+
+    /*
+     * The rectangle is always the whole screen, see vnc_update_client().
+     * The 4:2:0 encoders need even dimensions.
+     */
+    assert(x == 0 && y == 0);
+    w &= ~1;
+    h &= ~1;
+    if (!w || !h) {
+        return 0;
+    }
+
+    if (!vs->h264) {
+        vs->h264 = g_new0(VncH264, 1);
+    }
+    h264 = vs->h264;
+
+    if (h264->pipeline && (h264->width != w || h264->height != h ||
+                           vs->job_update == VNC_STATE_UPDATE_FORCE)) {
+        vnc_h264_pipeline_free(h264);
+    }
+    if (!h264->pipeline && !vnc_h264_pipeline_new(h264, w, h)) {
+        return 0;
+    }
+
+    buf = gst_buffer_new_allocate(NULL, w * h * VNC_SERVER_FB_BYTES, NULL);
+    gst_buffer_map(buf, &map, GST_MAP_WRITE);
+    for (int row = 0; row < h; row++) {
+        memcpy(map.data + row * w * VNC_SERVER_FB_BYTES, src + row * stride,
+               w * VNC_SERVER_FB_BYTES);
+    }
+    gst_buffer_unmap(buf, &map);
+
+    if (gst_app_src_push_buffer(GST_APP_SRC(h264->source), buf) !=
+        GST_FLOW_OK) {
+        vnc_h264_pipeline_free(h264);
+        return 0;
+    }
+
+    sample = gst_app_sink_try_pull_sample(GST_APP_SINK(h264->sink),
+                                          VNC_H264_PULL_TIMEOUT);
+    if (!sample) {
+        /* Nothing yet, the frame is sent with the next update */
+        return 0;
+    }
+
+    buf = gst_sample_get_buffer(sample);
+    gst_buffer_map(buf, &map, GST_MAP_READ);
+    trace_vnc_h264_frame(vs, w, h, map.size, h264->reset);
+
+    vnc_framebuffer_update(vs, 0, 0, w, h, VNC_ENCODING_H264);
+    vnc_write_u32(vs, map.size);
+    vnc_write_u32(vs, h264->reset ? VNC_H264_RESET_ALL_CONTEXTS : 0);
+    vnc_write(vs, map.data, map.size);
+    h264->reset = false;
+
+    gst_buffer_unmap(buf, &map);
+    gst_sample_unref(sample);
+    return 1;
+}
+
+void vnc_h264_clear(VncState *vs)
+{
+    if (vs->h264) {
+        vnc_h264_pipeline_free(vs->h264);
+        g_free(vs->h264);
+        vs->h264 = NULL;
+    }
+}
@@ -31,6 +31,7 @@
 #include "vnc-jobs.h"
 #include "qemu/sockets.h"
 #include "qemu/main-loop.h"
+#include "qemu/timer.h"
 #include "block/aio.h"
 #include "trace.h"
 
@@ -45,28 +46,31 @@
  * - VncState::output lock: used to make sure the output buffer is not corrupted
  *                          if two threads try to write on it at the same time
  *
- * While the VNC worker thread is working, the VncDisplay global lock is held
- * to avoid screen corruption (this does not block vnc_refresh() because it
- * uses trylock()) but the output lock is not held because the thread works on
- * its own output buffer.
+ * While a VNC worker thread is working, the VncDisplay global lock is held
+ * shared to avoid screen corruption (this does not block vnc_refresh()
+ * because it uses trylock()) but the output lock is not held because the
+ * thread works on its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * Several worker threads share the queue.  Jobs for different clients are
+ * encoded in parallel, jobs for the same client run one at a time and in
+ * order, because encoders such as tight and zlib keep per-client state.
  */
 
+#define VNC_WORKER_THREADS_MAX 4
+
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
-    QemuThread thread;
+    int nr_threads;
     bool exit;
     QTAILQ_HEAD(, VncJob) jobs;
 };
 
 typedef struct VncJobQueue VncJobQueue;
 
-/*
- * We use a single global queue, but most of the functions are
- * already reentrant, so we can easily add more than one encoding thread
- */
+/* We use a single global queue */
 static VncJobQueue *queue;
 
 static void vnc_lock_queue(VncJobQueue *queue)
@@ -193,6 +197,10 @@ static void vnc_async_encoding_start(VncState *orig, VncState *local)
     local->zlib = orig->zlib;
     local->hextile = orig->hextile;
     local->zrle = orig->zrle;
+#ifdef CONFIG_VNC_H264
+    local->h264 = orig->h264;
+#endif
+    local->job_update = orig->job_update;
     local->client_width = orig->client_width;
     local->client_height = orig->client_height;
 }
@@ -204,6 +212,9 @@ static void vnc_async_encoding_end(VncState *orig, VncState *local)
     orig->zlib = local->zlib;
     orig->hextile = local->hextile;
     orig->zrle = local->zrle;
+#ifdef CONFIG_VNC_H264
+    orig->h264 = local->h264;
+#endif
     orig->lossy_rect = local->lossy_rect;
 }
 
@@ -235,20 +246,45 @@ static bool vnc_worker_clamp_rect(VncState *vs, VncJob *job, VncRect *rect)
     return false;
 }
 
+/*
+ * Return the oldest job that is not running and whose client has no
+ * older job in the queue, or NULL.
+ */
+static VncJob *vnc_next_job_locked(VncJobQueue *queue)
+{
+    VncJob *job, *older;
+
+    QTAILQ_FOREACH(job, &queue->jobs, next) {
+        for (older = QTAILQ_FIRST(&queue->jobs); older != job;
+             older = QTAILQ_NEXT(older, next)) {
+            if (older->vs == job->vs) {
+                break;
+            }
+        }
+        if (older == job && !job->running) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
 static int vnc_worker_thread_loop(VncJobQueue *queue)
 {
-    VncJob *job;
+    VncJob *job = NULL;
     VncRectEntry *entry, *tmp;
     VncState vs = {};
     int n_rectangles;
     int saved_offset;
+    int64_t start;
 
     vnc_lock_queue(queue);
-    while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
+    while (!queue->exit && !(job = vnc_next_job_locked(queue))) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
     /* Here job can only be NULL if queue->exit is true */
-    job = QTAILQ_FIRST(&queue->jobs);
+    if (!queue->exit) {
+        job->running = true;
+    }
     vnc_unlock_queue(queue);
 
     if (queue->exit) {
@@ -275,6 +311,7 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     /* Make a local copy of vs and switch output buffers */
     vnc_async_encoding_start(job->vs, &vs);
     vs.magic = VNC_MAGIC;
+    start = get_clock();
 
     /* Start sending rectangles */
     n_rectangles = 0;
@@ -283,12 +320,12 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     saved_offset = vs.output.offset;
     vnc_write_u16(&vs, 0);
 
-    vnc_lock_display(job->vs->vd);
+    vnc_lock_display_shared(job->vs->vd);
     QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
         int n;
 
         if (job->vs->ioc == NULL) {
-            vnc_unlock_display(job->vs->vd);
+            vnc_unlock_display_shared(job->vs->vd);
             /* Copy persistent encoding data */
             vnc_async_encoding_end(job->vs, &vs);
             goto disconnected;
@@ -305,13 +342,17 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
         g_free(entry);
     }
     trace_vnc_job_nrects(&vs, job, n_rectangles);
-    vnc_unlock_display(job->vs->vd);
+    vnc_unlock_display_shared(job->vs->vd);
 
     /* Put n_rectangles at the beginning of the message */
     vs.output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
     vs.output.buffer[saved_offset + 1] = n_rectangles & 0xFF;
 
     vnc_lock_output(job->vs);
+    job->vs->encode_ns += get_clock() - start;
+    job->vs->encode_updates++;
+    trace_vnc_job_encoded(job->vs, job, n_rectangles, get_clock() - start,
+                          job->vs->encode_ns, job->vs->encode_updates);
     if (job->vs->ioc != NULL) {
         buffer_move(&job->vs->jobs_buffer, &vs.output);
         /* Copy persistent encoding data */
@@ -345,6 +386,7 @@ static VncJobQueue *vnc_queue_init(void)
     return queue;
 }
 
+/* Called by the last worker thread to exit */
 static void vnc_queue_clear(VncJobQueue *q)
 {
     qemu_cond_destroy(&queue->cond);
@@ -357,10 +399,16 @@ static void *vnc_worker_thread(void *arg)
 {
     VncJobQueue *queue = arg;
 
-    qemu_thread_get_self(&queue->thread);
+    bool last;
 
     while (!vnc_worker_thread_loop(queue)) ;
-    vnc_queue_clear(queue);
+
+    vnc_lock_queue(queue);
+    last = --queue->nr_threads == 0;
+    vnc_unlock_queue(queue);
+    if (last) {
+        vnc_queue_clear(queue);
+    }
     return NULL;
 }
 
@@ -372,12 +420,18 @@ static bool vnc_worker_thread_running(void)
 void vnc_start_worker_thread(void)
 {
     VncJobQueue *q;
+    QemuThread thread;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int i;
 
     if (vnc_worker_thread_running())
         return;
 
     q = vnc_queue_init();
-    qemu_thread_create(&q->thread, "vnc_worker", vnc_worker_thread, q,
-                       QEMU_THREAD_DETACHED);
+    q->nr_threads = MAX(MIN(nr_cpus, VNC_WORKER_THREADS_MAX), 1);
+    for (i = 0; i < q->nr_threads; i++) {
+        qemu_thread_create(&thread, "vnc_worker", vnc_worker_thread, q,
+                           QEMU_THREAD_DETACHED);
+    }
     queue = q; /* Set global queue */
 }
@@ -39,10 +39,21 @@ void vnc_jobs_join(VncState *vs);
 void vnc_jobs_consume_buffer(VncState *vs);
 void vnc_start_worker_thread(void);
 
-/* Locks */
+/*
+ * Locks
+ *
+ * The display lock is taken exclusively by vnc_refresh() to update the
+ * server surface, and shared by the job threads that encode from it.
+ */
 static inline int vnc_trylock_display(VncDisplay *vd)
 {
-    return qemu_mutex_trylock(&vd->mutex);
+    int ret = qemu_mutex_trylock(&vd->mutex);
+
+    if (!ret && qatomic_read(&vd->encoders)) {
+        qemu_mutex_unlock(&vd->mutex);
+        ret = -EBUSY;
+    }
+    return ret;
 }
 
 static inline void vnc_lock_display(VncDisplay *vd)
@@ -55,6 +66,18 @@ static inline void vnc_unlock_display(VncDisplay *vd)
     qemu_mutex_unlock(&vd->mutex);
 }
 
+static inline void vnc_lock_display_shared(VncDisplay *vd)
+{
+    qemu_mutex_lock(&vd->mutex);
+    qatomic_inc(&vd->encoders);
+    qemu_mutex_unlock(&vd->mutex);
+}
+
+static inline void vnc_unlock_display_shared(VncDisplay *vd)
+{
+    qatomic_dec(&vd->encoders);
+}
+
 static inline void vnc_lock_output(VncState *vs)
 {
     qemu_mutex_lock(&vs->output_mutex);
@@ -972,6 +972,11 @@ int vnc_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
         case VNC_ENCODING_ZYWRLE:
             n = vnc_zywrle_send_framebuffer_update(vs, x, y, w, h);
             break;
+#ifdef CONFIG_VNC_H264
+        case VNC_ENCODING_H264:
+            n = vnc_h264_send_framebuffer_update(vs, x, y, w, h);
+            break;
+#endif
         default:
             vnc_framebuffer_update(vs, x, y, w, h, VNC_ENCODING_RAW);
             n = vnc_raw_send_framebuffer_update(vs, x, y, w, h);
@@ -1174,6 +1179,15 @@ static int vnc_update_client(VncState *vs, int has_dirty)
     height = pixman_image_get_height(vd->server);
     width = pixman_image_get_width(vd->server);
 
+    if (vs->vnc_encoding == VNC_ENCODING_H264) {
+        /* Every update is one frame of the whole screen */
+        for (y = 0; y < height; y++) {
+            bitmap_zero(vs->dirty[y], VNC_DIRTY_BITS);
+        }
+        n = vnc_job_add_rect(job, 0, 0, width, height);
+        goto out;
+    }
+
     y = 0;
     for (;;) {
         int x, h;
@@ -1204,6 +1218,7 @@ static int vnc_update_client(VncState *vs, int has_dirty)
         }
     }
 
+out:
     vs->job_update = vs->update;
     vs->update = VNC_STATE_UPDATE_NONE;
     vnc_job_push(job);
@@ -1325,6 +1340,9 @@ void vnc_disconnect_finish(VncState *vs)
     vnc_zlib_clear(vs);
     vnc_tight_clear(vs);
     vnc_zrle_clear(vs);
+#ifdef CONFIG_VNC_H264
+    vnc_h264_clear(vs);
+#endif
 
 #ifdef CONFIG_VNC_SASL
     vnc_sasl_client_cleanup(vs);
@@ -2176,6 +2194,15 @@ static void set_encodings(VncState *vs, int32_t *encodings, size_t n_encodings)
             vs->features |= VNC_FEATURE_ZYWRLE_MASK;
             vs->vnc_encoding = enc;
             break;
+#ifdef CONFIG_VNC_H264
+        case VNC_ENCODING_H264:
+            /* H.264 is lossy, only use it if lossy encodings are allowed */
+            if (vs->vd->lossy && vnc_h264_available()) {
+                vs->features |= VNC_FEATURE_H264_MASK;
+                vs->vnc_encoding = enc;
+            }
+            break;
+#endif
         case VNC_ENCODING_DESKTOPRESIZE:
             vs->features |= VNC_FEATURE_RESIZE_MASK;
             break;
@@ -158,6 +158,7 @@ struct VncDisplay
     int ledstate;
     QKbdState *kbd;
     QemuMutex mutex;
+    unsigned int encoders; /* workers reading the server surface */
 
     int cursor_msize;
     uint8_t *cursor_mask;
@@ -228,6 +229,8 @@ typedef struct VncZrle {
     VncPalette palette;
 } VncZrle;
 
+typedef struct VncH264 VncH264;
+
 typedef struct VncZywrle {
     int buf[VNC_ZRLE_TILE_WIDTH * VNC_ZRLE_TILE_HEIGHT];
 } VncZywrle;
@@ -249,6 +252,7 @@ struct VncRectEntry
 struct VncJob
 {
     VncState *vs;
+    bool running;
 
     QLIST_HEAD(, VncRectEntry) rectangles;
     QTAILQ_ENTRY(VncJob) next;
@@ -336,6 +340,9 @@ struct VncState
     QemuMutex output_mutex;
     QEMUBH *bh;
     Buffer jobs_buffer;
+    /* Time spent encoding updates in the job threads, under output_mutex */
+    uint64_t encode_ns;
+    uint64_t encode_updates;
 
     /* Encoding specific, if you add something here, don't forget to
      *  update vnc_async_encoding_start()
@@ -345,6 +352,9 @@ struct VncState
     VncHextile hextile;
     VncZrle *zrle;
     VncZywrle zywrle;
+#ifdef CONFIG_VNC_H264
+    VncH264 *h264;
+#endif
 
     Notifier mouse_mode_notifier;
 
@@ -405,6 +415,7 @@ enum {
 #define VNC_ENCODING_TRLE                 0x0000000f
 #define VNC_ENCODING_ZRLE                 0x00000010
 #define VNC_ENCODING_ZYWRLE               0x00000011
+#define VNC_ENCODING_H264                 0x00000032
 #define VNC_ENCODING_COMPRESSLEVEL0       0xFFFFFF00 /* -256 */
 #define VNC_ENCODING_QUALITYLEVEL0        0xFFFFFFE0 /* -32  */
 #define VNC_ENCODING_XCURSOR              0xFFFFFF10 /* -240 */
@@ -465,6 +476,7 @@ enum VncFeatures {
     VNC_FEATURE_XVP,
     VNC_FEATURE_CLIPBOARD_EXT,
     VNC_FEATURE_AUDIO,
+    VNC_FEATURE_H264,
 };
 
 #define VNC_FEATURE_RESIZE_MASK              (1 << VNC_FEATURE_RESIZE)
@@ -483,6 +495,7 @@ enum VncFeatures {
 #define VNC_FEATURE_XVP_MASK                 (1 << VNC_FEATURE_XVP)
 #define VNC_FEATURE_CLIPBOARD_EXT_MASK       (1 <<  VNC_FEATURE_CLIPBOARD_EXT)
 #define VNC_FEATURE_AUDIO_MASK               (1 <<  VNC_FEATURE_AUDIO)
+#define VNC_FEATURE_H264_MASK                (1 <<  VNC_FEATURE_H264)
 
 
 /* Client -> Server message IDs */
@@ -638,6 +651,12 @@ int vnc_zrle_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
 int vnc_zywrle_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
 void vnc_zrle_clear(VncState *vs);
 
+#ifdef CONFIG_VNC_H264
+bool vnc_h264_available(void);
+int vnc_h264_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
+void vnc_h264_clear(VncState *vs);
+#endif
+
 /* vnc-clipboard.c */
 void vnc_server_cut_text_caps(VncState *vs);
 void vnc_client_cut_text(VncState *vs, size_t len, uint8_t *text);
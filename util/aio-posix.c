@@ -21,9 +21,12 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/sockets.h"
 #include "qemu/cutils.h"
+#include "qemu/stats-counter.h"
 #include "trace.h"
 #include "aio-posix.h"
 
+STATS_COUNTER_DEFINE(aio_poll_calls, "aio-poll-calls");
+
 /* Stop userspace polling on a handler if it isn't active for some time */
 #define POLL_IDLE_INTERVAL_NS (7 * NANOSECONDS_PER_SECOND)
 
@@ -148,6 +151,7 @@ void aio_set_fd_handler(AioContext *ctx,
             new_node->pfd.fd = fd;
         } else {
             new_node->pfd = node->pfd;
+            new_node->poll_ns = node->poll_ns;
         }
         g_source_add_poll(&ctx->source, &new_node->pfd);
 
@@ -417,20 +421,43 @@ static bool aio_dispatch_handlers(AioContext *ctx)
     return progress;
 }
 
+static bool run_poll_handlers_once(AioContext *ctx,
+                                   AioHandlerList *ready_list,
+                                   int64_t now,
+                                   int64_t elapsed_time,
+                                   int64_t *timeout);
+
 void aio_dispatch(AioContext *ctx)
 {
     qemu_lockcnt_inc(&ctx->list_lock);
     aio_bh_poll(ctx);
     aio_dispatch_handlers(ctx);
+
+    /* glib does not poll, so do it here, see aio_context_poll_busy() */
+    if (ctx->poll_busy_cnt) {
+        AioHandlerList ready_list = QLIST_HEAD_INITIALIZER(ready_list);
+        int64_t timeout = 0;
+
+        run_poll_handlers_once(ctx, &ready_list,
+                               qemu_clock_get_ns(QEMU_CLOCK_REALTIME), 0,
+                               &timeout);
+        aio_dispatch_ready_handlers(ctx, &ready_list);
+    }
+
     aio_free_deleted_handlers(ctx);
     qemu_lockcnt_dec(&ctx->list_lock);
 
     timerlistgroup_run_timers(&ctx->tlg);
 }
 
+/*
+ * Each handler is polled while @elapsed_time, the time since polling started,
+ * is within its own budget.  All handlers are polled at least once.
+ */
 static bool run_poll_handlers_once(AioContext *ctx,
                                    AioHandlerList *ready_list,
                                    int64_t now,
+                                   int64_t elapsed_time,
                                    int64_t *timeout)
 {
     bool progress = false;
@@ -438,10 +465,16 @@ static bool run_poll_handlers_once(AioContext *ctx,
     AioHandler *tmp;
 
     QLIST_FOREACH_SAFE(node, &ctx->poll_aio_handlers, node_poll, tmp) {
+        if (elapsed_time && elapsed_time >= node->poll_ns) {
+            continue;
+        }
+
         if (node->io_poll(node->opaque)) {
             aio_add_poll_ready_handler(ready_list, node);
+            stat64_add(&ctx->poll_hits, 1);
 
             node->poll_idle_timeout = now + POLL_IDLE_INTERVAL_NS;
+            node->poll_ready_time = now;
 
             /*
              * Polling was successful, exit try_poll_mode immediately
@@ -477,8 +510,11 @@ static bool remove_idle_poll_handlers(AioContext *ctx,
      * support suffer from starvation when a subset of handlers is polled
      * because fds will not be processed in a timely fashion.  Don't remove
      * idle poll handlers.
+     *
+     * Handlers must not be removed while someone relies on polling either,
+     * see aio_context_poll_busy().
      */
-    if (!fdmon_supports_polling(ctx)) {
+    if (!fdmon_supports_polling(ctx) || ctx->poll_busy_cnt) {
         return false;
     }
 
@@ -488,6 +524,7 @@ static bool remove_idle_poll_handlers(AioContext *ctx,
         } else if (now >= node->poll_idle_timeout) {
             trace_poll_remove(ctx, node, node->pfd.fd);
             node->poll_idle_timeout = 0LL;
+            node->poll_ns = 0;
             QLIST_SAFE_REMOVE(node, node_poll);
             if (ctx->poll_started && node->io_poll_end) {
                 node->io_poll_end(node->opaque);
@@ -523,7 +560,7 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
                               int64_t max_ns, int64_t *timeout)
 {
     bool progress;
-    int64_t start_time, elapsed_time;
+    int64_t start_time, now, elapsed_time;
 
     assert(qemu_lockcnt_count(&ctx->list_lock) > 0);
 
@@ -539,15 +576,21 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
      */
     RCU_READ_LOCK_GUARD();
 
-    start_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    start_time = now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     do {
-        progress = run_poll_handlers_once(ctx, ready_list,
-                                          start_time, timeout);
-        elapsed_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_time;
+        progress = run_poll_handlers_once(ctx, ready_list, now,
+                                          now - start_time, timeout);
+        now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        elapsed_time = now - start_time;
         max_ns = qemu_soonest_timeout(*timeout, max_ns);
         assert(!(max_ns && progress));
     } while (elapsed_time < max_ns && !ctx->fdmon_ops->need_wait(ctx));
 
+    if (!progress) {
+        stat64_add(&ctx->poll_misses, 1);
+        stat64_add(&ctx->poll_wasted_ns, elapsed_time);
+    }
+
     if (remove_idle_poll_handlers(ctx, ready_list,
                                   start_time + elapsed_time)) {
         *timeout = 0;
@@ -585,6 +628,9 @@ static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
     }
 
     max_ns = qemu_soonest_timeout(*timeout, ctx->poll_ns);
+    if (!max_ns && ctx->poll_busy_cnt) {
+        max_ns = 1; /* run the poll handlers at least once */
+    }
     if (max_ns && !ctx->fdmon_ops->need_wait(ctx)) {
         /*
          * Enable poll mode. It pairs with the poll_set_started() in
@@ -599,6 +645,93 @@ static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
     return false;
 }
 
+/*
+ * Adjust the polling budget of @node, which became ready @block_ns after
+ * aio_poll() started.
+ */
+static void adjust_handler_poll_ns(AioContext *ctx, AioHandler *node,
+                                   int64_t block_ns)
+{
+    int64_t old = node->poll_ns;
+
+    if (block_ns <= node->poll_ns) {
+        /* This is the sweet spot, no adjustment needed */
+    } else if (block_ns > ctx->poll_max_ns) {
+        /* We'd have to poll for too long, poll less */
+        if (ctx->poll_shrink) {
+            node->poll_ns /= ctx->poll_shrink;
+        } else {
+            node->poll_ns = 0;
+        }
+
+        trace_poll_shrink(ctx, node, old, node->poll_ns);
+    } else if (node->poll_ns < ctx->poll_max_ns &&
+               block_ns < ctx->poll_max_ns) {
+        /* There is room to grow, poll longer */
+        int64_t grow = ctx->poll_grow;
+
+        if (grow == 0) {
+            grow = 2;
+        }
+
+        if (node->poll_ns) {
+            node->poll_ns *= grow;
+        } else {
+            node->poll_ns = 4000; /* start polling at 4 microseconds */
+        }
+
+        if (node->poll_ns > ctx->poll_max_ns) {
+            node->poll_ns = ctx->poll_max_ns;
+        }
+
+        trace_poll_grow(ctx, node, old, node->poll_ns);
+    }
+}
+
+/*
+ * Adjust the polling budgets after an aio_poll() iteration that started at
+ * @start and finished waiting at @now.  Each handler's budget follows how
+ * long that handler took to become ready, so a slow or idle handler does not
+ * cut polling short for the others or keep the CPU spinning for them.  The
+ * AioContext polls for as long as the largest budget.
+ *
+ * Handlers that polling found ready are moved to the front of the list, so
+ * that the handlers most likely to make progress are polled first.
+ */
+static void adjust_polling_time(AioContext *ctx, int64_t start, int64_t now)
+{
+    AioHandler *node;
+    AioHandler *tmp;
+    int64_t poll_ns = 0;
+
+    QLIST_FOREACH_SAFE(node, &ctx->poll_aio_handlers, node_poll, tmp) {
+        int64_t block_ns = now - start;
+
+        if (node->poll_ns > ctx->poll_max_ns) {
+            node->poll_ns = ctx->poll_max_ns; /* poll-max-ns was lowered */
+        }
+
+        if (node->poll_ready && node->poll_ready_time >= start) {
+            block_ns = node->poll_ready_time - start;
+
+            if (node != QLIST_FIRST(&ctx->poll_aio_handlers)) {
+                QLIST_REMOVE(node, node_poll);
+                QLIST_INSERT_HEAD(&ctx->poll_aio_handlers, node, node_poll);
+            }
+            adjust_handler_poll_ns(ctx, node, block_ns);
+        } else if (node->poll_ready || node->pfd.revents) {
+            adjust_handler_poll_ns(ctx, node, block_ns);
+        } else if (block_ns > ctx->poll_max_ns) {
+            /* Not ready even after polling for the maximum time */
+            adjust_handler_poll_ns(ctx, node, block_ns);
+        }
+
+        poll_ns = MAX(poll_ns, node->poll_ns);
+    }
+
+    ctx->poll_ns = poll_ns;
+}
+
 bool aio_poll(AioContext *ctx, bool blocking)
 {
     AioHandlerList ready_list = QLIST_HEAD_INITIALIZER(ready_list);
@@ -618,6 +751,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
      */
     assert(in_aio_context_home_thread(ctx == iohandler_get_aio_context() ?
                                       qemu_get_aio_context() : ctx));
+    stats_counter_inc(&aio_poll_calls);
 
     qemu_lockcnt_inc(&ctx->list_lock);
 
@@ -629,6 +763,11 @@ bool aio_poll(AioContext *ctx, bool blocking)
     progress = try_poll_mode(ctx, &ready_list, &timeout);
     assert(!(timeout && progress));
 
+    if (ctx->poll_busy_cnt) {
+        /* Only check file descriptors, see aio_context_poll_busy() */
+        timeout = 0;
+    }
+
     /*
      * aio_notify can avoid the expensive event_notifier_set if
      * everything (file descriptors, bottom halves, timers) will
@@ -680,43 +819,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
     /* Adjust polling time */
     if (ctx->poll_max_ns) {
-        int64_t block_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
-
-        if (block_ns <= ctx->poll_ns) {
-            /* This is the sweet spot, no adjustment needed */
-        } else if (block_ns > ctx->poll_max_ns) {
-            /* We'd have to poll for too long, poll less */
-            int64_t old = ctx->poll_ns;
-
-            if (ctx->poll_shrink) {
-                ctx->poll_ns /= ctx->poll_shrink;
-            } else {
-                ctx->poll_ns = 0;
-            }
-
-            trace_poll_shrink(ctx, old, ctx->poll_ns);
-        } else if (ctx->poll_ns < ctx->poll_max_ns &&
-                   block_ns < ctx->poll_max_ns) {
-            /* There is room to grow, poll longer */
-            int64_t old = ctx->poll_ns;
-            int64_t grow = ctx->poll_grow;
-
-            if (grow == 0) {
-                grow = 2;
-            }
-
-            if (ctx->poll_ns) {
-                ctx->poll_ns *= grow;
-            } else {
-                ctx->poll_ns = 4000; /* start polling at 4 microseconds */
-            }
-
-            if (ctx->poll_ns > ctx->poll_max_ns) {
-                ctx->poll_ns = ctx->poll_max_ns;
-            }
-
-            trace_poll_grow(ctx, old, ctx->poll_ns);
-        }
+        adjust_polling_time(ctx, start, qemu_clock_get_ns(QEMU_CLOCK_REALTIME));
     }
 
     progress |= aio_bh_poll(ctx);
@@ -787,3 +890,37 @@ void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 
     aio_notify(ctx);
 }
+
+void aio_context_poll_busy(AioContext *ctx, bool busy)
+{
+    AioHandler *node;
+
+    assert(in_aio_context_home_thread(ctx));
+
+    if (!busy) {
+        ctx->poll_busy_cnt--;
+        assert(ctx->poll_busy_cnt >= 0);
+        return;
+    }
+
+    if (ctx->poll_busy_cnt++) {
+        return;
+    }
+
+    /*
+     * Handlers that were removed from poll_aio_handlers while idle would only
+     * be added back when their fd fires, which may never happen now.
+     */
+    qemu_lockcnt_inc(&ctx->list_lock);
+    QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
+        if (!QLIST_IS_INSERTED(node, node_deleted) &&
+            !QLIST_IS_INSERTED(node, node_poll) &&
+            node->io_poll) {
+            if (ctx->poll_started && node->io_poll_begin) {
+                node->io_poll_begin(node->opaque);
+            }
+            QLIST_INSERT_HEAD(&ctx->poll_aio_handlers, node, node_poll);
+        }
+    }
+    qemu_lockcnt_dec(&ctx->list_lock);
+}
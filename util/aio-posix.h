@@ -37,6 +37,8 @@ struct AioHandler {
     unsigned flags; /* see fdmon-io_uring.c */
 #endif
     int64_t poll_idle_timeout; /* when to stop userspace polling */
+    int64_t poll_ns; /* userspace polling budget, see aio_poll() */
+    int64_t poll_ready_time; /* when polling last detected an event */
     bool poll_ready; /* has polling detected an event? */
 };
 
@@ -23,6 +23,9 @@
 #include "qapi/error.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/error-report.h"
+#include "qemu/stats-counter.h"
+
+STATS_COUNTER_DEFINE(aio_poll_calls, "aio-poll-calls");
 
 struct AioHandler {
     EventNotifier *e;
@@ -338,6 +341,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
      */
     assert(in_aio_context_home_thread(ctx == iohandler_get_aio_context() ?
                                       qemu_get_aio_context() : ctx));
+    stats_counter_inc(&aio_poll_calls);
     progress = false;
 
     /* aio_notify can avoid the expensive event_notifier_set if
@@ -441,3 +445,7 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 {
 }
+
+void aio_context_poll_busy(AioContext *ctx, bool busy)
+{
+}
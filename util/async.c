@@ -27,6 +27,7 @@
 #include "qapi/error.h"
 #include "block/aio.h"
 #include "block/thread-pool.h"
+#include "block/bounce-pool.h"
 #include "block/graph-lock.h"
 #include "qemu/main-loop.h"
 #include "qemu/atomic.h"
@@ -34,9 +35,13 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine_int.h"
 #include "qemu/coroutine-tls.h"
+#include "qemu/stats-counter.h"
 #include "sysemu/cpu-timers.h"
 #include "trace.h"
 
+STATS_COUNTER_DEFINE(bh_scheduled, "bh-scheduled");
+STATS_COUNTER_DEFINE(bh_runs, "bh-runs");
+
 /***********************************************************/
 /* bottom halves (can be seen as timers which expire ASAP) */
 
@@ -79,6 +84,7 @@ static void aio_bh_enqueue(QEMUBH *bh, unsigned new_flags)
      * insertion starts after BH_PENDING is set.
      */
     old_flags = qatomic_fetch_or(&bh->flags, BH_PENDING | new_flags);
+    stats_counter_inc(&bh_scheduled);
 
     if (!(old_flags & BH_PENDING)) {
         /*
@@ -91,9 +97,20 @@ static void aio_bh_enqueue(QEMUBH *bh, unsigned new_flags)
          *    could be freed.
          */
         QSLIST_INSERT_HEAD_ATOMIC(&ctx->bh_list, bh, next);
+        aio_notify(ctx);
+    } else if ((old_flags & (BH_SCHEDULED | BH_IDLE)) != BH_SCHEDULED) {
+        /*
+         * Scheduling a bottom half again before it runs, e.g. once per
+         * completed request, only needs the first aio_notify().  Whoever
+         * set BH_SCHEDULED has notified ctx or will do so, and until
+         * aio_bh_poll() clears the flag ctx does not block without running
+         * bh.  A bottom half that is pending without BH_SCHEDULED, e.g.
+         * after qemu_bh_cancel(), or only as an idle bottom half still needs
+         * the notification.
+         */
+        aio_notify(ctx);
     }
 
-    aio_notify(ctx);
     if (unlikely(icount_enabled())) {
         /*
          * Workaround for record/replay.
@@ -168,6 +185,7 @@ void aio_bh_call(QEMUBH *bh)
         reentrancy_guard->engaged_in_io = true;
     }
 
+    stats_counter_inc(&bh_runs);
     bh->cb(bh->opaque);
 
     if (reentrancy_guard) {
@@ -180,6 +198,7 @@ int aio_bh_poll(AioContext *ctx)
 {
     BHListSlice slice;
     BHListSlice *s;
+    uint64_t calls = 0;
     int ret = 0;
 
     /* Synchronizes with QSLIST_INSERT_HEAD_ATOMIC in aio_bh_enqueue().  */
@@ -215,6 +234,7 @@ int aio_bh_poll(AioContext *ctx)
             if (!(flags & BH_IDLE)) {
                 ret = 1;
             }
+            calls++;
             aio_bh_call(bh);
         }
         if (flags & (BH_DELETED | BH_ONESHOT)) {
@@ -222,6 +242,10 @@ int aio_bh_poll(AioContext *ctx)
         }
     }
 
+    if (calls) {
+        stat64_add(&ctx->bh_calls, calls);
+        stat64_add(&ctx->bh_batches, 1);
+    }
     return ret;
 }
 
@@ -315,7 +339,7 @@ aio_ctx_prepare(GSource *source, gint    *timeout)
     /* We assume there is no timeout already supplied */
     *timeout = qemu_timeout_ns_to_ms(aio_compute_timeout(ctx));
 
-    if (aio_prepare(ctx)) {
+    if (aio_prepare(ctx) || ctx->poll_busy_cnt) {
         *timeout = 0;
     }
 
@@ -346,7 +370,8 @@ aio_ctx_check(GSource *source)
             }
         }
     }
-    return aio_pending(ctx) || (timerlistgroup_deadline_ns(&ctx->tlg) == 0);
+    return aio_pending(ctx) || ctx->poll_busy_cnt ||
+           (timerlistgroup_deadline_ns(&ctx->tlg) == 0);
 }
 
 static gboolean
@@ -369,6 +394,7 @@ aio_ctx_finalize(GSource     *source)
     unsigned flags;
 
     thread_pool_free(ctx->thread_pool);
+    bounce_pool_free(ctx->bounce_pool);
 
 #ifdef CONFIG_LINUX_AIO
     if (ctx->linux_aio) {
@@ -379,10 +405,12 @@ aio_ctx_finalize(GSource     *source)
 #endif
 
 #ifdef CONFIG_LINUX_IO_URING
-    if (ctx->linux_io_uring) {
-        luring_detach_aio_context(ctx->linux_io_uring, ctx);
-        luring_cleanup(ctx->linux_io_uring);
-        ctx->linux_io_uring = NULL;
+    for (int i = 0; i < LURING_NR_RINGS; i++) {
+        if (ctx->linux_io_uring[i]) {
+            luring_detach_aio_context(ctx->linux_io_uring[i], ctx);
+            luring_cleanup(ctx->linux_io_uring[i]);
+            ctx->linux_io_uring[i] = NULL;
+        }
     }
 #endif
 
@@ -442,6 +470,15 @@ ThreadPool *aio_get_thread_pool(AioContext *ctx)
     return ctx->thread_pool;
 }
 
+BouncePool *aio_get_bounce_pool(AioContext *ctx)
+{
+    if (!ctx->bounce_pool) {
+        /* Read by other threads for statistics */
+        qatomic_set(&ctx->bounce_pool, bounce_pool_new());
+    }
+    return ctx->bounce_pool;
+}
+
 #ifdef CONFIG_LINUX_AIO
 LinuxAioState *aio_setup_linux_aio(AioContext *ctx, Error **errp)
 {
@@ -462,25 +499,28 @@ LinuxAioState *aio_get_linux_aio(AioContext *ctx)
 #endif
 
 #ifdef CONFIG_LINUX_IO_URING
-LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
+LuringState *aio_setup_linux_io_uring(AioContext *ctx, unsigned int flags,
+                                      Error **errp)
 {
-    if (ctx->linux_io_uring) {
-        return ctx->linux_io_uring;
+    assert(flags < LURING_NR_RINGS);
+
+    if (ctx->linux_io_uring[flags]) {
+        return ctx->linux_io_uring[flags];
     }
 
-    ctx->linux_io_uring = luring_init(errp);
-    if (!ctx->linux_io_uring) {
+    ctx->linux_io_uring[flags] = luring_init(flags, errp);
+    if (!ctx->linux_io_uring[flags]) {
         return NULL;
     }
 
-    luring_attach_aio_context(ctx->linux_io_uring, ctx);
-    return ctx->linux_io_uring;
+    luring_attach_aio_context(ctx->linux_io_uring[flags], ctx);
+    return ctx->linux_io_uring[flags];
 }
 
-LuringState *aio_get_linux_io_uring(AioContext *ctx)
+LuringState *aio_get_linux_io_uring(AioContext *ctx, unsigned int flags)
 {
-    assert(ctx->linux_io_uring);
-    return ctx->linux_io_uring;
+    assert(flags < LURING_NR_RINGS && ctx->linux_io_uring[flags]);
+    return ctx->linux_io_uring[flags];
 }
 #endif
 
@@ -601,10 +641,11 @@ AioContext *aio_context_new(Error **errp)
 #endif
 
 #ifdef CONFIG_LINUX_IO_URING
-    ctx->linux_io_uring = NULL;
+    memset(ctx->linux_io_uring, 0, sizeof(ctx->linux_io_uring));
 #endif
 
     ctx->thread_pool = NULL;
+    ctx->bounce_pool = NULL;
     qemu_rec_mutex_init(&ctx->lock);
     timerlistgroup_init(&ctx->tlg, aio_timerlist_notify, ctx);
 
@@ -742,8 +783,24 @@ void qemu_set_current_aio_context(AioContext *ctx)
     set_my_aiocontext(ctx);
 }
 
+void aio_context_get_bh_stats(AioContext *ctx, uint64_t *calls,
+                              uint64_t *batches)
+{
+    *calls = stat64_get(&ctx->bh_calls);
+    *batches = stat64_get(&ctx->bh_batches);
+}
+
+void aio_context_get_poll_stats(AioContext *ctx, uint64_t *hits,
+                                uint64_t *misses, uint64_t *wasted_ns)
+{
+    *hits = stat64_get(&ctx->poll_hits);
+    *misses = stat64_get(&ctx->poll_misses);
+    *wasted_ns = stat64_get(&ctx->poll_wasted_ns);
+}
+
 void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
-                                        int64_t max, Error **errp)
+                                        int64_t max, struct ThreadContext *tc,
+                                        Error **errp)
 {
 
     if (min > max || !max || min > INT_MAX || max > INT_MAX) {
@@ -753,6 +810,7 @@ void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
 
     ctx->thread_pool_min = min;
     ctx->thread_pool_max = max;
+    ctx->thread_pool_context = tc;
 
     if (ctx->thread_pool) {
         thread_pool_update_params(ctx->thread_pool, ctx);
@@ -0,0 +1,166 @@
+/*
+ * Pool of aligned bounce buffers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Padding unaligned requests and bouncing misaligned iovecs for O_DIRECT
+ * would otherwise allocate and fault in a fresh buffer for every request.
+ * Buffers up to BOUNCE_POOL_MAX_SIZE are rounded up to a power of two,
+ * at least 4k, and kept on a free list per size class once returned.  The
+ * first time a class is needed, a few buffers are allocated and faulted in
+ * at once.  Each class keeps at most BOUNCE_POOL_CLASS_BYTES of free
+ * buffers, so the memory held by an idle pool stays small.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/memalign.h"
+#include "qemu/stats64.h"
+#include "block/bounce-pool.h"
+
+#define BOUNCE_POOL_MIN_SHIFT   12
+#define BOUNCE_POOL_MAX_SHIFT   18
+#define BOUNCE_POOL_CLASSES     (BOUNCE_POOL_MAX_SHIFT - BOUNCE_POOL_MIN_SHIFT + 1)
+#define BOUNCE_POOL_CLASS_BYTES (1 * MiB)
+#define BOUNCE_POOL_PREFILL     4
+
+QEMU_BUILD_BUG_ON(BOUNCE_POOL_MAX_SIZE != 1 << BOUNCE_POOL_MAX_SHIFT);
+
+typedef struct BouncePoolClass {
+    void **free;
+    unsigned nr_free;
+    unsigned max_free;
+    bool prefilled;
+} BouncePoolClass;
+
+struct BouncePool {
+    size_t align;               /* alignment of buffers on the free lists */
+    BouncePoolClass classes[BOUNCE_POOL_CLASSES];
+    Stat64 hits;
+    Stat64 misses;
+};
+
+static int bounce_pool_class(size_t size)
+{
+    if (size <= 1 << BOUNCE_POOL_MIN_SHIFT) {
+        return 0;
+    }
+    return 64 - clz64(size - 1) - BOUNCE_POOL_MIN_SHIFT;
+}
+
+static size_t bounce_pool_class_size(int c)
+{
+    return (size_t)1 << (c + BOUNCE_POOL_MIN_SHIFT);
+}
+
+/* Allocate a buffer and fault it in, so that the first I/O does not */
+static void *bounce_pool_alloc(size_t align, size_t size)
+{
+    void *buf = qemu_try_memalign(align, size);
+
+    if (buf) {
+        memset(buf, 0, size);
+    }
+    return buf;
+}
+
+BouncePool *bounce_pool_new(void)
+{
+    BouncePool *pool = g_new0(BouncePool, 1);
+
+    pool->align = qemu_real_host_page_size();
+    for (int c = 0; c < BOUNCE_POOL_CLASSES; c++) {
+        BouncePoolClass *bc = &pool->classes[c];
+
+        bc->max_free = MAX(2, BOUNCE_POOL_CLASS_BYTES /
+                              bounce_pool_class_size(c));
+        bc->free = g_new(void *, bc->max_free);
+    }
+    return pool;
+}
+
+void bounce_pool_free(BouncePool *pool)
+{
+    if (!pool) {
+        return;
+    }
+    for (int c = 0; c < BOUNCE_POOL_CLASSES; c++) {
+        BouncePoolClass *bc = &pool->classes[c];
+
+        while (bc->nr_free) {
+            qemu_vfree(bc->free[--bc->nr_free]);
+        }
+        g_free(bc->free);
+    }
+    g_free(pool);
+}
+
+void *bounce_pool_try_get(BouncePool *pool, size_t align, size_t size)
+{
+    BouncePoolClass *bc;
+    int c;
+
+    if (size > BOUNCE_POOL_MAX_SIZE) {
+        if (pool) {
+            stat64_add(&pool->misses, 1);
+        }
+        return qemu_try_memalign(align, size);
+    }
+
+    c = bounce_pool_class(size);
+    if (!pool || align > pool->align) {
+        if (pool) {
+            stat64_add(&pool->misses, 1);
+        }
+        return qemu_try_memalign(MAX(align, qemu_real_host_page_size()),
+                                 bounce_pool_class_size(c));
+    }
+
+    bc = &pool->classes[c];
+    if (!bc->nr_free && !bc->prefilled) {
+        bc->prefilled = true;
+        while (bc->nr_free < MIN(BOUNCE_POOL_PREFILL, bc->max_free)) {
+            void *buf = bounce_pool_alloc(pool->align,
+                                          bounce_pool_class_size(c));
+            if (!buf) {
+                break;
+            }
+            bc->free[bc->nr_free++] = buf;
+        }
+    }
+    if (bc->nr_free) {
+        stat64_add(&pool->hits, 1);
+        return bc->free[--bc->nr_free];
+    }
+
+    stat64_add(&pool->misses, 1);
+    return bounce_pool_alloc(pool->align, bounce_pool_class_size(c));
+}
+
+void bounce_pool_put(BouncePool *pool, void *buf, size_t size)
+{
+    BouncePoolClass *bc;
+
+    if (!buf) {
+        return;
+    }
+    if (!pool || size > BOUNCE_POOL_MAX_SIZE) {
+        qemu_vfree(buf);
+        return;
+    }
+
+    /* All buffers of a class are aligned to at least pool->align */
+    bc = &pool->classes[bounce_pool_class(size)];
+    if (bc->nr_free == bc->max_free) {
+        qemu_vfree(buf);
+        return;
+    }
+    bc->free[bc->nr_free++] = buf;
+}
+
+void bounce_pool_get_stats(BouncePool *pool, uint64_t *hits,
+                           uint64_t *misses)
+{
+    *hits = pool ? stat64_get(&pool->hits) : 0;
+    *misses = pool ? stat64_get(&pool->misses) : 0;
+}
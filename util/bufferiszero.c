@@ -264,6 +264,58 @@ static bool select_accel_fn(const void *buf, size_t len)
     return buffer_zero_int(buf, len);
 }
 
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+
+/* Note that this vectorized function requires len >= 64.  */
+static bool buffer_zero_neon(const void *buf, size_t len)
+{
+    uint64x2_t t = vld1q_u64(buf);
+    const uint64x2_t *p = (uint64x2_t *)(((uintptr_t)buf + 5 * 16) & -16);
+    const uint64x2_t *e = (uint64x2_t *)(((uintptr_t)buf + len) & -16);
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(vmaxvq_u32(vreinterpretq_u32_u64(t)))) {
+            return false;
+        }
+        t = vorrq_u64(vorrq_u64(p[-4], p[-3]), vorrq_u64(p[-2], p[-1]));
+        p += 4;
+    }
+
+    /* Finish the aligned tail.  */
+    t = vorrq_u64(t, e[-3]);
+    t = vorrq_u64(t, e[-2]);
+    t = vorrq_u64(t, e[-1]);
+
+    /* Finish the unaligned tail.  */
+    t = vorrq_u64(t, vld1q_u64(buf + len - 16));
+
+    return vmaxvq_u32(vreinterpretq_u32_u64(t)) == 0;
+}
+
+/* NEON is part of the base ARMv8-A ISA, so there is nothing to probe.  */
+static bool (*buffer_accel)(const void *, size_t) = buffer_zero_neon;
+
+bool test_buffer_is_zero_next_accel(void)
+{
+    /* After the NEON round, test the integer fallback once.  */
+    if (buffer_accel == buffer_zero_neon) {
+        buffer_accel = buffer_zero_int;
+        return true;
+    }
+    return false;
+}
+
+static bool select_accel_fn(const void *buf, size_t len)
+{
+    if (likely(len >= 64)) {
+        return buffer_accel(buf, len);
+    }
+    return buffer_zero_int(buf, len);
+}
+
 #else
 #define select_accel_fn  buffer_zero_int
 bool test_buffer_is_zero_next_accel(void)
@@ -288,3 +340,26 @@ bool buffer_is_zero(const void *buf, size_t len)
        includes a check for an unrolled loop over 64-bit integers.  */
     return select_accel_fn(buf, len);
 }
+
+/*
+ * Returns the number of consecutive @unit byte blocks at the start of
+ * @buf, at most @n, that are all zeroes if @zero is true, or that each
+ * contain a non-zero byte if @zero is false.  This is cheaper than
+ * calling buffer_is_zero() on each block since the next block is
+ * prefetched while the current one is checked.
+ */
+size_t buffer_is_zero_span(const void *buf, size_t unit, size_t n, bool zero)
+{
+    size_t i;
+
+    assert(unit);
+    __builtin_prefetch(buf);
+
+    for (i = 0; i < n; i++, buf += unit) {
+        __builtin_prefetch(buf + unit);
+        if (select_accel_fn(buf, unit) != zero) {
+            break;
+        }
+    }
+    return i;
+}
@@ -169,7 +169,7 @@ Coroutine *qemu_coroutine_new(void)
 
     co = g_malloc0(sizeof(*co));
     co->stack_size = COROUTINE_STACK_SIZE;
-    co->stack = qemu_alloc_stack(&co->stack_size);
+    co->stack = qemu_coroutine_alloc_stack(&co->stack_size);
     co->base.entry_arg = &old_env; /* stash away our jmp_buf */
 
     coTS = coroutine_get_thread_state();
@@ -266,7 +266,7 @@ void qemu_coroutine_delete(Coroutine *co_)
 {
     CoroutineSigAltStack *co = DO_UPCAST(CoroutineSigAltStack, base, co_);
 
-    qemu_free_stack(co->stack, co->stack_size);
+    qemu_coroutine_free_stack(co->stack, co->stack_size);
     g_free(co);
 }
 
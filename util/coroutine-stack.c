@@ -0,0 +1,155 @@
+/*
+ * Coroutine stack allocation
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ * Coroutine stacks are carved from arenas of COROUTINE_STACK_ARENA_SLOTS
+ * stacks, so that creating a coroutine needs neither mmap(2) nor mprotect(2).
+ * Each stack keeps a guard page below it, like qemu_alloc_stack().
+ *
+ * When a coroutine is deleted its stack goes back on a free list shared by
+ * all threads.  All but the topmost page of the stack, which holds the free
+ * list entry, are handed back to the kernel so that free stacks do not add
+ * to the resident set size.  Arenas are never unmapped.
+ *
+ * Only stacks of COROUTINE_STACK_SIZE come from arenas, other sizes are
+ * passed through to qemu_alloc_stack().
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/coroutine_int.h"
+#include "qemu/lockable.h"
+#include "qemu/madvise.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "trace.h"
+
+#define COROUTINE_STACK_ARENA_SLOTS 64
+
+/* Lives at the top of a free stack */
+typedef struct FreeStack {
+    QSLIST_ENTRY(FreeStack) next;
+} FreeStack;
+
+static QemuMutex stack_lock;
+static QSLIST_HEAD(, FreeStack) free_stacks =
+    QSLIST_HEAD_INITIALIZER(free_stacks);
+static unsigned int nr_arenas;
+static unsigned int nr_stacks_in_use;
+
+static void __attribute__((__constructor__)) coroutine_stack_init(void)
+{
+    qemu_mutex_init(&stack_lock);
+}
+
+/* Size of a stack slot including its guard page, or 0 if not supported */
+static size_t stack_slot_size(void)
+{
+#ifdef CONFIG_DEBUG_STACK_USAGE
+    return 0; /* qemu_free_stack() measures the stack usage */
+#else
+    size_t pagesz = qemu_real_host_page_size();
+#ifdef _SC_THREAD_STACK_MIN
+    if (sysconf(_SC_THREAD_STACK_MIN) > COROUTINE_STACK_SIZE) {
+        return 0;
+    }
+#endif
+    return ROUND_UP(COROUTINE_STACK_SIZE, pagesz) + pagesz;
+#endif
+}
+
+static FreeStack *free_stack_from_slot(void *slot, size_t slot_size)
+{
+    return slot + slot_size - sizeof(FreeStack);
+}
+
+static void *slot_from_free_stack(FreeStack *fs, size_t slot_size)
+{
+    return (void *)fs + sizeof(FreeStack) - slot_size;
+}
+
+/* Called with stack_lock held */
+static void coroutine_stack_arena_new(size_t slot_size)
+{
+    size_t pagesz = qemu_real_host_page_size();
+    size_t size = slot_size * COROUTINE_STACK_ARENA_SLOTS;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void *arena;
+
+#if defined(MAP_STACK) && defined(__OpenBSD__)
+    /* See qemu_alloc_stack() */
+    flags |= MAP_STACK;
+#endif
+
+    arena = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (arena == MAP_FAILED) {
+        perror("failed to allocate memory for coroutine stacks");
+        abort();
+    }
+
+    for (int i = COROUTINE_STACK_ARENA_SLOTS - 1; i >= 0; i--) {
+        void *slot = arena + i * slot_size;
+
+        /* Stack grows down -- guard page at the bottom. */
+        if (mprotect(slot, pagesz, PROT_NONE) != 0) {
+            perror("failed to set up stack guard page");
+            abort();
+        }
+
+        QSLIST_INSERT_HEAD(&free_stacks,
+                           free_stack_from_slot(slot, slot_size), next);
+    }
+
+    nr_arenas++;
+    trace_coroutine_stack_arena_new(arena, size, nr_arenas, nr_stacks_in_use);
+}
+
+void *qemu_coroutine_alloc_stack(size_t *sz)
+{
+    size_t slot_size = stack_slot_size();
+    FreeStack *fs;
+
+    if (*sz != COROUTINE_STACK_SIZE || !slot_size) {
+        return qemu_alloc_stack(sz);
+    }
+
+    WITH_QEMU_LOCK_GUARD(&stack_lock) {
+        if (QSLIST_EMPTY(&free_stacks)) {
+            coroutine_stack_arena_new(slot_size);
+        }
+        fs = QSLIST_FIRST(&free_stacks);
+        QSLIST_REMOVE_HEAD(&free_stacks, next);
+        nr_stacks_in_use++;
+    }
+
+    *sz = slot_size;
+    return slot_from_free_stack(fs, slot_size);
+}
+
+void qemu_coroutine_free_stack(void *stack, size_t sz)
+{
+    size_t pagesz = qemu_real_host_page_size();
+    size_t slot_size = stack_slot_size();
+
+    if (sz != slot_size) {
+        qemu_free_stack(stack, sz);
+        return;
+    }
+
+    /* Drop the memory between the guard page and the top page */
+    qemu_madvise(stack + pagesz, slot_size - 2 * pagesz, QEMU_MADV_DONTNEED);
+
+    QEMU_LOCK_GUARD(&stack_lock);
+    QSLIST_INSERT_HEAD(&free_stacks, free_stack_from_slot(stack, slot_size),
+                       next);
+    nr_stacks_in_use--;
+}
+
+void qemu_coroutine_get_stack_stats(unsigned int *arenas,
+                                    unsigned int *in_use)
+{
+    QEMU_LOCK_GUARD(&stack_lock);
+    *arenas = nr_arenas;
+    *in_use = nr_stacks_in_use;
+}
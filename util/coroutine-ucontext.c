@@ -199,10 +199,10 @@ Coroutine *qemu_coroutine_new(void)
 
     co = g_malloc0(sizeof(*co));
     co->stack_size = COROUTINE_STACK_SIZE;
-    co->stack = qemu_alloc_stack(&co->stack_size);
+    co->stack = qemu_coroutine_alloc_stack(&co->stack_size);
 #ifdef CONFIG_SAFESTACK
     co->unsafe_stack_size = COROUTINE_STACK_SIZE;
-    co->unsafe_stack = qemu_alloc_stack(&co->unsafe_stack_size);
+    co->unsafe_stack = qemu_coroutine_alloc_stack(&co->unsafe_stack_size);
 #endif
     co->base.entry_arg = &old_env; /* stash away our jmp_buf */
 
@@ -292,9 +292,9 @@ void qemu_coroutine_delete(Coroutine *co_)
     valgrind_stack_deregister(co);
 #endif
 
-    qemu_free_stack(co->stack, co->stack_size);
+    qemu_coroutine_free_stack(co->stack, co->stack_size);
 #ifdef CONFIG_SAFESTACK
-    qemu_free_stack(co->unsafe_stack, co->unsafe_stack_size);
+    qemu_coroutine_free_stack(co->unsafe_stack, co->unsafe_stack_size);
 #endif
     g_free(co);
 }
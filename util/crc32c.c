@@ -27,6 +27,8 @@
 
 #include "qemu/osdep.h"
 #include "qemu/crc32c.h"
+#include "qemu/bswap.h"
+#include "host/cpuinfo.h"
 
 /*
  * This is the CRC-32C table
@@ -105,12 +107,103 @@ static const uint32_t crc32c_table[256] = {
 };
 
 
-uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+static uint32_t crc32c_int(uint32_t crc, const uint8_t *data,
+                           unsigned int length)
 {
     while (length--) {
         crc = crc32c_table[(crc ^ *data++) & 0xFFL] ^ (crc >> 8);
     }
-    return crc^0xffffffff;
+    return crc;
+}
+
+/*
+ * The CRC32C instructions of x86 (SSE4.2) and AArch64 (ARMv8 CRC) use the
+ * same bit-reflected polynomial as the table above, so they can be fed the
+ * data eight bytes at a time in little-endian order.
+ */
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+
+static uint32_t __attribute__((target("sse4.2")))
+crc32c_hw(uint32_t crc, const uint8_t *data, unsigned int length)
+{
+    uint64_t crc64 = crc;
+
+    for (; length >= 8; length -= 8, data += 8) {
+        crc64 = _mm_crc32_u64(crc64, ldq_le_p(data));
+    }
+    crc = crc64;
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#define HAVE_CRC32C_HW
+#elif defined(__aarch64__)
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *data,
+                          unsigned int length)
+{
+    for (; length >= 8; length -= 8, data += 8) {
+        asm(".arch_extension crc\n\t"
+            "crc32cx %w0, %w0, %x1" : "+r"(crc) : "r"(ldq_le_p(data)));
+    }
+    while (length--) {
+        asm(".arch_extension crc\n\t"
+            "crc32cb %w0, %w0, %w1" : "+r"(crc) : "r"(*data++));
+    }
+    return crc;
+}
+#define HAVE_CRC32C_HW
+#endif
+
+#ifdef HAVE_CRC32C_HW
+static unsigned used_accel;
+static uint32_t (*crc32c_accel)(uint32_t, const uint8_t *, unsigned int)
+    = crc32c_int;
+
+static unsigned __attribute__((noinline))
+select_accel_cpuinfo(unsigned info)
+{
+    /* Array is sorted in order of algorithm preference. */
+    static const struct {
+        unsigned bit;
+        uint32_t (*fn)(uint32_t, const uint8_t *, unsigned int);
+    } all[] = {
+        { CPUINFO_CRC32,  crc32c_hw },
+        { CPUINFO_ALWAYS, crc32c_int },
+    };
+
+    for (unsigned i = 0; i < ARRAY_SIZE(all); ++i) {
+        if (info & all[i].bit) {
+            crc32c_accel = all[i].fn;
+            return all[i].bit;
+        }
+    }
+    return 0;
+}
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    used_accel = select_accel_cpuinfo(cpuinfo_init());
+}
+
+bool test_crc32c_next_accel(void)
+{
+    unsigned used = select_accel_cpuinfo(cpuinfo & ~used_accel);
+    used_accel |= used;
+    return used;
+}
+#else
+#define crc32c_accel crc32c_int
+bool test_crc32c_next_accel(void)
+{
+    return false;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+{
+    return crc32c_accel(crc, data, length) ^ 0xffffffff;
 }
 
 uint32_t iov_crc32c(uint32_t crc, const struct iovec *iov, size_t iov_cnt)
@@ -25,7 +25,12 @@
  *
  * File descriptor monitoring is implemented using the following operations:
  *
- * 1. IORING_OP_POLL_ADD - adds a file descriptor to be monitored.
+ * 1. IORING_OP_POLL_ADD - adds a file descriptor to be monitored.  Where the
+ *    kernel supports it the poll is multishot (IORING_POLL_ADD_MULTI), so it
+ *    stays armed and posts a cqe each time the file descriptor becomes ready.
+ *    This includes the AioContext's own EventNotifier, so aio_notify() wakeups
+ *    do not need any sqes to be submitted either.  Otherwise it is one-shot
+ *    and re-armed after each cqe.
  * 2. IORING_OP_POLL_REMOVE - removes a file descriptor being monitored.  When
  *    the poll mask changes for a file descriptor it is first removed and then
  *    re-added with the new poll mask, so this operation is also used as part
@@ -57,6 +62,16 @@ enum {
     FDMON_IO_URING_REMOVE   = (1 << 2),
 };
 
+/* Is the request that posted @cqe still armed? */
+static inline bool cqe_has_more(struct io_uring_cqe *cqe)
+{
+#ifdef IORING_CQE_F_MORE
+    return cqe->flags & IORING_CQE_F_MORE;
+#else
+    return false;
+#endif
+}
+
 static inline int poll_events_from_pfd(int pfd_events)
 {
     return (pfd_events & G_IO_IN ? POLLIN : 0) |
@@ -144,8 +159,8 @@ static void fdmon_io_uring_update(AioContext *ctx,
         /*
          * Deletion is tricky because IORING_OP_POLL_ADD and
          * IORING_OP_POLL_REMOVE are async.  We need to wait for the original
-         * IORING_OP_POLL_ADD to complete before this handler can be freed
-         * safely.
+         * IORING_OP_POLL_ADD to complete for the last time, i.e. post a cqe
+         * without IORING_CQE_F_MORE, before this handler can be freed safely.
          *
          * It's possible that the file descriptor becomes ready and the
          * IORING_OP_POLL_ADD cqe is enqueued before IORING_OP_POLL_REMOVE is
@@ -172,6 +187,11 @@ static void add_poll_add_sqe(AioContext *ctx, AioHandler *node)
     int events = poll_events_from_pfd(node->pfd.events);
 
     io_uring_prep_poll_add(sqe, node->pfd.fd, events);
+#ifdef IORING_POLL_ADD_MULTI
+    if (ctx->fdmon_io_uring_multishot) {
+        sqe->len |= IORING_POLL_ADD_MULTI;
+    }
+#endif
     io_uring_sqe_set_data(sqe, node);
 }
 
@@ -227,6 +247,7 @@ static bool process_cqe(AioContext *ctx,
                         struct io_uring_cqe *cqe)
 {
     AioHandler *node = io_uring_cqe_get_data(cqe);
+    bool more = cqe_has_more(cqe);
     unsigned flags;
 
     /* poll_timeout and poll_remove have a zero user_data field */
@@ -234,21 +255,45 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
-    /*
-     * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we race
-     * with enqueue() here then we can safely clear the FDMON_IO_URING_REMOVE
-     * bit before IORING_OP_POLL_REMOVE is submitted.
-     */
-    flags = qatomic_fetch_and(&node->flags, ~FDMON_IO_URING_REMOVE);
-    if (flags & FDMON_IO_URING_REMOVE) {
-        QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node, node_deleted);
-        return false;
+    if (more) {
+        /*
+         * Multishot IORING_OP_POLL_ADD is still armed.  A handler being
+         * deleted waits for the final cqe, its events are of no interest.
+         */
+        if (qatomic_read(&node->flags) & FDMON_IO_URING_REMOVE) {
+            return false;
+        }
+    } else {
+        /*
+         * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we
+         * race with enqueue() here then we can safely clear the
+         * FDMON_IO_URING_REMOVE bit before IORING_OP_POLL_REMOVE is
+         * submitted.
+         */
+        flags = qatomic_fetch_and(&node->flags, ~FDMON_IO_URING_REMOVE);
+        if (flags & FDMON_IO_URING_REMOVE) {
+            QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node,
+                                  node_deleted);
+            return false;
+        }
+
+        if (cqe->res == -EINVAL && ctx->fdmon_io_uring_multishot) {
+            /* Multishot poll needs Linux 5.13, fall back to one-shot */
+            ctx->fdmon_io_uring_multishot = false;
+            add_poll_add_sqe(ctx, node);
+            return false;
+        }
     }
 
     aio_add_ready_handler(ready_list, node, pfd_events_from_poll(cqe->res));
 
-    /* IORING_OP_POLL_ADD is one-shot so we must re-arm it */
-    add_poll_add_sqe(ctx, node);
+    /*
+     * One-shot IORING_OP_POLL_ADD must be re-armed, and so must multishot
+     * IORING_OP_POLL_ADD if the kernel terminated it (e.g. on cq overflow).
+     */
+    if (!more) {
+        add_poll_add_sqe(ctx, node);
+    }
     return true;
 }
 
@@ -331,6 +376,11 @@ bool fdmon_io_uring_setup(AioContext *ctx)
     }
 
     QSLIST_INIT(&ctx->submit_list);
+#ifdef IORING_POLL_ADD_MULTI
+    ctx->fdmon_io_uring_multishot = true;
+#else
+    ctx->fdmon_io_uring_multishot = false;
+#endif
     ctx->fdmon_ops = &fdmon_io_uring_ops;
     return true;
 }
@@ -892,6 +892,47 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
     }
 }
 
+/**
+ * hbitmap_or_into: performs dst = dst | src
+ * for bitmaps of the same size and granularity.
+ * Only visits the nonzero words of src, so it is O(dirty).
+ */
+static void hbitmap_or_into(HBitmap *dst, const HBitmap *src)
+{
+    HBitmapIter hbi;
+    unsigned long cur;
+    size_t pos;
+    int i;
+
+    hbitmap_iter_init(&hbi, src, 0);
+    for (;;) {
+        unsigned long old;
+
+        pos = hbitmap_iter_next_word(&hbi, &cur);
+        if (!cur) {
+            break;
+        }
+
+        old = dst->levels[HBITMAP_LEVELS - 1][pos];
+        if ((old | cur) == old) {
+            continue;
+        }
+        dst->levels[HBITMAP_LEVELS - 1][pos] = old | cur;
+        dst->count += ctpopl(cur & ~old);
+
+        /* Set the parent bits, stopping at the first one already set.  */
+        for (i = HBITMAP_LEVELS - 2; i >= 0; i--) {
+            unsigned long bit = 1UL << (pos & (BITS_PER_LONG - 1));
+
+            pos >>= BITS_PER_LEVEL;
+            if (dst->levels[i][pos] & bit) {
+                break;
+            }
+            dst->levels[i][pos] |= bit;
+        }
+    }
+}
+
 /**
  * Given HBitmaps A and B, let R := A (BITOR) B.
  * Bitmaps A and B will not be modified,
@@ -929,11 +970,20 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
         return;
     }
 
+    assert(a->size == b->size);
+
+    /* Merging in place only needs to visit the dirty words of the source. */
+    if (result == a) {
+        hbitmap_or_into(result, b);
+        return;
+    }
+    if (result == b) {
+        hbitmap_or_into(result, a);
+        return;
+    }
+
     /* This merge is O(size), as BITS_PER_LONG and HBITMAP_LEVELS are constant.
-     * It may be possible to improve running times for sparsely populated maps
-     * by using hbitmap_iter_next, but this is suboptimal for dense maps.
      */
-    assert(a->size == b->size);
     for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
         for (j = 0; j < a->sizes[i]; j++) {
             result->levels[i][j] = a->levels[i][j] | b->levels[i][j];
@@ -26,6 +26,14 @@ size_t iov_from_buf_full(const struct iovec *iov, unsigned int iov_cnt,
 {
     size_t done;
     unsigned int i;
+
+    /* Most requests fall entirely within the first element */
+    if (iov_cnt && offset < iov[0].iov_len &&
+        bytes <= iov[0].iov_len - offset) {
+        memcpy(iov[0].iov_base + offset, buf, bytes);
+        return bytes;
+    }
+
     for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
         if (offset < iov[i].iov_len) {
             size_t len = MIN(iov[i].iov_len - offset, bytes - done);
@@ -45,6 +53,13 @@ size_t iov_to_buf_full(const struct iovec *iov, const unsigned int iov_cnt,
 {
     size_t done;
     unsigned int i;
+
+    if (iov_cnt && offset < iov[0].iov_len &&
+        bytes <= iov[0].iov_len - offset) {
+        memcpy(buf, iov[0].iov_base + offset, bytes);
+        return bytes;
+    }
+
     for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
         if (offset < iov[i].iov_len) {
             size_t len = MIN(iov[i].iov_len - offset, bytes - done);
@@ -64,6 +79,13 @@ size_t iov_memset(const struct iovec *iov, const unsigned int iov_cnt,
 {
     size_t done;
     unsigned int i;
+
+    if (iov_cnt && offset < iov[0].iov_len &&
+        bytes <= iov[0].iov_len - offset) {
+        memset(iov[0].iov_base + offset, fillc, bytes);
+        return bytes;
+    }
+
     for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
         if (offset < iov[i].iov_len) {
             size_t len = MIN(iov[i].iov_len - offset, bytes - done);
@@ -90,6 +112,9 @@ size_t iov_size(const struct iovec *iov, const unsigned int iov_cnt)
     return len;
 }
 
+/* iov_send_recv() copies up to this many elements on the stack */
+#define IOV_SEND_RECV_STACK_IOV 16
+
 /* helper function for iov_send_recv() */
 static ssize_t
 do_send_recv(int sockfd, struct iovec *iov, unsigned iov_cnt, bool do_send)
@@ -149,13 +174,19 @@ ssize_t iov_send_recv(int sockfd, const struct iovec *_iov, unsigned iov_cnt,
     ssize_t ret;
     size_t orig_len, tail;
     unsigned niov;
+    struct iovec stack_iov[IOV_SEND_RECV_STACK_IOV];
+    g_autofree struct iovec *heap_iov = NULL;
     struct iovec *local_iov, *iov;
 
     if (bytes <= 0) {
         return 0;
     }
 
-    local_iov = g_new0(struct iovec, iov_cnt);
+    if (iov_cnt <= ARRAY_SIZE(stack_iov)) {
+        local_iov = stack_iov;
+    } else {
+        local_iov = heap_iov = g_new0(struct iovec, iov_cnt);
+    }
     iov_copy(local_iov, iov_cnt, _iov, iov_cnt, offset, bytes);
     offset = 0;
     iov = local_iov;
@@ -205,7 +236,6 @@ ssize_t iov_send_recv(int sockfd, const struct iovec *_iov, unsigned iov_cnt,
 
         if (ret < 0) {
             assert(errno != EINTR);
-            g_free(local_iov);
             if (errno == EAGAIN && total > 0) {
                 return total;
             }
@@ -224,7 +254,6 @@ ssize_t iov_send_recv(int sockfd, const struct iovec *_iov, unsigned iov_cnt,
         bytes -= ret;
     }
 
-    g_free(local_iov);
     return total;
 }
 
@@ -292,14 +321,23 @@ void qemu_iovec_init_external(QEMUIOVector *qiov, struct iovec *iov, int niov)
         qiov->size += iov[i].iov_len;
 }
 
-void qemu_iovec_add(QEMUIOVector *qiov, void *base, size_t len)
+/*
+ * Make room for at least @n more elements, growing geometrically so that
+ * repeated calls stay amortized O(1) per element.
+ */
+static void qemu_iovec_reserve(QEMUIOVector *qiov, int n)
 {
     assert(qiov->nalloc != -1);
 
-    if (qiov->niov == qiov->nalloc) {
-        qiov->nalloc = 2 * qiov->nalloc + 1;
+    if (qiov->niov + n > qiov->nalloc) {
+        qiov->nalloc = MAX(2 * qiov->nalloc + 1, qiov->niov + n);
         qiov->iov = g_renew(struct iovec, qiov->iov, qiov->nalloc);
     }
+}
+
+void qemu_iovec_add(QEMUIOVector *qiov, void *base, size_t len)
+{
+    qemu_iovec_reserve(qiov, 1);
     qiov->iov[qiov->niov].iov_base = base;
     qiov->iov[qiov->niov].iov_len = len;
     qiov->size += len;
@@ -320,13 +358,27 @@ size_t qemu_iovec_concat_iov(QEMUIOVector *dst,
                              struct iovec *src_iov, unsigned int src_cnt,
                              size_t soffset, size_t sbytes)
 {
-    int i;
-    size_t done;
+    int i, n;
+    size_t done, skip;
 
     if (!sbytes) {
         return 0;
     }
     assert(dst->nalloc != -1);
+
+    /* Count the elements to be added, so that dst is grown at most once */
+    for (i = 0, n = 0, done = 0, skip = soffset;
+         done < sbytes && i < src_cnt; i++) {
+        if (skip < src_iov[i].iov_len) {
+            done += MIN(src_iov[i].iov_len - skip, sbytes - done);
+            skip = 0;
+            n++;
+        } else {
+            skip -= src_iov[i].iov_len;
+        }
+    }
+    qemu_iovec_reserve(dst, n);
+
     for (i = 0, done = 0; done < sbytes && i < src_cnt; i++) {
         if (soffset < src_iov[i].iov_len) {
             size_t len = MIN(src_iov[i].iov_len - soffset, sbytes - done);
@@ -600,6 +652,7 @@ void qemu_iovec_clone(QEMUIOVector *dest, const QEMUIOVector *src, void *buf)
 
     /* Sort by source iovec index and build destination iovec */
     qsort(sortelems, src->niov, sizeof(sortelems[0]), sortelem_cmp_src_index);
+    qemu_iovec_reserve(dest, src->niov);
     for (i = 0; i < src->niov; i++) {
         qemu_iovec_add(dest, sortelems[i].dest_base, src->iov[i].iov_len);
     }
@@ -658,6 +658,13 @@ int qemu_thread_get_affinity(QemuThread *thread, unsigned long **host_cpus,
 #endif
 }
 
+int qemu_thread_set_scheduler(QemuThread *thread, int policy, int priority)
+{
+    struct sched_param param = { .sched_priority = priority };
+
+    return pthread_setschedparam(thread->thread, policy, &param);
+}
+
 void qemu_thread_get_self(QemuThread *thread)
 {
     thread->thread = pthread_self();
@@ -519,6 +519,11 @@ int qemu_thread_get_affinity(QemuThread *thread, unsigned long **host_cpus,
     return -ENOSYS;
 }
 
+int qemu_thread_set_scheduler(QemuThread *thread, int policy, int priority)
+{
+    return -ENOSYS;
+}
+
 void qemu_thread_get_self(QemuThread *thread)
 {
     thread->data = qemu_thread_data;
@@ -14,7 +14,13 @@
  * condition variables. Note that not all related functions are intercepted;
  * instead we profile only those functions that can have a performance impact,
  * either due to blocking (e.g. cond_wait, mutex_lock) or cache line
- * contention (e.g. mutex_lock, mutex_trylock).
+ * contention (e.g. mutex_lock, mutex_trylock).  For the BQL, the time it is
+ * held is profiled as well, attributed to the call site that took it.
+ *
+ * To keep the overhead low enough to leave the profiler on, it can sample
+ * one in every N operations on average.  Sampled operations are weighted
+ * by N, so that reports estimate the totals.  Each entry also keeps a
+ * histogram of the durations, in power-of-two buckets.
  *
  * QSP's design focuses on speed and scalability. This is achieved
  * by having threads do their profiling entirely on thread-local data.
@@ -70,6 +76,7 @@ enum QSPType {
     QSP_BQL_MUTEX,
     QSP_REC_MUTEX,
     QSP_CONDVAR,
+    QSP_BQL_HOLD,
 };
 
 struct QSPCallSite {
@@ -85,10 +92,22 @@ struct QSPEntry {
     const QSPCallSite *callsite;
     aligned_uint64_t n_acqs;
     aligned_uint64_t ns;
+    aligned_uint64_t hist[QSP_HIST_BUCKETS];
     unsigned int n_objs; /* count of coalesced objs; only used for reporting */
 };
 typedef struct QSPEntry QSPEntry;
 
+/* The BQL as held by the current thread, if its acquisition was sampled */
+struct QSPBQLHold {
+    const void *obj;
+    const char *file;
+    int line;
+    unsigned int weight;
+    unsigned int generation;
+    int64_t t0;
+};
+typedef struct QSPBQLHold QSPBQLHold;
+
 struct QSPSnapshot {
     struct rcu_head rcu;
     struct qht ht;
@@ -107,6 +126,18 @@ static size_t qsp_qemu_path_len;
 /* the address of qsp_thread gives us a unique 'thread ID' */
 static __thread int qsp_thread;
 
+/* profile one in every qsp_sample_period operations, on average */
+static unsigned int qsp_sample_period = 1;
+static __thread unsigned int qsp_sample_countdown;
+static __thread uint32_t qsp_sample_rand;
+
+/*
+ * Bumped by qsp_enable(), so that a BQL hold that started before the
+ * profiler was last disabled is not mistaken for a current one.
+ */
+static unsigned int qsp_generation;
+static __thread QSPBQLHold qsp_bql_hold;
+
 /*
  * Call sites are the same for all threads, so we track them in a separate hash
  * table to save memory.
@@ -122,9 +153,11 @@ static const char * const qsp_typenames[] = {
     [QSP_BQL_MUTEX] = "BQL mutex",
     [QSP_REC_MUTEX] = "rec_mutex",
     [QSP_CONDVAR]   = "condvar",
+    [QSP_BQL_HOLD]  = "BQL held",
 };
 
 QemuMutexLockFunc bql_mutex_lock_func = qemu_mutex_lock_impl;
+QemuMutexUnlockFunc bql_mutex_unlock_func = qemu_mutex_unlock_impl;
 QemuMutexLockFunc qemu_mutex_lock_func = qemu_mutex_lock_impl;
 QemuMutexTrylockFunc qemu_mutex_trylock_func = qemu_mutex_trylock_impl;
 QemuRecMutexLockFunc qemu_rec_mutex_lock_func = qemu_rec_mutex_lock_impl;
@@ -340,54 +373,109 @@ static QSPEntry *qsp_entry_get(const void *obj, const char *file, int line,
     return qsp_entry_find(&qsp_ht, &orig, hash);
 }
 
+/*
+ * Decide whether to profile the current operation.  If so, return the
+ * number of operations that it stands for; otherwise return 0.
+ */
+static inline unsigned int qsp_sample(void)
+{
+    unsigned int period = qatomic_read(&qsp_sample_period);
+    uint32_t x;
+
+    if (likely(period <= 1)) {
+        return 1;
+    }
+    if (qsp_sample_countdown) {
+        qsp_sample_countdown--;
+        return 0;
+    }
+
+    /*
+     * Pick the distance to the next sample at random, so that periodic
+     * patterns in lock usage do not bias the estimate.  Any non-zero
+     * seed works for xorshift, so start from the thread's address.
+     */
+    x = qsp_sample_rand;
+    if (unlikely(!x)) {
+        x = (uintptr_t)&qsp_thread | 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    qsp_sample_rand = x;
+    qsp_sample_countdown = x % (2 * period - 1);
+    return period;
+}
+
+static inline unsigned int qsp_hist_bucket(int64_t delta)
+{
+    if (delta < (1 << QSP_HIST_SHIFT)) {
+        return 0;
+    }
+    return MIN(63 - clz64(delta) - QSP_HIST_SHIFT + 1, QSP_HIST_BUCKETS - 1);
+}
+
 /*
  * @e is in the global hash table; it is only written to by the current thread,
  * so we write to it atomically (as in "write once") to prevent torn reads.
  */
-static inline void do_qsp_entry_record(QSPEntry *e, int64_t delta, bool acq)
+static inline void do_qsp_entry_record(QSPEntry *e, int64_t delta, bool acq,
+                                       unsigned int weight)
 {
-    qatomic_set_u64(&e->ns, e->ns + delta);
+    unsigned int b = qsp_hist_bucket(delta);
+
+    qatomic_set_u64(&e->ns, e->ns + delta * weight);
     if (acq) {
-        qatomic_set_u64(&e->n_acqs, e->n_acqs + 1);
+        qatomic_set_u64(&e->n_acqs, e->n_acqs + weight);
+        qatomic_set_u64(&e->hist[b], e->hist[b] + weight);
     }
 }
 
-static inline void qsp_entry_record(QSPEntry *e, int64_t delta)
+static inline void qsp_entry_record(QSPEntry *e, int64_t delta,
+                                    unsigned int weight)
 {
-    do_qsp_entry_record(e, delta, true);
+    do_qsp_entry_record(e, delta, true, weight);
 }
 
 #define QSP_GEN_VOID(type_, qsp_t_, func_, impl_)                       \
     static void func_(type_ *obj, const char *file, int line)           \
     {                                                                   \
+        unsigned int weight = qsp_sample();                             \
         QSPEntry *e;                                                    \
         int64_t t0, t1;                                                 \
                                                                         \
+        if (!weight) {                                                  \
+            impl_(obj, file, line);                                     \
+            return;                                                     \
+        }                                                               \
         t0 = get_clock();                                               \
         impl_(obj, file, line);                                         \
         t1 = get_clock();                                               \
                                                                         \
         e = qsp_entry_get(obj, file, line, qsp_t_);                     \
-        qsp_entry_record(e, t1 - t0);                                   \
+        qsp_entry_record(e, t1 - t0, weight);                           \
     }
 
 #define QSP_GEN_RET1(type_, qsp_t_, func_, impl_)                       \
     static int func_(type_ *obj, const char *file, int line)            \
     {                                                                   \
+        unsigned int weight = qsp_sample();                             \
         QSPEntry *e;                                                    \
         int64_t t0, t1;                                                 \
         int err;                                                        \
                                                                         \
+        if (!weight) {                                                  \
+            return impl_(obj, file, line);                              \
+        }                                                               \
         t0 = get_clock();                                               \
         err = impl_(obj, file, line);                                   \
         t1 = get_clock();                                               \
                                                                         \
         e = qsp_entry_get(obj, file, line, qsp_t_);                     \
-        do_qsp_entry_record(e, t1 - t0, !err);                          \
+        do_qsp_entry_record(e, t1 - t0, !err, weight);                  \
         return err;                                                     \
     }
 
-QSP_GEN_VOID(QemuMutex, QSP_BQL_MUTEX, qsp_bql_mutex_lock, qemu_mutex_lock_impl)
 QSP_GEN_VOID(QemuMutex, QSP_MUTEX, qsp_mutex_lock, qemu_mutex_lock_impl)
 QSP_GEN_RET1(QemuMutex, QSP_MUTEX, qsp_mutex_trylock, qemu_mutex_trylock_impl)
 
@@ -399,34 +487,118 @@ QSP_GEN_RET1(QemuRecMutex, QSP_REC_MUTEX, qsp_rec_mutex_trylock,
 #undef QSP_GEN_RET1
 #undef QSP_GEN_VOID
 
+static void qsp_bql_hold_start(const void *obj, const char *file, int line,
+                               unsigned int weight, int64_t t0)
+{
+    qsp_bql_hold = (QSPBQLHold) {
+        .obj = obj,
+        .file = file,
+        .line = line,
+        .weight = weight,
+        .generation = qatomic_read(&qsp_generation),
+        .t0 = t0,
+    };
+}
+
+static void qsp_bql_hold_end(int64_t t1)
+{
+    QSPBQLHold *hold = &qsp_bql_hold;
+    QSPEntry *e;
+
+    if (!hold->t0) {
+        return;
+    }
+    if (hold->generation == qatomic_read(&qsp_generation)) {
+        e = qsp_entry_get(hold->obj, hold->file, hold->line, QSP_BQL_HOLD);
+        qsp_entry_record(e, t1 - hold->t0, hold->weight);
+    }
+    hold->t0 = 0;
+}
+
+static void qsp_bql_mutex_lock(QemuMutex *mutex, const char *file, int line)
+{
+    unsigned int weight = qsp_sample();
+    QSPEntry *e;
+    int64_t t0, t1;
+
+    if (!weight) {
+        qemu_mutex_lock_impl(mutex, file, line);
+        qsp_bql_hold.t0 = 0;
+        return;
+    }
+    t0 = get_clock();
+    qemu_mutex_lock_impl(mutex, file, line);
+    t1 = get_clock();
+
+    e = qsp_entry_get(mutex, file, line, QSP_BQL_MUTEX);
+    qsp_entry_record(e, t1 - t0, weight);
+    qsp_bql_hold_start(mutex, file, line, weight, t1);
+}
+
+static void qsp_bql_mutex_unlock(QemuMutex *mutex, const char *file, int line)
+{
+    qemu_mutex_unlock_impl(mutex, file, line);
+    qsp_bql_hold_end(get_clock());
+}
+
 static void
 qsp_cond_wait(QemuCond *cond, QemuMutex *mutex, const char *file, int line)
 {
+    unsigned int weight = qsp_sample();
+    bool bql_held = qsp_bql_hold.t0 && qsp_bql_hold.obj == mutex;
     QSPEntry *e;
     int64_t t0, t1;
 
+    if (!weight && !bql_held) {
+        qemu_cond_wait_impl(cond, mutex, file, line);
+        return;
+    }
+
+    /* The BQL is not held while waiting; resume the hold from here */
     t0 = get_clock();
+    if (bql_held) {
+        qsp_bql_hold_end(t0);
+    }
     qemu_cond_wait_impl(cond, mutex, file, line);
     t1 = get_clock();
+    if (bql_held) {
+        qsp_bql_hold_start(mutex, file, line, qsp_bql_hold.weight, t1);
+    }
 
-    e = qsp_entry_get(cond, file, line, QSP_CONDVAR);
-    qsp_entry_record(e, t1 - t0);
+    if (weight) {
+        e = qsp_entry_get(cond, file, line, QSP_CONDVAR);
+        qsp_entry_record(e, t1 - t0, weight);
+    }
 }
 
 static bool
 qsp_cond_timedwait(QemuCond *cond, QemuMutex *mutex, int ms,
                    const char *file, int line)
 {
+    unsigned int weight = qsp_sample();
+    bool bql_held = qsp_bql_hold.t0 && qsp_bql_hold.obj == mutex;
     QSPEntry *e;
     int64_t t0, t1;
     bool ret;
 
+    if (!weight && !bql_held) {
+        return qemu_cond_timedwait_impl(cond, mutex, ms, file, line);
+    }
+
     t0 = get_clock();
+    if (bql_held) {
+        qsp_bql_hold_end(t0);
+    }
     ret = qemu_cond_timedwait_impl(cond, mutex, ms, file, line);
     t1 = get_clock();
+    if (bql_held) {
+        qsp_bql_hold_start(mutex, file, line, qsp_bql_hold.weight, t1);
+    }
 
-    e = qsp_entry_get(cond, file, line, QSP_CONDVAR);
-    qsp_entry_record(e, t1 - t0);
+    if (weight) {
+        e = qsp_entry_get(cond, file, line, QSP_CONDVAR);
+        qsp_entry_record(e, t1 - t0, weight);
+    }
     return ret;
 }
 
@@ -435,11 +607,23 @@ bool qsp_is_enabled(void)
     return qatomic_read(&qemu_mutex_lock_func) == qsp_mutex_lock;
 }
 
+unsigned int qsp_get_sample_period(void)
+{
+    return qatomic_read(&qsp_sample_period);
+}
+
+void qsp_set_sample_period(unsigned int period)
+{
+    qatomic_set(&qsp_sample_period, MAX(period, 1));
+}
+
 void qsp_enable(void)
 {
+    qatomic_inc(&qsp_generation);
     qatomic_set(&qemu_mutex_lock_func, qsp_mutex_lock);
     qatomic_set(&qemu_mutex_trylock_func, qsp_mutex_trylock);
     qatomic_set(&bql_mutex_lock_func, qsp_bql_mutex_lock);
+    qatomic_set(&bql_mutex_unlock_func, qsp_bql_mutex_unlock);
     qatomic_set(&qemu_rec_mutex_lock_func, qsp_rec_mutex_lock);
     qatomic_set(&qemu_rec_mutex_trylock_func, qsp_rec_mutex_trylock);
     qatomic_set(&qemu_cond_wait_func, qsp_cond_wait);
@@ -451,6 +635,7 @@ void qsp_disable(void)
     qatomic_set(&qemu_mutex_lock_func, qemu_mutex_lock_impl);
     qatomic_set(&qemu_mutex_trylock_func, qemu_mutex_trylock_impl);
     qatomic_set(&bql_mutex_lock_func, qemu_mutex_lock_impl);
+    qatomic_set(&bql_mutex_unlock_func, qemu_mutex_unlock_impl);
     qatomic_set(&qemu_rec_mutex_lock_func, qemu_rec_mutex_lock_impl);
     qatomic_set(&qemu_rec_mutex_trylock_func, qemu_rec_mutex_trylock_impl);
     qatomic_set(&qemu_cond_wait_func, qemu_cond_wait_impl);
@@ -540,6 +725,9 @@ static void qsp_aggregate(void *p, uint32_t h, void *up)
      */
     agg->ns += qatomic_read_u64(&e->ns);
     agg->n_acqs += qatomic_read_u64(&e->n_acqs);
+    for (int i = 0; i < QSP_HIST_BUCKETS; i++) {
+        agg->hist[i] += qatomic_read_u64(&e->hist[i]);
+    }
 }
 
 static void qsp_iter_diff(void *p, uint32_t hash, void *htp)
@@ -557,6 +745,9 @@ static void qsp_iter_diff(void *p, uint32_t hash, void *htp)
 
     new->n_acqs -= old->n_acqs;
     new->ns -= old->ns;
+    for (int i = 0; i < QSP_HIST_BUCKETS; i++) {
+        new->hist[i] -= old->hist[i];
+    }
 
     /* No point in reporting an empty entry */
     if (new->n_acqs == 0 && new->ns == 0) {
@@ -589,6 +780,9 @@ static void qsp_iter_callsite_coalesce(void *p, uint32_t h, void *htp)
     }
     e->ns += old->ns;
     e->n_acqs += old->n_acqs;
+    for (int i = 0; i < QSP_HIST_BUCKETS; i++) {
+        e->hist[i] += old->hist[i];
+    }
 }
 
 static void qsp_ht_delete(void *p, uint32_t h, void *htp)
@@ -658,19 +852,8 @@ static char *qsp_at(const QSPCallSite *callsite)
     return g_string_free(s, FALSE);
 }
 
-struct QSPReportEntry {
-    const void *obj;
-    char *callsite_at;
-    const char *typename;
-    double time_s;
-    double ns_avg;
-    uint64_t n_acqs;
-    unsigned int n_objs;
-};
-typedef struct QSPReportEntry QSPReportEntry;
-
 struct QSPReport {
-    QSPReportEntry *entries;
+    QSPStat *entries;
     size_t n_entries;
     size_t max_n_entries;
 };
@@ -680,7 +863,7 @@ static gboolean qsp_tree_report(gpointer key, gpointer value, gpointer udata)
 {
     const QSPEntry *e = key;
     QSPReport *report = udata;
-    QSPReportEntry *entry;
+    QSPStat *entry;
 
     if (report->n_entries == report->max_n_entries) {
         return TRUE;
@@ -692,13 +875,39 @@ static gboolean qsp_tree_report(gpointer key, gpointer value, gpointer udata)
     entry->n_objs = e->n_objs;
     entry->callsite_at = qsp_at(e->callsite);
     entry->typename = qsp_typenames[e->callsite->type];
-    entry->time_s = e->ns * 1e-9;
+    entry->ns = e->ns;
     entry->n_acqs = e->n_acqs;
-    entry->ns_avg = e->n_acqs ? e->ns / e->n_acqs : 0;
+    memcpy(entry->hist, e->hist, sizeof(entry->hist));
     return FALSE;
 }
 
-static void pr_report(const QSPReport *rep)
+/* Upper bound of histogram bucket @i, in nanoseconds */
+uint64_t qsp_hist_bucket_limit(unsigned int i)
+{
+    return i < QSP_HIST_BUCKETS - 1 ? 1ULL << (QSP_HIST_SHIFT + i) : UINT64_MAX;
+}
+
+static void pr_hist(GString *s, const QSPStat *e)
+{
+    g_string_append(s, "    histogram:");
+    for (int i = 0; i < QSP_HIST_BUCKETS; i++) {
+        if (!e->hist[i]) {
+            continue;
+        }
+        if (i < QSP_HIST_BUCKETS - 1) {
+            g_string_append_printf(s, "  <%" PRIu64 "us: %" PRIu64,
+                                   qsp_hist_bucket_limit(i) / 1000,
+                                   e->hist[i]);
+        } else {
+            g_string_append_printf(s, "  >=%" PRIu64 "us: %" PRIu64,
+                                   qsp_hist_bucket_limit(i - 1) / 1000,
+                                   e->hist[i]);
+        }
+    }
+    g_string_append_c(s, '\n');
+}
+
+static void pr_report(const QSPReport *rep, bool histogram)
 {
     char *dashes;
     size_t max_len = 0;
@@ -709,7 +918,7 @@ static void pr_report(const QSPReport *rep)
 
     /* find out the maximum length of all 'callsite' fields */
     for (i = 0; i < rep->n_entries; i++) {
-        const QSPReportEntry *e = &rep->entries[i];
+        const QSPStat *e = &rep->entries[i];
         size_t len = strlen(e->callsite_at);
 
         if (len > max_len) {
@@ -721,7 +930,7 @@ static void pr_report(const QSPReport *rep)
     /* white space to leave to the right of "Call site" */
     callsite_rspace = callsite_len - strlen("Call site");
 
-    qemu_printf("Type               Object  Call site%*s  Wait Time (s)  "
+    qemu_printf("Type               Object  Call site%*s  Wait/Hold (s)  "
                 "       Count  Average (us)\n", callsite_rspace, "");
 
     /* build a horizontal rule with dashes */
@@ -732,7 +941,8 @@ static void pr_report(const QSPReport *rep)
     qemu_printf("%s\n", dashes);
 
     for (i = 0; i < rep->n_entries; i++) {
-        const QSPReportEntry *e = &rep->entries[i];
+        const QSPStat *e = &rep->entries[i];
+        double ns_avg = e->n_acqs ? e->ns / e->n_acqs : 0;
         GString *s = g_string_new(NULL);
 
         g_string_append_printf(s, "%-9s  ", e->typename);
@@ -744,7 +954,10 @@ static void pr_report(const QSPReport *rep)
         g_string_append_printf(s, "  %s%*s  %13.5f  %12" PRIu64 "  %12.2f\n",
                                e->callsite_at,
                                callsite_len - (int)strlen(e->callsite_at), "",
-                               e->time_s, e->n_acqs, e->ns_avg * 1e-3);
+                               e->ns * 1e-9, e->n_acqs, ns_avg * 1e-3);
+        if (histogram) {
+            pr_hist(s, e);
+        }
         qemu_printf("%s", s->str);
         g_string_free(s, TRUE);
     }
@@ -753,12 +966,28 @@ static void pr_report(const QSPReport *rep)
     g_free(dashes);
 }
 
+static void report_init(QSPReport *rep, size_t max, enum QSPSortBy sort_by,
+                        bool callsite_coalesce)
+{
+    GTree *tree = g_tree_new_full(qsp_tree_cmp, &sort_by, g_free, NULL);
+
+    qsp_init();
+
+    rep->entries = g_new0(QSPStat, max);
+    rep->n_entries = 0;
+    rep->max_n_entries = max;
+
+    qsp_mktree(tree, callsite_coalesce);
+    g_tree_foreach(tree, qsp_tree_report, rep);
+    g_tree_destroy(tree);
+}
+
 static void report_destroy(QSPReport *rep)
 {
     size_t i;
 
     for (i = 0; i < rep->n_entries; i++) {
-        QSPReportEntry *e = &rep->entries[i];
+        QSPStat *e = &rep->entries[i];
 
         g_free(e->callsite_at);
     }
@@ -766,22 +995,25 @@ static void report_destroy(QSPReport *rep)
 }
 
 void qsp_report(size_t max, enum QSPSortBy sort_by,
-                bool callsite_coalesce)
+                bool callsite_coalesce, bool histogram)
 {
-    GTree *tree = g_tree_new_full(qsp_tree_cmp, &sort_by, g_free, NULL);
     QSPReport rep;
 
-    qsp_init();
-
-    rep.entries = g_new0(QSPReportEntry, max);
-    rep.n_entries = 0;
-    rep.max_n_entries = max;
+    report_init(&rep, max, sort_by, callsite_coalesce);
+    pr_report(&rep, histogram);
+    report_destroy(&rep);
+}
 
-    qsp_mktree(tree, callsite_coalesce);
-    g_tree_foreach(tree, qsp_tree_report, &rep);
-    g_tree_destroy(tree);
+void qsp_foreach(size_t max, enum QSPSortBy sort_by, bool callsite_coalesce,
+                 QSPStatFunc *fn, void *opaque)
+{
+    QSPReport rep;
+    size_t i;
 
-    pr_report(&rep);
+    report_init(&rep, max, sort_by, callsite_coalesce);
+    for (i = 0; i < rep.n_entries; i++) {
+        fn(&rep.entries[i], opaque);
+    }
     report_destroy(&rep);
 }
 
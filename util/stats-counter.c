@@ -0,0 +1,93 @@
+/*
+ * Always-on counters for hot paths
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/lockable.h"
+#include "qemu/thread.h"
+#include "qemu/stats-counter.h"
+
+QEMU_DEFINE_CO_TLS(StatsCounterThread *, stats_counter_thread)
+
+/* Filled in by constructors, so only atomics are used to register */
+static StatsCounter *counters[STATS_COUNTER_MAX];
+static unsigned int nr_counters;
+
+/* Protects threads and the counts of threads that have exited */
+static QemuMutex stats_counter_lock;
+static QLIST_HEAD(, StatsCounterThread) threads =
+    QLIST_HEAD_INITIALIZER(threads);
+static uint64_t exited_counts[STATS_COUNTER_MAX];
+
+static void __attribute__((__constructor__)) stats_counter_init(void)
+{
+    qemu_mutex_init(&stats_counter_lock);
+}
+
+void stats_counter_register(StatsCounter *counter)
+{
+    unsigned int index = qatomic_fetch_inc(&nr_counters);
+
+    if (index >= STATS_COUNTER_MAX) {
+        fprintf(stderr, "too many stats counters, increase "
+                "STATS_COUNTER_MAX\n");
+        abort();
+    }
+    counter->index = index;
+    qatomic_store_release(&counters[index], counter);
+}
+
+static void stats_counter_thread_exit(Notifier *n, void *unused)
+{
+    StatsCounterThread *t = container_of(n, StatsCounterThread,
+                                         exit_notifier);
+
+    WITH_QEMU_LOCK_GUARD(&stats_counter_lock) {
+        for (int i = 0; i < STATS_COUNTER_MAX; i++) {
+            exited_counts[i] += stat64_get(&t->counts[i]);
+        }
+        QLIST_REMOVE(t, next);
+    }
+    set_stats_counter_thread(NULL);
+    g_free(t);
+}
+
+StatsCounterThread *stats_counter_thread_new(void)
+{
+    StatsCounterThread *t = g_new0(StatsCounterThread, 1);
+
+    WITH_QEMU_LOCK_GUARD(&stats_counter_lock) {
+        QLIST_INSERT_HEAD(&threads, t, next);
+    }
+    t->exit_notifier.notify = stats_counter_thread_exit;
+    qemu_thread_atexit_add(&t->exit_notifier);
+    set_stats_counter_thread(t);
+    return t;
+}
+
+void stats_counter_foreach(StatsCounterFunc *fn, void *opaque)
+{
+    unsigned int n = MIN(qatomic_read(&nr_counters), STATS_COUNTER_MAX);
+    uint64_t totals[STATS_COUNTER_MAX];
+    StatsCounterThread *t;
+
+    WITH_QEMU_LOCK_GUARD(&stats_counter_lock) {
+        memcpy(totals, exited_counts, sizeof(totals));
+        QLIST_FOREACH(t, &threads, next) {
+            for (int i = 0; i < n; i++) {
+                totals[i] += stat64_get(&t->counts[i]);
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        StatsCounter *counter = qatomic_load_acquire(&counters[i]);
+
+        /* Skip a counter that is still being registered */
+        if (counter) {
+            fn(counter->name, totals[i], opaque);
+        }
+    }
+}
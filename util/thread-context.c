@@ -14,6 +14,7 @@
 #include "qemu/thread-context.h"
 #include "qapi/error.h"
 #include "qapi/qapi-builtin-visit.h"
+#include "qapi/qapi-types-qom.h"
 #include "qapi/visitor.h"
 #include "qemu/config-file.h"
 #include "qapi/qapi-builtin-visit.h"
@@ -24,6 +25,9 @@
 #ifdef CONFIG_NUMA
 #include <numa.h>
 #endif
+#ifdef CONFIG_LINUX
+#include <sys/resource.h>
+#endif
 
 enum {
     TC_CMD_NONE = 0,
@@ -235,6 +239,151 @@ out:
 #endif
 }
 
+static int thread_context_host_sched_policy(int policy)
+{
+    switch (policy) {
+#ifndef _WIN32
+    case THREAD_SCHED_POLICY_OTHER:
+        return SCHED_OTHER;
+#ifdef SCHED_BATCH
+    case THREAD_SCHED_POLICY_BATCH:
+        return SCHED_BATCH;
+#endif
+#ifdef SCHED_IDLE
+    case THREAD_SCHED_POLICY_IDLE:
+        return SCHED_IDLE;
+#endif
+    case THREAD_SCHED_POLICY_FIFO:
+        return SCHED_FIFO;
+    case THREAD_SCHED_POLICY_RR:
+        return SCHED_RR;
+#endif
+    default:
+        return -1;
+    }
+}
+
+/*
+ * Scheduling policy and nice value are per-thread attributes that new
+ * threads inherit from their creator, so like the CPU affinity they only
+ * need to be applied to the context thread.
+ */
+static void thread_context_apply_sched(ThreadContext *tc, Error **errp)
+{
+    int policy, ret;
+
+    if (!tc->sched_set) {
+        return;
+    }
+
+    policy = thread_context_host_sched_policy(tc->sched_policy);
+    if (policy < 0) {
+        error_setg(errp, "Scheduling policy '%s' not supported by this host",
+                   ThreadSchedPolicy_str(tc->sched_policy));
+        return;
+    }
+
+    ret = qemu_thread_set_scheduler(&tc->thread, policy, tc->sched_priority);
+    if (ret) {
+        error_setg(errp, "Setting scheduling policy failed: %s",
+                   strerror(ret));
+    }
+}
+
+static void thread_context_apply_nice(ThreadContext *tc, Error **errp)
+{
+#ifdef CONFIG_LINUX
+    if (!tc->nice_set) {
+        return;
+    }
+
+    if (setpriority(PRIO_PROCESS, tc->thread_id, tc->nice)) {
+        error_setg_errno(errp, errno, "Setting nice value failed");
+    }
+#endif
+}
+
+static int thread_context_get_sched_policy(Object *obj, Error **errp)
+{
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+
+    return tc->sched_policy;
+}
+
+static void thread_context_set_sched_policy(Object *obj, int value,
+                                            Error **errp)
+{
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+
+    tc->sched_policy = value;
+    tc->sched_set = true;
+    if (tc->thread_id != -1) {
+        thread_context_apply_sched(tc, errp);
+    }
+}
+
+static void thread_context_get_sched_priority(Object *obj, Visitor *v,
+                                              const char *name, void *opaque,
+                                              Error **errp)
+{
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+
+    visit_type_uint8(v, name, &tc->sched_priority, errp);
+}
+
+static void thread_context_set_sched_priority(Object *obj, Visitor *v,
+                                              const char *name, void *opaque,
+                                              Error **errp)
+{
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+    uint8_t value;
+
+    if (!visit_type_uint8(v, name, &value, errp)) {
+        return;
+    }
+
+    tc->sched_priority = value;
+    if (tc->thread_id != -1) {
+        thread_context_apply_sched(tc, errp);
+    }
+}
+
+static void thread_context_get_nice(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+
+    visit_type_int8(v, name, &tc->nice, errp);
+}
+
+static void thread_context_set_nice(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+#ifdef CONFIG_LINUX
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+    int8_t value;
+
+    if (!visit_type_int8(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value < -20 || value > 19) {
+        error_setg(errp, "Nice value must be in range [-20, 19]");
+        return;
+    }
+
+    tc->nice = value;
+    tc->nice_set = true;
+    if (tc->thread_id != -1) {
+        thread_context_apply_nice(tc, errp);
+    }
+#else
+    error_setg(errp, "Setting the nice value is not supported by this QEMU");
+#endif
+}
+
 static void thread_context_get_thread_id(Object *obj, Visitor *v,
                                          const char *name, void *opaque,
                                          Error **errp)
@@ -247,6 +396,7 @@ static void thread_context_get_thread_id(Object *obj, Visitor *v,
 
 static void thread_context_instance_complete(UserCreatable *uc, Error **errp)
 {
+    ERRP_GUARD();
     ThreadContext *tc = THREAD_CONTEXT(uc);
     char *thread_name;
     int ret;
@@ -271,6 +421,13 @@ static void thread_context_instance_complete(UserCreatable *uc, Error **errp)
         g_free(tc->init_cpu_bitmap);
         tc->init_cpu_bitmap = NULL;
     }
+
+    if (!*errp) {
+        thread_context_apply_sched(tc, errp);
+    }
+    if (!*errp) {
+        thread_context_apply_nice(tc, errp);
+    }
 }
 
 static void thread_context_class_init(ObjectClass *oc, void *data)
@@ -286,6 +443,16 @@ static void thread_context_class_init(ObjectClass *oc, void *data)
                               thread_context_set_cpu_affinity, NULL, NULL);
     object_class_property_add(oc, "node-affinity", "int", NULL,
                               thread_context_set_node_affinity, NULL, NULL);
+    object_class_property_add_enum(oc, "sched-policy", "ThreadSchedPolicy",
+                                   &ThreadSchedPolicy_lookup,
+                                   thread_context_get_sched_policy,
+                                   thread_context_set_sched_policy);
+    object_class_property_add(oc, "sched-priority", "uint8",
+                              thread_context_get_sched_priority,
+                              thread_context_set_sched_priority, NULL, NULL);
+    object_class_property_add(oc, "nice", "int8",
+                              thread_context_get_nice,
+                              thread_context_set_nice, NULL, NULL);
 }
 
 static void thread_context_instance_init(Object *obj)
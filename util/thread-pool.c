@@ -18,14 +18,23 @@
 #include "qemu/defer-call.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
+#include "qemu/thread-context.h"
 #include "qemu/coroutine.h"
 #include "trace.h"
 #include "block/thread-pool.h"
 #include "qemu/main-loop.h"
 
+/*
+ * Requests are spread over this many queues, each with its own lock, so that
+ * workers do not all contend on one lock.  Each worker has a home queue and
+ * steals from the others when its own is empty.
+ */
+#define THREAD_POOL_NR_QUEUES 8
+
 static void do_spawn_thread(ThreadPool *pool);
 
 typedef struct ThreadPoolElement ThreadPoolElement;
+typedef struct ThreadPoolQueue ThreadPoolQueue;
 
 enum ThreadState {
     THREAD_QUEUED,
@@ -39,20 +48,27 @@ struct ThreadPoolElement {
     ThreadPoolFunc *func;
     void *arg;
 
-    /* Moving state out of THREAD_QUEUED is protected by lock.  After
+    /* Moving state out of THREAD_QUEUED is protected by queue->lock.  After
      * that, only the worker thread can write to it.  Reads and writes
      * of state and ret are ordered with memory barriers.
      */
     enum ThreadState state;
     int ret;
 
-    /* Access to this list is protected by lock.  */
+    /* Access to this list is protected by queue->lock.  */
+    ThreadPoolQueue *queue;
     QTAILQ_ENTRY(ThreadPoolElement) reqs;
 
     /* This list is only written by the thread pool's mother thread.  */
     QLIST_ENTRY(ThreadPoolElement) all;
 };
 
+struct ThreadPoolQueue {
+    QemuMutex lock;
+    QTAILQ_HEAD(, ThreadPoolElement) request_list;
+    int nr_requests; /* written with lock held, may be peeked without */
+};
+
 struct ThreadPool {
     AioContext *ctx;
     QEMUBH *completion_bh;
@@ -61,65 +77,130 @@ struct ThreadPool {
     QemuCond request_cond;
     QEMUBH *new_thread_bh;
 
+    ThreadPoolQueue queues[THREAD_POOL_NR_QUEUES];
+
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    unsigned next_queue;  /* queue for the next request */
+    int unkicked;         /* requests submitted since thread_pool_kick() */
 
-    /* The following variables are protected by lock.  */
-    QTAILQ_HEAD(, ThreadPoolElement) request_list;
+    /*
+     * The following variables are protected by lock.  cur_threads,
+     * idle_threads and max_threads may also be read without it.
+     */
     int cur_threads;
     int idle_threads;
     int new_threads;     /* backlog of threads we need to create */
     int pending_threads; /* threads created but not running yet */
     int min_threads;
     int max_threads;
+    unsigned next_home;  /* home queue of the next worker */
+    ThreadContext *thread_context; /* creates worker threads, or NULL */
 };
 
+static bool thread_pool_has_requests(ThreadPool *pool)
+{
+    for (int i = 0; i < THREAD_POOL_NR_QUEUES; i++) {
+        if (qatomic_read(&pool->queues[i].nr_requests)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Take the oldest request from the @home queue, or steal one from another
+ * queue if it is empty.  Returns NULL if there are no requests.
+ */
+static ThreadPoolElement *thread_pool_dequeue(ThreadPool *pool, unsigned home)
+{
+    for (int i = 0; i < THREAD_POOL_NR_QUEUES; i++) {
+        ThreadPoolQueue *queue =
+            &pool->queues[(home + i) % THREAD_POOL_NR_QUEUES];
+        ThreadPoolElement *req;
+
+        if (!qatomic_read(&queue->nr_requests)) {
+            continue;
+        }
+
+        qemu_mutex_lock(&queue->lock);
+        req = QTAILQ_FIRST(&queue->request_list);
+        if (req) {
+            QTAILQ_REMOVE(&queue->request_list, req, reqs);
+            qatomic_set(&queue->nr_requests, queue->nr_requests - 1);
+            req->state = THREAD_ACTIVE;
+        }
+        qemu_mutex_unlock(&queue->lock);
+
+        if (req) {
+            return req;
+        }
+    }
+    return NULL;
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPool *pool = opaque;
+    unsigned home;
 
     qemu_mutex_lock(&pool->lock);
     pool->pending_threads--;
+    home = pool->next_home++ % THREAD_POOL_NR_QUEUES;
     do_spawn_thread(pool);
 
     while (pool->cur_threads <= pool->max_threads) {
         ThreadPoolElement *req;
         int ret;
 
-        if (QTAILQ_EMPTY(&pool->request_list)) {
-            pool->idle_threads++;
-            ret = qemu_cond_timedwait(&pool->request_cond, &pool->lock, 10000);
-            pool->idle_threads--;
-            if (ret == 0 &&
-                QTAILQ_EMPTY(&pool->request_list) &&
-                pool->cur_threads > pool->min_threads) {
-                /* Timed out + no work to do + no need for warm threads = exit.  */
-                break;
-            }
-            /*
-             * Even if there was some work to do, check if there aren't
-             * too many worker threads before picking it up.
-             */
-            continue;
+        /* Busy workers only take pool->lock once they run out of work */
+        qemu_mutex_unlock(&pool->lock);
+        while (qatomic_read(&pool->cur_threads) <=
+               qatomic_read(&pool->max_threads) &&
+               (req = thread_pool_dequeue(pool, home))) {
+            ret = req->func(req->arg);
+
+            req->ret = ret;
+            /* Write ret before state.  */
+            smp_wmb();
+            req->state = THREAD_DONE;
+
+            qemu_bh_schedule(pool->completion_bh);
         }
+        qemu_mutex_lock(&pool->lock);
 
-        req = QTAILQ_FIRST(&pool->request_list);
-        QTAILQ_REMOVE(&pool->request_list, req, reqs);
-        req->state = THREAD_ACTIVE;
-        qemu_mutex_unlock(&pool->lock);
+        if (pool->cur_threads > pool->max_threads) {
+            break;
+        }
 
-        ret = req->func(req->arg);
+        qatomic_set(&pool->idle_threads, pool->idle_threads + 1);
 
-        req->ret = ret;
-        /* Write ret before state.  */
-        smp_wmb();
-        req->state = THREAD_DONE;
+        /*
+         * Write idle_threads before checking the queues.  Pairs with
+         * smp_mb() in thread_pool_kick().
+         */
+        smp_mb();
 
-        qemu_bh_schedule(pool->completion_bh);
-        qemu_mutex_lock(&pool->lock);
+        if (thread_pool_has_requests(pool)) {
+            qatomic_set(&pool->idle_threads, pool->idle_threads - 1);
+            continue;
+        }
+
+        ret = qemu_cond_timedwait(&pool->request_cond, &pool->lock, 10000);
+        qatomic_set(&pool->idle_threads, pool->idle_threads - 1);
+        if (ret == 0 &&
+            !thread_pool_has_requests(pool) &&
+            pool->cur_threads > pool->min_threads) {
+            /* Timed out + no work to do + no need for warm threads = exit.  */
+            break;
+        }
+        /*
+         * Even if there was some work to do, check if there aren't
+         * too many worker threads before picking it up.
+         */
     }
 
-    pool->cur_threads--;
+    qatomic_set(&pool->cur_threads, pool->cur_threads - 1);
     qemu_cond_signal(&pool->worker_stopped);
 
     /*
@@ -143,7 +224,14 @@ static void do_spawn_thread(ThreadPool *pool)
     pool->new_threads--;
     pool->pending_threads++;
 
-    qemu_thread_create(&t, "worker", worker_thread, pool, QEMU_THREAD_DETACHED);
+    if (pool->thread_context) {
+        thread_context_create_thread(pool->thread_context, &t, "worker",
+                                     worker_thread, pool,
+                                     QEMU_THREAD_DETACHED);
+    } else {
+        qemu_thread_create(&t, "worker", worker_thread, pool,
+                           QEMU_THREAD_DETACHED);
+    }
 }
 
 static void spawn_thread_bh_fn(void *opaque)
@@ -157,14 +245,15 @@ static void spawn_thread_bh_fn(void *opaque)
 
 static void spawn_thread(ThreadPool *pool)
 {
-    pool->cur_threads++;
+    qatomic_set(&pool->cur_threads, pool->cur_threads + 1);
     pool->new_threads++;
     /* If there are threads being created, they will spawn new workers, so
      * we don't spend time creating many threads in a loop holding a mutex or
      * starving the current vcpu.
      *
      * If there are no idle threads, ask the main thread to create one, so we
-     * inherit the correct affinity instead of the vcpu affinity.
+     * inherit the correct affinity instead of the vcpu affinity.  The thread
+     * context, if any, decides the affinity anyway.
      */
     if (!pool->pending_threads) {
         qemu_bh_schedule(pool->new_thread_bh);
@@ -222,9 +311,10 @@ static void thread_pool_cancel(BlockAIOCB *acb)
 
     trace_thread_pool_cancel(elem, elem->common.opaque);
 
-    QEMU_LOCK_GUARD(&pool->lock);
+    QEMU_LOCK_GUARD(&elem->queue->lock);
     if (elem->state == THREAD_QUEUED) {
-        QTAILQ_REMOVE(&pool->request_list, elem, reqs);
+        QTAILQ_REMOVE(&elem->queue->request_list, elem, reqs);
+        qatomic_set(&elem->queue->nr_requests, elem->queue->nr_requests - 1);
         qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
@@ -238,10 +328,50 @@ static const AIOCBInfo thread_pool_aiocb_info = {
     .cancel_async       = thread_pool_cancel,
 };
 
+/*
+ * Wake up or create workers for the requests submitted since the last call.
+ * This is a deferred call, so that a batch of submissions takes pool->lock
+ * at most once, and not at all while every worker is busy.
+ */
+static void thread_pool_kick(void *opaque)
+{
+    ThreadPool *pool = opaque;
+    int n = pool->unkicked;
+    int idle;
+
+    pool->unkicked = 0;
+
+    /*
+     * Write the queues before reading idle_threads.  Pairs with smp_mb() in
+     * worker_thread().
+     */
+    smp_mb();
+
+    if (!qatomic_read(&pool->idle_threads) &&
+        qatomic_read(&pool->cur_threads) >= qatomic_read(&pool->max_threads)) {
+        return; /* busy workers pick up the requests when they are done */
+    }
+
+    QEMU_LOCK_GUARD(&pool->lock);
+    idle = pool->idle_threads;
+    while (idle < n && pool->cur_threads < pool->max_threads) {
+        spawn_thread(pool);
+        n--;
+    }
+    if (n >= idle) {
+        qemu_cond_broadcast(&pool->request_cond);
+    } else {
+        while (n--) {
+            qemu_cond_signal(&pool->request_cond);
+        }
+    }
+}
+
 BlockAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
                                    BlockCompletionFunc *cb, void *opaque)
 {
     ThreadPoolElement *req;
+    ThreadPoolQueue *queue;
     AioContext *ctx = qemu_get_current_aio_context();
     ThreadPool *pool = aio_get_thread_pool(ctx);
 
@@ -258,13 +388,16 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
 
     trace_thread_pool_submit(pool, req, arg);
 
-    qemu_mutex_lock(&pool->lock);
-    if (pool->idle_threads == 0 && pool->cur_threads < pool->max_threads) {
-        spawn_thread(pool);
-    }
-    QTAILQ_INSERT_TAIL(&pool->request_list, req, reqs);
-    qemu_mutex_unlock(&pool->lock);
-    qemu_cond_signal(&pool->request_cond);
+    queue = &pool->queues[pool->next_queue++ % THREAD_POOL_NR_QUEUES];
+    req->queue = queue;
+
+    qemu_mutex_lock(&queue->lock);
+    QTAILQ_INSERT_TAIL(&queue->request_list, req, reqs);
+    qatomic_set(&queue->nr_requests, queue->nr_requests + 1);
+    qemu_mutex_unlock(&queue->lock);
+
+    pool->unkicked++;
+    defer_call(thread_pool_kick, pool);
     return &req->common;
 }
 
@@ -300,7 +433,8 @@ void thread_pool_update_params(ThreadPool *pool, AioContext *ctx)
     qemu_mutex_lock(&pool->lock);
 
     pool->min_threads = ctx->thread_pool_min;
-    pool->max_threads = ctx->thread_pool_max;
+    qatomic_set(&pool->max_threads, ctx->thread_pool_max);
+    pool->thread_context = ctx->thread_pool_context;
 
     /*
      * We either have to:
@@ -337,7 +471,10 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
-    QTAILQ_INIT(&pool->request_list);
+    for (int i = 0; i < THREAD_POOL_NR_QUEUES; i++) {
+        qemu_mutex_init(&pool->queues[i].lock);
+        QTAILQ_INIT(&pool->queues[i].request_list);
+    }
 
     thread_pool_update_params(pool, ctx);
 }
@@ -361,11 +498,11 @@ void thread_pool_free(ThreadPool *pool)
 
     /* Stop new threads from spawning */
     qemu_bh_delete(pool->new_thread_bh);
-    pool->cur_threads -= pool->new_threads;
+    qatomic_set(&pool->cur_threads, pool->cur_threads - pool->new_threads);
     pool->new_threads = 0;
 
     /* Wait for worker threads to terminate */
-    pool->max_threads = 0;
+    qatomic_set(&pool->max_threads, 0);
     qemu_cond_broadcast(&pool->request_cond);
     while (pool->cur_threads > 0) {
         qemu_cond_wait(&pool->worker_stopped, &pool->lock);
@@ -377,5 +514,8 @@ void thread_pool_free(ThreadPool *pool)
     qemu_cond_destroy(&pool->request_cond);
     qemu_cond_destroy(&pool->worker_stopped);
     qemu_mutex_destroy(&pool->lock);
+    for (int i = 0; i < THREAD_POOL_NR_QUEUES; i++) {
+        qemu_mutex_destroy(&pool->queues[i].lock);
+    }
     g_free(pool);
 }
@@ -23,6 +23,7 @@
  */
 
 #include "qemu/osdep.h"
+#include <math.h>
 #include "qapi/error.h"
 #include "qemu/throttle.h"
 #include "qemu/timer.h"
@@ -467,19 +468,46 @@ bool throttle_schedule_timer(ThrottleState *ts,
  * @direction: throttle direction
  * @size:     the size of the operation
  */
+static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
+};
+static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
+};
+
+static void throttle_bucket_add(LeakyBucket *bkt, double amount)
+{
+    bkt->level = MAX(bkt->level + amount, 0);
+    if (bkt->burst_length > 1) {
+        bkt->burst_level = MAX(bkt->burst_level + amount, 0);
+    }
+}
+
+/* Account @units operations and @size bytes; negative values give back */
+static void throttle_do_account(ThrottleState *ts, ThrottleDirection direction,
+                                double units, double size)
+{
+    unsigned i;
+
+    assert(direction < THROTTLE_MAX);
+    for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
+        if (isfinite(size)) {
+            throttle_bucket_add(&ts->cfg.buckets[bucket_types_size[direction][i]],
+                                size);
+        }
+        if (isfinite(units)) {
+            throttle_bucket_add(&ts->cfg.buckets[bucket_types_units[direction][i]],
+                                units);
+        }
+    }
+}
+
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size)
 {
-    static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
-    };
-    static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
-    };
     double units = 1.0;
-    unsigned i;
 
     assert(direction < THROTTLE_MAX);
     /* if cfg.op_size is defined and smaller than size we compute unit count */
@@ -487,23 +515,61 @@ void throttle_account(ThrottleState *ts, ThrottleDirection direction,
         units = (double) size / ts->cfg.op_size;
     }
 
+    throttle_do_account(ts, direction, units, size);
+}
+
+/* Compute how many operations and bytes the limits for @direction allow
+ * in @ns nanoseconds at their average rate.  A dimension without a limit
+ * is reported as INFINITY.
+ */
+void throttle_budget_for(ThrottleState *ts, ThrottleDirection direction,
+                         int64_t ns, double *units, double *size)
+{
+    unsigned i;
+
+    assert(direction < THROTTLE_MAX);
+    *units = *size = INFINITY;
     for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
         LeakyBucket *bkt;
 
         bkt = &ts->cfg.buckets[bucket_types_size[direction][i]];
-        bkt->level += size;
-        if (bkt->burst_length > 1) {
-            bkt->burst_level += size;
+        if (bkt->avg) {
+            *size = MIN(*size, (double) bkt->avg * ns / NANOSECONDS_PER_SECOND);
         }
-
         bkt = &ts->cfg.buckets[bucket_types_units[direction][i]];
-        bkt->level += units;
-        if (bkt->burst_length > 1) {
-            bkt->burst_level += units;
+        if (bkt->avg) {
+            *units = MIN(*units,
+                         (double) bkt->avg * ns / NANOSECONDS_PER_SECOND);
         }
     }
 }
 
+/* Account @units operations and @size bytes ahead of time, unless that
+ * would make the next request wait.  Dimensions given as INFINITY are not
+ * accounted.
+ *
+ * @now: the current clock timestamp
+ * @ret: whether the budget was reserved
+ */
+bool throttle_reserve(ThrottleState *ts, ThrottleDirection direction,
+                      int64_t now, double units, double size)
+{
+    throttle_do_leak(ts, now);
+    throttle_do_account(ts, direction, units, size);
+    if (throttle_compute_wait_for(ts, direction)) {
+        throttle_do_account(ts, direction, -units, -size);
+        return false;
+    }
+    return true;
+}
+
+/* Give back budget that throttle_reserve() accounted but was not used */
+void throttle_unreserve(ThrottleState *ts, ThrottleDirection direction,
+                        double units, double size)
+{
+    throttle_do_account(ts, direction, -units, -size);
+}
+
 /* return a ThrottleConfig based on the options in a ThrottleLimits
  *
  * @arg:    the ThrottleLimits object to read from
@@ -44,6 +44,14 @@
  * dev->broken flag. Both vu_client_trip() and kick fd processing stop when
  * the dev->broken flag is set.
  *
+ * The kick fds of each virtqueue can be handled in an AioContext of their own,
+ * see vhost_user_server_set_vq_aio_contexts().  libvhost-user is not
+ * thread-safe, therefore virtqueue i is then only touched with vq_lock[i]
+ * held.  vu_client_trip() takes all of them after receiving a message and
+ * releases them after processing it, so that messages never race with
+ * virtqueue processing.  Watches removed while another thread may still be
+ * dispatching their kick are flagged and freed by a BH in that thread.
+ *
  * It is possible to switch AioContexts using
  * vhost_user_server_detach_aio_context() and
  * vhost_user_server_attach_aio_context(). They stop monitoring fds in the old
@@ -75,6 +83,60 @@ static void panic_cb(VuDev *vu_dev, const char *buf)
     error_report("vu_panic: %s", buf);
 }
 
+/*
+ * Takes ownership of @vq_ctx, which has an entry for each of the server's
+ * max_queues virtqueues.  Must be called before a client connects.
+ */
+void vhost_user_server_set_vq_aio_contexts(VuServer *server,
+                                           AioContext **vq_ctx)
+{
+    assert(!server->sioc && !server->vq_ctx);
+
+    server->vq_ctx = vq_ctx;
+    server->vq_lock = g_new(QemuRecMutex, server->max_queues);
+    for (int i = 0; i < server->max_queues; i++) {
+        qemu_rec_mutex_init(&server->vq_lock[i]);
+    }
+}
+
+void vhost_user_server_vq_lock(VuServer *server, int idx)
+{
+    if (server->vq_ctx) {
+        qemu_rec_mutex_lock(&server->vq_lock[idx]);
+    }
+}
+
+void vhost_user_server_vq_unlock(VuServer *server, int idx)
+{
+    if (server->vq_ctx) {
+        qemu_rec_mutex_unlock(&server->vq_lock[idx]);
+    }
+}
+
+static void vu_lock_all_vqs(VuServer *server)
+{
+    for (int i = 0; server->vq_ctx && i < server->max_queues; i++) {
+        qemu_rec_mutex_lock(&server->vq_lock[i]);
+    }
+}
+
+static void vu_unlock_all_vqs(VuServer *server)
+{
+    for (int i = 0; server->vq_ctx && i < server->max_queues; i++) {
+        qemu_rec_mutex_unlock(&server->vq_lock[i]);
+    }
+}
+
+/* The AioContext in which the kick fd of @vu_fd_watch is monitored */
+static AioContext *vu_fd_watch_ctx(VuServer *server, VuFdWatch *vu_fd_watch)
+{
+    if (server->vq_ctx) {
+        /* libvhost-user only watches kick fds, pvt is the virtqueue index */
+        return server->vq_ctx[(intptr_t)vu_fd_watch->pvt];
+    }
+    return server->ctx;
+}
+
 void vhost_user_server_inc_in_flight(VuServer *server)
 {
     assert(!server->wait_idle);
@@ -165,6 +227,16 @@ vu_message_read(VuDev *vu_dev, int conn_fd, VhostUserMsg *vmsg)
 
     /* qio_channel_readv_full will make socket fds blocking, unblock them */
     vmsg_unblock_fds(vmsg);
+
+    /*
+     * Stop virtqueue processing in other threads until vu_client_trip() is
+     * done with the message.  Nested reads, e.g. for postcopy acks, already
+     * hold the locks.
+     */
+    if (server->vq_ctx && !server->vq_locked) {
+        vu_lock_all_vqs(server);
+        server->vq_locked = true;
+    }
     if (vmsg->size > sizeof(vmsg->payload)) {
         error_report("Error: too big message request: %d, "
                      "size: vmsg->size: %u, "
@@ -207,20 +279,33 @@ static coroutine_fn void vu_client_trip(void *opaque)
             return;
         }
         /* vu_dispatch() returns false if server->ctx went away */
-        if (!vu_dispatch(vu_dev) && server->ctx) {
+        bool ok = vu_dispatch(vu_dev);
+
+        if (server->vq_locked) {
+            server->vq_locked = false;
+            vu_unlock_all_vqs(server);
+        }
+        if (!ok && server->ctx) {
             break;
         }
     }
 
     if (vhost_user_server_has_in_flight(server)) {
-        /* Wait for requests to complete before we can unmap the memory */
+        /*
+         * Wait for requests to complete before we can unmap the memory.
+         * Kicks handled in other threads check wait_idle under their lock.
+         */
+        vu_lock_all_vqs(server);
         server->wait_idle = true;
+        vu_unlock_all_vqs(server);
         qemu_coroutine_yield();
         server->wait_idle = false;
     }
     assert(!vhost_user_server_has_in_flight(server));
 
+    vu_lock_all_vqs(server);
     vu_deinit(vu_dev);
+    vu_unlock_all_vqs(server);
 
     /* vu_deinit() should have called remove_watch() */
     assert(QTAILQ_EMPTY(&server->vu_fd_watches));
@@ -249,13 +334,31 @@ static void kick_handler(void *opaque)
 {
     VuFdWatch *vu_fd_watch = opaque;
     VuDev *vu_dev = vu_fd_watch->vu_dev;
+    VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+
+    if (server->vq_ctx) {
+        int idx = (intptr_t)vu_fd_watch->pvt;
+        bool broken;
+
+        qemu_rec_mutex_lock(&server->vq_lock[idx]);
+        if (vu_fd_watch->removed || server->wait_idle) {
+            qemu_rec_mutex_unlock(&server->vq_lock[idx]);
+            return;
+        }
+        vu_fd_watch->cb(vu_dev, 0, vu_fd_watch->pvt);
+        broken = vu_dev->broken;
+        qemu_rec_mutex_unlock(&server->vq_lock[idx]);
+
+        if (broken) {
+            qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+        }
+        return;
+    }
 
     vu_fd_watch->cb(vu_dev, 0, vu_fd_watch->pvt);
 
     /* Stop vu_client_trip() if an error occurred in vu_fd_watch->cb() */
     if (vu_dev->broken) {
-        VuServer *server = container_of(vu_dev, VuServer, vu_dev);
-
         qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
     }
 }
@@ -291,11 +394,11 @@ set_watch(VuDev *vu_dev, int fd, int vu_evt,
 
         vu_fd_watch->fd = fd;
         vu_fd_watch->cb = cb;
-        qemu_socket_set_nonblock(fd);
-        aio_set_fd_handler(server->ctx, fd, kick_handler,
-                           NULL, NULL, NULL, vu_fd_watch);
         vu_fd_watch->vu_dev = vu_dev;
         vu_fd_watch->pvt = pvt;
+        qemu_socket_set_nonblock(fd);
+        aio_set_fd_handler(vu_fd_watch_ctx(server, vu_fd_watch), fd,
+                           kick_handler, NULL, NULL, NULL, vu_fd_watch);
     }
 }
 
@@ -313,10 +416,18 @@ static void remove_watch(VuDev *vu_dev, int fd)
     if (!vu_fd_watch) {
         return;
     }
-    aio_set_fd_handler(server->ctx, fd, NULL, NULL, NULL, NULL, NULL);
+    aio_set_fd_handler(vu_fd_watch_ctx(server, vu_fd_watch), fd,
+                       NULL, NULL, NULL, NULL, NULL);
 
     QTAILQ_REMOVE(&server->vu_fd_watches, vu_fd_watch, next);
-    g_free(vu_fd_watch);
+    if (server->vq_ctx) {
+        /* kick_handler() may be waiting for the vq lock in its thread */
+        vu_fd_watch->removed = true;
+        aio_bh_schedule_oneshot(vu_fd_watch_ctx(server, vu_fd_watch),
+                                g_free, vu_fd_watch);
+    } else {
+        g_free(vu_fd_watch);
+    }
 }
 
 
@@ -372,10 +483,13 @@ void vhost_user_server_stop(VuServer *server)
     if (server->sioc) {
         VuFdWatch *vu_fd_watch;
 
+        vu_lock_all_vqs(server);
         QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-            aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
+            aio_set_fd_handler(vu_fd_watch_ctx(server, vu_fd_watch),
+                               vu_fd_watch->fd,
                                NULL, NULL, NULL, NULL, vu_fd_watch);
         }
+        vu_unlock_all_vqs(server);
 
         qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
 
@@ -386,6 +500,16 @@ void vhost_user_server_stop(VuServer *server)
         qio_net_listener_disconnect(server->listener);
         object_unref(OBJECT(server->listener));
     }
+
+    if (server->vq_ctx) {
+        for (int i = 0; i < server->max_queues; i++) {
+            qemu_rec_mutex_destroy(&server->vq_lock[i]);
+        }
+        g_free(server->vq_lock);
+        server->vq_lock = NULL;
+        g_free(server->vq_ctx);
+        server->vq_ctx = NULL;
+    }
 }
 
 /*
@@ -411,10 +535,13 @@ void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx)
         return;
     }
 
+    vu_lock_all_vqs(server);
     QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-        aio_set_fd_handler(ctx, vu_fd_watch->fd, kick_handler, NULL,
+        aio_set_fd_handler(vu_fd_watch_ctx(server, vu_fd_watch),
+                           vu_fd_watch->fd, kick_handler, NULL,
                            NULL, NULL, vu_fd_watch);
     }
+    vu_unlock_all_vqs(server);
 
     if (server->co_trip) {
         /*
@@ -443,10 +570,13 @@ void vhost_user_server_detach_aio_context(VuServer *server)
     if (server->sioc) {
         VuFdWatch *vu_fd_watch;
 
+        vu_lock_all_vqs(server);
         QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-            aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
+            aio_set_fd_handler(vu_fd_watch_ctx(server, vu_fd_watch),
+                               vu_fd_watch->fd,
                                NULL, NULL, NULL, NULL, vu_fd_watch);
         }
+        vu_unlock_all_vqs(server);
     }
 
     server->ctx = NULL;